@@ -118,10 +118,12 @@
 #endif
 
 /**
- * The life-time of invalid DNS response in the resolver response cache.
- * An invalid DNS response is a response which RCODE is non-zero and 
- * response without any answer section. These responses can be put in 
- * the cache too to minimize message round-trip.
+ * The maximum life-time of negative DNS response in the resolver response
+ * cache. A negative DNS response is a NXDOMAIN response or a response
+ * without any answer section. These responses can be put in the cache
+ * too to minimize message round-trip. When the response carries an SOA
+ * record in the authority section, the negative TTL of the SOA (RFC 2308)
+ * is used if it is lower than this value.
  *
  * Default: 60 (one minute).
  *
@@ -131,6 +133,79 @@
 #   define PJ_DNS_RESOLVER_INVALID_TTL              60
 #endif
 
+
+/**
+ * The life-time of SERVFAIL and other error responses (other than
+ * NXDOMAIN) in the resolver response cache. This is kept short, so that
+ * a nameserver that is recovering is queried again soon, while a burst
+ * of queries to a failing name does not hit the nameserver repeatedly.
+ * If the value is zero, error responses won't be cached.
+ *
+ * Default: 5 seconds
+ */
+#ifndef PJ_DNS_RESOLVER_SERVFAIL_TTL
+#   define PJ_DNS_RESOLVER_SERVFAIL_TTL             5
+#endif
+
+
+/**
+ * Refresh-ahead threshold of the resolver response cache, in percent of
+ * the TTL of the cached response. When a cached response that has been
+ * used at least #PJ_DNS_RESOLVER_PREFETCH_MIN_HITS times is picked up with
+ * less than this percentage of its TTL remaining, the resolver serves the
+ * cached response and sends a background query to refresh the entry, so
+ * that subsequent queries do not stall when the entry expires. If the
+ * value is zero, prefetching will be disabled.
+ *
+ * Default: 10 (percent)
+ */
+#ifndef PJ_DNS_RESOLVER_PREFETCH_PCT
+#   define PJ_DNS_RESOLVER_PREFETCH_PCT             10
+#endif
+
+
+/**
+ * The minimum number of cache hits before a cached response is considered
+ * popular enough to be refreshed ahead of its expiry.
+ *
+ * Default: 2
+ *
+ * @see PJ_DNS_RESOLVER_PREFETCH_PCT
+ */
+#ifndef PJ_DNS_RESOLVER_PREFETCH_MIN_HITS
+#   define PJ_DNS_RESOLVER_PREFETCH_MIN_HITS        2
+#endif
+
+
+/**
+ * Enable support for memory mapped response cache file that can be shared
+ * by several processes on the same host, and which survives restarts.
+ * See #pj_dns_resolver_set_shared_cache(). This requires POSIX mmap() and
+ * GCC style atomic builtins.
+ *
+ * Default: enabled on Linux and macOS
+ */
+#ifndef PJ_DNS_RESOLVER_HAS_SHARED_CACHE
+#   if (defined(PJ_LINUX) && PJ_LINUX!=0) || \
+       (defined(PJ_DARWINOS) && PJ_DARWINOS!=0)
+#       define PJ_DNS_RESOLVER_HAS_SHARED_CACHE     1
+#   else
+#       define PJ_DNS_RESOLVER_HAS_SHARED_CACHE     0
+#   endif
+#endif
+
+
+/**
+ * Default number of entries in the shared response cache file, when
+ * it is created by #pj_dns_resolver_set_shared_cache(). Each entry
+ * occupies about PJ_DNS_RESOLVER_MAX_UDP_SIZE + PJ_MAX_HOSTNAME bytes.
+ *
+ * Default: 1024
+ */
+#ifndef PJ_DNS_RESOLVER_SHARED_CACHE_SIZE
+#   define PJ_DNS_RESOLVER_SHARED_CACHE_SIZE        1024
+#endif
+
 /**
  * The interval on which nameservers which are known to be good to be 
  * probed again to determine whether they are still good. Note that
@@ -210,6 +285,30 @@
 #endif
 
 
+/**
+ * Enable SSE4.2 and AVX2 fast paths for scanning runs of characters that
+ * belong (or don't belong) to a character input specification, such as
+ * tokens and header values in the SIP parser. The byte loop is used by
+ * default. Application may select a fast path with pj_scan_set_impl(),
+ * which checks that the CPU supports it, so no special compiler flags are
+ * needed. This requires #PJ_SCANNER_USE_BITWISE.
+ *
+ * Default: 1 on x86 and x86-64 with GCC, Clang or MSVC, otherwise 0.
+ */
+#ifndef PJ_SCANNER_HAS_SIMD
+#   if PJ_SCANNER_USE_BITWISE && \
+       (defined(__i386__) || defined(__x86_64__) || \
+        defined(_M_IX86) || defined(_M_X64)) && \
+       (defined(__clang__) || defined(_MSC_VER) || \
+        (defined(__GNUC__) && (__GNUC__ > 4 || \
+                               (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#       define PJ_SCANNER_HAS_SIMD                  1
+#   else
+#       define PJ_SCANNER_HAS_SIMD                  0
+#   endif
+#endif
+
+
 
 /* **************************************************************************
  * STUN CLIENT CONFIGURATION
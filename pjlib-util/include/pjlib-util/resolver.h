@@ -68,6 +68,16 @@ PJ_BEGIN_DECL
  * Response caching can be  disabled by setting the maximum TTL value of the 
  * resolver to zero.
  *
+ * Negative responses are cached too: NXDOMAIN and empty answers for the
+ * negative TTL advertised in the SOA record of the response (RFC 2308),
+ * and SERVFAIL and other errors for a short, separately configured TTL.
+ *
+ * Cached responses that are used often are refreshed in the background
+ * shortly before they expire, so that queries for popular names keep being
+ * answered from the cache. Optionally, the cache can be backed by a memory
+ * mapped file that is shared by several processes on the host (see
+ * #pj_dns_resolver_set_shared_cache()).
+ *
  * \subsection PJ_DNS_RESOLVER_FEATURES_PARALLEL Parallel and Backup Name Servers
  *
  * When the resolver is configured with multiple nameservers, initially the
@@ -154,6 +164,8 @@ PJ_BEGIN_DECL
  *  - <A HREF="http://www.faqs.org/rfcs/rfc2782.html">
  *    RFC 2782: "A DNS RR for specifying the location of services (DNS SRV)"
  *    </A>
+ *  - <A HREF="http://www.faqs.org/rfcs/rfc2308.html">
+ *    RFC 2308: "Negative Caching of DNS Queries (DNS NCACHE)"</A>
  */
 
 
@@ -195,6 +207,10 @@ typedef struct pj_dns_settings
                                      value is zero, caching is disabled.    */
     unsigned    good_ns_ttl;    /**< See #PJ_DNS_RESOLVER_GOOD_NS_TTL       */
     unsigned    bad_ns_ttl;     /**< See #PJ_DNS_RESOLVER_BAD_NS_TTL        */
+    unsigned    cache_neg_ttl;  /**< See #PJ_DNS_RESOLVER_INVALID_TTL       */
+    unsigned    cache_servfail_ttl; /**< See #PJ_DNS_RESOLVER_SERVFAIL_TTL  */
+    unsigned    prefetch_pct;   /**< See #PJ_DNS_RESOLVER_PREFETCH_PCT      */
+    unsigned    prefetch_min_hits;/**< See #PJ_DNS_RESOLVER_PREFETCH_MIN_HITS*/
 } pj_dns_settings;
 
 
@@ -483,6 +499,36 @@ PJ_DECL(pj_status_t) pj_dns_resolver_add_entry(pj_dns_resolver *resolver,
                                                const pj_dns_parsed_packet *pkt,
                                                pj_bool_t set_ttl);
 
+/**
+ * Attach a memory mapped response cache file to the resolver. Responses
+ * received from the nameservers are also written to this file, and
+ * queries that miss the resolver's own cache are looked up in the file
+ * before a query is sent to the nameservers. Several resolver instances,
+ * in the same or in different processes on the host, may share the same
+ * file, and the entries survive application restarts since expiration is
+ * recorded in wall clock time.
+ *
+ * The file is a direct mapped table: an entry whose slot is taken by a
+ * different name simply replaces it. Entries injected with
+ * #pj_dns_resolver_add_entry() are not written to the file.
+ *
+ * This function is only available when #PJ_DNS_RESOLVER_HAS_SHARED_CACHE
+ * is enabled, otherwise it will return PJ_ENOTSUP.
+ *
+ * @param resolver  The resolver instance.
+ * @param path      Path of the cache file. It will be created if it
+ *                  doesn't exist. Specify NULL to detach the current
+ *                  cache file from the resolver.
+ * @param slot_cnt  Number of entries when the file is created, or zero
+ *                  to use #PJ_DNS_RESOLVER_SHARED_CACHE_SIZE. An existing
+ *                  file keeps its own number of entries.
+ *
+ * @return          PJ_SUCCESS on success, or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_dns_resolver_set_shared_cache(pj_dns_resolver *resolver,
+                                                      const char *path,
+                                                      unsigned slot_cnt);
+
 /**
  * Get the total number of response in the response cache.
  *
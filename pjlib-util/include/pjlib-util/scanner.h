@@ -182,6 +182,10 @@ struct pj_scanner;
  * The callback function type to be called by the scanner when it encounters
  * syntax error.
  *
+ * The callback normally throws an exception. If it returns instead, the
+ * scanner function returns immediately, and the output string of the
+ * function (if any) is set to an empty string.
+ *
  * @param scanner       The scanner instance that calls the callback .
  */
 typedef void (*pj_syn_err_func_ptr)(struct pj_scanner *scanner);
@@ -530,6 +534,59 @@ PJ_DECL(void) pj_scan_save_state( const pj_scanner *scanner,
 PJ_DECL(void) pj_scan_restore_state( pj_scanner *scanner, 
                                      pj_scan_state *state);
 
+/**
+ * Implementations of the character class scanning loops.
+ */
+typedef enum pj_scan_impl
+{
+    /**
+     * Select the default implementation, which is currently the byte
+     * loop. The SIMD implementations do not parse typical SIP messages
+     * faster, since most tokens are short.
+     */
+    PJ_SCAN_IMPL_AUTO,
+
+    /**
+     * Byte at a time loop.
+     */
+    PJ_SCAN_IMPL_SCALAR,
+
+    /**
+     * SSE4.2 implementation, scanning 16 characters at a time.
+     */
+    PJ_SCAN_IMPL_SSE42,
+
+    /**
+     * AVX2 implementation, scanning 32 characters at a time.
+     */
+    PJ_SCAN_IMPL_AVX2
+
+} pj_scan_impl;
+
+/**
+ * Select the implementation of the character class scanning loops used
+ * by pj_scan_get(), pj_scan_get_until() and friends. The SIMD
+ * implementations are only used when selected here, e.g. for input with
+ * long tokens or lines, or for testing and benchmarking. See
+ * #PJ_SCANNER_HAS_SIMD.
+ *
+ * @param impl      The implementation.
+ *
+ * @return          PJ_SUCCESS on success, or PJ_ENOTSUP if the
+ *                  implementation is not available in this build or
+ *                  is not supported by the CPU.
+ */
+PJ_DECL(pj_status_t) pj_scan_set_impl(pj_scan_impl impl);
+
+/**
+ * Get the implementation of the character class scanning loops that is
+ * currently in use.
+ *
+ * @return          The implementation.
+ */
+PJ_DECL(pj_scan_impl) pj_scan_get_impl(void);
+
+
 /**
  * Get current column position.
  *
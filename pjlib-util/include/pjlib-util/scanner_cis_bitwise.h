@@ -50,6 +50,13 @@ typedef struct pj_cis_buf_t
 {
     pj_cis_elem_t    cis_buf[256];  /**< Must be 256 (not 128)! */
     pj_cis_elem_t    use_mask;      /**< To keep used indexes.  */
+#if PJ_SCANNER_HAS_SIMD
+    /** Nibble lookup table of each specification for the SIMD scanner.
+     *  Entry [id][lo] has bit hi set if character (hi<<4 | lo) is in the
+     *  specification, for 7bit characters only.
+     */
+    pj_uint8_t       simd_tbl[PJ_CIS_MAX_INDEX][16];
+#endif
 } pj_cis_buf_t;
 
 /**
@@ -65,6 +72,9 @@ typedef struct pj_cis_t
 /**
  * Set the membership of the specified character.
  * Note that this is a macro, and arguments may be evaluated more than once.
+ * Application should use the pj_cis_add_*() and pj_cis_del_*() functions
+ * instead, since this macro doesn't update the lookup table used by the
+ * SIMD scanner.
  *
  * @param cis       Pointer to character input specification.
  * @param c         The character.
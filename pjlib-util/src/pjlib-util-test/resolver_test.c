@@ -243,6 +243,18 @@ static int print_rr(pj_uint8_t *pkt, int size, pj_uint8_t *pos,
         p += (len + 8);
         size -= (len + 8);
 
+    } else if (rr->type == PJ_DNS_TYPE_SOA) {
+
+        /* Raw rdata */
+        if (size < rr->rdlength + 2)
+            return -1;
+
+        write16(p, rr->rdlength);
+        pj_memcpy(p+2, rr->data, rr->rdlength);
+
+        p += (rr->rdlength + 2);
+        size -= (rr->rdlength + 2);
+
     } else {
         pj_assert(!"Not supported");
         return -1;
@@ -1890,6 +1902,234 @@ static int srv_resolver_many_test(void)
 }
 
 
+////////////////////////////////////////////////////////////////////////////
+/* Negative caching, prefetch, and shared cache file test */
+#define IP_ADDR4        0x04050607
+#define SHARED_CACHE    "dnscache.tmp"
+
+static pj_status_t cache_cb_status;
+static pj_bool_t cache_cb_called;
+
+static void action4_1(const pj_dns_parsed_packet *pkt,
+                      pj_dns_parsed_packet **p_res)
+{
+    /* SOA with TTL 60 and MINIMUM 1, the negative TTL is the lower one */
+    static pj_uint8_t soa[22] = { 0, 0, 0,0,0,1, 0,0,0,1, 0,0,0,1,
+                                  0,0,0,1, 0,0,0,1 };
+    pj_dns_parsed_packet *res;
+
+    res = PJ_POOL_ZALLOC_T(pool, pj_dns_parsed_packet);
+    res->q = PJ_POOL_ZALLOC_T(pool, pj_dns_parsed_query);
+    res->ans = PJ_POOL_ZALLOC_T(pool, pj_dns_parsed_rr);
+    res->ns = PJ_POOL_ZALLOC_T(pool, pj_dns_parsed_rr);
+
+    res->hdr.qdcount = 1;
+    res->q[0].type = pkt->q[0].type;
+    res->q[0].dnsclass = pkt->q[0].dnsclass;
+    res->q[0].name = pkt->q[0].name;
+
+    if (pj_strncmp2(&pkt->q[0].name, "nx", 2)==0) {
+        res->hdr.flags = PJ_DNS_SET_RCODE(PJ_DNS_RCODE_NXDOMAIN);
+        res->hdr.nscount = 1;
+        res->ns[0].type = PJ_DNS_TYPE_SOA;
+        res->ns[0].dnsclass = 1;
+        res->ns[0].ttl = 60;
+        res->ns[0].name = pj_str("somedomain.com");
+        res->ns[0].rdlength = sizeof(soa);
+        res->ns[0].data = soa;
+    } else {
+        res->hdr.anscount = 1;
+        res->ans[0].type = PJ_DNS_TYPE_A;
+        res->ans[0].dnsclass = 1;
+        res->ans[0].ttl = 2;
+        res->ans[0].name = res->q[0].name;
+        res->ans[0].rdata.a.ip_addr.s_addr = IP_ADDR4;
+    }
+
+    *p_res = res;
+}
+
+static void cache_cb(void *user_data,
+                     pj_status_t status,
+                     pj_dns_parsed_packet *resp)
+{
+    PJ_UNUSED_ARG(user_data);
+    PJ_UNUSED_ARG(resp);
+
+    cache_cb_status = status;
+    cache_cb_called = PJ_TRUE;
+    pj_sem_post(sem);
+}
+
+/* Query A record of the name, and return PJ_TRUE if the response is
+ * served from the cache (i.e. the callback is called synchronously).
+ */
+static pj_bool_t cache_query(pj_dns_resolver *resv, const char *name,
+                             pj_status_t *cb_status)
+{
+    pj_str_t n = pj_str((char*)name);
+    pj_bool_t from_cache;
+    pj_status_t status;
+
+    cache_cb_called = PJ_FALSE;
+    status = pj_dns_resolver_start_query(resv, &n, PJ_DNS_TYPE_A, 0,
+                                         &cache_cb, NULL, NULL);
+    if (status != PJ_SUCCESS) {
+        *cb_status = status;
+        return PJ_FALSE;
+    }
+    from_cache = cache_cb_called;
+
+    pj_sem_wait(sem);
+    *cb_status = cache_cb_status;
+
+    /* The cache is updated after the callback returns */
+    if (!from_cache)
+        pj_thread_sleep(100);
+
+    return from_cache;
+}
+
+static int cache_test(void)
+{
+    pj_dns_resolver *resv2;
+    pj_dns_settings st;
+    pj_status_t status;
+    int rc = 0;
+
+    pj_dns_resolver_get_settings(resolver, &st);
+    st.cache_servfail_ttl = 1;
+    st.prefetch_pct = 50;
+    st.prefetch_min_hits = 2;
+    pj_dns_resolver_set_settings(resolver, &st);
+
+    g_server[0].action = ACTION_CB;
+    g_server[0].action_cb = &action4_1;
+    g_server[1].action = ACTION_CB;
+    g_server[1].action_cb = &action4_1;
+
+    PJ_LOG(3,(THIS_FILE, "  NXDOMAIN negative TTL from SOA"));
+    if (cache_query(resolver, "nx.somedomain.com", &status) ||
+        status != PJLIB_UTIL_EDNS_NXDOMAIN)
+    {
+        rc = -1100; goto on_return;
+    }
+    if (!cache_query(resolver, "nx.somedomain.com", &status) ||
+        status != PJLIB_UTIL_EDNS_NXDOMAIN)
+    {
+        rc = -1110; goto on_return;
+    }
+    pj_thread_sleep(1500);
+    if (cache_query(resolver, "nx.somedomain.com", &status)) {
+        rc = -1120; goto on_return;
+    }
+
+    PJ_LOG(3,(THIS_FILE, "  SERVFAIL caching"));
+    g_server[0].action = PJ_DNS_RCODE_SERVFAIL;
+    g_server[1].action = PJ_DNS_RCODE_SERVFAIL;
+    if (cache_query(resolver, "servfail.somedomain.com", &status) ||
+        status != PJLIB_UTIL_EDNS_SERVFAIL)
+    {
+        rc = -1130; goto on_return;
+    }
+    if (!cache_query(resolver, "servfail.somedomain.com", &status) ||
+        status != PJLIB_UTIL_EDNS_SERVFAIL)
+    {
+        rc = -1140; goto on_return;
+    }
+    pj_thread_sleep(1500);
+    if (cache_query(resolver, "servfail.somedomain.com", &status)) {
+        rc = -1150; goto on_return;
+    }
+
+    PJ_LOG(3,(THIS_FILE, "  prefetch of popular entry"));
+    g_server[0].action = ACTION_CB;
+    g_server[1].action = ACTION_CB;
+    if (cache_query(resolver, "hot.somedomain.com", &status) ||
+        status != PJ_SUCCESS)
+    {
+        rc = -1160; goto on_return;
+    }
+
+    /* Popular, but not close to expiry yet */
+    g_server[0].pkt_count = 0;
+    g_server[1].pkt_count = 0;
+    if (!cache_query(resolver, "hot.somedomain.com", &status) ||
+        !cache_query(resolver, "hot.somedomain.com", &status))
+    {
+        rc = -1170; goto on_return;
+    }
+    pj_thread_sleep(300);
+    if (g_server[0].pkt_count + g_server[1].pkt_count != 0) {
+        rc = -1180; goto on_return;
+    }
+
+    /* Less than half of the TTL remains: served from the cache, and
+     * refreshed in the background.
+     */
+    pj_thread_sleep(1000);
+    if (!cache_query(resolver, "hot.somedomain.com", &status) ||
+        status != PJ_SUCCESS)
+    {
+        rc = -1190; goto on_return;
+    }
+    pj_thread_sleep(300);
+    if (g_server[0].pkt_count + g_server[1].pkt_count == 0) {
+        rc = -1200; goto on_return;
+    }
+
+    /* The original entry has expired by now */
+    pj_thread_sleep(600);
+    if (!cache_query(resolver, "hot.somedomain.com", &status) ||
+        status != PJ_SUCCESS)
+    {
+        rc = -1210; goto on_return;
+    }
+
+#if PJ_DNS_RESOLVER_HAS_SHARED_CACHE
+    PJ_LOG(3,(THIS_FILE, "  shared cache file"));
+    pj_file_delete(SHARED_CACHE);
+
+    status = pj_dns_resolver_set_shared_cache(resolver, SHARED_CACHE, 64);
+    if (status != PJ_SUCCESS) {
+        rc = -1220; goto on_return;
+    }
+
+    if (cache_query(resolver, "shared.somedomain.com", &status) ||
+        status != PJ_SUCCESS)
+    {
+        rc = -1230; goto on_return;
+    }
+
+    /* Another resolver, without any nameserver, finds it in the file */
+    status = pj_dns_resolver_create(mem, "resolver2", 0, timer_heap, ioqueue,
+                                    &resv2);
+    if (status != PJ_SUCCESS) {
+        rc = -1240; goto on_return;
+    }
+
+    status = pj_dns_resolver_set_shared_cache(resv2, SHARED_CACHE, 0);
+    if (status != PJ_SUCCESS) {
+        rc = -1250;
+    } else if (!cache_query(resv2, "shared.somedomain.com", &status) ||
+               status != PJ_SUCCESS)
+    {
+        rc = -1260;
+    }
+
+    pj_dns_resolver_destroy(resv2, PJ_FALSE);
+    pj_dns_resolver_set_shared_cache(resolver, NULL, 0);
+    pj_file_delete(SHARED_CACHE);
+#else
+    PJ_UNUSED_ARG(resv2);
+#endif
+
+on_return:
+    pj_dns_resolver_set_settings(resolver, &set);
+    return rc;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////
 
 
@@ -1917,6 +2157,10 @@ int resolver_test(void)
     if (rc != 0)
         goto on_error;
 
+    rc = cache_test();
+    if (rc != 0)
+        goto on_error;
+
     rc = srv_resolver_test();
     if (rc != 0)
         goto on_error;
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#define THIS_FILE       "scanner_test.c"
+
+#if INCLUDE_SCANNER_TEST
+
+#include <pjlib-util/scanner.h>
+#include <pj/log.h>
+#include <pj/rand.h>
+#include <pj/string.h>
+
+/*
+ * Compare the character class scanning of each scanner implementation
+ * with the byte loop implementation, on random input.
+ */
+
+#define MAX_LEN     200
+#define ROUNDS      2000
+
+enum { SPEC_TOKEN, SPEC_NOT_NEWLINE, SPEC_DIGIT, SPEC_HIGH, SPEC_CNT };
+
+static pj_cis_buf_t cis_buf;
+static pj_cis_t spec[SPEC_CNT];
+
+static void on_syntax_error(pj_scanner *scanner)
+{
+    PJ_UNUSED_ARG(scanner);
+}
+
+static void init_specs(void)
+{
+    pj_cis_buf_init(&cis_buf);
+
+    pj_cis_init(&cis_buf, &spec[SPEC_TOKEN]);
+    pj_cis_add_alpha(&spec[SPEC_TOKEN]);
+    pj_cis_add_num(&spec[SPEC_TOKEN]);
+    pj_cis_add_str(&spec[SPEC_TOKEN], "-.!%*_`'~+");
+
+    pj_cis_init(&cis_buf, &spec[SPEC_NOT_NEWLINE]);
+    pj_cis_add_range(&spec[SPEC_NOT_NEWLINE], 1, 256);
+    pj_cis_del_str(&spec[SPEC_NOT_NEWLINE], "\r\n");
+
+    pj_cis_init(&cis_buf, &spec[SPEC_DIGIT]);
+    pj_cis_add_num(&spec[SPEC_DIGIT]);
+
+    /* Characters above 127 are handled outside the vector loop */
+    pj_cis_init(&cis_buf, &spec[SPEC_HIGH]);
+    pj_cis_add_alpha(&spec[SPEC_HIGH]);
+    pj_cis_add_range(&spec[SPEC_HIGH], 0xC0, 0x100);
+}
+
+/* Random input, mostly members of the spec so that runs are long */
+static void fill_random(char *buf, unsigned len, const pj_cis_t *cis)
+{
+    unsigned i;
+
+    for (i=0; i<len; ++i) {
+        int c;
+
+        do {
+            c = (pj_rand() & 0xFF);
+        } while (c == 0 ||
+                 ((pj_rand() % 16) != 0 && !pj_cis_match(cis, (pj_uint8_t)c)));
+        buf[i] = (char)c;
+    }
+    buf[len] = '\0';
+}
+
+static int scan_all(char *buf, unsigned len, const pj_cis_t *cis,
+                    int *result, unsigned max_result)
+{
+    pj_scanner scanner;
+    pj_str_t out;
+    unsigned n = 0;
+
+    pj_scan_init(&scanner, buf, len, 0, &on_syntax_error);
+    while (!pj_scan_is_eof(&scanner) && n+2 <= max_result) {
+        pj_scan_peek(&scanner, cis, &out);
+        result[n++] = (int)out.slen;
+        pj_scan_peek_until(&scanner, cis, &out);
+        result[n++] = (int)out.slen;
+        pj_scan_advance_n(&scanner, 1, PJ_FALSE);
+    }
+    pj_scan_fini(&scanner);
+
+    return n;
+}
+
+static int compare_impl(pj_scan_impl impl, const char *name)
+{
+    char buf[MAX_LEN+1];
+    int ref[MAX_LEN*2], res[MAX_LEN*2];
+    unsigned round;
+
+    if (pj_scan_set_impl(impl) != PJ_SUCCESS) {
+        PJ_LOG(3,(THIS_FILE, "  %s: not supported, skipped", name));
+        return 0;
+    }
+
+    PJ_LOG(3,(THIS_FILE, "  %s..", name));
+
+    for (round=0; round<ROUNDS; ++round) {
+        const pj_cis_t *cis = &spec[round % SPEC_CNT];
+        unsigned len = pj_rand() % MAX_LEN;
+        int n_ref, n_res;
+
+        fill_random(buf, len, cis);
+
+        pj_scan_set_impl(PJ_SCAN_IMPL_SCALAR);
+        n_ref = scan_all(buf, len, cis, ref, PJ_ARRAY_SIZE(ref));
+
+        pj_scan_set_impl(impl);
+        n_res = scan_all(buf, len, cis, res, PJ_ARRAY_SIZE(res));
+
+        if (n_ref != n_res ||
+            pj_memcmp(ref, res, n_ref * sizeof(ref[0])) != 0)
+        {
+            PJ_LOG(3,(THIS_FILE, "   error: %s mismatch at round %d",
+                      name, round));
+            return -10;
+        }
+    }
+
+    return 0;
+}
+
+/* The SIMD lookup table must follow changes of the specification */
+static int modify_test(void)
+{
+    char buf[] = "0123456789012345678901234567890123456789a0123456789";
+    pj_scanner scanner;
+    pj_str_t out;
+    pj_cis_t cis;
+
+    PJ_LOG(3,(THIS_FILE, "  spec modification.."));
+
+    pj_cis_dup(&cis, &spec[SPEC_DIGIT]);
+
+    pj_scan_init(&scanner, buf, sizeof(buf)-1, 0, &on_syntax_error);
+    pj_scan_peek(&scanner, &cis, &out);
+    if (out.slen != 40)
+        return -20;
+
+    pj_cis_add_str(&cis, "a");
+    pj_scan_peek(&scanner, &cis, &out);
+    if (out.slen != (pj_ssize_t)sizeof(buf)-1)
+        return -21;
+
+    pj_cis_del_range(&cis, '5', '6');
+    pj_scan_peek(&scanner, &cis, &out);
+    if (out.slen != 5)
+        return -22;
+
+    pj_cis_invert(&cis);
+    pj_scan_peek_until(&scanner, &cis, &out);
+    if (out.slen != 5)
+        return -23;
+
+    pj_scan_fini(&scanner);
+    return 0;
+}
+
+int scanner_test(void)
+{
+    pj_scan_impl saved_impl = pj_scan_get_impl();
+    int rc;
+
+    init_specs();
+
+    rc = compare_impl(PJ_SCAN_IMPL_SSE42, "SSE4.2");
+    if (rc == 0)
+        rc = compare_impl(PJ_SCAN_IMPL_AVX2, "AVX2");
+    if (rc == 0)
+        rc = modify_test();
+
+    pj_scan_set_impl(saved_impl);
+    return rc;
+}
+
+#else
+int dummy_scanner_test;
+#endif  /* INCLUDE_SCANNER_TEST */
@@ -30,6 +30,7 @@
 #define INCLUDE_STUN_TEST           1
 #define INCLUDE_RESOLVER_TEST       1
 #define INCLUDE_HTTP_CLIENT_TEST    1
+#define INCLUDE_SCANNER_TEST        1
 
 extern int xml_test(void);
 extern int json_test(void);
@@ -39,6 +40,7 @@ extern int stun_test();
 extern int test_main(void);
 extern int resolver_test(void);
 extern int http_client_test();
+extern int scanner_test(void);
 
 extern void app_perror(const char *title, pj_status_t rc);
 extern pj_pool_factory *mem;
@@ -33,6 +33,15 @@
 #include <pj/sock.h>
 #include <pj/timer.h>
 
+#if PJ_DNS_RESOLVER_HAS_SHARED_CACHE
+#   include <errno.h>
+#   include <fcntl.h>
+#   include <sys/file.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
 
 #define THIS_FILE           "resolver.c"
 
@@ -156,11 +165,54 @@ struct cached_res
     struct res_key           key;           /**< Resource key.              */
     pj_hash_entry_buf        hbuf;          /**< Hash buffer                */
     pj_time_val              expiry_time;   /**< Expiration time.           */
+    pj_uint32_t              ttl;           /**< Original TTL, 0: no expiry */
+    unsigned                 hit_cnt;       /**< Number of cache hits.      */
     pj_dns_parsed_packet    *pkt;           /**< The response packet.       */
     unsigned                 ref_cnt;       /**< Reference counter.         */
 };
 
 
+#if PJ_DNS_RESOLVER_HAS_SHARED_CACHE
+
+#define SHM_MAGIC           0x504A4443  /**< "PJDC"                     */
+#define SHM_VERSION         1           /**< Shared cache file version. */
+
+/* Header of the shared cache file, followed by the slots */
+struct shm_cache_hdr
+{
+    pj_uint32_t              magic;         /**< SHM_MAGIC                  */
+    pj_uint32_t              version;       /**< SHM_VERSION                */
+    pj_uint32_t              slot_cnt;      /**< Number of slots.           */
+    pj_uint32_t              slot_size;     /**< sizeof(shm_cache_slot)     */
+};
+
+/* Each slot of the shared cache file keeps the raw response packet.
+ * The seq member is a sequence lock: it is odd while a writer is
+ * updating the slot, and readers retry (i.e. treat as a miss) when it
+ * changes while they copy the slot.
+ */
+struct shm_cache_slot
+{
+    pj_uint32_t              seq;           /**< Sequence lock.             */
+    pj_uint32_t              expiry;        /**< Wall clock expiry, in sec. */
+    pj_uint32_t              ttl;           /**< Original TTL.              */
+    pj_uint16_t              len;           /**< Packet length, 0: empty.   */
+    struct res_key           key;           /**< Resource key.              */
+    pj_uint8_t               pkt[UDPSZ];    /**< The raw response packet.   */
+};
+
+/* Mapping of the shared cache file */
+struct shm_cache
+{
+    void                    *base;          /**< Mapped address.            */
+    pj_size_t                size;          /**< Mapped size.               */
+    struct shm_cache_slot   *slots;         /**< The slots, NULL if none.   */
+    unsigned                 slot_cnt;      /**< Number of slots.           */
+};
+
+#endif  /* PJ_DNS_RESOLVER_HAS_SHARED_CACHE */
+
+
 /* Resolver entry */
 struct pj_dns_resolver
 {
@@ -210,6 +262,11 @@ struct pj_dns_resolver
     /* Hash table for cached response */
     pj_hash_table_t     *hrescache;     /**< Cached response in hash table  */
 
+#if PJ_DNS_RESOLVER_HAS_SHARED_CACHE
+    /* Shared cache file */
+    struct shm_cache     shm;           /**< Shared response cache.         */
+#endif
+
     /* Pending asynchronous query, hashed by transaction ID. */
     pj_hash_table_t     *hquerybyid;
 
@@ -238,6 +295,24 @@ static pj_status_t select_nameservers(pj_dns_resolver *resolver,
 /* Destructor */
 static void dns_resolver_on_destroy(void *member);
 
+/* Put response into the cache */
+static void set_res_cache(pj_dns_resolver *resolver,
+                          const struct res_key *key,
+                          pj_uint32_t ttl,
+                          const pj_time_val *expiry,
+                          const pj_dns_parsed_packet *pkt);
+
+/* Shared cache file */
+static pj_bool_t shm_cache_load(pj_dns_resolver *resolver,
+                                const struct res_key *key,
+                                pj_uint32_t min_expiry);
+static void shm_cache_put(pj_dns_resolver *resolver,
+                          const struct res_key *key,
+                          pj_uint32_t ttl,
+                          const void *pkt,
+                          unsigned len);
+static void shm_cache_detach(pj_dns_resolver *resolver);
+
 /* Close UDP socket */
 static void close_sock(pj_dns_resolver *resv)
 {
@@ -369,6 +444,10 @@ PJ_DEF(void) pj_dns_settings_default(pj_dns_settings *s)
     s->cache_max_ttl = PJ_DNS_RESOLVER_MAX_TTL;
     s->good_ns_ttl = PJ_DNS_RESOLVER_GOOD_NS_TTL;
     s->bad_ns_ttl = PJ_DNS_RESOLVER_BAD_NS_TTL;
+    s->cache_neg_ttl = PJ_DNS_RESOLVER_INVALID_TTL;
+    s->cache_servfail_ttl = PJ_DNS_RESOLVER_SERVFAIL_TTL;
+    s->prefetch_pct = PJ_DNS_RESOLVER_PREFETCH_PCT;
+    s->prefetch_min_hits = PJ_DNS_RESOLVER_PREFETCH_MIN_HITS;
 }
 
 
@@ -510,6 +589,8 @@ PJ_DEF(pj_status_t) pj_dns_resolver_destroy( pj_dns_resolver *resolver,
         it = pj_hash_first(resolver->hrescache, &it_buf);
     }
 
+    shm_cache_detach(resolver);
+
     if (resolver->own_timer && resolver->timer) {
         pj_timer_heap_destroy(resolver->timer);
         resolver->timer = NULL;
@@ -850,6 +931,107 @@ static void free_entry(pj_dns_resolver *resolver, struct cached_res *cache)
 }
 
 
+/* Create a new query for the key and send it to the nameservers */
+static pj_status_t start_new_query(pj_dns_resolver *resolver,
+                                   const struct res_key *key,
+                                   unsigned options,
+                                   pj_dns_callback *cb,
+                                   void *user_data,
+                                   pj_dns_async_query **p_q)
+{
+    pj_dns_async_query *q;
+    pj_status_t status;
+
+    q = alloc_qnode(resolver, options, user_data, cb);
+
+    /* Save the ID and key */
+    /* TODO: dnsext-forgery-resilient: randomize id for security */
+    q->id = resolver->last_id++;
+    if (resolver->last_id == 0)
+        resolver->last_id = 1;
+    pj_memcpy(&q->key, key, sizeof(struct res_key));
+
+    /* Send the query */
+    status = transmit_query(resolver, q);
+    if (status != PJ_SUCCESS) {
+        pj_list_push_back(&resolver->query_free_nodes, q);
+        return status;
+    }
+
+    /* Add query entry to the hash tables */
+    pj_hash_set_np(resolver->hquerybyid, &q->id, sizeof(q->id), 
+                   0, q->hbufid, q);
+    pj_hash_set_np(resolver->hquerybyres, &q->key, sizeof(q->key),
+                   0, q->hbufkey, q);
+
+    *p_q = q;
+    return PJ_SUCCESS;
+}
+
+
+/* Count a cache hit, and check if the entry is popular enough and close
+ * enough to its expiry to be refreshed in the background.
+ */
+static pj_bool_t need_prefetch(pj_dns_resolver *resolver,
+                               struct cached_res *cache,
+                               const pj_time_val *now)
+{
+    pj_time_val remain;
+    pj_uint64_t remain_msec;
+
+    ++cache->hit_cnt;
+
+    /* Negative responses and entries that never expire are not refreshed */
+    if (resolver->settings.prefetch_pct == 0 || cache->ttl == 0 ||
+        cache->hit_cnt < resolver->settings.prefetch_min_hits ||
+        cache->pkt->hdr.anscount == 0 ||
+        PJ_DNS_GET_RCODE(cache->pkt->hdr.flags) != 0)
+    {
+        return PJ_FALSE;
+    }
+
+    remain = cache->expiry_time;
+    PJ_TIME_VAL_SUB(remain, *now);
+    remain_msec = PJ_TIME_VAL_MSEC(remain);
+
+    return remain_msec * 100 <= (pj_uint64_t)cache->ttl * 1000 *
+                                resolver->settings.prefetch_pct;
+}
+
+
+/* Send a background query to refresh the cached response of the key */
+static void start_prefetch(pj_dns_resolver *resolver,
+                           const struct res_key *key)
+{
+    struct cached_res *cache;
+    pj_dns_async_query *q;
+    pj_status_t status;
+
+    /* Nothing to do if the entry is being queried already */
+    if (pj_hash_get(resolver->hquerybyres, key, sizeof(*key), NULL))
+        return;
+
+    /* The entry may have been refreshed by another process */
+    cache = (struct cached_res *) pj_hash_get(resolver->hrescache, key,
+                                              sizeof(*key), NULL);
+    if (cache && shm_cache_load(resolver, key,
+                                (pj_uint32_t)cache->expiry_time.sec))
+    {
+        return;
+    }
+
+    PJ_LOG(5,(resolver->name.ptr, "Prefetching DNS %s record for %s",
+              pj_dns_get_type_name(key->qtype), key->name));
+
+    status = start_new_query(resolver, key, 0, NULL, NULL, &q);
+    if (status != PJ_SUCCESS) {
+        PJ_PERROR(4,(resolver->name.ptr, status,
+                     "Error prefetching DNS %s record for %s",
+                     pj_dns_get_type_name(key->qtype), key->name));
+    }
+}
+
+
 /*
  * Create and start asynchronous DNS query for a single resource.
  */
@@ -866,6 +1048,7 @@ PJ_DEF(pj_status_t) pj_dns_resolver_start_query( pj_dns_resolver *resolver,
     struct cached_res *cache;
     pj_dns_async_query *q, *p_q = NULL;
     pj_uint32_t hval;
+    pj_bool_t prefetch;
     pj_status_t status = PJ_SUCCESS;
 
     /* Validate arguments */
@@ -893,6 +1076,17 @@ PJ_DEF(pj_status_t) pj_dns_resolver_start_query( pj_dns_resolver *resolver,
     hval = 0;
     cache = (struct cached_res *) pj_hash_get(resolver->hrescache, &key, 
                                               sizeof(key), &hval);
+
+    /* On a miss, the response may be found in the shared cache file,
+     * written there by another resolver instance.
+     */
+    if ((cache == NULL || !PJ_TIME_VAL_GT(cache->expiry_time, now)) &&
+        shm_cache_load(resolver, &key, 0))
+    {
+        cache = (struct cached_res *) pj_hash_get(resolver->hrescache, &key,
+                                                  sizeof(key), &hval);
+    }
+
     if (cache) {
         /* We've found a cached entry. */
 
@@ -910,6 +1104,11 @@ PJ_DEF(pj_status_t) pj_dns_resolver_start_query( pj_dns_resolver *resolver,
             status = PJ_DNS_GET_RCODE(cache->pkt->hdr.flags);
             status = PJ_STATUS_FROM_DNS_RCODE(status);
 
+            /* Popular entries are refreshed before they expire, while the
+             * cached response is still served.
+             */
+            prefetch = need_prefetch(resolver, cache, &now);
+
             /* Workaround for deadlock problem. Need to increment the cache's
              * ref counter first before releasing mutex, so the cache won't be
              * destroyed by other thread while in callback.
@@ -934,6 +1133,9 @@ PJ_DEF(pj_status_t) pj_dns_resolver_start_query( pj_dns_resolver *resolver,
             if (cache->ref_cnt <= 0)
                 free_entry(resolver, cache);
 
+            if (prefetch)
+                start_prefetch(resolver, &key);
+
             /* Must return PJ_SUCCESS */
             status = PJ_SUCCESS;
 
@@ -981,29 +1183,7 @@ PJ_DEF(pj_status_t) pj_dns_resolver_start_query( pj_dns_resolver *resolver,
     } 
 
     /* There's no pending query to the same key, initiate a new one. */
-    q = alloc_qnode(resolver, options, user_data, cb);
-
-    /* Save the ID and key */
-    /* TODO: dnsext-forgery-resilient: randomize id for security */
-    q->id = resolver->last_id++;
-    if (resolver->last_id == 0)
-        resolver->last_id = 1;
-    pj_memcpy(&q->key, &key, sizeof(struct res_key));
-
-    /* Send the query */
-    status = transmit_query(resolver, q);
-    if (status != PJ_SUCCESS) {
-        pj_list_push_back(&resolver->query_free_nodes, q);
-        goto on_return;
-    }
-
-    /* Add query entry to the hash tables */
-    pj_hash_set_np(resolver->hquerybyid, &q->id, sizeof(q->id), 
-                   0, q->hbufid, q);
-    pj_hash_set_np(resolver->hquerybyres, &q->key, sizeof(q->key),
-                   0, q->hbufkey, q);
-
-    p_q = q;
+    status = start_new_query(resolver, &key, options, cb, user_data, &p_q);
 
 on_return:
     if (p_query)
@@ -1441,15 +1621,51 @@ static void report_nameserver_status(pj_dns_resolver *resolver,
 }
 
 
-/* Update response cache */
-static void update_res_cache(pj_dns_resolver *resolver,
-                             const struct res_key *key,
-                             pj_status_t status,
-                             pj_bool_t set_expiry,
-                             const pj_dns_parsed_packet *pkt)
+/* Get the negative TTL from the SOA record in the authority section of
+ * a negative response, i.e. the lower of the TTL of the SOA record and
+ * its MINIMUM field (RFC 2308 section 5).
+ */
+static pj_uint32_t get_neg_ttl(const pj_dns_parsed_packet *pkt,
+                               pj_uint32_t max_ttl)
+{
+    unsigned i;
+
+    for (i=0; i<pkt->hdr.nscount; ++i) {
+        const pj_dns_parsed_rr *rr = &pkt->ns[i];
+        const pj_uint8_t *p;
+        pj_uint32_t ttl;
+
+        /* MNAME and RNAME (at least one octet each), followed by five
+         * 32bit fields, the last one being MINIMUM.
+         */
+        if (rr->type != PJ_DNS_TYPE_SOA || !rr->data || rr->rdlength < 22)
+            continue;
+
+        p = (const pj_uint8_t*)rr->data + rr->rdlength - 4;
+        ttl = ((pj_uint32_t)p[0] << 24) | ((pj_uint32_t)p[1] << 16) |
+              ((pj_uint32_t)p[2] << 8) | p[3];
+        if (rr->ttl < ttl)
+            ttl = rr->ttl;
+
+        return ttl < max_ttl ? ttl : max_ttl;
+    }
+
+    return max_ttl;
+}
+
+
+/* Update response cache, and return the TTL of the cached entry (zero if
+ * the response is not cached or does not expire).
+ */
+static pj_uint32_t update_res_cache(pj_dns_resolver *resolver,
+                                    const struct res_key *key,
+                                    pj_status_t status,
+                                    pj_bool_t set_expiry,
+                                    const pj_dns_parsed_packet *pkt)
 {
     struct cached_res *cache;
     pj_uint32_t hval=0, ttl;
+    pj_time_val expiry;
 
     /* If status is unsuccessful, clear the same entry from the cache */
     if (status != PJ_SUCCESS) {
@@ -1466,12 +1682,19 @@ static void update_res_cache(pj_dns_resolver *resolver,
 
     /* Calculate expiration time. */
     if (set_expiry) {
-        if (pkt->hdr.anscount == 0 || status != PJ_SUCCESS) {
-            /* If we don't have answers for the name, then give a different
-             * ttl value (note: PJ_DNS_RESOLVER_INVALID_TTL may be zero, 
-             * which means that invalid names won't be kept in the cache)
+        if (status != PJ_SUCCESS && status != PJLIB_UTIL_EDNS_NXDOMAIN) {
+            /* SERVFAIL and other errors are only kept for a short time,
+             * the nameserver may recover soon (note: the value may be
+             * zero, which means that errors won't be kept in the cache)
              */
-            ttl = PJ_DNS_RESOLVER_INVALID_TTL;
+            ttl = resolver->settings.cache_servfail_ttl;
+
+        } else if (pkt->hdr.anscount == 0 || status != PJ_SUCCESS) {
+            /* If we don't have answers for the name, then use the negative
+             * TTL (note: cache_neg_ttl may be zero, which means that
+             * invalid names won't be kept in the cache)
+             */
+            ttl = get_neg_ttl(pkt, resolver->settings.cache_neg_ttl);
 
         } else {
             /* Otherwise get the minimum TTL from the answers */
@@ -1490,21 +1713,49 @@ static void update_res_cache(pj_dns_resolver *resolver,
     if (ttl > resolver->settings.cache_max_ttl)
         ttl = resolver->settings.cache_max_ttl;
 
-    /* Get a cache response entry */
-    cache = (struct cached_res *) pj_hash_get(resolver->hrescache, key,
-                                              sizeof(*key), &hval);
-
     /* If TTL is zero, clear the same entry in the hash table */
     if (ttl == 0) {
+        cache = (struct cached_res *) pj_hash_get(resolver->hrescache, key,
+                                                  sizeof(*key), &hval);
+
         /* Remove the entry before releasing its pool (see ticket #1710) */
         pj_hash_set(NULL, resolver->hrescache, key, sizeof(*key), hval, NULL);
 
         /* Free the entry */
         if (cache && --cache->ref_cnt <= 0)
             free_entry(resolver, cache);
-        return;
+        return 0;
     }
 
+    if (!set_expiry) {
+        set_res_cache(resolver, key, 0, NULL, pkt);
+        return 0;
+    }
+
+    pj_gettimeofday(&expiry);
+    expiry.sec += ttl;
+    set_res_cache(resolver, key, ttl, &expiry, pkt);
+
+    return ttl;
+}
+
+
+/* Put response into the cache, replacing existing entry with the same key.
+ * If expiry is NULL, the entry will not expire.
+ */
+static void set_res_cache(pj_dns_resolver *resolver,
+                          const struct res_key *key,
+                          pj_uint32_t ttl,
+                          const pj_time_val *expiry,
+                          const pj_dns_parsed_packet *pkt)
+{
+    struct cached_res *cache;
+    pj_uint32_t hval=0;
+
+    /* Get a cache response entry */
+    cache = (struct cached_res *) pj_hash_get(resolver->hrescache, key,
+                                              sizeof(*key), &hval);
+
     if (cache == NULL) {
         cache = alloc_entry(resolver);
     } else {
@@ -1534,14 +1785,14 @@ static void update_res_cache(pj_dns_resolver *resolver,
                       PJ_DNS_NO_NS | PJ_DNS_NO_AR,
                       &cache->pkt);
 
-    /* Calculate expiration time */
-    if (set_expiry) {
-        pj_gettimeofday(&cache->expiry_time);
-        cache->expiry_time.sec += ttl;
+    /* Set expiration time */
+    if (expiry) {
+        cache->expiry_time = *expiry;
     } else {
         cache->expiry_time.sec = 0x7FFFFFFFL;
         cache->expiry_time.msec = 0;
     }
+    cache->ttl = ttl;
 
     /* Copy key to the cached response */
     pj_memcpy(&cache->key, key, sizeof(*key));
@@ -1553,6 +1804,173 @@ static void update_res_cache(pj_dns_resolver *resolver,
 }
 
 
+#if PJ_DNS_RESOLVER_HAS_SHARED_CACHE
+
+/* Get the slot of the key in the shared cache file */
+static struct shm_cache_slot *shm_cache_slot(pj_dns_resolver *resolver,
+                                             const struct res_key *key)
+{
+    pj_uint32_t hval = pj_hash_calc(0, key, sizeof(*key));
+    return &resolver->shm.slots[hval % resolver->shm.slot_cnt];
+}
+
+
+/* Load the response of the key from the shared cache file into the
+ * resolver's cache, if it expires later than min_expiry.
+ */
+static pj_bool_t shm_cache_load(pj_dns_resolver *resolver,
+                                const struct res_key *key,
+                                pj_uint32_t min_expiry)
+{
+    struct shm_cache_slot *slot, copy;
+    pj_dns_parsed_packet *pkt;
+    pj_time_val now, expiry;
+    pj_uint32_t seq;
+    pj_pool_t *pool;
+    pj_status_t status;
+    PJ_USE_EXCEPTION;
+
+    if (resolver->shm.slots == NULL || resolver->settings.cache_max_ttl == 0)
+        return PJ_FALSE;
+
+    /* Copy the slot, and check that no writer has modified it meanwhile */
+    slot = shm_cache_slot(resolver, key);
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+        return PJ_FALSE;
+
+    pj_memcpy(&copy, slot, sizeof(copy));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+        return PJ_FALSE;
+
+    if (copy.len == 0 || copy.len > UDPSZ ||
+        pj_memcmp(&copy.key, key, sizeof(*key)) != 0)
+    {
+        return PJ_FALSE;
+    }
+
+    pj_gettimeofday(&now);
+    if (copy.expiry <= (pj_uint32_t)now.sec || copy.expiry <= min_expiry)
+        return PJ_FALSE;
+
+    pool = pj_pool_create(resolver->pool->factory, "dnsshm", 1000, 1000,
+                          NULL);
+    if (!pool)
+        return PJ_FALSE;
+
+    pkt = NULL;
+    PJ_TRY {
+        status = pj_dns_parse_packet(pool, copy.pkt, copy.len, &pkt);
+    }
+    PJ_CATCH_ANY {
+        status = PJ_ENOMEM;
+    }
+    PJ_END;
+
+    if (status == PJ_SUCCESS) {
+        /* Apply our own maximum TTL */
+        expiry.sec = copy.expiry;
+        expiry.msec = 0;
+        if (expiry.sec - now.sec > (long)resolver->settings.cache_max_ttl)
+            expiry.sec = now.sec + resolver->settings.cache_max_ttl;
+
+        set_res_cache(resolver, key, copy.ttl, &expiry, pkt);
+
+        PJ_LOG(5,(resolver->name.ptr,
+                  "Loaded DNS %s record for %s from shared cache, ttl=%d",
+                  pj_dns_get_type_name(key->qtype), key->name,
+                  (int)(expiry.sec - now.sec)));
+    }
+
+    pj_pool_release(pool);
+
+    return status == PJ_SUCCESS;
+}
+
+
+/* Write the raw response packet of the key to the shared cache file */
+static void shm_cache_put(pj_dns_resolver *resolver,
+                          const struct res_key *key,
+                          pj_uint32_t ttl,
+                          const void *pkt,
+                          unsigned len)
+{
+    struct shm_cache_slot *slot;
+    pj_time_val now;
+    pj_uint32_t seq;
+
+    if (resolver->shm.slots == NULL || ttl == 0 || len == 0 || len > UDPSZ)
+        return;
+
+    pj_gettimeofday(&now);
+
+    /* Skip the update if another writer is busy with the slot. Note that
+     * a writer that dies while holding the slot leaves it unusable until
+     * the file is recreated.
+     */
+    slot = shm_cache_slot(resolver, key);
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    if ((seq & 1) ||
+        !__atomic_compare_exchange_n(&slot->seq, &seq, seq+1, PJ_FALSE,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+
+    slot->expiry = (pj_uint32_t)now.sec + ttl;
+    slot->ttl = ttl;
+    slot->len = (pj_uint16_t)len;
+    pj_memcpy(&slot->key, key, sizeof(*key));
+    pj_memcpy(slot->pkt, pkt, len);
+
+    __atomic_store_n(&slot->seq, seq+2, __ATOMIC_RELEASE);
+}
+
+
+/* Unmap the shared cache file */
+static void shm_cache_detach(pj_dns_resolver *resolver)
+{
+    if (resolver->shm.base) {
+        munmap(resolver->shm.base, resolver->shm.size);
+        pj_bzero(&resolver->shm, sizeof(resolver->shm));
+    }
+}
+
+#else   /* PJ_DNS_RESOLVER_HAS_SHARED_CACHE */
+
+static pj_bool_t shm_cache_load(pj_dns_resolver *resolver,
+                                const struct res_key *key,
+                                pj_uint32_t min_expiry)
+{
+    PJ_UNUSED_ARG(resolver);
+    PJ_UNUSED_ARG(key);
+    PJ_UNUSED_ARG(min_expiry);
+    return PJ_FALSE;
+}
+
+static void shm_cache_put(pj_dns_resolver *resolver,
+                          const struct res_key *key,
+                          pj_uint32_t ttl,
+                          const void *pkt,
+                          unsigned len)
+{
+    PJ_UNUSED_ARG(resolver);
+    PJ_UNUSED_ARG(key);
+    PJ_UNUSED_ARG(ttl);
+    PJ_UNUSED_ARG(pkt);
+    PJ_UNUSED_ARG(len);
+}
+
+static void shm_cache_detach(pj_dns_resolver *resolver)
+{
+    PJ_UNUSED_ARG(resolver);
+}
+
+#endif  /* PJ_DNS_RESOLVER_HAS_SHARED_CACHE */
+
+
 /* Callback to be called when query has timed out */
 static void on_timeout( pj_timer_heap_t *timer_heap,
                         struct pj_timer_entry *entry)
@@ -1773,8 +2191,13 @@ static void on_read_complete(pj_ioqueue_key_t *key,
 
     /* Truncated responses MUST NOT be saved (cached). */
     if (PJ_DNS_GET_TC(dns_pkt->hdr.flags) == 0) {
+        pj_uint32_t ttl;
+
         /* Save/update response cache. */
-        update_res_cache(resolver, &q->key, status, PJ_TRUE, dns_pkt);
+        ttl = update_res_cache(resolver, &q->key, status, PJ_TRUE, dns_pkt);
+
+        /* Share the raw response with other resolver instances */
+        shm_cache_put(resolver, &q->key, ttl, rx_pkt, (unsigned)bytes_read);
     }
 
     /* Recycle query objects, starting with the child queries */
@@ -1862,6 +2285,115 @@ PJ_DEF(pj_status_t) pj_dns_resolver_add_entry( pj_dns_resolver *resolver,
 }
 
 
+/*
+ * Attach a memory mapped response cache file to the resolver.
+ */
+PJ_DEF(pj_status_t) pj_dns_resolver_set_shared_cache(pj_dns_resolver *resolver,
+                                                      const char *path,
+                                                      unsigned slot_cnt)
+{
+#if PJ_DNS_RESOLVER_HAS_SHARED_CACHE
+    struct shm_cache_hdr *hdr;
+    struct stat st;
+    pj_size_t size = 0;
+    void *base = MAP_FAILED;
+    pj_bool_t init = PJ_FALSE;
+    int fd;
+    pj_status_t status = PJ_SUCCESS;
+
+    PJ_ASSERT_RETURN(resolver, PJ_EINVAL);
+
+    if (slot_cnt == 0)
+        slot_cnt = PJ_DNS_RESOLVER_SHARED_CACHE_SIZE;
+
+    pj_grp_lock_acquire(resolver->grp_lock);
+
+    shm_cache_detach(resolver);
+    if (path == NULL)
+        goto on_return;
+
+    fd = open(path, O_RDWR | O_CREAT, 0660);
+    if (fd < 0) {
+        status = PJ_RETURN_OS_ERROR(errno);
+        goto on_return;
+    }
+
+    /* Serialize the initialization of a new file among processes */
+    if (flock(fd, LOCK_EX) != 0 || fstat(fd, &st) != 0) {
+        status = PJ_RETURN_OS_ERROR(errno);
+        goto on_error;
+    }
+
+    if (st.st_size == 0) {
+        size = sizeof(struct shm_cache_hdr) +
+               (pj_size_t)slot_cnt * sizeof(struct shm_cache_slot);
+        if (ftruncate(fd, size) != 0) {
+            status = PJ_RETURN_OS_ERROR(errno);
+            goto on_error;
+        }
+        init = PJ_TRUE;
+    } else {
+        size = (pj_size_t)st.st_size;
+    }
+
+    if (size < sizeof(struct shm_cache_hdr)) {
+        status = PJ_EINVAL;
+        goto on_error;
+    }
+
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        status = PJ_RETURN_OS_ERROR(errno);
+        goto on_error;
+    }
+
+    hdr = (struct shm_cache_hdr*) base;
+    if (init) {
+        hdr->magic = SHM_MAGIC;
+        hdr->version = SHM_VERSION;
+        hdr->slot_cnt = slot_cnt;
+        hdr->slot_size = sizeof(struct shm_cache_slot);
+    } else if (hdr->magic != SHM_MAGIC || hdr->version != SHM_VERSION ||
+               hdr->slot_size != sizeof(struct shm_cache_slot) ||
+               hdr->slot_cnt == 0 ||
+               size < sizeof(struct shm_cache_hdr) +
+                      (pj_size_t)hdr->slot_cnt * hdr->slot_size)
+    {
+        PJ_LOG(3,(resolver->name.ptr,
+                  "Incompatible shared DNS cache file %s", path));
+        status = PJ_EINVAL;
+        goto on_error;
+    }
+
+    resolver->shm.base = base;
+    resolver->shm.size = size;
+    resolver->shm.slots = (struct shm_cache_slot*) (hdr + 1);
+    resolver->shm.slot_cnt = hdr->slot_cnt;
+
+    PJ_LOG(4,(resolver->name.ptr, "Using shared DNS cache file %s (%u slots)",
+              path, resolver->shm.slot_cnt));
+
+on_error:
+    if (status != PJ_SUCCESS && base != MAP_FAILED)
+        munmap(base, size);
+
+    /* The mapping stays valid after the file is closed */
+    flock(fd, LOCK_UN);
+    close(fd);
+
+on_return:
+    pj_grp_lock_release(resolver->grp_lock);
+    return status;
+
+#else
+    PJ_UNUSED_ARG(resolver);
+    PJ_UNUSED_ARG(path);
+    PJ_UNUSED_ARG(slot_cnt);
+    return PJ_ENOTSUP;
+#endif
+}
+
+
 /*
  * Get the total number of response in the response cache.
  */
@@ -1925,6 +2457,12 @@ PJ_DEF(void) pj_dns_resolver_dump(pj_dns_resolver *resolver,
             it = pj_hash_next(resolver->hrescache, it);
         }
     }
+#if PJ_DNS_RESOLVER_HAS_SHARED_CACHE
+    if (resolver->shm.slots) {
+        PJ_LOG(3,(resolver->name.ptr, "  Shared cache slots: %u",
+                  resolver->shm.slot_cnt));
+    }
+#endif
     PJ_LOG(3,(resolver->name.ptr, "  Nb. of pending queries: %u (%u)",
               pj_hash_count(resolver->hquerybyid),
               pj_hash_count(resolver->hquerybyres)));
@@ -32,6 +32,46 @@
 #define PJ_SCAN_IS_PROBABLY_SPACE(c)    ((c) <= 32)
 #define PJ_SCAN_CHECK_EOF(s)            (s != scanner->end)
 
+#if PJ_SCANNER_HAS_SIMD
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#       include <immintrin.h>
+#       define TARGET_SSE42
+#       define TARGET_AVX2
+#   else
+#       include <immintrin.h>
+#       define TARGET_SSE42     __attribute__((target("sse4.2")))
+#       define TARGET_AVX2      __attribute__((target("avx2")))
+#   endif
+
+/* Number of characters checked with the byte loop before using the
+ * SIMD loops.
+ */
+#   define SCALAR_PREFIX_LEN    8
+
+/* The SIMD lookup table of a specification */
+#   define CIS_SIMD_TBL(cis)    \
+            (((const pj_cis_buf_t*)(cis)->cis_buf)->simd_tbl[(cis)->cis_id])
+
+/* Rebuild the SIMD lookup table after the specification is modified. */
+static void cis_update_simd(pj_cis_t *cis)
+{
+    pj_uint8_t *tbl = ((pj_cis_buf_t*)cis->cis_buf)->simd_tbl[cis->cis_id];
+    unsigned lo, hi;
+
+    for (lo=0; lo<16; ++lo) {
+        tbl[lo] = 0;
+        for (hi=0; hi<8; ++hi) {
+            if (PJ_CIS_ISSET(cis, (hi << 4) | lo))
+                tbl[lo] |= (pj_uint8_t)(1 << hi);
+        }
+    }
+}
+
+#else
+#   define cis_update_simd(cis)
+#endif
+
 
 #if defined(PJ_SCANNER_USE_BITWISE) && PJ_SCANNER_USE_BITWISE != 0
 #  include "scanner_cis_bitwise.c"
@@ -47,6 +87,84 @@ static void pj_scan_syntax_err(pj_scanner *scanner)
 }
 
 
+#if PJ_SCANNER_HAS_SIMD
+
+/* The set of routines of one implementation. */
+typedef struct scan_ops
+{
+    pj_scan_impl impl;
+    const char  *name;
+    int          width;         /* Vector width in characters       */
+
+    /* Skip whole vectors of characters which are in the specification
+     * (span) or which are not (cspan). Return the first character which
+     * may stop the scanning, or the position where the remaining input is
+     * shorter than a vector. Characters above 127 always stop the loop,
+     * and are checked by the caller.
+     */
+    char*       (*span)(const pj_uint8_t *tbl, char *s, const char *end);
+    char*       (*cspan)(const pj_uint8_t *tbl, char *s, const char *end);
+} scan_ops;
+
+static const scan_ops *get_scan_ops(pj_scan_impl impl);
+
+/* The implementation in use, selected on first use. */
+static const scan_ops *scan_op;
+
+#endif  /* PJ_SCANNER_HAS_SIMD */
+
+/* Return the first character in [s, end) which is not in the specification
+ * (if until is zero), or which is in the specification (if until is
+ * non-zero), or end if there is no such character.
+ */
+PJ_INLINE(char*) scan_class(const pj_cis_t *spec, char *s, char *end,
+                            int until)
+{
+#if PJ_SCANNER_HAS_SIMD
+    const scan_ops *op = scan_op;
+
+    if (!op)
+        scan_op = op = get_scan_ops(PJ_SCAN_IMPL_AUTO);
+
+    if (op->span) {
+        /* Most tokens are short, check the first few characters with the
+         * byte loop before switching to the vector loop.
+         */
+        char *prefix_end = (end - s > SCALAR_PREFIX_LEN) ?
+                           s + SCALAR_PREFIX_LEN : end;
+
+        while (s != prefix_end &&
+               (pj_cis_match(spec, *s) != 0) != (until != 0))
+        {
+            ++s;
+        }
+        if (s != prefix_end)
+            return s;
+
+        for (;;) {
+            if (end - s >= op->width) {
+                s = until? (*op->cspan)(CIS_SIMD_TBL(spec), s, end) :
+                           (*op->span)(CIS_SIMD_TBL(spec), s, end);
+            }
+            if (s == end || (pj_cis_match(spec, *s) != 0) == (until != 0))
+                break;
+            ++s;
+        }
+        return s;
+    }
+#endif
+
+    if (until) {
+        while (s != end && !pj_cis_match(spec, *s))
+            ++s;
+    } else {
+        while (s != end && pj_cis_match(spec, *s))
+            ++s;
+    }
+    return s;
+}
+
+
 PJ_DEF(void) pj_cis_add_range(pj_cis_t *cis, int cstart, int cend)
 {
     /* Can not set zero. This is the requirement of the parser. */
@@ -56,6 +174,7 @@ PJ_DEF(void) pj_cis_add_range(pj_cis_t *cis, int cstart, int cend)
         PJ_CIS_SET(cis, cstart);
         ++cstart;
     }
+    cis_update_simd(cis);
 }
 
 PJ_DEF(void) pj_cis_add_alpha(pj_cis_t *cis)
@@ -75,6 +194,7 @@ PJ_DEF(void) pj_cis_add_str( pj_cis_t *cis, const char *str)
         PJ_CIS_SET(cis, *str);
         ++str;
     }
+    cis_update_simd(cis);
 }
 
 PJ_DEF(void) pj_cis_add_cis( pj_cis_t *cis, const pj_cis_t *rhs)
@@ -84,6 +204,7 @@ PJ_DEF(void) pj_cis_add_cis( pj_cis_t *cis, const pj_cis_t *rhs)
         if (PJ_CIS_ISSET(rhs, i))
             PJ_CIS_SET(cis, i);
     }
+    cis_update_simd(cis);
 }
 
 PJ_DEF(void) pj_cis_del_range( pj_cis_t *cis, int cstart, int cend)
@@ -92,6 +213,7 @@ PJ_DEF(void) pj_cis_del_range( pj_cis_t *cis, int cstart, int cend)
         PJ_CIS_CLR(cis, cstart);
         cstart++;
     }
+    cis_update_simd(cis);
 }
 
 PJ_DEF(void) pj_cis_del_str( pj_cis_t *cis, const char *str)
@@ -100,6 +222,7 @@ PJ_DEF(void) pj_cis_del_str( pj_cis_t *cis, const char *str)
         PJ_CIS_CLR(cis, *str);
         ++str;
     }
+    cis_update_simd(cis);
 }
 
 PJ_DEF(void) pj_cis_invert( pj_cis_t *cis )
@@ -112,6 +235,7 @@ PJ_DEF(void) pj_cis_invert( pj_cis_t *cis )
         else
             PJ_CIS_SET(cis,i);
     }
+    cis_update_simd(cis);
 }
 
 PJ_DEF(void) pj_scan_init( pj_scanner *scanner, char *bufstart, 
@@ -222,12 +346,12 @@ PJ_DEF(int) pj_scan_peek( pj_scanner *scanner,
     register char *s = scanner->curptr;
 
     if (s >= scanner->end) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return -1;
     }
 
-    while (PJ_SCAN_CHECK_EOF(s) && pj_cis_match(spec, *s))
-        ++s;
+    s = scan_class(spec, s, scanner->end, 0);
 
     pj_strset3(out, scanner->curptr, s);
     return *s;
@@ -240,6 +364,7 @@ PJ_DEF(int) pj_scan_peek_n( pj_scanner *scanner,
     char *endpos = scanner->curptr + len;
 
     if (endpos > scanner->end) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return -1;
     }
@@ -256,12 +381,12 @@ PJ_DEF(int) pj_scan_peek_until( pj_scanner *scanner,
     register char *s = scanner->curptr;
 
     if (s >= scanner->end) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return -1;
     }
 
-    while (PJ_SCAN_CHECK_EOF(s) && !pj_cis_match( spec, *s))
-        ++s;
+    s = scan_class(spec, s, scanner->end, 1);
 
     pj_strset3(out, scanner->curptr, s);
     return *s;
@@ -276,13 +401,12 @@ PJ_DEF(void) pj_scan_get( pj_scanner *scanner,
     pj_assert(pj_cis_match(spec,0)==0);
 
     if (pj_scan_is_eof(scanner) || !pj_cis_match(spec, *s)) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return;
     }
 
-    do {
-        ++s;
-    } while (PJ_SCAN_CHECK_EOF(s) && pj_cis_match(spec, *s));
+    s = scan_class(spec, s+1, scanner->end, 0);
 
     pj_strset3(out, scanner->curptr, s);
 
@@ -308,6 +432,7 @@ PJ_DEF(void) pj_scan_get_unescape( pj_scanner *scanner,
     pj_assert(pj_cis_match(spec,'%')==0);
 
     if (pj_scan_is_eof(scanner) || (!pj_cis_match(spec, *s) && *s != '%')) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return;
     }
@@ -379,6 +504,7 @@ PJ_DEF(void) pj_scan_get_quotes(pj_scanner *scanner,
         }
     }
     if (qpair == -1) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return;
     }
@@ -418,6 +544,7 @@ PJ_DEF(void) pj_scan_get_quotes(pj_scanner *scanner,
 
     /* Check and eat the end quote. */
     if (*s != end_quote[qpair]) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return;
     }
@@ -439,6 +566,7 @@ PJ_DEF(void) pj_scan_get_n( pj_scanner *scanner,
                             unsigned N, pj_str_t *out)
 {
     if (scanner->curptr + N > scanner->end) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return;
     }
@@ -522,13 +650,12 @@ PJ_DEF(void) pj_scan_get_until( pj_scanner *scanner,
     register char *s = scanner->curptr;
 
     if (s >= scanner->end) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return;
     }
 
-    while (PJ_SCAN_CHECK_EOF(s) && !pj_cis_match(spec, *s)) {
-        ++s;
-    }
+    s = scan_class(spec, s, scanner->end, 1);
 
     pj_strset3(out, scanner->curptr, s);
 
@@ -548,13 +675,14 @@ PJ_DEF(void) pj_scan_get_until_ch( pj_scanner *scanner,
     register char *s = scanner->curptr;
 
     if (s >= scanner->end) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return;
     }
 
-    while (PJ_SCAN_CHECK_EOF(s) && *s != until_char) {
-        ++s;
-    }
+    s = (char*) pj_memchr(s, until_char, scanner->end - s);
+    if (!s)
+        s = scanner->end;
 
     pj_strset3(out, scanner->curptr, s);
 
@@ -575,6 +703,7 @@ PJ_DEF(void) pj_scan_get_until_chr( pj_scanner *scanner,
     pj_size_t speclen;
 
     if (s >= scanner->end) {
+        pj_strset(out, scanner->curptr, 0);
         pj_scan_syntax_err(scanner);
         return;
     }
@@ -658,3 +787,256 @@ PJ_DEF(void) pj_scan_restore_state( pj_scanner *scanner,
     scanner->line = state->line;
     scanner->start_line = state->start_line;
 }
+
+
+#if PJ_SCANNER_HAS_SIMD
+
+#if defined(_MSC_VER)
+PJ_INLINE(unsigned) first_bit(unsigned mask)
+{
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return (unsigned)idx;
+}
+#else
+#   define first_bit(mask)      ((unsigned)__builtin_ctz(mask))
+#endif
+
+
+/*
+ * SSE4.2 implementation.
+ *
+ * Each character is classified with two table lookups on its low and high
+ * nibble: the specification's table gives the set of high nibbles (0-7)
+ * which are in the specification for the low nibble, and the second table
+ * converts the high nibble to its bit. High nibbles 8-15 map to zero, so
+ * characters above 127 are never in the specification here.
+ */
+TARGET_SSE42
+static __m128i classify_sse42(__m128i v, __m128i tbl)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                       0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i lo = _mm_and_si128(v, nibble);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+
+    return _mm_and_si128(_mm_shuffle_epi8(tbl, lo),
+                         _mm_shuffle_epi8(bits, hi));
+}
+
+TARGET_SSE42
+static char* span_sse42(const pj_uint8_t *tbl, char *s, const char *end)
+{
+    const __m128i t = _mm_loadu_si128((const __m128i*)tbl);
+    const __m128i zero = _mm_setzero_si128();
+
+    while (end - s >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)s);
+        unsigned stop;
+
+        stop = _mm_movemask_epi8(_mm_cmpeq_epi8(classify_sse42(v, t), zero));
+        if (stop)
+            return s + first_bit(stop);
+        s += 16;
+    }
+    return s;
+}
+
+TARGET_SSE42
+static char* cspan_sse42(const pj_uint8_t *tbl, char *s, const char *end)
+{
+    const __m128i t = _mm_loadu_si128((const __m128i*)tbl);
+    const __m128i zero = _mm_setzero_si128();
+
+    while (end - s >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)s);
+        unsigned stop;
+
+        stop = _mm_movemask_epi8(_mm_cmpeq_epi8(classify_sse42(v, t), zero));
+        stop = (stop ^ 0xFFFF) | _mm_movemask_epi8(v);
+        if (stop)
+            return s + first_bit(stop);
+        s += 16;
+    }
+    return s;
+}
+
+static const scan_ops sse42_ops =
+{
+    PJ_SCAN_IMPL_SSE42, "SSE4.2", 16, &span_sse42, &cspan_sse42
+};
+
+
+/*
+ * AVX2 implementation, same as above with 32 characters at a time.
+ */
+TARGET_AVX2
+static __m256i classify_avx2(__m256i v, __m256i tbl)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                          0, 0, 0, 0, 0, 0, 0, 0,
+                                          1, 2, 4, 8, 16, 32, 64, -128,
+                                          0, 0, 0, 0, 0, 0, 0, 0);
+    __m256i lo = _mm256_and_si256(v, nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+
+    return _mm256_and_si256(_mm256_shuffle_epi8(tbl, lo),
+                            _mm256_shuffle_epi8(bits, hi));
+}
+
+TARGET_AVX2
+static char* span_avx2(const pj_uint8_t *tbl, char *s, const char *end)
+{
+    const __m256i t = _mm256_broadcastsi128_si256(
+                                _mm_loadu_si128((const __m128i*)tbl));
+    const __m256i zero = _mm256_setzero_si256();
+
+    while (end - s >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)s);
+        unsigned stop;
+
+        stop = (unsigned)_mm256_movemask_epi8(
+                            _mm256_cmpeq_epi8(classify_avx2(v, t), zero));
+        if (stop)
+            return s + first_bit(stop);
+        s += 32;
+    }
+    return s;
+}
+
+TARGET_AVX2
+static char* cspan_avx2(const pj_uint8_t *tbl, char *s, const char *end)
+{
+    const __m256i t = _mm256_broadcastsi128_si256(
+                                _mm_loadu_si128((const __m128i*)tbl));
+    const __m256i zero = _mm256_setzero_si256();
+
+    while (end - s >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)s);
+        unsigned stop;
+
+        stop = (unsigned)_mm256_movemask_epi8(
+                            _mm256_cmpeq_epi8(classify_avx2(v, t), zero));
+        stop = ~stop | (unsigned)_mm256_movemask_epi8(v);
+        if (stop)
+            return s + first_bit(stop);
+        s += 32;
+    }
+    return s;
+}
+
+static const scan_ops avx2_ops =
+{
+    PJ_SCAN_IMPL_AVX2, "AVX2", 32, &span_avx2, &cspan_avx2
+};
+
+static const scan_ops scalar_ops =
+{
+    PJ_SCAN_IMPL_SCALAR, "scalar", 0, NULL, NULL
+};
+
+
+/*
+ * CPU feature detection.
+ */
+#if defined(_MSC_VER)
+
+static pj_bool_t cpu_has_sse42(void)
+{
+    int info[4];
+
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+}
+
+static pj_bool_t cpu_has_avx2(void)
+{
+    int info[4];
+
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return PJ_FALSE;
+
+    /* Need OSXSAVE and AVX, and the OS must save the YMM registers */
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+        return PJ_FALSE;
+    if ((_xgetbv(0) & 6) != 6)
+        return PJ_FALSE;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+
+#else
+
+static pj_bool_t cpu_has_sse42(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") != 0;
+}
+
+static pj_bool_t cpu_has_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+}
+
+#endif
+
+static const scan_ops *get_scan_ops(pj_scan_impl impl)
+{
+    switch (impl) {
+    case PJ_SCAN_IMPL_AUTO:
+        /* Tokens in SIP messages are mostly too short for the vector
+         * loops to pay off, the msg_test benchmark parses slightly faster
+         * with the byte loop.
+         */
+        return &scalar_ops;
+    case PJ_SCAN_IMPL_SCALAR:
+        return &scalar_ops;
+    case PJ_SCAN_IMPL_SSE42:
+        return cpu_has_sse42() ? &sse42_ops : NULL;
+    case PJ_SCAN_IMPL_AVX2:
+        return cpu_has_avx2() ? &avx2_ops : NULL;
+    default:
+        return NULL;
+    }
+}
+
+PJ_DEF(pj_status_t) pj_scan_set_impl(pj_scan_impl impl)
+{
+    const scan_ops *op = get_scan_ops(impl);
+
+    if (!op)
+        return PJ_ENOTSUP;
+
+    scan_op = op;
+    PJ_LOG(5,(THIS_FILE, "Using %s scanner", scan_op->name));
+
+    return PJ_SUCCESS;
+}
+
+PJ_DEF(pj_scan_impl) pj_scan_get_impl(void)
+{
+    if (!scan_op)
+        scan_op = get_scan_ops(PJ_SCAN_IMPL_AUTO);
+    return scan_op->impl;
+}
+
+#else   /* PJ_SCANNER_HAS_SIMD */
+
+PJ_DEF(pj_status_t) pj_scan_set_impl(pj_scan_impl impl)
+{
+    return (impl==PJ_SCAN_IMPL_AUTO || impl==PJ_SCAN_IMPL_SCALAR) ?
+           PJ_SUCCESS : PJ_ENOTSUP;
+}
+
+PJ_DEF(pj_scan_impl) pj_scan_get_impl(void)
+{
+    return PJ_SCAN_IMPL_SCALAR;
+}
+
+#endif  /* PJ_SCANNER_HAS_SIMD */
@@ -26,6 +26,9 @@ PJ_DEF(void) pj_cis_buf_init( pj_cis_buf_t *cis_buf)
 {
     pj_bzero(cis_buf->cis_buf, sizeof(cis_buf->cis_buf));
     cis_buf->use_mask = 0;
+#if PJ_SCANNER_HAS_SIMD
+    pj_bzero(cis_buf->simd_tbl, sizeof(cis_buf->simd_tbl));
+#endif
 }
 
 PJ_DEF(pj_status_t) pj_cis_init(pj_cis_buf_t *cis_buf, pj_cis_t *cis)
@@ -62,6 +65,7 @@ PJ_DEF(pj_status_t) pj_cis_dup( pj_cis_t *new_cis, pj_cis_t *existing)
         else
             PJ_CIS_CLR(new_cis, i);
     }
+    cis_update_simd(new_cis);
 
     return PJ_SUCCESS;
 }
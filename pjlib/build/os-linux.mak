@@ -14,7 +14,9 @@ export PJLIB_OBJS += 	addr_resolv_sock.o file_access_unistd.o \
 			os_timestamp_common.o os_timestamp_posix.o \
 			pool_policy_malloc.o sock_bsd.o sock_select.o
 
-ifeq (epoll,$(LINUX_POLL))
+ifeq (uring,$(LINUX_POLL))
+export PJLIB_OBJS += ioqueue_uring.o
+else ifeq (epoll,$(LINUX_POLL))
 export PJLIB_OBJS += ioqueue_epoll.o
 else
 export PJLIB_OBJS += ioqueue_select.o 
@@ -188,6 +188,26 @@ typedef struct pj_activesock_cb
     pj_bool_t (*on_connect_complete)(pj_activesock_t *asock,
                                      pj_status_t status);
 
+    /**
+     * This callback is called instead of \a on_data_recvfrom() to report
+     * the packets received in one go, when the active socket has been
+     * created with \a rx_batch_cnt setting more than one. Errors are still
+     * reported with \a on_data_recvfrom(), if it is set.
+     *
+     * @param asock     The active socket.
+     * @param pkts      The packets received, containing the packet buffer,
+     *                  the packet length, and the source address.
+     * @param count     Number of packets, at least one.
+     *
+     * @return          PJ_TRUE if further read is desired, and PJ_FALSE 
+     *                  when application no longer wants to receive data.
+     *                  Application may destroy the active socket in the
+     *                  callback and return PJ_FALSE here.
+     */
+    pj_bool_t (*on_data_recvfrom_batch)(pj_activesock_t *asock,
+                                        pj_sock_mmsg pkts[],
+                                        unsigned count);
+
 } pj_activesock_cb;
 
 
@@ -254,6 +274,21 @@ typedef struct pj_activesock_cfg
     */
     pj_bool_t sock_cloexec;
 
+    /**
+     * Maximum number of packets to be processed on each read completion of
+     * a datagram socket started with pj_activesock_start_recvfrom(). When
+     * this is more than one, after the ioqueue reports a packet, the active
+     * socket reads the packets that are already queued in the socket with
+     * a single #pj_sock_recvmmsg() call (recvmmsg() on Linux), and reports
+     * them with \a on_data_recvfrom_batch() callback if it is set, or with
+     * \a on_data_recvfrom() one by one otherwise. Each asynchronous read
+     * operation will allocate this number of packet buffers. This is
+     * ignored with the io_uring ioqueue, see #PJ_IOQUEUE_URING_HAS_RX.
+     *
+     * Default value is 1 (no batching).
+     */
+    unsigned rx_batch_cnt;
+
 } pj_activesock_cfg;
 
 
@@ -540,6 +575,42 @@ PJ_DECL(pj_status_t) pj_activesock_sendto(pj_activesock_t *asock,
                                           const pj_sockaddr_t *addr,
                                           int addr_len);
 
+/**
+ * Send several datagrams using the socket. The packets are sent with as
+ * few system calls as possible using #pj_sock_sendmmsg() (sendmmsg() on
+ * Linux). Packets which cannot be sent immediately, for example because
+ * the socket send buffer is full, are sent with pj_activesock_sendto(),
+ * which will queue them to the ioqueue and report their completion with
+ * \a on_data_sent() callback with the corresponding send key.
+ *
+ * Note that packets sent immediately by this function may be sent before
+ * packets from previous pj_activesock_sendto() calls which are still
+ * pending in the ioqueue.
+ *
+ * @param asock     The active socket.
+ * @param send_key  Array of operation keys, one for each packet, to be
+ *                  used for the packets that cannot be sent immediately.
+ *                  The keys must remain valid until the data has been sent.
+ * @param pkts      The packets along with their destination addresses.
+ *                  The packet buffers must remain valid until the data
+ *                  has been sent. Upon return, the \a len field contains
+ *                  the length of data sent for packets that have been sent
+ *                  immediately, or the negated error code for packets that
+ *                  failed to be sent.
+ * @param count     Number of packets.
+ * @param flags     Flags to be given to the send operations.
+ *
+ * @return          PJ_SUCCESS if all packets have been sent immediately,
+ *                  PJ_EPENDING if some packets will be sent later and
+ *                  none has failed, or the error code of the last packet
+ *                  that failed to be sent.
+ */
+PJ_DECL(pj_status_t) pj_activesock_sendto_batch(pj_activesock_t *asock,
+                                                pj_ioqueue_op_key_t *send_key[],
+                                                pj_sock_mmsg pkts[],
+                                                unsigned count,
+                                                unsigned flags);
+
 #if PJ_HAS_TCP
 /**
  * Starts asynchronous socket accept() operations on this active socket. 
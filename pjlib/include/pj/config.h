@@ -605,6 +605,21 @@
 #  define PJ_TIMER_USE_LINKED_LIST    0
 #endif
 
+/**
+ * If enabled, timer heaps created with #pj_timer_heap_create() use the
+ * hierarchical timing wheel (#PJ_TIMER_HEAP_TYPE_WHEEL) instead of the
+ * binary heap. The timing wheel schedules and cancels entries in constant
+ * time, which is better suited for large number of entries that are
+ * mostly cancelled before they expire, such as SIP transaction timers.
+ * Application can also select the type of each timer heap with
+ * #pj_timer_heap_create2().
+ *
+ * Default: 0 (Use binary heap tree)
+ */
+#ifndef PJ_TIMER_USE_WHEEL
+#  define PJ_TIMER_USE_WHEEL    0
+#endif
+
 /**
  * Set this to 1 to enable debugging on the group lock. Default: 0
  */
@@ -774,6 +789,67 @@
 #endif
 
 
+/**
+ * Number of events in the event array of each polling thread, when
+ * PJ_IOQUEUE_EPOLL_BATCH flag is used with epoll ioqueue.
+ *
+ * Default: 256
+ */
+#ifndef PJ_IOQUEUE_EPOLL_BATCH_SIZE
+#   define PJ_IOQUEUE_EPOLL_BATCH_SIZE  256
+#endif
+
+
+/**
+ * Maximum datagram size that can be received by the multishot receive of
+ * the io_uring ioqueue. Datagrams are received by the kernel into buffers
+ * of this size provided by the ioqueue, and larger datagrams are
+ * truncated.
+ *
+ * Default: 4096
+ */
+#ifndef PJ_IOQUEUE_URING_RX_BUF_SIZE
+#   define PJ_IOQUEUE_URING_RX_BUF_SIZE 4096
+#endif
+
+
+/**
+ * Maximum number of receive buffers provided to the kernel by each
+ * io_uring ioqueue. The actual number is eight buffers for each handle
+ * of the ioqueue, up to this value. Set to zero to disable the multishot
+ * receive, the ioqueue then polls the readiness of the datagram sockets
+ * and reads them with recvfrom() like the other ioqueue backends.
+ *
+ * With the multishot receive a read never completes immediately while
+ * the backlog of the socket is empty, it always waits for the next poll.
+ * This removes the receive system call of every datagram, but it slows
+ * down lock-step exchanges where the application reads right after
+ * sending, such as the UDP case of the ioqueue performance test.
+ *
+ * Default: 256
+ */
+#ifndef PJ_IOQUEUE_URING_RX_BUF_CNT
+#   define PJ_IOQUEUE_URING_RX_BUF_CNT  256
+#endif
+
+
+/**
+ * This is set when the io_uring ioqueue is used with the multishot
+ * receive. The ioqueue then takes the datagrams from the registered
+ * sockets as soon as they arrive, so these sockets must not be read
+ * directly, e.g. with #pj_sock_recvmmsg() to read several datagrams at
+ * once, otherwise the datagrams would be received out of order. Reading
+ * several datagrams is not useful anyway, as the ioqueue already receives
+ * them without system calls.
+ */
+#if defined(PJ_HAS_LINUX_IO_URING) && PJ_HAS_LINUX_IO_URING!=0 && \
+    PJ_IOQUEUE_URING_RX_BUF_CNT > 0
+#   define PJ_IOQUEUE_URING_HAS_RX     1
+#else
+#   define PJ_IOQUEUE_URING_HAS_RX     0
+#endif
+
+
 /**
  * Determine if FD_SETSIZE is changeable/set-able. If so, then we will
  * set it to PJ_IOQUEUE_MAX_HANDLES. Currently we detect this by checking
@@ -1150,6 +1226,36 @@
 #endif
 
 
+/**
+ * Specify whether #pj_sock_recvmmsg() and #pj_sock_sendmmsg() should use
+ * the native recvmmsg() and sendmmsg() system calls, which transfer several
+ * datagrams with a single system call. When disabled, the functions are
+ * emulated with a loop of recvfrom() and sendto().
+ *
+ * Default: 1 on Linux, 0 otherwise
+ */
+#ifndef PJ_SOCK_HAS_MMSG
+#   if defined(PJ_LINUX) && PJ_LINUX!=0
+#       define PJ_SOCK_HAS_MMSG             1
+#   else
+#       define PJ_SOCK_HAS_MMSG             0
+#   endif
+#endif
+
+
+/**
+ * Maximum number of datagrams to be transferred by a single call to
+ * #pj_sock_recvmmsg() or #pj_sock_sendmmsg(). Larger requests are
+ * truncated to this value. The message headers are allocated on the
+ * stack, so this affects the stack usage of the functions.
+ *
+ * Default: 64
+ */
+#ifndef PJ_SOCK_MAX_MMSG
+#   define PJ_SOCK_MAX_MMSG                 64
+#endif
+
+
 /**
  * Maximum number of socket options in pj_sockopt_params.
  *
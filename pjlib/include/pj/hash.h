@@ -242,6 +242,188 @@ PJ_DECL(void*) pj_hash_this( pj_hash_table_t *ht,
                              pj_hash_iterator_t *it );
 
 
+/**
+ * @}
+ */
+
+/**
+ * @defgroup PJ_RHASH Resizable Hash Table
+ * @ingroup PJ_DS
+ * @{
+ * The resizable hash table is a variant of the hash table above which is
+ * not limited to the number of buckets given when it is created. It uses
+ * open addressing with linear probing over an array of hash values, so
+ * that a lookup mostly touches one or two cache lines, and it doubles its
+ * capacity when it becomes three quarters full. The entries are moved to
+ * the larger array a few at a time by the following insertions, so no
+ * single insertion has to rehash the whole table.
+ *
+ * The table may optionally be created for concurrent use, in which case
+ * it is split into a number of stripes, each with its own read-write
+ * mutex and its own array, and the functions to get and set values may
+ * be called from multiple threads. Iterating the table is not protected
+ * and must not be done while other threads may modify the table.
+ *
+ * The arrays are allocated from pools created from the factory of the
+ * pool given to #pj_rhash_create(), so the table must be destroyed with
+ * #pj_rhash_destroy().
+ */
+
+/**
+ * Opaque data type for resizable hash tables.
+ */
+typedef struct pj_rhash_table_t pj_rhash_table_t;
+
+/**
+ * Data type for resizable hash table iterator.
+ */
+typedef struct pj_rhash_iterator_t
+{
+    unsigned             stripe;    /**< Internal stripe index.         */
+    unsigned             index;     /**< Internal slot index.           */
+    pj_bool_t            old;       /**< Iterating the old array.       */
+} pj_rhash_iterator_t;
+
+/**
+ * Create a resizable hash table.
+ *
+ * @param pool          The pool to allocate the table and the locks from.
+ *                      The arrays are allocated from pools created from
+ *                      the factory of this pool.
+ * @param size          The expected number of entries. The table starts
+ *                      with enough capacity for this many entries, and
+ *                      grows when needed.
+ * @param concurrency   The number of lock stripes, which will be rounded
+ *                      up to a power of two, up to 256. Specify zero to
+ *                      create a table without any locking, which must
+ *                      then be protected by the application when it is
+ *                      used by multiple threads.
+ * @param p_ht          Pointer to receive the hash table.
+ *
+ * @return              PJ_SUCCESS on success, or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_rhash_create(pj_pool_t *pool, unsigned size,
+                                     unsigned concurrency,
+                                     pj_rhash_table_t **p_ht);
+
+/**
+ * Destroy the hash table, releasing its arrays and locks. The keys copied
+ * to the pools given to #pj_rhash_set() are not released.
+ *
+ * @param ht            The hash table.
+ */
+PJ_DECL(void) pj_rhash_destroy(pj_rhash_table_t *ht);
+
+/**
+ * Get the value associated with the specified key.
+ *
+ * @param ht            The hash table.
+ * @param key           The key to look for.
+ * @param keylen        The length of the key, or PJ_HASH_KEY_STRING to use
+ *                      the string length of the key.
+ * @param hval          If this argument is not NULL and the value is not
+ *                      zero, the value will be used as the computed hash
+ *                      value. If the argument is not NULL and the value
+ *                      is zero, it will be filled with the computed hash
+ *                      upon return.
+ *
+ * @return              The value associated with the key, or NULL if the
+ *                      key is not found.
+ */
+PJ_DECL(void*) pj_rhash_get(pj_rhash_table_t *ht,
+                            const void *key, unsigned keylen,
+                            pj_uint32_t *hval);
+
+/**
+ * Variant of #pj_rhash_get() with the key being converted to lowercase
+ * when calculating the hash value and comparing the keys.
+ *
+ * @see pj_rhash_get()
+ */
+PJ_DECL(void*) pj_rhash_get_lower(pj_rhash_table_t *ht,
+                                  const void *key, unsigned keylen,
+                                  pj_uint32_t *hval);
+
+/**
+ * Associate a value with a key, or delete the key when the value is NULL.
+ *
+ * @param pool          If the key is not yet in the table and the pool is
+ *                      not NULL, the key is copied to this pool. Otherwise
+ *                      the table keeps a reference to the key, which must
+ *                      stay valid for as long as the entry is in the
+ *                      table. When the table is used concurrently, the
+ *                      pool must not be shared by the threads.
+ * @param ht            The hash table.
+ * @param key           The key.
+ * @param keylen        The length of the key, or PJ_HASH_KEY_STRING to use
+ *                      the string length of the key.
+ * @param hval          The hash value of the key, or zero to let the table
+ *                      calculate it.
+ * @param value         The value to be associated, or NULL to delete the
+ *                      entry with the specified key.
+ *
+ * @return              PJ_SUCCESS on success, or PJ_ENOMEM if the table is
+ *                      full and its array could not be grown.
+ */
+PJ_DECL(pj_status_t) pj_rhash_set(pj_pool_t *pool, pj_rhash_table_t *ht,
+                                  const void *key, unsigned keylen,
+                                  pj_uint32_t hval, void *value);
+
+/**
+ * Variant of #pj_rhash_set() with the key being converted to lowercase
+ * when calculating the hash value and comparing the keys.
+ *
+ * @see pj_rhash_set()
+ */
+PJ_DECL(pj_status_t) pj_rhash_set_lower(pj_pool_t *pool,
+                                        pj_rhash_table_t *ht,
+                                        const void *key, unsigned keylen,
+                                        pj_uint32_t hval, void *value);
+
+/**
+ * Get the number of entries in the table.
+ *
+ * @param ht            The hash table.
+ *
+ * @return              The number of entries.
+ */
+PJ_DECL(unsigned) pj_rhash_count(pj_rhash_table_t *ht);
+
+/**
+ * Get the iterator to the first entry in the table.
+ *
+ * @param ht            The hash table.
+ * @param it            The iterator buffer.
+ *
+ * @return              The iterator, or NULL if the table is empty.
+ */
+PJ_DECL(pj_rhash_iterator_t*) pj_rhash_first(pj_rhash_table_t *ht,
+                                             pj_rhash_iterator_t *it);
+
+/**
+ * Get the next entry. The entry of the current iterator may be deleted
+ * before calling this function, but no entry may be added while the table
+ * is being iterated.
+ *
+ * @param ht            The hash table.
+ * @param it            The iterator.
+ *
+ * @return              The iterator, or NULL if there are no more entries.
+ */
+PJ_DECL(pj_rhash_iterator_t*) pj_rhash_next(pj_rhash_table_t *ht,
+                                            pj_rhash_iterator_t *it);
+
+/**
+ * Get the value of the entry of an iterator.
+ *
+ * @param ht            The hash table.
+ * @param it            The iterator.
+ *
+ * @return              The value of the entry.
+ */
+PJ_DECL(void*) pj_rhash_this(pj_rhash_table_t *ht, pj_rhash_iterator_t *it);
+
+
 /**
  * @}
  */
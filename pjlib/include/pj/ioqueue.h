@@ -351,9 +351,50 @@ typedef enum pj_ioqueue_epoll_flag
     PJ_IOQUEUE_EPOLL_AUTO      = PJ_IOQUEUE_EPOLL_EXCLUSIVE |
                                  PJ_IOQUEUE_EPOLL_ONESHOT,
 
+    /**
+     * Dispatch events in batches. Each polling thread owns an event array
+     * of PJ_IOQUEUE_EPOLL_BATCH_SIZE entries, and all keys reported ready
+     * by a single epoll_wait() are dispatched in one pass without taking
+     * the ioqueue lock, and without the PJ_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL
+     * limit. This is suitable for servers with high packet rate polled by
+     * several threads. This option requires PJ_IOQUEUE_HAS_SAFE_UNREG, and
+     * it is ignored otherwise.
+     */
+    PJ_IOQUEUE_EPOLL_BATCH     = 4,
+
 } pj_ioqueue_epoll_flag;
 
 
+/**
+ * Statistics of the ioqueue polling, see #pj_ioqueue_get_stat().
+ */
+typedef struct pj_ioqueue_stat
+{
+    /**
+     * Number of times the polling returned with some events.
+     */
+    pj_uint64_t wakeup_cnt;
+
+    /**
+     * Total number of events returned by the polling. Dividing this with
+     * wakeup_cnt gives the average number of events per wakeup.
+     */
+    pj_uint64_t event_cnt;
+
+    /**
+     * The highest number of events returned by a single polling.
+     */
+    unsigned    max_event_cnt;
+
+    /**
+     * Number of threads which have polled the ioqueue, only counted when
+     * PJ_IOQUEUE_EPOLL_BATCH is used.
+     */
+    unsigned    poller_cnt;
+
+} pj_ioqueue_stat;
+
+
 /**
  * Additional settings that can be given during ioqueue creation. Application
  * MUST initialize this structure with #pj_ioqueue_cfg_default().
@@ -945,6 +986,20 @@ PJ_DECL(pj_status_t) pj_ioqueue_sendto( pj_ioqueue_key_t *key,
 PJ_DECL(pj_oshandle_t) pj_ioqueue_get_os_handle( pj_ioqueue_t *ioqueue );
 
 
+/**
+ * Get the polling statistics of the ioqueue. This is currently only
+ * supported by the epoll backend.
+ *
+ * @param ioqueue       The ioqueue instance.
+ * @param stat          Pointer to receive the statistics.
+ *
+ * @return              PJ_SUCCESS on success, or PJ_ENOTSUP if the
+ *                      ioqueue backend does not support it.
+ */
+PJ_DECL(pj_status_t) pj_ioqueue_get_stat(pj_ioqueue_t *ioqueue,
+                                         pj_ioqueue_stat *stat);
+
+
 /**
  * @}
  */
@@ -317,6 +317,11 @@ extern const pj_uint16_t PJ_TCP_NODELAY;
  *  @see pj_SO_REUSEADDR */
 extern const pj_uint16_t PJ_SO_REUSEADDR;
 
+/** Allows multiple sockets to be bound to the same address, with the
+ *  incoming traffic distributed among them by the kernel. The value is
+ *  0xFFFF when not supported by the platform. @see pj_SO_REUSEPORT */
+extern const pj_uint16_t PJ_SO_REUSEPORT;
+
 /** Do not generate SIGPIPE. @see pj_SO_NOSIGPIPE */
 extern const pj_uint16_t PJ_SO_NOSIGPIPE;
 
@@ -356,6 +361,9 @@ extern const pj_uint16_t PJ_IP_DROP_MEMBERSHIP;
     /** Get #PJ_SO_REUSEADDR constant */
     PJ_DECL(pj_uint16_t) pj_SO_REUSEADDR(void);
 
+    /** Get #PJ_SO_REUSEPORT constant */
+    PJ_DECL(pj_uint16_t) pj_SO_REUSEPORT(void);
+
     /** Get #PJ_SO_NOSIGPIPE constant */
     PJ_DECL(pj_uint16_t) pj_SO_NOSIGPIPE(void);
 
@@ -392,6 +400,9 @@ extern const pj_uint16_t PJ_IP_DROP_MEMBERSHIP;
     /** Get #PJ_SO_REUSEADDR constant */
 #   define pj_SO_REUSEADDR() PJ_SO_REUSEADDR
 
+    /** Get #PJ_SO_REUSEPORT constant */
+#   define pj_SO_REUSEPORT() PJ_SO_REUSEPORT
+
     /** Get #PJ_SO_NOSIGPIPE constant */
 #   define pj_SO_NOSIGPIPE() PJ_SO_NOSIGPIPE
 
@@ -1493,6 +1504,85 @@ PJ_DECL(pj_status_t) pj_sock_sendto(pj_sock_t sockfd,
                                     const pj_sockaddr_t *to,
                                     int tolen);
 
+/**
+ * This structure describes a datagram to be received with
+ * #pj_sock_recvmmsg() or to be sent with #pj_sock_sendmmsg().
+ */
+typedef struct pj_sock_mmsg
+{
+    /**
+     * The packet buffer.
+     */
+    void           *buf;
+
+    /**
+     * For receive, on input this is the size of the buffer, and on return
+     * the length of the packet received. For send, on input this is the
+     * length of the packet, and on return the length of data sent.
+     */
+    pj_ssize_t      len;
+
+    /**
+     * The source address of the packet received, or the destination
+     * address of the packet to be sent.
+     */
+    pj_sockaddr     addr;
+
+    /**
+     * The length of the address. For receive, this is filled upon return.
+     */
+    int             addr_len;
+
+} pj_sock_mmsg;
+
+/**
+ * Receive several datagrams from the socket with a single call. On Linux
+ * this uses recvmmsg() system call (see #PJ_SOCK_HAS_MMSG), otherwise it
+ * calls recvfrom() repeatedly until it would block. The function returns
+ * as soon as no more datagram is immediately available, so it is normally
+ * used with non-blocking sockets.
+ *
+ * @param sockfd        The socket descriptor.
+ * @param msgs          The packets to receive. The \a buf and \a len fields
+ *                      must be set by the caller, the \a len, \a addr and
+ *                      \a addr_len fields will be filled upon return.
+ * @param count         On input, the number of elements in \a msgs, at
+ *                      most #PJ_SOCK_MAX_MMSG will be used. On return,
+ *                      the number of packets received.
+ * @param flags         Flags (such as pj_MSG_PEEK()).
+ *
+ * @return              PJ_SUCCESS if at least one packet has been
+ *                      received, or the error code of the first receive
+ *                      operation (e.g: EWOULDBLOCK when there is no data).
+ */
+PJ_DECL(pj_status_t) pj_sock_recvmmsg(pj_sock_t sockfd,
+                                      pj_sock_mmsg msgs[],
+                                      unsigned *count,
+                                      unsigned flags);
+
+/**
+ * Send several datagrams to the socket with a single call. On Linux this
+ * uses sendmmsg() system call (see #PJ_SOCK_HAS_MMSG), otherwise it calls
+ * sendto() for each packet. Sending stops at the first packet that cannot
+ * be sent.
+ *
+ * @param sockfd        The socket descriptor.
+ * @param msgs          The packets to send along with their destination
+ *                      addresses. Upon return, the \a len field of packets
+ *                      that have been sent contains the length of data sent.
+ * @param count         On input, the number of packets in \a msgs, at most
+ *                      #PJ_SOCK_MAX_MMSG will be used. On return, the
+ *                      number of packets sent.
+ * @param flags         Flags (such as pj_MSG_DONTROUTE()).
+ *
+ * @return              PJ_SUCCESS if at least one packet has been sent,
+ *                      or the error code of the first send operation.
+ */
+PJ_DECL(pj_status_t) pj_sock_sendmmsg(pj_sock_t sockfd,
+                                      pj_sock_mmsg msgs[],
+                                      unsigned *count,
+                                      unsigned flags);
+
 #if PJ_HAS_TCP
 /**
  * The shutdown call causes all or part of a full-duplex connection on the
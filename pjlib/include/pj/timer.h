@@ -126,6 +126,13 @@ typedef struct pj_timer_entry
      */
     pj_timer_id_t _timer_id;
 
+    /**
+     * Internal: index of the shard where this entry is scheduled, when
+     * the timer heap is sharded (see #pj_timer_heap_cfg). Application
+     * should not touch this field.
+     */
+    unsigned _shard;
+
 #if !PJ_TIMER_USE_COPY
     /** 
      * The future time when the timer expires, which the value is updated
@@ -148,6 +155,77 @@ typedef struct pj_timer_entry
 } pj_timer_entry;
 
 
+/**
+ * Types of timer heap implementation.
+ */
+typedef enum pj_timer_heap_type
+{
+    /**
+     * Binary heap, where scheduling and cancelling an entry take
+     * O(log n) time. If PJ_TIMER_USE_LINKED_LIST is enabled, sorted linked
+     * list is used instead.
+     */
+    PJ_TIMER_HEAP_TYPE_HEAP,
+
+    /**
+     * Hierarchical timing wheel with millisecond resolution, where
+     * scheduling and cancelling an entry take O(1) time. Entries which
+     * expire far in the future are moved to finer wheels as the time
+     * approaches. Note that with this type, the next delay returned by
+     * #pj_timer_heap_poll() may be shorter than the time until the
+     * earliest entry expires, in which case polling again simply returns
+     * zero.
+     */
+    PJ_TIMER_HEAP_TYPE_WHEEL
+
+} pj_timer_heap_type;
+
+
+/**
+ * Additional settings that can be given during timer heap creation.
+ * Application MUST initialize this structure with
+ * #pj_timer_heap_cfg_default().
+ */
+typedef struct pj_timer_heap_cfg
+{
+    /**
+     * The timer heap implementation.
+     *
+     * Default: PJ_TIMER_HEAP_TYPE_WHEEL if PJ_TIMER_USE_WHEEL is enabled,
+     * otherwise PJ_TIMER_HEAP_TYPE_HEAP.
+     */
+    pj_timer_heap_type  type;
+
+    /**
+     * Number of shards. If this is greater than one, the timer heap is
+     * split into this many timer heaps of the type above, each with its
+     * own lock, so that threads scheduling, cancelling and polling timers
+     * don't serialize on a single lock. Entries are distributed to the
+     * shards by their group lock (or by the entry itself if it has no
+     * group lock), so entries of the same object stay in the same shard.
+     * Each thread polling the timer heap polls its own shard first, then
+     * the other shards in turn. Each shard processes at most the number
+     * of entries set by #pj_timer_heap_set_max_timed_out_per_poll() in a
+     * poll, so a busy shard does not delay the entries of the others.
+     *
+     * Note that the lock given to #pj_timer_heap_set_lock() is not used
+     * to protect the entries of a sharded timer heap, since each shard
+     * has its own lock.
+     *
+     * Default: 1
+     */
+    unsigned            shard_cnt;
+
+} pj_timer_heap_cfg;
+
+
+/**
+ * Initialize the timer heap configuration with the default values.
+ *
+ * @param cfg       The configuration to be initialized.
+ */
+PJ_DECL(void) pj_timer_heap_cfg_default(pj_timer_heap_cfg *cfg);
+
 /**
  * Calculate memory size required to create a timer heap.
  *
@@ -175,6 +253,27 @@ PJ_DECL(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
                                            pj_size_t count,
                                            pj_timer_heap_t **ht);
 
+/**
+ * Create a timer heap with the specified settings.
+ *
+ * @param pool      The pool where allocations in the timer heap will be
+ *                  allocated.
+ * @param count     The maximum number of timer entries to be supported
+ *                  initially. If the application registers more entries
+ *                  during runtime, then the timer heap will resize.
+ * @param cfg       Optional timer heap configuration. Application must
+ *                  initialize this structure with pj_timer_heap_cfg_default()
+ *                  first. If this is not specified, default config values
+ *                  will be used.
+ * @param ht        Pointer to receive the created timer heap.
+ *
+ * @return          PJ_SUCCESS, or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_timer_heap_create2( pj_pool_t *pool,
+                                            pj_size_t count,
+                                            const pj_timer_heap_cfg *cfg,
+                                            pj_timer_heap_t **ht);
+
 /**
  * Destroy the timer heap.
  *
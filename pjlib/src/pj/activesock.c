@@ -57,6 +57,7 @@ struct read_op
     pj_size_t            size;
     pj_sockaddr          src_addr;
     int                  src_addr_len;
+    pj_sock_mmsg        *batch;
 };
 
 struct accept_op
@@ -78,6 +79,7 @@ struct send_data
 struct pj_activesock_t
 {
     pj_ioqueue_key_t    *key;
+    pj_sock_t            sock;
     pj_bool_t            stream_oriented;
     pj_bool_t            whole_data;
     pj_ioqueue_t        *ioqueue;
@@ -89,7 +91,6 @@ struct pj_activesock_t
 #if defined(PJ_IPHONE_OS_HAS_MULTITASKING_SUPPORT) && \
     PJ_IPHONE_OS_HAS_MULTITASKING_SUPPORT!=0
     int                  bg_setting;
-    pj_sock_t            sock;
     CFReadStreamRef      readStream;
 #endif
     
@@ -101,6 +102,7 @@ struct pj_activesock_t
     struct read_op      *read_op;
     pj_uint32_t          read_flags;
     enum read_type       read_type;
+    unsigned             rx_batch_cnt;
 
     struct accept_op    *accept_op;
 };
@@ -128,6 +130,7 @@ PJ_DEF(void) pj_activesock_cfg_default(pj_activesock_cfg *cfg)
     cfg->concurrency = -1;
     cfg->whole_data = PJ_TRUE;
     cfg->sock_cloexec = PJ_TRUE;
+    cfg->rx_batch_cnt = 1;
 }
 
 #if defined(PJ_IPHONE_OS_HAS_MULTITASKING_SUPPORT) && \
@@ -201,12 +204,21 @@ PJ_DEF(pj_status_t) pj_activesock_create( pj_pool_t *pool,
     PJ_ASSERT_RETURN((sock_type & 0xF)==pj_SOCK_STREAM() ||
                      (sock_type & 0xF)==pj_SOCK_DGRAM(), PJ_EINVAL);
     PJ_ASSERT_RETURN(!opt || opt->async_cnt >= 1, PJ_EINVAL);
+    PJ_ASSERT_RETURN(!opt || opt->rx_batch_cnt >= 1, PJ_EINVAL);
 
     asock = PJ_POOL_ZALLOC_T(pool, pj_activesock_t);
     asock->ioqueue = ioqueue;
+    asock->sock = sock;
     asock->stream_oriented = ((sock_type & 0xF) == pj_SOCK_STREAM());
     asock->async_count = (opt? opt->async_cnt : 1);
     asock->whole_data = (opt? opt->whole_data : 1);
+    asock->rx_batch_cnt = (opt? opt->rx_batch_cnt : 1);
+    if (asock->rx_batch_cnt > PJ_SOCK_MAX_MMSG + 1)
+        asock->rx_batch_cnt = PJ_SOCK_MAX_MMSG + 1;
+#if PJ_IOQUEUE_URING_HAS_RX
+    /* The ioqueue receives the datagrams itself */
+    asock->rx_batch_cnt = 1;
+#endif
     asock->max_loop = PJ_ACTIVESOCK_MAX_LOOP;
     asock->user_data = user_data;
     pj_memcpy(&asock->cb, cb, sizeof(*cb));
@@ -236,7 +248,6 @@ PJ_DEF(pj_status_t) pj_activesock_create( pj_pool_t *pool,
 
 #if defined(PJ_IPHONE_OS_HAS_MULTITASKING_SUPPORT) && \
     PJ_IPHONE_OS_HAS_MULTITASKING_SUPPORT!=0
-    asock->sock = sock;
     asock->bg_setting = PJ_ACTIVESOCK_TCP_IPHONE_OS_BG;
 #endif
 
@@ -450,6 +461,18 @@ PJ_DEF(pj_status_t) pj_activesock_start_recvfrom2( pj_activesock_t *asock,
         size_to_read = r->max_size = buff_size;
         r->src_addr_len = sizeof(r->src_addr);
 
+        if (asock->rx_batch_cnt > 1) {
+            unsigned j;
+
+            /* The first packet is the one read by the ioqueue */
+            r->batch = (pj_sock_mmsg*)
+                       pj_pool_calloc(pool, asock->rx_batch_cnt,
+                                      sizeof(pj_sock_mmsg));
+            r->batch[0].buf = r->pkt;
+            for (j=1; j<asock->rx_batch_cnt; ++j)
+                r->batch[j].buf = pj_pool_alloc(pool, buff_size);
+        }
+
         status = pj_ioqueue_recvfrom(asock->key, &r->op_key, r->pkt,
                                      &size_to_read, 
                                      PJ_IOQUEUE_ALWAYS_ASYNC | flags,
@@ -464,6 +487,61 @@ PJ_DEF(pj_status_t) pj_activesock_start_recvfrom2( pj_activesock_t *asock,
 }
 
 
+/* Read the packets already queued in the socket following the packet that
+ * has just been read by the ioqueue, and report them all to application.
+ * The drained argument is set when the socket has no more packets.
+ * Returns the callback return value.
+ */
+static pj_bool_t read_batch(pj_activesock_t *asock, struct read_op *r,
+                            pj_bool_t *drained)
+{
+    pj_sock_mmsg *pkts = r->batch;
+    unsigned i, cnt, pkt_cnt;
+    pj_status_t status;
+
+    pkts[0].len = r->size;
+    pj_memcpy(&pkts[0].addr, &r->src_addr, r->src_addr_len);
+    pkts[0].addr_len = r->src_addr_len;
+
+    for (i=1; i<asock->rx_batch_cnt; ++i)
+        pkts[i].len = r->max_size;
+
+    cnt = asock->rx_batch_cnt - 1;
+    status = pj_sock_recvmmsg(asock->sock, &pkts[1], &cnt, 0);
+    if (status != PJ_SUCCESS) {
+        /* Errors (e.g: ICMP errors) will be reported by the next read */
+        cnt = 0;
+    }
+    *drained = (cnt < asock->rx_batch_cnt - 1);
+
+    /* Skip zero length datagrams, as with single packet reads */
+    for (i=1, pkt_cnt=1; i<=cnt; ++i) {
+        if (pkts[i].len <= 0)
+            continue;
+        if (i != pkt_cnt) {
+            pj_sock_mmsg tmp = pkts[pkt_cnt];
+            pkts[pkt_cnt] = pkts[i];
+            pkts[i] = tmp;
+        }
+        ++pkt_cnt;
+    }
+
+    if (asock->cb.on_data_recvfrom_batch)
+        return (*asock->cb.on_data_recvfrom_batch)(asock, pkts, pkt_cnt);
+
+    for (i=0; i<pkt_cnt && asock->cb.on_data_recvfrom; ++i) {
+        if (!(*asock->cb.on_data_recvfrom)(asock, pkts[i].buf,
+                                           pkts[i].len, &pkts[i].addr,
+                                           pkts[i].addr_len, PJ_SUCCESS))
+        {
+            return PJ_FALSE;
+        }
+        if (asock->shutdown & SHUT_RX)
+            break;
+    }
+    return PJ_TRUE;
+}
+
 static void ioqueue_on_read_complete(pj_ioqueue_key_t *key, 
                                      pj_ioqueue_op_key_t *op_key, 
                                      pj_ssize_t bytes_read)
@@ -481,6 +559,7 @@ static void ioqueue_on_read_complete(pj_ioqueue_key_t *key,
 
     do {
         unsigned flags;
+        pj_bool_t drained = PJ_FALSE;
 
         if (bytes_read > 0) {
             /*
@@ -514,6 +593,8 @@ static void ioqueue_on_read_complete(pj_ioqueue_key_t *key,
                                    "activesock on_data_read()."));
                         remainder = 0;
                     });
+            } else if (asock->read_type == TYPE_RECV_FROM && r->batch) {
+                ret = read_batch(asock, r, &drained);
             } else if (asock->read_type == TYPE_RECV_FROM && 
                        asock->cb.on_data_recvfrom) 
             {
@@ -636,6 +717,12 @@ static void ioqueue_on_read_complete(pj_ioqueue_key_t *key,
         if (++loop >= asock->max_loop)
             flags |= PJ_IOQUEUE_ALWAYS_ASYNC;
 
+        /* No need to try reading immediately when the batch read has
+         * emptied the socket.
+         */
+        if (drained)
+            flags |= PJ_IOQUEUE_ALWAYS_ASYNC;
+
         if (asock->read_type == TYPE_RECV) {
             status = pj_ioqueue_recv(key, op_key, r->pkt + r->size, 
                                      &bytes_read, flags);
@@ -758,6 +845,58 @@ PJ_DEF(pj_status_t) pj_activesock_sendto( pj_activesock_t *asock,
 }
 
 
+PJ_DEF(pj_status_t) pj_activesock_sendto_batch(pj_activesock_t *asock,
+                                               pj_ioqueue_op_key_t *send_key[],
+                                               pj_sock_mmsg pkts[],
+                                               unsigned count,
+                                               unsigned flags)
+{
+    unsigned i = 0;
+    pj_status_t status = PJ_SUCCESS;
+    pj_bool_t pending = PJ_FALSE;
+
+    PJ_ASSERT_RETURN(asock && send_key && pkts, PJ_EINVAL);
+    PJ_ASSERT_RETURN(!asock->stream_oriented, PJ_EINVALIDOP);
+
+    if (asock->shutdown & SHUT_TX)
+        return PJ_EINVALIDOP;
+
+    /* Send as many packets as possible with the batch send */
+    while (i < count) {
+        unsigned cnt = count - i;
+
+        if (pj_sock_sendmmsg(asock->sock, &pkts[i], &cnt,
+                             flags) != PJ_SUCCESS)
+        {
+            break;
+        }
+        i += cnt;
+    }
+
+    /* Send the rest one by one, letting the ioqueue queue them if the
+     * socket would block, or to get the error of each packet.
+     */
+    for (; i<count; ++i) {
+        pj_status_t st;
+
+        st = pj_activesock_sendto(asock, send_key[i], pkts[i].buf,
+                                  &pkts[i].len, flags, &pkts[i].addr,
+                                  pkts[i].addr_len);
+        if (st == PJ_EPENDING) {
+            pending = PJ_TRUE;
+        } else if (st != PJ_SUCCESS) {
+            pkts[i].len = -st;
+            status = st;
+        }
+    }
+
+    if (status == PJ_SUCCESS && pending)
+        status = PJ_EPENDING;
+
+    return status;
+}
+
+
 static void ioqueue_on_write_complete(pj_ioqueue_key_t *key, 
                                       pj_ioqueue_op_key_t *op_key,
                                       pj_ssize_t bytes_sent)
@@ -23,6 +23,7 @@
 #include <pj/os.h>
 #include <pj/ctype.h>
 #include <pj/assert.h>
+#include <pj/errno.h>
 
 /**
  * The hash multiplier used to calculate hash value.
@@ -362,3 +363,504 @@ void pj_hash_dump_collision( pj_hash_table_t *ht )
 #endif
 
 
+
+
+/*
+ * Resizable hash table.
+ */
+
+/* Tags of empty and deleted slots. The tag of an entry is its hash value,
+ * moved out of the way of these two.
+ */
+#define RHASH_EMPTY         0
+#define RHASH_DELETED       1
+#define RHASH_TAG(hash)     ((hash) < 2 ? (hash) + 2 : (hash))
+
+/* Minimum capacity of the array of a stripe. */
+#define RHASH_MIN_CAPACITY  16
+
+/* Number of slots of the old array that are moved by each insertion
+ * while the table is being resized.
+ */
+#define RHASH_MIGRATE_STEP  8
+
+/* Maximum number of lock stripes. */
+#define RHASH_MAX_STRIPE    256
+
+typedef struct rhash_slot
+{
+    const void  *key;
+    void        *value;
+    unsigned     keylen;
+} rhash_slot;
+
+/* An array of slots. The tags are kept apart from the slots so that
+ * probing only needs to read the tags.
+ */
+typedef struct rhash_array
+{
+    pj_pool_t   *pool;
+    unsigned     mask;
+    pj_uint32_t *tag;
+    rhash_slot  *slot;
+} rhash_array;
+
+typedef struct rhash_stripe
+{
+    pj_rwmutex_t *lock;
+    unsigned     count;         /* Entries in both arrays.              */
+    unsigned     used;          /* Entries and deleted slots in cur.    */
+    rhash_array  cur;           /* The array receiving new entries.     */
+    rhash_array  old;           /* The array being moved, if any.       */
+    unsigned     old_pos;       /* The next slot of old to move.        */
+} rhash_stripe;
+
+struct pj_rhash_table_t
+{
+    pj_pool_factory *factory;
+    unsigned         stripe_cnt;
+    unsigned         stripe_shift;
+    rhash_stripe    *stripe;
+};
+
+/* Spread the bits of the hash, since the multiplicative hash leaves the
+ * low bits of short keys poorly distributed for linear probing.
+ */
+static pj_uint32_t rhash_mix(pj_uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+static pj_uint32_t rhash_calc(const void *key, unsigned *keylen,
+                              pj_uint32_t hval, pj_bool_t lower)
+{
+    const pj_uint8_t *p = (const pj_uint8_t*)key;
+
+    if (*keylen == PJ_HASH_KEY_STRING)
+        *keylen = (unsigned)pj_ansi_strlen((const char*)key);
+
+    if (hval == 0) {
+        const pj_uint8_t *end = p + *keylen;
+
+        for ( ; p != end; ++p) {
+            if (lower)
+                hval = hval * PJ_HASH_MULTIPLIER + pj_tolower(*p);
+            else
+                hval = hval * PJ_HASH_MULTIPLIER + *p;
+        }
+    }
+
+    return hval;
+}
+
+static pj_status_t rhash_array_create(pj_pool_factory *factory,
+                                      unsigned capacity, rhash_array *arr)
+{
+    pj_size_t size;
+
+    size = capacity * (sizeof(pj_uint32_t) + sizeof(rhash_slot));
+    arr->pool = pj_pool_create(factory, "rhash%p", size + 256, 256, NULL);
+    if (!arr->pool)
+        return PJ_ENOMEM;
+
+    arr->mask = capacity - 1;
+    arr->tag = (pj_uint32_t*)
+               pj_pool_calloc(arr->pool, capacity, sizeof(pj_uint32_t));
+    arr->slot = (rhash_slot*)
+                pj_pool_alloc(arr->pool, capacity * sizeof(rhash_slot));
+
+    return PJ_SUCCESS;
+}
+
+static void rhash_array_destroy(rhash_array *arr)
+{
+    if (arr->pool)
+        pj_pool_release(arr->pool);
+    pj_bzero(arr, sizeof(*arr));
+}
+
+/* Find the slot of the key in the array. Returns the index of the slot,
+ * or -1 if it is not found, in which case p_free receives the slot where
+ * the key may be inserted.
+ */
+static int rhash_find(const rhash_array *arr, pj_uint32_t tag,
+                      const void *key, unsigned keylen, pj_bool_t lower,
+                      unsigned *p_free)
+{
+    unsigned i = rhash_mix(tag) & arr->mask;
+    unsigned first_deleted = (unsigned)-1;
+
+    for (;;) {
+        pj_uint32_t t = arr->tag[i];
+
+        if (t == RHASH_EMPTY) {
+            if (p_free)
+                *p_free = (first_deleted != (unsigned)-1) ? first_deleted : i;
+            return -1;
+        }
+
+        if (t == tag) {
+            const rhash_slot *s = &arr->slot[i];
+            if (s->keylen == keylen &&
+                ((lower && pj_ansi_strnicmp((const char*)s->key,
+                                            (const char*)key, keylen)==0) ||
+                 (!lower && pj_memcmp(s->key, key, keylen)==0)))
+            {
+                return (int)i;
+            }
+        } else if (t == RHASH_DELETED && first_deleted == (unsigned)-1) {
+            first_deleted = i;
+        }
+
+        i = (i + 1) & arr->mask;
+    }
+}
+
+/* Put an entry which is known not to be in the table to the current
+ * array of the stripe.
+ */
+static void rhash_put(rhash_stripe *st, pj_uint32_t tag, const void *key,
+                      unsigned keylen, void *value)
+{
+    unsigned i = rhash_mix(tag) & st->cur.mask;
+
+    while (st->cur.tag[i] > RHASH_DELETED)
+        i = (i + 1) & st->cur.mask;
+
+    if (st->cur.tag[i] == RHASH_EMPTY)
+        ++st->used;
+    st->cur.tag[i] = tag;
+    st->cur.slot[i].key = key;
+    st->cur.slot[i].keylen = keylen;
+    st->cur.slot[i].value = value;
+}
+
+/* Move some entries from the old array to the current array. */
+static void rhash_migrate(rhash_stripe *st, unsigned cnt)
+{
+    if (!st->old.pool)
+        return;
+
+    while (cnt-- && st->old_pos <= st->old.mask) {
+        pj_uint32_t t = st->old.tag[st->old_pos];
+
+        if (t > RHASH_DELETED) {
+            const rhash_slot *s = &st->old.slot[st->old_pos];
+            rhash_put(st, t, s->key, s->keylen, s->value);
+            /* Keep the probe sequences of the old array intact. */
+            st->old.tag[st->old_pos] = RHASH_DELETED;
+        }
+        ++st->old_pos;
+    }
+
+    if (st->old_pos > st->old.mask)
+        rhash_array_destroy(&st->old);
+}
+
+/* Start moving the entries to a new array, which is twice as big unless
+ * most of the used slots of the current array are deleted ones.
+ */
+static pj_status_t rhash_grow(pj_rhash_table_t *ht, rhash_stripe *st)
+{
+    rhash_array arr;
+    unsigned capacity = st->cur.mask + 1;
+    pj_status_t status;
+
+    /* Finish the previous resize first. */
+    rhash_migrate(st, (unsigned)-1);
+
+    if (st->count >= capacity / 2)
+        capacity *= 2;
+
+    status = rhash_array_create(ht->factory, capacity, &arr);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    st->old = st->cur;
+    st->old_pos = 0;
+    st->cur = arr;
+    st->used = 0;
+
+    rhash_migrate(st, RHASH_MIGRATE_STEP);
+    return PJ_SUCCESS;
+}
+
+static rhash_stripe *rhash_get_stripe(pj_rhash_table_t *ht, pj_uint32_t tag)
+{
+    if (ht->stripe_cnt == 1)
+        return ht->stripe;
+    return &ht->stripe[(pj_uint32_t)(tag * 2654435761U) >> ht->stripe_shift];
+}
+
+PJ_DEF(pj_status_t) pj_rhash_create(pj_pool_t *pool, unsigned size,
+                                    unsigned concurrency,
+                                    pj_rhash_table_t **p_ht)
+{
+    pj_rhash_table_t *ht;
+    unsigned stripe_cnt, capacity, i;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(pool && p_ht, PJ_EINVAL);
+    PJ_ASSERT_RETURN(concurrency <= RHASH_MAX_STRIPE, PJ_EINVAL);
+
+    ht = PJ_POOL_ZALLOC_T(pool, pj_rhash_table_t);
+    ht->factory = pool->factory;
+
+    stripe_cnt = 1;
+    ht->stripe_shift = 32;
+    while (stripe_cnt < concurrency) {
+        stripe_cnt <<= 1;
+        --ht->stripe_shift;
+    }
+    ht->stripe_cnt = stripe_cnt;
+    ht->stripe = (rhash_stripe*)
+                 pj_pool_calloc(pool, stripe_cnt, sizeof(rhash_stripe));
+
+    /* Start with the array of each stripe at most half full. */
+    capacity = RHASH_MIN_CAPACITY;
+    while (capacity * stripe_cnt < size * 2)
+        capacity <<= 1;
+
+    for (i = 0; i < stripe_cnt; ++i) {
+        rhash_stripe *st = &ht->stripe[i];
+
+        status = rhash_array_create(ht->factory, capacity, &st->cur);
+        if (status == PJ_SUCCESS && concurrency)
+            status = pj_rwmutex_create(pool, "rhash%p", &st->lock);
+        if (status != PJ_SUCCESS) {
+            pj_rhash_destroy(ht);
+            return status;
+        }
+    }
+
+    *p_ht = ht;
+    return PJ_SUCCESS;
+}
+
+PJ_DEF(void) pj_rhash_destroy(pj_rhash_table_t *ht)
+{
+    unsigned i;
+
+    PJ_ASSERT_ON_FAIL(ht, return);
+
+    for (i = 0; i < ht->stripe_cnt; ++i) {
+        rhash_stripe *st = &ht->stripe[i];
+
+        if (st->lock)
+            pj_rwmutex_destroy(st->lock);
+        rhash_array_destroy(&st->old);
+        rhash_array_destroy(&st->cur);
+        pj_bzero(st, sizeof(*st));
+    }
+}
+
+static void *rhash_get(pj_rhash_table_t *ht, const void *key,
+                       unsigned keylen, pj_uint32_t *hval, pj_bool_t lower)
+{
+    pj_uint32_t hash, tag;
+    rhash_stripe *st;
+    void *value = NULL;
+    int i;
+
+    hash = rhash_calc(key, &keylen, hval ? *hval : 0, lower);
+    if (hval)
+        *hval = hash;
+    tag = RHASH_TAG(hash);
+    st = rhash_get_stripe(ht, tag);
+
+    if (st->lock)
+        pj_rwmutex_lock_read(st->lock);
+
+    i = rhash_find(&st->cur, tag, key, keylen, lower, NULL);
+    if (i >= 0) {
+        value = st->cur.slot[i].value;
+    } else if (st->old.pool) {
+        i = rhash_find(&st->old, tag, key, keylen, lower, NULL);
+        if (i >= 0)
+            value = st->old.slot[i].value;
+    }
+
+    if (st->lock)
+        pj_rwmutex_unlock_read(st->lock);
+
+    return value;
+}
+
+static pj_status_t rhash_set(pj_pool_t *pool, pj_rhash_table_t *ht,
+                             const void *key, unsigned keylen,
+                             pj_uint32_t hval, void *value, pj_bool_t lower)
+{
+    pj_uint32_t tag;
+    rhash_stripe *st;
+    unsigned free_slot;
+    int i;
+    pj_status_t status = PJ_SUCCESS;
+
+    tag = RHASH_TAG(rhash_calc(key, &keylen, hval, lower));
+    st = rhash_get_stripe(ht, tag);
+
+    if (st->lock)
+        pj_rwmutex_lock_write(st->lock);
+
+    /* Update or delete the entry where it is. */
+    i = rhash_find(&st->cur, tag, key, keylen, lower, &free_slot);
+    if (i >= 0) {
+        if (value) {
+            st->cur.slot[i].value = value;
+        } else {
+            st->cur.tag[i] = RHASH_DELETED;
+            --st->count;
+        }
+        goto on_return;
+    }
+
+    if (st->old.pool) {
+        i = rhash_find(&st->old, tag, key, keylen, lower, NULL);
+        if (i >= 0) {
+            if (value) {
+                st->old.slot[i].value = value;
+            } else {
+                st->old.tag[i] = RHASH_DELETED;
+                --st->count;
+            }
+            goto on_return;
+        }
+    }
+
+    if (value == NULL)
+        goto on_return;
+
+    /* Insert new entry, keeping at least one slot empty so that the
+     * probing always terminates.
+     */
+    if (st->cur.tag[free_slot] == RHASH_EMPTY && st->used >= st->cur.mask) {
+        status = PJ_ENOMEM;
+        goto on_return;
+    }
+
+    if (pool) {
+        void *k = pj_pool_alloc(pool, keylen);
+        pj_memcpy(k, key, keylen);
+        key = k;
+    }
+
+    if (st->cur.tag[free_slot] == RHASH_EMPTY)
+        ++st->used;
+    st->cur.tag[free_slot] = tag;
+    st->cur.slot[free_slot].key = key;
+    st->cur.slot[free_slot].keylen = keylen;
+    st->cur.slot[free_slot].value = value;
+    ++st->count;
+
+    rhash_migrate(st, RHASH_MIGRATE_STEP);
+
+    /* Grow when three quarters of the slots are used. Failing to grow is
+     * not fatal until the array is full.
+     */
+    if (st->used >= (st->cur.mask + 1) / 4 * 3)
+        rhash_grow(ht, st);
+
+on_return:
+    if (st->lock)
+        pj_rwmutex_unlock_write(st->lock);
+
+    return status;
+}
+
+PJ_DEF(void*) pj_rhash_get(pj_rhash_table_t *ht,
+                           const void *key, unsigned keylen,
+                           pj_uint32_t *hval)
+{
+    return rhash_get(ht, key, keylen, hval, PJ_FALSE);
+}
+
+PJ_DEF(void*) pj_rhash_get_lower(pj_rhash_table_t *ht,
+                                 const void *key, unsigned keylen,
+                                 pj_uint32_t *hval)
+{
+    return rhash_get(ht, key, keylen, hval, PJ_TRUE);
+}
+
+PJ_DEF(pj_status_t) pj_rhash_set(pj_pool_t *pool, pj_rhash_table_t *ht,
+                                 const void *key, unsigned keylen,
+                                 pj_uint32_t hval, void *value)
+{
+    return rhash_set(pool, ht, key, keylen, hval, value, PJ_FALSE);
+}
+
+PJ_DEF(pj_status_t) pj_rhash_set_lower(pj_pool_t *pool,
+                                       pj_rhash_table_t *ht,
+                                       const void *key, unsigned keylen,
+                                       pj_uint32_t hval, void *value)
+{
+    return rhash_set(pool, ht, key, keylen, hval, value, PJ_TRUE);
+}
+
+PJ_DEF(unsigned) pj_rhash_count(pj_rhash_table_t *ht)
+{
+    unsigned i, count = 0;
+
+    for (i = 0; i < ht->stripe_cnt; ++i)
+        count += ht->stripe[i].count;
+
+    return count;
+}
+
+/* Move the iterator to the next entry, starting from its current slot. */
+static pj_rhash_iterator_t *rhash_scan(pj_rhash_table_t *ht,
+                                       pj_rhash_iterator_t *it)
+{
+    for (; it->stripe < ht->stripe_cnt; ++it->stripe) {
+        rhash_stripe *st = &ht->stripe[it->stripe];
+
+        for (;;) {
+            const rhash_array *arr = it->old ? &st->old : &st->cur;
+
+            if (arr->pool) {
+                for (; it->index <= arr->mask; ++it->index) {
+                    if (arr->tag[it->index] > RHASH_DELETED)
+                        return it;
+                }
+            }
+
+            if (it->old)
+                break;
+            it->old = PJ_TRUE;
+            it->index = 0;
+        }
+
+        it->old = PJ_FALSE;
+        it->index = 0;
+    }
+
+    return NULL;
+}
+
+PJ_DEF(pj_rhash_iterator_t*) pj_rhash_first(pj_rhash_table_t *ht,
+                                            pj_rhash_iterator_t *it)
+{
+    it->stripe = 0;
+    it->index = 0;
+    it->old = PJ_FALSE;
+    return rhash_scan(ht, it);
+}
+
+PJ_DEF(pj_rhash_iterator_t*) pj_rhash_next(pj_rhash_table_t *ht,
+                                           pj_rhash_iterator_t *it)
+{
+    ++it->index;
+    return rhash_scan(ht, it);
+}
+
+PJ_DEF(void*) pj_rhash_this(pj_rhash_table_t *ht, pj_rhash_iterator_t *it)
+{
+    const rhash_stripe *st = &ht->stripe[it->stripe];
+    const rhash_array *arr = it->old ? &st->old : &st->cur;
+
+    return arr->slot[it->index].value;
+}
@@ -196,3 +196,11 @@ PJ_DEF(pj_oshandle_t) pj_ioqueue_get_os_handle( pj_ioqueue_t *ioqueue )
     PJ_UNUSED_ARG(ioqueue);
     return NULL;
 }
+
+PJ_DEF(pj_status_t) pj_ioqueue_get_stat(pj_ioqueue_t *ioqueue,
+                                        pj_ioqueue_stat *stat)
+{
+    PJ_UNUSED_ARG(ioqueue);
+    PJ_UNUSED_ARG(stat);
+    return PJ_ENOTSUP;
+}
@@ -94,6 +94,20 @@ struct queue
     enum ioqueue_event_type  event_type;
 };
 
+/*
+ * The event arrays of a polling thread, used with PJ_IOQUEUE_EPOLL_BATCH.
+ * Each thread only updates its own statistics, so no lock is needed.
+ */
+struct poller
+{
+    PJ_DECL_LIST_MEMBER(struct poller);
+    struct epoll_event      *events;
+    struct queue            *queue;
+    pj_uint64_t              wakeup_cnt;
+    pj_uint64_t              event_cnt;
+    unsigned                 max_event_cnt;
+};
+
 /*
  * This describes the I/O queue.
  */
@@ -113,6 +127,16 @@ struct pj_ioqueue_t
     pj_ioqueue_key_t    closing_list;
     pj_ioqueue_key_t    free_list;
 #endif
+
+    /* Polling statistics of the non-batch mode, protected by ioqueue lock */
+    pj_ioqueue_stat     stat;
+
+    /* PJ_IOQUEUE_EPOLL_BATCH: the pollers, and the thread local to find the
+     * poller of the calling thread.
+     */
+    pj_pool_t          *poller_pool;
+    long                poller_tls_id;
+    struct poller       poller_list;
 };
 
 /* Include implementation for common abstraction after we declare
@@ -305,6 +329,9 @@ PJ_DEF(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool,
     ioqueue->max = max_fd;
     ioqueue->count = 0;
     pj_list_init(&ioqueue->active_list);
+    pj_bzero(&ioqueue->stat, sizeof(ioqueue->stat));
+    ioqueue->poller_pool = NULL;
+    pj_list_init(&ioqueue->poller_list);
 
     /* Adjust/validate epoll type according to supported epoll types.
      */
@@ -326,6 +353,27 @@ PJ_DEF(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool,
         return PJ_EINVAL;
     }
 
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+    if (ioqueue->cfg.epoll_flags & PJ_IOQUEUE_EPOLL_BATCH) {
+        /* Pollers are created by the polling threads, so they need their
+         * own pool.
+         */
+        ioqueue->poller_pool = pj_pool_create(pool->factory, "ioqpoll%p",
+                                              4000, 4000, NULL);
+        if (!ioqueue->poller_pool)
+            return PJ_ENOMEM;
+
+        rc = pj_thread_local_alloc(&ioqueue->poller_tls_id);
+        if (rc != PJ_SUCCESS) {
+            pj_pool_release(ioqueue->poller_pool);
+            return rc;
+        }
+    }
+#else
+    /* Batch mode needs the keys to stay valid without the ioqueue lock */
+    ioqueue->cfg.epoll_flags &= ~PJ_IOQUEUE_EPOLL_BATCH;
+#endif
+
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
     /* When safe unregistration is used (the default), we pre-create
      * all keys and put them in the free list.
@@ -433,6 +481,13 @@ PJ_DEF(pj_status_t) pj_ioqueue_destroy(pj_ioqueue_t *ioqueue)
 
     pj_mutex_destroy(ioqueue->ref_cnt_mutex);
 #endif
+
+    if (ioqueue->poller_pool) {
+        pj_thread_local_free(ioqueue->poller_tls_id);
+        pj_pool_release(ioqueue->poller_pool);
+        ioqueue->poller_pool = NULL;
+    }
+
     return ioqueue_destroy(ioqueue);
 }
 
@@ -658,8 +713,13 @@ PJ_DEF(pj_status_t) pj_ioqueue_unregister( pj_ioqueue_key_t *key)
 
 
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
-    /* Mark key is closing. */
+    /* Mark key is closing. This is done with the reference counter mutex
+     * held, since batch polling checks this flag and takes the group lock
+     * reference under that mutex instead of the ioqueue lock.
+     */
+    pj_mutex_lock(ioqueue->ref_cnt_mutex);
     key->closing = 1;
+    pj_mutex_unlock(ioqueue->ref_cnt_mutex);
 
     /* Decrement counter. */
     decrement_counter(key);
@@ -818,6 +878,276 @@ static void scan_closing_keys(pj_ioqueue_t *ioqueue)
 }
 #endif
 
+/*
+ * Get the event to be dispatched for the epoll events reported for the key.
+ * If there is nothing to dispatch, NO_EVENT is returned, and rearm is set if
+ * the key should be rearmed when EPOLLONESHOT is used.
+ */
+static enum ioqueue_event_type get_event_type(pj_ioqueue_key_t *h,
+                                              pj_uint32_t events,
+                                              pj_bool_t *rearm)
+{
+    *rearm = PJ_FALSE;
+
+    /*
+     * Check readability.
+     */
+    if ((events & EPOLLIN) && 
+        (key_has_pending_read(h) || key_has_pending_accept(h)) && !IS_CLOSING(h) ) {
+        return READABLE_EVENT;
+    }
+
+    /*
+     * Check for writeability.
+     */
+    if ((events & EPOLLOUT) && key_has_pending_write(h) && !IS_CLOSING(h)) {
+        return WRITEABLE_EVENT;
+    }
+
+#if PJ_HAS_TCP
+    /*
+     * Check for completion of connect() operation.
+     */
+    if ((events & EPOLLOUT) && (h->connecting) && !IS_CLOSING(h)) {
+        return WRITEABLE_EVENT;
+    }
+#endif /* PJ_HAS_TCP */
+
+    /*
+     * Check for error condition.
+     */
+    if ((events & EPOLLERR) && !IS_CLOSING(h)) {
+        /*
+         * We need to handle this exception event.  If it's related to us
+         * connecting, report it as such.  If not, just report it as a
+         * read event and the higher layers will handle it.
+         */
+        if (h->connecting) {
+            return EXCEPTION_EVENT;
+        } else if (key_has_pending_read(h) || key_has_pending_accept(h)) {
+            return READABLE_EVENT;
+        }
+        return NO_EVENT;
+    }
+
+    *rearm = PJ_TRUE;
+    return NO_EVENT;
+}
+
+/*
+ * Dispatch the queued events, at most max_cnt of them, and release the
+ * references of the keys taken when the events were queued. The key
+ * reference counters are only decremented here if dec_counter is set.
+ */
+static int dispatch_queue(pj_ioqueue_t *ioqueue,
+                          struct queue *queue,
+                          int event_cnt,
+                          int max_cnt,
+                          pj_bool_t dec_counter)
+{
+    int i, processed_cnt = 0;
+
+#if !PJ_IOQUEUE_HAS_SAFE_UNREG
+    PJ_UNUSED_ARG(dec_counter);
+#endif
+
+    for (i=0; i<event_cnt; ++i) {
+        /* Just do not exceed the maximum events */
+        if (processed_cnt < max_cnt) {
+            pj_bool_t event_done = PJ_FALSE;
+            switch (queue[i].event_type) {
+            case READABLE_EVENT:
+                event_done = ioqueue_dispatch_read_event(ioqueue,queue[i].key);
+
+                break;
+            case WRITEABLE_EVENT:
+                event_done = ioqueue_dispatch_write_event(ioqueue,
+                                                          queue[i].key);
+
+                break;
+            case EXCEPTION_EVENT:
+                event_done = ioqueue_dispatch_exception_event(ioqueue,
+                                                              queue[i].key);
+                break;
+            case NO_EVENT:
+                pj_assert(!"Invalid event!");
+                break;
+            }
+            if (event_done) {
+                ++processed_cnt;
+            }
+        }
+
+        /* Re-arm ONESHOT as long as there are pending requests. This is
+         * necessary to deal with this case:
+         * - thread A and B are calling ioqueue_recv()
+         * - packet arrives, thread A is processing
+         * - but thread A doesn't call ioqueue_recv() again
+         * - if we don't rearm here, thread B will never get the event.
+         *
+         * On the other hand, if thread A calls ioqueue_recv() again above,
+         * this will result in double epoll_ctl() calls. This should be okay,
+         * albeit inefficient. We err on the safe side.
+         */
+        if ((ioqueue->cfg.epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT) &&
+            (queue[i].key->ev.events & IO_MASK))
+        {
+            pj_ioqueue_lock_key(queue[i].key);
+            update_epoll_event_set(ioqueue, queue[i].key,
+                                   queue[i].key->ev.events);
+            pj_ioqueue_unlock_key(queue[i].key);
+        }
+
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+        if (dec_counter)
+            decrement_counter(queue[i].key);
+#endif
+
+        if (queue[i].key->grp_lock)
+            pj_grp_lock_dec_ref_dbg(queue[i].key->grp_lock,
+                                    "ioqueue", 0);
+    }
+
+    return processed_cnt;
+}
+
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+/*
+ * Get the poller of the calling thread for PJ_IOQUEUE_EPOLL_BATCH, creating
+ * it on the first poll of the thread.
+ */
+static struct poller *get_poller(pj_ioqueue_t *ioqueue)
+{
+    struct poller *poller;
+
+    poller = (struct poller*)pj_thread_local_get(ioqueue->poller_tls_id);
+    if (poller)
+        return poller;
+
+    pj_lock_acquire(ioqueue->lock);
+    poller = PJ_POOL_ZALLOC_T(ioqueue->poller_pool, struct poller);
+    if (poller) {
+        poller->events = (struct epoll_event*)
+                         pj_pool_calloc(ioqueue->poller_pool,
+                                        PJ_IOQUEUE_EPOLL_BATCH_SIZE,
+                                        sizeof(struct epoll_event));
+        poller->queue = (struct queue*)
+                        pj_pool_calloc(ioqueue->poller_pool,
+                                       PJ_IOQUEUE_EPOLL_BATCH_SIZE,
+                                       sizeof(struct queue));
+        if (poller->events && poller->queue)
+            pj_list_push_back(&ioqueue->poller_list, poller);
+        else
+            poller = NULL;
+    }
+    pj_lock_release(ioqueue->lock);
+
+    if (poller)
+        pj_thread_local_set(ioqueue->poller_tls_id, poller);
+
+    return poller;
+}
+
+/*
+ * Decrement the reference counters of the dispatched keys, taking the
+ * counter mutex once for all of them. Keys whose counter would reach zero,
+ * i.e: those unregistered in the meantime, go through decrement_counter()
+ * to be moved to the closing list.
+ */
+static void decrement_counters(pj_ioqueue_t *ioqueue,
+                               struct queue *queue,
+                               int event_cnt)
+{
+    int i;
+
+    pj_mutex_lock(ioqueue->ref_cnt_mutex);
+    for (i=0; i<event_cnt; ++i) {
+        if (queue[i].key->ref_count > 1) {
+            --queue[i].key->ref_count;
+            queue[i].key = NULL;
+        }
+    }
+    pj_mutex_unlock(ioqueue->ref_cnt_mutex);
+
+    for (i=0; i<event_cnt; ++i) {
+        if (queue[i].key)
+            decrement_counter(queue[i].key);
+    }
+}
+
+/*
+ * Poll with PJ_IOQUEUE_EPOLL_BATCH: dispatch all events returned by a
+ * single epoll_wait() using the event arrays of the calling thread. The
+ * ioqueue lock is not needed since keys are never freed while safe
+ * unregistration is used; instead the keys are referenced under the
+ * reference counter mutex, once for the whole batch.
+ */
+static int poll_batch(pj_ioqueue_t *ioqueue, struct poller *poller, int msec)
+{
+    struct epoll_event *events = poller->events;
+    struct queue *queue = poller->queue;
+    int i, count, event_cnt, processed_cnt;
+
+    count = os_epoll_wait(ioqueue->epfd, events, PJ_IOQUEUE_EPOLL_BATCH_SIZE,
+                          msec);
+    if (count == 0) {
+        if (!pj_list_empty(&ioqueue->closing_list)) {
+            pj_lock_acquire(ioqueue->lock);
+            scan_closing_keys(ioqueue);
+            pj_lock_release(ioqueue->lock);
+        }
+        return 0;
+    } else if (count < 0) {
+        return -pj_get_netos_error();
+    }
+
+    ++poller->wakeup_cnt;
+    poller->event_cnt += count;
+    if ((unsigned)count > poller->max_event_cnt)
+        poller->max_event_cnt = count;
+
+    pj_mutex_lock(ioqueue->ref_cnt_mutex);
+    for (event_cnt=0, i=0; i<count; ++i) {
+        pj_ioqueue_key_t *h = (pj_ioqueue_key_t*)(epoll_data_type)
+                                events[i].epoll_data;
+        enum ioqueue_event_type event_type;
+        pj_bool_t rearm;
+
+        event_type = get_event_type(h, events[i].events, &rearm);
+        if (event_type != NO_EVENT) {
+            ++h->ref_count;
+            if (h->grp_lock)
+                pj_grp_lock_add_ref_dbg(h->grp_lock, "ioqueue", 0);
+            queue[event_cnt].key = h;
+            queue[event_cnt].event_type = event_type;
+            ++event_cnt;
+        } else if (rearm &&
+                   (ioqueue->cfg.epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT) &&
+                   !IS_CLOSING(h))
+        {
+            /* See the "UNHANDLED event" note in pj_ioqueue_poll() */
+            update_epoll_event_set(ioqueue, h, h->ev.events);
+        }
+    }
+    pj_mutex_unlock(ioqueue->ref_cnt_mutex);
+
+    processed_cnt = dispatch_queue(ioqueue, queue, event_cnt, event_cnt,
+                                   PJ_FALSE);
+    decrement_counters(ioqueue, queue, event_cnt);
+
+    /* Avoid busy polling on events which we don't process, see the
+     * special case in pj_ioqueue_poll().
+     */
+    if (!event_cnt && msec > 0)
+        pj_thread_sleep(msec < 10 ? msec : 10);
+
+    TRACE_((THIS_FILE, "     batch poll: count=%d events=%d processed=%d",
+                       count, event_cnt, processed_cnt));
+
+    return processed_cnt;
+}
+#endif  /* PJ_IOQUEUE_HAS_SAFE_UNREG */
+
 /*
  * pj_ioqueue_poll()
  *
@@ -837,6 +1167,14 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
 
     msec = timeout ? PJ_TIME_VAL_MSEC(*timeout) : 9000;
 
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+    if (ioqueue->cfg.epoll_flags & PJ_IOQUEUE_EPOLL_BATCH) {
+        struct poller *poller = get_poller(ioqueue);
+        if (poller)
+            return poll_batch(ioqueue, poller, msec);
+    }
+#endif
+
     TRACE_((THIS_FILE, "start os_epoll_wait, msec=%d", msec));
     pj_get_timestamp(&t1);
  
@@ -868,83 +1206,32 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
     /* Lock ioqueue. */
     pj_lock_acquire(ioqueue->lock);
 
+    ++ioqueue->stat.wakeup_cnt;
+    ioqueue->stat.event_cnt += count;
+    if ((unsigned)count > ioqueue->stat.max_event_cnt)
+        ioqueue->stat.max_event_cnt = count;
+
     for (event_cnt=0, i=0; i<count; ++i) {
         pj_ioqueue_key_t *h = (pj_ioqueue_key_t*)(epoll_data_type)
                                 events[i].epoll_data;
+        enum ioqueue_event_type event_type;
+        pj_bool_t rearm;
 
         TRACE_((THIS_FILE, "     event %d: events=%x", i, events[i].events));
 
-        /*
-         * Check readability.
-         */
-        if ((events[i].events & EPOLLIN) && 
-            (key_has_pending_read(h) || key_has_pending_accept(h)) && !IS_CLOSING(h) ) {
-
+        event_type = get_event_type(h, events[i].events, &rearm);
+        if (event_type != NO_EVENT) {
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
             increment_counter(h);
 #endif
             queue[event_cnt].key = h;
-            queue[event_cnt].event_type = READABLE_EVENT;
+            queue[event_cnt].event_type = event_type;
             ++event_cnt;
             continue;
         }
 
-        /*
-         * Check for writeability.
-         */
-        if ((events[i].events & EPOLLOUT) && key_has_pending_write(h) && !IS_CLOSING(h)) {
-
-#if PJ_IOQUEUE_HAS_SAFE_UNREG
-            increment_counter(h);
-#endif
-            queue[event_cnt].key = h;
-            queue[event_cnt].event_type = WRITEABLE_EVENT;
-            ++event_cnt;
-            continue;
-        }
-
-#if PJ_HAS_TCP
-        /*
-         * Check for completion of connect() operation.
-         */
-        if ((events[i].events & EPOLLOUT) && (h->connecting) && !IS_CLOSING(h)) {
-
-#if PJ_IOQUEUE_HAS_SAFE_UNREG
-            increment_counter(h);
-#endif
-            queue[event_cnt].key = h;
-            queue[event_cnt].event_type = WRITEABLE_EVENT;
-            ++event_cnt;
-            continue;
-        }
-#endif /* PJ_HAS_TCP */
-
-        /*
-         * Check for error condition.
-         */
-        if ((events[i].events & EPOLLERR) && !IS_CLOSING(h)) {
-            /*
-             * We need to handle this exception event.  If it's related to us
-             * connecting, report it as such.  If not, just report it as a
-             * read event and the higher layers will handle it.
-             */
-            if (h->connecting) {
-#if PJ_IOQUEUE_HAS_SAFE_UNREG
-                increment_counter(h);
-#endif
-                queue[event_cnt].key = h;
-                queue[event_cnt].event_type = EXCEPTION_EVENT;
-                ++event_cnt;
-            } else if (key_has_pending_read(h) || key_has_pending_accept(h)) {
-#if PJ_IOQUEUE_HAS_SAFE_UNREG
-                increment_counter(h);
-#endif
-                queue[event_cnt].key = h;
-                queue[event_cnt].event_type = READABLE_EVENT;
-                ++event_cnt;
-            }
+        if (!rearm)
             continue;
-        }
 
         if (ioqueue->cfg.epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT) {
             /* We are not processing this event, but we still need to rearm
@@ -989,64 +1276,10 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
 
     PJ_RACE_ME(5);
 
-    processed_cnt = 0;
-
     /* Now process the events. */
-    for (i=0; i<event_cnt; ++i) {
-        /* Just do not exceed PJ_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL */
-        if (processed_cnt < PJ_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL) {
-            pj_bool_t event_done = PJ_FALSE;
-            switch (queue[i].event_type) {
-            case READABLE_EVENT:
-                event_done = ioqueue_dispatch_read_event(ioqueue,queue[i].key);
-
-                break;
-            case WRITEABLE_EVENT:
-                event_done = ioqueue_dispatch_write_event(ioqueue,
-                                                          queue[i].key);
-
-                break;
-            case EXCEPTION_EVENT:
-                event_done = ioqueue_dispatch_exception_event(ioqueue,
-                                                              queue[i].key);
-                break;
-            case NO_EVENT:
-                pj_assert(!"Invalid event!");
-                break;
-            }
-            if (event_done) {
-                ++processed_cnt;
-            }
-        }
-
-        /* Re-arm ONESHOT as long as there are pending requests. This is
-         * necessary to deal with this case:
-         * - thread A and B are calling ioqueue_recv()
-         * - packet arrives, thread A is processing
-         * - but thread A doesn't call ioqueue_recv() again
-         * - if we don't rearm here, thread B will never get the event.
-         *
-         * On the other hand, if thread A calls ioqueue_recv() again above,
-         * this will result in double epoll_ctl() calls. This should be okay,
-         * albeit inefficient. We err on the safe side.
-         */
-        if ((ioqueue->cfg.epoll_flags & PJ_IOQUEUE_EPOLL_ONESHOT) &&
-            (queue[i].key->ev.events & IO_MASK))
-        {
-            pj_ioqueue_lock_key(queue[i].key);
-            update_epoll_event_set(ioqueue, queue[i].key,
-                                   queue[i].key->ev.events);
-            pj_ioqueue_unlock_key(queue[i].key);
-        }
-
-#if PJ_IOQUEUE_HAS_SAFE_UNREG
-        decrement_counter(queue[i].key);
-#endif
-
-        if (queue[i].key->grp_lock)
-            pj_grp_lock_dec_ref_dbg(queue[i].key->grp_lock,
-                                    "ioqueue", 0);
-    }
+    processed_cnt = dispatch_queue(ioqueue, queue, event_cnt,
+                                   PJ_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL,
+                                   PJ_TRUE);
 
     /* Special case:
      * When epoll returns > 0 but event_cnt, the number of events
@@ -1082,3 +1315,27 @@ PJ_DEF(pj_oshandle_t) pj_ioqueue_get_os_handle( pj_ioqueue_t *ioqueue )
 {
     return ioqueue ? (pj_oshandle_t)&ioqueue->epfd : NULL;
 }
+
+PJ_DEF(pj_status_t) pj_ioqueue_get_stat(pj_ioqueue_t *ioqueue,
+                                        pj_ioqueue_stat *stat)
+{
+    struct poller *poller;
+
+    PJ_ASSERT_RETURN(ioqueue && stat, PJ_EINVAL);
+
+    pj_lock_acquire(ioqueue->lock);
+    pj_memcpy(stat, &ioqueue->stat, sizeof(*stat));
+    for (poller = ioqueue->poller_list.next;
+         poller != &ioqueue->poller_list;
+         poller = poller->next)
+    {
+        stat->wakeup_cnt += poller->wakeup_cnt;
+        stat->event_cnt += poller->event_cnt;
+        if (poller->max_event_cnt > stat->max_event_cnt)
+            stat->max_event_cnt = poller->max_event_cnt;
+        ++stat->poller_cnt;
+    }
+    pj_lock_release(ioqueue->lock);
+
+    return PJ_SUCCESS;
+}
@@ -0,0 +1,1790 @@
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/*
+ * ioqueue_uring.c
+ *
+ * This is the implementation of IOQueue framework using Linux io_uring.
+ *
+ * Datagram sockets are received by the kernel with a multishot recvmsg
+ * request into a ring of buffers provided by the ioqueue. Each received
+ * datagram is delivered by a completion, without any system call, and is
+ * copied to the buffer of the pending read operation when it is
+ * dispatched. Datagrams that arrive when there is no pending read are kept
+ * in the key until the next read, which then completes immediately. The
+ * multishot request stays armed until the key is unregistered or the
+ * kernel runs out of buffers; in the latter case the key falls back to
+ * readiness polling until the socket becomes readable again.
+ *
+ * The readiness of the other sockets is monitored with one-shot io_uring
+ * poll requests, and the I/O itself is done by the common ioqueue
+ * abstraction, just like the epoll and kqueue backends. The poll requests
+ * are only armed while the key has pending operations. All ioqueue
+ * semantics (concurrency setting, group lock, safe unregistration, etc.)
+ * are preserved for both kinds of sockets.
+ *
+ * The requests to re-arm the key after the events have been dispatched
+ * are queued in the submission ring and submitted together with the next
+ * wait, so a busy polling thread only needs a single system call per
+ * wakeup for both.
+ *
+ * The ring is accessed with the raw system calls, so liburing is not
+ * needed. Linux 5.11 or later is required for the wait timeout, and the
+ * multishot receive requires Linux 6.0, otherwise the datagram sockets
+ * are polled too.
+ */
+
+#include <pj/ioqueue.h>
+#include <pj/os.h>
+#include <pj/lock.h>
+#include <pj/log.h>
+#include <pj/list.h>
+#include <pj/pool.h>
+#include <pj/string.h>
+#include <pj/assert.h>
+#include <pj/errno.h>
+#include <pj/sock.h>
+#include <pj/compat/socket.h>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define os_uring_setup(entries, p) \
+            (int)syscall(__NR_io_uring_setup, entries, p)
+#define os_uring_enter(fd, to_submit, min_complete, flags, arg, argsz) \
+            (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, \
+                         flags, arg, argsz)
+#define os_uring_register(fd, opcode, arg, nr_args) \
+            (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args)
+#define os_close                close
+
+#define THIS_FILE   "ioq_uring"
+
+//#define TRACE_(expr) PJ_LOG(3,expr)
+#define TRACE_(expr)
+
+#if !PJ_IOQUEUE_HAS_SAFE_UNREG
+    /* Completions of the poll requests may arrive after the key has been
+     * unregistered, so the key must not be freed immediately.
+     */
+#   error "io_uring ioqueue requires PJ_IOQUEUE_HAS_SAFE_UNREG"
+#endif
+
+/* User data of the requests: the generation of the key in the upper
+ * 32 bits, then the key index, and the request kind in the lowest two
+ * bits. The generation changes every time the key is registered, so
+ * completions arriving after the key has been recycled can be told apart.
+ * Zero is the user data of the removals.
+ */
+#define UD_READ_POLL            0
+#define UD_WRITE_POLL           1
+#define UD_RECV                 2
+#define UD_KICK                 3
+#define UD_KIND_MASK            3
+#define UD_INDEX_SHIFT          2
+#define UD_GEN_SHIFT            32
+
+/* Armed flags of the multishot receive and of the no-op request that
+ * dispatches the datagrams already received, in addition to
+ * READABLE_EVENT and WRITEABLE_EVENT for the polls.
+ */
+#define ARMED_RECV              8
+#define ARMED_KICK              16
+
+/* Multishot receive needs Linux 6.0 headers, which also have the provided
+ * buffer rings.
+ */
+#if defined(IORING_RECV_MULTISHOT) && PJ_IOQUEUE_URING_RX_BUF_CNT > 0
+#   define URING_HAS_RX         1
+#else
+#   define URING_HAS_RX         0
+#endif
+
+/* Buffer group of the receive buffers */
+#define RX_BGID                 0
+
+/* Maximum number of received datagrams dispatched for a key in a row */
+#define RX_MAX_DISPATCH         16
+
+/*
+ * Include common ioqueue abstraction.
+ */
+#include "ioqueue_common_abs.h"
+
+/*
+ * This describes each key.
+ */
+struct pj_ioqueue_key_t
+{
+    DECLARE_COMMON_KEY
+
+    /* READABLE_EVENT and/or WRITEABLE_EVENT when the poll request for
+     * the event is in the ring, and the ARMED_* flags of the other
+     * requests. Protected by the ring lock.
+     */
+    unsigned            armed;
+
+    /* Datagrams received by the multishot receive that have not been
+     * read, as a list of buffer ids linked by rx_next of the ioqueue,
+     * or -1 when empty. Poll the readiness instead of arming the
+     * multishot receive while rx_poll is set. Protected by the ring lock.
+     */
+    int                 rx_head;
+    int                 rx_tail;
+    pj_bool_t           rx_poll;
+    pj_bool_t           rx_queued;
+
+    /* Position in the key table and registration generation, to identify
+     * the poll requests. The generation is protected by the ring lock.
+     */
+    unsigned            index;
+    pj_uint32_t         gen;
+};
+
+struct queue
+{
+    pj_ioqueue_key_t        *key;
+    enum ioqueue_event_type  event_type;
+    pj_bool_t                rx;
+};
+
+/*
+ * The submission and completion rings, mapped from the kernel.
+ */
+struct uring
+{
+    int                  fd;
+    unsigned             sq_entries;
+
+    unsigned            *sq_head;
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned             sq_local_tail;
+
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void                *sq_ptr;
+    pj_size_t            sq_size;
+    void                *cq_ptr;
+    pj_size_t            cq_size;
+    pj_size_t            sqes_size;
+};
+
+/*
+ * This describes the I/O queue.
+ */
+struct pj_ioqueue_t
+{
+    DECLARE_COMMON_IOQUEUE
+
+    unsigned            max, count;
+    pj_ioqueue_key_t    active_list;
+    pj_ioqueue_key_t  **keys;
+
+    struct uring        ring;
+
+    /* Protects the rings, the number of queued requests that have not been
+     * submitted, the number of threads waiting for completions, and the
+     * armed flags of the keys.
+     */
+    pj_mutex_t         *ring_mutex;
+    unsigned            sq_pending;
+    unsigned            waiter_cnt;
+
+    /* User data of the poll requests whose removal could not be queued
+     * because the submission ring was full. Protected by the ring lock.
+     */
+    pj_uint64_t        *rm_pending;
+    unsigned            rm_pending_cnt;
+
+#if URING_HAS_RX
+    /* Ring of the buffers provided for the multishot receive, NULL when
+     * not supported, and the buffers. The length of the datagram in each
+     * buffer and the list of the received buffers of each key are kept in
+     * rx_len and rx_next. Protected by the ring lock.
+     */
+    struct io_uring_buf_ring *rx_ring;
+    pj_bool_t           rx_disabled;
+    pj_size_t           rx_ring_size;
+    unsigned            rx_cnt;
+    unsigned            rx_buf_size;
+    pj_uint16_t         rx_ring_tail;
+    char               *rx_bufs;
+    int                *rx_len;
+    int                *rx_next;
+    struct msghdr       rx_msg;
+#endif
+
+    /* Set to the ioqueue while a thread is dispatching events, to defer
+     * the submission of the re-arm requests.
+     */
+    long                dispatch_tls_id;
+
+    /* Polling statistics, protected by ioqueue lock */
+    pj_ioqueue_stat     stat;
+
+    pj_mutex_t         *ref_cnt_mutex;
+    pj_ioqueue_key_t    closing_list;
+    pj_ioqueue_key_t    free_list;
+};
+
+/* Include implementation for common abstraction after we declare
+ * pj_ioqueue_key_t and pj_ioqueue_t. The reads are wrapped below to take
+ * the datagrams already received by the multishot receive first.
+ */
+#define pj_ioqueue_recv         ioqueue_common_recv
+#define pj_ioqueue_recvfrom     ioqueue_common_recvfrom
+#include "ioqueue_common_abs.c"
+#undef pj_ioqueue_recv
+#undef pj_ioqueue_recvfrom
+
+/* Scan closing keys to be put to free list again */
+static void scan_closing_keys(pj_ioqueue_t *ioqueue);
+
+
+/*
+ * Map the rings of a new io_uring instance.
+ */
+static pj_status_t uring_init(struct uring *r, unsigned entries)
+{
+    struct io_uring_params p;
+    pj_status_t status;
+
+    pj_bzero(r, sizeof(*r));
+    r->fd = -1;
+    r->sq_ptr = r->cq_ptr = r->sqes = MAP_FAILED;
+
+    pj_bzero(&p, sizeof(p));
+    p.flags = IORING_SETUP_CLAMP;
+    r->fd = os_uring_setup(entries, &p);
+    if (r->fd < 0)
+        return PJ_RETURN_OS_ERROR(pj_get_native_os_error());
+
+    /* The timeout of the wait needs IORING_ENTER_EXT_ARG */
+    if ((p.features & IORING_FEAT_EXT_ARG) == 0) {
+        status = PJ_ENOTSUP;
+        goto on_error;
+    }
+
+    r->sq_entries = p.sq_entries;
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_size > r->sq_size)
+            r->sq_size = r->cq_size;
+        r->cq_size = r->sq_size;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED)
+        goto on_os_error;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd,
+                         IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED)
+            goto on_os_error;
+    }
+
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)
+              mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        goto on_os_error;
+
+    r->sq_head  = (unsigned*)((char*)r->sq_ptr + p.sq_off.head);
+    r->sq_tail  = (unsigned*)((char*)r->sq_ptr + p.sq_off.tail);
+    r->sq_mask  = (unsigned*)((char*)r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)((char*)r->sq_ptr + p.sq_off.array);
+    r->sq_local_tail = *r->sq_tail;
+
+    r->cq_head  = (unsigned*)((char*)r->cq_ptr + p.cq_off.head);
+    r->cq_tail  = (unsigned*)((char*)r->cq_ptr + p.cq_off.tail);
+    r->cq_mask  = (unsigned*)((char*)r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes     = (struct io_uring_cqe*)((char*)r->cq_ptr + p.cq_off.cqes);
+
+    return PJ_SUCCESS;
+
+on_os_error:
+    status = PJ_RETURN_OS_ERROR(pj_get_native_os_error());
+on_error:
+    if (r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_size);
+    if (r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_size);
+    if (r->sq_ptr != MAP_FAILED)
+        munmap(r->sq_ptr, r->sq_size);
+    os_close(r->fd);
+    r->fd = -1;
+    return status;
+}
+
+static void uring_destroy(struct uring *r)
+{
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_size);
+    munmap(r->sq_ptr, r->sq_size);
+    os_close(r->fd);
+    r->fd = -1;
+}
+
+/*
+ * Submit the queued requests without waiting.
+ */
+static void uring_flush(pj_ioqueue_t *ioqueue)
+{
+    unsigned to_submit;
+    int rc;
+
+    pj_mutex_lock(ioqueue->ring_mutex);
+    to_submit = ioqueue->sq_pending;
+    ioqueue->sq_pending = 0;
+    pj_mutex_unlock(ioqueue->ring_mutex);
+
+    if (to_submit == 0)
+        return;
+
+    rc = os_uring_enter(ioqueue->ring.fd, to_submit, 0, 0, NULL, 0);
+    if (rc < 0) {
+        /* Let the next enter submit them */
+        pj_mutex_lock(ioqueue->ring_mutex);
+        ioqueue->sq_pending += to_submit;
+        pj_mutex_unlock(ioqueue->ring_mutex);
+
+        TRACE_((THIS_FILE, "io_uring_enter() submit error %d", errno));
+    }
+}
+
+/*
+ * Get a free submission queue entry. Ring mutex must be held.
+ */
+static struct io_uring_sqe *get_sqe(pj_ioqueue_t *ioqueue)
+{
+    struct uring *r = &ioqueue->ring;
+    struct io_uring_sqe *sqe;
+    unsigned head, idx;
+
+    head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->sq_local_tail - head >= r->sq_entries) {
+        /* Ring is full, submit the queued entries now. The ring mutex is
+         * recursive, so uring_flush() can be called here.
+         */
+        uring_flush(ioqueue);
+        head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        if (r->sq_local_tail - head >= r->sq_entries)
+            return NULL;
+    }
+
+    idx = r->sq_local_tail & *r->sq_mask;
+    sqe = &r->sqes[idx];
+    r->sq_array[idx] = idx;
+    pj_bzero(sqe, sizeof(*sqe));
+
+    return sqe;
+}
+
+/*
+ * Publish the entry taken with get_sqe(). Ring mutex must be held.
+ */
+static void put_sqe(pj_ioqueue_t *ioqueue)
+{
+    struct uring *r = &ioqueue->ring;
+
+    ++r->sq_local_tail;
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+    ++ioqueue->sq_pending;
+}
+
+/*
+ * User data of the request of the specified kind of the key.
+ */
+static pj_uint64_t key_user_data(const pj_ioqueue_key_t *key, unsigned kind)
+{
+    return ((pj_uint64_t)key->gen << UD_GEN_SHIFT) |
+           ((pj_uint64_t)key->index << UD_INDEX_SHIFT) | kind;
+}
+
+/*
+ * User data of the poll request of the key for the event.
+ */
+static pj_uint64_t poll_user_data(const pj_ioqueue_key_t *key,
+                                  enum ioqueue_event_type event_type)
+{
+    return key_user_data(key, event_type == READABLE_EVENT ? UD_READ_POLL :
+                                                             UD_WRITE_POLL);
+}
+
+/*
+ * Queue the removal of a poll or multishot receive request. Ring mutex
+ * must be held.
+ */
+static pj_bool_t queue_removal(pj_ioqueue_t *ioqueue, pj_uint64_t user_data)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = get_sqe(ioqueue);
+    if (!sqe)
+        return PJ_FALSE;
+
+    /* The completion of the removal itself has zero user data */
+    sqe->opcode = ((user_data & UD_KIND_MASK) == UD_RECV) ?
+                  IORING_OP_ASYNC_CANCEL : IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    put_sqe(ioqueue);
+
+    return PJ_TRUE;
+}
+
+/*
+ * Queue the removals that did not fit in the ring before. Ring mutex must
+ * be held.
+ */
+static void queue_pending_removals(pj_ioqueue_t *ioqueue)
+{
+    while (ioqueue->rm_pending_cnt) {
+        unsigned i = ioqueue->rm_pending_cnt - 1;
+
+        if (!queue_removal(ioqueue, ioqueue->rm_pending[i]))
+            break;
+        ioqueue->rm_pending_cnt = i;
+    }
+}
+
+/*
+ * Queue a one-shot poll request for the event. Ring mutex must be held.
+ */
+static void arm_poll(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key,
+                     enum ioqueue_event_type event_type)
+{
+    struct io_uring_sqe *sqe;
+    pj_uint32_t events;
+
+    sqe = get_sqe(ioqueue);
+    if (!sqe) {
+        PJ_LOG(2,(THIS_FILE, "Unable to arm poll: submission ring is full"));
+        return;
+    }
+
+    events = (event_type == READABLE_EVENT) ? POLLIN : POLLOUT;
+#if defined(PJ_IS_BIG_ENDIAN) && PJ_IS_BIG_ENDIAN!=0
+    /* poll32_events is read as two little endian 16-bit halves */
+    events = (events << 16) | (events >> 16);
+#endif
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = key->fd;
+    sqe->poll32_events = events;
+    sqe->user_data = poll_user_data(key, event_type);
+    put_sqe(ioqueue);
+
+    key->armed |= event_type;
+}
+
+#if URING_HAS_RX
+/*
+ * Give the receive buffer back to the kernel. Ring mutex must be held.
+ */
+static void rx_recycle(pj_ioqueue_t *ioqueue, int bid)
+{
+    struct io_uring_buf *buf;
+
+    buf = &ioqueue->rx_ring->bufs[ioqueue->rx_ring_tail &
+                                  (ioqueue->rx_cnt - 1)];
+    buf->addr = (pj_uint64_t)(pj_size_t)
+                (ioqueue->rx_bufs + (pj_size_t)bid * ioqueue->rx_buf_size);
+    buf->len = ioqueue->rx_buf_size;
+    buf->bid = (pj_uint16_t)bid;
+
+    ++ioqueue->rx_ring_tail;
+    __atomic_store_n(&ioqueue->rx_ring->tail, ioqueue->rx_ring_tail,
+                     __ATOMIC_RELEASE);
+}
+
+/*
+ * Set up the provided buffer ring for the multishot receive. The ioqueue
+ * polls the datagram sockets if this fails.
+ */
+static void rx_init(pj_ioqueue_t *ioqueue, pj_pool_t *pool)
+{
+    struct io_uring_buf_reg reg;
+    unsigned cnt, i;
+    int rc;
+
+    for (cnt = 16; cnt < 8 * ioqueue->max &&
+                   cnt * 2 <= PJ_IOQUEUE_URING_RX_BUF_CNT; cnt <<= 1)
+        ;
+    if (cnt > PJ_IOQUEUE_URING_RX_BUF_CNT)
+        return;
+
+    /* The ring must be page aligned */
+    ioqueue->rx_ring_size = cnt * sizeof(struct io_uring_buf);
+    ioqueue->rx_ring = (struct io_uring_buf_ring*)
+                       mmap(NULL, ioqueue->rx_ring_size,
+                            PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ioqueue->rx_ring == MAP_FAILED) {
+        ioqueue->rx_ring = NULL;
+        return;
+    }
+
+    pj_bzero(&reg, sizeof(reg));
+    reg.ring_addr = (pj_uint64_t)(pj_size_t)ioqueue->rx_ring;
+    reg.ring_entries = cnt;
+    reg.bgid = RX_BGID;
+    rc = os_uring_register(ioqueue->ring.fd, IORING_REGISTER_PBUF_RING,
+                           &reg, 1);
+    if (rc < 0) {
+        PJ_LOG(4,(THIS_FILE, "Multishot receive is not available (err=%d)",
+                  errno));
+        munmap(ioqueue->rx_ring, ioqueue->rx_ring_size);
+        ioqueue->rx_ring = NULL;
+        return;
+    }
+
+    /* Each buffer holds the recvmsg header, the source address and the
+     * datagram.
+     */
+    ioqueue->rx_cnt = cnt;
+    ioqueue->rx_buf_size = (sizeof(struct io_uring_recvmsg_out) +
+                            sizeof(pj_sockaddr) +
+                            PJ_IOQUEUE_URING_RX_BUF_SIZE + 7) & ~7;
+    ioqueue->rx_bufs = (char*)pj_pool_alloc(pool, (pj_size_t)cnt *
+                                                  ioqueue->rx_buf_size);
+    ioqueue->rx_len = (int*)pj_pool_calloc(pool, cnt, sizeof(int));
+    ioqueue->rx_next = (int*)pj_pool_calloc(pool, cnt, sizeof(int));
+
+    pj_bzero(&ioqueue->rx_msg, sizeof(ioqueue->rx_msg));
+    ioqueue->rx_msg.msg_namelen = sizeof(pj_sockaddr);
+
+    ioqueue->rx_ring_tail = 0;
+    for (i=0; i<cnt; ++i)
+        rx_recycle(ioqueue, i);
+}
+
+/*
+ * Queue the multishot receive request. Ring mutex must be held.
+ */
+static void arm_recv(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = get_sqe(ioqueue);
+    if (!sqe) {
+        PJ_LOG(2,(THIS_FILE, "Unable to arm receive: submission ring is "
+                  "full"));
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = key->fd;
+    sqe->addr = (pj_uint64_t)(pj_size_t)&ioqueue->rx_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RX_BGID;
+    sqe->user_data = key_user_data(key, UD_RECV);
+    put_sqe(ioqueue);
+
+    key->armed |= ARMED_RECV;
+}
+
+/*
+ * Queue a no-op request, to dispatch the datagrams already received by
+ * the key with the next poll. Ring mutex must be held.
+ */
+static void arm_kick(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = get_sqe(ioqueue);
+    if (!sqe) {
+        PJ_LOG(2,(THIS_FILE, "Unable to queue dispatch: submission ring is "
+                  "full"));
+        return;
+    }
+
+    sqe->opcode = IORING_OP_NOP;
+    sqe->fd = -1;
+    sqe->user_data = key_user_data(key, UD_KICK);
+    put_sqe(ioqueue);
+
+    key->armed |= ARMED_KICK;
+}
+
+/*
+ * Give the received datagrams of the key back to the kernel. Ring mutex
+ * must be held.
+ */
+static void rx_release(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key)
+{
+    while (key->rx_head >= 0) {
+        int bid = key->rx_head;
+
+        key->rx_head = ioqueue->rx_next[bid];
+        rx_recycle(ioqueue, bid);
+    }
+    key->rx_tail = -1;
+}
+
+/*
+ * Copy the oldest received datagram of the key to the read operation.
+ * Returns PJ_FALSE if the key has no received datagram.
+ */
+static pj_bool_t rx_read(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key,
+                         struct read_operation *read_op,
+                         pj_ssize_t *bytes_read)
+{
+    struct io_uring_recvmsg_out *out;
+    char *buf, *payload;
+    pj_ssize_t len;
+    int bid;
+
+    pj_mutex_lock(ioqueue->ring_mutex);
+
+    bid = key->rx_head;
+    if (bid < 0) {
+        pj_mutex_unlock(ioqueue->ring_mutex);
+        return PJ_FALSE;
+    }
+    key->rx_head = ioqueue->rx_next[bid];
+    if (key->rx_head < 0)
+        key->rx_tail = -1;
+
+    /* Truncate like recvfrom() when the read buffer is too small */
+    buf = ioqueue->rx_bufs + (pj_size_t)bid * ioqueue->rx_buf_size;
+    out = (struct io_uring_recvmsg_out*)buf;
+    payload = buf + sizeof(*out) + ioqueue->rx_msg.msg_namelen;
+    len = ioqueue->rx_len[bid] - (payload - buf);
+    if (len > read_op->size)
+        len = read_op->size;
+    pj_memcpy(read_op->buf, payload, len);
+
+    if (read_op->op == PJ_IOQUEUE_OP_RECV_FROM && read_op->rmt_addr &&
+        read_op->rmt_addrlen)
+    {
+        int addrlen = (int)out->namelen;
+
+        if (addrlen > *read_op->rmt_addrlen)
+            addrlen = *read_op->rmt_addrlen;
+        if (addrlen > (int)ioqueue->rx_msg.msg_namelen)
+            addrlen = (int)ioqueue->rx_msg.msg_namelen;
+        pj_memcpy(read_op->rmt_addr, buf + sizeof(*out), addrlen);
+        *read_op->rmt_addrlen = (int)out->namelen;
+    }
+
+    rx_recycle(ioqueue, bid);
+
+    pj_mutex_unlock(ioqueue->ring_mutex);
+
+    *bytes_read = len;
+    return PJ_TRUE;
+}
+
+/*
+ * Handle the completion of the multishot receive or of the no-op request
+ * of the key. Returns PJ_TRUE if the key needs to be dispatched. Ring mutex
+ * must be held.
+ */
+static pj_bool_t rx_complete(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key,
+                             pj_bool_t stale,
+                             const struct io_uring_cqe *cqe)
+{
+    pj_bool_t has_buf = (cqe->flags & IORING_CQE_F_BUFFER) != 0;
+    int bid = (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+    if (stale) {
+        /* The buffer must be given back even if the key is gone */
+        if (has_buf)
+            rx_recycle(ioqueue, bid);
+        return PJ_FALSE;
+    }
+
+    if ((cqe->user_data & UD_KIND_MASK) == UD_KICK) {
+        key->armed &= ~ARMED_KICK;
+        return !IS_CLOSING(key);
+    }
+
+    if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+        /* The multishot receive has ended */
+        key->armed &= ~ARMED_RECV;
+        if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+            PJ_LOG(4,(THIS_FILE, "Multishot receive is not supported, "
+                      "polling datagram sockets instead"));
+            ioqueue->rx_disabled = PJ_TRUE;
+        } else if (cqe->res != -ECANCELED) {
+            /* Most likely out of buffers. Poll until the socket is
+             * readable again, to let the other keys consume their
+             * datagrams and give the buffers back.
+             */
+            key->rx_poll = PJ_TRUE;
+        }
+    }
+
+    if (has_buf) {
+        if (cqe->res < 0 || IS_CLOSING(key)) {
+            rx_recycle(ioqueue, bid);
+        } else {
+            ioqueue->rx_len[bid] = cqe->res;
+            ioqueue->rx_next[bid] = -1;
+            if (key->rx_tail >= 0)
+                ioqueue->rx_next[key->rx_tail] = bid;
+            else
+                key->rx_head = bid;
+            key->rx_tail = bid;
+        }
+    }
+
+    return !IS_CLOSING(key);
+}
+#endif  /* URING_HAS_RX */
+
+/*
+ * Check if the datagrams of the key are received by the multishot
+ * receive. Ring mutex must be held.
+ */
+static pj_bool_t key_uses_rx(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key)
+{
+#if URING_HAS_RX
+    return ioqueue->rx_ring && !ioqueue->rx_disabled &&
+           key->fd_type == pj_SOCK_DGRAM();
+#else
+    PJ_UNUSED_ARG(ioqueue);
+    PJ_UNUSED_ARG(key);
+    return PJ_FALSE;
+#endif
+}
+
+/*
+ * Queue the request to be notified of the pending read of the key: a
+ * no-op request when the key already has received datagrams, the
+ * multishot receive, or a poll. Ring mutex must be held.
+ */
+static void arm_read(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key)
+{
+#if URING_HAS_RX
+    if (key->rx_head >= 0) {
+        if ((key->armed & ARMED_KICK) == 0)
+            arm_kick(ioqueue, key);
+        return;
+    }
+
+    if (key_uses_rx(ioqueue, key) && !key->rx_poll) {
+        if ((key->armed & (ARMED_RECV | READABLE_EVENT)) == 0)
+            arm_recv(ioqueue, key);
+        return;
+    }
+#endif
+
+    if ((key->armed & (ARMED_RECV | READABLE_EVENT)) == 0)
+        arm_poll(ioqueue, key, READABLE_EVENT);
+}
+
+/*
+ * Queue the removal of the armed requests. Ring mutex must be held.
+ * The requests keep the socket file open, so a removal that doesn't
+ * fit in the ring is kept to be queued by the next poll.
+ */
+static void disarm_polls(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key)
+{
+    static const unsigned kinds[] = { UD_READ_POLL, UD_WRITE_POLL, UD_RECV };
+    static const unsigned flags[] = { READABLE_EVENT, WRITEABLE_EVENT,
+                                      ARMED_RECV };
+    unsigned i;
+
+    queue_pending_removals(ioqueue);
+
+    for (i=0; i<PJ_ARRAY_SIZE(kinds); ++i) {
+        pj_uint64_t user_data;
+
+        if ((key->armed & flags[i]) == 0)
+            continue;
+
+        user_data = key_user_data(key, kinds[i]);
+        if (queue_removal(ioqueue, user_data))
+            continue;
+
+        if (ioqueue->rm_pending_cnt < 3 * ioqueue->max) {
+            PJ_LOG(4,(THIS_FILE, "Removal of request of key %p deferred: "
+                      "submission ring is full", key));
+            ioqueue->rm_pending[ioqueue->rm_pending_cnt++] = user_data;
+        } else {
+            PJ_LOG(2,(THIS_FILE, "Unable to remove request of key %p: "
+                      "submission ring is full", key));
+        }
+    }
+
+#if URING_HAS_RX
+    if (ioqueue->rx_ring)
+        rx_release(ioqueue, key);
+#endif
+}
+
+/*
+ * Arm the requests needed by the pending operations of the key.
+ */
+static void rearm_key(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key)
+{
+    pj_mutex_lock(ioqueue->ring_mutex);
+    if (!IS_CLOSING(key)) {
+        if (key_has_pending_read(key) || key_has_pending_accept(key))
+            arm_read(ioqueue, key);
+        if ((key->armed & WRITEABLE_EVENT) == 0 &&
+            (key_has_pending_write(key) || key_has_pending_connect(key)))
+        {
+            arm_poll(ioqueue, key, WRITEABLE_EVENT);
+        }
+    }
+    pj_mutex_unlock(ioqueue->ring_mutex);
+}
+
+#if URING_HAS_RX
+/*
+ * Dispatch the received datagrams of the key to its pending reads.
+ */
+static pj_bool_t ioqueue_dispatch_rx_event(pj_ioqueue_t *ioqueue,
+                                           pj_ioqueue_key_t *h)
+{
+    unsigned n;
+
+    for (n=0; n<RX_MAX_DISPATCH; ++n) {
+        struct read_operation *read_op;
+        pj_ssize_t bytes_read;
+        pj_bool_t has_lock;
+
+        pj_ioqueue_lock_key(h);
+
+        if (IS_CLOSING(h) || !key_has_pending_read(h)) {
+            pj_ioqueue_unlock_key(h);
+            break;
+        }
+
+        read_op = h->read_list.next;
+        if (!rx_read(ioqueue, h, read_op, &bytes_read)) {
+            pj_ioqueue_unlock_key(h);
+            break;
+        }
+        pj_list_erase(read_op);
+        read_op->op = PJ_IOQUEUE_OP_NONE;
+
+        /* Unlock; from this point we don't need to hold key's mutex
+         * (unless concurrency is disabled, which in this case we should
+         * hold the mutex while calling the callback) */
+        if (h->allow_concurrent) {
+            /* concurrency may be changed while we're in the callback, so
+             * save it to a flag.
+             */
+            has_lock = PJ_FALSE;
+            pj_ioqueue_unlock_key(h);
+            PJ_RACE_ME(5);
+        } else {
+            has_lock = PJ_TRUE;
+        }
+
+        /* Call callback. */
+        if (h->cb.on_read_complete && !IS_CLOSING(h)) {
+            (*h->cb.on_read_complete)(h, (pj_ioqueue_op_key_t*)read_op,
+                                      bytes_read);
+        }
+
+        if (has_lock) {
+            pj_ioqueue_unlock_key(h);
+        }
+    }
+
+    return n > 0;
+}
+
+/*
+ * Complete the read with a datagram already received by the key, if the
+ * read is not queued behind other reads. Returns PJ_FALSE if the read
+ * must go through the common ioqueue.
+ */
+static pj_bool_t rx_read_now(pj_ioqueue_key_t *key,
+                             pj_ioqueue_op_key_t *op_key,
+                             int op, void *buffer, pj_ssize_t *length,
+                             unsigned flags, pj_sockaddr_t *addr,
+                             int *addrlen)
+{
+    struct read_operation *read_op = (struct read_operation*)op_key;
+    pj_bool_t done = PJ_FALSE;
+
+    if (!key || !op_key || !buffer || !length || IS_CLOSING(key) ||
+        key->rx_head < 0 || (flags & PJ_IOQUEUE_ALWAYS_ASYNC) ||
+        read_op->op != PJ_IOQUEUE_OP_NONE ||
+        key->ioqueue->rx_ring == NULL)
+    {
+        return PJ_FALSE;
+    }
+
+    pj_ioqueue_lock_key(key);
+    if (!IS_CLOSING(key) && pj_list_empty(&key->read_list)) {
+        read_op->op = (pj_ioqueue_operation_e)op;
+        read_op->buf = buffer;
+        read_op->size = *length;
+        read_op->flags = flags;
+        read_op->rmt_addr = addr;
+        read_op->rmt_addrlen = addrlen;
+        done = rx_read(key->ioqueue, key, read_op, length);
+        read_op->op = PJ_IOQUEUE_OP_NONE;
+    }
+    pj_ioqueue_unlock_key(key);
+
+    return done;
+}
+#endif  /* URING_HAS_RX */
+
+/*
+ * Flags for the common read. The datagrams are taken from the socket by
+ * the multishot receive, so reading the socket directly could return
+ * them out of order.
+ */
+static unsigned rx_read_flags(pj_ioqueue_key_t *key, unsigned flags)
+{
+    pj_ioqueue_t *ioqueue;
+
+    if (!key || IS_CLOSING(key))
+        return flags;
+
+    ioqueue = key->ioqueue;
+    pj_mutex_lock(ioqueue->ring_mutex);
+    if ((key_uses_rx(ioqueue, key) && !key->rx_poll) ||
+        (key->armed & ARMED_RECV) || key->rx_head >= 0)
+    {
+        flags |= PJ_IOQUEUE_ALWAYS_ASYNC;
+    }
+    pj_mutex_unlock(ioqueue->ring_mutex);
+
+    return flags;
+}
+
+/*
+ * pj_ioqueue_recv()
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_recv(  pj_ioqueue_key_t *key,
+                                      pj_ioqueue_op_key_t *op_key,
+                                      void *buffer,
+                                      pj_ssize_t *length,
+                                      unsigned flags )
+{
+#if URING_HAS_RX
+    if (rx_read_now(key, op_key, PJ_IOQUEUE_OP_RECV, buffer, length, flags,
+                    NULL, NULL))
+    {
+        return PJ_SUCCESS;
+    }
+#endif
+
+    return ioqueue_common_recv(key, op_key, buffer, length,
+                               rx_read_flags(key, flags));
+}
+
+/*
+ * pj_ioqueue_recvfrom()
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_recvfrom( pj_ioqueue_key_t *key,
+                                         pj_ioqueue_op_key_t *op_key,
+                                         void *buffer,
+                                         pj_ssize_t *length,
+                                         unsigned flags,
+                                         pj_sockaddr_t *addr,
+                                         int *addrlen)
+{
+#if URING_HAS_RX
+    if (rx_read_now(key, op_key, PJ_IOQUEUE_OP_RECV_FROM, buffer, length,
+                    flags, addr, addrlen))
+    {
+        return PJ_SUCCESS;
+    }
+#endif
+
+    return ioqueue_common_recvfrom(key, op_key, buffer, length,
+                                   rx_read_flags(key, flags), addr, addrlen);
+}
+
+/*
+ * pj_ioqueue_name()
+ */
+PJ_DEF(const char*) pj_ioqueue_name(void)
+{
+    return "io_uring";
+}
+
+/*
+ * pj_ioqueue_create()
+ *
+ * Create io_uring ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
+                                       pj_size_t max_fd,
+                                       pj_ioqueue_t **p_ioqueue)
+{
+    return pj_ioqueue_create2(pool, max_fd, NULL, p_ioqueue);
+}
+
+/*
+ * pj_ioqueue_create2()
+ *
+ * Create io_uring ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool,
+                                       pj_size_t max_fd,
+                                       const pj_ioqueue_cfg *cfg,
+                                       pj_ioqueue_t **p_ioqueue)
+{
+    pj_ioqueue_t *ioqueue;
+    pj_status_t rc;
+    pj_lock_t *lock;
+    unsigned entries, rx_cnt = 0;
+    pj_size_t i;
+
+    /* Check that arguments are valid. */
+    PJ_ASSERT_RETURN(pool != NULL && p_ioqueue != NULL &&
+                     max_fd > 0, PJ_EINVAL);
+
+    /* Check that size of pj_ioqueue_op_key_t is sufficient */
+    PJ_ASSERT_RETURN(sizeof(pj_ioqueue_op_key_t)-sizeof(void*) >=
+                     sizeof(union operation_key), PJ_EBUG);
+
+    ioqueue = PJ_POOL_ZALLOC_T(pool, pj_ioqueue_t);
+
+    ioqueue_init(ioqueue);
+
+    if (cfg)
+        pj_memcpy(&ioqueue->cfg, cfg, sizeof(*cfg));
+    else
+        pj_ioqueue_cfg_default(&ioqueue->cfg);
+    ioqueue->max = (unsigned)max_fd;
+    ioqueue->count = 0;
+    pj_list_init(&ioqueue->active_list);
+
+    /* Mutex to protect key's reference counter
+     * We don't want to use key's mutex or ioqueue's mutex because
+     * that would create deadlock situation in some cases.
+     */
+    rc = pj_mutex_create_simple(pool, NULL, &ioqueue->ref_cnt_mutex);
+    if (rc != PJ_SUCCESS)
+        return rc;
+
+    /* Init key list */
+    pj_list_init(&ioqueue->free_list);
+    pj_list_init(&ioqueue->closing_list);
+
+    ioqueue->keys = (pj_ioqueue_key_t**)
+                    pj_pool_calloc(pool, max_fd, sizeof(pj_ioqueue_key_t*));
+    ioqueue->rm_pending = (pj_uint64_t*)
+                          pj_pool_calloc(pool, 3 * max_fd,
+                                         sizeof(pj_uint64_t));
+
+    /* Pre-create all keys according to max_fd */
+    for (i=0; i<max_fd; ++i) {
+        pj_ioqueue_key_t *key;
+
+        key = PJ_POOL_ZALLOC_T(pool, pj_ioqueue_key_t);
+        key->ref_count = 0;
+        key->index = (unsigned)i;
+        ioqueue->keys[i] = key;
+        rc = pj_lock_create_recursive_mutex(pool, NULL, &key->lock);
+        if (rc != PJ_SUCCESS) {
+            key = ioqueue->free_list.next;
+            while (key != &ioqueue->free_list) {
+                pj_lock_destroy(key->lock);
+                key = key->next;
+            }
+            pj_mutex_destroy(ioqueue->ref_cnt_mutex);
+            return rc;
+        }
+
+        pj_list_push_back(&ioqueue->free_list, key);
+    }
+
+    rc = pj_mutex_create_recursive(pool, "ioqring%p", &ioqueue->ring_mutex);
+    if (rc != PJ_SUCCESS)
+        return rc;
+
+    rc = pj_thread_local_alloc(&ioqueue->dispatch_tls_id);
+    if (rc != PJ_SUCCESS) {
+        pj_mutex_destroy(ioqueue->ring_mutex);
+        return rc;
+    }
+
+    /* Create the lock */
+    rc = pj_lock_create_simple_mutex(pool, "ioq%p", &lock);
+    if (rc != PJ_SUCCESS)
+        return rc;
+
+    rc = pj_ioqueue_set_lock(ioqueue, lock, PJ_TRUE);
+    if (rc != PJ_SUCCESS)
+        return rc;
+
+    /* Room for a read and a write poll of every key, the kernel will
+     * clamp this to its limit.
+     */
+    for (entries = 64; entries < 2 * max_fd && entries < 32768; entries <<= 1)
+        ;
+
+    rc = uring_init(&ioqueue->ring, entries);
+    if (rc != PJ_SUCCESS) {
+        PJ_PERROR(1,(THIS_FILE, rc, "Error creating io_uring"));
+        pj_thread_local_free(ioqueue->dispatch_tls_id);
+        pj_mutex_destroy(ioqueue->ring_mutex);
+        pj_lock_acquire(ioqueue->lock);
+        ioqueue_destroy(ioqueue);
+        return rc;
+    }
+
+#if URING_HAS_RX
+    rx_init(ioqueue, pool);
+    if (ioqueue->rx_ring)
+        rx_cnt = ioqueue->rx_cnt;
+#endif
+
+    PJ_LOG(4, ("pjlib", "%s I/O Queue created (%d entries, %d receive "
+               "buffers, ptr=%p)", pj_ioqueue_name(),
+               ioqueue->ring.sq_entries, rx_cnt, ioqueue));
+
+    *p_ioqueue = ioqueue;
+    return PJ_SUCCESS;
+}
+
+/*
+ * pj_ioqueue_destroy()
+ *
+ * Destroy ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_destroy(pj_ioqueue_t *ioqueue)
+{
+    pj_ioqueue_key_t *key;
+
+    PJ_ASSERT_RETURN(ioqueue, PJ_EINVAL);
+    PJ_ASSERT_RETURN(ioqueue->ring.fd >= 0, PJ_EINVALIDOP);
+
+    pj_lock_acquire(ioqueue->lock);
+
+    /* Closing the ring also cancels all requests */
+    uring_destroy(&ioqueue->ring);
+#if URING_HAS_RX
+    if (ioqueue->rx_ring)
+        munmap(ioqueue->rx_ring, ioqueue->rx_ring_size);
+#endif
+
+    /* Destroy reference counters */
+    key = ioqueue->active_list.next;
+    while (key != &ioqueue->active_list) {
+        pj_lock_destroy(key->lock);
+        key = key->next;
+    }
+
+    key = ioqueue->closing_list.next;
+    while (key != &ioqueue->closing_list) {
+        pj_lock_destroy(key->lock);
+        key = key->next;
+    }
+
+    key = ioqueue->free_list.next;
+    while (key != &ioqueue->free_list) {
+        pj_lock_destroy(key->lock);
+        key = key->next;
+    }
+
+    pj_mutex_destroy(ioqueue->ref_cnt_mutex);
+    pj_mutex_destroy(ioqueue->ring_mutex);
+    pj_thread_local_free(ioqueue->dispatch_tls_id);
+
+    return ioqueue_destroy(ioqueue);
+}
+
+/*
+ * pj_ioqueue_register_sock()
+ *
+ * Register a socket to ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_register_sock2(pj_pool_t *pool,
+                                              pj_ioqueue_t *ioqueue,
+                                              pj_sock_t sock,
+                                              pj_grp_lock_t *grp_lock,
+                                              void *user_data,
+                                              const pj_ioqueue_callback *cb,
+                                              pj_ioqueue_key_t **p_key)
+{
+    pj_ioqueue_key_t *key = NULL;
+    pj_uint32_t value;
+    pj_status_t rc = PJ_SUCCESS;
+
+    PJ_ASSERT_RETURN(pool && ioqueue && sock != PJ_INVALID_SOCKET &&
+                     cb && p_key, PJ_EINVAL);
+
+    pj_lock_acquire(ioqueue->lock);
+
+    if (ioqueue->count >= ioqueue->max) {
+        rc = PJ_ETOOMANY;
+        TRACE_((THIS_FILE, "pj_ioqueue_register_sock error: too many files"));
+        goto on_return;
+    }
+
+    /* Set socket to nonblocking. */
+    value = 1;
+    if (ioctl(sock, FIONBIO, &value)) {
+        rc = pj_get_netos_error();
+        goto on_return;
+    }
+
+    /* Scan closing_keys first to let them come back to free_list */
+    scan_closing_keys(ioqueue);
+
+    pj_assert(!pj_list_empty(&ioqueue->free_list));
+    if (pj_list_empty(&ioqueue->free_list)) {
+        rc = PJ_ETOOMANY;
+        goto on_return;
+    }
+
+    key = ioqueue->free_list.next;
+    pj_list_erase(key);
+
+    rc = ioqueue_init_key(pool, ioqueue, key, sock, grp_lock, user_data, cb);
+    if (rc != PJ_SUCCESS) {
+        key = NULL;
+        goto on_return;
+    }
+
+    /* Polls are armed when operations are submitted. Zero generation is
+     * skipped, so the user data of the polls is never zero.
+     */
+    pj_mutex_lock(ioqueue->ring_mutex);
+    key->armed = 0;
+    key->rx_head = key->rx_tail = -1;
+    key->rx_poll = PJ_FALSE;
+    key->rx_queued = PJ_FALSE;
+    if (++key->gen == 0)
+        ++key->gen;
+    pj_mutex_unlock(ioqueue->ring_mutex);
+
+    /* Put in active list. */
+    pj_list_insert_before(&ioqueue->active_list, key);
+    ++ioqueue->count;
+
+on_return:
+    *p_key = key;
+    pj_lock_release(ioqueue->lock);
+
+    return rc;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_register_sock( pj_pool_t *pool,
+                                              pj_ioqueue_t *ioqueue,
+                                              pj_sock_t sock,
+                                              void *user_data,
+                                              const pj_ioqueue_callback *cb,
+                                              pj_ioqueue_key_t **p_key)
+{
+    return pj_ioqueue_register_sock2(pool, ioqueue, sock, NULL, user_data,
+                                     cb, p_key);
+}
+
+/* Increment key's reference counter */
+static void increment_counter(pj_ioqueue_key_t *key)
+{
+    pj_mutex_lock(key->ioqueue->ref_cnt_mutex);
+    ++key->ref_count;
+    pj_mutex_unlock(key->ioqueue->ref_cnt_mutex);
+}
+
+/* Decrement the key's reference counter, and when the counter reach zero,
+ * destroy the key.
+ *
+ * Note: MUST NOT CALL THIS FUNCTION WHILE HOLDING ioqueue's LOCK.
+ */
+static void decrement_counter(pj_ioqueue_key_t *key)
+{
+    pj_lock_acquire(key->ioqueue->lock);
+    pj_mutex_lock(key->ioqueue->ref_cnt_mutex);
+    --key->ref_count;
+    if (key->ref_count == 0) {
+
+        pj_assert(key->closing == 1);
+        pj_gettickcount(&key->free_time);
+        key->free_time.msec += PJ_IOQUEUE_KEY_FREE_DELAY;
+        pj_time_val_normalize(&key->free_time);
+
+        pj_list_erase(key);
+        pj_list_push_back(&key->ioqueue->closing_list, key);
+    }
+    pj_mutex_unlock(key->ioqueue->ref_cnt_mutex);
+    pj_lock_release(key->ioqueue->lock);
+}
+
+/*
+ * pj_ioqueue_unregister()
+ *
+ * Unregister handle from ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_unregister( pj_ioqueue_key_t *key)
+{
+    pj_ioqueue_t *ioqueue;
+
+    PJ_ASSERT_RETURN(key != NULL, PJ_EINVAL);
+
+    ioqueue = key->ioqueue;
+
+    /* Lock the key to make sure no callback is simultaneously modifying
+     * the key. We need to lock the key before ioqueue here to prevent
+     * deadlock.
+     */
+    pj_ioqueue_lock_key(key);
+
+    /* Best effort to avoid double key-unregistration */
+    if (IS_CLOSING(key)) {
+        pj_ioqueue_unlock_key(key);
+        return PJ_SUCCESS;
+    }
+
+    /* Also lock ioqueue */
+    pj_lock_acquire(ioqueue->lock);
+
+    /* Avoid "negative" ioqueue count */
+    if (ioqueue->count > 0) {
+        --ioqueue->count;
+    } else {
+        /* If this happens, very likely there is double unregistration
+         * of a key.
+         */
+        pj_assert(!"Bad ioqueue count in key unregistration!");
+        PJ_LOG(1,(THIS_FILE, "Bad ioqueue count in key unregistration!"));
+    }
+
+    /* Mark key is closing, and remove the requests. They must be
+     * removed before the socket is closed, since they hold a reference
+     * to the socket file.
+     */
+    pj_mutex_lock(ioqueue->ring_mutex);
+    key->closing = 1;
+    disarm_polls(ioqueue, key);
+    pj_mutex_unlock(ioqueue->ring_mutex);
+    uring_flush(ioqueue);
+
+    /* Destroy the key. */
+    pj_sock_close(key->fd);
+
+    pj_lock_release(ioqueue->lock);
+
+    /* Decrement counter. */
+    decrement_counter(key);
+
+    /* Done. */
+    if (key->grp_lock) {
+        /* just dec_ref and unlock. we will set grp_lock to NULL
+         * elsewhere */
+        pj_grp_lock_t *grp_lock = key->grp_lock;
+        // Don't set grp_lock to NULL otherwise the other thread
+        // will crash. Just leave it as dangling pointer, but this
+        // should be safe
+        // key->grp_lock = NULL;
+        pj_grp_lock_dec_ref_dbg(grp_lock, "ioqueue", 0);
+        pj_grp_lock_release(grp_lock);
+    } else {
+        pj_ioqueue_unlock_key(key);
+    }
+
+    return PJ_SUCCESS;
+}
+
+/* ioqueue_remove_from_set()
+ * This function is called from ioqueue_dispatch_event() to instruct
+ * the ioqueue to remove the specified descriptor from ioqueue's descriptor
+ * set for the specified event.
+ */
+static void ioqueue_remove_from_set2(pj_ioqueue_t *ioqueue,
+                                     pj_ioqueue_key_t *key,
+                                     unsigned event_types)
+{
+    /* Nothing to do: the polls are one-shot and are only re-armed while
+     * the key has pending operations. A poll that is still armed will
+     * complete at most once more, and the event is then ignored.
+     */
+    PJ_UNUSED_ARG(ioqueue);
+    PJ_UNUSED_ARG(key);
+    PJ_UNUSED_ARG(event_types);
+}
+
+static void ioqueue_remove_from_set( pj_ioqueue_t *ioqueue,
+                                     pj_ioqueue_key_t *key,
+                                     enum ioqueue_event_type event_type )
+{
+    ioqueue_remove_from_set2(ioqueue, key, event_type);
+}
+
+/*
+ * ioqueue_add_to_set()
+ * This function is called from pj_ioqueue_recv(), pj_ioqueue_send() etc
+ * to instruct the ioqueue to add the specified handle to ioqueue's descriptor
+ * set for the specified event.
+ */
+static void ioqueue_add_to_set2(pj_ioqueue_t *ioqueue,
+                                pj_ioqueue_key_t *key,
+                                unsigned event_types)
+{
+    pj_bool_t queued = PJ_FALSE;
+
+    pj_mutex_lock(ioqueue->ring_mutex);
+    if (!IS_CLOSING(key)) {
+        unsigned armed = key->armed;
+
+        if (event_types & READABLE_EVENT)
+            arm_read(ioqueue, key);
+        if ((event_types & (WRITEABLE_EVENT | EXCEPTION_EVENT)) &&
+            (key->armed & WRITEABLE_EVENT) == 0)
+        {
+            arm_poll(ioqueue, key, WRITEABLE_EVENT);
+        }
+        queued = (key->armed != armed);
+    }
+    pj_mutex_unlock(ioqueue->ring_mutex);
+
+    /* When called from a callback, the request will be submitted by the
+     * polling thread after the dispatching.
+     */
+    if (queued && pj_thread_local_get(ioqueue->dispatch_tls_id) != ioqueue)
+        uring_flush(ioqueue);
+}
+
+static void ioqueue_add_to_set( pj_ioqueue_t *ioqueue,
+                                pj_ioqueue_key_t *key,
+                                enum ioqueue_event_type event_type )
+{
+    ioqueue_add_to_set2(ioqueue, key, event_type);
+}
+
+/* Scan closing keys to be put to free list again */
+static void scan_closing_keys(pj_ioqueue_t *ioqueue)
+{
+    pj_time_val now;
+    pj_ioqueue_key_t *h;
+
+    pj_gettickcount(&now);
+    h = ioqueue->closing_list.next;
+    while (h != &ioqueue->closing_list) {
+        pj_ioqueue_key_t *next = h->next;
+
+        pj_assert(h->closing != 0);
+
+        if (PJ_TIME_VAL_GTE(now, h->free_time)) {
+            pj_list_erase(h);
+            // Don't set grp_lock to NULL otherwise the other thread
+            // will crash. Just leave it as dangling pointer, but this
+            // should be safe
+            // h->grp_lock = NULL;
+            pj_list_push_back(&ioqueue->free_list, h);
+        }
+        h = next;
+    }
+}
+
+/*
+ * Get the event to be dispatched for a poll completion, or NO_EVENT.
+ */
+static enum ioqueue_event_type get_event_type(pj_ioqueue_key_t *h,
+                                              pj_bool_t write_poll,
+                                              int res)
+{
+    if (res < 0 || IS_CLOSING(h))
+        return NO_EVENT;
+
+    if (!write_poll) {
+        if (key_has_pending_read(h) || key_has_pending_accept(h))
+            return READABLE_EVENT;
+        return NO_EVENT;
+    }
+
+#if PJ_HAS_TCP
+    if (h->connecting) {
+        return ((res & POLLERR) && !(res & POLLOUT)) ? EXCEPTION_EVENT :
+                                                       WRITEABLE_EVENT;
+    }
+#endif
+
+    if (key_has_pending_write(h))
+        return WRITEABLE_EVENT;
+
+    return NO_EVENT;
+}
+
+/*
+ * pj_ioqueue_poll()
+ *
+ */
+PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
+{
+    enum { MAX_EVENTS = PJ_IOQUEUE_MAX_CAND_EVENTS };
+    struct queue queue[MAX_EVENTS];
+    struct uring *r = &ioqueue->ring;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned to_submit, head, tail;
+    int i, rc, count, event_cnt, processed_cnt;
+    long msec;
+
+    PJ_CHECK_STACK();
+
+    msec = timeout ? PJ_TIME_VAL_MSEC(*timeout) : 9000;
+    ts.tv_sec = msec / 1000;
+    ts.tv_nsec = (msec % 1000) * 1000000;
+
+    pj_bzero(&arg, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (pj_uint64_t)(pj_size_t)&ts;
+
+    /* Submit the queued requests and wait for completions in one go */
+    pj_mutex_lock(ioqueue->ring_mutex);
+    queue_pending_removals(ioqueue);
+    to_submit = ioqueue->sq_pending;
+    ioqueue->sq_pending = 0;
+    ++ioqueue->waiter_cnt;
+    pj_mutex_unlock(ioqueue->ring_mutex);
+
+    TRACE_((THIS_FILE, "start io_uring_enter, submit=%d msec=%d",
+                       to_submit, msec));
+
+    rc = os_uring_enter(r->fd, to_submit, 1,
+                        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                        &arg, sizeof(arg));
+    if (rc < 0) {
+        rc = errno;
+        if (rc == EBUSY || rc == EAGAIN) {
+            /* The entries were not submitted, retry on the next poll */
+            pj_mutex_lock(ioqueue->ring_mutex);
+            ioqueue->sq_pending += to_submit;
+            pj_mutex_unlock(ioqueue->ring_mutex);
+        }
+    } else {
+        rc = 0;
+    }
+
+    pj_mutex_lock(ioqueue->ring_mutex);
+    --ioqueue->waiter_cnt;
+    pj_mutex_unlock(ioqueue->ring_mutex);
+
+    if (rc != 0 && rc != ETIME && rc != EINTR && rc != EBUSY &&
+        rc != EAGAIN)
+    {
+        TRACE_((THIS_FILE, "  io_uring_enter error"));
+        return -PJ_STATUS_FROM_OS(rc);
+    }
+
+    /* Lock ioqueue. */
+    pj_lock_acquire(ioqueue->lock);
+
+    /* Reap the completions */
+    pj_mutex_lock(ioqueue->ring_mutex);
+    head = *r->cq_head;
+    tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    for (count=0, event_cnt=0; head != tail && count < MAX_EVENTS;
+         ++head, ++count)
+    {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        pj_ioqueue_key_t *h;
+        pj_bool_t write_poll, stale;
+        unsigned index, kind;
+        enum ioqueue_event_type event_type;
+
+        /* Completion of removal */
+        if (cqe->user_data == 0)
+            continue;
+
+        index = (unsigned)(cqe->user_data & 0xFFFFFFFF) >> UD_INDEX_SHIFT;
+        kind = (unsigned)(cqe->user_data & UD_KIND_MASK);
+        if (index >= ioqueue->max)
+            continue;
+
+        /* Request of a previous registration of the key, its removal may
+         * have completed after the key was recycled.
+         */
+        h = ioqueue->keys[index];
+        stale = (h->gen != (pj_uint32_t)(cqe->user_data >> UD_GEN_SHIFT));
+
+#if URING_HAS_RX
+        if (kind == UD_RECV || kind == UD_KICK) {
+            TRACE_((THIS_FILE, "     cqe %d: key=%p rx kind=%d res=%d "
+                               "flags=%x", count, h, kind, cqe->res,
+                               cqe->flags));
+            if (rx_complete(ioqueue, h, stale, cqe) && !h->rx_queued) {
+                h->rx_queued = PJ_TRUE;
+                queue[event_cnt].key = h;
+                queue[event_cnt].event_type = READABLE_EVENT;
+                queue[event_cnt].rx = PJ_TRUE;
+                ++event_cnt;
+            }
+            continue;
+        }
+#endif
+
+        if (stale) {
+            TRACE_((THIS_FILE, "     cqe %d: stale poll of key %p", count,
+                               h));
+            continue;
+        }
+
+        /* The one-shot poll is no longer in the ring. A readable socket
+         * can be received with the multishot receive again.
+         */
+        write_poll = (kind == UD_WRITE_POLL);
+        h->armed &= ~(write_poll ? WRITEABLE_EVENT : READABLE_EVENT);
+        if (!write_poll)
+            h->rx_poll = PJ_FALSE;
+
+        TRACE_((THIS_FILE, "     cqe %d: key=%p write=%d res=%x", count, h,
+                           write_poll, cqe->res));
+
+        event_type = get_event_type(h, write_poll, cqe->res);
+        if (event_type != NO_EVENT) {
+            queue[event_cnt].key = h;
+            queue[event_cnt].event_type = event_type;
+            queue[event_cnt].rx = PJ_FALSE;
+            ++event_cnt;
+        }
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    pj_mutex_unlock(ioqueue->ring_mutex);
+
+    if (count > 0) {
+        ++ioqueue->stat.wakeup_cnt;
+        ioqueue->stat.event_cnt += count;
+        if ((unsigned)count > ioqueue->stat.max_event_cnt)
+            ioqueue->stat.max_event_cnt = count;
+    } else if (!pj_list_empty(&ioqueue->closing_list)) {
+        /* Check the closing keys only when there's no activity */
+        scan_closing_keys(ioqueue);
+    }
+
+    for (i=0; i<event_cnt; ++i) {
+        increment_counter(queue[i].key);
+        if (queue[i].key->grp_lock)
+            pj_grp_lock_add_ref_dbg(queue[i].key->grp_lock, "ioqueue", 0);
+    }
+
+    pj_lock_release(ioqueue->lock);
+
+    /* Now process the events. The re-arm requests are queued, and will be
+     * submitted with the next wait.
+     */
+    pj_thread_local_set(ioqueue->dispatch_tls_id, ioqueue);
+
+    processed_cnt = 0;
+    for (i=0; i<event_cnt; ++i) {
+        /* Received datagrams that are not dispatched here will be
+         * dispatched with the next poll, see rearm_key().
+         */
+        if (queue[i].rx) {
+            pj_mutex_lock(ioqueue->ring_mutex);
+            queue[i].key->rx_queued = PJ_FALSE;
+            pj_mutex_unlock(ioqueue->ring_mutex);
+        }
+
+        /* Just do not exceed PJ_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL */
+        if (processed_cnt < PJ_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL) {
+            pj_bool_t event_done = PJ_FALSE;
+
+            switch (queue[i].event_type) {
+            case READABLE_EVENT:
+#if URING_HAS_RX
+                if (queue[i].rx) {
+                    event_done = ioqueue_dispatch_rx_event(ioqueue,
+                                                           queue[i].key);
+                    break;
+                }
+#endif
+                event_done = ioqueue_dispatch_read_event(ioqueue,
+                                                         queue[i].key);
+                break;
+            case WRITEABLE_EVENT:
+                event_done = ioqueue_dispatch_write_event(ioqueue,
+                                                          queue[i].key);
+                break;
+            case EXCEPTION_EVENT:
+                event_done = ioqueue_dispatch_exception_event(ioqueue,
+                                                              queue[i].key);
+                break;
+            case NO_EVENT:
+                pj_assert(!"Invalid event!");
+                break;
+            }
+            if (event_done)
+                ++processed_cnt;
+        }
+
+        /* Re-arm as long as there are pending operations, including when
+         * the event was not dispatched above.
+         */
+        rearm_key(ioqueue, queue[i].key);
+
+        decrement_counter(queue[i].key);
+
+        if (queue[i].key->grp_lock)
+            pj_grp_lock_dec_ref_dbg(queue[i].key->grp_lock,
+                                    "ioqueue", 0);
+    }
+
+    pj_thread_local_set(ioqueue->dispatch_tls_id, NULL);
+
+    /* Other threads waiting in the ring won't see the re-armed polls
+     * until they are submitted, so don't defer them in this case.
+     */
+    pj_mutex_lock(ioqueue->ring_mutex);
+    to_submit = (ioqueue->waiter_cnt > 0) ? ioqueue->sq_pending : 0;
+    pj_mutex_unlock(ioqueue->ring_mutex);
+    if (to_submit)
+        uring_flush(ioqueue);
+
+    TRACE_((THIS_FILE, "     poll: count=%d events=%d processed=%d",
+                       count, event_cnt, processed_cnt));
+
+    return processed_cnt;
+}
+
+PJ_DEF(pj_oshandle_t) pj_ioqueue_get_os_handle( pj_ioqueue_t *ioqueue )
+{
+    return ioqueue ? (pj_oshandle_t)&ioqueue->ring.fd : NULL;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_get_stat(pj_ioqueue_t *ioqueue,
+                                        pj_ioqueue_stat *stat)
+{
+    PJ_ASSERT_RETURN(ioqueue && stat, PJ_EINVAL);
+
+    pj_lock_acquire(ioqueue->lock);
+    pj_memcpy(stat, &ioqueue->stat, sizeof(*stat));
+    pj_lock_release(ioqueue->lock);
+
+    return PJ_SUCCESS;
+}
@@ -16,11 +16,17 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
  */
+/* For recvmmsg() and sendmmsg() with glibc, see PJ_SOCK_HAS_MMSG */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE
+#endif
+
 #include <pj/sock.h>
 #include <pj/assert.h>
 #include <pj/ctype.h>
 #include <pj/errno.h>
 #include <pj/ip_helper.h>
+#include <pj/math.h>
 #include <pj/os.h>
 #include <pj/addr_resolv.h>
 #include <pj/rand.h>
@@ -1386,6 +1392,142 @@ PJ_DEF(pj_status_t) pj_sock_socketpair(int family,
 #endif
 
 
+#if defined(PJ_SOCK_HAS_MMSG) && PJ_SOCK_HAS_MMSG!=0
+PJ_DEF(pj_status_t) pj_sock_recvmmsg(pj_sock_t sockfd,
+                                     pj_sock_mmsg msgs[],
+                                     unsigned *count,
+                                     unsigned flags)
+{
+    struct mmsghdr hdr[PJ_SOCK_MAX_MMSG];
+    struct iovec iov[PJ_SOCK_MAX_MMSG];
+    unsigned i, cnt;
+    int rc;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(msgs && count && *count, PJ_EINVAL);
+
+    cnt = PJ_MIN(*count, PJ_SOCK_MAX_MMSG);
+    pj_bzero(hdr, cnt * sizeof(hdr[0]));
+    for (i=0; i<cnt; ++i) {
+        iov[i].iov_base = msgs[i].buf;
+        iov[i].iov_len = msgs[i].len;
+        hdr[i].msg_hdr.msg_name = &msgs[i].addr;
+        hdr[i].msg_hdr.msg_namelen = sizeof(msgs[i].addr);
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    rc = recvmmsg(sockfd, hdr, cnt, flags, NULL);
+    if (rc < 0) {
+        *count = 0;
+        return PJ_RETURN_OS_ERROR(pj_get_native_netos_error());
+    }
+
+    for (i=0; i<(unsigned)rc; ++i) {
+        msgs[i].len = hdr[i].msg_len;
+        msgs[i].addr_len = hdr[i].msg_hdr.msg_namelen;
+        PJ_SOCKADDR_RESET_LEN(&msgs[i].addr);
+    }
+    *count = rc;
+
+    return PJ_SUCCESS;
+}
+
+PJ_DEF(pj_status_t) pj_sock_sendmmsg(pj_sock_t sockfd,
+                                     pj_sock_mmsg msgs[],
+                                     unsigned *count,
+                                     unsigned flags)
+{
+    struct mmsghdr hdr[PJ_SOCK_MAX_MMSG];
+    struct iovec iov[PJ_SOCK_MAX_MMSG];
+    unsigned i, cnt;
+    int rc;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(msgs && count && *count, PJ_EINVAL);
+
+#ifdef MSG_NOSIGNAL
+    /* Suppress SIGPIPE, as in pj_sock_sendto() */
+    flags |= MSG_NOSIGNAL;
+#endif
+
+    cnt = PJ_MIN(*count, PJ_SOCK_MAX_MMSG);
+    pj_bzero(hdr, cnt * sizeof(hdr[0]));
+    for (i=0; i<cnt; ++i) {
+        iov[i].iov_base = msgs[i].buf;
+        iov[i].iov_len = msgs[i].len;
+        hdr[i].msg_hdr.msg_name = &msgs[i].addr;
+        hdr[i].msg_hdr.msg_namelen = msgs[i].addr_len;
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    rc = sendmmsg(sockfd, hdr, cnt, flags);
+    if (rc < 0) {
+        *count = 0;
+        return PJ_RETURN_OS_ERROR(pj_get_native_netos_error());
+    }
+
+    for (i=0; i<(unsigned)rc; ++i) {
+        msgs[i].len = hdr[i].msg_len;
+    }
+    *count = rc;
+
+    return PJ_SUCCESS;
+}
+#else
+PJ_DEF(pj_status_t) pj_sock_recvmmsg(pj_sock_t sockfd,
+                                     pj_sock_mmsg msgs[],
+                                     unsigned *count,
+                                     unsigned flags)
+{
+    unsigned i, cnt;
+    pj_status_t status = PJ_SUCCESS;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(msgs && count && *count, PJ_EINVAL);
+
+    cnt = PJ_MIN(*count, PJ_SOCK_MAX_MMSG);
+    for (i=0; i<cnt; ++i) {
+        msgs[i].addr_len = sizeof(msgs[i].addr);
+        status = pj_sock_recvfrom(sockfd, msgs[i].buf, &msgs[i].len, flags,
+                                  &msgs[i].addr, &msgs[i].addr_len);
+        if (status != PJ_SUCCESS)
+            break;
+    }
+    *count = i;
+
+    return (i > 0) ? PJ_SUCCESS : status;
+}
+
+PJ_DEF(pj_status_t) pj_sock_sendmmsg(pj_sock_t sockfd,
+                                     pj_sock_mmsg msgs[],
+                                     unsigned *count,
+                                     unsigned flags)
+{
+    unsigned i, cnt;
+    pj_status_t status = PJ_SUCCESS;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(msgs && count && *count, PJ_EINVAL);
+
+    cnt = PJ_MIN(*count, PJ_SOCK_MAX_MMSG);
+    for (i=0; i<cnt; ++i) {
+        pj_ssize_t len = msgs[i].len;
+
+        status = pj_sock_sendto(sockfd, msgs[i].buf, &len, flags,
+                                &msgs[i].addr, msgs[i].addr_len);
+        if (status != PJ_SUCCESS)
+            break;
+        msgs[i].len = len;
+    }
+    *count = i;
+
+    return (i > 0) ? PJ_SUCCESS : status;
+}
+#endif  /* PJ_SOCK_HAS_MMSG */
+
+
 /* Only need to implement these in DLL build */
 #if defined(PJ_DLL)
 
@@ -1524,6 +1666,11 @@ PJ_DEF(pj_uint16_t) pj_SO_REUSEADDR(void)
     return PJ_SO_REUSEADDR;
 }
 
+PJ_DEF(pj_uint16_t) pj_SO_REUSEPORT(void)
+{
+    return PJ_SO_REUSEPORT;
+}
+
 PJ_DEF(pj_uint16_t) pj_SO_NOSIGPIPE(void)
 {
     return PJ_SO_NOSIGPIPE;
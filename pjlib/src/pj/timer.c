@@ -45,6 +45,17 @@
 
 #define DEFAULT_MAX_TIMED_OUT_PER_POLL  (64)
 
+/* Timing wheel geometry: each level has 64 slots, and a slot of a level
+ * spans a whole round of the level below it. With 1 msec ticks, six levels
+ * cover 2^36 msec (about two years); entries beyond that are put in the
+ * farthest slot and are moved again when that slot is reached.
+ */
+#define WHEEL_BITS      6
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    6
+#define WHEEL_RANGE     ((pj_uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
 /* Enable this to raise assertion in order to catch bug of timer entry
  * which has been deallocated without being cancelled. If disabled,
  * the timer heap will simply remove the destroyed entry (and print log)
@@ -116,6 +127,17 @@ typedef pj_timer_entry pj_timer_entry_dup;
 
 #endif
 
+/* Link of an entry in a timing wheel slot. The slots are circular doubly
+ * linked lists of timer ids (id zero is never used, so it means "none"),
+ * which stay valid when the timer heap grows.
+ */
+typedef struct wheel_node
+{
+    pj_timer_id_t   next;
+    pj_timer_id_t   prev;
+    unsigned        pos;        /* level * WHEEL_SLOTS + slot       */
+} wheel_node;
+
 /**
  * The implementation of timer heap.
  */
@@ -181,6 +203,48 @@ struct pj_timer_heap_t
     /** Callback to be called when a timer expires. */
     pj_timer_heap_callback *callback;
 
+    /** Type of the timer heap. */
+    pj_timer_heap_type type;
+
+    /**
+     * Timing wheel. In this mode, <heap> is indexed by timer id instead of
+     * being a heap, <timer_ids> maps each active timer id to itself, and
+     * the entries are linked in the slots through <wheel_nodes>.
+     */
+    wheel_node *wheel_nodes;
+
+    /** Head of each slot, zero if the slot is empty. */
+    pj_timer_id_t wheel_head[WHEEL_LEVELS][WHEEL_SLOTS];
+
+    /** Bitmask of the non-empty slots of each level. */
+    pj_uint64_t wheel_bits[WHEEL_LEVELS];
+
+    /**
+     * Current tick, in msec. All ticks before this have been processed,
+     * and the level zero slot of this tick holds the entries which are
+     * due now.
+     */
+    pj_uint64_t wheel_time;
+
+    /** The sharded timer heap owning this shard, NULL if not a shard. */
+    pj_timer_heap_t *parent;
+
+    /** Index of this shard in the parent. */
+    unsigned shard_idx;
+
+    /** Number of shards, zero if this timer heap is not sharded. */
+    unsigned shard_cnt;
+
+    /** The shards, and the pools where they allocate from. */
+    pj_timer_heap_t **shards;
+    pj_pool_t **shard_pools;
+
+    /** Thread local storing the shard of each poller thread, plus one. */
+    long poller_tls_id;
+
+    /** The shard to be assigned to the next new poller thread. */
+    unsigned next_poller_shard;
+
 };
 
 
@@ -200,6 +264,238 @@ PJ_INLINE(void) unlock_timer_heap( pj_timer_heap_t *ht )
 }
 
 
+PJ_INLINE(pj_uint64_t) time_to_tick(const pj_time_val *t)
+{
+    return (pj_uint64_t)t->sec * 1000 + t->msec;
+}
+
+/* Index of the lowest bit set, the value must not be zero. */
+static unsigned lowest_bit(pj_uint64_t v)
+{
+    unsigned n = 0;
+
+    if ((v & 0xFFFFFFFF) == 0) { n += 32; v >>= 32; }
+    if ((v & 0xFFFF) == 0) { n += 16; v >>= 16; }
+    if ((v & 0xFF) == 0) { n += 8; v >>= 8; }
+    if ((v & 0xF) == 0) { n += 4; v >>= 4; }
+    if ((v & 0x3) == 0) { n += 2; v >>= 2; }
+    if ((v & 0x1) == 0) { n += 1; }
+    return n;
+}
+
+/* Put the entry to the slot according to its expiration tick. */
+static void wheel_link(pj_timer_heap_t *ht, pj_timer_id_t id,
+                       pj_uint64_t tick)
+{
+    wheel_node *node = &ht->wheel_nodes[id];
+    pj_timer_id_t *head;
+    unsigned level = 0, slot;
+
+    if (tick < ht->wheel_time)
+        tick = ht->wheel_time;
+    else if (tick - ht->wheel_time >= WHEEL_RANGE)
+        tick = ht->wheel_time + WHEEL_RANGE - 1;
+
+    while ((tick - ht->wheel_time) >> (WHEEL_BITS * (level+1)))
+        ++level;
+
+    slot = (unsigned)(tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    node->pos = level * WHEEL_SLOTS + slot;
+    head = &ht->wheel_head[level][slot];
+
+    /* Append to keep the order of entries with the same expiration */
+    if (*head == 0) {
+        node->next = node->prev = id;
+        *head = id;
+        ht->wheel_bits[level] |= ((pj_uint64_t)1 << slot);
+    } else {
+        wheel_node *first = &ht->wheel_nodes[*head];
+
+        node->next = *head;
+        node->prev = first->prev;
+        ht->wheel_nodes[first->prev].next = id;
+        first->prev = id;
+    }
+}
+
+/* Remove the entry from its slot. */
+static void wheel_unlink(pj_timer_heap_t *ht, pj_timer_id_t id)
+{
+    wheel_node *node = &ht->wheel_nodes[id];
+    unsigned level = node->pos / WHEEL_SLOTS;
+    unsigned slot = node->pos % WHEEL_SLOTS;
+    pj_timer_id_t *head = &ht->wheel_head[level][slot];
+
+    if (node->next == id) {
+        *head = 0;
+        ht->wheel_bits[level] &= ~((pj_uint64_t)1 << slot);
+    } else {
+        ht->wheel_nodes[node->prev].next = node->next;
+        ht->wheel_nodes[node->next].prev = node->prev;
+        if (*head == id)
+            *head = node->next;
+    }
+}
+
+/* Move the entries of the slot to the lower levels. */
+static void wheel_cascade_slot(pj_timer_heap_t *ht, unsigned level,
+                               unsigned slot)
+{
+    pj_timer_id_t first = ht->wheel_head[level][slot];
+    pj_timer_id_t id = first;
+
+    if (!first)
+        return;
+
+    ht->wheel_head[level][slot] = 0;
+    ht->wheel_bits[level] &= ~((pj_uint64_t)1 << slot);
+
+    do {
+        pj_timer_id_t next = ht->wheel_nodes[id].next;
+
+        wheel_link(ht, id, time_to_tick(&ht->heap[id]->_timer_value));
+        id = next;
+    } while (id != first);
+}
+
+/* Advance the current tick towards now, stopping at the first tick which
+ * has due entries. Empty slots are skipped.
+ */
+static void wheel_advance(pj_timer_heap_t *ht, pj_uint64_t now)
+{
+    if (ht->cur_size == 0) {
+        if (now > ht->wheel_time)
+            ht->wheel_time = now;
+        return;
+    }
+
+    while (ht->wheel_time < now) {
+        unsigned idx = (unsigned)ht->wheel_time & WHEEL_MASK;
+        pj_uint64_t next;
+        unsigned level;
+
+        if (ht->wheel_head[0][idx])
+            return;
+
+        /* Skip to the next non-empty slot of this round */
+        if (idx < WHEEL_MASK && (ht->wheel_bits[0] >> (idx+1))) {
+            next = ht->wheel_time + 1 +
+                   lowest_bit(ht->wheel_bits[0] >> (idx+1));
+            ht->wheel_time = (next < now) ? next : now;
+            continue;
+        }
+
+        /* Nothing left in this round, go to the start of the next round */
+        next = (ht->wheel_time | WHEEL_MASK) + 1;
+        if (next > now) {
+            ht->wheel_time = now;
+            return;
+        }
+        ht->wheel_time = next;
+
+        /* Move the entries of the next round down from the upper levels */
+        for (level = 1; level < WHEEL_LEVELS; ++level) {
+            unsigned slot = (unsigned)(next >> (WHEEL_BITS * level)) &
+                            WHEEL_MASK;
+
+            wheel_cascade_slot(ht, level, slot);
+            if (slot != 0)
+                break;
+        }
+    }
+}
+
+/* Get the earliest tick of the first non-empty slot of each level after the
+ * current tick, which is the earliest tick at which polling may find some
+ * work. If exact is set, the entries of these slots are examined to get the
+ * expiration time of the earliest entry.
+ */
+static pj_uint64_t wheel_next_tick(pj_timer_heap_t *ht, pj_bool_t exact)
+{
+    pj_uint64_t earliest = (pj_uint64_t)-1;
+    unsigned level;
+
+    if (ht->wheel_head[0][ht->wheel_time & WHEEL_MASK])
+        return ht->wheel_time;
+
+    for (level = 0; level < WHEEL_LEVELS; ++level) {
+        pj_uint64_t bits = ht->wheel_bits[level];
+        pj_uint64_t base, tick;
+        unsigned shift, k;
+
+        if (!bits)
+            continue;
+
+        /* Rotate so that bit zero is the slot after the current one */
+        base = ht->wheel_time >> (WHEEL_BITS * level);
+        shift = (unsigned)(base + 1) & WHEEL_MASK;
+        if (shift)
+            bits = (bits >> shift) | (bits << (WHEEL_SLOTS - shift));
+
+        k = lowest_bit(bits);
+        tick = (base + 1 + k) << (WHEEL_BITS * level);
+
+        if (exact && level > 0) {
+            pj_timer_id_t first, id;
+
+            first = ht->wheel_head[level][(base + 1 + k) & WHEEL_MASK];
+            id = first;
+            tick = (pj_uint64_t)-1;
+            do {
+                pj_uint64_t t = time_to_tick(&ht->heap[id]->_timer_value);
+                if (t < tick)
+                    tick = t;
+                id = ht->wheel_nodes[id].next;
+            } while (id != first);
+        }
+
+        if (tick < earliest)
+            earliest = tick;
+    }
+
+    return earliest;
+}
+
+/* Get the slot of the earliest entry if it has expired. */
+static pj_bool_t get_expired_slot(pj_timer_heap_t *ht,
+                                  const pj_time_val *now,
+                                  pj_size_t *slot)
+{
+    if (!ht->cur_size)
+        return PJ_FALSE;
+
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL) {
+        wheel_advance(ht, time_to_tick(now));
+        *slot = ht->wheel_head[0][ht->wheel_time & WHEEL_MASK];
+        return (*slot != 0);
+    }
+
+#if PJ_TIMER_USE_LINKED_LIST
+    *slot = ht->timer_ids[GET_FIELD(ht->head_list.next, _timer_id)];
+#else
+    *slot = 0;
+#endif
+    return PJ_TIME_VAL_LTE(ht->heap[*slot]->_timer_value, *now);
+}
+
+/* Get the expiration time of the earliest entry, the heap must not be
+ * empty. For the timing wheel, unless exact is set, this may be earlier
+ * than the actual expiration time.
+ */
+static void get_earliest_time(pj_timer_heap_t *ht, pj_bool_t exact,
+                              pj_time_val *timeval)
+{
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL) {
+        pj_uint64_t tick = wheel_next_tick(ht, exact);
+
+        timeval->sec = (long)(tick / 1000);
+        timeval->msec = (long)(tick % 1000);
+        return;
+    }
+
+    *timeval = ht->heap[0]->_timer_value;
+}
+
 static void copy_node( pj_timer_heap_t *ht, pj_size_t slot, 
                        pj_timer_entry_dup *moved_node )
 {
@@ -334,6 +630,12 @@ static pj_timer_entry_dup * remove_node( pj_timer_heap_t *ht, size_t slot)
     GET_ENTRY(removed_node)->_timer_id = -1;
     GET_FIELD(removed_node, _timer_id) = -1;
 
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL) {
+        wheel_unlink(ht, (pj_timer_id_t)slot);
+        ht->heap[slot] = NULL;
+        return removed_node;
+    }
+
 #if !PJ_TIMER_USE_LINKED_LIST
     // Only try to reheapify if we're not deleting the last entry.
 
@@ -401,11 +703,19 @@ static pj_status_t grow_heap(pj_timer_heap_t *ht)
 
     memcpy(new_timer_dups, ht->timer_dups,
            ht->max_size * sizeof(pj_timer_entry_dup));
-    for (i = 0; i < ht->cur_size; i++) {
-        int idx = (int)(ht->heap[i] - ht->timer_dups);
-        // Point to the address in the new array
-        pj_assert(idx >= 0 && idx < (int)ht->max_size);
-        new_heap[i] = &new_timer_dups[idx];
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL) {
+        // The heap is indexed by timer id
+        for (i = 0; i < ht->max_size; i++) {
+            if (ht->heap[i])
+                new_heap[i] = &new_timer_dups[i];
+        }
+    } else {
+        for (i = 0; i < ht->cur_size; i++) {
+            int idx = (int)(ht->heap[i] - ht->timer_dups);
+            // Point to the address in the new array
+            pj_assert(idx >= 0 && idx < (int)ht->max_size);
+            new_heap[i] = &new_timer_dups[idx];
+        }
     }
     ht->timer_dups = new_timer_dups;
 #else
@@ -442,6 +752,19 @@ static pj_status_t grow_heap(pj_timer_heap_t *ht)
     for (i = ht->max_size; i < new_size; i++)
         ht->timer_ids[i] = -((pj_timer_id_t) (i + 1));
 
+    // Grow the timing wheel links.
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL) {
+        wheel_node *new_nodes;
+
+        new_nodes = (wheel_node*)
+                    pj_pool_calloc(ht->pool, new_size, sizeof(wheel_node));
+        if (!new_nodes)
+            return PJ_ENOMEM;
+
+        memcpy(new_nodes, ht->wheel_nodes, ht->max_size * sizeof(wheel_node));
+        ht->wheel_nodes = new_nodes;
+    }
+
     ht->max_size = new_size;
 
     return PJ_SUCCESS;
@@ -477,6 +800,22 @@ static pj_status_t insert_node(pj_timer_heap_t *ht,
 
     timer_copy->_timer_value = *future_time;
 
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL) {
+        // Don't walk the wheel through the time it has been empty.
+        if (ht->cur_size == 0) {
+            pj_time_val now;
+
+            pj_gettickcount(&now);
+            wheel_advance(ht, time_to_tick(&now));
+        }
+
+        copy_node(ht, new_node->_timer_id, timer_copy);
+        wheel_link(ht, new_node->_timer_id, time_to_tick(future_time));
+        ht->cur_size++;
+
+        return PJ_SUCCESS;
+    }
+
 #if !PJ_TIMER_USE_LINKED_LIST
     reheap_up(ht, timer_copy, ht->cur_size, HEAP_PARENT(ht->cur_size));
 #else
@@ -573,10 +912,26 @@ PJ_DEF(pj_size_t) pj_timer_heap_mem_size(pj_size_t count)
            /* size of each entry: */
            (count+2) * (sizeof(pj_timer_entry_dup*)+sizeof(pj_timer_id_t)+
            sizeof(pj_timer_entry_dup)) +
+           /* timing wheel links, if used: */
+           (count+2) * sizeof(wheel_node) +
            /* lock, pool etc: */
            132;
 }
 
+/*
+ * Initialize timer heap settings with default values.
+ */
+PJ_DEF(void) pj_timer_heap_cfg_default(pj_timer_heap_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+#if PJ_TIMER_USE_WHEEL
+    cfg->type = PJ_TIMER_HEAP_TYPE_WHEEL;
+#else
+    cfg->type = PJ_TIMER_HEAP_TYPE_HEAP;
+#endif
+    cfg->shard_cnt = 1;
+}
+
 /*
  * Create a new timer heap.
  */
@@ -584,13 +939,117 @@ PJ_DEF(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
                                           pj_size_t size,
                                           pj_timer_heap_t **p_heap)
 {
+    return pj_timer_heap_create2(pool, size, NULL, p_heap);
+}
+
+/*
+ * Create a sharded timer heap. Each shard is a timer heap with its own
+ * pool and lock, since shards grow independently of each other.
+ */
+static pj_status_t create_shards(pj_pool_t *pool,
+                                 pj_size_t size,
+                                 const pj_timer_heap_cfg *cfg,
+                                 pj_timer_heap_t **p_heap)
+{
+    pj_timer_heap_cfg shard_cfg;
+    pj_size_t shard_size;
+    pj_timer_heap_t *ht;
+    pj_status_t status;
+    unsigned i;
+
+    ht = PJ_POOL_ZALLOC_T(pool, pj_timer_heap_t);
+    if (!ht)
+        return PJ_ENOMEM;
+
+    ht->pool = pool;
+    ht->type = cfg->type;
+    ht->max_entries_per_poll = DEFAULT_MAX_TIMED_OUT_PER_POLL;
+    ht->shards = (pj_timer_heap_t**)
+                 pj_pool_calloc(pool, cfg->shard_cnt, sizeof(ht->shards[0]));
+    ht->shard_pools = (pj_pool_t**)
+                      pj_pool_calloc(pool, cfg->shard_cnt,
+                                     sizeof(ht->shard_pools[0]));
+    if (!ht->shards || !ht->shard_pools)
+        return PJ_ENOMEM;
+
+    status = pj_thread_local_alloc(&ht->poller_tls_id);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    /* Set the shard count now so that destroy cleans up the shards */
+    ht->shard_cnt = cfg->shard_cnt;
+
+    status = pj_lock_create_simple_mutex(pool, "tmrshard", &ht->lock);
+    if (status != PJ_SUCCESS)
+        goto on_error;
+    ht->auto_delete_lock = PJ_TRUE;
+
+    pj_memcpy(&shard_cfg, cfg, sizeof(shard_cfg));
+    shard_cfg.shard_cnt = 1;
+    shard_size = size / cfg->shard_cnt + 1;
+
+    for (i = 0; i < cfg->shard_cnt; ++i) {
+        pj_timer_heap_t *shard;
+        pj_lock_t *lock;
+
+        ht->shard_pools[i] = pj_pool_create(pool->factory, "tmrshard%p",
+                                            pj_timer_heap_mem_size(shard_size),
+                                            4000, NULL);
+        if (!ht->shard_pools[i]) {
+            status = PJ_ENOMEM;
+            goto on_error;
+        }
+
+        status = pj_timer_heap_create2(ht->shard_pools[i], shard_size,
+                                       &shard_cfg, &ht->shards[i]);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+
+        shard = ht->shards[i];
+        shard->parent = ht;
+        shard->shard_idx = i;
+
+        status = pj_lock_create_recursive_mutex(ht->shard_pools[i],
+                                                "tmrshard%p", &lock);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+        pj_timer_heap_set_lock(shard, lock, PJ_TRUE);
+    }
+
+    *p_heap = ht;
+    return PJ_SUCCESS;
+
+on_error:
+    pj_timer_heap_destroy(ht);
+    return status;
+}
+
+/*
+ * Create a new timer heap with the specified settings.
+ */
+PJ_DEF(pj_status_t) pj_timer_heap_create2( pj_pool_t *pool,
+                                           pj_size_t size,
+                                           const pj_timer_heap_cfg *cfg,
+                                           pj_timer_heap_t **p_heap)
+{
+    pj_timer_heap_cfg default_cfg;
     pj_timer_heap_t *ht;
     pj_size_t i;
 
     PJ_ASSERT_RETURN(pool && p_heap, PJ_EINVAL);
 
+    if (!cfg) {
+        pj_timer_heap_cfg_default(&default_cfg);
+        cfg = &default_cfg;
+    }
+    PJ_ASSERT_RETURN(cfg->type == PJ_TIMER_HEAP_TYPE_HEAP ||
+                     cfg->type == PJ_TIMER_HEAP_TYPE_WHEEL, PJ_EINVAL);
+
     *p_heap = NULL;
 
+    if (cfg->shard_cnt > 1)
+        return create_shards(pool, size, cfg, p_heap);
+
     /* Magic? */
     size += 2;
 
@@ -605,6 +1064,7 @@ PJ_DEF(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
     ht->max_entries_per_poll = DEFAULT_MAX_TIMED_OUT_PER_POLL;
     ht->timer_ids_freelist = 1;
     ht->pool = pool;
+    ht->type = cfg->type;
 
     /* Lock. */
     ht->lock = NULL;
@@ -640,12 +1100,37 @@ PJ_DEF(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
     pj_list_init(&ht->head_list);
 #endif
 
+    if (ht->type == PJ_TIMER_HEAP_TYPE_WHEEL) {
+        pj_time_val now;
+
+        ht->wheel_nodes = (wheel_node*)
+                          pj_pool_calloc(pool, size, sizeof(wheel_node));
+        if (!ht->wheel_nodes)
+            return PJ_ENOMEM;
+
+        pj_gettickcount(&now);
+        ht->wheel_time = time_to_tick(&now);
+    }
+
     *p_heap = ht;
     return PJ_SUCCESS;
 }
 
 PJ_DEF(void) pj_timer_heap_destroy( pj_timer_heap_t *ht )
 {
+    if (ht->shard_cnt) {
+        unsigned i;
+
+        for (i = 0; i < ht->shard_cnt; ++i) {
+            if (ht->shards[i])
+                pj_timer_heap_destroy(ht->shards[i]);
+            if (ht->shard_pools[i])
+                pj_pool_release(ht->shard_pools[i]);
+        }
+        pj_thread_local_free(ht->poller_tls_id);
+        ht->shard_cnt = 0;
+    }
+
     if (ht->lock && ht->auto_delete_lock) {
         pj_lock_destroy(ht->lock);
         ht->lock = NULL;
@@ -668,7 +1153,11 @@ PJ_DEF(unsigned) pj_timer_heap_set_max_timed_out_per_poll(pj_timer_heap_t *ht,
                                                           unsigned count )
 {
     unsigned old_count = ht->max_entries_per_poll;
+    unsigned i;
+
     ht->max_entries_per_poll = count;
+    for (i = 0; i < ht->shard_cnt; ++i)
+        ht->shards[i]->max_entries_per_poll = count;
     return old_count;
 }
 
@@ -680,6 +1169,7 @@ PJ_DEF(pj_timer_entry*) pj_timer_entry_init( pj_timer_entry *entry,
     pj_assert(entry && cb);
 
     entry->_timer_id = -1;
+    entry->_shard = 0;
     entry->id = id;
     entry->user_data = user_data;
     entry->cb = cb;
@@ -695,6 +1185,34 @@ PJ_DEF(pj_bool_t) pj_timer_entry_running( pj_timer_entry *entry )
     return (entry->_timer_id >= 1);
 }
 
+/* Get the shard for the entry. Entries sharing a group lock are put in the
+ * same shard.
+ */
+static unsigned get_entry_shard(pj_timer_heap_t *ht,
+                                const pj_timer_entry *entry,
+                                const pj_grp_lock_t *grp_lock)
+{
+    pj_size_t key = grp_lock ? (pj_size_t)grp_lock : (pj_size_t)entry;
+
+    /* Drop the low bits which are the same due to alignment */
+    key = (key >> 4) ^ (key >> 12);
+    return (unsigned)(key % ht->shard_cnt);
+}
+
+/* Get the shard to be drained first by the calling thread. */
+static unsigned get_poller_shard(pj_timer_heap_t *ht)
+{
+    pj_size_t idx = (pj_size_t)pj_thread_local_get(ht->poller_tls_id);
+
+    if (idx == 0) {
+        lock_timer_heap(ht);
+        idx = (ht->next_poller_shard++ % ht->shard_cnt) + 1;
+        unlock_timer_heap(ht);
+        pj_thread_local_set(ht->poller_tls_id, (void*)idx);
+    }
+    return (unsigned)(idx - 1);
+}
+
 #if PJ_TIMER_DEBUG
 static pj_status_t schedule_w_grp_lock_dbg(pj_timer_heap_t *ht,
                                            pj_timer_entry *entry,
@@ -719,6 +1237,19 @@ static pj_status_t schedule_w_grp_lock(pj_timer_heap_t *ht,
     PJ_ASSERT_RETURN(ht && entry && delay, PJ_EINVAL);
     PJ_ASSERT_RETURN(entry->cb != NULL, PJ_EINVAL);
 
+    if (ht->shard_cnt) {
+        pj_timer_heap_t *shard;
+
+        shard = ht->shards[get_entry_shard(ht, entry, grp_lock)];
+#if PJ_TIMER_DEBUG
+        return schedule_w_grp_lock_dbg(shard, entry, delay, set_id, id_val,
+                                       grp_lock, src_file, src_line);
+#else
+        return schedule_w_grp_lock(shard, entry, delay, set_id, id_val,
+                                   grp_lock);
+#endif
+    }
+
     /* Prevent same entry from being scheduled more than once */
     //PJ_ASSERT_RETURN(entry->_timer_id < 1, PJ_EINVALIDOP);
 
@@ -739,6 +1270,7 @@ static pj_status_t schedule_w_grp_lock(pj_timer_heap_t *ht,
     if (status == PJ_SUCCESS) {
         pj_timer_entry_dup *timer_copy = GET_TIMER(ht, entry);
 
+        entry->_shard = ht->shard_idx;
         if (set_id)
             GET_FIELD(timer_copy, id) = entry->id = id_val;
         timer_copy->_grp_lock = grp_lock;
@@ -809,7 +1341,26 @@ static int cancel_timer(pj_timer_heap_t *ht,
 
     PJ_ASSERT_RETURN(ht && entry, PJ_EINVAL);
 
+    if (ht->shard_cnt) {
+        /* Retry if the entry is moved to another shard before we get
+         * the shard lock.
+         */
+        do {
+            unsigned idx = entry->_shard;
+
+            if (idx >= ht->shard_cnt)
+                return 0;
+            count = cancel_timer(ht->shards[idx], entry, flags, id_val);
+        } while (count < 0);
+
+        return count;
+    }
+
     lock_timer_heap(ht);
+    if (ht->parent && entry->_shard != ht->shard_idx) {
+        unlock_timer_heap(ht);
+        return -1;
+    }
     timer_copy = GET_TIMER(ht, entry);
     grp_lock = timer_copy->_grp_lock;
 
@@ -841,16 +1392,44 @@ PJ_DEF(int) pj_timer_heap_cancel_if_active(pj_timer_heap_t *ht,
     return cancel_timer(ht, entry, F_SET_ID | F_DONT_ASSERT, id_val);
 }
 
+/* Poll a sharded timer heap. The shard of the calling thread is polled
+ * first, then the other shards in turn. Each shard polls at most
+ * max_entries_per_poll entries, so a shard that keeps expiring entries
+ * does not starve the others.
+ */
+static unsigned poll_shards(pj_timer_heap_t *ht, pj_time_val *next_delay)
+{
+    unsigned own = get_poller_shard(ht);
+    unsigned i, count = 0;
+
+    if (next_delay)
+        next_delay->sec = next_delay->msec = PJ_MAXINT32;
+
+    for (i = 0; i < ht->shard_cnt; ++i) {
+        pj_timer_heap_t *shard = ht->shards[(own + i) % ht->shard_cnt];
+        pj_time_val delay;
+
+        count += pj_timer_heap_poll(shard, next_delay ? &delay : NULL);
+
+        if (next_delay && PJ_TIME_VAL_LT(delay, *next_delay))
+            *next_delay = delay;
+    }
+
+    return count;
+}
+
 PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht, 
                                      pj_time_val *next_delay )
 {
     pj_time_val now;
-    pj_time_val min_time_node = {0,0};
     unsigned count;
-    pj_timer_id_t slot = 0;
+    pj_size_t slot;
 
     PJ_ASSERT_RETURN(ht, 0);
 
+    if (ht->shard_cnt)
+        return poll_shards(ht, next_delay);
+
     lock_timer_heap(ht);
     if (!ht->cur_size && next_delay) {
         next_delay->sec = next_delay->msec = PJ_MAXINT32;
@@ -861,16 +1440,8 @@ PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht,
     count = 0;
     pj_gettickcount(&now);
 
-    if (ht->cur_size) {
-#if PJ_TIMER_USE_LINKED_LIST
-        slot = ht->timer_ids[GET_FIELD(ht->head_list.next, _timer_id)];
-#endif
-        min_time_node = ht->heap[slot]->_timer_value;
-    }
-
-    while ( ht->cur_size && 
-            PJ_TIME_VAL_LTE(min_time_node, now) &&
-            count < ht->max_entries_per_poll ) 
+    while ( count < ht->max_entries_per_poll &&
+            get_expired_slot(ht, &now, &slot) )
     {
         pj_timer_entry_dup *node = remove_node(ht, slot);
         pj_timer_entry *entry = GET_ENTRY(node);
@@ -909,7 +1480,7 @@ PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht,
         PJ_RACE_ME(5);
 
         if (valid && entry->cb)
-            (*entry->cb)(ht, entry);
+            (*entry->cb)(ht->parent ? ht->parent : ht, entry);
 
         if (valid && grp_lock)
             pj_grp_lock_dec_ref(grp_lock);
@@ -918,17 +1489,11 @@ PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht,
         /* Now, the timer is really free for re-use. */
         ///push_freelist(ht, node_timer_id);
 
-        if (ht->cur_size) {
-#if PJ_TIMER_USE_LINKED_LIST
-            slot = ht->timer_ids[GET_FIELD(ht->head_list.next, _timer_id)];
-#endif
-            min_time_node = ht->heap[slot]->_timer_value;
-            /* Update now */
-            pj_gettickcount(&now);
-        }
+        /* Update now */
+        pj_gettickcount(&now);
     }
     if (ht->cur_size && next_delay) {
-        *next_delay = ht->heap[0]->_timer_value;
+        get_earliest_time(ht, PJ_FALSE, next_delay);
         if (count > 0)
             pj_gettickcount(&now);
         PJ_TIME_VAL_SUB(*next_delay, now);
@@ -946,18 +1511,47 @@ PJ_DEF(pj_size_t) pj_timer_heap_count( pj_timer_heap_t *ht )
 {
     PJ_ASSERT_RETURN(ht, 0);
 
+    if (ht->shard_cnt) {
+        pj_size_t count = 0;
+        unsigned i;
+
+        for (i = 0; i < ht->shard_cnt; ++i)
+            count += ht->shards[i]->cur_size;
+        return count;
+    }
+
     return ht->cur_size;
 }
 
 PJ_DEF(pj_status_t) pj_timer_heap_earliest_time( pj_timer_heap_t * ht,
                                                  pj_time_val *timeval)
 {
+    if (ht->shard_cnt) {
+        pj_status_t status = PJ_ENOTFOUND;
+        unsigned i;
+
+        for (i = 0; i < ht->shard_cnt; ++i) {
+            pj_timer_heap_t *shard = ht->shards[i];
+            pj_time_val t;
+
+            lock_timer_heap(shard);
+            if (shard->cur_size) {
+                get_earliest_time(shard, PJ_TRUE, &t);
+                if (status != PJ_SUCCESS || PJ_TIME_VAL_LT(t, *timeval))
+                    *timeval = t;
+                status = PJ_SUCCESS;
+            }
+            unlock_timer_heap(shard);
+        }
+        return status;
+    }
+
     pj_assert(ht->cur_size != 0);
     if (ht->cur_size == 0)
         return PJ_ENOTFOUND;
 
     lock_timer_heap(ht);
-    *timeval = ht->heap[0]->_timer_value;
+    get_earliest_time(ht, PJ_TRUE, timeval);
     unlock_timer_heap(ht);
 
     return PJ_SUCCESS;
@@ -966,6 +1560,16 @@ PJ_DEF(pj_status_t) pj_timer_heap_earliest_time( pj_timer_heap_t * ht,
 #if PJ_TIMER_DEBUG
 PJ_DEF(void) pj_timer_heap_dump(pj_timer_heap_t *ht)
 {
+    if (ht->shard_cnt) {
+        unsigned i;
+
+        for (i = 0; i < ht->shard_cnt; ++i) {
+            PJ_LOG(3,(THIS_FILE, "Shard %d of %d:", i, ht->shard_cnt));
+            pj_timer_heap_dump(ht->shards[i]);
+        }
+        return;
+    }
+
     lock_timer_heap(ht);
 
     PJ_LOG(3,(THIS_FILE, "Dumping timer heap:"));
@@ -987,9 +1591,16 @@ PJ_DEF(void) pj_timer_heap_dump(pj_timer_heap_t *ht)
         pj_gettickcount(&now);
 
 #if !PJ_TIMER_USE_LINKED_LIST
-        for (i=0; i<(unsigned)ht->cur_size; ++i)
+        for (i=0; i<(unsigned)ht->max_size; ++i)
         {
             pj_timer_entry_dup *e = ht->heap[i];
+
+            if (ht->type == PJ_TIMER_HEAP_TYPE_HEAP) {
+                if (i >= (unsigned)ht->cur_size)
+                    break;
+            } else if (!e) {
+                continue;
+            }
 #else
         for (tmp_dup = ht->head_list.next; tmp_dup != &ht->head_list;
              tmp_dup = tmp_dup->next)
@@ -282,6 +282,29 @@ PJ_DEF(pj_size_t) pj_timer_heap_mem_size(pj_size_t count)
            132;
 }
 
+/*
+ * Initialize timer heap settings with default values.
+ */
+PJ_DEF(void) pj_timer_heap_cfg_default(pj_timer_heap_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->type = PJ_TIMER_HEAP_TYPE_HEAP;
+    cfg->shard_cnt = 1;
+}
+
+/*
+ * Create a new timer heap with the specified settings. The settings are
+ * ignored since the timers are implemented with Symbian timer objects.
+ */
+PJ_DEF(pj_status_t) pj_timer_heap_create2( pj_pool_t *pool,
+                                           pj_size_t size,
+                                           const pj_timer_heap_cfg *cfg,
+                                           pj_timer_heap_t **p_heap)
+{
+    PJ_UNUSED_ARG(cfg);
+    return pj_timer_heap_create(pool, size, p_heap);
+}
+
 /*
  * Create a new timer heap.
  */
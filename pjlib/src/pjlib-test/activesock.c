@@ -247,6 +247,204 @@ on_return:
 }
 
 
+/*******************************************************************
+ * UDP batch test: send packets with pj_activesock_sendto_batch() and
+ * receive them with rx_batch_cnt setting.
+ */
+#define BATCH_PKT_CNT   64
+#define BATCH_RX_CNT    16
+
+struct udp_batch_state
+{
+    unsigned             rx_cnt;
+    unsigned             max_batch;
+    unsigned             err_cnt;
+};
+
+static pj_bool_t udp_batch_on_data_recvfrom(pj_activesock_t *asock,
+                                            void *data,
+                                            pj_size_t size,
+                                            const pj_sockaddr_t *src_addr,
+                                            int addr_len,
+                                            pj_status_t status)
+{
+    struct udp_batch_state *st;
+    pj_uint32_t seq;
+
+    PJ_UNUSED_ARG(src_addr);
+    PJ_UNUSED_ARG(addr_len);
+
+    st = (struct udp_batch_state*) pj_activesock_get_user_data(asock);
+
+    if (status != PJ_SUCCESS || size != sizeof(seq)) {
+        st->err_cnt++;
+        return PJ_TRUE;
+    }
+
+    pj_memcpy(&seq, data, sizeof(seq));
+    if (seq != st->rx_cnt) {
+        PJ_LOG(3,(THIS_FILE, "   error: expecting seq %u, got %u",
+                  st->rx_cnt, seq));
+        st->err_cnt++;
+    }
+    st->rx_cnt++;
+
+    return PJ_TRUE;
+}
+
+static pj_bool_t udp_batch_on_data_recvfrom_batch(pj_activesock_t *asock,
+                                                  pj_sock_mmsg pkts[],
+                                                  unsigned count)
+{
+    struct udp_batch_state *st;
+    unsigned i;
+
+    st = (struct udp_batch_state*) pj_activesock_get_user_data(asock);
+
+    if (count > st->max_batch)
+        st->max_batch = count;
+
+    for (i=0; i<count; ++i) {
+        udp_batch_on_data_recvfrom(asock, pkts[i].buf, pkts[i].len,
+                                   &pkts[i].addr, pkts[i].addr_len,
+                                   PJ_SUCCESS);
+    }
+
+    return PJ_TRUE;
+}
+
+static int udp_batch_test(pj_bool_t batch_cb)
+{
+    pj_ioqueue_t *ioqueue = NULL;
+    pj_pool_t *pool = NULL;
+    pj_activesock_t *rx_asock = NULL, *tx_asock = NULL;
+    pj_activesock_cfg cfg;
+    pj_activesock_cb cb;
+    pj_sockaddr addr, rx_addr;
+    pj_str_t loopback;
+    struct udp_batch_state st;
+    pj_ioqueue_op_key_t send_keys[BATCH_PKT_CNT];
+    pj_ioqueue_op_key_t *send_key[BATCH_PKT_CNT];
+    pj_sock_mmsg pkts[BATCH_PKT_CNT];
+    pj_uint32_t seq[BATCH_PKT_CNT];
+    unsigned i;
+    int ret;
+    pj_status_t status;
+
+    pj_bzero(&st, sizeof(st));
+
+    pool = pj_pool_create(mem, "udpbatch", 512, 512, NULL);
+    if (!pool)
+        return -100;
+
+    status = pj_ioqueue_create(pool, 4, &ioqueue);
+    if (status != PJ_SUCCESS) {
+        ret = -110;
+        udp_echo_err("pj_ioqueue_create()", status);
+        goto on_return;
+    }
+
+    loopback = pj_str("127.0.0.1");
+    pj_sockaddr_init(pj_AF_INET(), &addr, &loopback, 0);
+
+    pj_activesock_cfg_default(&cfg);
+    cfg.rx_batch_cnt = BATCH_RX_CNT;
+
+    pj_bzero(&cb, sizeof(cb));
+    cb.on_data_recvfrom = &udp_batch_on_data_recvfrom;
+    if (batch_cb)
+        cb.on_data_recvfrom_batch = &udp_batch_on_data_recvfrom_batch;
+
+    status = pj_activesock_create_udp(pool, &addr, &cfg, ioqueue, &cb,
+                                      &st, &rx_asock, &rx_addr);
+    if (status != PJ_SUCCESS) {
+        ret = -120;
+        udp_echo_err("pj_activesock_create_udp()", status);
+        goto on_return;
+    }
+
+    status = pj_activesock_start_recvfrom(rx_asock, pool, 32, 0);
+    if (status != PJ_SUCCESS) {
+        ret = -130;
+        udp_echo_err("pj_activesock_start_recvfrom()", status);
+        goto on_return;
+    }
+
+    pj_bzero(&cb, sizeof(cb));
+    status = pj_activesock_create_udp(pool, &addr, NULL, ioqueue, &cb,
+                                      NULL, &tx_asock, NULL);
+    if (status != PJ_SUCCESS) {
+        ret = -140;
+        udp_echo_err("pj_activesock_create_udp()", status);
+        goto on_return;
+    }
+
+    /* Send all packets before polling, so that they are queued in the
+     * receiving socket.
+     */
+    for (i=0; i<BATCH_PKT_CNT; ++i) {
+        seq[i] = i;
+        pj_ioqueue_op_key_init(&send_keys[i], sizeof(send_keys[i]));
+        send_key[i] = &send_keys[i];
+        pkts[i].buf = &seq[i];
+        pkts[i].len = sizeof(seq[i]);
+        pj_sockaddr_cp(&pkts[i].addr, &rx_addr);
+        pkts[i].addr_len = pj_sockaddr_get_len(&rx_addr);
+    }
+
+    status = pj_activesock_sendto_batch(tx_asock, send_key, pkts,
+                                        BATCH_PKT_CNT, 0);
+    if (status != PJ_SUCCESS && status != PJ_EPENDING) {
+        ret = -150;
+        udp_echo_err("pj_activesock_sendto_batch()", status);
+        goto on_return;
+    }
+
+    for (i=0; i<500 && st.rx_cnt < BATCH_PKT_CNT; ++i) {
+        pj_time_val delay = {0, 10};
+#ifdef PJ_SYMBIAN
+        PJ_UNUSED_ARG(delay);
+        pj_symbianos_poll(-1, 100);
+#else
+        pj_ioqueue_poll(ioqueue, &delay);
+#endif
+    }
+
+    if (st.err_cnt) {
+        ret = -160;
+        goto on_return;
+    }
+
+    if (st.rx_cnt != BATCH_PKT_CNT) {
+        PJ_LOG(3,(THIS_FILE, "   error: only %u of %u packets received",
+                  st.rx_cnt, BATCH_PKT_CNT));
+        ret = -170;
+        goto on_return;
+    }
+
+    /* The io_uring ioqueue receives the packets itself, without batch */
+    if (batch_cb && st.max_batch < 2 && !PJ_IOQUEUE_URING_HAS_RX) {
+        PJ_LOG(3,(THIS_FILE, "   error: packets were not received in batch"));
+        ret = -180;
+        goto on_return;
+    }
+
+    ret = 0;
+
+on_return:
+    if (tx_asock)
+        pj_activesock_close(tx_asock);
+    if (rx_asock)
+        pj_activesock_close(rx_asock);
+    if (ioqueue)
+        pj_ioqueue_destroy(ioqueue);
+    if (pool)
+        pj_pool_release(pool);
+
+    return ret;
+}
+
+
 
 #define SIGNATURE   0xdeadbeef
 struct tcp_pkt
@@ -500,6 +698,16 @@ int activesock_test(void)
     if (ret != 0)
         return ret;
 
+    PJ_LOG(3,("", "..udp batch test"));
+    ret = udp_batch_test(PJ_TRUE);
+    if (ret != 0)
+        return ret;
+
+    PJ_LOG(3,("", "..udp batch test (per packet callback)"));
+    ret = udp_batch_test(PJ_FALSE);
+    if (ret != 0)
+        return ret;
+
     PJ_LOG(3,("", "..tcp perf test"));
     ret = tcp_perf_test();
     if (ret != 0)
@@ -19,11 +19,14 @@
 #include <pj/hash.h>
 #include <pj/rand.h>
 #include <pj/log.h>
+#include <pj/os.h>
 #include <pj/pool.h>
+#include <pj/string.h>
 #include "test.h"
 
 #if INCLUDE_HASH_TEST
 
+#define THIS_FILE   "hash_test.c"
 #define HASH_COUNT  31
 
 static int hash_test_with_key(pj_pool_t *pool, unsigned char key)
@@ -129,6 +132,277 @@ static int hash_collision_test(pj_pool_t *pool)
 }
 
 
+/*
+ * Resizable hash table test: grow the table well beyond its initial size
+ * while deleting some of the entries, then check every entry.
+ */
+static int rhash_grow_test(pj_pool_t *pool, unsigned concurrency)
+{
+    enum { COUNT = 5000 };
+    pj_rhash_table_t *ht;
+    pj_rhash_iterator_t it_buf, *it;
+    unsigned *values;
+    unsigned i, cnt;
+    pj_status_t status;
+    int rc = 0;
+
+    status = pj_rhash_create(pool, HASH_COUNT, concurrency, &ht);
+    if (status != PJ_SUCCESS)
+        return -300;
+
+    values = (unsigned*) pj_pool_alloc(pool, COUNT * sizeof(unsigned));
+
+    for (i=0; i<COUNT; ++i) {
+        values[i] = i;
+        status = pj_rhash_set(pool, ht, &i, sizeof(i), 0, &values[i]);
+        if (status != PJ_SUCCESS) {
+            rc = -310;
+            goto on_return;
+        }
+
+        /* Delete every third entry some time after it was added. */
+        if (i >= 100 && (i-100) % 3 == 0) {
+            unsigned key = i - 100;
+            pj_rhash_set(NULL, ht, &key, sizeof(key), 0, NULL);
+        }
+    }
+
+    cnt = 0;
+    for (i=0; i<COUNT; ++i) {
+        unsigned *entry = (unsigned*) pj_rhash_get(ht, &i, sizeof(i), NULL);
+        pj_bool_t deleted = (i+100 < COUNT && i % 3 == 0);
+
+        if (deleted && entry) {
+            rc = -320;
+            goto on_return;
+        }
+        if (!deleted) {
+            if (!entry || *entry != i) {
+                rc = -330;
+                goto on_return;
+            }
+            ++cnt;
+        }
+    }
+
+    if (pj_rhash_count(ht) != cnt) {
+        rc = -340;
+        goto on_return;
+    }
+
+    /* Iterate while deleting the entries. */
+    i = 0;
+    it = pj_rhash_first(ht, &it_buf);
+    while (it) {
+        unsigned *entry = (unsigned*) pj_rhash_this(ht, it);
+        pj_rhash_set(NULL, ht, entry, sizeof(*entry), 0, NULL);
+        ++i;
+        it = pj_rhash_next(ht, it);
+    }
+
+    if (i != cnt || pj_rhash_count(ht) != 0)
+        rc = -350;
+
+on_return:
+    pj_rhash_destroy(ht);
+    return rc;
+}
+
+static int rhash_lower_test(pj_pool_t *pool)
+{
+    pj_rhash_table_t *ht;
+    pj_str_t key1 = pj_str("Call-ID"), key2 = pj_str("CALL-id");
+    unsigned value = 1;
+    pj_status_t status;
+    int rc = 0;
+
+    status = pj_rhash_create(pool, 0, 0, &ht);
+    if (status != PJ_SUCCESS)
+        return -400;
+
+    pj_rhash_set_lower(pool, ht, key1.ptr, (unsigned)key1.slen, 0, &value);
+    if (pj_rhash_get_lower(ht, key2.ptr, (unsigned)key2.slen, NULL) != &value)
+        rc = -410;
+    else if (pj_rhash_get(ht, key2.ptr, (unsigned)key2.slen, NULL) != NULL)
+        rc = -420;
+
+    pj_rhash_destroy(ht);
+    return rc;
+}
+
+#if PJ_HAS_THREADS
+enum { RHASH_THREAD_CNT = 4, RHASH_THREAD_KEYS = 20000 };
+
+static pj_rhash_table_t *rhash_mt;
+static pj_ssize_t rhash_mt_keys[RHASH_THREAD_CNT * RHASH_THREAD_KEYS];
+static pj_bool_t rhash_mt_err;
+
+static int rhash_mt_thread(void *arg)
+{
+    pj_ssize_t *keys = &rhash_mt_keys[(pj_ssize_t)arg * RHASH_THREAD_KEYS];
+    unsigned i;
+
+    /* The table refers to the keys, and the keys are also the values. */
+    for (i = 0; i < RHASH_THREAD_KEYS; ++i) {
+        keys[i] = (pj_ssize_t)arg * RHASH_THREAD_KEYS + i + 1;
+        if (pj_rhash_set(NULL, rhash_mt, &keys[i], sizeof(keys[i]), 0,
+                         (void*)keys[i]) != PJ_SUCCESS)
+        {
+            rhash_mt_err = PJ_TRUE;
+        }
+    }
+
+    for (i = 0; i < RHASH_THREAD_KEYS; ++i) {
+        if (pj_rhash_get(rhash_mt, &keys[i], sizeof(keys[i]),
+                         NULL) != (void*)keys[i])
+        {
+            rhash_mt_err = PJ_TRUE;
+        }
+        if (i % 2)
+            pj_rhash_set(NULL, rhash_mt, &keys[i], sizeof(keys[i]), 0, NULL);
+    }
+
+    return 0;
+}
+
+static int rhash_concurrent_test(pj_pool_t *pool)
+{
+    pj_thread_t *threads[RHASH_THREAD_CNT];
+    pj_ssize_t i;
+    pj_status_t status;
+    int rc = 0;
+
+    status = pj_rhash_create(pool, 64, 8, &rhash_mt);
+    if (status != PJ_SUCCESS)
+        return -500;
+
+    rhash_mt_err = PJ_FALSE;
+    for (i = 0; i < RHASH_THREAD_CNT; ++i) {
+        status = pj_thread_create(pool, "rhash", &rhash_mt_thread,
+                                  (void*)i, 0, 0, &threads[i]);
+        if (status != PJ_SUCCESS) {
+            threads[i] = NULL;
+            rc = -510;
+        }
+    }
+
+    for (i = 0; i < RHASH_THREAD_CNT; ++i) {
+        if (threads[i]) {
+            pj_thread_join(threads[i]);
+            pj_thread_destroy(threads[i]);
+        }
+    }
+
+    if (rc == 0 && rhash_mt_err)
+        rc = -520;
+    if (rc == 0 &&
+        pj_rhash_count(rhash_mt) != RHASH_THREAD_CNT * RHASH_THREAD_KEYS / 2)
+    {
+        rc = -530;
+    }
+
+    pj_rhash_destroy(rhash_mt);
+    return rc;
+}
+#endif  /* PJ_HAS_THREADS */
+
+#if WITH_BENCHMARK
+/*
+ * Compare insert and lookup throughput of the chained hash table, with a
+ * typical fixed size and with a size matching the number of entries, and
+ * of the resizable hash table.
+ */
+enum { BENCH_COUNT = 100000, BENCH_KEY_LEN = 24 };
+
+static unsigned bench_rate(const pj_timestamp *t1, const pj_timestamp *t2)
+{
+    pj_uint32_t usec = pj_elapsed_usec(t1, t2);
+    return usec ? (unsigned)((pj_uint64_t)BENCH_COUNT * 1000000 / usec) : 0;
+}
+
+static int hash_bench(void)
+{
+    pj_pool_t *pool;
+    char *keys;
+    unsigned i, sizes[2] = { 1023, BENCH_COUNT };
+    pj_timestamp t1, t2;
+    int rc = 0;
+
+    pool = pj_pool_create(mem, "hashbench", 1024*1024, 1024*1024, NULL);
+    if (!pool)
+        return -600;
+
+    keys = (char*) pj_pool_alloc(pool, BENCH_COUNT * BENCH_KEY_LEN);
+    for (i = 0; i < BENCH_COUNT; ++i) {
+        pj_ansi_snprintf(keys + i*BENCH_KEY_LEN, BENCH_KEY_LEN,
+                         "z9hG4bK%08x%08x", pj_rand(), i);
+    }
+
+    PJ_LOG(3,(THIS_FILE, "  hash table benchmark, %d keys:", BENCH_COUNT));
+
+    for (i = 0; i < PJ_ARRAY_SIZE(sizes); ++i) {
+        pj_hash_table_t *ht = pj_hash_create(pool, sizes[i]);
+        unsigned j, ins, get;
+
+        pj_get_timestamp(&t1);
+        for (j = 0; j < BENCH_COUNT; ++j) {
+            const char *key = keys + j*BENCH_KEY_LEN;
+            pj_hash_set(pool, ht, key, PJ_HASH_KEY_STRING, 0, (void*)key);
+        }
+        pj_get_timestamp(&t2);
+        ins = bench_rate(&t1, &t2);
+
+        pj_get_timestamp(&t1);
+        for (j = 0; j < BENCH_COUNT; ++j) {
+            const char *key = keys + j*BENCH_KEY_LEN;
+            if (pj_hash_get(ht, key, PJ_HASH_KEY_STRING, NULL) != key)
+                rc = -610;
+        }
+        pj_get_timestamp(&t2);
+        get = bench_rate(&t1, &t2);
+
+        PJ_LOG(3,(THIS_FILE, "   chained, %6d rows   : %9u ins/s %9u get/s",
+                  sizes[i], ins, get));
+    }
+
+    for (i = 0; i < 2; ++i) {
+        pj_rhash_table_t *ht;
+        unsigned j, ins, get;
+
+        if (pj_rhash_create(pool, 1023, i ? 16 : 0, &ht) != PJ_SUCCESS) {
+            rc = -620;
+            break;
+        }
+
+        pj_get_timestamp(&t1);
+        for (j = 0; j < BENCH_COUNT; ++j) {
+            const char *key = keys + j*BENCH_KEY_LEN;
+            pj_rhash_set(NULL, ht, key, PJ_HASH_KEY_STRING, 0, (void*)key);
+        }
+        pj_get_timestamp(&t2);
+        ins = bench_rate(&t1, &t2);
+
+        pj_get_timestamp(&t1);
+        for (j = 0; j < BENCH_COUNT; ++j) {
+            const char *key = keys + j*BENCH_KEY_LEN;
+            if (pj_rhash_get(ht, key, PJ_HASH_KEY_STRING, NULL) != key)
+                rc = -630;
+        }
+        pj_get_timestamp(&t2);
+        get = bench_rate(&t1, &t2);
+
+        pj_rhash_destroy(ht);
+
+        PJ_LOG(3,(THIS_FILE, "   resizable, %-12s: %9u ins/s %9u get/s",
+                  (i ? "16 stripes" : "unlocked"), ins, get));
+    }
+
+    pj_pool_release(pool);
+    return rc;
+}
+#endif  /* WITH_BENCHMARK */
+
+
 /*
  * Hash table test.
  */
@@ -154,7 +428,29 @@ int hash_test(void)
         return rc;
     }
 
+    /* Resizable hash table tests */
+    rc = rhash_grow_test(pool, 0);
+    if (rc == 0)
+        rc = rhash_grow_test(pool, 4);
+    if (rc == 0)
+        rc = rhash_lower_test(pool);
+#if PJ_HAS_THREADS
+    if (rc == 0)
+        rc = rhash_concurrent_test(pool);
+#endif
+    if (rc != 0) {
+        pj_pool_release(pool);
+        return rc;
+    }
+
     pj_pool_release(pool);
+
+#if WITH_BENCHMARK
+    rc = hash_bench();
+    if (rc != 0)
+        return rc;
+#endif
+
     return 0;
 }
 
@@ -460,6 +460,21 @@ static int perform_test(const pj_ioqueue_cfg *cfg,
         pj_thread_destroy(thread[i]);
     }
 
+    /* Get dispatch statistics, when the backend supports it. */
+    if (display_report) {
+        pj_ioqueue_stat stat;
+
+        if (pj_ioqueue_get_stat(ioqueue, &stat) == PJ_SUCCESS &&
+            stat.wakeup_cnt)
+        {
+            PJ_LOG(3,(THIS_FILE, "  Dispatch : %lu wakeups, %.2f events/wakeup"
+                      " (max %u), %u poller(s)",
+                      (unsigned long)stat.wakeup_cnt,
+                      (double)stat.event_cnt / stat.wakeup_cnt,
+                      stat.max_event_cnt, stat.poller_cnt));
+        }
+    }
+
     /* Destroy ioqueue. */
     TRACE_((THIS_FILE, "     destroying ioqueue.."));
     pj_ioqueue_destroy(ioqueue);
@@ -594,6 +609,7 @@ int ioqueue_perf_test(void)
         PJ_IOQUEUE_EPOLL_EXCLUSIVE,
         PJ_IOQUEUE_EPOLL_ONESHOT,
         0,
+        PJ_IOQUEUE_EPOLL_EXCLUSIVE | PJ_IOQUEUE_EPOLL_BATCH,
 #else
         PJ_IOQUEUE_EPOLL_AUTO,
 #endif
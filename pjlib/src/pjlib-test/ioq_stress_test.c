@@ -1029,6 +1029,40 @@ static test_desc tests[128] = {
         .cfg.n_clients = 2,
         .cfg.repeat = 4
     },
+    /* Batch dispatch (udp).
+     */
+    {
+        .cfg.title = "udp (multithreads, EPOLLEXCLUSIVE, batch)",
+        .cfg.max_fd = 4,
+        .cfg.allow_concur = 1,
+        .cfg.epoll_flags = PJ_IOQUEUE_EPOLL_EXCLUSIVE |
+                           PJ_IOQUEUE_EPOLL_BATCH,
+        .cfg.sock_type = SOCK_DGRAM,
+        .cfg.n_threads = MAX_THREADS,
+        .cfg.rx_so_buf_size = MAX_THREADS,
+        .cfg.pkt_len = 4,
+        .cfg.tx_cnt = 4*8*512,
+        .cfg.rx_cnt = 4*8*512,
+        .cfg.n_servers = MAX_ASYNC,
+        .cfg.n_clients = MAX_ASYNC,
+        .cfg.repeat = 4
+    },
+    {
+        .cfg.title = "udp (multithreads, EPOLLONESHOT, batch)",
+        .cfg.max_fd = 4,
+        .cfg.allow_concur = 1,
+        .cfg.epoll_flags = PJ_IOQUEUE_EPOLL_ONESHOT |
+                           PJ_IOQUEUE_EPOLL_BATCH,
+        .cfg.sock_type = SOCK_DGRAM,
+        .cfg.n_threads = 2,
+        .cfg.rx_so_buf_size = 2,
+        .cfg.pkt_len = 4,
+        .cfg.tx_cnt = 4*8*512,
+        .cfg.rx_cnt = 4*8*512,
+        .cfg.n_servers = 2,
+        .cfg.n_clients = 2,
+        .cfg.repeat = 4
+    },
     #endif
     /* quite involved test (tcp). Multithreads, parallel send/recv operations,
      * limitation in recv buffer. max_fd is small/limited to test management of
@@ -1099,6 +1133,23 @@ static test_desc tests[128] = {
         .cfg.n_clients = MAX_ASYNC,
         .cfg.repeat = 4
     },
+    {
+        .cfg.title = "tcp (multithreads, EPOLLEXCLUSIVE, batch)",
+        .cfg.max_fd = 6,
+        .cfg.epoll_flags = PJ_IOQUEUE_EPOLL_EXCLUSIVE |
+                           PJ_IOQUEUE_EPOLL_BATCH,
+        .cfg.allow_concur = 1,
+        .cfg.sock_type = SOCK_STREAM,
+        .cfg.n_threads = MAX_THREADS,
+        .cfg.rx_so_buf_size = 2,        /* Set to small to control flow of tcp */
+        .cfg.tx_so_buf_size = MAX_ASYNC,
+        .cfg.pkt_len = 4,
+        .cfg.tx_cnt = 4*MAX_THREADS*512,
+        .cfg.rx_cnt = 4*MAX_THREADS*512,
+        .cfg.n_servers = MAX_ASYNC,
+        .cfg.n_clients = MAX_ASYNC,
+        .cfg.repeat = 4
+    },
     #endif
     /* when concurrency is disabled, TCP packets should be received in correct
      * order
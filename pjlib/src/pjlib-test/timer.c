@@ -43,6 +43,20 @@
 #define DELAY           (D < MIN_DELAY ? MIN_DELAY : D)
 #define THIS_FILE       "timer_test"
 
+static const char *type_names[] = { "heap", "wheel" };
+
+static pj_status_t create_timer_heap(pj_pool_t *pool, pj_size_t count,
+                                     pj_timer_heap_type type,
+                                     unsigned shard_cnt,
+                                     pj_timer_heap_t **p_timer)
+{
+    pj_timer_heap_cfg cfg;
+
+    pj_timer_heap_cfg_default(&cfg);
+    cfg.type = type;
+    cfg.shard_cnt = shard_cnt;
+    return pj_timer_heap_create2(pool, count, &cfg, p_timer);
+}
 
 static void timer_callback(pj_timer_heap_t *ht, pj_timer_entry *e)
 {
@@ -50,7 +64,7 @@ static void timer_callback(pj_timer_heap_t *ht, pj_timer_entry *e)
     PJ_UNUSED_ARG(e);
 }
 
-static int test_timer_heap(void)
+static int test_timer_heap(pj_timer_heap_type type, unsigned shard_cnt)
 {
     int i, j;
     pj_timer_entry *entry;
@@ -62,7 +76,8 @@ static int test_timer_heap(void)
     pj_size_t size;
     unsigned count;
 
-    PJ_LOG(3,("test", "...Basic test"));
+    PJ_LOG(3,("test", "...Basic test (%s, %d shard(s))", type_names[type],
+              shard_cnt));
 
     size = pj_timer_heap_mem_size(MAX_COUNT)+MAX_COUNT*sizeof(pj_timer_entry);
     pool = pj_pool_create( mem, NULL, size, 4000, NULL);
@@ -79,7 +94,7 @@ static int test_timer_heap(void)
     for (i=0; i<MAX_COUNT; ++i) {
         entry[i].cb = &timer_callback;
     }
-    status = pj_timer_heap_create(pool, MAX_COUNT, &timer);
+    status = create_timer_heap(pool, MAX_COUNT, type, shard_cnt, &timer);
     if (status != PJ_SUCCESS) {
         app_perror("...error: unable to create timer heap", status);
         return -30;
@@ -179,11 +194,234 @@ static int test_timer_heap(void)
             break;
     }
 
+    pj_timer_heap_destroy(timer);
     pj_pool_release(pool);
     return err;
 }
 
 
+/*
+ * Each shard must get a turn on every poll, even when the shard of the
+ * polling thread keeps having expired entries.
+ */
+#define SP_ENTRY_COUNT  32
+
+static int shard_poll_test(unsigned shard_cnt)
+{
+    pj_pool_t *pool;
+    pj_timer_heap_t *timer;
+    pj_timer_entry *entry;
+    pj_time_val delay = { 0, 0 };
+    pj_bool_t used[64];
+    unsigned i, used_cnt = 0, count;
+    int rc = 0;
+
+    PJ_LOG(3,("test", "...Shard poll test (%d shards)", shard_cnt));
+
+    PJ_ASSERT_RETURN(shard_cnt <= PJ_ARRAY_SIZE(used), -200);
+    pj_bzero(used, sizeof(used));
+
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+    if (!pool)
+        return -210;
+
+    entry = (pj_timer_entry*)pj_pool_calloc(pool, SP_ENTRY_COUNT,
+                                            sizeof(*entry));
+    if (create_timer_heap(pool, SP_ENTRY_COUNT, PJ_TIMER_HEAP_TYPE_HEAP,
+                          shard_cnt, &timer) != PJ_SUCCESS)
+    {
+        pj_pool_release(pool);
+        return -220;
+    }
+
+    pj_timer_heap_set_max_timed_out_per_poll(timer, 1);
+
+    for (i = 0; i < SP_ENTRY_COUNT; ++i) {
+        entry[i].cb = &timer_callback;
+        if (pj_timer_heap_schedule(timer, &entry[i], &delay) != PJ_SUCCESS) {
+            rc = -230;
+            goto on_return;
+        }
+        if (!used[entry[i]._shard]) {
+            used[entry[i]._shard] = PJ_TRUE;
+            ++used_cnt;
+        }
+    }
+
+    /* Every shard with entries expires one of them */
+    count = pj_timer_heap_poll(timer, NULL);
+    if (count != used_cnt) {
+        PJ_LOG(3,("test", "...error: %d entries polled from %d shards",
+                  count, used_cnt));
+        rc = -240;
+        goto on_return;
+    }
+
+on_return:
+    pj_timer_heap_destroy(timer);
+    pj_pool_release(pool);
+    return rc;
+}
+
+
+/*****************
+ * Accuracy test *
+ *****************
+ * Schedule entries with delays spanning several levels of the timing
+ * wheel, cancel some of them, and poll by sleeping for the delay returned
+ * by the poll. Every entry must expire in order, not before its time and
+ * not too late.
+ */
+#define AT_ENTRY_COUNT      1000
+#define AT_MAX_DELAY_MS     4500
+#define AT_MAX_LATENESS_MS  100
+
+struct at_entry
+{
+    pj_timer_entry  entry;
+    pj_time_val     expire;
+    pj_bool_t       cancelled;
+    pj_bool_t       fired;
+    int             late_ms;
+};
+
+static pj_time_val at_last_expire;
+static int at_err;
+
+static void at_callback(pj_timer_heap_t *ht, pj_timer_entry *e)
+{
+    struct at_entry *ae = (struct at_entry*)e->user_data;
+    pj_time_val now, late;
+
+    PJ_UNUSED_ARG(ht);
+
+    pj_gettickcount(&now);
+
+    if (ae->fired || ae->cancelled) {
+        PJ_LOG(3,("test", "...error: entry fired twice or after cancel"));
+        at_err = -10;
+    } else if (PJ_TIME_VAL_LT(now, ae->expire)) {
+        PJ_LOG(3,("test", "...error: entry fired too early"));
+        at_err = -20;
+    } else if (PJ_TIME_VAL_LT(ae->expire, at_last_expire)) {
+        PJ_LOG(3,("test", "...error: entry fired out of order"));
+        at_err = -30;
+    }
+
+    late = now;
+    PJ_TIME_VAL_SUB(late, ae->expire);
+    ae->late_ms = (int)PJ_TIME_VAL_MSEC(late);
+    ae->fired = PJ_TRUE;
+    at_last_expire = ae->expire;
+}
+
+static int timer_accuracy_test(pj_timer_heap_type type)
+{
+    pj_pool_t *pool;
+    pj_timer_heap_t *timer;
+    struct at_entry *entries;
+    pj_time_val now;
+    pj_status_t status;
+    int i, max_late = 0;
+    unsigned cancelled = 0;
+
+    PJ_LOG(3,("test", "...Accuracy test (%s)", type_names[type]));
+
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+    if (!pool)
+        return -100;
+
+    entries = (struct at_entry*)pj_pool_calloc(pool, AT_ENTRY_COUNT,
+                                               sizeof(*entries));
+
+    /* Start small to exercise the heap growth */
+    status = create_timer_heap(pool, 16, type, 1, &timer);
+    if (status != PJ_SUCCESS) {
+        app_perror("...error: unable to create timer heap", status);
+        pj_pool_release(pool);
+        return -110;
+    }
+
+    pj_gettickcount(&now);
+    pj_srand(now.sec);
+    at_err = 0;
+    at_last_expire.sec = at_last_expire.msec = 0;
+
+    for (i = 0; i < AT_ENTRY_COUNT; ++i) {
+        struct at_entry *ae = &entries[i];
+        pj_time_val delay;
+
+        delay.sec = 0;
+        delay.msec = pj_rand() % AT_MAX_DELAY_MS;
+        pj_time_val_normalize(&delay);
+
+        pj_timer_entry_init(&ae->entry, 0, ae, &at_callback);
+        pj_gettickcount(&ae->expire);
+        PJ_TIME_VAL_ADD(ae->expire, delay);
+
+        status = pj_timer_heap_schedule(timer, &ae->entry, &delay);
+        if (status != PJ_SUCCESS) {
+            pj_pool_release(pool);
+            return -120;
+        }
+    }
+
+    /* Cancel some of them */
+    for (i = 0; i < AT_ENTRY_COUNT; i += 7) {
+        if (pj_timer_heap_cancel(timer, &entries[i].entry) == 1) {
+            entries[i].cancelled = PJ_TRUE;
+            ++cancelled;
+        }
+    }
+
+    if (pj_timer_heap_count(timer) != AT_ENTRY_COUNT - cancelled) {
+        PJ_LOG(3,("test", "...error: wrong timer count"));
+        pj_pool_release(pool);
+        return -130;
+    }
+
+    while (pj_timer_heap_count(timer) && at_err == 0) {
+        pj_time_val next_delay;
+
+        pj_timer_heap_poll(timer, &next_delay);
+        if (pj_timer_heap_count(timer) == 0)
+            break;
+
+        if (next_delay.sec > 0 || next_delay.msec > 500) {
+            next_delay.sec = 0;
+            next_delay.msec = 500;
+        }
+        pj_thread_sleep(PJ_TIME_VAL_MSEC(next_delay));
+    }
+
+    if (at_err) {
+        pj_pool_release(pool);
+        return at_err - 100;
+    }
+
+    for (i = 0; i < AT_ENTRY_COUNT; ++i) {
+        if (!entries[i].cancelled && !entries[i].fired) {
+            PJ_LOG(3,("test", "...error: entry did not fire"));
+            pj_pool_release(pool);
+            return -140;
+        }
+        if (entries[i].late_ms > max_late)
+            max_late = entries[i].late_ms;
+    }
+
+    PJ_LOG(3,("test", "....ok, max lateness %d msec", max_late));
+
+    pj_pool_release(pool);
+
+    if (max_late > AT_MAX_LATENESS_MS) {
+        PJ_LOG(3,("test", "...error: entries fired too late"));
+        return -150;
+    }
+
+    return 0;
+}
+
+
 /***************
  * Stress test *
  ***************
@@ -229,6 +467,9 @@ static int test_timer_heap(void)
  */
 #define ST_ENTRY_GROUP_LOCK_COUNT   1
 
+/* Number of shards when testing sharded timer heap. */
+#define ST_SHARD_COUNT              4
+
 #define BT_ENTRY_COUNT 100000
 #define BT_ENTRY_SHOW_START 100
 #define BT_ENTRY_SHOW_MULT 10
@@ -469,7 +710,7 @@ static int cancel_worker(void *arg)
 }
 #endif
 
-static int timer_stress_test(void)
+static int timer_stress_test(pj_timer_heap_type type, unsigned shard_cnt)
 {
     unsigned count = 0, n_sched = 0, n_cancel = 0, n_poll = 0;
     int i;
@@ -492,7 +733,8 @@ static int timer_stress_test(void)
     pj_time_val delay = {0};
 #endif
 
-    PJ_LOG(3,("test", "...Stress test"));
+    PJ_LOG(3,("test", "...Stress test (%s, %d shard(s))", type_names[type],
+              shard_cnt));
 
     pj_gettimeofday(&now);
     pj_srand(now.sec);
@@ -508,7 +750,8 @@ static int timer_stress_test(void)
      * Initially we only create a fraction of what's required,
      * to test the timer heap growth algorithm.
      */
-    status = pj_timer_heap_create(pool, ST_ENTRY_COUNT/64, &timer);
+    status = create_timer_heap(pool, ST_ENTRY_COUNT/64, type, shard_cnt,
+                               &timer);
     if (status != PJ_SUCCESS) {
         app_perror("...error: unable to create timer heap", status);
         err = -20;
@@ -881,7 +1124,7 @@ static int bench_test(pj_timer_heap_t *timer,
     return 0;
 }
 
-static int timer_bench_test(void)
+static int timer_bench_test(pj_timer_heap_type type)
 {
     pj_pool_t *pool = NULL;
     pj_timer_heap_t *timer = NULL;
@@ -891,7 +1134,7 @@ static int timer_bench_test(void)
     pj_timestamp freq;
     int i;
 
-    PJ_LOG(3,("test", "...Benchmark test"));
+    PJ_LOG(3,("test", "...Benchmark test (%s)", type_names[type]));
 
     status = pj_get_timestamp_freq(&freq);
     if (status != PJ_SUCCESS) {
@@ -908,7 +1151,7 @@ static int timer_bench_test(void)
     }
 
     /* Create timer heap.*/
-    status = pj_timer_heap_create(pool, BT_ENTRY_COUNT/64, &timer);
+    status = create_timer_heap(pool, BT_ENTRY_COUNT/64, type, 1, &timer);
     if (status != PJ_SUCCESS) {
         app_perror("...error: unable to create timer heap", status);
         err = -30;
@@ -955,20 +1198,44 @@ static int timer_bench_test(void)
 
 int timer_test()
 {
+    const pj_timer_heap_type types[] = { PJ_TIMER_HEAP_TYPE_HEAP,
+                                         PJ_TIMER_HEAP_TYPE_WHEEL };
+    unsigned i;
     int rc;
 
-    rc = test_timer_heap();
+    for (i = 0; i < PJ_ARRAY_SIZE(types); ++i) {
+        rc = test_timer_heap(types[i], 1);
+        if (rc != 0)
+            return rc;
+
+        rc = timer_accuracy_test(types[i]);
+        if (rc != 0)
+            return rc;
+
+        rc = timer_stress_test(types[i], 1);
+        if (rc != 0)
+            return rc;
+    }
+
+    /* Sharded timer heap */
+    rc = test_timer_heap(PJ_TIMER_HEAP_TYPE_HEAP, ST_SHARD_COUNT);
     if (rc != 0)
         return rc;
 
-    rc = timer_stress_test();
+    rc = shard_poll_test(ST_SHARD_COUNT);
     if (rc != 0)
         return rc;
 
-#if WITH_BENCHMARK
-    rc = timer_bench_test();
+    rc = timer_stress_test(PJ_TIMER_HEAP_TYPE_HEAP, ST_SHARD_COUNT);
     if (rc != 0)
         return rc;
+
+#if WITH_BENCHMARK
+    for (i = 0; i < PJ_ARRAY_SIZE(types); ++i) {
+        rc = timer_bench_test(types[i]);
+        if (rc != 0)
+            return rc;
+    }
 #else
     /* Avoid unused warning */
     PJ_UNUSED_ARG(timer_bench_test);
@@ -176,7 +176,22 @@ enum pjmedia_clock_options
     /**
      * Prevent the clock from setting it's thread to highest priority.
      */
-    PJMEDIA_CLOCK_NO_HIGHEST_PRIO = 2
+    PJMEDIA_CLOCK_NO_HIGHEST_PRIO = 2,
+
+    /**
+     * Run the clock on the shared clock scheduler, which serves many
+     * clocks with a small, fixed number of timing threads (see
+     * #PJMEDIA_CLOCK_SCHED_THREAD_CNT), instead of starting a thread for
+     * the clock. The callbacks of clocks served by the same timing thread
+     * are called one after another, so they should not block.
+     */
+    PJMEDIA_CLOCK_SHARED = 4,
+
+    /**
+     * Always run the clock on its own thread, even when
+     * #PJMEDIA_CLOCK_SHARED_SCHED is enabled.
+     */
+    PJMEDIA_CLOCK_OWN_THREAD = 8
 };
 
 
@@ -193,6 +208,20 @@ typedef struct pjmedia_clock_param
     unsigned clock_rate;
 } pjmedia_clock_param;
 
+/**
+ * Statistics of the shared clock scheduler.
+ */
+typedef struct pjmedia_clock_sched_stat
+{
+    unsigned    thread_cnt;     /**< Number of timing threads.              */
+    unsigned    clock_cnt;      /**< Number of clocks being served.         */
+    pj_uint64_t tick_cnt;       /**< Number of ticks run.                   */
+    pj_uint64_t overrun_cnt;    /**< Number of ticks that ran one interval
+                                     or more after their deadline.          */
+    unsigned    avg_late_usec;  /**< Average lateness of the ticks, in usec.*/
+    unsigned    max_late_usec;  /**< Maximum lateness of a tick, in usec.   */
+} pjmedia_clock_sched_stat;
+
 /**
  * Type of media clock callback.
  *
@@ -326,6 +355,23 @@ PJ_DECL(pj_bool_t) pjmedia_clock_wait(pjmedia_clock *clock,
 PJ_DECL(pj_status_t) pjmedia_clock_destroy(pjmedia_clock *clock);
 
 
+/**
+ * Get the statistics of the shared clock scheduler. The scheduler runs
+ * as long as there is a clock created with PJMEDIA_CLOCK_SHARED option
+ * (or with #PJMEDIA_CLOCK_SHARED_SCHED enabled), otherwise all values
+ * will be zero. When the last clock is destroyed from a clock callback,
+ * the scheduler is kept until the next clock or #pj_shutdown(), and
+ * only its clock count is zero.
+ *
+ * @param stat              The statistics.
+ * @param reset             Reset the tick statistics after retrieving.
+ *
+ * @return                  PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_clock_sched_get_stat(pjmedia_clock_sched_stat *stat,
+                                                  pj_bool_t reset);
+
+
 
 PJ_END_DECL
 
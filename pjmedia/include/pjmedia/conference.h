@@ -171,6 +171,103 @@ PJ_DECL(pj_status_t) pjmedia_conf_create( pj_pool_t *pool,
                                           pjmedia_conf **p_conf );
 
 
+/**
+ * Conference bridge settings, to be specified in #pjmedia_conf_create2().
+ * Application should initialize this structure with
+ * #pjmedia_conf_param_default() before setting the fields.
+ */
+typedef struct pjmedia_conf_param
+{
+    /**
+     * Maximum number of slots/ports to be created in the bridge, see
+     * \a max_slots in #pjmedia_conf_create().
+     */
+    unsigned            max_slots;
+
+    /**
+     * Sampling rate of the bridge.
+     */
+    unsigned            sampling_rate;
+
+    /**
+     * Number of channels in the PCM stream.
+     */
+    unsigned            channel_count;
+
+    /**
+     * Number of samples per frame.
+     */
+    unsigned            samples_per_frame;
+
+    /**
+     * Number of bits per sample. Currently only 16 is supported.
+     */
+    unsigned            bits_per_sample;
+
+    /**
+     * Bitmask options, constructed from #pjmedia_conf_option.
+     *
+     * Default: 0
+     */
+    unsigned            options;
+
+    /**
+     * Total number of threads used to process the ports on each clock
+     * tick, including the clock thread itself. When this is greater
+     * than one, the bridge creates (worker_threads - 1) worker threads
+     * and splits the read, mix and write phases between them. The phases
+     * are joined on every tick, and the mixed output is bit-identical to
+     * the single threaded mode.
+     *
+     * Note that in this mode the get_frame() and put_frame() of the
+     * ports may be called from the worker threads, without the bridge
+     * mutex being held by the calling thread. Ports MUST NOT call the
+     * bridge API from within these callbacks.
+     *
+     * Default: PJMEDIA_CONF_THREADS
+     */
+    unsigned            worker_threads;
+
+    /**
+     * Maximum number of talkers to be mixed on each frame, or zero to mix
+     * all ports. When this is non-zero, only the frames of the loudest
+     * active ports are mixed, and each listener receives the sum of these
+     * talkers minus its own signal. The value must not exceed 32. See
+     * PJMEDIA_CONF_ACTIVE_SPEAKERS for how the output compares to mixing
+     * all ports.
+     *
+     * Default: PJMEDIA_CONF_ACTIVE_SPEAKERS
+     */
+    unsigned            active_speakers;
+
+} pjmedia_conf_param;
+
+
+/**
+ * Initialize conference bridge settings with default values.
+ *
+ * @param param             The settings to be initialized.
+ */
+PJ_DECL(void) pjmedia_conf_param_default(pjmedia_conf_param *param);
+
+
+/**
+ * Create conference bridge with the specified settings. This function
+ * is similar to #pjmedia_conf_create(), but additionally allows
+ * application to specify the number of threads used by the bridge.
+ *
+ * @param pool              Pool to use to allocate the bridge and
+ *                          additional buffers for the sound device.
+ * @param param             The conference bridge settings.
+ * @param p_conf            Pointer to receive the conference bridge instance.
+ *
+ * @return                  PJ_SUCCESS if conference bridge can be created.
+ */
+PJ_DECL(pj_status_t) pjmedia_conf_create2(pj_pool_t *pool,
+                                          const pjmedia_conf_param *param,
+                                          pjmedia_conf **p_conf);
+
+
 /**
  * Destroy conference bridge.
  *
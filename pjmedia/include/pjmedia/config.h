@@ -112,6 +112,74 @@
 #endif
 
 
+/**
+ * Default number of threads used by the conference bridge to read, mix
+ * and write the ports on each clock tick. A value of 1 means the bridge
+ * does all the work in the clock thread (the traditional behavior). A
+ * value greater than 1 makes the bridge spawn (value - 1) additional
+ * worker threads, and the work for each phase is split between the clock
+ * thread and the workers. The mixed output is identical in both modes.
+ *
+ * This value is used as the default of \a worker_threads field of
+ * #pjmedia_conf_param. It is only applicable when
+ * PJMEDIA_CONF_USE_SWITCH_BOARD is disabled.
+ *
+ * Default: 1
+ */
+#ifndef PJMEDIA_CONF_THREADS
+#   define PJMEDIA_CONF_THREADS             1
+#endif
+
+
+/**
+ * Maximum number of simultaneous talkers mixed by the conference bridge
+ * on each frame. When this is non-zero, the bridge only mixes the frames
+ * of the loudest active ports, ranked by their RX signal level, and the
+ * frames of the other ports are dropped. Each listener receives the sum
+ * of these talkers minus its own signal, which is computed from a single
+ * shared sum for all listeners whose connections to the talkers are at
+ * normal level. This reduces the mixing work of large conferences from
+ * O(N^2) to O(N*K) per frame.
+ *
+ * When no more than this number of ports are talking, the output is the
+ * same as mixing all ports, unless the sum overflows. The level of an
+ * overflowed sum is then adjusted based on each listener's own sum only,
+ * while the normal mixing also checks the partial sums, so the output may
+ * differ in that case.
+ *
+ * This value is used as the default of \a active_speakers field of
+ * #pjmedia_conf_param. The maximum value is 32. It is only applicable when
+ * PJMEDIA_CONF_USE_SWITCH_BOARD is disabled.
+ *
+ * Default: 0 (mix all ports)
+ */
+#ifndef PJMEDIA_CONF_ACTIVE_SPEAKERS
+#   define PJMEDIA_CONF_ACTIVE_SPEAKERS     0
+#endif
+
+
+/**
+ * Enable SSE2 and AVX2 implementations of the audio mixing routines
+ * (see @ref PJMEDIA_MIX), which are used by the conference bridge and the
+ * signal level calculation. The implementation is selected at run-time
+ * based on the CPU capabilities, with the portable C implementation as
+ * the fallback, so no special compiler flags are needed.
+ *
+ * Default: 1 on x86 and x86-64 with GCC, Clang or MSVC, otherwise 0.
+ */
+#ifndef PJMEDIA_HAS_MIX_SIMD
+#   if (defined(__i386__) || defined(__x86_64__) || \
+        defined(_M_IX86) || defined(_M_X64)) && \
+       (defined(__clang__) || defined(_MSC_VER) || \
+        (defined(__GNUC__) && (__GNUC__ > 4 || \
+                               (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#       define PJMEDIA_HAS_MIX_SIMD         1
+#   else
+#       define PJMEDIA_HAS_MIX_SIMD         0
+#   endif
+#endif
+
+
 /*
  * Types of sound stream backends.
  */
@@ -1161,6 +1229,27 @@
 #endif
 
 
+/**
+ * Enable the AES-NI implementation of the AES_CM_128 cipher for the
+ * bundled libsrtp, which generates the counter mode keystream several
+ * blocks at a time (a VAES variant can be selected as well). It replaces
+ * the libsrtp cipher at run-time when the CPU supports AES-NI, otherwise
+ * libsrtp's own cipher is used. See #pjmedia_srtp_set_cipher_impl().
+ *
+ * Default: 1 on x86 and x86-64 with GCC 8 or Clang and bundled libsrtp,
+ * otherwise 0.
+ */
+#ifndef PJMEDIA_SRTP_HAS_AESNI
+#   if !defined(PJMEDIA_EXTERNAL_SRTP) && \
+       (defined(__i386__) || defined(__x86_64__)) && \
+       (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8))
+#       define PJMEDIA_SRTP_HAS_AESNI               1
+#   else
+#       define PJMEDIA_SRTP_HAS_AESNI               0
+#   endif
+#endif
+
+
 /**
  * Specify whether SRTP needs to handle condition that old packets with
  * incorect RTP seq are still coming when SRTP is restarted.
@@ -1484,6 +1573,33 @@
 #endif
 
 
+/**
+ * Serve all asynchronous media clocks (see @ref PJMEDIA_CLOCK) with the
+ * shared clock scheduler by default, instead of starting one thread per
+ * clock. The clocks of master ports, video ports and the video conference
+ * bridge always use the scheduler (master ports unless created with
+ * PJMEDIA_CLOCK_OWN_THREAD), this also moves the remaining clocks, such
+ * as application clocks. Individual clocks can still choose with
+ * PJMEDIA_CLOCK_SHARED and PJMEDIA_CLOCK_OWN_THREAD options.
+ *
+ * Default: 0
+ */
+#ifndef PJMEDIA_CLOCK_SHARED_SCHED
+#   define PJMEDIA_CLOCK_SHARED_SCHED               0
+#endif
+
+
+/**
+ * Number of timing threads of the shared clock scheduler. Clocks are
+ * distributed among these threads.
+ *
+ * Default: 2
+ */
+#ifndef PJMEDIA_CLOCK_SCHED_THREAD_CNT
+#   define PJMEDIA_CLOCK_SCHED_THREAD_CNT           2
+#endif
+
+
 /**
  * Minimum gap between two consecutive discards in jitter buffer,
  * in milliseconds.
@@ -1541,6 +1657,73 @@
 #endif
 
 
+/**
+ * Quantile of the packet delay distribution to be covered by the target
+ * delay of jitter buffer delay-based algorithm (PJMEDIA_JB_DISCARD_DELAY),
+ * in percent. Frames arriving later than this quantile will be late and
+ * concealed.
+ *
+ * Default: 97
+ */
+#ifndef PJMEDIA_JBUF_DELAY_QUANTILE
+#   define PJMEDIA_JBUF_DELAY_QUANTILE              97
+#endif
+
+
+/**
+ * Forget factor of the delay histogram in jitter buffer delay-based
+ * algorithm, in Q15. Every incoming frame scales down the existing
+ * histogram by this factor, so the higher the value, the longer the
+ * delay history is remembered.
+ *
+ * Default: 32604 (0.995)
+ */
+#ifndef PJMEDIA_JBUF_DELAY_FORGET_FACTOR
+#   define PJMEDIA_JBUF_DELAY_FORGET_FACTOR         32604
+#endif
+
+
+/**
+ * Window for finding the fastest frame arrival in jitter buffer delay-based
+ * algorithm, in milliseconds. Frame delays are measured relative to the
+ * fastest arrival in this window, so clock drift older than this window
+ * does not add up into the delay estimate. A short window lets the fastest
+ * arrival follow the jitter itself, which moves all the measured delays.
+ *
+ * Default: 30000 ms
+ */
+#ifndef PJMEDIA_JBUF_DELAY_WINDOW
+#   define PJMEDIA_JBUF_DELAY_WINDOW                30000
+#endif
+
+
+/**
+ * Excess latency above the target delay that makes jitter buffer
+ * delay-based algorithm discard frames by itself, in milliseconds.
+ * Smaller excess is expected to be removed smoothly by the application
+ * using time-stretching, see #pjmedia_jbuf_get_delay_adjust().
+ *
+ * Default: 60 ms
+ */
+#ifndef PJMEDIA_JBUF_DELAY_DISC_EXCESS
+#   define PJMEDIA_JBUF_DELAY_DISC_EXCESS           60
+#endif
+
+
+/**
+ * Number of frame buffers the jitter buffer allocates in addition to its
+ * capacity, for the frames held by application: allocated with
+ * #pjmedia_jbuf_alloc_buf() but not put yet, or borrowed with
+ * #pjmedia_jbuf_borrow_frame() or #pjmedia_jbuf_peek_buf() and not
+ * released yet.
+ *
+ * Default: 4
+ */
+#ifndef PJMEDIA_JBUF_EXTRA_BUF_CNT
+#   define PJMEDIA_JBUF_EXTRA_BUF_CNT               4
+#endif
+
+
 /**
  * Reset jitter buffer and return silent audio on stream playback start
  * (first get_frame()). This is useful to avoid possible noise that may be
@@ -1628,6 +1811,30 @@
 #endif
 
 
+/**
+ * Maximum number of RTP packets to be read by UDP media transport in one
+ * socket readiness notification. When this is greater than one, after a
+ * packet is read by the ioqueue, the transport drains the packets already
+ * queued in the RTP socket with #pj_sock_recvmmsg(), which uses a single
+ * recvmmsg() system call on Linux (see #PJ_SOCK_HAS_MMSG). This reduces
+ * the number of system calls on hosts handling many streams, at the cost
+ * of (PJMEDIA_TRANSPORT_UDP_RX_BATCH - 1) * PJMEDIA_MAX_MRU bytes of
+ * buffer per transport. The value must not be greater than
+ * #PJ_SOCK_MAX_MMSG + 1. This is disabled with the io_uring ioqueue, see
+ * #PJ_IOQUEUE_URING_HAS_RX.
+ *
+ * Default: 1 (disabled, one packet per read)
+ */
+#ifndef PJMEDIA_TRANSPORT_UDP_RX_BATCH
+#   define PJMEDIA_TRANSPORT_UDP_RX_BATCH       1
+#endif
+
+#if PJ_IOQUEUE_URING_HAS_RX
+#   undef PJMEDIA_TRANSPORT_UDP_RX_BATCH
+#   define PJMEDIA_TRANSPORT_UDP_RX_BATCH       1
+#endif
+
+
 /**
  * Specify if libyuv is available.
  *
@@ -87,7 +87,23 @@ typedef enum pjmedia_jb_discard_algo
      * a new frame arrives, one frame will be discarded to make space for the
      * new frame.
      */
-    PJMEDIA_JB_DISCARD_PROGRESSIVE
+    PJMEDIA_JB_DISCARD_PROGRESSIVE,
+
+    /**
+     * The target latency is estimated from a histogram of frame arrival
+     * delays, as the delay covering PJMEDIA_JBUF_DELAY_QUANTILE percent of
+     * the frames. Application should follow the target smoothly by
+     * time-stretching the decoded audio, as suggested by
+     * #pjmedia_jbuf_get_delay_adjust(), the jitter buffer only discards
+     * frames when latency exceeds the target by more than
+     * PJMEDIA_JBUF_DELAY_DISC_EXCESS. Audio stream does the time-stretching
+     * automatically when this algorithm is used.
+     *
+     * This algorithm is experimental. In the jbsim scenarios its latency is
+     * not yet lower than PJMEDIA_JB_DISCARD_PROGRESSIVE's, which is still
+     * the recommended algorithm.
+     */
+    PJMEDIA_JB_DISCARD_DELAY
 
 } pjmedia_jb_discard_algo;
 
@@ -107,6 +123,9 @@ typedef struct pjmedia_jb_state
     unsigned    burst;              /**< Current burst level, in frames     */
     unsigned    prefetch;           /**< Current prefetch value, in frames  */
     unsigned    size;               /**< Current buffer size, in frames.    */
+    unsigned    target;             /**< Target buffer size estimated from
+                                         arrival delays, in frames. Only
+                                         set by PJMEDIA_JB_DISCARD_DELAY.   */
 
     /* Statistic */
     unsigned    avg_delay;          /**< Average delay, in ms.              */
@@ -131,6 +150,14 @@ typedef struct pjmedia_jb_state
  */
 typedef struct pjmedia_jbuf pjmedia_jbuf;
 
+/**
+ * Opaque declaration for reference counted frame buffer of a jitter buffer,
+ * used to put and get frames without copying the frame content. The buffer
+ * is owned by the jitter buffer, so all references must be released before
+ * the jitter buffer is destroyed.
+ */
+typedef struct pjmedia_jb_buf pjmedia_jb_buf;
+
 
 /**
  * Create an adaptive jitter buffer according to the specification. If
@@ -441,6 +468,119 @@ PJ_DECL(void) pjmedia_jbuf_peek_frame(pjmedia_jbuf *jb,
                                       int *seq);
 
 
+/**
+ * Peek a frame from the jitter buffer and get a reference to its content,
+ * so the content stays valid after the frame is removed from the jitter
+ * buffer, until the reference is released with #pjmedia_jbuf_release_buf().
+ * The jitter buffer state will not be modified.
+ *
+ * @param jb            The jitter buffer.
+ * @param offset        Offset from the oldest frame to be peeked.
+ * @param frame         Pointer to receive the frame content, may be NULL.
+ * @param p_buf         Pointer to receive the frame buffer reference, or
+ *                      NULL if the frame is not a normal frame.
+ * @param size          Pointer to receive frame size.
+ * @param p_frm_type    Pointer to receive frame type.
+ *                      @see pjmedia_jbuf_get_frame().
+ * @param bit_info      Bit precise info of the frame.
+ * @param ts            Frame timestamp.
+ * @param seq           Frame sequence number.
+ */
+PJ_DECL(void) pjmedia_jbuf_peek_buf(pjmedia_jbuf *jb,
+                                    unsigned offset,
+                                    const void **frame,
+                                    pjmedia_jb_buf **p_buf,
+                                    pj_size_t *size,
+                                    char *p_frm_type,
+                                    pj_uint32_t *bit_info,
+                                    pj_uint32_t *ts,
+                                    int *seq);
+
+
+/**
+ * Get a frame from the jitter buffer without copying it. This works like
+ * #pjmedia_jbuf_get_frame3(), except that the frame content is read in
+ * place: when a normal frame is returned, the application receives the
+ * reference to the frame buffer and must release it with
+ * #pjmedia_jbuf_release_buf() once it is done with the content.
+ *
+ * Application MUST manage it's own synchronization when multiple threads
+ * are accessing the jitter buffer at the same time.
+ *
+ * @param jb            The jitter buffer.
+ * @param frame         Pointer to receive the frame content, or NULL if
+ *                      the frame is not a normal frame.
+ * @param p_buf         Pointer to receive the frame buffer reference, or
+ *                      NULL if the frame is not a normal frame.
+ * @param size          Pointer to receive the frame size.
+ * @param p_frm_type    Pointer to receive frame type.
+ *                      @see pjmedia_jbuf_get_frame().
+ * @param bit_info      Bit precise info of the frame.
+ * @param ts            Frame timestamp.
+ * @param seq           Frame sequence number.
+ */
+PJ_DECL(void) pjmedia_jbuf_borrow_frame(pjmedia_jbuf *jb,
+                                        const void **frame,
+                                        pjmedia_jb_buf **p_buf,
+                                        pj_size_t *size,
+                                        char *p_frm_type,
+                                        pj_uint32_t *bit_info,
+                                        pj_uint32_t *ts,
+                                        int *seq);
+
+
+/**
+ * Allocate a frame buffer, so application can build the frame content
+ * in place and put it to the jitter buffer with #pjmedia_jbuf_put_buf().
+ * The buffer size is the frame size specified when the jitter buffer was
+ * created.
+ *
+ * @param jb            The jitter buffer.
+ * @param p_buf         Pointer to receive the frame buffer reference.
+ * @param p_data        Pointer to receive the frame buffer content.
+ *
+ * @return              PJ_SUCCESS on success, or PJ_ETOOMANY if all
+ *                      frame buffers are in use.
+ */
+PJ_DECL(pj_status_t) pjmedia_jbuf_alloc_buf(pjmedia_jbuf *jb,
+                                            pjmedia_jb_buf **p_buf,
+                                            void **p_data);
+
+
+/**
+ * Put a frame buffer to the jitter buffer, without copying it. This works
+ * like #pjmedia_jbuf_put_frame3(), the jitter buffer takes over the
+ * application's reference to the buffer, also when the frame is discarded.
+ *
+ * @param jb            The jitter buffer.
+ * @param buf           The frame buffer, from #pjmedia_jbuf_alloc_buf().
+ * @param size          The frame size.
+ * @param bit_info      Bit precise info of the frame.
+ * @param frame_seq     The frame sequence number.
+ * @param frame_ts      The frame timestamp.
+ * @param discarded     Flag whether the frame is discarded by jitter buffer.
+ */
+PJ_DECL(void) pjmedia_jbuf_put_buf(pjmedia_jbuf *jb,
+                                   pjmedia_jb_buf *buf,
+                                   pj_size_t size,
+                                   pj_uint32_t bit_info,
+                                   int frame_seq,
+                                   pj_uint32_t frame_ts,
+                                   pj_bool_t *discarded);
+
+
+/**
+ * Release a frame buffer reference, returned by
+ * #pjmedia_jbuf_borrow_frame(), #pjmedia_jbuf_peek_buf(), or
+ * #pjmedia_jbuf_alloc_buf().
+ *
+ * @param jb            The jitter buffer.
+ * @param buf           The frame buffer.
+ */
+PJ_DECL(void) pjmedia_jbuf_release_buf(pjmedia_jbuf *jb,
+                                       pjmedia_jb_buf *buf);
+
+
 /**
  * Remove frames from the jitter buffer.
  *
@@ -474,6 +614,41 @@ PJ_DECL(pj_status_t) pjmedia_jbuf_get_state( const pjmedia_jbuf *jb,
                                              pjmedia_jb_state *state );
 
 
+/**
+ * Get the latency adjustment suggested by the delay-based discard
+ * algorithm (PJMEDIA_JB_DISCARD_DELAY). A positive value means the
+ * buffered latency is above the target, application should shorten
+ * the decoded audio (e.g: with #pjmedia_wsola_discard()) and consume
+ * frames faster. A negative value means the latency is below the target,
+ * application should lengthen the audio (e.g: with
+ * #pjmedia_wsola_generate()) without consuming a frame, and report it
+ * with #pjmedia_jbuf_time_stretched(). The latency is re-evaluated as
+ * frames arrive, so application only needs to act on the sign of the
+ * value.
+ *
+ * @param jb            The jitter buffer.
+ *
+ * @return              Number of frames the latency is above (positive)
+ *                      or below (negative) the target band, or zero when
+ *                      no adjustment is needed or another discard
+ *                      algorithm is used.
+ */
+PJ_DECL(int) pjmedia_jbuf_get_delay_adjust(const pjmedia_jbuf *jb);
+
+
+/**
+ * Inform the jitter buffer that application has time-stretched the audio
+ * following #pjmedia_jbuf_get_delay_adjust(). The delay-based discard
+ * algorithm measures frame arrival delay against the playout time, which
+ * otherwise is derived from the number of GET operations.
+ *
+ * @param jb            The jitter buffer.
+ * @param usec          Duration of audio synthesized (positive) or
+ *                      erased (negative), in microseconds.
+ */
+PJ_DECL(void) pjmedia_jbuf_time_stretched(pjmedia_jbuf *jb, int usec);
+
+
 
 PJ_END_DECL
 
@@ -72,7 +72,9 @@ typedef struct pjmedia_master_port pjmedia_master_port;
  * @param u_port        Upstream port.
  * @param d_port        Downstream port.
  * @param options       Options flags, from bitmask combinations from
- *                      pjmedia_clock_options.
+ *                      pjmedia_clock_options. The clock is served by the
+ *                      shared clock scheduler, unless
+ *                      PJMEDIA_CLOCK_OWN_THREAD is specified.
  * @param p_m           Pointer to receive the master port instance.
  *
  * @return              PJ_SUCCESS on success.
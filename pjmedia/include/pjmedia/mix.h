@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef __PJMEDIA_MIX_H__
+#define __PJMEDIA_MIX_H__
+
+/**
+ * @file mix.h
+ * @brief Audio mixing and signal level routines.
+ */
+#include <pjmedia/types.h>
+
+
+/**
+ * @defgroup PJMEDIA_MIX Audio mixing routines
+ * @ingroup PJMEDIA_FRAME_OP
+ * @brief Mixing, level adjustment and signal level calculation of
+ *        16bit PCM samples
+ * @{
+ *
+ * These are the inner loops of the conference bridge. Each routine has a
+ * portable scalar implementation, and when #PJMEDIA_HAS_MIX_SIMD is
+ * enabled, SSE2 and AVX2 implementations which are selected at run-time
+ * according to the capabilities of the CPU. All implementations produce
+ * identical results.
+ *
+ * Level adjustments are expressed the same way as in the conference
+ * bridge, i.e. a value of 128 means no adjustment, and the adjusted
+ * sample is calculated as (sample * adj_level) >> 7, clipped to 16bit.
+ */
+
+PJ_BEGIN_DECL
+
+
+/**
+ * Implementations of the mixing routines.
+ */
+typedef enum pjmedia_mix_impl
+{
+    /**
+     * Automatically select the fastest implementation supported by the
+     * CPU.
+     */
+    PJMEDIA_MIX_IMPL_AUTO,
+
+    /**
+     * Portable C implementation.
+     */
+    PJMEDIA_MIX_IMPL_SCALAR,
+
+    /**
+     * SSE2 implementation.
+     */
+    PJMEDIA_MIX_IMPL_SSE2,
+
+    /**
+     * AVX2 implementation.
+     */
+    PJMEDIA_MIX_IMPL_AVX2
+
+} pjmedia_mix_impl;
+
+
+/**
+ * Select the implementation of the mixing routines. This is mostly
+ * useful for testing, since by default the fastest implementation is
+ * selected automatically.
+ *
+ * @param impl          The implementation.
+ *
+ * @return              PJ_SUCCESS on success, or PJ_ENOTSUP if the
+ *                      implementation is not available in this build or
+ *                      is not supported by the CPU.
+ */
+PJ_DECL(pj_status_t) pjmedia_mix_set_impl(pjmedia_mix_impl impl);
+
+
+/**
+ * Get the implementation of the mixing routines currently in use.
+ *
+ * @return              The implementation, never PJMEDIA_MIX_IMPL_AUTO.
+ */
+PJ_DECL(pjmedia_mix_impl) pjmedia_mix_get_impl(void);
+
+
+/**
+ * Add samples to the mix buffer, and get the minimum and maximum value
+ * of the mix buffer after the addition.
+ *
+ * @param mix_buf       The mix buffer.
+ * @param samples       The samples to be added.
+ * @param count         Number of samples.
+ * @param p_min         Optional pointer to receive the minimum value in
+ *                      the mix buffer, or zero if it is greater than zero.
+ * @param p_max         Optional pointer to receive the maximum value in
+ *                      the mix buffer, or zero if it is less than zero.
+ */
+PJ_DECL(void) pjmedia_mix_add_samples(pj_int32_t mix_buf[],
+                                      const pj_int16_t samples[],
+                                      unsigned count,
+                                      pj_int32_t *p_min,
+                                      pj_int32_t *p_max);
+
+
+/**
+ * Subtract samples from the mix buffer, e.g. to remove the signal of a
+ * participant from the sum of all participants, and get the minimum and
+ * maximum value of the result. The destination buffer may be the mix
+ * buffer itself.
+ *
+ * @param dst           Buffer to receive the result.
+ * @param mix_buf       The mix buffer.
+ * @param samples       The samples to be subtracted.
+ * @param count         Number of samples.
+ * @param p_min         Optional pointer to receive the minimum value in
+ *                      the result, or zero if it is greater than zero.
+ * @param p_max         Optional pointer to receive the maximum value in
+ *                      the result, or zero if it is less than zero.
+ */
+PJ_DECL(void) pjmedia_mix_sub_samples(pj_int32_t dst[],
+                                      const pj_int32_t mix_buf[],
+                                      const pj_int16_t samples[],
+                                      unsigned count,
+                                      pj_int32_t *p_min,
+                                      pj_int32_t *p_max);
+
+
+/**
+ * Copy samples to the mix buffer.
+ *
+ * @param mix_buf       The mix buffer.
+ * @param samples       The samples.
+ * @param count         Number of samples.
+ */
+PJ_DECL(void) pjmedia_mix_copy_samples(pj_int32_t mix_buf[],
+                                       const pj_int16_t samples[],
+                                       unsigned count);
+
+
+/**
+ * Adjust the level of the samples. The source and destination buffer
+ * may be the same buffer.
+ *
+ * @param dst           Buffer to receive the adjusted samples.
+ * @param src           The samples.
+ * @param count         Number of samples.
+ * @param adj_level     The level adjustment, 128 means no adjustment.
+ *
+ * @return              Sum of the absolute value of the adjusted samples.
+ */
+PJ_DECL(pj_uint32_t) pjmedia_mix_adjust_samples(pj_int16_t dst[],
+                                                const pj_int16_t src[],
+                                                unsigned count,
+                                                unsigned adj_level);
+
+
+/**
+ * Adjust the level of the mix buffer and convert it to 16bit samples,
+ * clipping the samples that are too loud. The destination buffer may be
+ * the mix buffer itself, as the conference bridge does.
+ *
+ * @param dst           Buffer to receive the 16bit samples.
+ * @param mix_buf       The mix buffer.
+ * @param count         Number of samples.
+ * @param adj_level     The level adjustment, 128 means no adjustment.
+ *
+ * @return              Sum of the absolute value of the output samples.
+ */
+PJ_DECL(pj_uint32_t) pjmedia_mix_to_samples(pj_int16_t dst[],
+                                            const pj_int32_t mix_buf[],
+                                            unsigned count,
+                                            unsigned adj_level);
+
+
+/**
+ * Calculate the sum of the absolute value of the samples.
+ *
+ * @param samples       The samples.
+ * @param count         Number of samples.
+ *
+ * @return              Sum of the absolute value of the samples.
+ */
+PJ_DECL(pj_uint32_t) pjmedia_mix_sum_abs(const pj_int16_t samples[],
+                                         unsigned count);
+
+
+PJ_END_DECL
+
+/**
+ * @}
+ */
+
+#endif  /* __PJMEDIA_MIX_H__ */
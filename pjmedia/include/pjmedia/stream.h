@@ -373,6 +373,21 @@ PJ_DECL(pj_status_t) pjmedia_stream_get_stat_jbuf(const pjmedia_stream *stream,
                                                   pjmedia_jb_state *state);
 
 
+/**
+ * Get the duration of the decoded audio queued for time-stretching, which
+ * adds to the jitter buffer latency when the delay-based jitter buffer
+ * (PJMEDIA_JB_DISCARD_DELAY) is used.
+ *
+ * @param stream        The media stream.
+ * @param msec          Duration of the queued audio, in msec.
+ *
+ * @return              PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_stream_get_stretch_delay(
+                                            const pjmedia_stream *stream,
+                                            unsigned *msec);
+
+
 /**
  * Pause the individual channel in the stream.
  *
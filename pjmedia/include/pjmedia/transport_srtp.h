@@ -359,6 +359,66 @@ typedef struct pjmedia_srtp_dtls_nego_param
 
 
 
+/**
+ * Implementations of the AES_CM_128 cipher, see
+ * #pjmedia_srtp_set_cipher_impl().
+ */
+typedef enum pjmedia_srtp_cipher_impl
+{
+    /**
+     * Select AES-NI implementation when supported by the CPU, otherwise
+     * the cipher of libsrtp.
+     */
+    PJMEDIA_SRTP_CIPHER_IMPL_AUTO,
+
+    /**
+     * The cipher of libsrtp.
+     */
+    PJMEDIA_SRTP_CIPHER_IMPL_LIBSRTP,
+
+    /**
+     * AES-NI implementation, generating the keystream four blocks at
+     * a time. Requires #PJMEDIA_SRTP_HAS_AESNI.
+     */
+    PJMEDIA_SRTP_CIPHER_IMPL_AESNI,
+
+    /**
+     * VAES implementation, generating the keystream eight blocks at a time
+     * with 256-bit AES instructions. It only pays off for large packets
+     * (e.g: video), as audio packets are a few blocks long and the
+     * authentication dominates. Requires #PJMEDIA_SRTP_HAS_AESNI.
+     */
+    PJMEDIA_SRTP_CIPHER_IMPL_VAES
+
+} pjmedia_srtp_cipher_impl;
+
+
+/**
+ * A packet to be encrypted with #pjmedia_transport_srtp_encrypt_batch().
+ */
+typedef struct pjmedia_srtp_batch_pkt
+{
+    /** The SRTP transport whose TX context encrypts the packet. */
+    pjmedia_transport  *tp;
+
+    /** Non-zero if the packet is RTP, zero if it is RTCP. */
+    pj_bool_t           is_rtp;
+
+    /** The packet, encrypted in place. The buffer must have room for the
+     *  SRTP trailer (authentication tag, MKI and SRTCP index) after the
+     *  packet. */
+    void               *pkt;
+
+    /** On input, the length of the packet. On output, the length of the
+     *  encrypted packet. */
+    int                 len;
+
+    /** On output, the status of the encryption of this packet. */
+    pj_status_t         status;
+
+} pjmedia_srtp_batch_pkt;
+
+
 /**
  * Initialize SRTP library. This function should be called before
  * any SRTP functions, however calling #pjmedia_transport_srtp_create() 
@@ -409,6 +469,29 @@ PJ_DECL(pj_status_t) pjmedia_srtp_enum_keying(unsigned *count,
                                       pjmedia_srtp_keying_method keying[]);
 
 
+/**
+ * Select the implementation of the AES_CM_128 cipher, used by SRTP
+ * contexts created afterwards. By default, AES-NI implementation is
+ * used when supported by the CPU. If SRTP library has not been initialized,
+ * the selection is applied when it is.
+ *
+ * @param impl      The implementation.
+ *
+ * @return          PJ_SUCCESS on success, or PJ_ENOTSUP if the
+ *                  implementation is not available.
+ */
+PJ_DECL(pj_status_t) pjmedia_srtp_set_cipher_impl(pjmedia_srtp_cipher_impl impl);
+
+
+/**
+ * Get the implementation of the AES_CM_128 cipher currently in use, or
+ * the selected one if SRTP library has not been initialized.
+ *
+ * @return          The implementation.
+ */
+PJ_DECL(pjmedia_srtp_cipher_impl) pjmedia_srtp_get_cipher_impl(void);
+
+
 /**
  * Create an SRTP media transport.
  *
@@ -559,6 +642,27 @@ PJ_DECL(pj_status_t) pjmedia_transport_srtp_decrypt_pkt(pjmedia_transport *tp,
                                                         int *pkt_len);
 
 
+/**
+ * Encrypt a batch of RTP/RTCP packets in place, without sending them,
+ * for applications that send many packets of many streams at once, such
+ * as media gateways. The packets may belong to different SRTP transports,
+ * consecutive packets of the same transport are encrypted under one
+ * acquisition of its lock, so grouping the packets by transport is
+ * recommended. Packets of a transport whose SRTP is bypassed are left
+ * unchanged.
+ *
+ * @param pkts          The packets.
+ * @param count         Number of packets.
+ *
+ * @return              PJ_SUCCESS if all packets have been encrypted,
+ *                      otherwise the status of the first failure. The
+ *                      status of each packet is set in the packet.
+ */
+PJ_DECL(pj_status_t) pjmedia_transport_srtp_encrypt_batch(
+                                            pjmedia_srtp_batch_pkt pkts[],
+                                            unsigned count);
+
+
 /**
  * Query member transport of SRTP.
  *
@@ -25,6 +25,14 @@
 #include <pj/string.h>
 #include <pj/compat/high_precision.h>
 
+#if defined(PJ_LINUX) && PJ_LINUX!=0
+#   define SCHED_HAS_TIMERFD    1
+#   include <sys/timerfd.h>
+#   include <unistd.h>
+#else
+#   define SCHED_HAS_TIMERFD    0
+#endif
+
 /* API: Init clock source */
 PJ_DEF(pj_status_t) pjmedia_clock_src_init( pjmedia_clock_src *clocksrc,
                                             pjmedia_type media_type,
@@ -106,6 +114,8 @@ pjmedia_clock_src_get_time_msec( const pjmedia_clock_src *clocksrc )
  * Implementation of media clock with OS thread.
  */
 
+struct sched_thread;
+
 struct pjmedia_clock
 {
     pj_pool_t               *pool;
@@ -122,10 +132,64 @@ struct pjmedia_clock
     pj_bool_t                running;
     pj_bool_t                quitting;
     pj_lock_t               *lock;
+
+    /* Shared scheduler */
+    struct sched_thread     *sched;         /* Timing thread, or NULL.  */
+    int                      heap_idx;      /* Index in the heap or -1. */
 };
 
 
+/*
+ * Shared clock scheduler. A small, fixed number of timing threads serve
+ * all clocks created with PJMEDIA_CLOCK_SHARED. Each timing thread keeps
+ * its running clocks in a binary heap ordered by the next tick, and
+ * sleeps until the earliest tick (on a timerfd where available). Ticks
+ * that are due within SCHED_SLACK_USEC are run in the same wakeup.
+ */
+#define SCHED_SLACK_USEC        500
+#define SCHED_MAX_WAIT_MSEC     1000
+
+typedef struct sched_thread
+{
+    pj_pool_t               *pool;
+    pj_thread_t             *thread;
+    pj_mutex_t              *mutex;
+    int                      tfd;
+    pj_bool_t                quitting;
+    pjmedia_clock          **heap;
+    unsigned                 heap_cnt;
+    unsigned                 heap_max;
+    unsigned                 clock_cnt;     /* Clocks assigned.         */
+    pjmedia_clock           *cur;           /* Clock in callback.       */
+
+    /* Tick statistics */
+    pj_uint64_t              tick_cnt;
+    pj_uint64_t              overrun_cnt;
+    pj_uint64_t              late_usec_total;
+    unsigned                 max_late_usec;
+} sched_thread;
+
+static struct clock_sched
+{
+    unsigned                 ref_cnt;
+    pj_bool_t                destroying;    /* Threads being joined.    */
+    pj_caching_pool          cp;            /* Scheduler's own factory. */
+    pj_pool_t               *pool;
+    pj_timestamp             freq;
+    pj_uint64_t              slack;
+    unsigned                 phase_seq;
+    sched_thread             th[PJMEDIA_CLOCK_SCHED_THREAD_CNT];
+} sched;
+
+/* Whether sched_atexit() has been registered to pj_atexit() */
+static pj_bool_t sched_atexit_registered;
+
+
 static int clock_thread(void *arg);
+static pj_status_t sched_add_clock(pjmedia_clock *clock);
+static pj_status_t sched_start(pjmedia_clock *clock);
+static pj_status_t sched_stop(pjmedia_clock *clock);
+static void sched_remove_clock(pjmedia_clock *clock);
 
 #define MAX_JUMP_MSEC   500
 #define USEC_IN_SEC     (pj_uint64_t)1000000
@@ -185,12 +249,28 @@ PJ_DEF(pj_status_t) pjmedia_clock_create2(pj_pool_t *pool,
     clock->thread = NULL;
     clock->running = PJ_FALSE;
     clock->quitting = PJ_FALSE;
+    clock->sched = NULL;
+    clock->heap_idx = -1;
     
     /* I don't think we need a mutex, so we'll use null. */
     status = pj_lock_create_null_mutex(pool, "clock", &clock->lock);
     if (status != PJ_SUCCESS)
         return status;
 
+    /* Asynchronous clock may be served by the shared scheduler */
+    if ((options & PJMEDIA_CLOCK_NO_ASYNC) == 0 &&
+        ((options & PJMEDIA_CLOCK_SHARED) ||
+         (PJMEDIA_CLOCK_SHARED_SCHED &&
+          (options & PJMEDIA_CLOCK_OWN_THREAD) == 0)))
+    {
+        status = sched_add_clock(clock);
+        if (status != PJ_SUCCESS) {
+            pj_lock_destroy(clock->lock);
+            pj_pool_release(clock->pool);
+            return status;
+        }
+    }
+
     *p_clock = clock;
 
     return PJ_SUCCESS;
@@ -210,6 +290,9 @@ PJ_DEF(pj_status_t) pjmedia_clock_start(pjmedia_clock *clock)
     if (clock->running)
         return PJ_SUCCESS;
 
+    if (clock->sched)
+        return sched_start(clock);
+
     status = pj_get_timestamp(&now);
     if (status != PJ_SUCCESS)
         return status;
@@ -246,6 +329,9 @@ PJ_DEF(pj_status_t) pjmedia_clock_stop(pjmedia_clock *clock)
 {
     PJ_ASSERT_RETURN(clock != NULL, PJ_EINVAL);
 
+    if (clock->sched)
+        return sched_stop(clock);
+
     clock->running = PJ_FALSE;
     clock->quitting = PJ_TRUE;
 
@@ -416,6 +502,11 @@ PJ_DEF(pj_status_t) pjmedia_clock_destroy(pjmedia_clock *clock)
 {
     PJ_ASSERT_RETURN(clock != NULL, PJ_EINVAL);
 
+    if (clock->sched) {
+        sched_stop(clock);
+        sched_remove_clock(clock);
+    }
+
     clock->running = PJ_FALSE;
     clock->quitting = PJ_TRUE;
 
@@ -436,3 +527,550 @@ PJ_DEF(pj_status_t) pjmedia_clock_destroy(pjmedia_clock *clock)
 }
 
 
+
+/*
+ * Shared scheduler: heap of running clocks, ordered by next tick.
+ * All heap functions are called with the timing thread's mutex held.
+ */
+static void heap_set(sched_thread *th, unsigned idx, pjmedia_clock *clock)
+{
+    th->heap[idx] = clock;
+    clock->heap_idx = (int)idx;
+}
+
+static void heap_up(sched_thread *th, unsigned idx)
+{
+    pjmedia_clock *clock = th->heap[idx];
+
+    while (idx > 0) {
+        unsigned parent = (idx - 1) / 2;
+
+        if (th->heap[parent]->next_tick.u64 <= clock->next_tick.u64)
+            break;
+        heap_set(th, idx, th->heap[parent]);
+        idx = parent;
+    }
+    heap_set(th, idx, clock);
+}
+
+static void heap_down(sched_thread *th, unsigned idx)
+{
+    pjmedia_clock *clock = th->heap[idx];
+
+    for (;;) {
+        unsigned child = idx * 2 + 1;
+
+        if (child >= th->heap_cnt)
+            break;
+        if (child + 1 < th->heap_cnt &&
+            th->heap[child+1]->next_tick.u64 < th->heap[child]->next_tick.u64)
+        {
+            ++child;
+        }
+        if (clock->next_tick.u64 <= th->heap[child]->next_tick.u64)
+            break;
+        heap_set(th, idx, th->heap[child]);
+        idx = child;
+    }
+    heap_set(th, idx, clock);
+}
+
+static void heap_push(sched_thread *th, pjmedia_clock *clock)
+{
+    if (th->heap_cnt == th->heap_max) {
+        unsigned new_max = th->heap_max ? th->heap_max * 2 : 16;
+        pjmedia_clock **new_heap;
+
+        new_heap = (pjmedia_clock**)
+                   pj_pool_calloc(th->pool, new_max, sizeof(pjmedia_clock*));
+        if (th->heap_cnt)
+            pj_memcpy(new_heap, th->heap,
+                      th->heap_cnt * sizeof(pjmedia_clock*));
+        th->heap = new_heap;
+        th->heap_max = new_max;
+    }
+
+    heap_set(th, th->heap_cnt++, clock);
+    heap_up(th, th->heap_cnt - 1);
+}
+
+static void heap_remove(sched_thread *th, pjmedia_clock *clock)
+{
+    unsigned idx = (unsigned)clock->heap_idx;
+    pjmedia_clock *last = th->heap[--th->heap_cnt];
+
+    clock->heap_idx = -1;
+    if (last != clock) {
+        heap_set(th, idx, last);
+        heap_down(th, idx);
+        heap_up(th, (unsigned)last->heap_idx);
+    }
+}
+
+/* Wake up the timing thread so that it re-evaluates the heap */
+static void sched_wakeup(sched_thread *th)
+{
+#if SCHED_HAS_TIMERFD
+    if (th->tfd >= 0) {
+        struct itimerspec its;
+
+        pj_bzero(&its, sizeof(its));
+        its.it_value.tv_nsec = 1;
+        timerfd_settime(th->tfd, 0, &its, NULL);
+    }
+#else
+    PJ_UNUSED_ARG(th);
+#endif
+}
+
+/* Wait until the earliest tick. Called and returns with the mutex held. */
+static void sched_wait(sched_thread *th, const pj_timestamp *now)
+{
+    pjmedia_clock *clock = th->heap_cnt ? th->heap[0] : NULL;
+    pj_uint32_t usec;
+
+    if (clock) {
+        usec = pj_elapsed_usec(now, &clock->next_tick);
+        if (usec > SCHED_MAX_WAIT_MSEC * 1000)
+            usec = SCHED_MAX_WAIT_MSEC * 1000;
+    } else {
+        usec = SCHED_MAX_WAIT_MSEC * 1000;
+    }
+
+#if SCHED_HAS_TIMERFD
+    if (th->tfd >= 0) {
+        struct itimerspec its;
+        pj_uint64_t exp;
+
+        pj_bzero(&its, sizeof(its));
+        its.it_value.tv_sec = usec / 1000000;
+        its.it_value.tv_nsec = (usec % 1000000) * 1000;
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+            its.it_value.tv_nsec = 1;
+        timerfd_settime(th->tfd, 0, &its, NULL);
+
+        pj_mutex_unlock(th->mutex);
+        if (read(th->tfd, &exp, sizeof(exp)) < 0) {
+            /* Interrupted, just re-evaluate */
+        }
+        pj_mutex_lock(th->mutex);
+        return;
+    }
+#endif
+
+    /* Without timerfd, new clocks are noticed at the next wakeup, so
+     * keep the sleep short.
+     */
+    if (usec > 10000)
+        usec = 10000;
+    pj_mutex_unlock(th->mutex);
+    pj_thread_sleep(usec / 1000);
+    pj_mutex_lock(th->mutex);
+}
+
+/* Timing thread of the shared scheduler */
+static int sched_thread_func(void *arg)
+{
+    sched_thread *th = (sched_thread*) arg;
+    int max;
+
+    /* Set thread priority to maximum */
+    max = pj_thread_get_prio_max(pj_thread_this());
+    if (max > 0)
+        pj_thread_set_prio(pj_thread_this(), max);
+
+    pj_mutex_lock(th->mutex);
+    while (!th->quitting) {
+        pjmedia_clock *clock;
+        pj_timestamp now;
+        unsigned late_usec;
+
+        pj_get_timestamp(&now);
+
+        clock = th->heap_cnt ? th->heap[0] : NULL;
+        if (!clock || clock->next_tick.u64 > now.u64 + sched.slack) {
+            sched_wait(th, &now);
+            continue;
+        }
+
+        heap_remove(th, clock);
+        th->cur = clock;
+
+        /* Update statistics */
+        late_usec = (now.u64 > clock->next_tick.u64) ?
+                    pj_elapsed_usec(&clock->next_tick, &now) : 0;
+        th->tick_cnt++;
+        th->late_usec_total += late_usec;
+        if (late_usec > th->max_late_usec)
+            th->max_late_usec = late_usec;
+        if (now.u64 >= clock->next_tick.u64 + clock->interval.u64)
+            th->overrun_cnt++;
+
+        pj_mutex_unlock(th->mutex);
+
+        /* Call callback, if any */
+        if (clock->cb)
+            (*clock->cb)(&clock->timestamp, clock->user_data);
+
+        pj_mutex_lock(th->mutex);
+        th->cur = NULL;
+
+        /* Reschedule unless the clock has been stopped in the meantime */
+        if (clock->running && clock->heap_idx < 0) {
+            clock->timestamp.u64 += clock->timestamp_inc;
+            clock_calc_next_tick(clock, &now);
+            heap_push(th, clock);
+        }
+    }
+    pj_mutex_unlock(th->mutex);
+
+    return 0;
+}
+
+static pj_bool_t sched_is_timing_thread(void)
+{
+    pj_thread_t *this_thread = pj_thread_this();
+    unsigned i;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(sched.th); ++i) {
+        if (sched.th[i].thread == this_thread)
+            return PJ_TRUE;
+    }
+    return PJ_FALSE;
+}
+
+/* Tell the timing threads to quit. Called inside the critical section,
+ * sched_add_clock() waits until sched_release() has completed.
+ */
+static void sched_shutdown(void)
+{
+    unsigned i;
+
+    sched.destroying = PJ_TRUE;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(sched.th); ++i) {
+        sched_thread *th = &sched.th[i];
+
+        if (th->thread) {
+            pj_mutex_lock(th->mutex);
+            th->quitting = PJ_TRUE;
+            sched_wakeup(th);
+            pj_mutex_unlock(th->mutex);
+        }
+    }
+}
+
+/* Join the timing threads and free the scheduler after sched_shutdown().
+ * Called outside the critical section, so that a callback still running
+ * on a timing thread can't deadlock with us.
+ */
+static void sched_release(void)
+{
+    unsigned i;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(sched.th); ++i) {
+        sched_thread *th = &sched.th[i];
+
+        if (th->thread) {
+            pj_thread_join(th->thread);
+            pj_thread_destroy(th->thread);
+        }
+    }
+
+    pj_enter_critical_section();
+
+    for (i = 0; i < PJ_ARRAY_SIZE(sched.th); ++i) {
+        sched_thread *th = &sched.th[i];
+
+#if SCHED_HAS_TIMERFD
+        if (th->tfd >= 0)
+            close(th->tfd);
+#endif
+        if (th->mutex)
+            pj_mutex_destroy(th->mutex);
+        if (th->pool)
+            pj_pool_release(th->pool);
+    }
+
+    if (sched.pool)
+        pj_pool_release(sched.pool);
+
+    pj_caching_pool_destroy(&sched.cp);
+
+    pj_bzero(&sched, sizeof(sched));
+
+    pj_leave_critical_section();
+}
+
+/* Destroy the scheduler if it has no more clocks. Called outside the
+ * critical section.
+ */
+static void sched_destroy(void)
+{
+    pj_enter_critical_section();
+    if (!sched.pool || sched.ref_cnt != 0 || sched.destroying) {
+        pj_leave_critical_section();
+        return;
+    }
+    sched_shutdown();
+    pj_leave_critical_section();
+
+    sched_release();
+}
+
+/* Destroy the scheduler that has been kept because its last clock was
+ * destroyed from a timing thread.
+ */
+static void sched_atexit(void)
+{
+    sched_destroy();
+
+    pj_enter_critical_section();
+    sched_atexit_registered = PJ_FALSE;
+    pj_leave_critical_section();
+}
+
+/* Create the scheduler. Called inside the critical section. */
+static pj_status_t sched_create(void)
+{
+    pj_pool_factory *pf;
+    unsigned i;
+    pj_status_t status;
+
+    pj_bzero(&sched, sizeof(sched));
+    for (i = 0; i < PJ_ARRAY_SIZE(sched.th); ++i)
+        sched.th[i].tfd = -1;
+
+    /* The timing threads may outlive the clock that creates them, see
+     * sched_remove_clock(), so don't allocate from the clock's factory.
+     */
+    pj_caching_pool_init(&sched.cp, NULL, 0);
+    pf = &sched.cp.factory;
+
+    if (!sched_atexit_registered) {
+        status = pj_atexit(&sched_atexit);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+        sched_atexit_registered = PJ_TRUE;
+    }
+
+    sched.pool = pj_pool_create(pf, "clocksched", 512, 512, NULL);
+    if (!sched.pool) {
+        status = PJ_ENOMEM;
+        goto on_error;
+    }
+
+    pj_get_timestamp_freq(&sched.freq);
+    sched.slack = sched.freq.u64 * SCHED_SLACK_USEC / USEC_IN_SEC;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(sched.th); ++i) {
+        sched_thread *th = &sched.th[i];
+
+        th->pool = pj_pool_create(pf, "clockheap", 512, 512, NULL);
+        if (!th->pool) {
+            status = PJ_ENOMEM;
+            goto on_error;
+        }
+
+        status = pj_mutex_create_simple(sched.pool, "clocksched",
+                                        &th->mutex);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+
+#if SCHED_HAS_TIMERFD
+        th->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+#endif
+
+        status = pj_thread_create(sched.pool, "clocksched",
+                                  &sched_thread_func, th, 0, 0,
+                                  &th->thread);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+    }
+
+    return PJ_SUCCESS;
+
+on_error:
+    /* The caller releases what has been created */
+    return status;
+}
+
+/* Assign the clock to the least loaded timing thread */
+static pj_status_t sched_add_clock(pjmedia_clock *clock)
+{
+    sched_thread *th = NULL;
+    unsigned i;
+    pj_status_t status;
+
+    pj_enter_critical_section();
+
+    /* Wait until the previous scheduler has been released */
+    while (sched.destroying) {
+        pj_leave_critical_section();
+        pj_thread_sleep(1);
+        pj_enter_critical_section();
+    }
+
+    if (sched.pool == NULL) {
+        status = sched_create();
+        if (status != PJ_SUCCESS)
+            goto on_error;
+    }
+
+    for (i = 0; i < PJ_ARRAY_SIZE(sched.th); ++i) {
+        if (!th || sched.th[i].clock_cnt < th->clock_cnt)
+            th = &sched.th[i];
+    }
+
+    pj_mutex_lock(th->mutex);
+    th->clock_cnt++;
+    pj_mutex_unlock(th->mutex);
+
+    clock->sched = th;
+    sched.ref_cnt++;
+
+    pj_leave_critical_section();
+    return PJ_SUCCESS;
+
+on_error:
+    /* Release what sched_create() has created */
+    sched_shutdown();
+    pj_leave_critical_section();
+    sched_release();
+    return status;
+}
+
+/* Release the clock from its timing thread */
+static void sched_remove_clock(pjmedia_clock *clock)
+{
+    sched_thread *th = clock->sched;
+
+    pj_enter_critical_section();
+
+    pj_mutex_lock(th->mutex);
+    th->clock_cnt--;
+    pj_mutex_unlock(th->mutex);
+
+    clock->sched = NULL;
+
+    /* The timing threads can't be joined from one of them, in that case
+     * the scheduler is kept, to be reused by the next clock or destroyed
+     * by pj_shutdown() (see sched_atexit()).
+     */
+    if (--sched.ref_cnt == 0 && !sched_is_timing_thread()) {
+        sched_shutdown();
+        pj_leave_critical_section();
+        sched_release();
+        return;
+    }
+
+    pj_leave_critical_section();
+}
+
+static pj_status_t sched_start(pjmedia_clock *clock)
+{
+    sched_thread *th = clock->sched;
+    pj_timestamp now;
+    pj_uint64_t phase;
+    pj_status_t status;
+
+    status = pj_get_timestamp(&now);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    pj_mutex_lock(th->mutex);
+
+    /* Spread the first ticks of the clocks over the interval (golden
+     * ratio sequence), so that clocks started together don't all fire
+     * in the same wakeup.
+     */
+    phase = (sched.phase_seq++ * 40503) & 0xFFFF;
+    clock->next_tick.u64 = now.u64 + clock->interval.u64 +
+                           ((clock->interval.u64 * phase) >> 16);
+    clock->quitting = PJ_FALSE;
+    clock->running = PJ_TRUE;
+
+    if (clock->heap_idx < 0 && th->cur != clock) {
+        heap_push(th, clock);
+        if (th->heap[0] == clock)
+            sched_wakeup(th);
+    }
+
+    pj_mutex_unlock(th->mutex);
+
+    return PJ_SUCCESS;
+}
+
+static pj_status_t sched_stop(pjmedia_clock *clock)
+{
+    sched_thread *th = clock->sched;
+    pj_status_t status = PJ_SUCCESS;
+
+    pj_mutex_lock(th->mutex);
+
+    clock->running = PJ_FALSE;
+    clock->quitting = PJ_TRUE;
+    if (clock->heap_idx >= 0)
+        heap_remove(th, clock);
+
+    /* Wait until the callback in progress has returned */
+    while (th->cur == clock) {
+        if (pj_thread_this() == th->thread) {
+            /* Stopped from its own callback */
+            status = PJ_EBUSY;
+            break;
+        }
+        pj_mutex_unlock(th->mutex);
+        pj_thread_sleep(1);
+        pj_mutex_lock(th->mutex);
+    }
+
+    pj_mutex_unlock(th->mutex);
+
+    return status;
+}
+
+
+/*
+ * Get the shared scheduler statistics.
+ */
+PJ_DEF(pj_status_t) pjmedia_clock_sched_get_stat(pjmedia_clock_sched_stat *stat,
+                                                 pj_bool_t reset)
+{
+    pj_uint64_t late_total = 0;
+    unsigned i;
+
+    PJ_ASSERT_RETURN(stat, PJ_EINVAL);
+
+    pj_bzero(stat, sizeof(*stat));
+
+    pj_enter_critical_section();
+
+    if (sched.pool) {
+        stat->thread_cnt = PJ_ARRAY_SIZE(sched.th);
+
+        for (i = 0; i < PJ_ARRAY_SIZE(sched.th); ++i) {
+            sched_thread *th = &sched.th[i];
+
+            pj_mutex_lock(th->mutex);
+            stat->clock_cnt += th->clock_cnt;
+            stat->tick_cnt += th->tick_cnt;
+            stat->overrun_cnt += th->overrun_cnt;
+            late_total += th->late_usec_total;
+            if (th->max_late_usec > stat->max_late_usec)
+                stat->max_late_usec = th->max_late_usec;
+            if (reset) {
+                th->tick_cnt = th->overrun_cnt = th->late_usec_total = 0;
+                th->max_late_usec = 0;
+            }
+            pj_mutex_unlock(th->mutex);
+        }
+
+        if (stat->tick_cnt)
+            stat->avg_late_usec = (unsigned)(late_total / stat->tick_cnt);
+    }
+
+    pj_leave_critical_section();
+
+    return PJ_SUCCESS;
+}
@@ -276,6 +276,23 @@ PJ_DEF(pj_status_t) pjmedia_conf_create( pj_pool_t *pool,
 }
 
 
+/*
+ * Create conference bridge with the specified settings. The switchboard
+ * does not mix, so the worker_threads setting is ignored.
+ */
+PJ_DEF(pj_status_t) pjmedia_conf_create2( pj_pool_t *pool,
+                                          const pjmedia_conf_param *param,
+                                          pjmedia_conf **p_conf )
+{
+    PJ_ASSERT_RETURN(pool && param && p_conf, PJ_EINVAL);
+
+    return pjmedia_conf_create(pool, param->max_slots, param->sampling_rate,
+                               param->channel_count, param->samples_per_frame,
+                               param->bits_per_sample, param->options,
+                               p_conf);
+}
+
+
 /*
  * Pause sound device.
  */
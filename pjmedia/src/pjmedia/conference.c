@@ -20,6 +20,7 @@
 #include <pjmedia/alaw_ulaw.h>
 #include <pjmedia/delaybuf.h>
 #include <pjmedia/errno.h>
+#include <pjmedia/mix.h>
 #include <pjmedia/port.h>
 #include <pjmedia/resample.h>
 #include <pjmedia/silencedet.h>
@@ -28,9 +29,24 @@
 #include <pj/array.h>
 #include <pj/assert.h>
 #include <pj/log.h>
+#include <pj/os.h>
 #include <pj/pool.h>
 #include <pj/string.h>
 
+
+/*
+ * Initialize conference bridge settings with default values.
+ */
+PJ_DEF(void) pjmedia_conf_param_default(pjmedia_conf_param *param)
+{
+    pj_bzero(param, sizeof(*param));
+    param->channel_count = 1;
+    param->bits_per_sample = 16;
+    param->worker_threads = PJMEDIA_CONF_THREADS;
+    param->active_speakers = PJMEDIA_CONF_ACTIVE_SPEAKERS;
+}
+
+
 #if !defined(PJMEDIA_CONF_USE_SWITCH_BOARD) || PJMEDIA_CONF_USE_SWITCH_BOARD==0
 
 /* CONF_DEBUG enables detailed operation of the conference bridge.
@@ -95,6 +111,15 @@ static FILE *fhnd_rec;
 #define IS_OVERFLOW(s) ((s > MAX_LEVEL) || (s < MIN_LEVEL))
 
 
+/* Phases of get_frame() when the bridge runs in parallel mode. */
+enum conf_phase
+{
+    PHASE_READ,         /* Reset mix buffer, read frame and rx level.   */
+    PHASE_MIX,          /* Mix the frames to the listeners.             */
+    PHASE_WRITE         /* Write the mixed frames to the ports.         */
+};
+
+
 /*
  * DON'T GET CONFUSED WITH TX/RX!!
  *
@@ -221,6 +246,39 @@ struct conf_port
      * Burst and drift are handled by delay buffer.
      */
     pjmedia_delay_buf   *delay_buf;
+
+    /* In parallel and active speaker modes, the frames of all ports are
+     * read before the mixing starts, so each port needs its own buffer to
+     * hold the frame between the read and mix phases. This is NULL in
+     * serial mode.
+     */
+    pj_int16_t          *rx_frame_buf;  /**< Frame read from the port.      */
+    pj_bool_t            rx_frame_ok;   /**< rx_frame_buf contains audio.   */
+
+    /* Active speaker mode, recalculated on every frame. Bit N of the masks
+     * corresponds to the N-th entry of the bridge's talker list.
+     */
+    int                  spk_idx;       /**< Index in talker list, or -1.   */
+    pj_uint32_t          spk_mask;      /**< Talkers transmitting to us.    */
+    pj_uint32_t          spk_adj_mask;  /**< Talkers with conn level adj.   */
+    unsigned            *spk_adj_level; /**< Conn level of each talker.     */
+};
+
+
+/*
+ * Worker of the parallel and active speaker modes. Worker zero is the
+ * clock thread itself, the other workers have their own threads. On each
+ * phase, worker N processes the slots whose index modulo the number of
+ * workers is N, so the split is deterministic and every mix buffer is
+ * written by exactly one worker.
+ */
+struct conf_worker
+{
+    pjmedia_conf        *conf;          /**< The bridge.                    */
+    unsigned             idx;           /**< Worker index.                  */
+    pj_thread_t         *thread;        /**< Thread, NULL for worker zero.  */
+    pj_sem_t            *start_sem;     /**< Posted to start a phase.       */
+    pj_int16_t          *adj_level_buf; /**< Connection level scratch buf.  */
 };
 
 
@@ -242,6 +300,23 @@ struct pjmedia_conf
     unsigned              channel_count;/**< Number of channels (1=mono).   */
     unsigned              samples_per_frame;    /**< Samples per frame.     */
     unsigned              bits_per_sample;      /**< Bits per sample.       */
+
+    /* Parallel mode, see pjmedia_conf_param.worker_threads. */
+    unsigned              worker_cnt;   /**< Number of workers (incl clock).*/
+    struct conf_worker   *workers;      /**< Array of workers.              */
+    pj_sem_t             *done_sem;     /**< Posted when a worker is done.  */
+    enum conf_phase       phase;        /**< Phase being run by workers.    */
+    pj_bool_t             quit;         /**< Signal workers to quit.        */
+    const pj_timestamp   *timestamp;    /**< Timestamp of current frame.    */
+    pjmedia_frame_type    speaker_frame_type; /**< Port zero frame type.    */
+
+    /* Active speaker mode, see pjmedia_conf_param.active_speakers. */
+    unsigned              max_spk;      /**< Max talkers, zero to disable.  */
+    unsigned              spk_cnt;      /**< Talkers in current frame.      */
+    unsigned             *spk_slots;    /**< Talkers, loudest first.        */
+    pj_int32_t           *spk_mix_buf;  /**< Sum of all talkers.            */
+    pj_int32_t            spk_mix_min;  /**< Minimum value in spk_mix_buf.  */
+    pj_int32_t            spk_mix_max;  /**< Maximum value in spk_mix_buf.  */
 };
 
 
@@ -422,6 +497,23 @@ static pj_status_t create_conf_port( pj_pool_t *pool,
     PJ_ASSERT_RETURN(conf_port->mix_buf, PJ_ENOMEM);
     conf_port->last_mix_adj = NORMAL_LEVEL;
 
+    /* Create frame buffer for parallel and active speaker modes. */
+    if (conf->worker_cnt > 1 || conf->max_spk) {
+        conf_port->rx_frame_buf = (pj_int16_t*)
+                                  pj_pool_zalloc(pool, conf->samples_per_frame *
+                                                       sizeof(pj_int16_t));
+        PJ_ASSERT_RETURN(conf_port->rx_frame_buf, PJ_ENOMEM);
+    }
+
+    /* Create connection level array for active speaker mode. */
+    conf_port->spk_idx = -1;
+    if (conf->max_spk) {
+        conf_port->spk_adj_level = (unsigned*)
+                                   pj_pool_zalloc(pool, conf->max_spk *
+                                                        sizeof(unsigned));
+        PJ_ASSERT_RETURN(conf_port->spk_adj_level, PJ_ENOMEM);
+    }
+
 
     /* Done */
     *p_conf_port = conf_port;
@@ -535,6 +627,113 @@ static pj_status_t create_sound_port( pj_pool_t *pool,
     return PJ_SUCCESS;
 }
 
+/*
+ * Worker thread of the parallel mode.
+ */
+static void run_phase(struct conf_worker *worker);
+
+static int worker_thread(void *arg)
+{
+    struct conf_worker *worker = (struct conf_worker*) arg;
+    pjmedia_conf *conf = worker->conf;
+
+    for (;;) {
+        pj_sem_wait(worker->start_sem);
+        if (conf->quit)
+            break;
+
+        run_phase(worker);
+
+        pj_sem_post(conf->done_sem);
+    }
+
+    return 0;
+}
+
+/*
+ * Create the workers of the parallel mode.
+ */
+static pj_status_t create_workers( pj_pool_t *pool,
+                                   pjmedia_conf *conf )
+{
+    unsigned i;
+    pj_status_t status;
+
+    conf->workers = (struct conf_worker*)
+                    pj_pool_zalloc(pool, conf->worker_cnt *
+                                         sizeof(struct conf_worker));
+    PJ_ASSERT_RETURN(conf->workers, PJ_ENOMEM);
+
+    status = pj_sem_create(pool, "conf_done", 0, conf->worker_cnt,
+                           &conf->done_sem);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    for (i = 0; i < conf->worker_cnt; ++i) {
+        struct conf_worker *worker = &conf->workers[i];
+
+        worker->conf = conf;
+        worker->idx = i;
+        worker->adj_level_buf = (pj_int16_t*)
+                                pj_pool_zalloc(pool, conf->samples_per_frame *
+                                                     sizeof(pj_int16_t));
+        PJ_ASSERT_RETURN(worker->adj_level_buf, PJ_ENOMEM);
+
+        /* Worker zero is the clock thread */
+        if (i == 0)
+            continue;
+
+        status = pj_sem_create(pool, "conf_wrk", 0, 1, &worker->start_sem);
+        if (status != PJ_SUCCESS)
+            return status;
+
+        status = pj_thread_create(pool, "conf_wrk%p", &worker_thread,
+                                  worker, 0, 0, &worker->thread);
+        if (status != PJ_SUCCESS)
+            return status;
+    }
+
+    PJ_LOG(5,(THIS_FILE, "Conference bridge uses %d threads",
+              conf->worker_cnt));
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Stop and destroy the workers of the parallel mode.
+ */
+static void destroy_workers( pjmedia_conf *conf )
+{
+    unsigned i;
+
+    if (!conf->workers)
+        return;
+
+    conf->quit = PJ_TRUE;
+
+    for (i = 1; i < conf->worker_cnt; ++i) {
+        struct conf_worker *worker = &conf->workers[i];
+
+        if (worker->thread) {
+            pj_sem_post(worker->start_sem);
+            pj_thread_join(worker->thread);
+            pj_thread_destroy(worker->thread);
+            worker->thread = NULL;
+        }
+        if (worker->start_sem) {
+            pj_sem_destroy(worker->start_sem);
+            worker->start_sem = NULL;
+        }
+    }
+
+    if (conf->done_sem) {
+        pj_sem_destroy(conf->done_sem);
+        conf->done_sem = NULL;
+    }
+
+    conf->workers = NULL;
+}
+
 /*
  * Create conference bridge.
  */
@@ -546,32 +745,75 @@ PJ_DEF(pj_status_t) pjmedia_conf_create( pj_pool_t *pool,
                                          unsigned bits_per_sample,
                                          unsigned options,
                                          pjmedia_conf **p_conf )
+{
+    pjmedia_conf_param param;
+
+    pjmedia_conf_param_default(&param);
+    param.max_slots = max_ports;
+    param.sampling_rate = clock_rate;
+    param.channel_count = channel_count;
+    param.samples_per_frame = samples_per_frame;
+    param.bits_per_sample = bits_per_sample;
+    param.options = options;
+
+    return pjmedia_conf_create2(pool, &param, p_conf);
+}
+
+/*
+ * Create conference bridge with the specified settings.
+ */
+PJ_DEF(pj_status_t) pjmedia_conf_create2( pj_pool_t *pool,
+                                          const pjmedia_conf_param *param,
+                                          pjmedia_conf **p_conf )
 {
     pjmedia_conf *conf;
     const pj_str_t name = { "Conf", 4 };
     pj_status_t status;
 
-    PJ_ASSERT_RETURN(samples_per_frame > 0, PJ_EINVAL);
+    PJ_ASSERT_RETURN(pool && param && p_conf, PJ_EINVAL);
+    PJ_ASSERT_RETURN(param->samples_per_frame > 0, PJ_EINVAL);
     /* Can only accept 16bits per sample, for now.. */
-    PJ_ASSERT_RETURN(bits_per_sample == 16, PJ_EINVAL);
+    PJ_ASSERT_RETURN(param->bits_per_sample == 16, PJ_EINVAL);
+    /* Talkers are tracked in 32bit masks */
+    PJ_ASSERT_RETURN(param->active_speakers <= 32, PJ_EINVAL);
 
     PJ_LOG(5,(THIS_FILE, "Creating conference bridge with %d ports",
-              max_ports));
+              param->max_slots));
 
     /* Create and init conf structure. */
     conf = PJ_POOL_ZALLOC_T(pool, pjmedia_conf);
     PJ_ASSERT_RETURN(conf, PJ_ENOMEM);
 
     conf->ports = (struct conf_port**) 
-                  pj_pool_zalloc(pool, max_ports*sizeof(void*));
+                  pj_pool_zalloc(pool, param->max_slots*sizeof(void*));
     PJ_ASSERT_RETURN(conf->ports, PJ_ENOMEM);
 
-    conf->options = options;
-    conf->max_ports = max_ports;
-    conf->clock_rate = clock_rate;
-    conf->channel_count = channel_count;
-    conf->samples_per_frame = samples_per_frame;
-    conf->bits_per_sample = bits_per_sample;
+    conf->options = param->options;
+    conf->max_ports = param->max_slots;
+    conf->clock_rate = param->sampling_rate;
+    conf->channel_count = param->channel_count;
+    conf->samples_per_frame = param->samples_per_frame;
+    conf->bits_per_sample = param->bits_per_sample;
+
+#if PJ_HAS_THREADS
+    /* No point having more workers than slots. */
+    conf->worker_cnt = PJ_MIN(param->worker_threads, conf->max_ports);
+#endif
+    if (conf->worker_cnt == 0)
+        conf->worker_cnt = 1;
+
+    conf->max_spk = param->active_speakers;
+    if (conf->max_spk) {
+        conf->spk_slots = (unsigned*)
+                          pj_pool_zalloc(pool, conf->max_spk *
+                                               sizeof(unsigned));
+        PJ_ASSERT_RETURN(conf->spk_slots, PJ_ENOMEM);
+
+        conf->spk_mix_buf = (pj_int32_t*)
+                            pj_pool_zalloc(pool, conf->samples_per_frame *
+                                                 sizeof(pj_int32_t));
+        PJ_ASSERT_RETURN(conf->spk_mix_buf, PJ_ENOMEM);
+    }
 
     
     /* Create and initialize the master port interface. */
@@ -579,8 +821,8 @@ PJ_DEF(pj_status_t) pjmedia_conf_create( pj_pool_t *pool,
     PJ_ASSERT_RETURN(conf->master_port, PJ_ENOMEM);
     
     pjmedia_port_info_init(&conf->master_port->info, &name, SIGNATURE,
-                           clock_rate, channel_count, bits_per_sample,
-                           samples_per_frame);
+                           conf->clock_rate, conf->channel_count,
+                           conf->bits_per_sample, conf->samples_per_frame);
 
     conf->master_port->port_data.pdata = conf;
     conf->master_port->port_data.ldata = 0;
@@ -604,6 +846,17 @@ PJ_DEF(pj_status_t) pjmedia_conf_create( pj_pool_t *pool,
         return status;
     }
 
+    /* Create workers for parallel and active speaker modes. In active
+     * speaker mode with a single thread, only worker zero is created.
+     */
+    if (conf->worker_cnt > 1 || conf->max_spk) {
+        status = create_workers(pool, conf);
+        if (status != PJ_SUCCESS) {
+            pjmedia_conf_destroy(conf);
+            return status;
+        }
+    }
+
     /* If sound device was created, connect sound device to the
      * master port.
      */
@@ -661,6 +914,9 @@ PJ_DEF(pj_status_t) pjmedia_conf_destroy( pjmedia_conf *conf )
         conf->snd_dev_port = NULL;
     }
 
+    /* Stop worker threads. */
+    destroy_workers(conf);
+
     /* Destroy delay buf of all (passive) ports. */
     for (i=0, ci=0; i<conf->max_ports && ci<conf->port_cnt; ++i) {
         struct conf_port *cport;
@@ -1710,7 +1966,7 @@ static pj_status_t write_port(pjmedia_conf *conf, struct conf_port *cport,
                               pjmedia_frame_type *frm_type)
 {
     pj_int16_t *buf;
-    unsigned j, ts;
+    unsigned ts;
     pj_status_t status;
     pj_int32_t adj_level;
     pj_int32_t tx_level;
@@ -1796,31 +2052,11 @@ static pj_status_t write_port(pjmedia_conf *conf, struct conf_port *cport,
     adj_level = cport->tx_adj_level * cport->mix_adj;
     adj_level >>= 7;
 
-    tx_level = 0;
-
-    if (adj_level != NORMAL_LEVEL) {
-        for (j=0; j<conf->samples_per_frame; ++j) {
-            pj_int32_t itemp = cport->mix_buf[j];
-
-            /* Adjust the level */
-            /*itemp = itemp * adj_level / NORMAL_LEVEL;*/
-            itemp = (itemp * adj_level) >> 7;
-
-            /* Clip the signal if it's too loud */
-            if (itemp > MAX_LEVEL) itemp = MAX_LEVEL;
-            else if (itemp < MIN_LEVEL) itemp = MIN_LEVEL;
-
-            /* Put back in the buffer. */
-            buf[j] = (pj_int16_t) itemp;
-
-            tx_level += (buf[j]>=0? buf[j] : -buf[j]);
-        }
-    } else {
-        for (j=0; j<conf->samples_per_frame; ++j) {
-            buf[j] = (pj_int16_t) cport->mix_buf[j];
-            tx_level += (buf[j]>=0? buf[j] : -buf[j]);
-        }
-    }
+    /* Adjust the level, clip the signal if it's too loud, and put it
+     * back in the buffer.
+     */
+    tx_level = pjmedia_mix_to_samples(buf, cport->mix_buf,
+                                      conf->samples_per_frame, adj_level);
 
     tx_level /= conf->samples_per_frame;
 
@@ -1944,264 +2180,532 @@ static pj_status_t write_port(pjmedia_conf *conf, struct conf_port *cport,
 
 
 /*
- * Player callback.
+ * Reset the mix buffer of the port before mixing.
  */
-static pj_status_t get_frame(pjmedia_port *this_port, 
-                             pjmedia_frame *frame)
+static void reset_mix_buf(pjmedia_conf *conf, struct conf_port *conf_port)
 {
-    pjmedia_conf *conf = (pjmedia_conf*) this_port->port_data.pdata;
-    pjmedia_frame_type speaker_frame_type = PJMEDIA_FRAME_TYPE_NONE;
-    unsigned ci, cj, i, j;
-    pj_int16_t *p_in;
-    
-    TRACE_((THIS_FILE, "- clock -"));
+    /* Reset active speaker state */
+    conf_port->spk_idx = -1;
+    conf_port->spk_mask = 0;
+    conf_port->spk_adj_mask = 0;
 
-    /* Check that correct size is specified. */
-    pj_assert(frame->size == conf->samples_per_frame *
-                             conf->bits_per_sample / 8);
-
-    /* Must lock mutex */
-    pj_mutex_lock(conf->mutex);
+    /* Skip if we're not allowed to transmit to this port. */
+    if (conf_port->tx_setting != PJMEDIA_PORT_ENABLE)
+        return;
 
-    /* Reset port source count. We will only reset port's mix
-     * buffer when we have someone transmitting to it.
+    /* Reset buffer (only necessary if the port has transmitter) and
+     * reset auto adjustment level for mixed signal.
      */
-    for (i=0, ci=0; i<conf->max_ports && ci < conf->port_cnt; ++i) {
-        struct conf_port *conf_port = conf->ports[i];
+    conf_port->mix_adj = NORMAL_LEVEL;
+    if (conf_port->transmitter_cnt) {
+        pj_bzero(conf_port->mix_buf,
+                 conf->samples_per_frame*sizeof(conf_port->mix_buf[0]));
+    }
+}
 
-        /* Skip empty port. */
-        if (!conf_port)
-            continue;
 
-        /* Var "ci" is to count how many ports have been visited so far. */
-        ++ci;
+/*
+ * Get frame from the port in the specified slot, adjust the RX level and
+ * calculate the RX level of the port. Returns PJ_FALSE if there is no
+ * audio to be mixed from this port.
+ */
+static pj_bool_t get_port_frame(pjmedia_conf *conf, unsigned slot,
+                                pj_int16_t *p_in)
+{
+    struct conf_port *conf_port = conf->ports[slot];
+    pj_int32_t level;
 
-        /* Skip if we're not allowed to transmit to this port. */
-        if (conf_port->tx_setting != PJMEDIA_PORT_ENABLE)
-            continue;
+    /* Skip if we're not allowed to receive from this port. */
+    if (conf_port->rx_setting == PJMEDIA_PORT_DISABLE) {
+        conf_port->rx_level = 0;
+        return PJ_FALSE;
+    }
 
-        /* Reset buffer (only necessary if the port has transmitter) and
-         * reset auto adjustment level for mixed signal.
-         */
-        conf_port->mix_adj = NORMAL_LEVEL;
-        if (conf_port->transmitter_cnt) {
-            pj_bzero(conf_port->mix_buf,
-                     conf->samples_per_frame*sizeof(conf_port->mix_buf[0]));
-        }
+    /* Also skip if this port doesn't have listeners. */
+    if (conf_port->listener_cnt == 0) {
+        conf_port->rx_level = 0;
+        return PJ_FALSE;
     }
 
-    /* Get frames from all ports, and "mix" the signal 
-     * to mix_buf of all listeners of the port.
+    /* Get frame from this port.
+     * For passive ports, get the frame from the delay_buf.
+     * For other ports, get the frame from the port. 
      */
-    for (i=0, ci=0; i < conf->max_ports && ci < conf->port_cnt; ++i) {
-        struct conf_port *conf_port = conf->ports[i];
-        pj_int32_t level = 0;
+    if (conf_port->delay_buf != NULL) {
+        pj_status_t status;
+    
+        status = pjmedia_delay_buf_get(conf_port->delay_buf, p_in);
+        if (status != PJ_SUCCESS) {
+            conf_port->rx_level = 0;
+            return PJ_FALSE;
+        }           
 
-        /* Skip empty port. */
-        if (!conf_port)
-            continue;
+    } else {
 
-        /* Var "ci" is to count how many ports have been visited so far. */
-        ++ci;
+        pj_status_t status;
+        pjmedia_frame_type frame_type;
 
-        /* Skip if we're not allowed to receive from this port. */
-        if (conf_port->rx_setting == PJMEDIA_PORT_DISABLE) {
+        status = read_port(conf, conf_port, p_in, 
+                           conf->samples_per_frame, &frame_type);
+        
+        if (status != PJ_SUCCESS) {
+            /* bennylp: why do we need this????
+             * Also see comments on similar issue with write_port().
+            PJ_LOG(4,(THIS_FILE, "Port %.*s get_frame() returned %d. "
+                                 "Port is now disabled",
+                                 (int)conf_port->name.slen,
+                                 conf_port->name.ptr,
+                                 status));
+            conf_port->rx_setting = PJMEDIA_PORT_DISABLE;
+             */
             conf_port->rx_level = 0;
-            continue;
+            return PJ_FALSE;
         }
 
-        /* Also skip if this port doesn't have listeners. */
-        if (conf_port->listener_cnt == 0) {
+        /* Check that the port is not removed when we call get_frame() */
+        if (conf->ports[slot] == NULL) {
             conf_port->rx_level = 0;
-            continue;
+            return PJ_FALSE;
         }
+            
+
+        /* Ignore if we didn't get any frame */
+        if (frame_type != PJMEDIA_FRAME_TYPE_AUDIO) {
+            conf_port->rx_level = 0;
+            return PJ_FALSE;
+        }           
+    }
+
+    /* Adjust the RX level from this port
+     * and calculate the average level at the same time.
+     */
+    if (conf_port->rx_adj_level != NORMAL_LEVEL) {
+        level = pjmedia_mix_adjust_samples(p_in, p_in,
+                                           conf->samples_per_frame,
+                                           conf_port->rx_adj_level);
+    } else {
+        level = pjmedia_mix_sum_abs(p_in, conf->samples_per_frame);
+    }
+
+    level /= conf->samples_per_frame;
+
+    /* Convert level to 8bit complement ulaw */
+    level = pjmedia_linear2ulaw(level) ^ 0xff;
 
-        /* Get frame from this port.
-         * For passive ports, get the frame from the delay_buf.
-         * For other ports, get the frame from the port. 
+    /* Put this level to port's last RX level. */
+    conf_port->rx_level = level;
+
+    // Ticket #671: Skipping very low audio signal may cause noise 
+    // to be generated in the remote end by some hardphones.
+    /* Skip processing frame if level is zero */
+    //if (level == 0)
+    //    return PJ_FALSE;
+
+    return PJ_TRUE;
+}
+
+
+/*
+ * Calculate appropriate level adjustment if there is any overflowed level
+ * in the mixed signal.
+ */
+static void update_mix_adj(struct conf_port *listener,
+                           pj_int32_t mix_buf_min, pj_int32_t mix_buf_max)
+{
+    /* Check if normalization adjustment needed. */
+    if (mix_buf_min < MIN_LEVEL || mix_buf_max > MAX_LEVEL) {
+        int tmp_adj;
+
+        if (-mix_buf_min > mix_buf_max)
+            mix_buf_max = -mix_buf_min;
+
+        /* NORMAL_LEVEL * MAX_LEVEL / mix_buf_max; */
+        tmp_adj = (MAX_LEVEL<<7) / mix_buf_max;
+        if (tmp_adj < listener->mix_adj)
+            listener->mix_adj = tmp_adj;
+    }
+}
+
+
+/*
+ * Add the frame from a port to the mix buffer of one of its listeners.
+ * The adj_level_buf is a scratch buffer for applying connection level.
+ */
+static void mix_to_listener(pjmedia_conf *conf, struct conf_port *conf_port,
+                            unsigned cj, const pj_int16_t *p_in,
+                            pj_int16_t *adj_level_buf)
+{
+    struct conf_port *listener;
+    pj_int32_t *mix_buf;            
+    const pj_int16_t *p_in_conn_leveled;
+
+    listener = conf->ports[conf_port->listener_slots[cj]];
+
+    /* Skip if this listener doesn't want to receive audio */
+    if (listener->tx_setting != PJMEDIA_PORT_ENABLE)
+        return;
+
+    mix_buf = listener->mix_buf;
+
+    /* apply connection level, if not normal */
+    if (conf_port->listener_adj_level[cj] != NORMAL_LEVEL) {
+        pjmedia_mix_adjust_samples(adj_level_buf, p_in,
+                                   conf->samples_per_frame,
+                                   conf_port->listener_adj_level[cj]);
+
+        /* take the leveled frame */
+        p_in_conn_leveled = adj_level_buf;
+    } else {
+        /* take the frame as-is */
+        p_in_conn_leveled = p_in;
+    }
+
+    if (listener->transmitter_cnt > 1) {
+        /* Mixing signals,
+         * and calculate appropriate level adjustment if there is
+         * any overflowed level in the mixed signal.
          */
-        if (conf_port->delay_buf != NULL) {
-            pj_status_t status;
-        
-            status = pjmedia_delay_buf_get(conf_port->delay_buf,
-                                  (pj_int16_t*)frame->buf);
-            if (status != PJ_SUCCESS) {
-                conf_port->rx_level = 0;
-                continue;
-            }           
+        pj_int32_t mix_buf_min;
+        pj_int32_t mix_buf_max;
 
-        } else {
+        pjmedia_mix_add_samples(mix_buf, p_in_conn_leveled,
+                                conf->samples_per_frame,
+                                &mix_buf_min, &mix_buf_max);
 
-            pj_status_t status;
-            pjmedia_frame_type frame_type;
+        update_mix_adj(listener, mix_buf_min, mix_buf_max);
+    } else {
+        /* Only 1 transmitter:
+         * just copy the samples to the mix buffer
+         * no mixing and level adjustment needed
+         */
+        pjmedia_mix_copy_samples(mix_buf, p_in_conn_leveled,
+                                 conf->samples_per_frame);
+    }
+}
 
-            status = read_port(conf, conf_port, (pj_int16_t*)frame->buf, 
-                               conf->samples_per_frame, &frame_type);
-            
-            if (status != PJ_SUCCESS) {
-                /* bennylp: why do we need this????
-                 * Also see comments on similar issue with write_port().
-                PJ_LOG(4,(THIS_FILE, "Port %.*s get_frame() returned %d. "
-                                     "Port is now disabled",
-                                     (int)conf_port->name.slen,
-                                     conf_port->name.ptr,
-                                     status));
-                conf_port->rx_setting = PJMEDIA_PORT_DISABLE;
-                 */
-                conf_port->rx_level = 0;
-                continue;
-            }
 
-            /* Check that the port is not removed when we call get_frame() */
-            if (conf->ports[i] == NULL) {
-                conf_port->rx_level = 0;
-                continue;
-            }
-                
+/*
+ * Active speaker mode: select the loudest ports among those with audio in
+ * this frame, build the sum of their frames, and mark the listeners of
+ * each of them. Must be called after all frames have been read.
+ */
+static void select_speakers(pjmedia_conf *conf)
+{
+    pj_int32_t mix_min = 0, mix_max = 0;
+    unsigned i, k, cnt = 0;
 
-            /* Ignore if we didn't get any frame */
-            if (frame_type != PJMEDIA_FRAME_TYPE_AUDIO) {
-                conf_port->rx_level = 0;
-                continue;
-            }           
+    for (i = 0; i < conf->max_ports; ++i) {
+        struct conf_port *conf_port = conf->ports[i];
+
+        /* Skip ports without audio, and silent ports */
+        if (!conf_port || !conf_port->rx_frame_ok || !conf_port->rx_level)
+            continue;
+
+        /* Insertion into the list which is sorted by level. On equal
+         * levels, the port with the lower slot number wins.
+         */
+        for (k = cnt; k > 0; --k) {
+            struct conf_port *other = conf->ports[conf->spk_slots[k-1]];
+
+            if (other->rx_level >= conf_port->rx_level)
+                break;
+            if (k < conf->max_spk)
+                conf->spk_slots[k] = conf->spk_slots[k-1];
+        }
+        if (k < conf->max_spk) {
+            conf->spk_slots[k] = i;
+            if (cnt < conf->max_spk)
+                ++cnt;
         }
+    }
+
+    conf->spk_cnt = cnt;
+    if (cnt == 0)
+        return;
 
-        p_in = (pj_int16_t*) frame->buf;
+    pj_bzero(conf->spk_mix_buf,
+             conf->samples_per_frame * sizeof(conf->spk_mix_buf[0]));
 
-        /* Adjust the RX level from this port
-         * and calculate the average level at the same time.
+    for (k = 0; k < cnt; ++k) {
+        struct conf_port *talker = conf->ports[conf->spk_slots[k]];
+        pj_uint32_t bit = (pj_uint32_t)1 << k;
+        unsigned cj;
+
+        talker->spk_idx = k;
+
+        /* The minimum and maximum after the last addition are those of
+         * the total sum.
          */
-        if (conf_port->rx_adj_level != NORMAL_LEVEL) {
-            for (j=0; j<conf->samples_per_frame; ++j) {
-                /* For the level adjustment, we need to store the sample to
-                 * a temporary 32bit integer value to avoid overflowing the
-                 * 16bit sample storage.
-                 */
-                pj_int32_t itemp;
-
-                itemp = p_in[j];
-                /*itemp = itemp * adj / NORMAL_LEVEL;*/
-                /* bad code (signed/unsigned badness):
-                 *  itemp = (itemp * conf_port->rx_adj_level) >> 7;
-                 */
-                itemp *= conf_port->rx_adj_level;
-                itemp >>= 7;
-
-                /* Clip the signal if it's too loud */
-                if (itemp > MAX_LEVEL) itemp = MAX_LEVEL;
-                else if (itemp < MIN_LEVEL) itemp = MIN_LEVEL;
-
-                p_in[j] = (pj_int16_t) itemp;
-                level += (p_in[j]>=0? p_in[j] : -p_in[j]);
-            }
-        } else {
-            for (j=0; j<conf->samples_per_frame; ++j) {
-                level += (p_in[j]>=0? p_in[j] : -p_in[j]);
+        pjmedia_mix_add_samples(conf->spk_mix_buf, talker->rx_frame_buf,
+                                conf->samples_per_frame,
+                                &mix_min, &mix_max);
+
+        for (cj = 0; cj < talker->listener_cnt; ++cj) {
+            struct conf_port *listener;
+
+            listener = conf->ports[talker->listener_slots[cj]];
+            listener->spk_mask |= bit;
+            if (talker->listener_adj_level[cj] != NORMAL_LEVEL) {
+                listener->spk_adj_mask |= bit;
+                listener->spk_adj_level[k] = talker->listener_adj_level[cj];
             }
         }
+    }
 
-        level /= conf->samples_per_frame;
+    conf->spk_mix_min = mix_min;
+    conf->spk_mix_max = mix_max;
+}
 
-        /* Convert level to 8bit complement ulaw */
-        level = pjmedia_linear2ulaw(level) ^ 0xff;
 
-        /* Put this level to port's last RX level. */
-        conf_port->rx_level = level;
+/*
+ * Active speaker mode: mix the talkers to the listener. A listener which
+ * receives all talkers at normal level gets the shared sum, or the shared
+ * sum minus its own signal if it is one of the talkers. Otherwise the
+ * talkers are mixed individually.
+ *
+ * In all three cases the mix_adj is calculated from the minimum and the
+ * maximum of the listener's own sum. mix_to_listener() also checks the
+ * partial sums after each addition, so when the sum overflows the output
+ * of the normal mode may be softer than in this mode.
+ */
+static void mix_speakers(pjmedia_conf *conf, struct conf_port *listener,
+                         pj_int16_t *adj_level_buf)
+{
+    pj_uint32_t all_mask;
+    pj_int32_t mix_buf_min, mix_buf_max;
+
+    /* Skip if this listener doesn't want to receive audio, or none of
+     * the talkers is transmitting to it.
+     */
+    if (listener->tx_setting != PJMEDIA_PORT_ENABLE || !listener->spk_mask)
+        return;
+
+    all_mask = (conf->spk_cnt == 32) ? 0xFFFFFFFF :
+               (((pj_uint32_t)1 << conf->spk_cnt) - 1);
+
+    if (listener->spk_adj_mask == 0 && listener->spk_mask == all_mask) {
+        /* Listening to all talkers */
+        pj_memcpy(listener->mix_buf, conf->spk_mix_buf,
+                  conf->samples_per_frame * sizeof(listener->mix_buf[0]));
+        mix_buf_min = conf->spk_mix_min;
+        mix_buf_max = conf->spk_mix_max;
+
+    } else if (listener->spk_adj_mask == 0 && listener->spk_idx >= 0 &&
+               listener->spk_mask ==
+                    (all_mask & ~((pj_uint32_t)1 << listener->spk_idx)))
+    {
+        /* Listening to all talkers but itself */
+        pjmedia_mix_sub_samples(listener->mix_buf, conf->spk_mix_buf,
+                                listener->rx_frame_buf,
+                                conf->samples_per_frame,
+                                &mix_buf_min, &mix_buf_max);
 
-        // Ticket #671: Skipping very low audio signal may cause noise 
-        // to be generated in the remote end by some hardphones.
-        /* Skip processing frame if level is zero */
-        //if (level == 0)
-        //    continue;
+    } else {
+        unsigned k;
 
-        /* Add the signal to all listeners. */
-        for (cj=0; cj < conf_port->listener_cnt; ++cj) 
-        {
-            struct conf_port *listener;
-            pj_int32_t *mix_buf;            
-            pj_int16_t *p_in_conn_leveled;
+        mix_buf_min = mix_buf_max = 0;
 
-            listener = conf->ports[conf_port->listener_slots[cj]];
+        for (k = 0; k < conf->spk_cnt; ++k) {
+            pj_uint32_t bit = (pj_uint32_t)1 << k;
+            const pj_int16_t *p_in;
 
-            /* Skip if this listener doesn't want to receive audio */
-            if (listener->tx_setting != PJMEDIA_PORT_ENABLE)
+            if ((listener->spk_mask & bit) == 0)
                 continue;
 
-            mix_buf = listener->mix_buf;
+            p_in = conf->ports[conf->spk_slots[k]]->rx_frame_buf;
 
             /* apply connection level, if not normal */
-            if (conf_port->listener_adj_level[cj] != NORMAL_LEVEL) {
-                unsigned k = 0;
-                for (; k < conf->samples_per_frame; ++k) {
-                    /* For the level adjustment, we need to store the sample to
-                     * a temporary 32bit integer value to avoid overflowing the
-                     * 16bit sample storage.
-                     */
-                    pj_int32_t itemp;
-
-                    itemp = p_in[k];
-                    /*itemp = itemp * adj / NORMAL_LEVEL;*/
-                    /* bad code (signed/unsigned badness):
-                     *  itemp = (itemp * conf_port->listsener_adj_level) >> 7;
-                     */
-                    itemp *= conf_port->listener_adj_level[cj];
-                    itemp >>= 7;
-
-                    /* Clip the signal if it's too loud */
-                    if (itemp > MAX_LEVEL) itemp = MAX_LEVEL;
-                    else if (itemp < MIN_LEVEL) itemp = MIN_LEVEL;
-
-                    conf_port->adj_level_buf[k] = (pj_int16_t)itemp;
-                }
-
-                /* take the leveled frame */
-                p_in_conn_leveled = conf_port->adj_level_buf;
-            } else {
-                /* take the frame as-is */
-                p_in_conn_leveled = p_in;
+            if (listener->spk_adj_mask & bit) {
+                pjmedia_mix_adjust_samples(adj_level_buf, p_in,
+                                           conf->samples_per_frame,
+                                           listener->spk_adj_level[k]);
+                p_in = adj_level_buf;
             }
 
-            if (listener->transmitter_cnt > 1) {
-                /* Mixing signals,
-                 * and calculate appropriate level adjustment if there is
-                 * any overflowed level in the mixed signal.
-                 */
-                unsigned k, samples_per_frame = conf->samples_per_frame;
-                pj_int32_t mix_buf_min = 0;
-                pj_int32_t mix_buf_max = 0;
-
-                for (k = 0; k < samples_per_frame; ++k) {
-                    mix_buf[k] += p_in_conn_leveled[k];
-                    if (mix_buf[k] < mix_buf_min)
-                        mix_buf_min = mix_buf[k];
-                    if (mix_buf[k] > mix_buf_max)
-                        mix_buf_max = mix_buf[k];
-                }
+            /* The minimum and maximum after the last addition are those
+             * of the listener's sum.
+             */
+            pjmedia_mix_add_samples(listener->mix_buf, p_in,
+                                    conf->samples_per_frame,
+                                    &mix_buf_min, &mix_buf_max);
+        }
+    }
+
+    update_mix_adj(listener, mix_buf_min, mix_buf_max);
+}
+
+
+/*
+ * Run the current phase for the slots belonging to the worker.
+ */
+static void run_phase(struct conf_worker *worker)
+{
+    pjmedia_conf *conf = worker->conf;
+    unsigned i, cj;
 
-                /* Check if normalization adjustment needed. */
-                if (mix_buf_min < MIN_LEVEL || mix_buf_max > MAX_LEVEL) {
-                    int tmp_adj;
+    switch (conf->phase) {
+    case PHASE_READ:
+        for (i = worker->idx; i < conf->max_ports; i += conf->worker_cnt) {
+            struct conf_port *conf_port = conf->ports[i];
 
-                    if (-mix_buf_min > mix_buf_max)
-                        mix_buf_max = -mix_buf_min;
+            if (!conf_port)
+                continue;
 
-                    /* NORMAL_LEVEL * MAX_LEVEL / mix_buf_max; */
-                    tmp_adj = (MAX_LEVEL<<7) / mix_buf_max;
-                    if (tmp_adj < listener->mix_adj)
-                        listener->mix_adj = tmp_adj;
+            reset_mix_buf(conf, conf_port);
+            conf_port->rx_frame_ok = get_port_frame(conf, i,
+                                                    conf_port->rx_frame_buf);
+        }
+        break;
+
+    case PHASE_MIX:
+        if (conf->max_spk) {
+            for (i = worker->idx; i < conf->max_ports; i += conf->worker_cnt)
+            {
+                if (conf->ports[i]) {
+                    mix_speakers(conf, conf->ports[i],
+                                 worker->adj_level_buf);
                 }
-            } else {
-                /* Only 1 transmitter:
-                 * just copy the samples to the mix buffer
-                 * no mixing and level adjustment needed
-                 */
-                unsigned k, samples_per_frame = conf->samples_per_frame;
-
-                for (k = 0; k < samples_per_frame; ++k) {
-                    mix_buf[k] = p_in_conn_leveled[k];
+            }
+            break;
+        }
+
+        /* All workers walk the transmitters in slot order, but each only
+         * mixes to the listeners it owns. This keeps the order of the
+         * additions to each mix buffer the same as in serial mode, hence
+         * the same mix_adj and the same output. This does not apply to
+         * the active speaker mode above, see mix_speakers().
+         */
+        for (i = 0; i < conf->max_ports; ++i) {
+            struct conf_port *conf_port = conf->ports[i];
+
+            if (!conf_port || !conf_port->rx_frame_ok)
+                continue;
+
+            for (cj = 0; cj < conf_port->listener_cnt; ++cj) {
+                if (conf_port->listener_slots[cj] % conf->worker_cnt !=
+                    worker->idx)
+                {
+                    continue;
                 }
+                mix_to_listener(conf, conf_port, cj, conf_port->rx_frame_buf,
+                                worker->adj_level_buf);
             }
-        } /* loop the listeners of conf port */
+        }
+        break;
+
+    case PHASE_WRITE:
+        for (i = worker->idx; i < conf->max_ports; i += conf->worker_cnt) {
+            struct conf_port *conf_port = conf->ports[i];
+            pjmedia_frame_type frm_type;
+            pj_status_t status;
+
+            if (!conf_port)
+                continue;
+
+            status = write_port(conf, conf_port, conf->timestamp, &frm_type);
+            if (status == PJ_SUCCESS && i == 0)
+                conf->speaker_frame_type = frm_type;
+        }
+        break;
+    }
+}
+
+
+/*
+ * Run a phase on all workers, and wait until all of them are done.
+ */
+static void run_workers(pjmedia_conf *conf, enum conf_phase phase)
+{
+    unsigned i;
+
+    conf->phase = phase;
+
+    for (i = 1; i < conf->worker_cnt; ++i)
+        pj_sem_post(conf->workers[i].start_sem);
+
+    /* The clock thread is worker zero */
+    run_phase(&conf->workers[0]);
+
+    for (i = 1; i < conf->worker_cnt; ++i)
+        pj_sem_wait(conf->done_sem);
+}
+
+
+/*
+ * Player callback.
+ */
+static pj_status_t get_frame(pjmedia_port *this_port, 
+                             pjmedia_frame *frame)
+{
+    pjmedia_conf *conf = (pjmedia_conf*) this_port->port_data.pdata;
+    pjmedia_frame_type speaker_frame_type = PJMEDIA_FRAME_TYPE_NONE;
+    unsigned ci, cj, i;
+    
+    TRACE_((THIS_FILE, "- clock -"));
+
+    /* Check that correct size is specified. */
+    pj_assert(frame->size == conf->samples_per_frame *
+                             conf->bits_per_sample / 8);
+
+    /* Must lock mutex */
+    pj_mutex_lock(conf->mutex);
+
+    if (conf->workers) {
+        /* Parallel and/or active speaker mode: each phase is split between
+         * the workers, and all workers must finish a phase before the next
+         * one starts.
+         */
+        conf->timestamp = &frame->timestamp;
+        conf->speaker_frame_type = PJMEDIA_FRAME_TYPE_NONE;
+
+        run_workers(conf, PHASE_READ);
+        if (conf->max_spk)
+            select_speakers(conf);
+        run_workers(conf, PHASE_MIX);
+        run_workers(conf, PHASE_WRITE);
+
+        speaker_frame_type = conf->speaker_frame_type;
+        goto on_mixed;
+    }
+
+    /* Reset port source count. We will only reset port's mix
+     * buffer when we have someone transmitting to it.
+     */
+    for (i=0, ci=0; i<conf->max_ports && ci < conf->port_cnt; ++i) {
+        struct conf_port *conf_port = conf->ports[i];
+
+        /* Skip empty port. */
+        if (!conf_port)
+            continue;
+
+        /* Var "ci" is to count how many ports have been visited so far. */
+        ++ci;
+
+        reset_mix_buf(conf, conf_port);
+    }
+
+    /* Get frames from all ports, and "mix" the signal 
+     * to mix_buf of all listeners of the port.
+     */
+    for (i=0, ci=0; i < conf->max_ports && ci < conf->port_cnt; ++i) {
+        struct conf_port *conf_port = conf->ports[i];
+        pj_int16_t *p_in = (pj_int16_t*) frame->buf;
+
+        /* Skip empty port. */
+        if (!conf_port)
+            continue;
+
+        /* Var "ci" is to count how many ports have been visited so far. */
+        ++ci;
+
+        if (!get_port_frame(conf, i, p_in))
+            continue;
+
+        /* Add the signal to all listeners. */
+        for (cj=0; cj < conf_port->listener_cnt; ++cj) {
+            mix_to_listener(conf, conf_port, cj, p_in,
+                            conf_port->adj_level_buf);
+        }
     } /* loop of all conf ports */
 
     /* Time for all ports to transmit whetever they have in their
@@ -2244,6 +2748,7 @@ static pj_status_t get_frame(pjmedia_port *this_port,
             speaker_frame_type = frm_type;
     }
 
+on_mixed:
     /* Return sound playback frame. */
     if (conf->ports[0]->tx_level) {
         TRACE_((THIS_FILE, "write to audio, count=%d", 
@@ -59,8 +59,35 @@
 #define STA_DISC_SAFE_SHRINKING_DIFF    1
 
 
+/* Number of slots of the window for finding the fastest arrival in delay
+ * estimation, the minimum is tracked per slot so the window slides one
+ * slot at a time.
+ */
+#define DELAY_WIN_SLOT_CNT      4
+
+/* Number of delay histogram buckets per frame, in power of two. Finer
+ * buckets let the target follow the delay quantile closer than a whole
+ * frame.
+ */
+#define DELAY_HIST_RES_SHIFT    2
+
+
+/* Reference counted frame buffer. The frame list slot holding the frame
+ * owns one reference, application gets another one when it borrows or
+ * peeks the frame with a buffer reference, so the content stays valid
+ * after the frame leaves the jitter buffer.
+ */
+struct pjmedia_jb_buf
+{
+    pjmedia_jb_buf  *next;              /**< next buffer in free list       */
+    unsigned         ref_cnt;           /**< reference counter              */
+    char            *data;              /**< frame content                  */
+};
+
+
 /* Struct of JB internal buffer, represented in a circular buffer containing
- * frame content, frame type, frame length, and frame bit info.
+ * references to the frame content, frame type, frame length, and frame bit
+ * info.
  */
 typedef struct jb_framelist_t
 {
@@ -69,7 +96,8 @@ typedef struct jb_framelist_t
     unsigned         max_count;         /**< maximum number of frames       */
 
     /* Buffers */
-    char            *content;           /**< frame content array            */
+    pjmedia_jb_buf **content;           /**< frame content reference array  */
+    pjmedia_jb_buf  *free_buf;          /**< free frame buffers             */
     int             *frame_type;        /**< frame type array               */
     pj_size_t       *content_len;       /**< frame length array             */
     pj_uint32_t     *bit_info;          /**< frame bit info array           */
@@ -90,6 +118,14 @@ typedef struct jb_framelist_t
 typedef void (*discard_algo)(pjmedia_jbuf *jb);
 static void jbuf_discard_static(pjmedia_jbuf *jb);
 static void jbuf_discard_progressive(pjmedia_jbuf *jb);
+static void jbuf_discard_delay(pjmedia_jbuf *jb);
+static void jbuf_put(pjmedia_jbuf *jb, const void *frame,
+                     pjmedia_jb_buf *buf, pj_size_t frame_size,
+                     pj_uint32_t bit_info, int frame_seq, pj_uint32_t ts,
+                     pj_bool_t *discarded);
+static void jbuf_get(pjmedia_jbuf *jb, void *frame, pjmedia_jb_buf **p_buf,
+                     pj_size_t *size, char *p_frame_type,
+                     pj_uint32_t *bit_info, pj_uint32_t *ts, int *seq);
 
 
 struct pjmedia_jbuf
@@ -110,6 +146,8 @@ struct pjmedia_jbuf
                                              calculation                    */
     int             jb_min_shrink_gap;  /**< How often can we shrink        */
     discard_algo    jb_discard_algo;    /**< Discard algorithm              */
+    pj_bool_t       jb_delay_est;       /**< Estimate target delay from
+                                             arrival delay histogram        */
 
     /* Buffer */
     jb_framelist_t  jb_framelist;       /**< the buffer                     */
@@ -143,6 +181,29 @@ struct pjmedia_jbuf
     unsigned        jb_discard_dist;    /**< Distance from jb_discard_ref
                                              to perform discard (in frm)    */
 
+    /* Delay estimation, for PJMEDIA_JB_DISCARD_DELAY */
+    pj_uint32_t    *jb_delay_hist;      /**< probability of each arrival
+                                             delay (in 1/4 frm), in Q30     */
+    unsigned        jb_delay_hist_cnt;  /**< number of histogram buckets    */
+    unsigned        jb_delay_samples;   /**< number of delays put into the
+                                             histogram (saturated)          */
+    pj_uint64_t     jb_clock;           /**< playout clock, advanced by GET
+                                             and time-stretching (in usec)  */
+    pj_bool_t       jb_delay_win_init;  /**< arrival window initialized?    */
+    int             jb_delay_win_min[DELAY_WIN_SLOT_CNT];
+                                        /**< fastest arrival in each window
+                                             slot (in frm), in Q8           */
+    unsigned        jb_delay_win_slot;  /**< current window slot            */
+    unsigned        jb_delay_win_start; /**< clock at current slot start
+                                             (in frm), in Q8                */
+    int             jb_target;          /**< target size estimated from the
+                                             histogram (in frm)             */
+    int             jb_target_lag;      /**< target playout lag (in frm),
+                                             in Q8                          */
+    int             jb_lag_filt;        /**< filtered playout lag relative
+                                             to the fastest arrival (in frm),
+                                             in Q8                          */
+
     /* Statistics */
     pj_math_stat    jb_delay;           /**< Delay statistics of jitter buffer
                                              (in ms)                        */
@@ -185,20 +246,57 @@ static pj_status_t jb_framelist_reset(jb_framelist_t *framelist);
 static unsigned jb_framelist_remove_head(jb_framelist_t *framelist,
                                          unsigned count);
 
+
+static pjmedia_jb_buf* jb_buf_alloc(jb_framelist_t *framelist)
+{
+    pjmedia_jb_buf *buf = framelist->free_buf;
+
+    if (buf) {
+        framelist->free_buf = buf->next;
+        buf->next = NULL;
+        buf->ref_cnt = 1;
+    }
+    return buf;
+}
+
+static void jb_buf_dec_ref(jb_framelist_t *framelist, pjmedia_jb_buf *buf)
+{
+    pj_assert(buf->ref_cnt > 0);
+    if (--buf->ref_cnt == 0) {
+        buf->next = framelist->free_buf;
+        framelist->free_buf = buf;
+    }
+}
+
+/* Empty a slot, dropping its reference to the frame content */
+static void jb_framelist_clear_slot(jb_framelist_t *framelist, unsigned pos)
+{
+    if (framelist->content[pos]) {
+        jb_buf_dec_ref(framelist, framelist->content[pos]);
+        framelist->content[pos] = NULL;
+    }
+    framelist->frame_type[pos] = PJMEDIA_JB_MISSING_FRAME;
+    framelist->content_len[pos] = 0;
+}
+
 static pj_status_t jb_framelist_init( pj_pool_t *pool,
                                       jb_framelist_t *framelist,
                                       unsigned frame_size,
                                       unsigned max_count)
 {
+    unsigned i, buf_cnt;
+    pj_size_t data_size;
+    char *data;
+
     PJ_ASSERT_RETURN(pool && framelist, PJ_EINVAL);
 
     pj_bzero(framelist, sizeof(jb_framelist_t));
 
     framelist->frame_size   = frame_size;
     framelist->max_count    = max_count;
-    framelist->content      = (char*)
-                              pj_pool_alloc(pool,
-                                            (pj_size_t)framelist->frame_size*
+    framelist->content      = (pjmedia_jb_buf**)
+                              pj_pool_zalloc(pool,
+                                            sizeof(framelist->content[0])*
                                             framelist->max_count);
     framelist->frame_type   = (int*)
                               pj_pool_alloc(pool,
@@ -217,6 +315,20 @@ static pj_status_t jb_framelist_init( pj_pool_t *pool,
                                             sizeof(framelist->ts[0])*
                                             framelist->max_count);
 
+    /* Frame buffers: one for each slot, plus the ones the application
+     * may hold (allocated but not put yet, or borrowed).
+     */
+    buf_cnt = max_count + PJMEDIA_JBUF_EXTRA_BUF_CNT;
+    data_size = (frame_size + 7) & ~7;
+    data = (char*) pj_pool_alloc(pool, data_size * buf_cnt);
+    for (i = 0; i < buf_cnt; ++i) {
+        pjmedia_jb_buf *buf = PJ_POOL_ZALLOC_T(pool, pjmedia_jb_buf);
+
+        buf->data = data + data_size * i;
+        buf->next = framelist->free_buf;
+        framelist->free_buf = buf;
+    }
+
     return jb_framelist_reset(framelist);
 
 }
@@ -229,24 +341,15 @@ static pj_status_t jb_framelist_destroy(jb_framelist_t *framelist)
 
 static pj_status_t jb_framelist_reset(jb_framelist_t *framelist)
 {
+    unsigned i;
+
     framelist->head = 0;
     framelist->origin = INVALID_OFFSET;
     framelist->size = 0;
     framelist->discarded_num = 0;
 
-
-    //pj_bzero(framelist->content,
-    //       framelist->frame_size *
-    //       framelist->max_count);
-
-    pj_memset(framelist->frame_type,
-              PJMEDIA_JB_MISSING_FRAME,
-              sizeof(framelist->frame_type[0]) *
-              framelist->max_count);
-
-    pj_bzero(framelist->content_len,
-             sizeof(framelist->content_len[0]) *
-             framelist->max_count);
+    for (i = 0; i < framelist->max_count; ++i)
+        jb_framelist_clear_slot(framelist, i);
 
     //pj_bzero(framelist->bit_info,
     //       sizeof(framelist->bit_info[0]) *
@@ -273,8 +376,12 @@ static int jb_framelist_origin(const jb_framelist_t *framelist)
 }
 
 
+/* Get the head frame, either copying its content to 'frame', or taking
+ * over the slot's reference to the content when 'p_buf' is given.
+ */
 static pj_bool_t jb_framelist_get(jb_framelist_t *framelist,
                                   void *frame, pj_size_t *size,
+                                  pjmedia_jb_buf **p_buf,
                                   pjmedia_jb_frame_type *p_type,
                                   pj_uint32_t *bit_info,
                                   pj_uint32_t *ts,
@@ -302,6 +409,16 @@ static pj_bool_t jb_framelist_get(jb_framelist_t *framelist,
                     *size = 0;
                 if (bit_info)
                     *bit_info = 0;
+            } else if (p_buf) {
+                /* Zero-copy, the reference moves to the caller */
+                *p_buf = framelist->content[framelist->head];
+                framelist->content[framelist->head] = NULL;
+                *p_type = (pjmedia_jb_frame_type)
+                          framelist->frame_type[framelist->head];
+                if (size)
+                    *size = framelist->content_len[framelist->head];
+                if (bit_info)
+                    *bit_info = framelist->bit_info[framelist->head];
             } else {
                 pj_size_t frm_size = framelist->content_len[framelist->head];
                 pj_size_t max_size = size? *size : frm_size;
@@ -314,10 +431,11 @@ static pj_bool_t jb_framelist_get(jb_framelist_t *framelist,
                                           "retrieved frame!"));
                 }
 
-                pj_memcpy(frame,
-                          framelist->content +
-                          framelist->head * framelist->frame_size,
-                          copy_size);
+                if (copy_size) {
+                    pj_memcpy(frame,
+                              framelist->content[framelist->head]->data,
+                              copy_size);
+                }
                 *p_type = (pjmedia_jb_frame_type)
                           framelist->frame_type[framelist->head];
                 if (size)
@@ -330,11 +448,7 @@ static pj_bool_t jb_framelist_get(jb_framelist_t *framelist,
             if (seq)
                 *seq = framelist->origin;
 
-            //pj_bzero(framelist->content +
-            //   framelist->head * framelist->frame_size,
-            //   framelist->frame_size);
-            framelist->frame_type[framelist->head] = PJMEDIA_JB_MISSING_FRAME;
-            framelist->content_len[framelist->head] = 0;
+            jb_framelist_clear_slot(framelist, framelist->head);
             framelist->bit_info[framelist->head] = 0;
             framelist->ts[framelist->head] = 0;
 
@@ -347,7 +461,8 @@ static pj_bool_t jb_framelist_get(jb_framelist_t *framelist,
     }
 
     /* No frame available */
-    pj_bzero(frame, framelist->frame_size);
+    if (frame)
+        pj_bzero(frame, framelist->frame_size);
 
     return PJ_FALSE;
 }
@@ -356,6 +471,7 @@ static pj_bool_t jb_framelist_get(jb_framelist_t *framelist,
 static pj_bool_t jb_framelist_peek(jb_framelist_t *framelist,
                                    unsigned offset,
                                    const void **frame,
+                                   pjmedia_jb_buf **p_buf,
                                    pj_size_t *size,
                                    pjmedia_jb_frame_type *type,
                                    pj_uint32_t *bit_info,
@@ -381,9 +497,16 @@ static pj_bool_t jb_framelist_peek(jb_framelist_t *framelist,
         pos = (pos + 1) % framelist->max_count;
     }
 
-    /* Return the frame pointer */
-    if (frame)
-        *frame = framelist->content + pos*framelist->frame_size;
+    /* Return the frame pointer, and a reference to it if requested */
+    if (frame) {
+        *frame = framelist->content[pos]? framelist->content[pos]->data :
+                                          NULL;
+    }
+    if (p_buf) {
+        *p_buf = framelist->content[pos];
+        if (*p_buf)
+            ++(*p_buf)->ref_cnt;
+    }
     if (type)
         *type = (pjmedia_jb_frame_type)
                 framelist->frame_type[pos];
@@ -408,49 +531,18 @@ static unsigned jb_framelist_remove_head(jb_framelist_t *framelist,
         count = framelist->size;
 
     if (count) {
-        /* may be done in two steps if overlapping */
-        unsigned step1,step2;
-        unsigned tmp = framelist->head+count;
-        unsigned i;
-
-        if (tmp > framelist->max_count) {
-            step1 = framelist->max_count - framelist->head;
-            step2 = count-step1;
-        } else {
-            step1 = count;
-            step2 = 0;
-        }
+        unsigned i, pos = framelist->head;
 
-        for (i = framelist->head; i < (framelist->head + step1); ++i) {
-            if (framelist->frame_type[i] == PJMEDIA_JB_DISCARDED_FRAME) {
+        /* Single pass over the removed slots of the ring */
+        for (i = 0; i < count; ++i) {
+            if (framelist->frame_type[pos] == PJMEDIA_JB_DISCARDED_FRAME) {
                 pj_assert(framelist->discarded_num > 0);
                 framelist->discarded_num--;
             }
-        }
+            jb_framelist_clear_slot(framelist, pos);
 
-        //pj_bzero(framelist->content +
-        //          framelist->head * framelist->frame_size,
-        //          step1*framelist->frame_size);
-        pj_memset(framelist->frame_type+framelist->head,
-                  PJMEDIA_JB_MISSING_FRAME,
-                  step1*sizeof(framelist->frame_type[0]));
-        pj_bzero(framelist->content_len+framelist->head,
-                 step1*sizeof(framelist->content_len[0]));
-
-        if (step2) {
-            for (i = 0; i < step2; ++i) {
-                if (framelist->frame_type[i] == PJMEDIA_JB_DISCARDED_FRAME) {
-                    pj_assert(framelist->discarded_num > 0);
-                    framelist->discarded_num--;
-                }
-            }
-            //pj_bzero( framelist->content,
-            //        step2*framelist->frame_size);
-            pj_memset(framelist->frame_type,
-                      PJMEDIA_JB_MISSING_FRAME,
-                      step2*sizeof(framelist->frame_type[0]));
-            pj_bzero (framelist->content_len,
-                      step2*sizeof(framelist->content_len[0]));
+            if (++pos == framelist->max_count)
+                pos = 0;
         }
 
         /* update states */
@@ -463,9 +555,13 @@ static unsigned jb_framelist_remove_head(jb_framelist_t *framelist,
 }
 
 
+/* Put a frame, either copying 'frame' or taking over the reference to
+ * 'buf' when it is given.
+ */
 static pj_status_t jb_framelist_put_at(jb_framelist_t *framelist,
                                        int index,
                                        const void *frame,
+                                       pjmedia_jb_buf *buf,
                                        unsigned frame_size,
                                        pj_uint32_t bit_info,
                                        pj_uint32_t ts,
@@ -541,7 +637,19 @@ static pj_status_t jb_framelist_put_at(jb_framelist_t *framelist,
         return PJ_EEXISTS;
     }
 
+    /* get the frame content buffer, copying the frame if needed */
+    if (PJMEDIA_JB_NORMAL_FRAME == frame_type && !buf) {
+        buf = jb_buf_alloc(framelist);
+        if (!buf) {
+            /* All spare buffers are held by the application */
+            TRACE__((THIS_FILE,"Put frame #%d: no buffer", index));
+            return PJ_ENOMEM;
+        }
+        pj_memcpy(buf->data, frame, frame_size);
+    }
+
     /* put the frame into the slot */
+    framelist->content[pos] = buf;
     framelist->frame_type[pos] = frame_type;
     framelist->content_len[pos] = frame_size;
     framelist->bit_info[pos] = bit_info;
@@ -551,12 +659,6 @@ static pj_status_t jb_framelist_put_at(jb_framelist_t *framelist,
     if (framelist->origin + (int)framelist->size <= index)
         framelist->size = distance + 1;
 
-    if(PJMEDIA_JB_NORMAL_FRAME == frame_type) {
-        /* copy frame content */
-        pj_memcpy(framelist->content + pos * framelist->frame_size,
-                  frame, frame_size);
-    }
-
     return PJ_SUCCESS;
 }
 
@@ -617,6 +719,11 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_create(pj_pool_t *pool,
     jb->jb_min_shrink_gap= PJMEDIA_JBUF_DISC_MIN_GAP / ptime;
     jb->jb_max_burst     = PJ_MAX(MAX_BURST_MSEC / ptime, max_count*3/4);
 
+    jb->jb_delay_hist_cnt= max_count << DELAY_HIST_RES_SHIFT;
+    jb->jb_delay_hist    = (pj_uint32_t*)
+                           pj_pool_calloc(pool, jb->jb_delay_hist_cnt,
+                                          sizeof(jb->jb_delay_hist[0]));
+
     pj_math_stat_init(&jb->jb_delay);
     pj_math_stat_init(&jb->jb_burst);
 
@@ -696,10 +803,15 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_set_discard( pjmedia_jbuf *jb,
 {
     PJ_ASSERT_RETURN(jb, PJ_EINVAL);
     PJ_ASSERT_RETURN(algo >= PJMEDIA_JB_DISCARD_NONE &&
-                     algo <= PJMEDIA_JB_DISCARD_PROGRESSIVE,
+                     algo <= PJMEDIA_JB_DISCARD_DELAY,
                      PJ_EINVAL);
 
+    jb->jb_delay_est = (algo == PJMEDIA_JB_DISCARD_DELAY);
+
     switch(algo) {
+    case PJMEDIA_JB_DISCARD_DELAY:
+        jb->jb_discard_algo = &jbuf_discard_delay;
+        break;
     case PJMEDIA_JB_DISCARD_PROGRESSIVE:
         jb->jb_discard_algo = &jbuf_discard_progressive;
         break;
@@ -725,6 +837,8 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_reset(pjmedia_jbuf *jb)
     jb->jb_max_hist_level= 0;
     jb->jb_prefetching   = (jb->jb_prefetch != 0);
     jb->jb_discard_dist  = 0;
+    jb->jb_delay_win_init= PJ_FALSE;
+    jb->jb_lag_filt      = 0;
 
     jb_framelist_reset(&jb->jb_framelist);
 
@@ -788,7 +902,7 @@ static void jbuf_calculate_jitter(pjmedia_jbuf *jb)
             jb->jb_eff_level -= diff;
 
             /* Update prefetch based on level */
-            if (jb->jb_init_prefetch) {
+            if (jb->jb_init_prefetch && !jb->jb_delay_est) {
                 jb->jb_prefetch = jb->jb_eff_level;
                 if (jb->jb_prefetch < jb->jb_min_prefetch)
                     jb->jb_prefetch = jb->jb_min_prefetch;
@@ -814,7 +928,7 @@ static void jbuf_calculate_jitter(pjmedia_jbuf *jb)
                                   (int)(jb->jb_max_count*4/5));
 
         /* Update prefetch based on level */
-        if (jb->jb_init_prefetch) {
+        if (jb->jb_init_prefetch && !jb->jb_delay_est) {
             jb->jb_prefetch = jb->jb_eff_level;
             if (jb->jb_prefetch > jb->jb_max_prefetch)
                 jb->jb_prefetch = jb->jb_max_prefetch;
@@ -837,6 +951,131 @@ static void jbuf_calculate_jitter(pjmedia_jbuf *jb)
 }
 
 
+/* Update the arrival delay histogram with a newly arrived frame and
+ * recalculate the target size. This is similar to the delay manager of
+ * WebRTC NetEq: the arrival delay is measured relative to the fastest
+ * arrival in the last PJMEDIA_JBUF_DELAY_WINDOW ms, and the target is
+ * the delay covering PJMEDIA_JBUF_DELAY_QUANTILE percent of the frames.
+ */
+static void jbuf_update_delay_hist(pjmedia_jbuf *jb, int frame_seq)
+{
+    unsigned i, now, slot_len, forget;
+    pj_uint64_t sum, cum, threshold;
+    int rel, min_rel, lag, delay, target;
+    pj_bool_t restart = PJ_FALSE;
+
+    /* Playout time elapsed minus position in the stream, in Q8 frames.
+     * Constant network delay makes it constant too. Unsigned arithmetic
+     * keeps the differences right when the clock wraps.
+     */
+    now = (unsigned)((jb->jb_clock * jb->jb_frame_ptime_denum << 8) /
+                     (jb->jb_frame_ptime * 1000));
+    rel = (int)(now - ((unsigned)frame_seq << 8));
+
+    slot_len = (PJMEDIA_JBUF_DELAY_WINDOW * jb->jb_frame_ptime_denum << 8) /
+               jb->jb_frame_ptime / DELAY_WIN_SLOT_CNT;
+    if (slot_len == 0)
+        slot_len = 1;
+
+    if (!jb->jb_delay_win_init ||
+        now - jb->jb_delay_win_start >= slot_len * DELAY_WIN_SLOT_CNT)
+    {
+        /* Start a new window */
+        for (i = 0; i < DELAY_WIN_SLOT_CNT; ++i)
+            jb->jb_delay_win_min[i] = rel;
+        jb->jb_delay_win_slot = 0;
+        jb->jb_delay_win_start = now;
+        jb->jb_delay_win_init = PJ_TRUE;
+        restart = PJ_TRUE;
+    } else if (now - jb->jb_delay_win_start >= slot_len) {
+        /* Slide the window */
+        jb->jb_delay_win_slot = (jb->jb_delay_win_slot + 1) %
+                                DELAY_WIN_SLOT_CNT;
+        jb->jb_delay_win_min[jb->jb_delay_win_slot] = rel;
+        jb->jb_delay_win_start = now;
+    } else if (rel < jb->jb_delay_win_min[jb->jb_delay_win_slot]) {
+        jb->jb_delay_win_min[jb->jb_delay_win_slot] = rel;
+    }
+
+    min_rel = rel;
+    for (i = 0; i < DELAY_WIN_SLOT_CNT; ++i)
+        min_rel = PJ_MIN(min_rel, jb->jb_delay_win_min[i]);
+    delay = rel - min_rel;
+
+    /* Delay longer than max burst means GET has been idle or the sequence
+     * has restarted, measure the next frames from this one.
+     */
+    if (delay > (jb->jb_max_burst << 8)) {
+        jb->jb_delay_win_init = PJ_FALSE;
+        return;
+    }
+
+    /* Playout lag is how long the fastest frame would wait before being
+     * played, the next GET plays the origin. It only changes on
+     * time-stretching, discard or underflow, the filter smoothes out the
+     * fastest arrival moving.
+     */
+    lag = (int)(now + 256 -
+                ((unsigned)jb_framelist_origin(&jb->jb_framelist) << 8)) -
+          min_rel;
+    if (restart)
+        jb->jb_lag_filt = lag;
+    else
+        jb->jb_lag_filt += (lag - jb->jb_lag_filt) >> 3;
+
+    /* Forget factor starts low so the first delays converge quickly */
+    forget = 32768 - 32768 / (jb->jb_delay_samples + 1);
+    if (forget > PJMEDIA_JBUF_DELAY_FORGET_FACTOR)
+        forget = PJMEDIA_JBUF_DELAY_FORGET_FACTOR;
+    if (jb->jb_delay_samples < 32768)
+        jb->jb_delay_samples++;
+
+    delay >>= 8 - DELAY_HIST_RES_SHIFT;
+    if (delay >= (int)jb->jb_delay_hist_cnt)
+        delay = jb->jb_delay_hist_cnt - 1;
+
+    sum = 0;
+    for (i = 0; i < jb->jb_delay_hist_cnt; ++i) {
+        jb->jb_delay_hist[i] = (pj_uint32_t)
+                               (((pj_uint64_t)jb->jb_delay_hist[i] *
+                                 forget) >> 15);
+        if (i == (unsigned)delay)
+            jb->jb_delay_hist[i] += (32768 - forget) << 15;
+        sum += jb->jb_delay_hist[i];
+    }
+
+    /* Find the quantile, the target lag is the upper edge of its bucket */
+    threshold = sum * PJMEDIA_JBUF_DELAY_QUANTILE / 100;
+    cum = 0;
+    for (i = 0; i < jb->jb_delay_hist_cnt - 1; ++i) {
+        cum += jb->jb_delay_hist[i];
+        if (cum >= threshold)
+            break;
+    }
+
+    target = (int)(i + 1) << (8 - DELAY_HIST_RES_SHIFT);
+    if (target < (jb->jb_min_prefetch << 8))
+        target = jb->jb_min_prefetch << 8;
+    if (target > (jb->jb_max_prefetch << 8))
+        target = jb->jb_max_prefetch << 8;
+    jb->jb_target_lag = target;
+
+    /* Target size, a frame arriving with no extra delay still needs one
+     * frame buffer.
+     */
+    target = (target + 255) >> 8;
+    if (target != jb->jb_target) {
+        TRACE__((jb->jb_name.ptr, "jb target updated, %d -> %d, size=%d",
+                 jb->jb_target, target,
+                 jb_framelist_eff_size(&jb->jb_framelist)));
+        jb->jb_target = target;
+    }
+
+    if (jb->jb_init_prefetch)
+        jb->jb_prefetch = jb->jb_target;
+}
+
+
 static void jbuf_discard_static(pjmedia_jbuf *jb)
 {
     /* These code is used for shortening the delay in the jitter buffer.
@@ -967,6 +1206,44 @@ static void jbuf_discard_progressive(pjmedia_jbuf *jb)
 }
 
 
+static void jbuf_discard_delay(pjmedia_jbuf *jb)
+{
+    /* Latency around the target is adjusted by application with
+     * time-stretching, see pjmedia_jbuf_get_delay_adjust(). Here we
+     * only drop frames when latency is way above the target, e.g: after
+     * a long burst, shrinking one frame per PJMEDIA_JBUF_DISC_MIN_GAP ms
+     * as static discard does.
+     */
+    int excess, seq_origin, removed;
+
+    /* Should be done in PUT operation */
+    if (jb->jb_last_op != JB_OP_PUT)
+        return;
+
+    excess = jb_framelist_eff_size(&jb->jb_framelist) - jb->jb_target -
+             (int)(PJMEDIA_JBUF_DELAY_DISC_EXCESS *
+                   jb->jb_frame_ptime_denum / jb->jb_frame_ptime);
+    if (excess <= 0)
+        return;
+
+    /* Check and adjust jb_discard_ref, in case there was seq restart */
+    seq_origin = jb_framelist_origin(&jb->jb_framelist);
+    if (seq_origin < jb->jb_discard_ref)
+        jb->jb_discard_ref = seq_origin;
+
+    if (seq_origin - jb->jb_discard_ref >= jb->jb_min_shrink_gap) {
+        removed = jb_framelist_remove_head(&jb->jb_framelist, 1);
+        jb->jb_discard_ref = jb_framelist_origin(&jb->jb_framelist);
+        jb->jb_discard += removed;
+
+        TRACE__((jb->jb_name.ptr,
+                 "JB shrinking %d frame(s), cur size=%d, target=%d",
+                 removed, jb_framelist_eff_size(&jb->jb_framelist),
+                 jb->jb_target));
+    }
+}
+
+
 PJ_INLINE(void) jbuf_update(pjmedia_jbuf *jb, int oper)
 {
     if(jb->jb_last_op != oper) {
@@ -1034,6 +1311,70 @@ PJ_DEF(void) pjmedia_jbuf_put_frame3(pjmedia_jbuf *jb,
                                      int frame_seq,
                                      pj_uint32_t ts,
                                      pj_bool_t *discarded)
+{
+    jbuf_put(jb, frame, NULL, frame_size, bit_info, frame_seq, ts, discarded);
+}
+
+/*
+ * Put a frame buffer to jitter buffer, without copying.
+ */
+PJ_DEF(void) pjmedia_jbuf_put_buf(pjmedia_jbuf *jb,
+                                  pjmedia_jb_buf *buf,
+                                  pj_size_t frame_size,
+                                  pj_uint32_t bit_info,
+                                  int frame_seq,
+                                  pj_uint32_t ts,
+                                  pj_bool_t *discarded)
+{
+    pj_bool_t disc;
+
+    PJ_ASSERT_ON_FAIL(jb && buf, return);
+
+    jbuf_put(jb, buf->data, buf, frame_size, bit_info, frame_seq, ts, &disc);
+
+    /* The jitter buffer holds the reference now, unless it was rejected */
+    if (disc)
+        jb_buf_dec_ref(&jb->jb_framelist, buf);
+    if (discarded)
+        *discarded = disc;
+}
+
+/*
+ * Allocate a frame buffer to be filled by application.
+ */
+PJ_DEF(pj_status_t) pjmedia_jbuf_alloc_buf(pjmedia_jbuf *jb,
+                                           pjmedia_jb_buf **p_buf,
+                                           void **p_data)
+{
+    PJ_ASSERT_RETURN(jb && p_buf, PJ_EINVAL);
+
+    *p_buf = jb_buf_alloc(&jb->jb_framelist);
+    if (!*p_buf)
+        return PJ_ETOOMANY;
+
+    if (p_data)
+        *p_data = (*p_buf)->data;
+    return PJ_SUCCESS;
+}
+
+/*
+ * Release a frame buffer reference.
+ */
+PJ_DEF(void) pjmedia_jbuf_release_buf(pjmedia_jbuf *jb,
+                                      pjmedia_jb_buf *buf)
+{
+    PJ_ASSERT_ON_FAIL(jb && buf, return);
+    jb_buf_dec_ref(&jb->jb_framelist, buf);
+}
+
+static void jbuf_put(pjmedia_jbuf *jb,
+                     const void *frame,
+                     pjmedia_jb_buf *buf,
+                     pj_size_t frame_size,
+                     pj_uint32_t bit_info,
+                     int frame_seq,
+                     pj_uint32_t ts,
+                     pj_bool_t *discarded)
 {
     pj_size_t min_frame_size;
     int new_size, cur_size;
@@ -1049,7 +1390,7 @@ PJ_DEF(void) pjmedia_jbuf_put_frame3(pjmedia_jbuf *jb,
 
     /* Attempt to store the frame */
     min_frame_size = PJ_MIN(frame_size, jb->jb_frame_size);
-    status = jb_framelist_put_at(&jb->jb_framelist, frame_seq, frame,
+    status = jb_framelist_put_at(&jb->jb_framelist, frame_seq, frame, buf,
                                  (unsigned)min_frame_size, bit_info, ts,
                                  PJMEDIA_JB_NORMAL_FRAME);
 
@@ -1069,12 +1410,16 @@ PJ_DEF(void) pjmedia_jbuf_put_frame3(pjmedia_jbuf *jb,
 
         removed = jb_framelist_remove_head(&jb->jb_framelist, distance);
         status = jb_framelist_put_at(&jb->jb_framelist, frame_seq, frame,
-                                     (unsigned)min_frame_size, bit_info, ts,
-                                     PJMEDIA_JB_NORMAL_FRAME);
+                                     buf, (unsigned)min_frame_size,
+                                     bit_info, ts, PJMEDIA_JB_NORMAL_FRAME);
 
         jb->jb_discard += removed;
     }
 
+    /* Frames arriving too late to be played count in delay estimation */
+    if (jb->jb_delay_est)
+        jbuf_update_delay_hist(jb, frame_seq);
+
     /* Get new JB size after PUT */
     new_size = jb_framelist_eff_size(&jb->jb_framelist);
 
@@ -1130,6 +1475,39 @@ PJ_DEF(void) pjmedia_jbuf_get_frame3(pjmedia_jbuf *jb,
                                      pj_uint32_t *ts,
                                      int *seq)
 {
+    jbuf_get(jb, frame, NULL, size, p_frame_type, bit_info, ts, seq);
+}
+
+/*
+ * Get frame from jitter buffer, without copying.
+ */
+PJ_DEF(void) pjmedia_jbuf_borrow_frame(pjmedia_jbuf *jb,
+                                       const void **frame,
+                                       pjmedia_jb_buf **p_buf,
+                                       pj_size_t *size,
+                                       char *p_frame_type,
+                                       pj_uint32_t *bit_info,
+                                       pj_uint32_t *ts,
+                                       int *seq)
+{
+    PJ_ASSERT_ON_FAIL(jb && frame && p_buf, return);
+
+    *p_buf = NULL;
+    jbuf_get(jb, NULL, p_buf, size, p_frame_type, bit_info, ts, seq);
+    *frame = *p_buf? (*p_buf)->data : NULL;
+}
+
+static void jbuf_get(pjmedia_jbuf *jb,
+                     void *frame,
+                     pjmedia_jb_buf **p_buf,
+                     pj_size_t *size,
+                     char *p_frame_type,
+                     pj_uint32_t *bit_info,
+                     pj_uint32_t *ts,
+                     int *seq)
+{
+    jb->jb_clock += jb->jb_frame_ptime * 1000 / jb->jb_frame_ptime_denum;
+
     if (jb->jb_prefetching) {
 
         /* Can't return frame because jitter buffer is filling up
@@ -1152,8 +1530,8 @@ PJ_DEF(void) pjmedia_jbuf_get_frame3(pjmedia_jbuf *jb,
         pj_bool_t res;
 
         /* Try to retrieve a frame from frame list */
-        res = jb_framelist_get(&jb->jb_framelist, frame, size, &ftype,
-                               bit_info, ts, seq);
+        res = jb_framelist_get(&jb->jb_framelist, frame, size, p_buf,
+                               &ftype, bit_info, ts, seq);
         if (res) {
             /* We've successfully retrieved a frame from the frame list, but
              * the frame could be a blank frame!
@@ -1209,6 +1587,7 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_get_state( const pjmedia_jbuf *jb,
     state->burst = jb->jb_eff_level;
     state->prefetch = jb->jb_prefetch;
     state->size = jb_framelist_eff_size(&jb->jb_framelist);
+    state->target = jb->jb_delay_est? jb->jb_target : 0;
 
     state->avg_delay = jb->jb_delay.mean;
     state->min_delay = jb->jb_delay.min;
@@ -1224,6 +1603,49 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_get_state( const pjmedia_jbuf *jb,
 }
 
 
+PJ_DEF(int) pjmedia_jbuf_get_delay_adjust(const pjmedia_jbuf *jb)
+{
+    int low, high;
+
+    PJ_ASSERT_RETURN(jb, 0);
+
+    if (!jb->jb_delay_est || jb->jb_delay_samples == 0)
+        return 0;
+
+    /* Keep the filtered playout lag between the target and the target
+     * plus one frame, in Q8.
+     */
+    low = jb->jb_target_lag;
+    high = low + 256;
+
+    if (jb->jb_lag_filt < low)
+        return -((low - jb->jb_lag_filt + 255) >> 8);
+    if (jb->jb_lag_filt >= high)
+        return ((jb->jb_lag_filt - high) >> 8) + 1;
+    return 0;
+}
+
+
+PJ_DEF(void) pjmedia_jbuf_time_stretched(pjmedia_jbuf *jb, int usec)
+{
+    PJ_ASSERT_ON_FAIL(jb, return);
+
+    /* Synthesized audio is played without GET, erased audio is taken
+     * with GET but never played.
+     */
+    if (usec < 0 && (pj_uint64_t)-usec > jb->jb_clock)
+        jb->jb_clock = 0;
+    else
+        jb->jb_clock += usec;
+
+    /* The playout lag changes right away, don't wait for the filter to
+     * see it or the stretching would overshoot.
+     */
+    jb->jb_lag_filt += (int)(((pj_int64_t)usec * jb->jb_frame_ptime_denum
+                              << 8) / (jb->jb_frame_ptime * 1000));
+}
+
+
 PJ_DEF(void) pjmedia_jbuf_peek_frame( pjmedia_jbuf *jb,
                                       unsigned offset,
                                       const void **frame,
@@ -1232,12 +1654,30 @@ PJ_DEF(void) pjmedia_jbuf_peek_frame( pjmedia_jbuf *jb,
                                       pj_uint32_t *bit_info,
                                       pj_uint32_t *ts,
                                       int *seq)
+{
+    pjmedia_jbuf_peek_buf(jb, offset, frame, NULL, size, p_frm_type,
+                          bit_info, ts, seq);
+}
+
+
+PJ_DEF(void) pjmedia_jbuf_peek_buf(pjmedia_jbuf *jb,
+                                   unsigned offset,
+                                   const void **frame,
+                                   pjmedia_jb_buf **p_buf,
+                                   pj_size_t *size,
+                                   char *p_frm_type,
+                                   pj_uint32_t *bit_info,
+                                   pj_uint32_t *ts,
+                                   int *seq)
 {
     pjmedia_jb_frame_type ftype;
     pj_bool_t res;
 
-    res = jb_framelist_peek(&jb->jb_framelist, offset, frame, size, &ftype,
-                            bit_info, ts, seq);
+    if (p_buf)
+        *p_buf = NULL;
+
+    res = jb_framelist_peek(&jb->jb_framelist, offset, frame, p_buf, size,
+                            &ftype, bit_info, ts, seq);
     if (!res)
         *p_frm_type = PJMEDIA_JB_ZERO_EMPTY_FRAME;
     else if (ftype == PJMEDIA_JB_NORMAL_FRAME)
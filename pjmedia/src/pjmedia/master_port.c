@@ -110,7 +110,12 @@ PJ_DEF(pj_status_t) pjmedia_master_port_create( pj_pool_t *pool,
     if (status != PJ_SUCCESS)
         return status;
 
-    /* Create media clock */
+    /* Create media clock, on the shared clock scheduler unless the
+     * application wants a thread for it.
+     */
+    if ((options & PJMEDIA_CLOCK_OWN_THREAD) == 0)
+        options |= PJMEDIA_CLOCK_SHARED;
+
     status = pjmedia_clock_create(pool, clock_rate, channel_count, 
                                   samples_per_frame, options, &clock_callback,
                                   m, &m->clock);
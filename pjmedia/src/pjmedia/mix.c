@@ -0,0 +1,790 @@
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include <pjmedia/mix.h>
+#include <pjmedia/errno.h>
+#include <pj/assert.h>
+#include <pj/log.h>
+
+#define THIS_FILE       "mix.c"
+
+#define NORMAL_LEVEL    128
+#define MAX_LEVEL       (32767)
+#define MIN_LEVEL       (-32768)
+
+#if PJMEDIA_HAS_MIX_SIMD
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#       include <immintrin.h>
+#       define TARGET_SSE2
+#       define TARGET_AVX2
+#   else
+#       include <immintrin.h>
+#       define TARGET_SSE2      __attribute__((target("sse2")))
+#       define TARGET_AVX2      __attribute__((target("avx2")))
+#   endif
+#endif
+
+
+/* The set of routines of one implementation. */
+typedef struct mix_ops
+{
+    pjmedia_mix_impl impl;
+    const char      *name;
+
+    void        (*add)(pj_int32_t *mix_buf, const pj_int16_t *samples,
+                       unsigned count, pj_int32_t *p_min, pj_int32_t *p_max);
+    void        (*sub)(pj_int32_t *dst, const pj_int32_t *mix_buf,
+                       const pj_int16_t *samples, unsigned count,
+                       pj_int32_t *p_min, pj_int32_t *p_max);
+    void        (*copy)(pj_int32_t *mix_buf, const pj_int16_t *samples,
+                        unsigned count);
+    pj_uint32_t (*adjust)(pj_int16_t *dst, const pj_int16_t *src,
+                          unsigned count, unsigned adj_level);
+    pj_uint32_t (*to_samples)(pj_int16_t *dst, const pj_int32_t *mix_buf,
+                              unsigned count, unsigned adj_level);
+    pj_uint32_t (*sum_abs)(const pj_int16_t *samples, unsigned count);
+} mix_ops;
+
+
+/*
+ * Scalar implementation. The SIMD implementations use these for the
+ * remaining samples which don't fill a whole vector.
+ */
+
+static void add_scalar(pj_int32_t *mix_buf, const pj_int16_t *samples,
+                       unsigned count, pj_int32_t *p_min, pj_int32_t *p_max)
+{
+    pj_int32_t mix_min = *p_min;
+    pj_int32_t mix_max = *p_max;
+    unsigned k;
+
+    for (k = 0; k < count; ++k) {
+        mix_buf[k] += samples[k];
+        if (mix_buf[k] < mix_min)
+            mix_min = mix_buf[k];
+        if (mix_buf[k] > mix_max)
+            mix_max = mix_buf[k];
+    }
+
+    *p_min = mix_min;
+    *p_max = mix_max;
+}
+
+static void sub_scalar(pj_int32_t *dst, const pj_int32_t *mix_buf,
+                       const pj_int16_t *samples, unsigned count,
+                       pj_int32_t *p_min, pj_int32_t *p_max)
+{
+    pj_int32_t mix_min = *p_min;
+    pj_int32_t mix_max = *p_max;
+    unsigned k;
+
+    for (k = 0; k < count; ++k) {
+        dst[k] = mix_buf[k] - samples[k];
+        if (dst[k] < mix_min)
+            mix_min = dst[k];
+        if (dst[k] > mix_max)
+            mix_max = dst[k];
+    }
+
+    *p_min = mix_min;
+    *p_max = mix_max;
+}
+
+static void copy_scalar(pj_int32_t *mix_buf, const pj_int16_t *samples,
+                        unsigned count)
+{
+    unsigned k;
+
+    for (k = 0; k < count; ++k)
+        mix_buf[k] = samples[k];
+}
+
+static pj_uint32_t adjust_scalar(pj_int16_t *dst, const pj_int16_t *src,
+                                 unsigned count, unsigned adj_level)
+{
+    pj_uint32_t sum = 0;
+    unsigned k;
+
+    for (k = 0; k < count; ++k) {
+        /* Multiply as unsigned like the bridge always did, so overflow
+         * wraps around the same way as the SIMD multiplication.
+         */
+        pj_int32_t itemp = (pj_int32_t)((pj_uint32_t)src[k] * adj_level);
+        itemp >>= 7;
+
+        /* Clip the signal if it's too loud */
+        if (itemp > MAX_LEVEL) itemp = MAX_LEVEL;
+        else if (itemp < MIN_LEVEL) itemp = MIN_LEVEL;
+
+        dst[k] = (pj_int16_t) itemp;
+        sum += (itemp >= 0 ? itemp : -itemp);
+    }
+
+    return sum;
+}
+
+static pj_uint32_t to_samples_scalar(pj_int16_t *dst,
+                                     const pj_int32_t *mix_buf,
+                                     unsigned count, unsigned adj_level)
+{
+    pj_uint32_t sum = 0;
+    unsigned k;
+
+    for (k = 0; k < count; ++k) {
+        pj_int32_t itemp = mix_buf[k];
+
+        if (adj_level != NORMAL_LEVEL) {
+            itemp = (pj_int32_t)((pj_uint32_t)itemp * adj_level);
+            itemp >>= 7;
+        }
+
+        /* Clip the signal if it's too loud */
+        if (itemp > MAX_LEVEL) itemp = MAX_LEVEL;
+        else if (itemp < MIN_LEVEL) itemp = MIN_LEVEL;
+
+        /* dst may be mix_buf, but we're done reading mix_buf[k] */
+        dst[k] = (pj_int16_t) itemp;
+        sum += (itemp >= 0 ? itemp : -itemp);
+    }
+
+    return sum;
+}
+
+static pj_uint32_t sum_abs_scalar(const pj_int16_t *samples, unsigned count)
+{
+    pj_uint32_t sum = 0;
+    unsigned k;
+
+    for (k = 0; k < count; ++k) {
+        if (samples[k] < 0)
+            sum -= samples[k];
+        else
+            sum += samples[k];
+    }
+
+    return sum;
+}
+
+static const mix_ops scalar_ops =
+{
+    PJMEDIA_MIX_IMPL_SCALAR, "scalar",
+    &add_scalar, &sub_scalar, &copy_scalar, &adjust_scalar,
+    &to_samples_scalar, &sum_abs_scalar
+};
+
+
+#if PJMEDIA_HAS_MIX_SIMD
+
+/*
+ * SSE2 implementation, 8 samples at a time. SSE2 lacks 32bit multiply,
+ * min, max and abs, so these are emulated.
+ */
+
+TARGET_SSE2
+PJ_INLINE(__m128i) sext_lo_sse2(__m128i x)
+{
+    return _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+}
+
+TARGET_SSE2
+PJ_INLINE(__m128i) sext_hi_sse2(__m128i x)
+{
+    return _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+}
+
+TARGET_SSE2
+PJ_INLINE(__m128i) mullo_sse2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+TARGET_SSE2
+PJ_INLINE(__m128i) min_sse2(__m128i a, __m128i b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+
+TARGET_SSE2
+PJ_INLINE(__m128i) max_sse2(__m128i a, __m128i b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+TARGET_SSE2
+PJ_INLINE(__m128i) abs_sse2(__m128i a)
+{
+    __m128i sign = _mm_srai_epi32(a, 31);
+    return _mm_sub_epi32(_mm_xor_si128(a, sign), sign);
+}
+
+/* Sum of absolute value of 8 (already clipped) 16bit samples */
+TARGET_SSE2
+PJ_INLINE(__m128i) abs_acc_sse2(__m128i acc, __m128i x)
+{
+    acc = _mm_add_epi32(acc, abs_sse2(sext_lo_sse2(x)));
+    return _mm_add_epi32(acc, abs_sse2(sext_hi_sse2(x)));
+}
+
+TARGET_SSE2
+static pj_uint32_t hsum_sse2(__m128i acc)
+{
+    pj_uint32_t v[4];
+
+    _mm_storeu_si128((__m128i*)v, acc);
+    return v[0] + v[1] + v[2] + v[3];
+}
+
+TARGET_SSE2
+static void add_sse2(pj_int32_t *mix_buf, const pj_int16_t *samples,
+                     unsigned count, pj_int32_t *p_min, pj_int32_t *p_max)
+{
+    __m128i vmin = _mm_setzero_si128();
+    __m128i vmax = _mm_setzero_si128();
+    pj_int32_t v[4];
+    unsigned k, i;
+
+    for (k = 0; k + 8 <= count; k += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(samples + k));
+        __m128i m0 = _mm_loadu_si128((const __m128i*)(mix_buf + k));
+        __m128i m1 = _mm_loadu_si128((const __m128i*)(mix_buf + k + 4));
+
+        m0 = _mm_add_epi32(m0, sext_lo_sse2(x));
+        m1 = _mm_add_epi32(m1, sext_hi_sse2(x));
+        _mm_storeu_si128((__m128i*)(mix_buf + k), m0);
+        _mm_storeu_si128((__m128i*)(mix_buf + k + 4), m1);
+
+        vmin = min_sse2(vmin, min_sse2(m0, m1));
+        vmax = max_sse2(vmax, max_sse2(m0, m1));
+    }
+
+    _mm_storeu_si128((__m128i*)v, vmin);
+    for (i = 0; i < 4; ++i) {
+        if (v[i] < *p_min) *p_min = v[i];
+    }
+    _mm_storeu_si128((__m128i*)v, vmax);
+    for (i = 0; i < 4; ++i) {
+        if (v[i] > *p_max) *p_max = v[i];
+    }
+
+    add_scalar(mix_buf + k, samples + k, count - k, p_min, p_max);
+}
+
+TARGET_SSE2
+static void sub_sse2(pj_int32_t *dst, const pj_int32_t *mix_buf,
+                     const pj_int16_t *samples, unsigned count,
+                     pj_int32_t *p_min, pj_int32_t *p_max)
+{
+    __m128i vmin = _mm_setzero_si128();
+    __m128i vmax = _mm_setzero_si128();
+    pj_int32_t v[4];
+    unsigned k, i;
+
+    for (k = 0; k + 8 <= count; k += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(samples + k));
+        __m128i m0 = _mm_loadu_si128((const __m128i*)(mix_buf + k));
+        __m128i m1 = _mm_loadu_si128((const __m128i*)(mix_buf + k + 4));
+
+        m0 = _mm_sub_epi32(m0, sext_lo_sse2(x));
+        m1 = _mm_sub_epi32(m1, sext_hi_sse2(x));
+        _mm_storeu_si128((__m128i*)(dst + k), m0);
+        _mm_storeu_si128((__m128i*)(dst + k + 4), m1);
+
+        vmin = min_sse2(vmin, min_sse2(m0, m1));
+        vmax = max_sse2(vmax, max_sse2(m0, m1));
+    }
+
+    _mm_storeu_si128((__m128i*)v, vmin);
+    for (i = 0; i < 4; ++i) {
+        if (v[i] < *p_min) *p_min = v[i];
+    }
+    _mm_storeu_si128((__m128i*)v, vmax);
+    for (i = 0; i < 4; ++i) {
+        if (v[i] > *p_max) *p_max = v[i];
+    }
+
+    sub_scalar(dst + k, mix_buf + k, samples + k, count - k, p_min, p_max);
+}
+
+TARGET_SSE2
+static void copy_sse2(pj_int32_t *mix_buf, const pj_int16_t *samples,
+                      unsigned count)
+{
+    unsigned k;
+
+    for (k = 0; k + 8 <= count; k += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(samples + k));
+
+        _mm_storeu_si128((__m128i*)(mix_buf + k), sext_lo_sse2(x));
+        _mm_storeu_si128((__m128i*)(mix_buf + k + 4), sext_hi_sse2(x));
+    }
+
+    copy_scalar(mix_buf + k, samples + k, count - k);
+}
+
+TARGET_SSE2
+static pj_uint32_t adjust_sse2(pj_int16_t *dst, const pj_int16_t *src,
+                               unsigned count, unsigned adj_level)
+{
+    __m128i vadj = _mm_set1_epi32((int)adj_level);
+    __m128i acc = _mm_setzero_si128();
+    unsigned k;
+
+    for (k = 0; k + 8 <= count; k += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(src + k));
+        __m128i lo = _mm_srai_epi32(mullo_sse2(sext_lo_sse2(x), vadj), 7);
+        __m128i hi = _mm_srai_epi32(mullo_sse2(sext_hi_sse2(x), vadj), 7);
+
+        /* Saturating pack does the clipping */
+        x = _mm_packs_epi32(lo, hi);
+        _mm_storeu_si128((__m128i*)(dst + k), x);
+        acc = abs_acc_sse2(acc, x);
+    }
+
+    return hsum_sse2(acc) +
+           adjust_scalar(dst + k, src + k, count - k, adj_level);
+}
+
+TARGET_SSE2
+static pj_uint32_t to_samples_sse2(pj_int16_t *dst, const pj_int32_t *mix_buf,
+                                   unsigned count, unsigned adj_level)
+{
+    __m128i vadj = _mm_set1_epi32((int)adj_level);
+    __m128i acc = _mm_setzero_si128();
+    unsigned k;
+
+    /* When dst is mix_buf, the 8 samples written on each iteration only
+     * overlap the part of mix_buf that has been read.
+     */
+    for (k = 0; k + 8 <= count; k += 8) {
+        __m128i m0 = _mm_loadu_si128((const __m128i*)(mix_buf + k));
+        __m128i m1 = _mm_loadu_si128((const __m128i*)(mix_buf + k + 4));
+        __m128i x;
+
+        if (adj_level != NORMAL_LEVEL) {
+            m0 = _mm_srai_epi32(mullo_sse2(m0, vadj), 7);
+            m1 = _mm_srai_epi32(mullo_sse2(m1, vadj), 7);
+        }
+
+        x = _mm_packs_epi32(m0, m1);
+        _mm_storeu_si128((__m128i*)(dst + k), x);
+        acc = abs_acc_sse2(acc, x);
+    }
+
+    return hsum_sse2(acc) +
+           to_samples_scalar(dst + k, mix_buf + k, count - k, adj_level);
+}
+
+TARGET_SSE2
+static pj_uint32_t sum_abs_sse2(const pj_int16_t *samples, unsigned count)
+{
+    __m128i acc = _mm_setzero_si128();
+    unsigned k;
+
+    for (k = 0; k + 8 <= count; k += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(samples + k));
+        acc = abs_acc_sse2(acc, x);
+    }
+
+    return hsum_sse2(acc) + sum_abs_scalar(samples + k, count - k);
+}
+
+static const mix_ops sse2_ops =
+{
+    PJMEDIA_MIX_IMPL_SSE2, "SSE2",
+    &add_sse2, &sub_sse2, &copy_sse2, &adjust_sse2, &to_samples_sse2,
+    &sum_abs_sse2
+};
+
+
+/*
+ * AVX2 implementation, 16 samples at a time.
+ */
+
+TARGET_AVX2
+PJ_INLINE(__m256i) load_sext_avx2(const pj_int16_t *p)
+{
+    return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)p));
+}
+
+/* Pack two vectors of 8 32bit values to 16 16bit values with saturation.
+ * The AVX2 pack works per 128bit lane, so the result has to be reordered.
+ */
+TARGET_AVX2
+PJ_INLINE(__m256i) packs_avx2(__m256i lo, __m256i hi)
+{
+    return _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi),
+                                    _MM_SHUFFLE(3,1,2,0));
+}
+
+TARGET_AVX2
+PJ_INLINE(__m256i) clip_avx2(__m256i x)
+{
+    x = _mm256_min_epi32(x, _mm256_set1_epi32(MAX_LEVEL));
+    return _mm256_max_epi32(x, _mm256_set1_epi32(MIN_LEVEL));
+}
+
+TARGET_AVX2
+static pj_uint32_t hsum_avx2(__m256i acc)
+{
+    pj_uint32_t v[8];
+    unsigned i;
+    pj_uint32_t sum = 0;
+
+    _mm256_storeu_si256((__m256i*)v, acc);
+    for (i = 0; i < 8; ++i)
+        sum += v[i];
+    return sum;
+}
+
+TARGET_AVX2
+static void add_avx2(pj_int32_t *mix_buf, const pj_int16_t *samples,
+                     unsigned count, pj_int32_t *p_min, pj_int32_t *p_max)
+{
+    __m256i vmin = _mm256_setzero_si256();
+    __m256i vmax = _mm256_setzero_si256();
+    pj_int32_t v[8];
+    unsigned k, i;
+
+    for (k = 0; k + 16 <= count; k += 16) {
+        __m256i m0 = _mm256_loadu_si256((const __m256i*)(mix_buf + k));
+        __m256i m1 = _mm256_loadu_si256((const __m256i*)(mix_buf + k + 8));
+
+        m0 = _mm256_add_epi32(m0, load_sext_avx2(samples + k));
+        m1 = _mm256_add_epi32(m1, load_sext_avx2(samples + k + 8));
+        _mm256_storeu_si256((__m256i*)(mix_buf + k), m0);
+        _mm256_storeu_si256((__m256i*)(mix_buf + k + 8), m1);
+
+        vmin = _mm256_min_epi32(vmin, _mm256_min_epi32(m0, m1));
+        vmax = _mm256_max_epi32(vmax, _mm256_max_epi32(m0, m1));
+    }
+
+    _mm256_storeu_si256((__m256i*)v, vmin);
+    for (i = 0; i < 8; ++i) {
+        if (v[i] < *p_min) *p_min = v[i];
+    }
+    _mm256_storeu_si256((__m256i*)v, vmax);
+    for (i = 0; i < 8; ++i) {
+        if (v[i] > *p_max) *p_max = v[i];
+    }
+
+    add_scalar(mix_buf + k, samples + k, count - k, p_min, p_max);
+}
+
+TARGET_AVX2
+static void sub_avx2(pj_int32_t *dst, const pj_int32_t *mix_buf,
+                     const pj_int16_t *samples, unsigned count,
+                     pj_int32_t *p_min, pj_int32_t *p_max)
+{
+    __m256i vmin = _mm256_setzero_si256();
+    __m256i vmax = _mm256_setzero_si256();
+    pj_int32_t v[8];
+    unsigned k, i;
+
+    for (k = 0; k + 16 <= count; k += 16) {
+        __m256i m0 = _mm256_loadu_si256((const __m256i*)(mix_buf + k));
+        __m256i m1 = _mm256_loadu_si256((const __m256i*)(mix_buf + k + 8));
+
+        m0 = _mm256_sub_epi32(m0, load_sext_avx2(samples + k));
+        m1 = _mm256_sub_epi32(m1, load_sext_avx2(samples + k + 8));
+        _mm256_storeu_si256((__m256i*)(dst + k), m0);
+        _mm256_storeu_si256((__m256i*)(dst + k + 8), m1);
+
+        vmin = _mm256_min_epi32(vmin, _mm256_min_epi32(m0, m1));
+        vmax = _mm256_max_epi32(vmax, _mm256_max_epi32(m0, m1));
+    }
+
+    _mm256_storeu_si256((__m256i*)v, vmin);
+    for (i = 0; i < 8; ++i) {
+        if (v[i] < *p_min) *p_min = v[i];
+    }
+    _mm256_storeu_si256((__m256i*)v, vmax);
+    for (i = 0; i < 8; ++i) {
+        if (v[i] > *p_max) *p_max = v[i];
+    }
+
+    sub_scalar(dst + k, mix_buf + k, samples + k, count - k, p_min, p_max);
+}
+
+TARGET_AVX2
+static void copy_avx2(pj_int32_t *mix_buf, const pj_int16_t *samples,
+                      unsigned count)
+{
+    unsigned k;
+
+    for (k = 0; k + 8 <= count; k += 8) {
+        _mm256_storeu_si256((__m256i*)(mix_buf + k),
+                            load_sext_avx2(samples + k));
+    }
+
+    copy_scalar(mix_buf + k, samples + k, count - k);
+}
+
+TARGET_AVX2
+static pj_uint32_t adjust_avx2(pj_int16_t *dst, const pj_int16_t *src,
+                               unsigned count, unsigned adj_level)
+{
+    __m256i vadj = _mm256_set1_epi32((int)adj_level);
+    __m256i acc = _mm256_setzero_si256();
+    unsigned k;
+
+    for (k = 0; k + 16 <= count; k += 16) {
+        __m256i lo = load_sext_avx2(src + k);
+        __m256i hi = load_sext_avx2(src + k + 8);
+
+        lo = clip_avx2(_mm256_srai_epi32(_mm256_mullo_epi32(lo, vadj), 7));
+        hi = clip_avx2(_mm256_srai_epi32(_mm256_mullo_epi32(hi, vadj), 7));
+
+        _mm256_storeu_si256((__m256i*)(dst + k), packs_avx2(lo, hi));
+        acc = _mm256_add_epi32(acc, _mm256_abs_epi32(lo));
+        acc = _mm256_add_epi32(acc, _mm256_abs_epi32(hi));
+    }
+
+    return hsum_avx2(acc) +
+           adjust_scalar(dst + k, src + k, count - k, adj_level);
+}
+
+TARGET_AVX2
+static pj_uint32_t to_samples_avx2(pj_int16_t *dst, const pj_int32_t *mix_buf,
+                                   unsigned count, unsigned adj_level)
+{
+    __m256i vadj = _mm256_set1_epi32((int)adj_level);
+    __m256i acc = _mm256_setzero_si256();
+    unsigned k;
+
+    /* See to_samples_sse2() on writing to mix_buf */
+    for (k = 0; k + 16 <= count; k += 16) {
+        __m256i m0 = _mm256_loadu_si256((const __m256i*)(mix_buf + k));
+        __m256i m1 = _mm256_loadu_si256((const __m256i*)(mix_buf + k + 8));
+
+        if (adj_level != NORMAL_LEVEL) {
+            m0 = _mm256_srai_epi32(_mm256_mullo_epi32(m0, vadj), 7);
+            m1 = _mm256_srai_epi32(_mm256_mullo_epi32(m1, vadj), 7);
+        }
+        m0 = clip_avx2(m0);
+        m1 = clip_avx2(m1);
+
+        _mm256_storeu_si256((__m256i*)(dst + k), packs_avx2(m0, m1));
+        acc = _mm256_add_epi32(acc, _mm256_abs_epi32(m0));
+        acc = _mm256_add_epi32(acc, _mm256_abs_epi32(m1));
+    }
+
+    return hsum_avx2(acc) +
+           to_samples_scalar(dst + k, mix_buf + k, count - k, adj_level);
+}
+
+TARGET_AVX2
+static pj_uint32_t sum_abs_avx2(const pj_int16_t *samples, unsigned count)
+{
+    __m256i acc = _mm256_setzero_si256();
+    unsigned k;
+
+    for (k = 0; k + 8 <= count; k += 8) {
+        __m256i x = load_sext_avx2(samples + k);
+        acc = _mm256_add_epi32(acc, _mm256_abs_epi32(x));
+    }
+
+    return hsum_avx2(acc) + sum_abs_scalar(samples + k, count - k);
+}
+
+static const mix_ops avx2_ops =
+{
+    PJMEDIA_MIX_IMPL_AVX2, "AVX2",
+    &add_avx2, &sub_avx2, &copy_avx2, &adjust_avx2, &to_samples_avx2,
+    &sum_abs_avx2
+};
+
+
+/*
+ * CPU feature detection.
+ */
+#if defined(_MSC_VER)
+
+static pj_bool_t cpu_has_sse2(void)
+{
+    int info[4];
+
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+}
+
+static pj_bool_t cpu_has_avx2(void)
+{
+    int info[4];
+
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return PJ_FALSE;
+
+    /* Need OSXSAVE and AVX, and the OS must save the YMM registers */
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+        return PJ_FALSE;
+    if ((_xgetbv(0) & 6) != 6)
+        return PJ_FALSE;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+
+#else
+
+static pj_bool_t cpu_has_sse2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") != 0;
+}
+
+static pj_bool_t cpu_has_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+}
+
+#endif
+
+#endif  /* PJMEDIA_HAS_MIX_SIMD */
+
+
+/* The implementation in use, selected on first use. */
+static const mix_ops *mix_op;
+
+static const mix_ops *get_ops(pjmedia_mix_impl impl)
+{
+    switch (impl) {
+    case PJMEDIA_MIX_IMPL_AUTO:
+#if PJMEDIA_HAS_MIX_SIMD
+        if (cpu_has_avx2())
+            return &avx2_ops;
+        if (cpu_has_sse2())
+            return &sse2_ops;
+#endif
+        return &scalar_ops;
+    case PJMEDIA_MIX_IMPL_SCALAR:
+        return &scalar_ops;
+#if PJMEDIA_HAS_MIX_SIMD
+    case PJMEDIA_MIX_IMPL_SSE2:
+        return cpu_has_sse2() ? &sse2_ops : NULL;
+    case PJMEDIA_MIX_IMPL_AVX2:
+        return cpu_has_avx2() ? &avx2_ops : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static const mix_ops *ops(void)
+{
+    /* Racing on the first call is harmless, all callers will select the
+     * same implementation.
+     */
+    if (!mix_op) {
+        mix_op = get_ops(PJMEDIA_MIX_IMPL_AUTO);
+        PJ_LOG(5,(THIS_FILE, "Using %s mixing routines", mix_op->name));
+    }
+    return mix_op;
+}
+
+
+PJ_DEF(pj_status_t) pjmedia_mix_set_impl(pjmedia_mix_impl impl)
+{
+    const mix_ops *op = get_ops(impl);
+
+    if (!op)
+        return PJ_ENOTSUP;
+
+    mix_op = op;
+    PJ_LOG(5,(THIS_FILE, "Using %s mixing routines", mix_op->name));
+
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(pjmedia_mix_impl) pjmedia_mix_get_impl(void)
+{
+    return ops()->impl;
+}
+
+
+PJ_DEF(void) pjmedia_mix_add_samples(pj_int32_t mix_buf[],
+                                     const pj_int16_t samples[],
+                                     unsigned count,
+                                     pj_int32_t *p_min,
+                                     pj_int32_t *p_max)
+{
+    pj_int32_t mix_min = 0, mix_max = 0;
+
+    ops()->add(mix_buf, samples, count, &mix_min, &mix_max);
+
+    if (p_min) *p_min = mix_min;
+    if (p_max) *p_max = mix_max;
+}
+
+
+PJ_DEF(void) pjmedia_mix_sub_samples(pj_int32_t dst[],
+                                     const pj_int32_t mix_buf[],
+                                     const pj_int16_t samples[],
+                                     unsigned count,
+                                     pj_int32_t *p_min,
+                                     pj_int32_t *p_max)
+{
+    pj_int32_t mix_min = 0, mix_max = 0;
+
+    ops()->sub(dst, mix_buf, samples, count, &mix_min, &mix_max);
+
+    if (p_min) *p_min = mix_min;
+    if (p_max) *p_max = mix_max;
+}
+
+
+PJ_DEF(void) pjmedia_mix_copy_samples(pj_int32_t mix_buf[],
+                                      const pj_int16_t samples[],
+                                      unsigned count)
+{
+    ops()->copy(mix_buf, samples, count);
+}
+
+
+PJ_DEF(pj_uint32_t) pjmedia_mix_adjust_samples(pj_int16_t dst[],
+                                               const pj_int16_t src[],
+                                               unsigned count,
+                                               unsigned adj_level)
+{
+    return ops()->adjust(dst, src, count, adj_level);
+}
+
+
+PJ_DEF(pj_uint32_t) pjmedia_mix_to_samples(pj_int16_t dst[],
+                                           const pj_int32_t mix_buf[],
+                                           unsigned count,
+                                           unsigned adj_level)
+{
+    return ops()->to_samples(dst, mix_buf, count, adj_level);
+}
+
+
+PJ_DEF(pj_uint32_t) pjmedia_mix_sum_abs(const pj_int16_t samples[],
+                                        unsigned count)
+{
+    return ops()->sum_abs(samples, count);
+}
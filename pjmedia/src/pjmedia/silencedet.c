@@ -19,6 +19,7 @@
 #include <pjmedia/silencedet.h>
 #include <pjmedia/alaw_ulaw.h>
 #include <pjmedia/errno.h>
+#include <pjmedia/mix.h>
 #include <pj/assert.h>
 #include <pj/log.h>
 #include <pj/pool.h>
@@ -189,20 +190,12 @@ PJ_DEF(pj_status_t) pjmedia_silence_det_disable( pjmedia_silence_det *sd )
 PJ_DEF(pj_int32_t) pjmedia_calc_avg_signal( const pj_int16_t samples[],
                                             pj_size_t count)
 {
-    pj_uint32_t sum = 0;
-    
-    const pj_int16_t * pcm = samples;
-    const pj_int16_t * end = samples + count;
+    pj_uint32_t sum;
 
     if (count==0)
         return 0;
 
-    while (pcm != end) {
-        if (*pcm < 0)
-            sum -= *pcm++;
-        else
-            sum += *pcm++;
-    }
+    sum = pjmedia_mix_sum_abs(samples, (unsigned)count);
     
     return (pj_int32_t)(sum / count);
 }
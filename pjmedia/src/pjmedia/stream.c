@@ -21,6 +21,8 @@
 #include <pjmedia/rtp.h>
 #include <pjmedia/rtcp.h>
 #include <pjmedia/jbuf.h>
+#include <pjmedia/circbuf.h>
+#include <pjmedia/wsola.h>
 #include <pj/array.h>
 #include <pj/assert.h>
 #include <pj/ctype.h>
@@ -49,6 +51,12 @@
  */
 #define MAX_PLC_MSEC                    PJMEDIA_MAX_PLC_DURATION_MSEC
 
+/* Time-stretching buffer size, in frames, and the number of decoded
+ * frames WSOLA needs as history before it can synthesize a frame.
+ */
+#define TS_BUF_FRAME_CNT                4
+#define TS_MIN_HIST_CNT                 2
+
 
 /* Tracing jitter buffer operations in a stream session to a CSV file.
  * The trace will contain JB operation timestamp, frame info, RTP info, and
@@ -152,6 +160,15 @@ struct pjmedia_stream
     unsigned                 plc_cnt;       /**< # of consecutive PLC frames*/
     unsigned                 max_plc_cnt;   /**< Max # of PLC frames        */
 
+    pjmedia_wsola           *ts_wsola;      /**< Time-stretcher, for delay-
+                                                 based jitter buffer.       */
+    pjmedia_circ_buf        *ts_buf;        /**< Decoded samples to play.   */
+    pj_int16_t              *ts_frm;        /**< Decoding/synthesis frame.  */
+    unsigned                 ts_hist_cnt;   /**< # of frames in WSOLA hist. */
+    pj_bool_t                ts_expanded;   /**< Last frame was synthesized?*/
+    unsigned                 ts_fill_cnt;   /**< # of samples filled by PLC
+                                                 or silence without GET.    */
+
     unsigned                 vad_enabled;   /**< VAD enabled in param.      */
     unsigned                 frame_size;    /**< Size of encoded base frame.*/
     pj_bool_t                is_streaming;  /**< Currently streaming?. This
@@ -512,40 +529,15 @@ static void send_keep_alive_packet(pjmedia_stream *stream)
 }
 #endif  /* defined(PJMEDIA_STREAM_ENABLE_KA) */
 
-/*
- * play_callback()
- *
- * This callback is called by sound device's player thread when it
- * needs to feed the player with some frames.
+/* Get frames from the jitter buffer and decode them into one audio frame,
+ * frame type will be PJMEDIA_FRAME_TYPE_NONE if nothing is decoded.
  */
-static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
+static void decode_frames(pjmedia_stream *stream, pjmedia_frame *frame)
 {
-    pjmedia_stream *stream = (pjmedia_stream*) port->port_data.pdata;
-    pjmedia_channel *channel = stream->dec;
     unsigned samples_count, samples_per_frame, samples_required;
     pj_int16_t *p_out_samp;
     pj_status_t status;
 
-
-    /* Return no frame is channel is paused */
-    if (channel->paused) {
-        frame->type = PJMEDIA_FRAME_TYPE_NONE;
-        return PJ_SUCCESS;
-    }
-
-    if (stream->soft_start_cnt) {
-        if (stream->soft_start_cnt == PJMEDIA_STREAM_SOFT_START) {
-            PJ_LOG(4,(stream->port.info.name.ptr,
-                      "Resetting jitter buffer in stream playback start"));
-            pj_mutex_lock( stream->jb_mutex );
-            pjmedia_jbuf_reset(stream->jb);
-            pj_mutex_unlock( stream->jb_mutex );
-        }
-        --stream->soft_start_cnt;
-        frame->type = PJMEDIA_FRAME_TYPE_NONE;
-        return PJ_SUCCESS;
-    }
-
     /* Repeat get frame from the jitter buffer and decode the frame
      * until we have enough frames according to codec's ptime.
      */
@@ -563,8 +555,11 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
 
     for (samples_count=0; samples_count < samples_required;) {
         char frame_type;
-        pj_size_t frame_size = channel->out_pkt_size;
+        pj_size_t frame_size;
         pj_uint32_t bit_info;
+        const void *frame_data;
+        pjmedia_jb_buf *frame_buf;
+        unsigned get_pos = samples_count;
 
         if (stream->dec_buf && stream->dec_buf_pos < stream->dec_buf_count) {
             unsigned nsamples_req = samples_required - samples_count;
@@ -580,9 +575,10 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
             continue;
         }
 
-        /* Get frame from jitter buffer. */
-        pjmedia_jbuf_get_frame2(stream->jb, channel->out_pkt, &frame_size,
-                                &frame_type, &bit_info);
+        /* Get frame from jitter buffer, the decoder reads it in place. */
+        pjmedia_jbuf_borrow_frame(stream->jb, &frame_data, &frame_buf,
+                                  &frame_size, &frame_type, &bit_info,
+                                  NULL, NULL);
 
 #if TRACE_JB
         trace_jb_get(stream, frame_type, frame_size);
@@ -671,6 +667,11 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
                 samples_count = samples_required;
             }
 
+            /* One GET has filled the rest of the frame */
+            if (stream->ts_buf && samples_count - get_pos > samples_per_frame)
+                stream->ts_fill_cnt += samples_count - get_pos -
+                                       samples_per_frame;
+
             if (stream->jb_last_frm != frame_type) {
                 pjmedia_jb_state jb_state;
 
@@ -725,6 +726,11 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
                 samples_count = samples_required;
             }
 
+            /* One GET has filled the rest of the frame */
+            if (stream->ts_buf && samples_count - get_pos > samples_per_frame)
+                stream->ts_fill_cnt += samples_count - get_pos -
+                                       samples_per_frame;
+
             if (stream->jb_last_frm != frame_type) {
                 pjmedia_jb_state jb_state;
 
@@ -749,7 +755,7 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
             stream->plc_cnt = 0;
 
             /* Decode */
-            frame_in.buf = channel->out_pkt;
+            frame_in.buf = (void*)frame_data;
             frame_in.size = frame_size;
             frame_in.bit_info = bit_info;
             frame_in.type = PJMEDIA_FRAME_TYPE_AUDIO;  /* ignored */
@@ -770,8 +776,11 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
             status = pjmedia_codec_decode( stream->codec, &frame_in,
                                            (unsigned)frame_out.size,
                                            &frame_out);
+            if (frame_buf)
+                pjmedia_jbuf_release_buf(stream->jb, frame_buf);
+
             if (status != 0) {
-                LOGERR_((port->info.name.ptr, status,
+                LOGERR_((stream->port.info.name.ptr, status,
                          "codec decode() error"));
 
                 if (use_dec_buf) {
@@ -818,6 +827,186 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
         frame->size = samples_count * BYTES_PER_SAMPLE;
         frame->timestamp.u64 = 0;
     }
+}
+
+
+/* Reset time-stretching state, e.g: when jitter buffer is reset. */
+static void reset_stretch(pjmedia_stream *stream)
+{
+    pjmedia_circ_buf_reset(stream->ts_buf);
+    pjmedia_wsola_reset(stream->ts_wsola, 0);
+    stream->ts_hist_cnt = 0;
+    stream->ts_expanded = PJ_FALSE;
+}
+
+
+/* Duration of the specified number of samples, in usec. */
+static int stretch_usec(pjmedia_stream *stream, unsigned samples)
+{
+    return (int)((pj_uint64_t)samples * 1000000 /
+                 (PJMEDIA_PIA_SRATE(&stream->port.info) *
+                  PJMEDIA_PIA_CCNT(&stream->port.info)));
+}
+
+
+/* Get frame with time-stretching, for delay-based jitter buffer
+ * (PJMEDIA_JB_DISCARD_DELAY). Decoded audio is queued in ts_buf, when the
+ * jitter buffer latency is above its target, one more frame is decoded
+ * and WSOLA erases about half a frame from the queue, when the latency
+ * is below the target, WSOLA synthesizes a frame instead of decoding one.
+ */
+static void get_frame_stretch(pjmedia_stream *stream, pjmedia_frame *frame)
+{
+    unsigned spf = PJMEDIA_PIA_SPF(&stream->port.info);
+    unsigned len, needed;
+    int adjust;
+    pj_status_t status;
+
+    pj_mutex_lock( stream->jb_mutex );
+    adjust = pjmedia_jbuf_get_delay_adjust(stream->jb);
+    pj_mutex_unlock( stream->jb_mutex );
+
+    stream->ts_fill_cnt = 0;
+
+    len = pjmedia_circ_buf_get_len(stream->ts_buf);
+
+    /* Lengthen the audio, but not with two synthesized frames in a row */
+    if (adjust < 0 && len < spf && !stream->ts_expanded &&
+        stream->ts_hist_cnt >= TS_MIN_HIST_CNT)
+    {
+        status = pjmedia_wsola_generate(stream->ts_wsola, stream->ts_frm);
+        if (status == PJ_SUCCESS) {
+            pjmedia_circ_buf_write(stream->ts_buf, stream->ts_frm, spf);
+            stream->ts_expanded = PJ_TRUE;
+            len += spf;
+
+            pj_mutex_lock( stream->jb_mutex );
+            pjmedia_jbuf_time_stretched(stream->jb, stretch_usec(stream, spf));
+            pj_mutex_unlock( stream->jb_mutex );
+        }
+    }
+
+    /* Decode more frames to be played and, if latency is too high, to
+     * be compressed. A synthesized frame adds a whole packet of jitter
+     * buffer frames, the latency must exceed the target by that much or
+     * it would be compressed right back.
+     */
+    if (adjust > 0 && adjust < (int)stream->codec_param.setting.frm_per_pkt)
+        adjust = 0;
+
+    needed = spf;
+    if (adjust > 0 && stream->ts_hist_cnt >= TS_MIN_HIST_CNT)
+        needed = spf * 2;
+
+    while (len < needed) {
+        pjmedia_frame frm;
+
+        frm.buf = stream->ts_frm;
+        frm.size = spf * BYTES_PER_SAMPLE;
+        decode_frames(stream, &frm);
+
+        if (frm.type != PJMEDIA_FRAME_TYPE_AUDIO) {
+            /* Nothing decoded, history is no longer continuous */
+            pjmedia_wsola_reset(stream->ts_wsola, 0);
+            stream->ts_hist_cnt = 0;
+            stream->ts_expanded = PJ_FALSE;
+            break;
+        }
+
+        pjmedia_wsola_save(stream->ts_wsola, stream->ts_frm,
+                           stream->ts_expanded);
+        pjmedia_circ_buf_write(stream->ts_buf, stream->ts_frm, spf);
+        stream->ts_expanded = PJ_FALSE;
+        if (stream->ts_hist_cnt < TS_MIN_HIST_CNT)
+            ++stream->ts_hist_cnt;
+        len += spf;
+    }
+
+    /* Audio concealed by a single GET is played without GET too */
+    if (stream->ts_fill_cnt) {
+        pj_mutex_lock( stream->jb_mutex );
+        pjmedia_jbuf_time_stretched(stream->jb,
+                                    stretch_usec(stream, stream->ts_fill_cnt));
+        pj_mutex_unlock( stream->jb_mutex );
+    }
+
+    /* Shorten the audio */
+    if (adjust > 0 && len >= spf * 2) {
+        pj_int16_t *buf1, *buf2;
+        unsigned buf1_len, buf2_len, erase_cnt = spf >> 1;
+
+        pjmedia_circ_buf_get_read_regions(stream->ts_buf, &buf1, &buf1_len,
+                                          &buf2, &buf2_len);
+        status = pjmedia_wsola_discard(stream->ts_wsola, buf1, buf1_len,
+                                       buf2, buf2_len, &erase_cnt);
+        if (status == PJ_SUCCESS && erase_cnt < len) {
+            len -= erase_cnt;
+            pjmedia_circ_buf_set_len(stream->ts_buf, len);
+
+            pj_mutex_lock( stream->jb_mutex );
+            pjmedia_jbuf_time_stretched(stream->jb,
+                                        -stretch_usec(stream, erase_cnt));
+            pj_mutex_unlock( stream->jb_mutex );
+        }
+    }
+
+    if (len == 0) {
+        frame->type = PJMEDIA_FRAME_TYPE_NONE;
+        frame->size = 0;
+        return;
+    }
+
+    /* Play what we have, pad with silence if it's not enough */
+    if (len < spf) {
+        pjmedia_circ_buf_read(stream->ts_buf, (pj_int16_t*)frame->buf, len);
+        pjmedia_zero_samples((pj_int16_t*)frame->buf + len, spf - len);
+    } else {
+        pjmedia_circ_buf_read(stream->ts_buf, (pj_int16_t*)frame->buf, spf);
+    }
+
+    frame->type = PJMEDIA_FRAME_TYPE_AUDIO;
+    frame->size = spf * BYTES_PER_SAMPLE;
+    frame->timestamp.u64 = 0;
+}
+
+
+/*
+ * play_callback()
+ *
+ * This callback is called by sound device's player thread when it
+ * needs to feed the player with some frames.
+ */
+static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
+{
+    pjmedia_stream *stream = (pjmedia_stream*) port->port_data.pdata;
+    pjmedia_channel *channel = stream->dec;
+
+    /* Return no frame is channel is paused */
+    if (channel->paused) {
+        frame->type = PJMEDIA_FRAME_TYPE_NONE;
+        return PJ_SUCCESS;
+    }
+
+    if (stream->soft_start_cnt) {
+        if (stream->soft_start_cnt == PJMEDIA_STREAM_SOFT_START) {
+            PJ_LOG(4,(stream->port.info.name.ptr,
+                      "Resetting jitter buffer in stream playback start"));
+            pj_mutex_lock( stream->jb_mutex );
+            pjmedia_jbuf_reset(stream->jb);
+            pj_mutex_unlock( stream->jb_mutex );
+
+            if (stream->ts_wsola)
+                reset_stretch(stream);
+        }
+        --stream->soft_start_cnt;
+        frame->type = PJMEDIA_FRAME_TYPE_NONE;
+        return PJ_SUCCESS;
+    }
+
+    if (stream->ts_wsola)
+        get_frame_stretch(stream, frame);
+    else
+        decode_frames(stream, frame);
 
     return PJ_SUCCESS;
 }
@@ -2814,6 +3003,30 @@ PJ_DEF(pj_status_t) pjmedia_stream_create( pjmedia_endpt *endpt,
     pjmedia_jbuf_set_adaptive( stream->jb, jb_init, jb_min_pre, jb_max_pre);
     pjmedia_jbuf_set_discard(stream->jb, info->jb_discard_algo);
 
+    /* Delay-based jitter buffer needs the decoded audio to be
+     * time-stretched to follow its target latency.
+     */
+    if (info->jb_discard_algo == PJMEDIA_JB_DISCARD_DELAY &&
+        stream->port.get_frame == &get_frame)
+    {
+        unsigned spf = PJMEDIA_PIA_SPF(&stream->port.info);
+
+        status = pjmedia_wsola_create(pool, afd->clock_rate, spf,
+                                      afd->channel_count,
+                                      PJMEDIA_WSOLA_NO_FADING,
+                                      &stream->ts_wsola);
+        if (status != PJ_SUCCESS)
+            goto err_cleanup;
+
+        status = pjmedia_circ_buf_create(pool, spf * TS_BUF_FRAME_CNT,
+                                         &stream->ts_buf);
+        if (status != PJ_SUCCESS)
+            goto err_cleanup;
+
+        stream->ts_frm = (pj_int16_t*)pj_pool_alloc(pool, spf *
+                                                    sizeof(pj_int16_t));
+    }
+
     /* Create decoder channel: */
 
     status = create_channel( pool, stream, PJMEDIA_DIR_DECODING,
@@ -3158,6 +3371,11 @@ PJ_DEF(pj_status_t) pjmedia_stream_destroy( pjmedia_stream *stream )
     if (stream->jb)
         pjmedia_jbuf_destroy(stream->jb);
 
+    if (stream->ts_wsola) {
+        pjmedia_wsola_destroy(stream->ts_wsola);
+        stream->ts_wsola = NULL;
+    }
+
 #if TRACE_JB
     if (TRACE_JB_OPENED(stream)) {
         pj_file_close(stream->trace_jb_fd);
@@ -3302,6 +3520,25 @@ PJ_DEF(pj_status_t) pjmedia_stream_get_stat_jbuf(const pjmedia_stream *stream,
     return pjmedia_jbuf_get_state(stream->jb, state);
 }
 
+/*
+ * Get the duration of the time-stretching queue.
+ */
+PJ_DEF(pj_status_t) pjmedia_stream_get_stretch_delay(
+                                            const pjmedia_stream *stream,
+                                            unsigned *msec)
+{
+    PJ_ASSERT_RETURN(stream && msec, PJ_EINVAL);
+
+    *msec = 0;
+    if (stream->ts_buf) {
+        *msec = (unsigned)
+                ((pj_uint64_t)pjmedia_circ_buf_get_len(stream->ts_buf) *
+                 1000 / (PJMEDIA_PIA_SRATE(&stream->port.info) *
+                         PJMEDIA_PIA_CCNT(&stream->port.info)));
+    }
+    return PJ_SUCCESS;
+}
+
 /*
  * Pause stream.
  */
@@ -256,7 +256,9 @@ typedef struct transport_srtp
 {
     pjmedia_transport    base;              /**< Base transport interface.  */
     pj_pool_t           *pool;              /**< Pool for transport SRTP.   */
-    pj_lock_t           *mutex;             /**< Mutex for libsrtp contexts.*/
+    pj_lock_t           *mutex;             /**< Mutex for session state.   */
+    pj_lock_t           *tx_mutex;          /**< Mutex for TX libsrtp use.  */
+    pj_lock_t           *rx_mutex;          /**< Mutex for RX libsrtp use.  */
     char                 rtp_tx_buffer[MAX_RTP_BUFFER_LEN];
     char                 rtcp_tx_buffer[MAX_RTCP_BUFFER_LEN];
     pjmedia_srtp_setting setting;
@@ -433,6 +435,8 @@ static pj_status_t create_srtp_ctx(transport_srtp *srtp,
                                    const pjmedia_srtp_crypto *rx);
 /* Destroy SRTP context */
 static void destroy_srtp_ctx(transport_srtp *p_srtp, srtp_context *ctx);
+static void swap_srtp_ctx(transport_srtp *srtp, srtp_context *ctx,
+                          srtp_t *tx_ctx, srtp_t *rx_ctx);
 
 /* SRTP destroy handler */
 static void srtp_on_destroy(void *arg);
@@ -521,6 +525,11 @@ PJ_DEF(pj_status_t) pjmedia_transport_srtp_dtls_get_fingerprint(
 }
 #endif
 
+/* AES-NI implementation of AES_CM_128 cipher */
+#if defined(PJMEDIA_SRTP_HAS_AESNI) && (PJMEDIA_SRTP_HAS_AESNI != 0)
+#  include "transport_srtp_aesni.c"
+#endif
+
 
 static pj_bool_t libsrtp_initialized;
 static void pjmedia_srtp_deinit_lib(pjmedia_endpt *endpt);
@@ -547,6 +556,11 @@ PJ_DEF(pj_status_t) pjmedia_srtp_init_lib(pjmedia_endpt *endpt)
     }
 #endif
 
+#if defined(PJMEDIA_SRTP_HAS_AESNI) && (PJMEDIA_SRTP_HAS_AESNI != 0)
+    /* Install the selected AES_CM_128 cipher implementation */
+    aesni_set_impl(aes_impl_req);
+#endif
+
 #if defined(PJMEDIA_SRTP_HAS_DTLS) && (PJMEDIA_SRTP_HAS_DTLS != 0)
     dtls_init();
 #endif
@@ -606,10 +620,51 @@ static void pjmedia_srtp_deinit_lib(pjmedia_endpt *endpt)
     dtls_deinit();
 #endif
 
+#if defined(PJMEDIA_SRTP_HAS_AESNI) && (PJMEDIA_SRTP_HAS_AESNI != 0) && \
+    PJMEDIA_LIBSRTP_AUTO_INIT_DEINIT
+    /* libsrtp is back to its own ciphers */
+    aes_impl = PJMEDIA_SRTP_CIPHER_IMPL_LIBSRTP;
+#endif
+
     libsrtp_initialized = PJ_FALSE;
 }
 
 
+/*
+ * Select the AES_CM_128 cipher implementation.
+ */
+PJ_DEF(pj_status_t) pjmedia_srtp_set_cipher_impl(pjmedia_srtp_cipher_impl impl)
+{
+#if defined(PJMEDIA_SRTP_HAS_AESNI) && (PJMEDIA_SRTP_HAS_AESNI != 0)
+    pj_status_t status = PJ_SUCCESS;
+
+    /* The crypto kernel does not exist before libsrtp is initialized */
+    if (libsrtp_initialized)
+        status = aesni_set_impl(impl);
+    else if (!aesni_supported(impl))
+        status = PJ_ENOTSUP;
+
+    if (status == PJ_SUCCESS)
+        aes_impl_req = impl;
+    return status;
+#else
+    return (impl == PJMEDIA_SRTP_CIPHER_IMPL_AUTO ||
+            impl == PJMEDIA_SRTP_CIPHER_IMPL_LIBSRTP) ? PJ_SUCCESS :
+                                                        PJ_ENOTSUP;
+#endif
+}
+
+
+PJ_DEF(pjmedia_srtp_cipher_impl) pjmedia_srtp_get_cipher_impl(void)
+{
+#if defined(PJMEDIA_SRTP_HAS_AESNI) && (PJMEDIA_SRTP_HAS_AESNI != 0)
+    return libsrtp_initialized ? aes_impl : aes_impl_req;
+#else
+    return PJMEDIA_SRTP_CIPHER_IMPL_LIBSRTP;
+#endif
+}
+
+
 static int get_crypto_idx(const pj_str_t* crypto_name)
 {
     int i;
@@ -795,6 +850,24 @@ PJ_DEF(pj_status_t) pjmedia_transport_srtp_create(
         return status;
     }
 
+    /* The two directions have separate locks, so that sending (usually
+     * on the clock thread) and receiving (on the ioqueue thread) don't
+     * block each other.
+     */
+    status = pj_lock_create_recursive_mutex(pool, pool->obj_name,
+                                            &srtp->tx_mutex);
+    if (status == PJ_SUCCESS) {
+        status = pj_lock_create_recursive_mutex(pool, pool->obj_name,
+                                                &srtp->rx_mutex);
+    }
+    if (status != PJ_SUCCESS) {
+        if (srtp->tx_mutex)
+            pj_lock_destroy(srtp->tx_mutex);
+        pj_lock_destroy(srtp->mutex);
+        pj_pool_release(pool);
+        return status;
+    }
+
     /* Initialize base pjmedia_transport */
     pj_memcpy(srtp->base.name, pool->obj_name, PJ_MAX_OBJ_NAME);
     if (tp)
@@ -888,6 +961,8 @@ static pj_status_t create_srtp_ctx(transport_srtp *srtp,
 {
     srtp_policy_t    tx_;
     srtp_policy_t    rx_;
+    srtp_t           tx_ctx = NULL;
+    srtp_t           rx_ctx = NULL;
     srtp_err_status_t err;
     int              cr_tx_idx = 0;
     int              au_tx_idx = 0;
@@ -897,8 +972,11 @@ static pj_status_t create_srtp_ctx(transport_srtp *srtp,
 
     pj_lock_acquire(srtp->mutex);
 
-    if (ctx->srtp_tx_ctx || ctx->srtp_rx_ctx)
-        destroy_srtp_ctx(srtp, ctx);
+    /* The new contexts are set up aside while the data path keeps using
+     * the current ones, and replaced at the end.
+     */
+    pj_bzero(&ctx->rx_policy, sizeof(ctx->rx_policy));
+    pj_bzero(&ctx->tx_policy, sizeof(ctx->tx_policy));
 
     /* Get encryption and authentication method */
     cr_tx_idx = au_tx_idx = get_crypto_idx(&tx->name);
@@ -966,7 +1044,7 @@ static pj_status_t create_srtp_ctx(transport_srtp *srtp,
     tx_.rtcp                = tx_.rtp;
     tx_.rtcp.auth_tag_len   = crypto_suites[au_tx_idx].srtcp_auth_tag_len;
     tx_.next                = NULL;
-    err = srtp_create(&ctx->srtp_tx_ctx, &tx_);
+    err = srtp_create(&tx_ctx, &tx_);
     if (err != srtp_err_status_ok) {
         status = PJMEDIA_ERRNO_FROM_LIBSRTP(err);
         goto on_return;
@@ -974,7 +1052,7 @@ static pj_status_t create_srtp_ctx(transport_srtp *srtp,
     if (setting->tx_roc.roc != 0 &&
         setting->tx_roc.ssrc != 0)
     {
-        err = srtp_set_stream_roc(ctx->srtp_tx_ctx,
+        err = srtp_set_stream_roc(tx_ctx,
                                   setting->tx_roc.ssrc,
                                   setting->tx_roc.roc);
         PJ_LOG(4, (THIS_FILE, "Initializing SRTP TX ROC to SSRC %d with "
@@ -1017,16 +1095,17 @@ static pj_status_t create_srtp_ctx(transport_srtp *srtp,
     rx_.rtcp                = rx_.rtp;
     rx_.rtcp.auth_tag_len   = crypto_suites[au_rx_idx].srtcp_auth_tag_len;
     rx_.next                = NULL;
-    err = srtp_create(&ctx->srtp_rx_ctx, &rx_);
+    err = srtp_create(&rx_ctx, &rx_);
     if (err != srtp_err_status_ok) {
-        srtp_dealloc(ctx->srtp_tx_ctx);
+        srtp_dealloc(tx_ctx);
+        tx_ctx = NULL;
         status = PJMEDIA_ERRNO_FROM_LIBSRTP(err);
         goto on_return;
     }
     if (setting->rx_roc.roc != 0 &&
         setting->rx_roc.ssrc != 0)
     {
-        err = srtp_set_stream_roc(ctx->srtp_rx_ctx,
+        err = srtp_set_stream_roc(rx_ctx,
                                   setting->rx_roc.ssrc,
                                   setting->rx_roc.roc);
         PJ_LOG(4, (THIS_FILE, "Initializing SRTP RX ROC from SSRC %d with "
@@ -1081,6 +1160,13 @@ static pj_status_t create_srtp_ctx(transport_srtp *srtp,
 #endif
 
 on_return:
+    /* Replace the current contexts (if any), with the new ones */
+    swap_srtp_ctx(srtp, ctx, &tx_ctx, &rx_ctx);
+    if (rx_ctx)
+        srtp_dealloc(rx_ctx);
+    if (tx_ctx)
+        srtp_dealloc(tx_ctx);
+
     pj_lock_release(srtp->mutex);
     return status;
 }
@@ -1100,18 +1186,18 @@ PJ_DEF(pj_status_t) pjmedia_transport_srtp_start(
 
     pj_lock_acquire(srtp->mutex);
 
+    /* On restart, the new contexts replace the current ones without
+     * stopping the session, so the media flow is not interrupted.
+     */
     if (srtp->session_inited) {
-        pjmedia_transport_srtp_stop(tp);
+        destroy_srtp_ctx(srtp, &srtp->srtp_rtcp);
     }
 
     status = create_srtp_ctx(srtp, &srtp->srtp_ctx, &srtp->setting, tx, rx);
-    if (status == PJ_SUCCESS) {
-        if (srtp->srtp_ctx.srtp_tx_ctx && srtp->srtp_ctx.srtp_rx_ctx) {
-            /* Declare SRTP session initialized */
-            srtp->session_inited = PJ_TRUE;
-        } else {
-            srtp->bypass_srtp = PJ_TRUE;
-        }
+    srtp->session_inited = (srtp->srtp_ctx.srtp_tx_ctx &&
+                            srtp->srtp_ctx.srtp_rx_ctx);
+    if (status == PJ_SUCCESS && !srtp->session_inited) {
+        srtp->bypass_srtp = PJ_TRUE;
     }
 
     pj_lock_release(srtp->mutex);
@@ -1119,29 +1205,55 @@ PJ_DEF(pj_status_t) pjmedia_transport_srtp_start(
     return status;
 }
 
+/* Replace the libsrtp contexts used by the data path, the old contexts
+ * are returned in tx_ctx and rx_ctx. The data path only uses a context
+ * while holding the lock of its direction, so once the pointer has been
+ * replaced under that lock, the old context is no longer in use and can
+ * be freed by the caller without holding any lock (RCU-style). This way
+ * rekeying (the expensive srtp_create()) never stalls the media flow.
+ */
+static void swap_srtp_ctx(transport_srtp *srtp, srtp_context *ctx,
+                          srtp_t *tx_ctx, srtp_t *rx_ctx)
+{
+    srtp_t old;
+
+    pj_lock_acquire(srtp->tx_mutex);
+    old = ctx->srtp_tx_ctx;
+    ctx->srtp_tx_ctx = *tx_ctx;
+    pj_lock_release(srtp->tx_mutex);
+    *tx_ctx = old;
+
+    pj_lock_acquire(srtp->rx_mutex);
+    old = ctx->srtp_rx_ctx;
+    ctx->srtp_rx_ctx = *rx_ctx;
+    pj_lock_release(srtp->rx_mutex);
+    *rx_ctx = old;
+}
+
 /* Destroy SRTP context */
 static void destroy_srtp_ctx(transport_srtp *p_srtp, srtp_context *ctx)
 {
+    srtp_t tx_ctx = NULL, rx_ctx = NULL;
     srtp_err_status_t err;
 
-    if (ctx->srtp_rx_ctx) {
-        err = srtp_dealloc(ctx->srtp_rx_ctx);
+    swap_srtp_ctx(p_srtp, ctx, &tx_ctx, &rx_ctx);
+
+    if (rx_ctx) {
+        err = srtp_dealloc(rx_ctx);
         if (err != srtp_err_status_ok) {
             PJ_LOG(4, (p_srtp->pool->obj_name,
                        "Failed to dealloc RX SRTP context: %s",
                        get_libsrtp_errstr(err)));
         }
     }
-    if (ctx->srtp_tx_ctx) {
-        err = srtp_dealloc(ctx->srtp_tx_ctx);
+    if (tx_ctx) {
+        err = srtp_dealloc(tx_ctx);
         if (err != srtp_err_status_ok) {
             PJ_LOG(4, (p_srtp->pool->obj_name,
                        "Failed to dealloc TX SRTP context: %s",
                        get_libsrtp_errstr(err)));
         }
     }
-    ctx->srtp_rx_ctx = NULL;
-    ctx->srtp_tx_ctx = NULL;
 
     pj_bzero(&ctx->rx_policy, sizeof(ctx->rx_policy));
     pj_bzero(&ctx->tx_policy, sizeof(ctx->tx_policy));
@@ -1299,7 +1411,7 @@ static pj_status_t transport_attach2(pjmedia_transport *tp,
     PJ_ASSERT_RETURN(tp && param, PJ_EINVAL);
 
     /* Save the callbacks */
-    pj_lock_acquire(srtp->mutex);
+    pj_lock_acquire(srtp->rx_mutex);
     if (param->rtp_cb || param->rtp_cb2) {
         /* Do not update rtp_cb if not set, as attach() is called by
          * keying method.
@@ -1309,7 +1421,7 @@ static pj_status_t transport_attach2(pjmedia_transport *tp,
         srtp->rtcp_cb = param->rtcp_cb;
         srtp->user_data = param->user_data;
     }
-    pj_lock_release(srtp->mutex);
+    pj_lock_release(srtp->rx_mutex);
 
     /* Attach self to member transport */
     member_param = *param;
@@ -1319,11 +1431,11 @@ static pj_status_t transport_attach2(pjmedia_transport *tp,
     member_param.rtcp_cb = &srtp_rtcp_cb;
     status = pjmedia_transport_attach2(srtp->member_tp, &member_param);
     if (status != PJ_SUCCESS) {
-        pj_lock_acquire(srtp->mutex);
+        pj_lock_acquire(srtp->rx_mutex);
         srtp->rtp_cb = NULL;
         srtp->rtcp_cb = NULL;
         srtp->user_data = NULL;
-        pj_lock_release(srtp->mutex);
+        pj_lock_release(srtp->rx_mutex);
         return status;
     }
 
@@ -1347,12 +1459,12 @@ static void transport_detach(pjmedia_transport *tp, void *strm)
     }
 
     /* Clear up application infos from transport */
-    pj_lock_acquire(srtp->mutex);
+    pj_lock_acquire(srtp->rx_mutex);
     srtp->rtp_cb = NULL;
     srtp->rtp_cb2 = NULL;
     srtp->rtcp_cb = NULL;
     srtp->user_data = NULL;
-    pj_lock_release(srtp->mutex);
+    pj_lock_release(srtp->rx_mutex);
     srtp->member_tp_attached = PJ_FALSE;
 }
 
@@ -1373,9 +1485,9 @@ static pj_status_t transport_send_rtp( pjmedia_transport *tp,
 
     pj_memcpy(srtp->rtp_tx_buffer, pkt, size);
 
-    pj_lock_acquire(srtp->mutex);
-    if (!srtp->session_inited) {
-        pj_lock_release(srtp->mutex);
+    pj_lock_acquire(srtp->tx_mutex);
+    if (!srtp->srtp_ctx.srtp_tx_ctx) {
+        pj_lock_release(srtp->tx_mutex);
         return PJMEDIA_SRTP_EKEYNOTREADY;
     }
 
@@ -1397,7 +1509,7 @@ static pj_status_t transport_send_rtp( pjmedia_transport *tp,
 #endif
 
     err = srtp_protect(srtp->srtp_ctx.srtp_tx_ctx, srtp->rtp_tx_buffer, &len);
-    pj_lock_release(srtp->mutex);
+    pj_lock_release(srtp->tx_mutex);
 
     if (err == srtp_err_status_ok) {
         status = pjmedia_transport_send_rtp(srtp->member_tp,
@@ -1437,16 +1549,16 @@ static pj_status_t transport_send_rtcp2(pjmedia_transport *tp,
 
     pj_memcpy(srtp->rtcp_tx_buffer, pkt, size);
 
-    pj_lock_acquire(srtp->mutex);
-    if (!srtp->session_inited) {
-        pj_lock_release(srtp->mutex);
+    pj_lock_acquire(srtp->tx_mutex);
+    if (!srtp->srtp_ctx.srtp_tx_ctx) {
+        pj_lock_release(srtp->tx_mutex);
         return PJMEDIA_SRTP_EKEYNOTREADY;
     }
     err = srtp_protect_rtcp(srtp->srtp_rtcp.srtp_tx_ctx?
                             srtp->srtp_rtcp.srtp_tx_ctx:
                             srtp->srtp_ctx.srtp_tx_ctx,
                             srtp->rtcp_tx_buffer, &len);
-    pj_lock_release(srtp->mutex);
+    pj_lock_release(srtp->tx_mutex);
 
     if (err == srtp_err_status_ok) {
         status = pjmedia_transport_send_rtcp2(srtp->member_tp, addr, addr_len,
@@ -1478,6 +1590,8 @@ static void srtp_on_destroy(void *arg)
 
     PJ_LOG(4, (srtp->pool->obj_name, "SRTP transport destroyed"));
 
+    pj_lock_destroy(srtp->rx_mutex);
+    pj_lock_destroy(srtp->tx_mutex);
     pj_lock_destroy(srtp->mutex);
     pj_pool_safe_release(&srtp->pool);
 }
@@ -1521,8 +1635,10 @@ static pj_status_t transport_destroy  (pjmedia_transport *tp)
          * An effort to synchronize destroy() & callbacks when the underlying
          * transport does not provide a group lock.
          */
-        pj_lock_acquire(srtp->mutex);
-        pj_lock_release(srtp->mutex);
+        pj_lock_acquire(srtp->tx_mutex);
+        pj_lock_release(srtp->tx_mutex);
+        pj_lock_acquire(srtp->rx_mutex);
+        pj_lock_release(srtp->rx_mutex);
 
         srtp_on_destroy(srtp);
     }
@@ -1586,10 +1702,10 @@ static void srtp_rtp_cb(pjmedia_tp_cb_param *param)
     if (srtp->probation_cnt > 0)
         --srtp->probation_cnt;
 
-    pj_lock_acquire(srtp->mutex);
+    pj_lock_acquire(srtp->rx_mutex);
 
-    if (!srtp->session_inited) {
-        pj_lock_release(srtp->mutex);
+    if (!srtp->srtp_ctx.srtp_rx_ctx) {
+        pj_lock_release(srtp->rx_mutex);
         return;
     }
 
@@ -1598,7 +1714,7 @@ static void srtp_rtp_cb(pjmedia_tp_cb_param *param)
         pjmedia_rtp_hdr *hdr = (pjmedia_rtp_hdr *)pkt;
   
         if (hdr->pt >= 64 && hdr->pt <= 95) {   
-            pj_lock_release(srtp->mutex);
+            pj_lock_release(srtp->rx_mutex);
             srtp_rtcp_cb(srtp, pkt, size);
             return;
         }
@@ -1640,20 +1756,27 @@ static void srtp_rtp_cb(pjmedia_tp_cb_param *param)
         pjmedia_srtp_crypto tx, rx;
         pj_status_t status;
 
+        /* Restarting replaces the RX context, which is done under the
+         * session lock, so don't hold the RX lock meanwhile.
+         */
+        pj_lock_release(srtp->rx_mutex);
+        pj_lock_acquire(srtp->mutex);
+
         tx = srtp->srtp_ctx.tx_policy;
         rx = srtp->srtp_ctx.rx_policy;
 
-        /* Stop SRTP first, otherwise srtp_start() will maintain current
-         * roll-over counter.
+        /* Restart SRTP with new contexts, this also resets the roll-over
+         * counter.
          */
-        pjmedia_transport_srtp_stop((pjmedia_transport*)srtp);
-
         status = pjmedia_transport_srtp_start((pjmedia_transport*)srtp,
                                               &tx, &rx);
+        pj_lock_release(srtp->mutex);
+        pj_lock_acquire(srtp->rx_mutex);
+
         if (status != PJ_SUCCESS) {
             PJ_LOG(5,(srtp->pool->obj_name, "Failed to restart SRTP, err=%s",
                       get_libsrtp_errstr(err)));
-        } else if (!srtp->bypass_srtp) {
+        } else if (!srtp->bypass_srtp && srtp->srtp_ctx.srtp_rx_ctx) {
             err = srtp_unprotect(srtp->srtp_ctx.srtp_rx_ctx,
                                  (pj_uint8_t*)pkt, &len);
         }
@@ -1701,7 +1824,7 @@ static void srtp_rtp_cb(pjmedia_tp_cb_param *param)
         srtp->rx_ssrc = ntohl(((pjmedia_rtp_hdr*)pkt)->ssrc);
     }
 
-    pj_lock_release(srtp->mutex);
+    pj_lock_release(srtp->rx_mutex);
 
     if (cb2) {
         pjmedia_tp_cb_param param2 = *param;
@@ -1755,10 +1878,10 @@ static void srtp_rtcp_cb( void *user_data, void *pkt, pj_ssize_t size)
     /* Make sure buffer is 32bit aligned */
     PJ_ASSERT_ON_FAIL( (((pj_ssize_t)pkt) & 0x03)==0, return );
 
-    pj_lock_acquire(srtp->mutex);
+    pj_lock_acquire(srtp->rx_mutex);
 
-    if (!srtp->session_inited) {
-        pj_lock_release(srtp->mutex);
+    if (!srtp->srtp_ctx.srtp_rx_ctx) {
+        pj_lock_release(srtp->rx_mutex);
         return;
     }
     err = srtp_unprotect_rtcp(srtp->srtp_rtcp.srtp_rx_ctx?
@@ -1774,7 +1897,7 @@ static void srtp_rtcp_cb( void *user_data, void *pkt, pj_ssize_t size)
         cb_data = srtp->user_data;
     }
 
-    pj_lock_release(srtp->mutex);
+    pj_lock_release(srtp->rx_mutex);
 
     if (cb) {
         (*cb)(cb_data, pkt, len);
@@ -2100,10 +2223,10 @@ PJ_DEF(pj_status_t) pjmedia_transport_srtp_decrypt_pkt(pjmedia_transport *tp,
     /* Make sure buffer is 32bit aligned */
     PJ_ASSERT_ON_FAIL( (((pj_ssize_t)pkt) & 0x03)==0, return PJ_EINVAL);
 
-    pj_lock_acquire(srtp->mutex);
+    pj_lock_acquire(srtp->rx_mutex);
 
-    if (!srtp->session_inited) {
-        pj_lock_release(srtp->mutex);
+    if (!srtp->srtp_ctx.srtp_rx_ctx) {
+        pj_lock_release(srtp->rx_mutex);
         return PJ_EINVALIDOP;
     }
 
@@ -2118,10 +2241,71 @@ PJ_DEF(pj_status_t) pjmedia_transport_srtp_decrypt_pkt(pjmedia_transport *tp,
                   *pkt_len, get_libsrtp_errstr(err)));
     }
 
-    pj_lock_release(srtp->mutex);
+    pj_lock_release(srtp->rx_mutex);
 
     return (err==srtp_err_status_ok) ? PJ_SUCCESS :
                                        PJMEDIA_ERRNO_FROM_LIBSRTP(err);
 }
 
+
+PJ_DEF(pj_status_t) pjmedia_transport_srtp_encrypt_batch(
+                                            pjmedia_srtp_batch_pkt pkts[],
+                                            unsigned count)
+{
+    pj_status_t status = PJ_SUCCESS;
+    unsigned i = 0;
+
+    PJ_ASSERT_RETURN(pkts || count == 0, PJ_EINVAL);
+
+    while (i < count) {
+        transport_srtp *srtp = (transport_srtp *)pkts[i].tp;
+        unsigned end;
+
+        PJ_ASSERT_RETURN(srtp, PJ_EINVAL);
+
+        /* Consecutive packets of the same transport */
+        for (end = i+1; end < count && pkts[end].tp == pkts[i].tp; ++end)
+            ;
+
+        if (srtp->bypass_srtp) {
+            for (; i < end; ++i)
+                pkts[i].status = PJ_SUCCESS;
+            continue;
+        }
+
+        pj_lock_acquire(srtp->tx_mutex);
+
+        for (; i < end; ++i) {
+            pjmedia_srtp_batch_pkt *p = &pkts[i];
+            srtp_err_status_t err;
+
+            if (!srtp->srtp_ctx.srtp_tx_ctx) {
+                p->status = PJMEDIA_SRTP_EKEYNOTREADY;
+            } else if (p->is_rtp) {
+                /* Save outgoing SSRC, as transport_send_rtp() does */
+                srtp->tx_ssrc = ntohl(((pjmedia_rtp_hdr*)p->pkt)->ssrc);
+
+                err = srtp_protect(srtp->srtp_ctx.srtp_tx_ctx, p->pkt,
+                                   &p->len);
+                p->status = (err == srtp_err_status_ok) ? PJ_SUCCESS :
+                            PJMEDIA_ERRNO_FROM_LIBSRTP(err);
+            } else {
+                err = srtp_protect_rtcp(srtp->srtp_rtcp.srtp_tx_ctx?
+                                        srtp->srtp_rtcp.srtp_tx_ctx:
+                                        srtp->srtp_ctx.srtp_tx_ctx,
+                                        p->pkt, &p->len);
+                p->status = (err == srtp_err_status_ok) ? PJ_SUCCESS :
+                            PJMEDIA_ERRNO_FROM_LIBSRTP(err);
+            }
+
+            if (p->status != PJ_SUCCESS && status == PJ_SUCCESS)
+                status = p->status;
+        }
+
+        pj_lock_release(srtp->tx_mutex);
+    }
+
+    return status;
+}
+
 #endif
@@ -0,0 +1,411 @@
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+/*
+ * AES-128 integer counter mode (AES_CM_128) cipher for the bundled libsrtp
+ * using AES-NI. The counter blocks of a packet are independent, so the
+ * keystream is generated several blocks at a time to keep the AES units
+ * busy: four blocks with AES-NI, eight blocks with VAES (two blocks per
+ * 256-bit register). The cipher replaces libsrtp's SRTP_AES_ICM_128
+ * cipher type, which is also used by the SRTP key derivation, so it
+ * follows libsrtp's aes_icm semantic exactly, including the keystream
+ * left over between calls.
+ *
+ * This file is included by transport_srtp.c.
+ */
+
+#include <cipher_types.h>
+#include <immintrin.h>
+#include <stdlib.h>
+
+#define AESNI_TARGET    __attribute__((target("aes,sse4.1")))
+#define VAES_TARGET     __attribute__((target("aes,sse4.1,avx2,vaes")))
+
+#define AESNI_KEY_LEN   SRTP_AES_ICM_128_KEY_LEN_WSALT
+#define AESNI_ROUNDS    10
+
+typedef struct aesni_icm_ctx
+{
+    pj_uint8_t   rk[AESNI_ROUNDS+1][16];    /* Expanded key             */
+    pj_uint8_t   counter[16];
+    pj_uint8_t   offset[16];
+    pj_uint8_t   keystream[16];
+    unsigned     bytes_in_buffer;           /* Unused keystream bytes   */
+    pj_bool_t    use_vaes;
+} aesni_icm_ctx;
+
+static srtp_cipher_type_t aesni_icm_128;
+static pjmedia_srtp_cipher_impl aes_impl = PJMEDIA_SRTP_CIPHER_IMPL_LIBSRTP;
+
+/* Implementation to install when libsrtp is initialized */
+static pjmedia_srtp_cipher_impl aes_impl_req = PJMEDIA_SRTP_CIPHER_IMPL_AUTO;
+
+
+AESNI_TARGET static __m128i aesni_key_step(__m128i key, __m128i kg)
+{
+    kg = _mm_shuffle_epi32(kg, 0xFF);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, kg);
+}
+
+AESNI_TARGET static void aesni_expand_key(const pj_uint8_t *key,
+                                          pj_uint8_t rk[][16])
+{
+    __m128i k = _mm_loadu_si128((const __m128i*)key);
+
+#define KEY_STEP(i, rcon) \
+    k = aesni_key_step(k, _mm_aeskeygenassist_si128(k, rcon)); \
+    _mm_storeu_si128((__m128i*)rk[i], k)
+
+    _mm_storeu_si128((__m128i*)rk[0], k);
+    KEY_STEP(1, 0x01);
+    KEY_STEP(2, 0x02);
+    KEY_STEP(3, 0x04);
+    KEY_STEP(4, 0x08);
+    KEY_STEP(5, 0x10);
+    KEY_STEP(6, 0x20);
+    KEY_STEP(7, 0x40);
+    KEY_STEP(8, 0x80);
+    KEY_STEP(9, 0x1B);
+    KEY_STEP(10, 0x36);
+
+#undef KEY_STEP
+}
+
+/* Counter block with the (big endian) block index set to ctr */
+AESNI_TARGET static __m128i aesni_ctr_block(__m128i base, unsigned ctr)
+{
+    return _mm_insert_epi16(base, (int)(((ctr >> 8) & 0xFF) |
+                                        ((ctr & 0xFF) << 8)), 7);
+}
+
+/* XOR nblocks of keystream into buf, advancing the block index */
+AESNI_TARGET static void aesni_ctr_xor(aesni_icm_ctx *c, pj_uint8_t *buf,
+                                       unsigned nblocks)
+{
+    __m128i rk[AESNI_ROUNDS+1];
+    __m128i base = _mm_loadu_si128((const __m128i*)c->counter);
+    unsigned ctr = (c->counter[14] << 8) | c->counter[15];
+    unsigned i;
+
+    for (i = 0; i <= AESNI_ROUNDS; ++i)
+        rk[i] = _mm_loadu_si128((const __m128i*)c->rk[i]);
+
+    for (; nblocks >= 4; nblocks -= 4, ctr += 4, buf += 64) {
+        __m128i b0 = _mm_xor_si128(aesni_ctr_block(base, ctr), rk[0]);
+        __m128i b1 = _mm_xor_si128(aesni_ctr_block(base, ctr+1), rk[0]);
+        __m128i b2 = _mm_xor_si128(aesni_ctr_block(base, ctr+2), rk[0]);
+        __m128i b3 = _mm_xor_si128(aesni_ctr_block(base, ctr+3), rk[0]);
+
+        for (i = 1; i < AESNI_ROUNDS; ++i) {
+            b0 = _mm_aesenc_si128(b0, rk[i]);
+            b1 = _mm_aesenc_si128(b1, rk[i]);
+            b2 = _mm_aesenc_si128(b2, rk[i]);
+            b3 = _mm_aesenc_si128(b3, rk[i]);
+        }
+        b0 = _mm_aesenclast_si128(b0, rk[AESNI_ROUNDS]);
+        b1 = _mm_aesenclast_si128(b1, rk[AESNI_ROUNDS]);
+        b2 = _mm_aesenclast_si128(b2, rk[AESNI_ROUNDS]);
+        b3 = _mm_aesenclast_si128(b3, rk[AESNI_ROUNDS]);
+
+        _mm_storeu_si128((__m128i*)buf, _mm_xor_si128(b0,
+                         _mm_loadu_si128((const __m128i*)buf)));
+        _mm_storeu_si128((__m128i*)(buf+16), _mm_xor_si128(b1,
+                         _mm_loadu_si128((const __m128i*)(buf+16))));
+        _mm_storeu_si128((__m128i*)(buf+32), _mm_xor_si128(b2,
+                         _mm_loadu_si128((const __m128i*)(buf+32))));
+        _mm_storeu_si128((__m128i*)(buf+48), _mm_xor_si128(b3,
+                         _mm_loadu_si128((const __m128i*)(buf+48))));
+    }
+
+    for (; nblocks; --nblocks, ++ctr, buf += 16) {
+        __m128i b0 = _mm_xor_si128(aesni_ctr_block(base, ctr), rk[0]);
+
+        for (i = 1; i < AESNI_ROUNDS; ++i)
+            b0 = _mm_aesenc_si128(b0, rk[i]);
+        b0 = _mm_aesenclast_si128(b0, rk[AESNI_ROUNDS]);
+
+        _mm_storeu_si128((__m128i*)buf, _mm_xor_si128(b0,
+                         _mm_loadu_si128((const __m128i*)buf)));
+    }
+
+    c->counter[14] = (pj_uint8_t)((ctr >> 8) & 0xFF);
+    c->counter[15] = (pj_uint8_t)(ctr & 0xFF);
+}
+
+VAES_TARGET static __m256i vaes_ctr_block(__m128i base, unsigned ctr)
+{
+    return _mm256_set_m128i(aesni_ctr_block(base, ctr+1),
+                            aesni_ctr_block(base, ctr));
+}
+
+/* Same as aesni_ctr_xor(), eight blocks at a time */
+VAES_TARGET static void vaes_ctr_xor(aesni_icm_ctx *c, pj_uint8_t *buf,
+                                     unsigned nblocks)
+{
+    __m256i rk[AESNI_ROUNDS+1];
+    __m128i base = _mm_loadu_si128((const __m128i*)c->counter);
+    unsigned ctr = (c->counter[14] << 8) | c->counter[15];
+    unsigned i;
+
+    if (nblocks < 8) {
+        aesni_ctr_xor(c, buf, nblocks);
+        return;
+    }
+
+    for (i = 0; i <= AESNI_ROUNDS; ++i) {
+        rk[i] = _mm256_broadcastsi128_si256(
+                    _mm_loadu_si128((const __m128i*)c->rk[i]));
+    }
+
+    for (; nblocks >= 8; nblocks -= 8, ctr += 8, buf += 128) {
+        __m256i b0 = _mm256_xor_si256(vaes_ctr_block(base, ctr), rk[0]);
+        __m256i b1 = _mm256_xor_si256(vaes_ctr_block(base, ctr+2), rk[0]);
+        __m256i b2 = _mm256_xor_si256(vaes_ctr_block(base, ctr+4), rk[0]);
+        __m256i b3 = _mm256_xor_si256(vaes_ctr_block(base, ctr+6), rk[0]);
+
+        for (i = 1; i < AESNI_ROUNDS; ++i) {
+            b0 = _mm256_aesenc_epi128(b0, rk[i]);
+            b1 = _mm256_aesenc_epi128(b1, rk[i]);
+            b2 = _mm256_aesenc_epi128(b2, rk[i]);
+            b3 = _mm256_aesenc_epi128(b3, rk[i]);
+        }
+        b0 = _mm256_aesenclast_epi128(b0, rk[AESNI_ROUNDS]);
+        b1 = _mm256_aesenclast_epi128(b1, rk[AESNI_ROUNDS]);
+        b2 = _mm256_aesenclast_epi128(b2, rk[AESNI_ROUNDS]);
+        b3 = _mm256_aesenclast_epi128(b3, rk[AESNI_ROUNDS]);
+
+        _mm256_storeu_si256((__m256i*)buf, _mm256_xor_si256(b0,
+                            _mm256_loadu_si256((const __m256i*)buf)));
+        _mm256_storeu_si256((__m256i*)(buf+32), _mm256_xor_si256(b1,
+                            _mm256_loadu_si256((const __m256i*)(buf+32))));
+        _mm256_storeu_si256((__m256i*)(buf+64), _mm256_xor_si256(b2,
+                            _mm256_loadu_si256((const __m256i*)(buf+64))));
+        _mm256_storeu_si256((__m256i*)(buf+96), _mm256_xor_si256(b3,
+                            _mm256_loadu_si256((const __m256i*)(buf+96))));
+    }
+
+    c->counter[14] = (pj_uint8_t)((ctr >> 8) & 0xFF);
+    c->counter[15] = (pj_uint8_t)(ctr & 0xFF);
+
+    if (nblocks)
+        aesni_ctr_xor(c, buf, nblocks);
+}
+
+
+/*
+ * libsrtp cipher type functions.
+ */
+static srtp_err_status_t aesni_icm_alloc(srtp_cipher_t **c, int key_len,
+                                         int tlen)
+{
+    aesni_icm_ctx *icm;
+
+    PJ_UNUSED_ARG(tlen);
+
+    if (key_len != AESNI_KEY_LEN)
+        return srtp_err_status_bad_param;
+
+    *c = (srtp_cipher_t*) calloc(1, sizeof(srtp_cipher_t));
+    if (*c == NULL)
+        return srtp_err_status_alloc_fail;
+
+    icm = (aesni_icm_ctx*) calloc(1, sizeof(aesni_icm_ctx));
+    if (icm == NULL) {
+        free(*c);
+        *c = NULL;
+        return srtp_err_status_alloc_fail;
+    }
+
+    icm->use_vaes = (aes_impl == PJMEDIA_SRTP_CIPHER_IMPL_VAES);
+
+    (*c)->state = icm;
+    (*c)->type = &aesni_icm_128;
+    (*c)->algorithm = SRTP_AES_ICM_128;
+    (*c)->key_len = key_len;
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t aesni_icm_dealloc(srtp_cipher_t *c)
+{
+    if (c == NULL)
+        return srtp_err_status_bad_param;
+
+    if (c->state) {
+        /* Zeroize the key material */
+        pj_bzero(c->state, sizeof(aesni_icm_ctx));
+        free(c->state);
+    }
+    free(c);
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t aesni_icm_init(void *cv, const uint8_t *key)
+{
+    aesni_icm_ctx *c = (aesni_icm_ctx*) cv;
+
+    /* The salt is the offset, with the block index (last two octets)
+     * left zero.
+     */
+    pj_bzero(c->offset, sizeof(c->offset));
+    pj_memcpy(c->offset, key + 16, SRTP_SALT_LEN);
+    pj_memcpy(c->counter, c->offset, sizeof(c->counter));
+
+    aesni_expand_key(key, c->rk);
+    c->bytes_in_buffer = 0;
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t aesni_icm_set_iv(void *cv, uint8_t *iv,
+                                          srtp_cipher_direction_t direction)
+{
+    aesni_icm_ctx *c = (aesni_icm_ctx*) cv;
+    unsigned i;
+
+    PJ_UNUSED_ARG(direction);
+
+    for (i = 0; i < sizeof(c->counter); ++i)
+        c->counter[i] = c->offset[i] ^ iv[i];
+    c->bytes_in_buffer = 0;
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t aesni_icm_encrypt(void *cv, unsigned char *buf,
+                                           unsigned int *enc_len)
+{
+    aesni_icm_ctx *c = (aesni_icm_ctx*) cv;
+    unsigned bytes = *enc_len;
+    unsigned ctr = (c->counter[14] << 8) | c->counter[15];
+    unsigned i, nblocks;
+
+    /* Use the keystream left from the previous call first */
+    if (bytes <= c->bytes_in_buffer) {
+        const pj_uint8_t *ks = c->keystream + 16 - c->bytes_in_buffer;
+
+        for (i = 0; i < bytes; ++i)
+            buf[i] ^= ks[i];
+        c->bytes_in_buffer -= bytes;
+        return srtp_err_status_ok;
+    }
+
+    /* Check that there's enough segment left */
+    if (((bytes - c->bytes_in_buffer + 15) >> 4) + ctr > 0xFFFF)
+        return srtp_err_status_terminus;
+
+    for (i = 0; i < c->bytes_in_buffer; ++i)
+        buf[i] ^= c->keystream[16 - c->bytes_in_buffer + i];
+    buf += c->bytes_in_buffer;
+    bytes -= c->bytes_in_buffer;
+    c->bytes_in_buffer = 0;
+
+    /* Whole blocks */
+    nblocks = bytes >> 4;
+    if (nblocks) {
+        if (c->use_vaes)
+            vaes_ctr_xor(c, buf, nblocks);
+        else
+            aesni_ctr_xor(c, buf, nblocks);
+        buf += nblocks << 4;
+        bytes &= 0x0F;
+    }
+
+    /* Tail, keep the rest of the keystream block for the next call */
+    if (bytes) {
+        pj_bzero(c->keystream, sizeof(c->keystream));
+        aesni_ctr_xor(c, c->keystream, 1);
+        for (i = 0; i < bytes; ++i)
+            buf[i] ^= c->keystream[i];
+        c->bytes_in_buffer = 16 - bytes;
+    }
+
+    return srtp_err_status_ok;
+}
+
+static srtp_cipher_type_t aesni_icm_128 =
+{
+    &aesni_icm_alloc,
+    &aesni_icm_dealloc,
+    &aesni_icm_init,
+    NULL,                       /* set_aad */
+    &aesni_icm_encrypt,
+    &aesni_icm_encrypt,         /* decrypt is the same as encrypt */
+    &aesni_icm_set_iv,
+    NULL,                       /* get_tag */
+    "AES-128 integer counter mode (AES-NI)",
+    NULL,                       /* test_data, set at run-time */
+    SRTP_AES_ICM_128
+};
+
+
+static pj_bool_t aesni_supported(pjmedia_srtp_cipher_impl impl)
+{
+    __builtin_cpu_init();
+
+    switch (impl) {
+    case PJMEDIA_SRTP_CIPHER_IMPL_AESNI:
+        return __builtin_cpu_supports("aes") &&
+               __builtin_cpu_supports("sse4.1");
+    case PJMEDIA_SRTP_CIPHER_IMPL_VAES:
+        return __builtin_cpu_supports("aes") &&
+               __builtin_cpu_supports("avx2") &&
+               __builtin_cpu_supports("vaes");
+    default:
+        return PJ_TRUE;
+    }
+}
+
+/* Install the cipher implementation to libsrtp crypto kernel */
+static pj_status_t aesni_set_impl(pjmedia_srtp_cipher_impl impl)
+{
+    srtp_err_status_t err;
+
+    if (impl == PJMEDIA_SRTP_CIPHER_IMPL_AUTO) {
+        if (aesni_supported(PJMEDIA_SRTP_CIPHER_IMPL_AESNI))
+            impl = PJMEDIA_SRTP_CIPHER_IMPL_AESNI;
+        else
+            impl = PJMEDIA_SRTP_CIPHER_IMPL_LIBSRTP;
+    } else if (!aesni_supported(impl)) {
+        return PJ_ENOTSUP;
+    }
+
+    if (impl == PJMEDIA_SRTP_CIPHER_IMPL_LIBSRTP) {
+        err = srtp_replace_cipher_type(&srtp_aes_icm_128, SRTP_AES_ICM_128);
+    } else {
+        /* libsrtp runs its own test vectors on the new cipher */
+        aesni_icm_128.test_data = srtp_aes_icm_128.test_data;
+        aes_impl = impl;
+        err = srtp_replace_cipher_type(&aesni_icm_128, SRTP_AES_ICM_128);
+    }
+
+    if (err != srtp_err_status_ok) {
+        PJ_LOG(4, (THIS_FILE, "Failed to set AES_CM_128 implementation: %s",
+                   get_libsrtp_errstr(err)));
+        srtp_replace_cipher_type(&srtp_aes_icm_128, SRTP_AES_ICM_128);
+        aes_impl = PJMEDIA_SRTP_CIPHER_IMPL_LIBSRTP;
+        return PJMEDIA_ERRNO_FROM_LIBSRTP(err);
+    }
+
+    aes_impl = impl;
+    return PJ_SUCCESS;
+}
@@ -90,6 +90,10 @@ struct transport_udp
     pj_sockaddr         rtp_src_addr;   /**< Actual packet src addr.        */
     int                 rtp_addrlen;    /**< Address length.                */
     char                rtp_pkt[RTP_LEN];/**< Incoming RTP packet buffer    */
+#if PJMEDIA_TRANSPORT_UDP_RX_BATCH > 1
+    pj_sock_mmsg        rtp_batch[PJMEDIA_TRANSPORT_UDP_RX_BATCH-1];
+                                        /**< Batch read RTP packets         */
+#endif
 
     pj_bool_t           enable_rtcp_mux;/**< Enable RTP & RTCP multiplexing?*/
     pj_bool_t           use_rtcp_mux;   /**< Use RTP & RTCP multiplexing?   */
@@ -299,6 +303,9 @@ PJ_DEF(pj_status_t) pjmedia_transport_udp_attach( pjmedia_endpt *endpt,
     pj_ioqueue_t *ioqueue;
     pj_ioqueue_callback rtp_cb, rtcp_cb;
     pj_grp_lock_t *grp_lock;
+#if PJMEDIA_TRANSPORT_UDP_RX_BATCH > 1
+    unsigned i;
+#endif
     pj_status_t status;
 
 
@@ -357,6 +364,12 @@ PJ_DEF(pj_status_t) pjmedia_transport_udp_attach( pjmedia_endpt *endpt,
     pj_grp_lock_add_ref(grp_lock);
     tp->base.grp_lock = grp_lock;
 
+#if PJMEDIA_TRANSPORT_UDP_RX_BATCH > 1
+    /* Buffers for the RTP packets drained after the ioqueue read */
+    for (i=0; i<PJ_ARRAY_SIZE(tp->rtp_batch); ++i)
+        tp->rtp_batch[i].buf = pj_pool_alloc(pool, RTP_LEN);
+#endif
+
     /* Setup RTP socket with the ioqueue */
     pj_bzero(&rtp_cb, sizeof(rtp_cb));
     rtp_cb.on_read_complete = &on_rx_rtp;
@@ -481,8 +494,8 @@ static pj_status_t transport_destroy(pjmedia_transport *tp)
 }
 
 /* Call RTP cb. */
-static void call_rtp_cb(struct transport_udp *udp, pj_ssize_t bytes_read, 
-                        pj_bool_t *rem_switch)
+static void call_rtp_cb(struct transport_udp *udp, void *pkt,
+                        pj_ssize_t bytes_read, pj_bool_t *rem_switch)
 {
     void (*cb)(void*,void*,pj_ssize_t);
     void (*cb2)(pjmedia_tp_cb_param*);
@@ -496,7 +509,7 @@ static void call_rtp_cb(struct transport_udp *udp, pj_ssize_t bytes_read,
         pjmedia_tp_cb_param param;
 
         param.user_data = user_data;
-        param.pkt = udp->rtp_pkt;
+        param.pkt = pkt;
         param.size = bytes_read;
         param.src_addr = &udp->rtp_src_addr;
         param.rem_switch = PJ_FALSE;
@@ -504,7 +517,7 @@ static void call_rtp_cb(struct transport_udp *udp, pj_ssize_t bytes_read,
         if (rem_switch)
             *rem_switch = param.rem_switch;
     } else if (cb) {
-        (*cb)(user_data, udp->rtp_pkt, bytes_read);
+        (*cb)(user_data, pkt, bytes_read);
     }
 }
 
@@ -521,6 +534,100 @@ static void call_rtcp_cb(struct transport_udp *udp, pj_ssize_t bytes_read)
         (*cb)(user_data, udp->rtcp_pkt, bytes_read);
 }
 
+/* Report an incoming RTP packet, whose source address is in rtp_src_addr,
+ * and switch the remote address if the stream asks for it.
+ */
+static void on_rx_rtp_pkt(struct transport_udp *udp, void *pkt,
+                          pj_ssize_t bytes_read)
+{
+    pj_bool_t rem_switch = PJ_FALSE;
+    pj_bool_t discard = PJ_FALSE;
+
+    /* Simulate packet lost on RX direction */
+    if (udp->rx_drop_pct) {
+        if ((pj_rand() % 100) <= (int)udp->rx_drop_pct) {
+            PJ_LOG(5,(udp->base.name, 
+                      "RX RTP packet dropped because of pkt lost "
+                      "simulation"));
+            discard = PJ_TRUE;
+        }
+    }
+
+    //if (!discard && udp->attached && cb)
+    if (!discard && 
+        (-bytes_read != PJ_STATUS_FROM_OS(PJ_BLOCKING_ERROR_VAL))) 
+    {
+        call_rtp_cb(udp, pkt, bytes_read, &rem_switch);
+    }
+
+#if defined(PJMEDIA_TRANSPORT_SWITCH_REMOTE_ADDR) && \
+    (PJMEDIA_TRANSPORT_SWITCH_REMOTE_ADDR == 1)
+    if (rem_switch &&
+        (udp->options & PJMEDIA_UDP_NO_SRC_ADDR_CHECKING)==0)
+    {
+        char addr_text[PJ_INET6_ADDRSTRLEN+10];
+
+        /* Set remote RTP address to source address */
+        pj_sockaddr_cp(&udp->rem_rtp_addr, &udp->rtp_src_addr);
+
+        PJ_LOG(4,(udp->base.name,
+                  "Remote RTP address switched to %s",
+                  pj_sockaddr_print(&udp->rtp_src_addr, addr_text,
+                                    sizeof(addr_text), 3)));
+
+        if (udp->use_rtcp_mux) {
+            pj_sockaddr_cp(&udp->rem_rtcp_addr, &udp->rem_rtp_addr);
+            pj_sockaddr_cp(&udp->rtcp_src_addr, &udp->rem_rtcp_addr);
+        } else if (!pj_sockaddr_has_addr(&udp->rtcp_src_addr)) {
+            /* Also update remote RTCP address if actual RTCP source
+             * address is not heard yet.
+             */
+            pj_uint16_t port;
+
+            pj_sockaddr_cp(&udp->rem_rtcp_addr, &udp->rem_rtp_addr);
+            port = (pj_uint16_t)
+                   (pj_sockaddr_get_port(&udp->rem_rtp_addr)+1);
+            pj_sockaddr_set_port(&udp->rem_rtcp_addr, port);
+
+            pj_sockaddr_cp(&udp->rtcp_src_addr, &udp->rem_rtcp_addr);
+
+            PJ_LOG(4,(udp->base.name,
+                      "Remote RTCP address switched to predicted"
+                      " address %s",
+                      pj_sockaddr_print(&udp->rtcp_src_addr, addr_text,
+                                        sizeof(addr_text), 3)));
+        }
+    }
+#endif
+}
+
+#if PJMEDIA_TRANSPORT_UDP_RX_BATCH > 1
+/* Read the packets already queued in the RTP socket with a single call
+ * and report them. Returns PJ_TRUE when the socket has no more packets.
+ */
+static pj_bool_t read_rtp_batch(struct transport_udp *udp)
+{
+    pj_sock_mmsg *pkts = udp->rtp_batch;
+    unsigned i, cnt = PJ_ARRAY_SIZE(udp->rtp_batch);
+
+    for (i=0; i<cnt; ++i)
+        pkts[i].len = RTP_LEN;
+
+    if (pj_sock_recvmmsg(udp->rtp_sock, pkts, &cnt, 0) != PJ_SUCCESS) {
+        /* Errors (e.g: ICMP errors) will be reported by the next read */
+        return PJ_TRUE;
+    }
+
+    for (i=0; i<cnt && udp->started; ++i) {
+        udp->rtp_src_addr = pkts[i].addr;
+        udp->rtp_addrlen = pkts[i].addr_len;
+        on_rx_rtp_pkt(udp, pkts[i].buf, pkts[i].len);
+    }
+
+    return (cnt < PJ_ARRAY_SIZE(udp->rtp_batch));
+}
+#endif
+
 /* Notification from ioqueue about incoming RTP packet */
 static void on_rx_rtp(pj_ioqueue_key_t *key,
                       pj_ioqueue_op_key_t *op_key,
@@ -528,7 +635,6 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
 {
     struct transport_udp *udp;
     pj_status_t status;
-    pj_bool_t rem_switch = PJ_FALSE;
     pj_bool_t transport_restarted = PJ_FALSE;
     unsigned num_err = 0;
     pj_status_t last_err = PJ_SUCCESS;
@@ -549,75 +655,28 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
         status = transport_restart(PJ_TRUE, udp);
         if (status != PJ_SUCCESS) {
             bytes_read = -PJ_ESOCKETSTOP;
-            call_rtp_cb(udp, bytes_read, NULL);
+            call_rtp_cb(udp, udp->rtp_pkt, bytes_read, NULL);
         }
         return;
     }
 
     do {
-        pj_bool_t discard = PJ_FALSE;
-
-        /* Simulate packet lost on RX direction */
-        if (udp->rx_drop_pct) {
-            if ((pj_rand() % 100) <= (int)udp->rx_drop_pct) {
-                PJ_LOG(5,(udp->base.name, 
-                          "RX RTP packet dropped because of pkt lost "
-                          "simulation"));
-                discard = PJ_TRUE;
-            }
-        }
-
-        //if (!discard && udp->attached && cb)
-        if (!discard && 
-            (-bytes_read != PJ_STATUS_FROM_OS(PJ_BLOCKING_ERROR_VAL))) 
-        {
-            call_rtp_cb(udp, bytes_read, &rem_switch);
-        }
+        unsigned flags = 0;
 
-#if defined(PJMEDIA_TRANSPORT_SWITCH_REMOTE_ADDR) && \
-    (PJMEDIA_TRANSPORT_SWITCH_REMOTE_ADDR == 1)
-        if (rem_switch &&
-            (udp->options & PJMEDIA_UDP_NO_SRC_ADDR_CHECKING)==0)
-        {
-            char addr_text[PJ_INET6_ADDRSTRLEN+10];
+        on_rx_rtp_pkt(udp, udp->rtp_pkt, bytes_read);
 
-            /* Set remote RTP address to source address */
-            pj_sockaddr_cp(&udp->rem_rtp_addr, &udp->rtp_src_addr);
-
-            PJ_LOG(4,(udp->base.name,
-                      "Remote RTP address switched to %s",
-                      pj_sockaddr_print(&udp->rtp_src_addr, addr_text,
-                                        sizeof(addr_text), 3)));
-
-            if (udp->use_rtcp_mux) {
-                pj_sockaddr_cp(&udp->rem_rtcp_addr, &udp->rem_rtp_addr);
-                pj_sockaddr_cp(&udp->rtcp_src_addr, &udp->rem_rtcp_addr);
-            } else if (!pj_sockaddr_has_addr(&udp->rtcp_src_addr)) {
-                /* Also update remote RTCP address if actual RTCP source
-                 * address is not heard yet.
-                 */
-                pj_uint16_t port;
-
-                pj_sockaddr_cp(&udp->rem_rtcp_addr, &udp->rem_rtp_addr);
-                port = (pj_uint16_t)
-                       (pj_sockaddr_get_port(&udp->rem_rtp_addr)+1);
-                pj_sockaddr_set_port(&udp->rem_rtcp_addr, port);
-
-                pj_sockaddr_cp(&udp->rtcp_src_addr, &udp->rem_rtcp_addr);
-
-                PJ_LOG(4,(udp->base.name,
-                          "Remote RTCP address switched to predicted"
-                          " address %s",
-                          pj_sockaddr_print(&udp->rtcp_src_addr, addr_text,
-                                            sizeof(addr_text), 3)));
-            }
-        }
+#if PJMEDIA_TRANSPORT_UDP_RX_BATCH > 1
+        /* Drain the packets already queued in the socket, then wait for
+         * the next packet asynchronously if there is no more.
+         */
+        if (bytes_read >= 0 && udp->started && read_rtp_batch(udp))
+            flags = PJ_IOQUEUE_ALWAYS_ASYNC;
 #endif
 
         bytes_read = sizeof(udp->rtp_pkt);
         udp->rtp_addrlen = sizeof(udp->rtp_src_addr);
         status = pj_ioqueue_recvfrom(udp->rtp_key, &udp->rtp_read_op,
-                                        udp->rtp_pkt, &bytes_read, 0,
+                                        udp->rtp_pkt, &bytes_read, flags,
                                         &udp->rtp_src_addr,
                                         &udp->rtp_addrlen);
 
@@ -625,7 +684,7 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
             if (transport_restarted && last_err == status) {
                 /* Still the same error after restart */
                 bytes_read = -PJ_ESOCKETSTOP;
-                call_rtp_cb(udp, bytes_read, NULL);
+                call_rtp_cb(udp, udp->rtp_pkt, bytes_read, NULL);
                 break;
             } else if (PJMEDIA_IGNORE_RECV_ERR_CNT) {
                 if (last_err == status) {
@@ -641,7 +700,7 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
                     status = transport_restart(PJ_TRUE, udp);               
                     if (status != PJ_SUCCESS) {
                         bytes_read = -PJ_ESOCKETSTOP;
-                        call_rtp_cb(udp, bytes_read, NULL);
+                        call_rtp_cb(udp, udp->rtp_pkt, bytes_read, NULL);
                         break;
                     }
                     transport_restarted = PJ_TRUE;
@@ -294,8 +294,8 @@ PJ_DEF(pj_status_t) pjmedia_vid_conf_create(
     pj_bzero(&clock_param, sizeof(clock_param));
     clock_param.clock_rate = TS_CLOCK_RATE;
     clock_param.usec_interval = 1000000 / vid_conf->opt.frame_rate;
-    status = pjmedia_clock_create2(pool, &clock_param, 0, &on_clock_tick,
-                                   vid_conf, &vid_conf->clock);
+    status = pjmedia_clock_create2(pool, &clock_param, PJMEDIA_CLOCK_SHARED,
+                                   &on_clock_tick, vid_conf, &vid_conf->clock);
     if (status != PJ_SUCCESS) {
         PJ_PERROR(1, (THIS_FILE, status, "Create failed in create clock"));
         pjmedia_vid_conf_destroy(vid_conf);
@@ -651,7 +651,8 @@ PJ_DEF(pj_status_t) pjmedia_vid_port_create( pj_pool_t *pool,
         param.usec_interval = PJMEDIA_PTIME(&vfd->fps);
         param.clock_rate = prm->vidparam.clock_rate;
         status = pjmedia_clock_create2(pool, &param,
-                                       PJMEDIA_CLOCK_NO_HIGHEST_PRIO,
+                                       PJMEDIA_CLOCK_NO_HIGHEST_PRIO |
+                                       PJMEDIA_CLOCK_SHARED,
                                        (vp->dir & PJMEDIA_DIR_ENCODING) ?
                                        &enc_clock_cb: &dec_clock_cb,
                                        vp, &vp->clock);
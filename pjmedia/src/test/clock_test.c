@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#define THIS_FILE       "clock_test.c"
+
+#define CLOCK_CNT       20
+#define CLOCK_RATE      8000
+#define SPF             80      /* 10 ms */
+#define RUN_MSEC        500
+
+/*
+ * Test the shared clock scheduler: many clocks served by the timing
+ * threads must all tick at their own rate.
+ */
+typedef struct clock_data
+{
+    pjmedia_clock   *clock;
+    unsigned         tick_cnt;
+    pj_uint64_t      last_ts;
+    pj_bool_t        ts_error;
+    pj_bool_t        self_stop;
+    pj_status_t      self_stop_status;
+    pj_bool_t        self_destroy;
+} clock_data;
+
+static clock_data data[CLOCK_CNT];
+
+static void clock_cb(const pj_timestamp *ts, void *user_data)
+{
+    clock_data *cd = (clock_data*) user_data;
+
+    if (cd->tick_cnt && ts->u64 != cd->last_ts + SPF)
+        cd->ts_error = PJ_TRUE;
+    cd->last_ts = ts->u64;
+    cd->tick_cnt++;
+
+    if (cd->self_stop)
+        cd->self_stop_status = pjmedia_clock_stop(cd->clock);
+
+    if (cd->self_destroy) {
+        pjmedia_clock_destroy(cd->clock);
+        cd->clock = NULL;
+    }
+}
+
+int clock_test(void)
+{
+    pj_pool_t *pool;
+    pjmedia_clock_param param;
+    pjmedia_clock_sched_stat stat;
+    unsigned i, expected, cnt[CLOCK_CNT];
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "Testing shared clock scheduler.."));
+
+    pool = pj_pool_create(mem, "clocktest", 1000, 1000, NULL);
+    pj_bzero(data, sizeof(data));
+
+    param.usec_interval = SPF * 1000000 / CLOCK_RATE;
+    param.clock_rate = CLOCK_RATE;
+
+    for (i = 0; i < CLOCK_CNT; ++i) {
+        status = pjmedia_clock_create2(pool, &param, PJMEDIA_CLOCK_SHARED,
+                                       &clock_cb, &data[i], &data[i].clock);
+        if (status != PJ_SUCCESS) {
+            app_perror(status, "  error creating clock");
+            rc = -10;
+            goto on_return;
+        }
+    }
+
+    pjmedia_clock_sched_get_stat(&stat, PJ_TRUE);
+    if (stat.thread_cnt != PJMEDIA_CLOCK_SCHED_THREAD_CNT ||
+        stat.clock_cnt != CLOCK_CNT)
+    {
+        rc = -20;
+        goto on_return;
+    }
+
+    for (i = 0; i < CLOCK_CNT; ++i) {
+        status = pjmedia_clock_start(data[i].clock);
+        if (status != PJ_SUCCESS) {
+            rc = -30;
+            goto on_return;
+        }
+    }
+
+    pj_thread_sleep(RUN_MSEC);
+
+    for (i = 0; i < CLOCK_CNT; ++i) {
+        pjmedia_clock_stop(data[i].clock);
+        cnt[i] = data[i].tick_cnt;
+    }
+
+    /* Allow some slack for the phase offset and a loaded machine */
+    expected = RUN_MSEC * CLOCK_RATE / SPF / 1000;
+    for (i = 0; i < CLOCK_CNT; ++i) {
+        if (data[i].ts_error) {
+            PJ_LOG(3,(THIS_FILE, "  error: clock %d timestamp jump", i));
+            rc = -40;
+            goto on_return;
+        }
+        if (cnt[i] < expected * 7 / 10 || cnt[i] > expected + 2) {
+            PJ_LOG(3,(THIS_FILE, "  error: clock %d ticked %d times, "
+                      "expecting %d", i, cnt[i], expected));
+            rc = -50;
+            goto on_return;
+        }
+    }
+
+    pjmedia_clock_sched_get_stat(&stat, PJ_FALSE);
+    PJ_LOG(3,(THIS_FILE, "  %d clocks on %d threads: %d ticks, %d overruns, "
+              "lateness avg %d usec, max %d usec",
+              stat.clock_cnt, stat.thread_cnt, (int)stat.tick_cnt,
+              (int)stat.overrun_cnt, stat.avg_late_usec,
+              stat.max_late_usec));
+
+    /* No more ticks after the clocks have been stopped */
+    pj_thread_sleep(50);
+    for (i = 0; i < CLOCK_CNT; ++i) {
+        if (data[i].tick_cnt != cnt[i]) {
+            rc = -60;
+            goto on_return;
+        }
+    }
+
+    /* Stopping the clock from its own callback */
+    data[0].self_stop = PJ_TRUE;
+    data[0].tick_cnt = 0;
+    pjmedia_clock_start(data[0].clock);
+    pj_thread_sleep(50);
+    if (data[0].tick_cnt != 1 || data[0].self_stop_status != PJ_EBUSY) {
+        rc = -70;
+        goto on_return;
+    }
+
+on_return:
+    for (i = 0; i < CLOCK_CNT; ++i) {
+        if (data[i].clock)
+            pjmedia_clock_destroy(data[i].clock);
+    }
+
+    /* The scheduler is gone with the last clock */
+    pjmedia_clock_sched_get_stat(&stat, PJ_FALSE);
+    if (rc == 0 && (stat.thread_cnt != 0 || stat.clock_cnt != 0))
+        rc = -80;
+
+    /* Destroying the last clock from its own callback keeps the scheduler,
+     * the next clock destroyed outside the timing threads destroys it.
+     */
+    if (rc == 0) {
+        pj_bzero(&data[0], sizeof(data[0]));
+        data[0].self_destroy = PJ_TRUE;
+        status = pjmedia_clock_create2(pool, &param, PJMEDIA_CLOCK_SHARED,
+                                       &clock_cb, &data[0], &data[0].clock);
+        if (status == PJ_SUCCESS)
+            status = pjmedia_clock_start(data[0].clock);
+        if (status != PJ_SUCCESS) {
+            rc = -90;
+            goto on_destroy;
+        }
+
+        pj_thread_sleep(50);
+        pjmedia_clock_sched_get_stat(&stat, PJ_FALSE);
+        if (data[0].clock || stat.thread_cnt == 0 || stat.clock_cnt != 0) {
+            rc = -100;
+            goto on_destroy;
+        }
+
+        pj_bzero(&data[0], sizeof(data[0]));
+        status = pjmedia_clock_create2(pool, &param, PJMEDIA_CLOCK_SHARED,
+                                       &clock_cb, &data[0], &data[0].clock);
+        if (status != PJ_SUCCESS) {
+            rc = -110;
+            goto on_destroy;
+        }
+        pjmedia_clock_destroy(data[0].clock);
+        data[0].clock = NULL;
+
+        pjmedia_clock_sched_get_stat(&stat, PJ_FALSE);
+        if (stat.thread_cnt != 0)
+            rc = -120;
+    }
+
+on_destroy:
+    if (data[0].clock)
+        pjmedia_clock_destroy(data[0].clock);
+
+    pj_pool_release(pool);
+    return rc;
+}
@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#define THIS_FILE           "conf_test.c"
+
+#define CLOCK_RATE          16000
+#define SPF                 320
+#define PORT_CNT            12
+#define FRAME_CNT           200
+
+#define TEST_SIGNATURE      PJMEDIA_SIG_CLASS_PORT_AUD('T','C')
+
+/*
+ * Test port: generates pseudo-random audio (by default loud enough to make
+ * the bridge normalize the mixed signal), and hashes every frame it
+ * receives from the bridge.
+ */
+typedef struct test_port
+{
+    pjmedia_port    base;
+    unsigned        id;
+    unsigned        amplitude;
+    pj_uint32_t     seed;
+    unsigned        frame_cnt;
+    pj_uint32_t     rx_hash;
+} test_port;
+
+
+static pj_uint32_t hash_buf(pj_uint32_t hash, const void *buf, pj_size_t len)
+{
+    const pj_uint8_t *p = (const pj_uint8_t*) buf;
+    pj_size_t i;
+
+    /* FNV-1a */
+    for (i = 0; i < len; ++i) {
+        hash ^= p[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+static pj_status_t tp_get_frame(pjmedia_port *this_port,
+                                pjmedia_frame *frame)
+{
+    test_port *tp = (test_port*) this_port;
+    pj_int16_t *samples = (pj_int16_t*) frame->buf;
+    unsigned i, count;
+
+    ++tp->frame_cnt;
+
+    /* Be silent once in a while */
+    if (tp->amplitude == 0 || (tp->frame_cnt + tp->id) % 7 == 0) {
+        frame->type = PJMEDIA_FRAME_TYPE_NONE;
+        frame->size = 0;
+        return PJ_SUCCESS;
+    }
+
+    count = PJMEDIA_PIA_SPF(&this_port->info);
+    for (i = 0; i < count; ++i) {
+        tp->seed = tp->seed * 1103515245 + 12345;
+        samples[i] = (pj_int16_t)((int)((tp->seed >> 16) %
+                                        (2 * tp->amplitude + 1)) -
+                                  (int)tp->amplitude);
+    }
+
+    frame->type = PJMEDIA_FRAME_TYPE_AUDIO;
+    frame->size = count * 2;
+    return PJ_SUCCESS;
+}
+
+static pj_status_t tp_put_frame(pjmedia_port *this_port,
+                                pjmedia_frame *frame)
+{
+    test_port *tp = (test_port*) this_port;
+    pj_uint32_t type = frame->type;
+
+    tp->rx_hash = hash_buf(tp->rx_hash, &type, sizeof(type));
+    if (frame->type == PJMEDIA_FRAME_TYPE_AUDIO)
+        tp->rx_hash = hash_buf(tp->rx_hash, frame->buf, frame->size);
+
+    return PJ_SUCCESS;
+}
+
+static test_port *create_test_port(pj_pool_t *pool, unsigned id,
+                                   unsigned spf, unsigned amplitude)
+{
+    test_port *tp = PJ_POOL_ZALLOC_T(pool, test_port);
+    char name[16];
+    pj_str_t port_name;
+
+    pj_ansi_snprintf(name, sizeof(name), "tp%u", id);
+    pj_strdup2(pool, &port_name, name);
+
+    pjmedia_port_info_init(&tp->base.info, &port_name, TEST_SIGNATURE,
+                           CLOCK_RATE, 1, 16, spf);
+    tp->base.get_frame = &tp_get_frame;
+    tp->base.put_frame = &tp_put_frame;
+    tp->id = id;
+    tp->amplitude = amplitude;
+    tp->seed = id * 7919;
+    tp->rx_hash = 2166136261U;
+
+    return tp;
+}
+
+/*
+ * Run a conference with the specified number of threads and active
+ * speakers, where only the first talker_cnt ports generate audio, and
+ * store the hash of the frames received by each port and the master port.
+ */
+static int run_conf(unsigned threads, unsigned active_speakers,
+                    unsigned talker_cnt, pj_uint32_t hashes[PORT_CNT+1])
+{
+    pj_pool_t *pool;
+    pjmedia_conf_param param;
+    pjmedia_conf *conf = NULL;
+    pjmedia_port *master;
+    test_port *tp[PORT_CNT];
+    unsigned slot[PORT_CNT];
+    pj_int16_t buf[SPF];
+    pj_uint32_t master_hash = 2166136261U;
+    unsigned i, j;
+    pj_status_t status;
+    int rc = 0;
+
+    pool = pj_pool_create(mem, "conftest", 4000, 4000, NULL);
+
+    pjmedia_conf_param_default(&param);
+    param.max_slots = PORT_CNT + 1;
+    param.sampling_rate = CLOCK_RATE;
+    param.channel_count = 1;
+    param.samples_per_frame = SPF;
+    param.bits_per_sample = 16;
+    param.options = PJMEDIA_CONF_NO_DEVICE;
+    param.worker_threads = threads;
+    param.active_speakers = active_speakers;
+
+    status = pjmedia_conf_create2(pool, &param, &conf);
+    if (status != PJ_SUCCESS) {
+        app_perror(status, "pjmedia_conf_create2() error");
+        rc = -10;
+        goto on_return;
+    }
+
+    for (i = 0; i < PORT_CNT; ++i) {
+        unsigned amplitude;
+
+        /* With all ports talking, make them loud. Otherwise make them
+         * quiet enough so the sum never needs to be normalized.
+         */
+        if (i >= talker_cnt)
+            amplitude = 0;
+        else if (talker_cnt == PORT_CNT)
+            amplitude = 20000;
+        else
+            amplitude = 32000 / talker_cnt;
+
+        /* Mix some ports with different ptime to exercise buffering */
+        tp[i] = create_test_port(pool, i, (i % 5 == 4) ? SPF * 2 : SPF,
+                                 amplitude);
+        status = pjmedia_conf_add_port(conf, pool, &tp[i]->base, NULL,
+                                       &slot[i]);
+        if (status != PJ_SUCCESS) {
+            app_perror(status, "pjmedia_conf_add_port() error");
+            rc = -20;
+            goto on_return;
+        }
+    }
+
+    /* Full mesh, with various level adjustments */
+    for (i = 0; i < PORT_CNT; ++i) {
+        pjmedia_conf_connect_port(conf, slot[i], 0, 0);
+        for (j = 0; j < PORT_CNT; ++j) {
+            if (i == j)
+                continue;
+            pjmedia_conf_connect_port(conf, slot[i], slot[j],
+                                      ((i + j) % 4 == 0) ? 64 : 0);
+        }
+        if (i % 3 == 1)
+            pjmedia_conf_adjust_rx_level(conf, slot[i], -64);
+        if (i % 4 == 2)
+            pjmedia_conf_adjust_tx_level(conf, slot[i], 32);
+    }
+
+    master = pjmedia_conf_get_master_port(conf);
+    for (i = 0; i < FRAME_CNT; ++i) {
+        pjmedia_frame frame;
+        pj_uint32_t type;
+
+        frame.buf = buf;
+        frame.size = sizeof(buf);
+        frame.timestamp.u64 = i * SPF;
+        frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+
+        status = pjmedia_port_get_frame(master, &frame);
+        if (status != PJ_SUCCESS) {
+            rc = -30;
+            goto on_return;
+        }
+
+        type = frame.type;
+        master_hash = hash_buf(master_hash, &type, sizeof(type));
+        if (frame.type == PJMEDIA_FRAME_TYPE_AUDIO)
+            master_hash = hash_buf(master_hash, buf, sizeof(buf));
+    }
+
+    for (i = 0; i < PORT_CNT; ++i)
+        hashes[i] = tp[i]->rx_hash;
+    hashes[PORT_CNT] = master_hash;
+
+on_return:
+    if (conf)
+        pjmedia_conf_destroy(conf);
+    pj_pool_release(pool);
+    return rc;
+}
+
+/*
+ * Verify that the parallel mode produces the same output as the
+ * single threaded mode.
+ */
+static int parallel_test(void)
+{
+    pj_uint32_t serial[PORT_CNT+1];
+    const unsigned threads[] = { 2, 3, 4 };
+    unsigned i, j;
+    int rc;
+
+    rc = run_conf(1, 0, PORT_CNT, serial);
+    if (rc != 0)
+        return rc;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(threads); ++i) {
+        pj_uint32_t parallel[PORT_CNT+1];
+
+        PJ_LOG(3,(THIS_FILE, "  comparing %u threads with serial mode",
+                  threads[i]));
+
+        rc = run_conf(threads[i], 0, PORT_CNT, parallel);
+        if (rc != 0)
+            return rc - 100;
+
+        for (j = 0; j <= PORT_CNT; ++j) {
+            if (parallel[j] != serial[j]) {
+                PJ_LOG(1,(THIS_FILE, "  error: output of port %u differs "
+                          "with %u threads", j, threads[i]));
+                return -200;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Verify the active speaker mode. When there are no more talkers than
+ * the limit, the output must be the same as mixing all ports, in both
+ * serial and parallel mode. With fewer active speakers than talkers, the
+ * output must differ, but still be the same in parallel mode.
+ */
+static int active_speaker_test(void)
+{
+    enum { TALKER_CNT = 4 };
+    pj_uint32_t full[PORT_CNT+1];
+    pj_uint32_t active[PORT_CNT+1];
+    pj_uint32_t pruned[PORT_CNT+1];
+    const unsigned threads[] = { 1, 3 };
+    unsigned i, j;
+    int rc;
+
+    rc = run_conf(1, 0, TALKER_CNT, full);
+    if (rc != 0)
+        return rc;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(threads); ++i) {
+        PJ_LOG(3,(THIS_FILE, "  %u active speakers with %u thread(s)",
+                  TALKER_CNT, threads[i]));
+
+        rc = run_conf(threads[i], TALKER_CNT, TALKER_CNT, active);
+        if (rc != 0)
+            return rc - 100;
+
+        for (j = 0; j <= PORT_CNT; ++j) {
+            if (active[j] != full[j]) {
+                PJ_LOG(1,(THIS_FILE, "  error: output of port %u differs "
+                          "from full mixing", j));
+                return -200;
+            }
+        }
+    }
+
+    PJ_LOG(3,(THIS_FILE, "  %u active speakers out of %u talkers",
+              TALKER_CNT/2, TALKER_CNT));
+
+    rc = run_conf(1, TALKER_CNT/2, TALKER_CNT, pruned);
+    if (rc != 0)
+        return rc - 300;
+
+    for (j = 0; j < PORT_CNT; ++j) {
+        if (pruned[j] != full[j])
+            break;
+    }
+    if (j == PORT_CNT) {
+        PJ_LOG(1,(THIS_FILE, "  error: talkers are not pruned"));
+        return -400;
+    }
+
+    rc = run_conf(3, TALKER_CNT/2, TALKER_CNT, active);
+    if (rc != 0)
+        return rc - 500;
+
+    for (j = 0; j <= PORT_CNT; ++j) {
+        if (active[j] != pruned[j]) {
+            PJ_LOG(1,(THIS_FILE, "  error: output of port %u differs "
+                      "in parallel mode", j));
+            return -600;
+        }
+    }
+
+    return 0;
+}
+
+int conf_test(void)
+{
+    int rc;
+
+    PJ_LOG(3,(THIS_FILE, "Conference bridge parallel mode test"));
+    rc = parallel_test();
+    if (rc != 0)
+        return rc;
+
+    PJ_LOG(3,(THIS_FILE, "Conference bridge active speaker test"));
+    rc = active_speaker_test();
+    if (rc != 0)
+        return rc - 1000;
+
+    return 0;
+}
@@ -27,6 +27,13 @@
 #define JB_PTIME            20
 #define JB_BUF_SIZE         50
 
+#define ZC_FRAME_SIZE       32
+#define ZC_MAX_COUNT        8
+
+#define DL_TICKS            500
+#define DL_LATE_PERIOD      10
+#define DL_LATE_TICKS       3
+
 //#define REPORT
 //#define PRINT_COMMENT
 
@@ -164,6 +171,220 @@ static pj_bool_t process_test_data(char data, pjmedia_jbuf *jb,
     return PJ_TRUE;
 }
 
+/* Number of free frame buffers, all must be free after the test */
+static unsigned count_free_buf(pjmedia_jbuf *jb)
+{
+    pjmedia_jb_buf *buf[ZC_MAX_COUNT + PJMEDIA_JBUF_EXTRA_BUF_CNT + 1];
+    unsigned i, cnt = 0;
+
+    while (cnt < PJ_ARRAY_SIZE(buf) &&
+           pjmedia_jbuf_alloc_buf(jb, &buf[cnt], NULL) == PJ_SUCCESS)
+    {
+        ++cnt;
+    }
+    for (i = 0; i < cnt; ++i)
+        pjmedia_jbuf_release_buf(jb, buf[i]);
+
+    return cnt;
+}
+
+/* Put frames without copy, and read them in place */
+static int zero_copy_test(void)
+{
+    pj_str_t jb_name = {"JBZC", 4};
+    pj_pool_t *pool;
+    pjmedia_jbuf *jb;
+    pjmedia_jb_buf *buf, *peeked;
+    const void *data;
+    char frame[ZC_FRAME_SIZE], f_type;
+    pj_size_t size;
+    pj_bool_t discarded;
+    int seq, rc = 0;
+
+    printf("\n\nZero-copy frame access\n");
+
+    pool = pj_pool_create(mem, "JBZC", 1000, 1000, NULL);
+    pjmedia_jbuf_create(pool, &jb_name, ZC_FRAME_SIZE, JB_PTIME,
+                        ZC_MAX_COUNT, &jb);
+    pjmedia_jbuf_set_fixed(jb, 0);
+
+    /* Frame 1..4 are built in place, frame 5 is copied */
+    for (seq = 1; seq <= 4; ++seq) {
+        void *p;
+
+        if (pjmedia_jbuf_alloc_buf(jb, &buf, &p) != PJ_SUCCESS) {
+            rc = -100;
+            goto on_return;
+        }
+        pj_memset(p, seq, ZC_FRAME_SIZE);
+        pjmedia_jbuf_put_buf(jb, buf, ZC_FRAME_SIZE - seq, 0, seq, 0,
+                             &discarded);
+        if (discarded) {
+            rc = -110;
+            goto on_return;
+        }
+    }
+    pj_memset(frame, 5, sizeof(frame));
+    pjmedia_jbuf_put_frame3(jb, frame, ZC_FRAME_SIZE - 5, 0, 5, 0, NULL);
+
+    /* Duplicate is rejected and its buffer is released */
+    pjmedia_jbuf_alloc_buf(jb, &buf, NULL);
+    pjmedia_jbuf_put_buf(jb, buf, 1, 0, 3, 0, &discarded);
+    if (!discarded) {
+        rc = -120;
+        goto on_return;
+    }
+
+    /* Peeked frame content outlives its removal from the jitter buffer */
+    pjmedia_jbuf_peek_buf(jb, 0, &data, &peeked, &size, &f_type,
+                          NULL, NULL, NULL);
+    if (f_type != PJMEDIA_JB_NORMAL_FRAME || !peeked) {
+        rc = -130;
+        goto on_return;
+    }
+    pjmedia_jbuf_remove_frame(jb, 1);
+    if (size != ZC_FRAME_SIZE - 1 || ((const char*)data)[0] != 1) {
+        rc = -140;
+        goto on_return;
+    }
+    pjmedia_jbuf_release_buf(jb, peeked);
+
+    /* Borrow the rest */
+    for (seq = 2; seq <= 5; ++seq) {
+        pjmedia_jbuf_borrow_frame(jb, &data, &buf, &size, &f_type,
+                                  NULL, NULL, NULL);
+        if (f_type != PJMEDIA_JB_NORMAL_FRAME || !buf ||
+            size != (pj_size_t)(ZC_FRAME_SIZE - seq) ||
+            ((const char*)data)[0] != seq ||
+            ((const char*)data)[size-1] != seq)
+        {
+            printf("! Borrowed frame %d is wrong\n", seq);
+            rc = -150;
+            goto on_return;
+        }
+        pjmedia_jbuf_release_buf(jb, buf);
+    }
+
+    pjmedia_jbuf_borrow_frame(jb, &data, &buf, &size, &f_type,
+                              NULL, NULL, NULL);
+    if (f_type != PJMEDIA_JB_ZERO_EMPTY_FRAME || buf || data) {
+        rc = -160;
+        goto on_return;
+    }
+
+    /* Every buffer is back */
+    if (count_free_buf(jb) != ZC_MAX_COUNT + PJMEDIA_JBUF_EXTRA_BUF_CNT) {
+        printf("! Frame buffers leaked\n");
+        rc = -170;
+        goto on_return;
+    }
+
+on_return:
+    pjmedia_jbuf_destroy(jb);
+    pj_pool_release(pool);
+    return rc;
+}
+
+/* Every DL_LATE_PERIOD-th frame arrives DL_LATE_TICKS ticks late, so
+ * delay-based algorithm should target DL_LATE_TICKS+1 frames.
+ */
+static void delay_put_tick(pjmedia_jbuf *jb, int tick)
+{
+    char frame[ZC_FRAME_SIZE];
+    int seq;
+
+    pj_bzero(frame, sizeof(frame));
+    for (seq = tick - DL_LATE_TICKS; seq <= tick; ++seq) {
+        pj_bool_t late = (seq % DL_LATE_PERIOD) == DL_LATE_PERIOD / 2;
+
+        if (seq < 0 || seq + (late? DL_LATE_TICKS : 0) != tick)
+            continue;
+        pjmedia_jbuf_put_frame3(jb, frame, sizeof(frame), 0, seq, 0, NULL);
+    }
+}
+
+static int delay_target_test(void)
+{
+    pj_str_t jb_name = {"JBDL", 4};
+    pj_pool_t *pool;
+    pjmedia_jbuf *jb;
+    pjmedia_jb_state state;
+    char frame[ZC_FRAME_SIZE], f_type;
+    unsigned discard = 0;
+    pj_bool_t skipped = PJ_FALSE;
+    int tick, adjust, rc = 0;
+
+    printf("\n\nDelay-based target estimation\n");
+
+    pool = pj_pool_create(mem, "JBDL", 1000, 1000, NULL);
+    pjmedia_jbuf_create(pool, &jb_name, ZC_FRAME_SIZE, JB_PTIME,
+                        JB_BUF_SIZE, &jb);
+    pjmedia_jbuf_set_adaptive(jb, JB_INIT_PREFETCH, JB_MIN_PREFETCH,
+                              JB_MAX_PREFETCH);
+    pjmedia_jbuf_set_discard(jb, PJMEDIA_JB_DISCARD_DELAY);
+
+    /* Without time-stretching, the latency stays low */
+    for (tick = 0; tick < DL_TICKS; ++tick) {
+        delay_put_tick(jb, tick);
+        pjmedia_jbuf_get_frame(jb, frame, &f_type);
+    }
+
+    pjmedia_jbuf_get_state(jb, &state);
+    adjust = pjmedia_jbuf_get_delay_adjust(jb);
+    printf("target=%d size=%d adjust=%d discard=%d\n", state.target,
+           state.size, adjust, state.discard);
+    if (state.target != DL_LATE_TICKS + 1) {
+        rc = -200;
+        goto on_return;
+    }
+    if (adjust >= 0) {
+        rc = -210;
+        goto on_return;
+    }
+
+    /* Follow the adjustment as audio stream does, i.e: skip GET (but not
+     * twice in a row) to lengthen the audio, or GET one more frame to
+     * shorten it. The latency reaches the target, then late frames are
+     * no longer discarded.
+     */
+    for (; tick < DL_TICKS * 2; ++tick) {
+        delay_put_tick(jb, tick);
+        adjust = pjmedia_jbuf_get_delay_adjust(jb);
+        if (adjust < 0 && !skipped) {
+            pjmedia_jbuf_time_stretched(jb, JB_PTIME * 1000);
+            skipped = PJ_TRUE;
+        } else {
+            pjmedia_jbuf_get_frame(jb, frame, &f_type);
+            if (adjust > 0) {
+                pjmedia_jbuf_get_frame(jb, frame, &f_type);
+                pjmedia_jbuf_time_stretched(jb, -JB_PTIME * 1000);
+            }
+            skipped = PJ_FALSE;
+        }
+        if (tick == DL_TICKS * 3 / 2) {
+            pjmedia_jbuf_get_state(jb, &state);
+            discard = state.discard;
+        }
+    }
+
+    pjmedia_jbuf_get_state(jb, &state);
+    printf("target=%d size=%d adjust=%d discard=%d\n", state.target,
+           state.size, adjust, state.discard);
+    if (adjust != 0 || state.target != DL_LATE_TICKS + 1) {
+        rc = -220;
+        goto on_return;
+    }
+    if (state.discard != discard) {
+        rc = -230;
+        goto on_return;
+    }
+
+on_return:
+    pjmedia_jbuf_destroy(jb);
+    pj_pool_release(pool);
+    return rc;
+}
+
 int jbuf_main(void)
 {
     FILE *input;
@@ -344,6 +565,13 @@ int jbuf_main(void)
     }
 
     fclose(input);
+
+    if (rc == 0)
+        rc = zero_copy_test();
+
+    if (rc == 0)
+        rc = delay_target_test();
+
     pj_log_set_level(old_log_level);
 
     return rc;
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#define THIS_FILE       "mix_test.c"
+
+#define MAX_COUNT       1920
+#define BENCH_LOOP      20000
+#define BENCH_SPF       320
+
+static const char *impl_names[] = { "auto", "scalar", "SSE2", "AVX2" };
+
+static pj_int16_t   src16[MAX_COUNT];
+static pj_int32_t   src32[MAX_COUNT];
+static pj_int32_t   ref_mix[MAX_COUNT];
+static pj_int32_t   test_mix[MAX_COUNT];
+static pj_int16_t   ref16[MAX_COUNT];
+static pj_int16_t   test16[MAX_COUNT];
+
+
+static void fill_random(unsigned count, pj_int32_t range32)
+{
+    unsigned i;
+
+    for (i = 0; i < count; ++i) {
+        pj_uint32_t r = ((pj_uint32_t)pj_rand() << 16) ^ (pj_uint32_t)pj_rand();
+
+        src16[i] = (pj_int16_t)(r & 0xFFFF);
+        src32[i] = (pj_int32_t)((pj_int64_t)(r % (2 * (pj_uint32_t)range32 + 1))
+                                - range32);
+    }
+
+    /* Make sure the extremes are there */
+    if (count > 2) {
+        src16[0] = -32768;
+        src16[1] = 32767;
+    }
+}
+
+/*
+ * Compare the output of the implementation with the scalar routines
+ * for one buffer size and adjustment level.
+ */
+static int compare_impl(pjmedia_mix_impl impl, unsigned count,
+                        unsigned adj_level, pj_int32_t range32)
+{
+    pj_int32_t ref_min, ref_max, test_min, test_max;
+    pj_uint32_t ref_sum, test_sum;
+
+    fill_random(count, range32);
+
+    /* Mixing */
+    pj_memcpy(ref_mix, src32, count * sizeof(pj_int32_t));
+    pj_memcpy(test_mix, src32, count * sizeof(pj_int32_t));
+    pjmedia_mix_set_impl(PJMEDIA_MIX_IMPL_SCALAR);
+    pjmedia_mix_add_samples(ref_mix, src16, count, &ref_min, &ref_max);
+    pjmedia_mix_set_impl(impl);
+    pjmedia_mix_add_samples(test_mix, src16, count, &test_min, &test_max);
+    if (pj_memcmp(ref_mix, test_mix, count * sizeof(pj_int32_t)) ||
+        ref_min != test_min || ref_max != test_max)
+    {
+        return -10;
+    }
+
+    /* Mix-minus, in place */
+    pjmedia_mix_set_impl(PJMEDIA_MIX_IMPL_SCALAR);
+    pjmedia_mix_sub_samples(ref_mix, ref_mix, src16, count,
+                            &ref_min, &ref_max);
+    pjmedia_mix_set_impl(impl);
+    pjmedia_mix_sub_samples(test_mix, test_mix, src16, count,
+                            &test_min, &test_max);
+    if (pj_memcmp(ref_mix, test_mix, count * sizeof(pj_int32_t)) ||
+        ref_min != test_min || ref_max != test_max)
+    {
+        return -15;
+    }
+
+    /* Copy */
+    pjmedia_mix_set_impl(PJMEDIA_MIX_IMPL_SCALAR);
+    pjmedia_mix_copy_samples(ref_mix, src16, count);
+    pjmedia_mix_set_impl(impl);
+    pjmedia_mix_copy_samples(test_mix, src16, count);
+    if (pj_memcmp(ref_mix, test_mix, count * sizeof(pj_int32_t)))
+        return -20;
+
+    /* Level adjustment, in place */
+    pj_memcpy(ref16, src16, count * sizeof(pj_int16_t));
+    pj_memcpy(test16, src16, count * sizeof(pj_int16_t));
+    pjmedia_mix_set_impl(PJMEDIA_MIX_IMPL_SCALAR);
+    ref_sum = pjmedia_mix_adjust_samples(ref16, ref16, count, adj_level);
+    pjmedia_mix_set_impl(impl);
+    test_sum = pjmedia_mix_adjust_samples(test16, test16, count, adj_level);
+    if (pj_memcmp(ref16, test16, count * sizeof(pj_int16_t)) ||
+        ref_sum != test_sum)
+    {
+        return -30;
+    }
+
+    /* Conversion to 16bit, in place in the mix buffer like the bridge */
+    pj_memcpy(ref_mix, src32, count * sizeof(pj_int32_t));
+    pj_memcpy(test_mix, src32, count * sizeof(pj_int32_t));
+    pjmedia_mix_set_impl(PJMEDIA_MIX_IMPL_SCALAR);
+    ref_sum = pjmedia_mix_to_samples((pj_int16_t*)ref_mix, ref_mix, count,
+                                     adj_level);
+    pjmedia_mix_set_impl(impl);
+    test_sum = pjmedia_mix_to_samples((pj_int16_t*)test_mix, test_mix, count,
+                                      adj_level);
+    if (pj_memcmp(ref_mix, test_mix, count * sizeof(pj_int16_t)) ||
+        ref_sum != test_sum)
+    {
+        return -40;
+    }
+
+    /* Signal level */
+    pjmedia_mix_set_impl(PJMEDIA_MIX_IMPL_SCALAR);
+    ref_sum = pjmedia_mix_sum_abs(src16, count);
+    pjmedia_mix_set_impl(impl);
+    test_sum = pjmedia_mix_sum_abs(src16, count);
+    if (ref_sum != test_sum)
+        return -50;
+
+    return 0;
+}
+
+static int impl_test(pjmedia_mix_impl impl)
+{
+    const unsigned adj_levels[] = { 0, 1, 64, 128, 129, 200, 255, 100000 };
+    /* Large enough to overflow the level adjustment, but not the mixing */
+    const pj_int32_t ranges[] = { 100, 40000, 8000000, 0x7FFF0000 };
+    unsigned count, i, j;
+    int rc;
+
+    for (count = 0; count <= MAX_COUNT;
+         count = (count < 70 ? count + 1 : count * 2))
+    {
+        for (i = 0; i < PJ_ARRAY_SIZE(adj_levels); ++i) {
+            for (j = 0; j < PJ_ARRAY_SIZE(ranges); ++j) {
+                rc = compare_impl(impl, count, adj_levels[i], ranges[j]);
+                if (rc != 0) {
+                    PJ_LOG(1,(THIS_FILE, "  error: %s differs from scalar "
+                              "(rc=%d count=%u adj=%u range=%d)",
+                              impl_names[impl], rc, count, adj_levels[i],
+                              ranges[j]));
+                    return rc;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+#if WITH_BENCHMARK
+static void bench_impl(pjmedia_mix_impl impl)
+{
+    pj_timestamp t0, t1;
+    pj_int32_t mix_min, mix_max;
+    unsigned i;
+
+    fill_random(BENCH_SPF, 32767);
+    pj_bzero(test_mix, sizeof(test_mix));
+    pjmedia_mix_set_impl(impl);
+
+    pj_get_timestamp(&t0);
+    for (i = 0; i < BENCH_LOOP; ++i) {
+        pjmedia_mix_adjust_samples(test16, src16, BENCH_SPF, 100);
+        pjmedia_mix_add_samples(test_mix, test16, BENCH_SPF,
+                                &mix_min, &mix_max);
+        pjmedia_mix_sum_abs(src16, BENCH_SPF);
+        if ((i & 7) == 7) {
+            pjmedia_mix_to_samples(test16, test_mix, BENCH_SPF, 100);
+            pj_bzero(test_mix, BENCH_SPF * sizeof(pj_int32_t));
+        }
+    }
+    pj_get_timestamp(&t1);
+
+    PJ_LOG(3,(THIS_FILE, "  %-6s: %u frames of %u samples in %u usec",
+              impl_names[impl], BENCH_LOOP, BENCH_SPF,
+              pj_elapsed_usec(&t0, &t1)));
+}
+#endif
+
+int mix_test(void)
+{
+    const pjmedia_mix_impl impls[] = { PJMEDIA_MIX_IMPL_SCALAR,
+                                       PJMEDIA_MIX_IMPL_SSE2,
+                                       PJMEDIA_MIX_IMPL_AVX2 };
+    pjmedia_mix_impl orig_impl = pjmedia_mix_get_impl();
+    unsigned i;
+    int rc = 0;
+
+    pj_srand(0x1234);
+
+    for (i = 0; i < PJ_ARRAY_SIZE(impls); ++i) {
+        if (pjmedia_mix_set_impl(impls[i]) != PJ_SUCCESS) {
+            PJ_LOG(3,(THIS_FILE, "  %s is not supported, skipped",
+                      impl_names[impls[i]]));
+            continue;
+        }
+
+        PJ_LOG(3,(THIS_FILE, "  testing %s mixing routines",
+                  impl_names[impls[i]]));
+        rc = impl_test(impls[i]);
+        if (rc != 0)
+            goto on_return;
+
+#if WITH_BENCHMARK
+        bench_impl(impls[i]);
+#endif
+    }
+
+on_return:
+    pjmedia_mix_set_impl(orig_impl);
+    return rc;
+}
@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#define THIS_FILE       "srtp_test.c"
+
+#if defined(PJMEDIA_HAS_SRTP) && (PJMEDIA_HAS_SRTP != 0)
+
+/*
+ * Test the AES_CM_128 cipher implementations and the batch encryption:
+ * every implementation must produce the same SRTP/SRTCP packets as the
+ * libsrtp cipher, and the packets must decrypt back to the original.
+ */
+
+#define CRYPTO_NAME     "AES_CM_128_HMAC_SHA1_80"
+#define PKT_CNT         40
+#define BATCH           8
+#define MAX_PKT         1500
+#define SSRC            0x12345678
+
+#define BENCH_STREAMS   64
+#define BENCH_PKT_PER   4
+#define BENCH_ROUNDS    250
+#define BENCH_PAYLOAD   160
+
+static const char *impl_names[] = { "auto", "libsrtp", "aesni", "vaes" };
+
+static pj_uint8_t plain[PKT_CNT][MAX_PKT];
+static int plain_len[PKT_CNT];
+static pj_uint8_t ref[PKT_CNT][MAX_PKT];
+static int ref_len[PKT_CNT];
+static pj_uint8_t enc[PKT_CNT][MAX_PKT];
+static int enc_len[PKT_CNT];
+
+static void set_key(pjmedia_srtp_crypto *crypto, char *key, pj_uint8_t seed)
+{
+    unsigned i;
+
+    for (i = 0; i < 30; ++i)
+        key[i] = (char)(seed + i * 7);
+
+    pj_bzero(crypto, sizeof(*crypto));
+    crypto->key = pj_str(key);
+    crypto->key.slen = 30;
+    crypto->name = pj_str(CRYPTO_NAME);
+}
+
+/* Create a pair of SRTP transports keyed to talk to each other */
+static pj_status_t create_pair(pjmedia_endpt *endpt,
+                               pjmedia_transport **a,
+                               pjmedia_transport **b)
+{
+    static char key1[30], key2[30];
+    pjmedia_srtp_crypto c1, c2;
+    pjmedia_transport *loop;
+    pj_status_t status;
+    int i;
+
+    *a = *b = NULL;
+    set_key(&c1, key1, 1);
+    set_key(&c2, key2, 100);
+
+    for (i = 0; i < 2; ++i) {
+        pjmedia_transport **p = i==0 ? a : b;
+
+        status = pjmedia_transport_loop_create(endpt, &loop);
+        if (status != PJ_SUCCESS)
+            return status;
+
+        status = pjmedia_transport_srtp_create(endpt, loop, NULL, p);
+        if (status != PJ_SUCCESS) {
+            pjmedia_transport_close(loop);
+            return status;
+        }
+    }
+
+    status = pjmedia_transport_srtp_start(*a, &c1, &c2);
+    if (status == PJ_SUCCESS)
+        status = pjmedia_transport_srtp_start(*b, &c2, &c1);
+    return status;
+}
+
+static void destroy_pair(pjmedia_transport *a, pjmedia_transport *b)
+{
+    if (a) pjmedia_transport_close(a);
+    if (b) pjmedia_transport_close(b);
+}
+
+/* RTP packet with sequence number seq, or RTCP SR when seq is negative */
+static int build_pkt(pj_uint8_t *pkt, int seq, unsigned payload_len)
+{
+    unsigned i, hdr_len;
+
+    if (seq >= 0) {
+        pkt[0] = 0x80;
+        pkt[1] = 0;
+        pkt[2] = (pj_uint8_t)(seq >> 8);
+        pkt[3] = (pj_uint8_t)seq;
+        pj_bzero(pkt+4, 4);
+        hdr_len = 12;
+    } else {
+        pkt[0] = 0x80;
+        pkt[1] = 200;
+        pkt[2] = 0;
+        pkt[3] = (pj_uint8_t)((payload_len + 8) / 4 - 1);
+        hdr_len = 8;
+    }
+    pkt[hdr_len-4] = (pj_uint8_t)(SSRC >> 24);
+    pkt[hdr_len-3] = (pj_uint8_t)(SSRC >> 16);
+    pkt[hdr_len-2] = (pj_uint8_t)(SSRC >> 8);
+    pkt[hdr_len-1] = (pj_uint8_t)SSRC;
+
+    for (i = 0; i < payload_len; ++i)
+        pkt[hdr_len + i] = (pj_uint8_t)(i * 13 + seq);
+
+    return hdr_len + payload_len;
+}
+
+static void build_all(void)
+{
+    unsigned i;
+
+    /* Lengths around the block and batch boundaries, plus RTCP */
+    for (i = 0; i < PKT_CNT; ++i) {
+        unsigned payload_len = (i * 37) % 1200 + (i & 1);
+
+        if (i % 10 == 9)
+            plain_len[i] = build_pkt(plain[i], -1, 40 + i * 4);
+        else
+            plain_len[i] = build_pkt(plain[i], i, payload_len);
+    }
+}
+
+/* Encrypt the test packets on a fresh session with the given cipher */
+static int encrypt_all(pjmedia_endpt *endpt, pj_uint8_t out[][MAX_PKT],
+                       int out_len[], pj_bool_t verify)
+{
+    pjmedia_transport *a, *b;
+    pjmedia_srtp_batch_pkt pkts[BATCH];
+    pj_uint8_t buf[MAX_PKT];
+    unsigned i, j;
+    pj_status_t status;
+    int rc = 0;
+
+    status = create_pair(endpt, &a, &b);
+    if (status != PJ_SUCCESS) {
+        app_perror(status, "  error creating SRTP transports");
+        destroy_pair(a, b);
+        return -10;
+    }
+
+    for (i = 0; i < PKT_CNT; i += BATCH) {
+        unsigned cnt = PJ_MIN(BATCH, PKT_CNT - i);
+
+        for (j = 0; j < cnt; ++j) {
+            pj_memcpy(out[i+j], plain[i+j], plain_len[i+j]);
+            pkts[j].tp = a;
+            pkts[j].is_rtp = (i+j) % 10 != 9;
+            pkts[j].pkt = out[i+j];
+            pkts[j].len = plain_len[i+j];
+        }
+
+        status = pjmedia_transport_srtp_encrypt_batch(pkts, cnt);
+        if (status != PJ_SUCCESS) {
+            app_perror(status, "  error encrypting batch");
+            rc = -20;
+            goto on_return;
+        }
+
+        for (j = 0; j < cnt; ++j)
+            out_len[i+j] = pkts[j].len;
+    }
+
+    if (!verify)
+        goto on_return;
+
+    /* TX ROC is reported for the SSRC of the batch */
+    {
+        pjmedia_transport_info info;
+        pjmedia_srtp_info *srtp_info;
+
+        pjmedia_transport_info_init(&info);
+        pjmedia_transport_get_info(a, &info);
+        srtp_info = (pjmedia_srtp_info*)
+                    pjmedia_transport_info_get_spc_info(
+                                    &info, PJMEDIA_TRANSPORT_TYPE_SRTP);
+        if (!srtp_info || srtp_info->tx_roc.ssrc != SSRC) {
+            PJ_LOG(3,(THIS_FILE, "  error: TX ROC SSRC is not set"));
+            rc = -25;
+            goto on_return;
+        }
+    }
+
+    for (i = 0; i < PKT_CNT; ++i) {
+        int len = out_len[i];
+
+        pj_memcpy(buf, out[i], len);
+        status = pjmedia_transport_srtp_decrypt_pkt(b, i % 10 != 9,
+                                                    buf, &len);
+        if (status != PJ_SUCCESS) {
+            app_perror(status, "  error decrypting packet");
+            rc = -30;
+            goto on_return;
+        }
+        if (len != plain_len[i] || pj_memcmp(buf, plain[i], len) != 0) {
+            PJ_LOG(3,(THIS_FILE, "  error: packet %d decrypts wrongly", i));
+            rc = -40;
+            goto on_return;
+        }
+    }
+
+on_return:
+    destroy_pair(a, b);
+    return rc;
+}
+
+#if WITH_BENCHMARK
+static void bench_impl(pjmedia_endpt *endpt, const char *name,
+                       unsigned batch)
+{
+    static pj_uint8_t buf[BENCH_STREAMS*BENCH_PKT_PER][MAX_PKT];
+    pjmedia_transport *a[BENCH_STREAMS], *b[BENCH_STREAMS];
+    pjmedia_srtp_batch_pkt pkts[BENCH_STREAMS*BENCH_PKT_PER];
+    const unsigned total = BENCH_STREAMS * BENCH_PKT_PER;
+    pj_timestamp t0, t1;
+    pj_uint32_t usec;
+    unsigned i, j, seq = 0;
+
+    pj_bzero(a, sizeof(a));
+    pj_bzero(b, sizeof(b));
+    for (i = 0; i < BENCH_STREAMS; ++i) {
+        if (create_pair(endpt, &a[i], &b[i]) != PJ_SUCCESS)
+            goto on_return;
+    }
+
+    pj_get_timestamp(&t0);
+    for (i = 0; i < BENCH_ROUNDS; ++i) {
+        for (j = 0; j < total; ++j) {
+            pkts[j].tp = a[j / BENCH_PKT_PER];
+            pkts[j].is_rtp = PJ_TRUE;
+            pkts[j].pkt = buf[j];
+            pkts[j].len = build_pkt(buf[j], seq + (j % BENCH_PKT_PER),
+                                    BENCH_PAYLOAD);
+        }
+        for (j = 0; j < total; j += batch)
+            pjmedia_transport_srtp_encrypt_batch(&pkts[j], batch);
+        seq += BENCH_PKT_PER;
+    }
+    pj_get_timestamp(&t1);
+
+    usec = pj_elapsed_usec(&t0, &t1);
+    if (usec == 0) usec = 1;
+    PJ_LOG(3,(THIS_FILE, "  %-7s batch %3u: %u packets in %u usec, "
+              "%u packets/sec/core",
+              name, batch, BENCH_ROUNDS * total, usec,
+              (unsigned)((pj_uint64_t)BENCH_ROUNDS * total * 1000000 /
+                         usec)));
+
+on_return:
+    for (i = 0; i < BENCH_STREAMS; ++i)
+        destroy_pair(a[i], b[i]);
+}
+#endif
+
+int srtp_test(void)
+{
+    const pjmedia_srtp_cipher_impl impls[] = {
+        PJMEDIA_SRTP_CIPHER_IMPL_AESNI, PJMEDIA_SRTP_CIPHER_IMPL_VAES
+    };
+    pjmedia_srtp_cipher_impl saved_impl = pjmedia_srtp_get_cipher_impl();
+    pjmedia_endpt *endpt;
+    pj_status_t status;
+    unsigned i, j;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "Testing SRTP cipher implementations.."));
+
+    status = pjmedia_endpt_create(mem, NULL, 0, &endpt);
+    if (status != PJ_SUCCESS)
+        return -1;
+
+    build_all();
+
+    /* Reference: the libsrtp cipher */
+    pjmedia_srtp_set_cipher_impl(PJMEDIA_SRTP_CIPHER_IMPL_LIBSRTP);
+    rc = encrypt_all(endpt, ref, ref_len, PJ_TRUE);
+    if (rc != 0)
+        goto on_return;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(impls); ++i) {
+        const char *name = impl_names[impls[i]];
+
+        if (pjmedia_srtp_set_cipher_impl(impls[i]) != PJ_SUCCESS) {
+            PJ_LOG(3,(THIS_FILE, "  %s: not supported, skipped", name));
+            continue;
+        }
+
+        PJ_LOG(3,(THIS_FILE, "  %s..", name));
+        rc = encrypt_all(endpt, enc, enc_len, PJ_TRUE);
+        if (rc != 0)
+            goto on_return;
+
+        for (j = 0; j < PKT_CNT; ++j) {
+            if (enc_len[j] != ref_len[j] ||
+                pj_memcmp(enc[j], ref[j], ref_len[j]) != 0)
+            {
+                PJ_LOG(3,(THIS_FILE, "  error: %s differs from libsrtp "
+                          "at packet %d", name, j));
+                rc = -50;
+                goto on_return;
+            }
+        }
+    }
+
+#if WITH_BENCHMARK
+    {
+        const pjmedia_srtp_cipher_impl bench[] = {
+            PJMEDIA_SRTP_CIPHER_IMPL_LIBSRTP, PJMEDIA_SRTP_CIPHER_IMPL_AESNI,
+            PJMEDIA_SRTP_CIPHER_IMPL_VAES
+        };
+
+        PJ_LOG(3,(THIS_FILE, "  encrypting %d streams of %d byte payload",
+                  BENCH_STREAMS, BENCH_PAYLOAD));
+        for (i = 0; i < PJ_ARRAY_SIZE(bench); ++i) {
+            if (pjmedia_srtp_set_cipher_impl(bench[i]) != PJ_SUCCESS)
+                continue;
+            bench_impl(endpt, impl_names[bench[i]], 1);
+            bench_impl(endpt, impl_names[bench[i]],
+                       BENCH_STREAMS * BENCH_PKT_PER);
+        }
+    }
+#endif
+
+on_return:
+    pjmedia_srtp_set_cipher_impl(saved_impl);
+    pjmedia_endpt_destroy(endpt);
+    return rc;
+}
+
+#else
+int dummy_srtp_test;
+#endif  /* PJMEDIA_HAS_SRTP */
@@ -98,6 +98,18 @@ int test_main(void)
 #if HAS_JBUF_TEST
     DO_TEST(jbuf_main());
 #endif
+#if HAS_MIX_TEST
+    DO_TEST(mix_test());
+#endif
+#if HAS_CONF_TEST
+    DO_TEST(conf_test());
+#endif
+#if HAS_CLOCK_TEST
+    DO_TEST(clock_test());
+#endif
+#if HAS_SRTP_TEST
+    DO_TEST(srtp_test());
+#endif
 #if HAS_MIPS_TEST
     DO_TEST(mips_test());
 #endif
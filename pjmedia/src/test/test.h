@@ -35,6 +35,10 @@
 #endif
 #define HAS_SDP_NEG_TEST        1
 #define HAS_JBUF_TEST           1
+#define HAS_CONF_TEST           1
+#define HAS_MIX_TEST            1
+#define HAS_CLOCK_TEST          1
+#define HAS_SRTP_TEST           PJMEDIA_HAS_SRTP
 #define HAS_MIPS_TEST           WITH_BENCHMARK
 #define HAS_CODEC_VECTOR_TEST   1
 
@@ -42,6 +46,10 @@ int session_test(void);
 int rtp_test(void);
 int sdp_test(void);
 int jbuf_main(void);
+int conf_test(void);
+int mix_test(void);
+int clock_test(void);
+int srtp_test(void);
 int sdp_neg_test(void);
 int mips_test(void);
 int codec_test_vectors(void);
@@ -50,6 +50,11 @@
 #define LOSS_CORR       0
 #define LOSS_EXTRA      2
 #define SILENT          1
+#define JB_ALGO         PJMEDIA_JB_DISCARD_PROGRESSIVE
+#define SEED            1
+
+/* Maximum mouth-to-ear latency in the latency histogram, in ms */
+#define M2E_HIST_MAX    2000
 
 /*
    Test setup:
@@ -86,6 +91,9 @@ struct stream
             int         total_lost;     /* # of dropped pkts so far */
             unsigned    cur_lost_burst; /* current # of lost bursts */
             unsigned    drop_prob;      /* drop probability value   */
+            long        last_nominal;   /* Capture time of last pkt
+                                           that was not dropped, or
+                                           -1 if none (ms)          */
                                         
         } tx;
 
@@ -149,6 +157,18 @@ struct test_cfg
     int              rx_jb_min_pre;     /* JB minimum prefetch (ms) */
     int              rx_jb_max_pre;     /* JB maximum prefetch (ms) */
     int              rx_jb_max;         /* JB maximum size (ms)     */
+    pjmedia_jb_discard_algo rx_jb_algo; /* JB discard algorithm     */
+    pj_bool_t        rx_jb_compare;     /* Run with all algorithms  */
+};
+
+/* Result of a simulation */
+struct test_result
+{
+    pjmedia_jb_discard_algo algo;       /* JB discard algorithm     */
+    unsigned         m2e_avg;           /* Average latency (ms)     */
+    unsigned         m2e_p95;           /* 95th percentile (ms)     */
+    unsigned         m2e_max;           /* Maximum latency (ms)     */
+    pjmedia_jb_state jb_state;          /* Final JB state           */
 };
 
 /*
@@ -173,6 +193,12 @@ struct global_app
     pjmedia_port        *rx_wav;
 
     pj_time_val          wall_clock;
+
+    /* Mouth-to-ear latency */
+    unsigned             rx_frm_ptime;  /* JB frame ptime (ms)      */
+    pj_math_stat         m2e;           /* Latency statistic (ms)   */
+    unsigned             m2e_hist[M2E_HIST_MAX+1];
+                                        /* Latency histogram (ms)   */
 };
 
 static struct global_app g_app;
@@ -339,7 +365,7 @@ static pj_status_t stream_init(const struct stream_cfg *cfg, struct stream **p_s
         si.jb_min_pre = g_app.cfg.rx_jb_min_pre;
         si.jb_max_pre = g_app.cfg.rx_jb_max_pre;
         si.jb_max = g_app.cfg.rx_jb_max;
-        si.jb_discard_algo = PJMEDIA_JB_DISCARD_PROGRESSIVE;
+        si.jb_discard_algo = g_app.cfg.rx_jb_algo;
     }
 
     /* Get the codec info and param */
@@ -568,6 +594,17 @@ static pj_status_t test_init(void)
     /* Set the receiver in the loop transport */
     pjmedia_transport_loop_disable_rx(g_app.loop, g_app.tx->strm, PJ_TRUE);
 
+    /* Jitter buffer frame ptime, for calculating the latency */
+    {
+        pjmedia_stream_info si;
+
+        pjmedia_stream_get_info(g_app.rx->strm, &si);
+        g_app.rx_frm_ptime = si.param->info.frm_ptime /
+                             PJ_MAX(si.param->info.frm_ptime_denum, 1);
+    }
+    g_app.tx->state.tx.last_nominal = -1;
+    pj_math_stat_init(&g_app.m2e);
+
     /* Done */
     return PJ_SUCCESS;
 
@@ -704,6 +741,8 @@ static void tx_tick(const pj_time_val *t)
                                 sizeof(log_msg));
 
             strm->state.tx.cur_lost_burst = 0;
+            strm->state.tx.last_nominal = strm->state.tx.total_tx *
+                                          pkt_interval;
         }
 
         write_log(&entry, PJ_TRUE);
@@ -788,6 +827,25 @@ static void rx_tick(const pj_time_val *t)
             pjmedia_stream_get_stat_jbuf(g_app.rx->strm, &jstate);
             last_empty = jstate.empty;
 
+            /* Mouth-to-ear latency of the frame to be played: age of the
+             * newest received frame plus the frames queued before it,
+             * including the time-stretching queue in the stream.
+             */
+            if (jstate.size && g_app.tx->state.tx.last_nominal >= 0) {
+                unsigned ts_delay;
+                long m2e;
+
+                pjmedia_stream_get_stretch_delay(g_app.rx->strm, &ts_delay);
+                m2e = PJ_TIME_VAL_MSEC(*t) -
+                      g_app.tx->state.tx.last_nominal +
+                      (long)(jstate.size * g_app.rx_frm_ptime) +
+                      (long)ts_delay;
+                if (m2e < 0)
+                    m2e = 0;
+                pj_math_stat_update(&g_app.m2e, (int)m2e);
+                ++g_app.m2e_hist[MIN(m2e, M2E_HIST_MAX)];
+            }
+
             /* Pre GET event */
             pj_bzero(&entry, sizeof(entry));
             entry.event = EVENT_GET_PRE;
@@ -875,6 +933,14 @@ enum {
     OPT_MIN_LOST_BURST = 1,
     OPT_MAX_LOST_BURST,
     OPT_LOSS_CORR,
+    OPT_JB_ALGO,
+    OPT_JB_COMPARE,
+};
+
+/* Jitter buffer discard algorithm names, indexed by pjmedia_jb_discard_algo */
+static const char *jb_algo_names[] =
+{
+    "none", "static", "progressive", "delay"
 };
 
 
@@ -928,6 +994,14 @@ static void usage(void)
     printf("  --jb-max-pre, -%c MSEC  Jitter buffer maximum prefetch delay in msec\n", OPT_JB_MAX_PRE);
     printf("  --jb-max, -%c MSEC      Set maximum delay that can be accomodated by the\n", OPT_JB_MAX);
     printf("                         jitter buffer msec.\n");
+    printf("  --jb-algo NAME         Jitter buffer discard algorithm: none, static,\n");
+    printf("                         progressive, or delay (experimental, latency\n");
+    printf("                         is not lower than progressive yet).\n");
+    printf("                         Default: %s\n", jb_algo_names[JB_ALGO]);
+    printf("  --jb-compare           Run the simulation with each discard algorithm\n");
+    printf("                         under the same network conditions and compare\n");
+    printf("                         the mouth-to-ear latency. The log and output\n");
+    printf("                         WAV files are from the last run.\n");
 }
 
 
@@ -954,6 +1028,8 @@ static int init_options(int argc, char *argv[])
         { "jb-min-pre",     1, 0, OPT_JB_MIN_PRE },
         { "jb-max-pre",     1, 0, OPT_JB_MAX_PRE },
         { "jb-max",         1, 0, OPT_JB_MAX },
+        { "jb-algo",        1, 0, OPT_JB_ALGO },
+        { "jb-compare",     0, 0, OPT_JB_COMPARE },
         { "help",           0, 0, OPT_HELP},
         { NULL, 0, 0, 0 },
     };
@@ -984,6 +1060,7 @@ static int init_options(int argc, char *argv[])
     g_app.cfg.rx_jb_min_pre = -1;
     g_app.cfg.rx_jb_max_pre = -1;
     g_app.cfg.rx_jb_max = -1;
+    g_app.cfg.rx_jb_algo = JB_ALGO;
 
     /* Build format */
     format[0] = '\0';
@@ -1076,6 +1153,20 @@ static int init_options(int argc, char *argv[])
         case OPT_JB_MAX:
             g_app.cfg.rx_jb_max = atoi(pj_optarg);
             break;
+        case OPT_JB_ALGO:
+            for (c=0; c<(int)PJ_ARRAY_SIZE(jb_algo_names); ++c) {
+                if (pj_ansi_stricmp(pj_optarg, jb_algo_names[c]) == 0)
+                    break;
+            }
+            if (c == (int)PJ_ARRAY_SIZE(jb_algo_names)) {
+                puts("Error: Invalid jitter buffer discard algorithm?");
+                return 1;
+            }
+            g_app.cfg.rx_jb_algo = (pjmedia_jb_discard_algo)c;
+            break;
+        case OPT_JB_COMPARE:
+            g_app.cfg.rx_jb_compare = PJ_TRUE;
+            break;
         case OPT_HELP:
             usage();
             return 1;
@@ -1105,19 +1196,27 @@ static int init_options(int argc, char *argv[])
 /*****************************************************************************
  * main()
  */
-int main(int argc, char *argv[])
+
+/* Run one simulation with the specified jitter buffer discard algorithm */
+static int run_test(pjmedia_jb_discard_algo algo, struct test_result *res)
 {
+    struct test_cfg cfg = g_app.cfg;
+    unsigned i, cnt;
     pj_status_t status;
 
-    if (init_options(argc, argv) != 0)
-        return 1;
-
+    /* Start with a clean state, except the config */
+    pj_bzero(&g_app, sizeof(g_app));
+    g_app.cfg = cfg;
+    g_app.cfg.rx_jb_algo = algo;
 
     /* Init */
     status = test_init();
     if (status != PJ_SUCCESS)
         return 1;
 
+    /* Same network conditions for every run */
+    pj_srand(SEED);
+
     /* Print parameters */
     PJ_LOG(3,(THIS_FILE, "Starting simulation. Parameters: "));
     PJ_LOG(3,(THIS_FILE, "  Codec=%.*s, tx_ptime=%d, rx_ptime=%d",
@@ -1137,6 +1236,8 @@ int main(int argc, char *argv[])
               g_app.cfg.rx_jb_min_pre,
               g_app.cfg.rx_jb_max_pre,
               g_app.cfg.rx_jb_max));
+    PJ_LOG(3,(THIS_FILE, " RX jb discard algorithm:%s",
+              jb_algo_names[algo]));
     PJ_LOG(3,(THIS_FILE, " RX sound burst:%d frames",
               g_app.cfg.rx_snd_burst));
     PJ_LOG(3,(THIS_FILE, " DTX=%d, PLC=%d",
@@ -1145,15 +1246,75 @@ int main(int argc, char *argv[])
     /* Run test loop */
     test_loop(g_app.cfg.duration_msec);
 
+    /* Collect result */
+    pj_bzero(res, sizeof(*res));
+    res->algo = algo;
+    pjmedia_stream_get_stat_jbuf(g_app.rx->strm, &res->jb_state);
+    if (g_app.m2e.n) {
+        res->m2e_avg = g_app.m2e.mean;
+        res->m2e_max = g_app.m2e.max;
+        for (i=0, cnt=0; i<=M2E_HIST_MAX; ++i) {
+            cnt += g_app.m2e_hist[i];
+            if (cnt * 100 >= g_app.m2e.n * 95)
+                break;
+        }
+        res->m2e_p95 = i;
+    }
+
     /* Print statistics */
     PJ_LOG(3,(THIS_FILE, "Simulation done"));
     PJ_LOG(3,(THIS_FILE, " TX packets=%u, dropped=%u/%5.1f%%",
               g_app.tx->state.tx.total_tx,
               g_app.tx->state.tx.total_lost,
               (float)(g_app.tx->state.tx.total_lost * 100.0 / g_app.tx->state.tx.total_tx)));
+    PJ_LOG(3,(THIS_FILE, " Mouth-to-ear latency avg=%ums, p95=%ums, max=%ums",
+              res->m2e_avg, res->m2e_p95, res->m2e_max));
+    PJ_LOG(3,(THIS_FILE, " JB lost=%u, discard=%u, empty=%u",
+              res->jb_state.lost, res->jb_state.discard,
+              res->jb_state.empty));
 
     /* Done */
     test_destroy();
 
     return 0;
 }
+
+int main(int argc, char *argv[])
+{
+    struct test_result res[PJ_ARRAY_SIZE(jb_algo_names)];
+    unsigned i, cnt = 0;
+
+    if (init_options(argc, argv) != 0)
+        return 1;
+
+    if (g_app.cfg.rx_jb_compare) {
+        for (i=0; i<PJ_ARRAY_SIZE(jb_algo_names); ++i) {
+            if (run_test((pjmedia_jb_discard_algo)i, &res[cnt]) != 0)
+                return 1;
+            ++cnt;
+        }
+    } else {
+        if (run_test(g_app.cfg.rx_jb_algo, &res[cnt]) != 0)
+            return 1;
+        ++cnt;
+    }
+
+    /* Print comparison, it's printed to stdout as the log may be
+     * redirected to the log file.
+     */
+    if (cnt > 1) {
+        printf("\nMouth-to-ear latency (ms) by jitter buffer discard "
+               "algorithm:\n");
+        printf("  %-12s %6s %6s %6s %6s %8s %6s\n",
+               "algorithm", "avg", "p95", "max", "lost", "discard",
+               "empty");
+        for (i=0; i<cnt; ++i) {
+            printf("  %-12s %6u %6u %6u %6u %8u %6u\n",
+                   jb_algo_names[res[i].algo], res[i].m2e_avg,
+                   res[i].m2e_p95, res[i].m2e_max, res[i].jb_state.lost,
+                   res[i].jb_state.discard, res[i].jb_state.empty);
+        }
+    }
+
+    return 0;
+}
@@ -133,11 +133,14 @@ struct app
 
     pj_bool_t            thread_quit;
     unsigned             thread_count;
+    unsigned             rx_queue_count;
     pj_thread_t         *thread[16];
 
     pj_bool_t            real_sdp;
     pjmedia_sdp_session *dummy_sdp;
 
+    pj_bool_t            encode_bench;
+
     int                  log_level;
 
     struct {
@@ -871,6 +874,14 @@ static pj_status_t init_sip()
     PJ_ASSERT_RETURN(status == PJ_SUCCESS, status);
 
 
+    /* Process incoming messages in receive queues */
+    if (app.rx_queue_count) {
+        status = pjsip_endpt_create_rx_queues(app.sip_endpt,
+                                              app.rx_queue_count);
+        PJ_ASSERT_RETURN(status == PJ_SUCCESS, status);
+    }
+
+
     /* Done */
     return PJ_SUCCESS;
 }
@@ -1145,11 +1156,16 @@ static void usage(void)
         "                           client, you must add ;transport=tcp parameter to URL\n"
         "                           [default: no]\n"
         "   --thread-count=N        Set number of worker threads [default=1]\n"
+        "   --rx-queues=N           Process incoming messages in N receive queues\n"
+        "                           by Call-ID [default: no]\n"
         "   --trying                Send 100/Trying response (server, default no)\n"
         "   --ringing               Send 180/Ringing response (server, default no)\n"
         "   --delay=MS, -d          Delay answering call by MS (server, default no)\n"
         "\n"
         "Misc options:\n"
+        "   --encode-bench          Measure the cost of re-encoding a request with\n"
+        "                           the whole message or only the Via and CSeq\n"
+        "                           headers modified (--count times), and quit\n"
         "   --help, -h              Display this screen\n"
         "   --verbose, -v           Verbose logging (put more than once for even more)\n"
         "\n"
@@ -1170,7 +1186,8 @@ static int my_atoi(const char *s)
 
 static pj_status_t init_options(int argc, char *argv[])
 {
-    enum { OPT_THREAD_COUNT = 1, OPT_REAL_SDP, OPT_TRYING, OPT_RINGING };
+    enum { OPT_THREAD_COUNT = 1, OPT_REAL_SDP, OPT_TRYING, OPT_RINGING,
+           OPT_ENCODE_BENCH, OPT_RX_QUEUES };
     struct pj_getopt_option long_options[] = {
         { "local-port",     1, 0, 'p' },
         { "count",          1, 0, 'c' },
@@ -1186,6 +1203,8 @@ static pj_status_t init_options(int argc, char *argv[])
         { "delay",          1, 0, 'd' },
         { "trying",         0, 0, OPT_TRYING},
         { "ringing",        0, 0, OPT_RINGING},
+        { "encode-bench",   0, 0, OPT_ENCODE_BENCH},
+        { "rx-queues",      1, 0, OPT_RX_QUEUES},
         { NULL, 0, 0, 0 },
     };
     int c;
@@ -1292,6 +1311,18 @@ static pj_status_t init_options(int argc, char *argv[])
             app.server.send_ringing = 1;
             break;
 
+        case OPT_ENCODE_BENCH:
+            app.encode_bench = PJ_TRUE;
+            break;
+
+        case OPT_RX_QUEUES:
+            app.rx_queue_count = my_atoi(pj_optarg);
+            if (app.rx_queue_count > 64) {
+                PJ_LOG(3,(THIS_FILE, "Invalid --rx-queues %s", pj_optarg));
+                return -1;
+            }
+            break;
+
         default:
             PJ_LOG(1,(THIS_FILE, 
                       "Invalid argument. Use --help to see help"));
@@ -1648,6 +1679,84 @@ static void write_report(const char *msg)
 }
 
 
+/* Measure pjsip_tx_data_encode() when the request is re-sent, e.g. after
+ * failing over to another destination, with the whole message invalidated
+ * or with only the modified headers invalidated.
+ */
+static pj_status_t encode_bench(void)
+{
+    static char report[256];
+    pj_str_t target = pj_str("sip:bench@127.0.0.1");
+    pjsip_tx_data *tdata;
+    pjsip_via_hdr *via;
+    pjsip_cseq_hdr *cseq;
+    pj_timestamp t1, t2;
+    pj_uint32_t msec[2];
+    unsigned i, round;
+    pj_status_t status;
+
+    status = pjsip_endpt_create_request(app.sip_endpt, &pjsip_invite_method,
+                                        &target, &app.local_uri, &target,
+                                        &app.local_contact, NULL, -1, NULL,
+                                        &tdata);
+    if (status != PJ_SUCCESS) {
+        app_perror(THIS_FILE, "Error creating request", status);
+        return status;
+    }
+
+    tdata->msg->body = pjsip_msg_body_create(tdata->pool, &mime_application,
+                                             &mime_sdp, &dummy_sdp_str);
+
+    via = pjsip_via_hdr_create(tdata->pool);
+    via->transport = pj_str("UDP");
+    via->sent_by.host = app.local_addr;
+    via->sent_by.port = app.local_port;
+    via->branch_param = pj_str("z9hG4bKencode-bench");
+    pjsip_msg_insert_first_hdr(tdata->msg, (pjsip_hdr*)via);
+    cseq = (pjsip_cseq_hdr*) pjsip_msg_find_hdr(tdata->msg, PJSIP_H_CSEQ,
+                                                NULL);
+
+    for (round=0; round<2; ++round) {
+        pj_get_timestamp(&t1);
+        for (i=0; i<app.client.job_count; ++i) {
+            ++via->sent_by.port;
+            ++cseq->cseq;
+            if (round == 0) {
+                pjsip_tx_data_invalidate_msg(tdata);
+            } else {
+                pjsip_tx_data_invalidate_hdr(tdata, via);
+                pjsip_tx_data_invalidate_hdr(tdata, cseq);
+            }
+
+            status = pjsip_tx_data_encode(tdata);
+            if (status != PJ_SUCCESS) {
+                app_perror(THIS_FILE, "Error encoding request", status);
+                pjsip_tx_data_dec_ref(tdata);
+                return status;
+            }
+        }
+        pj_get_timestamp(&t2);
+        msec[round] = pj_elapsed_msec(&t1, &t2);
+        if (msec[round] == 0) msec[round] = 1;
+    }
+
+    pj_ansi_snprintf(report, sizeof(report),
+                     "Encoded %d INVITE requests of %d bytes:\n"
+                     " - whole message invalidated:  %d ms (%d/sec)\n"
+                     " - Via and CSeq invalidated:   %d ms (%d/sec)",
+                     app.client.job_count,
+                     (int)(tdata->buf.cur - tdata->buf.start),
+                     msec[0],
+                     (int)((pj_uint64_t)app.client.job_count*1000/msec[0]),
+                     msec[1],
+                     (int)((pj_uint64_t)app.client.job_count*1000/msec[1]));
+    write_report(report);
+
+    pjsip_tx_data_dec_ref(tdata);
+    return PJ_SUCCESS;
+}
+
+
 int main(int argc, char *argv[])
 {
     static char report[1024];
@@ -1674,6 +1783,12 @@ int main(int argc, char *argv[])
         pjsip_endpt_register_module(app.sip_endpt, &msg_logger);
     }
 
+    if (app.encode_bench) {
+        pj_status_t status = encode_bench();
+        destroy_app();
+        return status==PJ_SUCCESS ? 0 : 1;
+    }
+
 
     /* Misc infos */
     if (app.client.dst_uri.slen != 0) {
@@ -506,24 +506,29 @@ static pj_status_t proxy_process_routing(pjsip_tx_data *tdata)
 }
 
 
+/* Create Record-Route header pointing to this proxy */
+static pjsip_hdr *proxy_create_record_route(pj_pool_t *pool)
+{
+    char uribuf[128];
+    pj_str_t uri;
+    const pj_str_t H_RR = { "Record-Route", 12 };
+
+    pj_ansi_snprintf(uribuf, sizeof(uribuf), "<sip:%.*s:%d;lr>",
+                     (int)global.name[0].host.slen,
+                     global.name[0].host.ptr,
+                     global.name[0].port);
+    uri = pj_str(uribuf);
+    return (pjsip_hdr*) pjsip_generic_string_hdr_create(pool, &H_RR, &uri);
+}
+
+
 /* Postprocess the request before forwarding it */
 static void proxy_postprocess(pjsip_tx_data *tdata)
 {
     /* Optionally record-route */
     if (global.record_route) {
-        char uribuf[128];
-        pj_str_t uri;
-        const pj_str_t H_RR = { "Record-Route", 12 };
-        pjsip_generic_string_hdr *rr;
-
-        pj_ansi_snprintf(uribuf, sizeof(uribuf), "<sip:%.*s:%d;lr>",
-                         (int)global.name[0].host.slen,
-                         global.name[0].host.ptr,
-                         global.name[0].port);
-        uri = pj_str(uribuf);
-        rr = pjsip_generic_string_hdr_create(tdata->pool,
-                                             &H_RR, &uri);
-        pjsip_msg_insert_first_hdr(tdata->msg, (pjsip_hdr*)rr);
+        pjsip_msg_insert_first_hdr(tdata->msg,
+                                   proxy_create_record_route(tdata->pool));
     }
 }
 
@@ -59,45 +59,35 @@ static pj_status_t init_stateless_proxy(void)
 }
 
 
-/* Callback to be called to handle incoming requests. */
-static pj_bool_t on_rx_request( pjsip_rx_data *rdata )
+/* Forward strict routed request by cloning it, since the Route set
+ * needs to be rewritten (see proxy_process_routing()).
+ */
+static void forward_by_clone( pjsip_rx_data *rdata )
 {
     pjsip_tx_data *tdata;
     pj_status_t status;
 
-
-    /* Verify incoming request */
-    status = proxy_verify_request(rdata);
-    if (status != PJ_SUCCESS) {
-        app_perror("RX invalid request", status);
-        return PJ_TRUE;
-    }
-
-    /*
-     * Request looks sane, next clone the request to create transmit data.
-     */
     status = pjsip_endpt_create_request_fwd(global.endpt, rdata, NULL,
                                             NULL, 0, &tdata);
     if (status != PJ_SUCCESS) {
         pjsip_endpt_respond_stateless(global.endpt, rdata,
                                       PJSIP_SC_INTERNAL_SERVER_ERROR, NULL, 
                                       NULL, NULL);
-        return PJ_TRUE;
+        return;
     }
 
-
     /* Process routing */
     status = proxy_process_routing(tdata);
     if (status != PJ_SUCCESS) {
         app_perror("Error processing route", status);
-        return PJ_TRUE;
+        return;
     }
 
     /* Calculate target */
     status = proxy_calculate_target(rdata, tdata);
     if (status != PJ_SUCCESS) {
         app_perror("Error calculating target", status);
-        return PJ_TRUE;
+        return;
     }
 
     /* Target is set, forward the request */
@@ -105,64 +95,166 @@ static pj_bool_t on_rx_request( pjsip_rx_data *rdata )
                                                 NULL, NULL);
     if (status != PJ_SUCCESS) {
         app_perror("Error forwarding request", status);
-        return PJ_TRUE;
+        return;
     }
+}
 
-    return PJ_TRUE;
+
+/* Check if the last Route header is a strict route */
+static pj_bool_t is_strict_routed( pjsip_msg *msg )
+{
+    pjsip_route_hdr *r, *hroute = NULL;
+    pjsip_sip_uri *uri;
+
+    r = (pjsip_route_hdr*) pjsip_msg_find_hdr(msg, PJSIP_H_ROUTE, NULL);
+    while (r) {
+        hroute = r;
+        r = (pjsip_route_hdr*) pjsip_msg_find_hdr(msg, PJSIP_H_ROUTE, r->next);
+    }
+
+    if (hroute == NULL)
+        return PJ_FALSE;
+
+    uri = (pjsip_sip_uri*) pjsip_uri_get_uri(&hroute->name_addr);
+    return uri->lr_param == 0;
 }
 
 
-/* Callback to be called to handle incoming response. */
-static pj_bool_t on_rx_response( pjsip_rx_data *rdata )
+/* Callback to be called to handle incoming requests.
+ *
+ * The request is not cloned: the changes are recorded as edits to the
+ * received packet, which is copied with the edits applied when it is
+ * sent. This follows the same steps as proxy_process_routing() and
+ * proxy_calculate_target().
+ */
+static pj_bool_t on_rx_request( pjsip_rx_data *rdata )
 {
-    pjsip_tx_data *tdata;
-    pjsip_response_addr res_addr;
-    pjsip_via_hdr *hvia;
+    const pj_str_t H_ROUTE = { "Route", 5 };
+    pjsip_msg *msg = rdata->msg_info.msg;
+    pjsip_fwd_data fwd;
+    pjsip_sip_uri *target;
+    pjsip_route_hdr *hroute;
+    pjsip_uri *next_hop;
     pj_status_t status;
 
-    /* Create response to be forwarded upstream (Via will be stripped here) */
-    status = pjsip_endpt_create_response_fwd(global.endpt, rdata, 0, &tdata);
+
+    /* Verify incoming request */
+    status = proxy_verify_request(rdata);
     if (status != PJ_SUCCESS) {
-        app_perror("Error creating response", status);
+        app_perror("RX invalid request", status);
+        return PJ_TRUE;
+    }
+
+    target = (pjsip_sip_uri*) msg->line.req.uri;
+
+    if (is_uri_local(target) && is_strict_routed(msg)) {
+        forward_by_clone(rdata);
         return PJ_TRUE;
     }
 
-    /* Get topmost Via header */
-    hvia = (pjsip_via_hdr*) pjsip_msg_find_hdr(tdata->msg, PJSIP_H_VIA, NULL);
-    if (hvia == NULL) {
-        /* Invalid response! Just drop it */
-        pjsip_tx_data_dec_ref(tdata);
+    pjsip_fwd_data_init(&fwd, rdata);
+
+    /* Strip maddr that indicates this proxy */
+    if (target->maddr_param.slen != 0) {
+        pjsip_sip_uri maddr_uri;
+
+        maddr_uri.host = target->maddr_param;
+        maddr_uri.port = global.port;
+
+        if (is_uri_local(&maddr_uri)) {
+            target = (pjsip_sip_uri*)
+                     pjsip_uri_clone(rdata->tp_info.pool, target);
+            target->maddr_param.slen = 0;
+            target->port = 0;
+            target->transport_param.slen = 0;
+
+            status = pjsip_fwd_data_set_uri(&fwd, (pjsip_uri*)target);
+            if (status != PJ_SUCCESS)
+                goto on_error;
+        }
+    }
+
+    /* Remove the first Route if it indicates this proxy */
+    hroute = (pjsip_route_hdr*) pjsip_msg_find_hdr(msg, PJSIP_H_ROUTE, NULL);
+    if (hroute && is_uri_local((pjsip_sip_uri*)hroute->name_addr.uri)) {
+        status = pjsip_fwd_data_remove_hdr(&fwd, &H_ROUTE, NULL);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+
+        hroute = (pjsip_route_hdr*)
+                 pjsip_msg_find_hdr(msg, PJSIP_H_ROUTE, hroute->next);
+    }
+
+    /* We're not interested to receive request destined to us, so
+     * respond with 404/Not Found (only if request is not ACK!).
+     */
+    if (target->maddr_param.slen == 0 && is_uri_local(target)) {
+        if (msg->line.req.method.id != PJSIP_ACK_METHOD) {
+            pjsip_endpt_respond_stateless(global.endpt, rdata,
+                                          PJSIP_SC_NOT_FOUND, NULL,
+                                          NULL, NULL);
+        }
         return PJ_TRUE;
     }
 
-    /* Calculate the address to forward the response */
-    pj_bzero(&res_addr, sizeof(res_addr));
-    res_addr.dst_host.type = PJSIP_TRANSPORT_UDP;
-    res_addr.dst_host.flag = pjsip_transport_get_flag_from_type(PJSIP_TRANSPORT_UDP);
+    /* Optionally record-route */
+    if (global.record_route) {
+        status = pjsip_fwd_data_insert_hdr(&fwd, 
+                        proxy_create_record_route(rdata->tp_info.pool));
+        if (status != PJ_SUCCESS)
+            goto on_error;
+    }
+
+    status = pjsip_fwd_data_dec_max_fwd(&fwd);
+    if (status != PJ_SUCCESS)
+        goto on_error;
 
-    /* Destination address is Via's received param */
-    res_addr.dst_host.addr.host = hvia->recvd_param;
-    if (res_addr.dst_host.addr.host.slen == 0) {
-        /* Someone has messed up our Via header! */
-        res_addr.dst_host.addr.host = hvia->sent_by.host;
+    /* Our Via is written with the transport that is selected once the
+     * next hop is resolved.
+     */
+    status = pjsip_fwd_data_add_via(&fwd, NULL, NULL, NULL);
+    if (status != PJ_SUCCESS)
+        goto on_error;
+
+    /* Forward the request to the next Route, or to the target */
+    next_hop = hroute ? (pjsip_uri*)&hroute->name_addr : (pjsip_uri*)target;
+    status = pjsip_endpt_send_fwd(global.endpt, &fwd, next_hop, NULL,
+                                  NULL, NULL);
+    if (status != PJ_SUCCESS) {
+        app_perror("Error forwarding request", status);
+        return PJ_TRUE;
     }
 
-    /* Destination port is the rpot */
-    if (hvia->rport_param != 0 && hvia->rport_param != -1)
-        res_addr.dst_host.addr.port = hvia->rport_param;
+    return PJ_TRUE;
+
+on_error:
+    app_perror("Error creating request", status);
+    pjsip_endpt_respond_stateless(global.endpt, rdata,
+                                  PJSIP_SC_INTERNAL_SERVER_ERROR, NULL, 
+                                  NULL, NULL);
+    return PJ_TRUE;
+}
+
 
-    if (res_addr.dst_host.addr.port == 0) {
-        /* Ugh, original sender didn't put rport!
-         * At best, can only send the response to the port in Via.
-         */
-        res_addr.dst_host.addr.port = hvia->sent_by.port;
+/* Callback to be called to handle incoming response. */
+static pj_bool_t on_rx_response( pjsip_rx_data *rdata )
+{
+    pjsip_fwd_data fwd;
+    pj_status_t status;
+
+    /* Strip our Via from the response to be forwarded upstream. */
+    pjsip_fwd_data_init(&fwd, rdata);
+    status = pjsip_fwd_data_remove_via(&fwd);
+    if (status != PJ_SUCCESS) {
+        app_perror("Error creating response", status);
+        return PJ_TRUE;
     }
 
-    /* Forward response */
-    status = pjsip_endpt_send_response(global.endpt, &res_addr, tdata, 
-                                       NULL, NULL);
+    /* Forward response to the address in the next Via */
+    status = pjsip_endpt_send_fwd(global.endpt, &fwd, NULL, NULL,
+                                  NULL, NULL);
     if (status != PJ_SUCCESS) {
-        pjsip_tx_data_dec_ref(tdata);
+        /* Invalid response without another Via, just drop it */
         app_perror("Error forwarding response", status);
         return PJ_TRUE;
     }
@@ -188,6 +188,18 @@ typedef struct pjsip_cfg_t
          */
         pj_bool_t keep_inv_after_tsx_timeout;
 
+        /**
+         * Parse only the headers needed for transaction matching and routing
+         * (Via, From, To, Call-ID, CSeq, Route, Record-Route, Max-Forwards,
+         * Content-Length, Content-Type, Require and Supported) when an
+         * incoming message is parsed. Other headers are kept as raw string
+         * values and are parsed the first time they are looked up with
+         * #pjsip_msg_find_hdr() and friends. See #pjsip_parse_lazy_hdr().
+         *
+         * Default is PJSIP_LAZY_HDR_PARSING.
+         */
+        pj_bool_t lazy_hdr_parsing;
+
     } endpt;
 
     /** Transaction layer settings. */
@@ -310,23 +322,59 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
  * For efficiency, the value should be 2^n-1 since it will be
  * rounded up to 2^n.
  *
+ * The value is used to size the buckets of the transaction table, which
+ * is split evenly among the #PJSIP_TSX_TABLE_SHARD_CNT shards. A shard
+ * doubles its buckets when it holds more than twice as many transactions
+ * as buckets, so this is not a hard limit on the number of transactions.
+ *
  * Default value is 1023
  */
 #ifndef PJSIP_MAX_TSX_COUNT
 #   define PJSIP_MAX_TSX_COUNT          (1024-1)
 #endif
 
+/**
+ * Number of shards in the transaction table. Each shard has its own
+ * lock and hash tables, and a transaction is placed in a shard according
+ * to the hash of its key, so threads looking up transactions in
+ * different shards do not contend with each other. The value must be a
+ * power of two, no more than 256. Set to 1 to get a single table under
+ * a single lock.
+ *
+ * Default: 16
+ */
+#ifndef PJSIP_TSX_TABLE_SHARD_CNT
+#   define PJSIP_TSX_TABLE_SHARD_CNT    16
+#endif
+
 /**
  * Specify maximum number of dialogs in the dialog hash table.
  * For efficiency, the value should be 2^n-1 since it will be
  * rounded up to 2^n.
  *
+ * The value is used to size the buckets of the dialog table, which is
+ * split evenly among the #PJSIP_DLG_TABLE_SHARD_CNT shards.
+ *
  * Default value is 511.
  */
 #ifndef PJSIP_MAX_DIALOG_COUNT
 #   define PJSIP_MAX_DIALOG_COUNT       (512-1)
 #endif
 
+/**
+ * Number of shards in the dialog table of the user agent layer. Each
+ * shard has its own lock and hash table, and a dialog set is placed in
+ * a shard according to the hash of its Call-ID, so threads handling
+ * messages of different calls do not contend with each other. The value
+ * must be a power of two, no more than 256. Set to 1 to get a single
+ * table under a single lock.
+ *
+ * Default: 16
+ */
+#ifndef PJSIP_DLG_TABLE_SHARD_CNT
+#   define PJSIP_DLG_TABLE_SHARD_CNT    16
+#endif
+
 
 /**
  * Specify maximum number of transports.
@@ -355,6 +403,17 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Maximum number of byte range edits (splices) that can be recorded in
+ * a #pjsip_fwd_data, when forwarding a message without cloning it.
+ *
+ * Default: 16
+ */
+#ifndef PJSIP_MAX_FWD_SPLICE
+#   define PJSIP_MAX_FWD_SPLICE         16
+#endif
+
+
 /**
  * Specify maximum number of modules.
  * This mainly affects the size of mod_data array in various components.
@@ -454,6 +513,21 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Defer parsing of headers that are not needed for transaction matching
+ * and routing until they are accessed with #pjsip_msg_find_hdr(). This
+ * reduces the parsing cost on proxies that forward most headers untouched.
+ *
+ * This option can also be controlled at run-time by the
+ * \a lazy_hdr_parsing setting in pjsip_cfg_t.
+ *
+ * Default is PJ_FALSE.
+ */
+#ifndef PJSIP_LAZY_HDR_PARSING
+#   define PJSIP_LAZY_HDR_PARSING                   PJ_FALSE
+#endif
+
+
 /**
  * Specify whether "alias" param should be added to the Via header
  * in any outgoing request with connection oriented transport.
@@ -507,6 +581,29 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Maximum number of packets to be read by a pending read operation of the
+ * UDP transport in one socket readiness notification. When this is greater
+ * than one, after a packet is read by the ioqueue, the packets already
+ * queued in the socket are read with #pj_sock_recvmmsg(), which uses a
+ * single recvmmsg() system call on Linux (see #PJ_SOCK_HAS_MMSG), and
+ * processed one by one. This needs PJSIP_UDP_RX_BATCH * PJSIP_MAX_PKT_LEN
+ * bytes of buffer for each pending read operation. The value must not be
+ * greater than #PJ_SOCK_MAX_MMSG. This is disabled with the io_uring
+ * ioqueue, see #PJ_IOQUEUE_URING_HAS_RX.
+ *
+ * Default: 1 (disabled, one packet per read)
+ */
+#ifndef PJSIP_UDP_RX_BATCH
+#   define PJSIP_UDP_RX_BATCH           1
+#endif
+
+#if PJ_IOQUEUE_URING_HAS_RX
+#   undef PJSIP_UDP_RX_BATCH
+#   define PJSIP_UDP_RX_BATCH           1
+#endif
+
+
 /**
  * Encode SIP headers in their short forms to reduce size. By default,
  * SIP headers in outgoing messages will be encoded in their full names. 
@@ -945,6 +1042,31 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
                                          2*PJSIP_MAX_DIALOG_COUNT)
 #endif
 
+/**
+ * Specify the number of shards of the endpoint timer heap. With more than
+ * one shard, timers are spread over several timer heaps with their own
+ * locks, so worker threads calling #pjsip_endpt_handle_events() don't
+ * contend on a single timer heap lock. See #pj_timer_heap_cfg for more
+ * info.
+ *
+ * Default: 1
+ */
+#ifndef PJSIP_TIMER_HEAP_SHARD_COUNT
+#   define PJSIP_TIMER_HEAP_SHARD_COUNT 1
+#endif
+
+/**
+ * Specify the number of messages each receive queue of the endpoint can
+ * hold, see #pjsip_endpt_create_rx_queues(). When a queue is full, the
+ * message is processed by the thread that received it. The value must be
+ * a power of two.
+ *
+ * Default: 1024
+ */
+#ifndef PJSIP_RX_QUEUE_SIZE
+#   define PJSIP_RX_QUEUE_SIZE          1024
+#endif
+
 /**
  * Initial memory block for the endpoint.
  */
@@ -1004,6 +1126,24 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #   define PJSIP_POOL_INC_TDATA         4000
 #endif
 
+/**
+ * Number of released tdata pools and cloned rdata pools that each thread
+ * keeps for reuse, for each of the two kinds. Reusing a pool from the
+ * calling thread's own list avoids taking the pool factory lock when
+ * creating tdata with #pjsip_tx_data_create() and cloning rdata with
+ * #pjsip_rx_data_clone(). Use #pjsip_tpmgr_get_pool_stat() to see the
+ * hit rate. Set to zero to disable the pool reuse.
+ *
+ * The pools kept by a thread that has exited are only released when the
+ * transport manager is destroyed, so applications that keep creating
+ * short-lived threads to send SIP messages may want to disable this.
+ *
+ * Default: 16
+ */
+#ifndef PJSIP_TPMGR_POOL_CACHE_SIZE
+#   define PJSIP_TPMGR_POOL_CACHE_SIZE  16
+#endif
+
 /**
  * Initial memory size for UA layer
  */
@@ -688,6 +688,12 @@ PJ_DECL(pj_status_t) pjsip_dlg_create_request(  pjsip_dialog *dlg,
  * local cseq number and update the cseq in the request according to dialog's 
  * cseq.
  *
+ * When the request has been sent before, only the headers updated here
+ * (CSeq, the topmost Via, Route and Contact) are printed again. If the
+ * application has modified other headers of the request in place, it
+ * must invalidate them with #pjsip_tx_data_invalidate_hdr() or
+ * #pjsip_tx_data_invalidate_msg().
+ *
  * If p_tsx is not null, this argument will be set with the transaction 
  * instance that was used to send the request.
  *
@@ -138,6 +138,26 @@ PJ_DECL(pj_status_t) pjsip_endpt_handle_events2(pjsip_endpoint *endpt,
                                                 const pj_time_val *max_timeout,
                                                 unsigned *count);
 
+/**
+ * Create receive queues, each with its own worker thread, to process the
+ * incoming messages. Instead of being processed by the thread that polls
+ * the transport, a message is put in the queue selected by the hash of
+ * its Call-ID, so the messages of a dialog are always processed by the
+ * same thread, in the order they were received. This reduces contention
+ * on the dialog and transaction locks when there are several threads
+ * calling #pjsip_endpt_handle_events().
+ *
+ * The queues are destroyed with the endpoint. This function may only be
+ * called once.
+ *
+ * @param endpt         The endpoint.
+ * @param count         Number of queues and worker threads.
+ *
+ * @return              PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_endpt_create_rx_queues(pjsip_endpoint *endpt,
+                                                  unsigned count);
+
 /**
  * Schedule timer to endpoint's timer heap. Application must poll the endpoint
  * periodically (by calling #pjsip_endpt_handle_events) to ensure that the
@@ -1010,6 +1010,58 @@ PJ_DECL(pj_ssize_t) pjsip_msg_print(const pjsip_msg *msg,
                                     char *buf, pj_size_t size);
 
 
+/**
+ * Position of a header in the buffer where the message was printed by
+ * #pjsip_msg_print2().
+ */
+typedef struct pjsip_hdr_print_pos
+{
+    const pjsip_hdr *hdr;       /**< The header.                        */
+    unsigned         offset;    /**< Offset of the header in the buffer. */
+    unsigned         len;       /**< Length, including the CRLF. Zero
+                                     if the header must be printed
+                                     again.                             */
+} pjsip_hdr_print_pos;
+
+/**
+ * The printed headers of the previous #pjsip_msg_print2() call, so that
+ * headers that have not been modified since are copied instead of
+ * printed again.
+ */
+typedef struct pjsip_msg_print_cache
+{
+    const char          *buf;   /**< Buffer of the previous print, or
+                                     NULL if there is none.             */
+    unsigned             max;   /**< Number of elements in pos.         */
+    unsigned             cnt;   /**< Number of headers recorded.        */
+    pjsip_hdr_print_pos *pos;   /**< Headers in the order printed.      */
+} pjsip_msg_print_cache;
+
+/**
+ * Print the message to the specified buffer, reusing the headers that
+ * were printed to another buffer previously. Headers are matched by
+ * their pointer, so the caller must set the len of the position of the
+ * headers that have been modified to zero (see
+ * #pjsip_tx_data_invalidate_hdr()). Headers that are new in the message
+ * are always printed. The start line and the body are always printed.
+ *
+ * After the call, the cache describes the headers in buf, up to the
+ * first max headers of the message.
+ *
+ * @param msg   The message to print.
+ * @param buf   The buffer, which must not be the buffer of the cache.
+ * @param size  The size of the buffer.
+ * @param cache The print cache, or NULL to print the whole message
+ *              like #pjsip_msg_print().
+ *
+ * @return      The length of the printed characters (in bytes), or NEGATIVE
+ *              value if the message is too large for the specified buffer.
+ */
+PJ_DECL(pj_ssize_t) pjsip_msg_print2(const pjsip_msg *msg,
+                                     char *buf, pj_size_t size,
+                                     pjsip_msg_print_cache *cache);
+
+
 /*
  * Some usefull macros to find common headers.
  */
@@ -275,6 +275,55 @@ PJ_DECL(pjsip_msg *) pjsip_parse_msg( pj_pool_t *pool,
 PJ_DECL(pjsip_msg *) pjsip_parse_rdata( char *buf, pj_size_t size,
                                         pjsip_rx_data *rdata );
 
+/**
+ * Parse a packet buffer and build a full SIP message from the packet, just
+ * like #pjsip_parse_msg(). This function however doesn't use exception
+ * internally: syntax errors are propagated through the parser as return
+ * values, so there's no setjmp() and exception handler setup cost for
+ * every message. The resulting message and the error reports are identical
+ * to #pjsip_parse_msg().
+ *
+ * Header parsers registered by application with
+ * #pjsip_register_hdr_parser() and URI parsers registered with
+ * #pjsip_register_uri_parser() may still throw exception, hence they are
+ * called inside a try block.
+ *
+ * Note that the input string buffer MUST be NULL terminated and have
+ * length at least size+1 (size MUST NOT include the NULL terminator).
+ *
+ * @param pool          The pool to allocate memory.
+ * @param buf           The input buffer, which MUST be NULL terminated.
+ * @param size          The length of the string (not counting NULL terminator).
+ * @param err_list      If this parameter is not NULL, then the parser will
+ *                      put error messages during parsing in this list.
+ * @param p_msg         Pointer to receive the message, or NULL when failed.
+ *
+ * @return              PJ_SUCCESS if a message is returned, or
+ *                      PJSIP_EINVALIDMSG. Note that like #pjsip_parse_msg(),
+ *                      the message may be returned even though some headers
+ *                      failed to parse, check \a err_list for this.
+ */
+PJ_DECL(pj_status_t) pjsip_parse_msg2( pj_pool_t *pool,
+                                       char *buf, pj_size_t size,
+                                       pjsip_parser_err_report *err_list,
+                                       pjsip_msg **p_msg);
+
+/**
+ * Parse a packet buffer and build a rdata, just like #pjsip_parse_rdata(),
+ * but without using exception internally. See #pjsip_parse_msg2() for
+ * the details.
+ *
+ * @param buf           The input buffer, which MUST be NULL terminated.
+ * @param size          The length of the string (not counting NULL terminator).
+ * @param rdata         The receive data buffer to store the message and
+ *                      its elements.
+ *
+ * @return              PJ_SUCCESS if a message is stored in the \c msg field
+ *                      of the rdata, or PJSIP_EINVALIDMSG.
+ */
+PJ_DECL(pj_status_t) pjsip_parse_rdata2( char *buf, pj_size_t size,
+                                         pjsip_rx_data *rdata );
+
 /**
  * Check incoming packet to see if a (probably) valid SIP message has been 
  * received.
@@ -349,6 +398,37 @@ PJ_DECL(pj_status_t) pjsip_parse_headers( pj_pool_t *pool, char *input,
                                           pj_size_t size, pjsip_hdr *hlist,
                                           unsigned options);
 
+/**
+ * Check whether the header is a lazy header, i.e. a header whose parsing
+ * has been deferred because \a lazy_hdr_parsing is enabled in pjsip_cfg().
+ * A lazy header has PJSIP_H_OTHER type and can be printed and cloned like
+ * a generic string header, but it must be parsed with
+ * #pjsip_parse_lazy_hdr() before it can be accessed as its real type.
+ *
+ * @param hdr           The header.
+ *
+ * @return              PJ_TRUE if the header is a lazy header.
+ */
+PJ_DECL(pj_bool_t) pjsip_hdr_is_lazy(const pjsip_hdr *hdr);
+
+/**
+ * Parse a lazy header and replace it in its header list with the parsed
+ * header(s). A header line containing a comma separated list (e.g.
+ * multiple Contacts) may produce more than one header, in which case the
+ * first one is returned and the rest follow it in the list. If the value
+ * cannot be parsed, the header is replaced with a generic string header.
+ *
+ * #pjsip_msg_find_hdr() and friends call this function automatically,
+ * hence application only needs to call this when it walks the header list
+ * directly.
+ *
+ * @param hdr           The header. If it is not a lazy header, it is
+ *                      returned unchanged.
+ *
+ * @return              The (first) parsed header.
+ */
+PJ_DECL(pjsip_hdr*) pjsip_parse_lazy_hdr(pjsip_hdr *hdr);
+
 
 /**
  * @}
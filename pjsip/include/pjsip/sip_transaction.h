@@ -27,6 +27,7 @@
 #include <pjsip/sip_msg.h>
 #include <pjsip/sip_util.h>
 #include <pjsip/sip_transport.h>
+#include <pj/hash.h>
 #include <pj/timer.h>
 
 PJ_BEGIN_DECL
@@ -103,6 +104,8 @@ struct pjsip_transaction
                                                      tsx lookup.            */
     pj_uint32_t                 hashed_key;     /**< Key's hashed value.    */
     pj_uint32_t                 hashed_key2;    /**< Key's hashed value (2).*/
+    pj_hash_entry_buf           hentry;         /**< Hash table entry.      */
+    pj_hash_entry_buf           hentry2;        /**< Hash table entry (2).  */
     pj_str_t                    branch;         /**< The branch Id.         */
 
     /*
@@ -599,6 +599,16 @@ struct pjsip_tx_data
      */
     pjsip_buffer         buf;
 
+    /** Position of the headers printed in buf, so that only the headers
+     *  invalidated by #pjsip_tx_data_invalidate_hdr() are printed again.
+     */
+    pjsip_msg_print_cache print_cache;
+
+    /** Second print buffer, where the message is printed using the
+     *  headers in buf before the two buffers are swapped.
+     */
+    char                *spare_buf;
+
     /** Reference counter. */
     pj_atomic_t         *ref_cnt;
 
@@ -742,6 +752,26 @@ PJ_DECL(pj_bool_t) pjsip_tx_data_is_valid( pjsip_tx_data *tdata );
  */
 PJ_DECL(void) pjsip_tx_data_invalidate_msg( pjsip_tx_data *tdata );
 
+/**
+ * Invalidate the print buffer after a header of the message has been
+ * modified. Unlike #pjsip_tx_data_invalidate_msg(), the next encoding
+ * prints only this header, the start line and the body again, and copies
+ * the rest of the headers from the previous encoding. Headers added to
+ * the message since then are printed too, so this needs to be called for
+ * modified headers only.
+ *
+ * Every header modified in place after the message was printed must be
+ * invalidated this way, otherwise its previous text is sent. When the
+ * message may have been modified elsewhere, e.g: when resending a request
+ * that application has edited, use #pjsip_tx_data_invalidate_msg()
+ * instead.
+ *
+ * @param tdata     The transmit buffer.
+ * @param hdr       The header that has been modified.
+ */
+PJ_DECL(void) pjsip_tx_data_invalidate_hdr( pjsip_tx_data *tdata,
+                                            const void *hdr );
+
 /**
  * Get short printable info about the transmit data. This will normally return
  * short information about the message.
@@ -1302,6 +1332,40 @@ PJ_DECL(pj_status_t) pjsip_tpmgr_find_local_addr2(pjsip_tpmgr *tpmgr,
 PJ_DECL(unsigned) pjsip_tpmgr_get_transport_count(pjsip_tpmgr *mgr);
 
 
+/**
+ * Statistics of the per-thread reuse of tdata and cloned rdata pools.
+ * See #PJSIP_TPMGR_POOL_CACHE_SIZE.
+ */
+typedef struct pjsip_tpmgr_pool_stat
+{
+    /** Number of tdata pools taken from the reuse list. */
+    pj_uint64_t     tdata_hit;
+
+    /** Number of tdata pools that had to be created. */
+    pj_uint64_t     tdata_miss;
+
+    /** Number of cloned rdata pools taken from the reuse list. */
+    pj_uint64_t     rdata_hit;
+
+    /** Number of cloned rdata pools that had to be created. */
+    pj_uint64_t     rdata_miss;
+
+} pjsip_tpmgr_pool_stat;
+
+
+/**
+ * Get the statistics of the per-thread reuse of tdata and cloned rdata
+ * pools, summed over all threads.
+ *
+ * @param mgr       The transport manager.
+ * @param stat      Structure to receive the statistics.
+ *
+ * @return          PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_tpmgr_get_pool_stat(pjsip_tpmgr *mgr,
+                                               pjsip_tpmgr_pool_stat *stat);
+
+
 /**
  * Destroy a transport manager. Normally application doesn't need to call
  * this function directly, since a transport manager will be created and
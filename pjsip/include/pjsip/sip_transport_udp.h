@@ -120,6 +120,26 @@ typedef struct pjsip_udp_transport_cfg
      */
     pj_sockopt_params   sockopt_params;
 
+    /**
+     * Number of sockets to open on the bound address. When this is more
+     * than one, all sockets are opened with SO_REUSEPORT so that the
+     * kernel spreads the incoming packets among them. The first socket is
+     * polled by the endpoint's ioqueue as usual, while each additional
+     * socket is polled by its own ioqueue and thread. Outgoing messages
+     * are sent from the socket where the last packet from the destination
+     * was received. The maximum value is 64.
+     *
+     * This requires SO_REUSEPORT support from the platform. Pausing or
+     * restarting the transport with #pjsip_udp_transport_pause() and
+     * #pjsip_udp_transport_restart2() applies to all the sockets. When
+     * the socket is replaced by an application supplied socket, that
+     * socket must have SO_REUSEPORT enabled so that the additional
+     * sockets can be bound to the same address.
+     *
+     * Default: 1
+     */
+    unsigned            reuseport_cnt;
+
 } pjsip_udp_transport_cfg;
 
 
@@ -878,6 +878,226 @@ PJ_DECL(pj_status_t) pjsip_endpt_create_response_fwd( pjsip_endpoint *endpt,
 PJ_DECL(pj_str_t) pjsip_calculate_branch_id( pjsip_rx_data *rdata );
 
 
+/**
+ * A byte range edit to the packet of a message being forwarded. The
+ * range [start, end) of the received packet is replaced by text when
+ * the message is printed. An empty range inserts the text, and an
+ * empty text removes the range.
+ */
+typedef struct pjsip_fwd_splice
+{
+    const char      *start;     /**< Start of range in the packet.      */
+    const char      *end;       /**< End of range in the packet.        */
+    pj_str_t         text;      /**< Replacement text.                  */
+} pjsip_fwd_splice;
+
+
+/**
+ * This structure describes a message to be forwarded as edits to the
+ * packet it was received in, so that a stateless proxy does not need to
+ * clone the message with #pjsip_endpt_create_request_fwd() or
+ * #pjsip_endpt_create_response_fwd() and print it again. Only the edited
+ * ranges are printed, the rest of the packet is copied as is when the
+ * message is sent with #pjsip_endpt_send_fwd().
+ *
+ * The edits refer to the packet and the pool of the rdata, so the
+ * structure is only valid during the rdata callback.
+ */
+typedef struct pjsip_fwd_data
+{
+    /** The message being forwarded. */
+    pjsip_rx_data       *rdata;
+
+    /** Number of splices. */
+    unsigned             splice_cnt;
+
+    /** The splices, sorted by their position in the packet. */
+    pjsip_fwd_splice     splice[PJSIP_MAX_FWD_SPLICE];
+
+    /** Position of the Via that #pjsip_endpt_send_fwd() will write once
+     *  the transport is selected, or NULL. */
+    const char          *via_pos;
+
+    /** Branch parameter of that Via. */
+    pj_str_t             via_branch;
+
+} pjsip_fwd_data;
+
+
+/**
+ * Initialize the forwarding data for the message in rdata, without any
+ * edit. The Request-URI, the Max-Forwards and the Via headers are not
+ * updated until the application calls the functions below.
+ *
+ * Note: like #pjsip_endpt_create_request_fwd(), this DOES NOT perform
+ *        Route information preprocessing.
+ *
+ * @param fwd       The forwarding data.
+ * @param rdata     The incoming request or response message.
+ */
+PJ_DECL(void) pjsip_fwd_data_init(pjsip_fwd_data *fwd, pjsip_rx_data *rdata);
+
+/**
+ * Add a byte range edit. The range must be inside the packet of the
+ * rdata and must not overlap with other ranges.
+ *
+ * @param fwd       The forwarding data.
+ * @param start     Start of the range in rdata->msg_info.msg_buf.
+ * @param end       End of the range, or equal to start to insert text.
+ * @param text      The replacement text, which must remain valid until
+ *                  the message is sent, or NULL to remove the range.
+ *
+ * @return          PJ_SUCCESS, PJ_EINVAL if the range overlaps with
+ *                  another one, or PJ_ETOOMANY if PJSIP_MAX_FWD_SPLICE
+ *                  has been reached.
+ */
+PJ_DECL(pj_status_t) pjsip_fwd_data_splice(pjsip_fwd_data *fwd,
+                                           const char *start,
+                                           const char *end,
+                                           const pj_str_t *text);
+
+/**
+ * Replace the Request-URI of the request.
+ *
+ * @param fwd       The forwarding data.
+ * @param uri       The new Request-URI.
+ *
+ * @return          PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_fwd_data_set_uri(pjsip_fwd_data *fwd,
+                                            const pjsip_uri *uri);
+
+/**
+ * Decrement the Max-Forwards of the request, or add the header with
+ * value 70 if the request does not have one (RFC 3261 Section 16.6).
+ *
+ * @param fwd       The forwarding data.
+ *
+ * @return          PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_fwd_data_dec_max_fwd(pjsip_fwd_data *fwd);
+
+/**
+ * Add a Via header on top of the request. The received and rport
+ * parameters that the transport layer has set in the top-most Via of
+ * the incoming request are written to the packet as well, since they
+ * are needed to route the response back.
+ *
+ * When transport and sent_by are NULL, the Via is written by
+ * #pjsip_endpt_send_fwd() with the transport it selects after resolving
+ * the next hop, and #pjsip_fwd_data_print() leaves it out.
+ *
+ * @param fwd       The forwarding data.
+ * @param transport Transport name of the Via, normally the type name of
+ *                  the transport the request will be sent with, or NULL.
+ * @param sent_by   The sent-by address of the Via, or NULL.
+ * @param branch    Optional branch parameter. If it is NULL, the branch
+ *                  is generated by #pjsip_calculate_branch_id().
+ *
+ * @return          PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_fwd_data_add_via(pjsip_fwd_data *fwd,
+                                            const pj_str_t *transport,
+                                            const pjsip_host_port *sent_by,
+                                            const pj_str_t *branch);
+
+/**
+ * Remove the top-most Via of the response, i.e. the one added by this
+ * proxy when the request was forwarded.
+ *
+ * @param fwd       The forwarding data.
+ *
+ * @return          PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_fwd_data_remove_via(pjsip_fwd_data *fwd);
+
+/**
+ * Remove the first value of the first header with the specified name,
+ * for example the top-most Route when it indicates this proxy. The
+ * header is removed when it has no other value.
+ *
+ * @param fwd       The forwarding data.
+ * @param name      Header name.
+ * @param sname     Optional compact form of the header name.
+ *
+ * @return          PJ_SUCCESS, or PJ_ENOTFOUND if the message does not
+ *                  have the header.
+ */
+PJ_DECL(pj_status_t) pjsip_fwd_data_remove_hdr(pjsip_fwd_data *fwd,
+                                               const pj_str_t *name,
+                                               const pj_str_t *sname);
+
+/**
+ * Insert a header as the first header of the message, for example a
+ * Record-Route header.
+ *
+ * @param fwd       The forwarding data.
+ * @param hdr       The header to insert.
+ *
+ * @return          PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_fwd_data_insert_hdr(pjsip_fwd_data *fwd,
+                                               const pjsip_hdr *hdr);
+
+/**
+ * Get the length of the message after the edits are applied.
+ *
+ * @param fwd       The forwarding data.
+ *
+ * @return          The length in bytes.
+ */
+PJ_DECL(pj_size_t) pjsip_fwd_data_get_len(const pjsip_fwd_data *fwd);
+
+/**
+ * Print the message with the edits applied to a contiguous buffer.
+ *
+ * @param fwd       The forwarding data.
+ * @param buf       The buffer.
+ * @param size      The size of the buffer.
+ *
+ * @return          The length printed, or -1 if the buffer is too small.
+ */
+PJ_DECL(pj_ssize_t) pjsip_fwd_data_print(const pjsip_fwd_data *fwd,
+                                         char *buf, pj_size_t size);
+
+/**
+ * Send the message in the forwarding data statelessly. The message is
+ * printed with #pjsip_fwd_data_print() directly to the transmit buffer,
+ * so nothing of the received message is cloned or printed again. The
+ * destination is resolved from dst_uri for requests, and from the Via
+ * below the top-most one (which is the one removed with
+ * #pjsip_fwd_data_remove_via()) for responses, using its maddr,
+ * received and rport parameters as described in RFC 3261 Section 18.2.2
+ * and RFC 3581.
+ *
+ * If the Via of the request was added with #pjsip_fwd_data_add_via()
+ * without transport, it is written here with the transport acquired for
+ * the resolved address, and the request is sent with that transport.
+ * Otherwise the Via is sent as it was added, so sel should specify the
+ * transport it names. Note that unlike
+ * #pjsip_endpt_send_request_stateless(), the message is sent to the
+ * first resolved address only.
+ *
+ * @param endpt     The endpoint instance.
+ * @param fwd       The forwarding data.
+ * @param dst_uri   Next hop for requests, e.g. the Request-URI or the
+ *                  top-most Route. Must be NULL for responses.
+ * @param sel       Optional transport selector.
+ * @param token     Arbitrary token to be returned back to callback.
+ * @param cb        Optional callback to be called to notify caller about
+ *                  the completion status of the pending send operation.
+ *
+ * @return          PJ_SUCCESS if the message has been scheduled to be
+ *                  sent, the callback will be called with the result.
+ */
+PJ_DECL(pj_status_t) pjsip_endpt_send_fwd(pjsip_endpoint *endpt,
+                                          const pjsip_fwd_data *fwd,
+                                          const pjsip_uri *dst_uri,
+                                          const pjsip_tpselector *sel,
+                                          void *token,
+                                          pjsip_tp_send_callback cb);
+
+
 /**
  * @}
  */
@@ -2144,6 +2144,17 @@ typedef struct pjsua_config
      */
     unsigned        thread_cnt;
 
+    /**
+     * Number of receive queues to process incoming SIP messages, each with
+     * its own thread. When non-zero, the worker threads only receive the
+     * messages, and the messages of the same Call-ID are always processed
+     * by the same receive queue thread. See #pjsip_endpt_create_rx_queues()
+     * for more info.
+     *
+     * Default: 0 (messages are processed by the worker threads)
+     */
+    unsigned        rx_queue_cnt;
+
     /**
      * Number of nameservers. If no name server is configured, the SIP SRV
      * resolution would be disabled, and domain will be resolved with
@@ -7149,7 +7160,8 @@ struct pjsua_media_config
 
     /**
      * Set the algorithm the jitter buffer uses to discard frames in order to
-     * adjust the latency.
+     * adjust the latency. PJMEDIA_JB_DISCARD_DELAY is experimental and is
+     * not recommended yet.
      *
      * Default: PJMEDIA_JB_DISCARD_PROGRESSIVE
      */
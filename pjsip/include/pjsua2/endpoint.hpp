@@ -653,6 +653,15 @@ struct UaConfig : public PersistentObject
      */
     unsigned            threadCnt;
 
+    /**
+     * Number of receive queues to process incoming SIP messages, each with
+     * its own thread. When non-zero, the messages of the same Call-ID are
+     * always processed by the same receive queue thread.
+     *
+     * Default: 0 (messages are processed by the worker threads)
+     */
+    unsigned            rxQueueCnt;
+
     /**
      * When this flag is non-zero, all callbacks that come from thread
      * other than main thread will be posted to the main thread and
@@ -1085,7 +1094,8 @@ public:
 
     /**
      * Set the algorithm the jitter buffer uses to discard frames in order to
-     * adjust the latency.
+     * adjust the latency. PJMEDIA_JB_DISCARD_DELAY is experimental and is
+     * not recommended yet.
      *
      * Default: PJMEDIA_JB_DISCARD_PROGRESSIVE
      */
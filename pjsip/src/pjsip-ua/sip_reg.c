@@ -936,15 +936,18 @@ static pj_uint32_t calculate_response_expiration(const pjsip_regc *regc,
     const pjsip_msg *msg = rdata->msg_info.msg;
     const pjsip_hdr *hdr;
 
-    /* Enumerate all Contact headers in the response */
+    /* Enumerate all Contact headers in the response. They are searched
+     * with pjsip_msg_find_hdr(), which also parses them when header
+     * parsing is lazy.
+     */
     *contact_cnt = 0;
-    for (hdr=msg->hdr.next; hdr!=&msg->hdr; hdr=hdr->next) {
-        if (hdr->type == PJSIP_H_CONTACT && 
-            *contact_cnt < max_contact) 
-        {
-            contacts[*contact_cnt] = (pjsip_contact_hdr*)hdr;
-            ++(*contact_cnt);
-        }
+    hdr = (const pjsip_hdr*)
+          pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT, NULL);
+    while (hdr && *contact_cnt < max_contact) {
+        contacts[*contact_cnt] = (pjsip_contact_hdr*)hdr;
+        ++(*contact_cnt);
+        hdr = (const pjsip_hdr*)
+              pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT, hdr->next);
     }
 
     if (regc->current_op == REGC_REGISTERING) {
@@ -1189,7 +1192,11 @@ static void regc_tsx_callback(void *token, pjsip_event *event)
             hdr = msg->hdr.next;
             ins_hdr = &msg->hdr;
             while (hdr != &msg->hdr) {
-                pjsip_hdr *next = hdr->next;
+                pjsip_hdr *next;
+
+                /* Headers are matched by type, parse the lazy ones */
+                hdr = pjsip_parse_lazy_hdr(hdr);
+                next = hdr->next;
 
                 if (hdr->type == PJSIP_H_CONTACT) {
                     chdr = (pjsip_contact_hdr *)hdr;
@@ -1422,6 +1422,22 @@ PJ_DEF(pj_status_t) pjsip_auth_clt_reinit_req(  pjsip_auth_clt_sess *sess,
     tdata = old_request;
     tdata->auth_retry = PJ_FALSE;
 
+    /* The challenges are searched by header type below, have them parsed
+     * first in case header parsing is lazy.
+     */
+    hdr = &rdata->msg_info.msg->hdr;
+    while ((hdr = (const pjsip_hdr*)
+                  pjsip_msg_find_hdr(rdata->msg_info.msg,
+                                     PJSIP_H_WWW_AUTHENTICATE,
+                                     hdr->next)) != NULL)
+        ;
+    hdr = &rdata->msg_info.msg->hdr;
+    while ((hdr = (const pjsip_hdr*)
+                  pjsip_msg_find_hdr(rdata->msg_info.msg,
+                                     PJSIP_H_PROXY_AUTHENTICATE,
+                                     hdr->next)) != NULL)
+        ;
+
     /*
      * Respond to each authentication challenge.
      */
@@ -39,7 +39,8 @@ pjsip_cfg_t pjsip_sip_cfg_var =
        0,
        PJSIP_ENCODE_SHORT_HNAME,
        PJSIP_ACCEPT_MULTIPLE_SDP_ANSWERS,
-       0
+       0,
+       PJSIP_LAZY_HDR_PARSING
     },
 
     /* Transaction settings */
@@ -72,6 +73,8 @@ PJ_DEF(void) pjsip_dump_config(void)
     PJ_LOG(3, (id, "Dumping PJSIP configurations:"));
     PJ_LOG(3, (id, " PJSIP_MAX_DIALOG_COUNT                             : %d", 
                PJSIP_MAX_DIALOG_COUNT));
+    PJ_LOG(3, (id, " PJSIP_DLG_TABLE_SHARD_CNT                          : %d", 
+               PJSIP_DLG_TABLE_SHARD_CNT));
     PJ_LOG(3, (id, " PJSIP_MAX_TRANSPORTS                               : %d", 
                PJSIP_MAX_TRANSPORTS));
     PJ_LOG(3, (id, " PJSIP_TPMGR_HTABLE_SIZE                            : %d", 
@@ -238,6 +241,8 @@ PJ_DEF(void) pjsip_dump_config(void)
                pjsip_cfg()->endpt.accept_multiple_sdp_answers));
     PJ_LOG(3, (id, " pjsip_cfg()->endpt.keep_inv_after_tsx_timeout      : %d", 
                pjsip_cfg()->endpt.keep_inv_after_tsx_timeout));
+    PJ_LOG(3, (id, " pjsip_cfg()->endpt.lazy_hdr_parsing                : %d", 
+               pjsip_cfg()->endpt.lazy_hdr_parsing));
     PJ_LOG(3, (id, " pjsip_cfg()->tsx.max_count                         : %d", 
                pjsip_cfg()->tsx.max_count));
     PJ_LOG(3, (id, " pjsip_cfg()->tsx.t1                                : %d", 
@@ -1301,6 +1301,32 @@ static void send_ack_callback( pjsip_send_state *send_state,
     }
 }
 
+/*
+ * Invalidate the headers that the dialog and the transaction update when
+ * a request is sent, so that only these are re-printed when the request
+ * has been sent before.
+ */
+static void invalidate_dlg_hdrs(pjsip_tx_data *tdata)
+{
+    pjsip_hdr *hdr = tdata->msg->hdr.next;
+    pj_bool_t via_found = PJ_FALSE;
+
+    for (; hdr != &tdata->msg->hdr; hdr = hdr->next) {
+        if (hdr->type == PJSIP_H_VIA) {
+            /* Only the topmost Via is ours */
+            if (via_found)
+                continue;
+            via_found = PJ_TRUE;
+        } else if (hdr->type != PJSIP_H_CSEQ &&
+                   hdr->type != PJSIP_H_ROUTE &&
+                   hdr->type != PJSIP_H_CONTACT)
+        {
+            continue;
+        }
+        pjsip_tx_data_invalidate_hdr(tdata, hdr);
+    }
+}
+
 /*
  * Send request statefully, and update dialog'c CSeq.
  */
@@ -1347,8 +1373,8 @@ PJ_DEF(pj_status_t) pjsip_dlg_send_request( pjsip_dialog *dlg,
 
         ch->cseq = dlg->local.cseq++;
 
-        /* Force the whole message to be re-printed. */
-        pjsip_tx_data_invalidate_msg( tdata );
+        /* Force the headers updated by the dialog to be re-printed. */
+        invalidate_dlg_hdrs( tdata );
     }
 
     /* Create a new transaction if method is not ACK.
@@ -38,6 +38,10 @@
 #define PJSIP_EX_NO_MEMORY  pj_NO_MEMORY_EXCEPTION()
 #define THIS_FILE           "sip_endpoint.c"
 
+#if (PJSIP_RX_QUEUE_SIZE & (PJSIP_RX_QUEUE_SIZE-1)) != 0
+#   error "PJSIP_RX_QUEUE_SIZE must be a power of two"
+#endif
+
 #define MAX_METHODS   32
 
 
@@ -49,6 +53,23 @@ typedef struct exit_cb
 } exit_cb;
 
 
+/* Receive queue, a ring of cloned rdata processed by its worker thread.
+ * The semaphore is posted once for each queued rdata, and once more to
+ * stop the thread.
+ */
+typedef struct rx_queue
+{
+    pjsip_endpoint     *endpt;
+    pj_mutex_t         *mutex;
+    pj_sem_t           *sem;
+    pj_thread_t        *thread;
+    pj_bool_t           quit;
+    unsigned            head;
+    unsigned            tail;
+    pjsip_rx_data      *ring[PJSIP_RX_QUEUE_SIZE];
+} rx_queue;
+
+
 /**
  * The SIP endpoint.
  */
@@ -98,6 +119,10 @@ struct pjsip_endpoint
 
     /** List of exit callback. */
     exit_cb              exit_cb_list;
+
+    /** Receive queues, see pjsip_endpt_create_rx_queues(). */
+    unsigned             rx_queue_cnt;
+    rx_queue            *rx_queue;
 };
 
 
@@ -116,6 +141,12 @@ struct pjsip_endpoint
  */
 static void endpt_on_rx_msg( pjsip_endpoint*, 
                              pj_status_t, pjsip_rx_data*);
+static void endpt_process_rx_msg( pjsip_endpoint *endpt,
+                                  pjsip_rx_data *rdata );
+static pj_bool_t endpt_queue_rx_msg( pjsip_endpoint *endpt,
+                                     pjsip_rx_data *rdata );
+static void stop_rx_queues( rx_queue *queues, unsigned count );
+static void destroy_rx_queues( rx_queue *queues, unsigned count );
 static pj_status_t endpt_on_tx_msg( pjsip_endpoint *endpt,
                                     pjsip_tx_data *tdata );
 static pj_status_t unload_module(pjsip_endpoint *endpt,
@@ -434,6 +465,7 @@ PJ_DEF(pj_status_t) pjsip_endpt_create(pj_pool_factory *pf,
     pjsip_endpoint *endpt;
     pjsip_max_fwd_hdr *mf_hdr;
     pj_lock_t *lock = NULL;
+    pj_timer_heap_cfg timer_cfg;
 
 
     status = pj_register_strerror(PJSIP_ERRNO_START, PJ_ERRNO_SPACE_SIZE,
@@ -488,8 +520,10 @@ PJ_DEF(pj_status_t) pjsip_endpt_create(pj_pool_factory *pf,
     }
 
     /* Create timer heap to manage all timers within this endpoint. */
-    status = pj_timer_heap_create( endpt->pool, PJSIP_MAX_TIMER_COUNT, 
-                                   &endpt->timer_heap);
+    pj_timer_heap_cfg_default(&timer_cfg);
+    timer_cfg.shard_cnt = PJSIP_TIMER_HEAP_SHARD_COUNT;
+    status = pj_timer_heap_create2( endpt->pool, PJSIP_MAX_TIMER_COUNT,
+                                    &timer_cfg, &endpt->timer_heap);
     if (status != PJ_SUCCESS) {
         goto on_error;
     }
@@ -582,6 +616,9 @@ PJ_DEF(void) pjsip_endpt_destroy(pjsip_endpoint *endpt)
 
     PJ_LOG(5, (THIS_FILE, "Destroying endpoint instance.."));
 
+    /* Process the queued messages and stop the receive queue workers */
+    stop_rx_queues(endpt->rx_queue, endpt->rx_queue_cnt);
+
     /* Phase 1: stop all modules */
     mod = endpt->module_list.prev;
     while (mod != &endpt->module_list) {
@@ -606,6 +643,10 @@ PJ_DEF(void) pjsip_endpt_destroy(pjsip_endpoint *endpt)
     /* Shutdown and destroy all transports. */
     pjsip_tpmgr_destroy(endpt->transport_mgr);
 
+    /* No more messages can be queued now */
+    destroy_rx_queues(endpt->rx_queue, endpt->rx_queue_cnt);
+    endpt->rx_queue_cnt = 0;
+
     /* Destroy ioqueue */
     pj_ioqueue_destroy(endpt->ioqueue);
 
@@ -955,6 +996,164 @@ on_return:
     return status;
 }
 
+/*
+ * Worker thread of a receive queue.
+ */
+static int rx_queue_worker(void *arg)
+{
+    rx_queue *q = (rx_queue*) arg;
+
+    for (;;) {
+        pjsip_rx_data *rdata = NULL;
+        pj_bool_t quit;
+
+        pj_sem_wait(q->sem);
+
+        pj_mutex_lock(q->mutex);
+        if (q->head != q->tail)
+            rdata = q->ring[q->head++ & (PJSIP_RX_QUEUE_SIZE-1)];
+        quit = q->quit;
+        pj_mutex_unlock(q->mutex);
+
+        if (rdata) {
+            endpt_process_rx_msg(q->endpt, rdata);
+            pjsip_rx_data_free_cloned(rdata);
+        } else if (quit) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Create receive queues.
+ */
+PJ_DEF(pj_status_t) pjsip_endpt_create_rx_queues(pjsip_endpoint *endpt,
+                                                 unsigned count)
+{
+    rx_queue *queues;
+    unsigned i;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(endpt && count, PJ_EINVAL);
+    PJ_ASSERT_RETURN(endpt->rx_queue == NULL, PJ_EINVALIDOP);
+
+    queues = (rx_queue*) pj_pool_calloc(endpt->pool, count, sizeof(rx_queue));
+
+    for (i=0; i<count; ++i) {
+        rx_queue *q = &queues[i];
+        char name[PJ_MAX_OBJ_NAME];
+
+        q->endpt = endpt;
+
+        status = pj_mutex_create_simple(endpt->pool, "rxq%p", &q->mutex);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+
+        status = pj_sem_create(endpt->pool, "rxq%p", 0, PJSIP_RX_QUEUE_SIZE+1,
+                               &q->sem);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+
+        pj_ansi_snprintf(name, sizeof(name), "sip_rxq%d", i);
+        status = pj_thread_create(endpt->pool, name, &rx_queue_worker, q,
+                                  0, 0, &q->thread);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+    }
+
+    endpt->rx_queue = queues;
+    endpt->rx_queue_cnt = count;
+
+    PJ_LOG(4, (THIS_FILE, "%d SIP receive queues created", count));
+    return PJ_SUCCESS;
+
+on_error:
+    stop_rx_queues(queues, count);
+    destroy_rx_queues(queues, count);
+    return status;
+}
+
+/*
+ * Put a clone of the incoming message in the receive queue selected by
+ * its Call-ID. Returns PJ_FALSE if the message was not queued.
+ */
+static pj_bool_t endpt_queue_rx_msg( pjsip_endpoint *endpt,
+                                     pjsip_rx_data *rdata )
+{
+    const pj_str_t *call_id = &rdata->msg_info.cid->id;
+    pjsip_rx_data *clone;
+    rx_queue *q;
+    pj_uint32_t hval;
+    pj_bool_t queued = PJ_FALSE;
+
+    hval = pj_hash_calc(0, call_id->ptr, (unsigned)call_id->slen);
+    q = &endpt->rx_queue[hval % endpt->rx_queue_cnt];
+
+    if (pjsip_rx_data_clone(rdata, 0, &clone) != PJ_SUCCESS)
+        return PJ_FALSE;
+
+    pj_mutex_lock(q->mutex);
+    if (!q->quit && q->tail - q->head < PJSIP_RX_QUEUE_SIZE) {
+        q->ring[q->tail++ & (PJSIP_RX_QUEUE_SIZE-1)] = clone;
+        queued = PJ_TRUE;
+    }
+    pj_mutex_unlock(q->mutex);
+
+    if (!queued) {
+        PJ_LOG(5, (THIS_FILE, "Receive queue is full, processing %s in "
+                   "the receiving thread", pjsip_rx_data_get_info(rdata)));
+        pjsip_rx_data_free_cloned(clone);
+        return PJ_FALSE;
+    }
+
+    pj_sem_post(q->sem);
+    return PJ_TRUE;
+}
+
+/*
+ * Let the workers process the queued messages, then stop them.
+ */
+static void stop_rx_queues( rx_queue *queues, unsigned count )
+{
+    unsigned i;
+
+    for (i=0; i<count; ++i) {
+        rx_queue *q = &queues[i];
+
+        if (!q->thread)
+            continue;
+
+        pj_mutex_lock(q->mutex);
+        q->quit = PJ_TRUE;
+        pj_mutex_unlock(q->mutex);
+        pj_sem_post(q->sem);
+
+        pj_thread_join(q->thread);
+        pj_thread_destroy(q->thread);
+        q->thread = NULL;
+    }
+}
+
+/*
+ * Destroy the receive queues, after the workers have been stopped.
+ */
+static void destroy_rx_queues( rx_queue *queues, unsigned count )
+{
+    unsigned i;
+
+    for (i=0; i<count; ++i) {
+        rx_queue *q = &queues[i];
+
+        pj_assert(q->thread == NULL && q->head == q->tail);
+        if (q->sem)
+            pj_sem_destroy(q->sem);
+        if (q->mutex)
+            pj_mutex_destroy(q->mutex);
+    }
+}
+
 /*
  * This is the callback that is called by the transport manager when it 
  * receives a message from the network.
@@ -963,12 +1162,6 @@ static void endpt_on_rx_msg( pjsip_endpoint *endpt,
                              pj_status_t status,
                              pjsip_rx_data *rdata )
 {
-    pjsip_msg *msg = rdata->msg_info.msg;
-    pjsip_process_rdata_param proc_prm;
-    pj_bool_t handled = PJ_FALSE;
-
-    PJ_UNUSED_ARG(msg);
-
     if (status != PJ_SUCCESS) {
         char info[30];
         char errmsg[PJ_ERR_MSG_SIZE];
@@ -1010,6 +1203,27 @@ static void endpt_on_rx_msg( pjsip_endpoint *endpt,
         return;
     }
 
+    /* Hand over to the receive queue of the Call-ID. If it can't be
+     * queued, process the message here.
+     */
+    if (endpt->rx_queue_cnt && endpt_queue_rx_msg(endpt, rdata))
+        return;
+
+    endpt_process_rx_msg(endpt, rdata);
+}
+
+/*
+ * Distribute an incoming message to the modules.
+ */
+static void endpt_process_rx_msg( pjsip_endpoint *endpt,
+                                  pjsip_rx_data *rdata )
+{
+    pjsip_msg *msg = rdata->msg_info.msg;
+    pjsip_process_rdata_param proc_prm;
+    pj_bool_t handled = PJ_FALSE;
+
+    PJ_UNUSED_ARG(msg);
+
     PJ_LOG(5, (THIS_FILE, "Processing incoming message: %s", 
                pjsip_rx_data_get_info(rdata)));
     pj_log_push_indent();
@@ -355,6 +355,38 @@ PJ_DEF(pjsip_msg*) pjsip_msg_clone( pj_pool_t *pool, const pjsip_msg *src)
     return dst;
 }
 
+/* Check if a lazy (not yet parsed) header may be of the specified type. */
+static pj_bool_t lazy_hdr_match_type(const pjsip_hdr *hdr,
+                                     pjsip_hdr_e hdr_type)
+{
+    const pjsip_hdr_name_info_t *info = &pjsip_hdr_names[hdr_type];
+
+    if (hdr->name.slen == 1) {
+        return info->sname &&
+               pj_tolower(hdr->name.ptr[0]) == pj_tolower(info->sname[0]);
+    }
+    return hdr->name.slen == (pj_ssize_t)info->name_len &&
+           pj_ansi_strnicmp(hdr->name.ptr, info->name, info->name_len) == 0;
+}
+
+/* Parse the header if it is a lazy header. Compact form names are always
+ * parsed, since their full name is only known after parsing.
+ */
+static const pjsip_hdr* parse_lazy_by_name(const pjsip_hdr *hdr,
+                                           const pj_str_t *name,
+                                           const pj_str_t *sname)
+{
+    if (hdr->type != PJSIP_H_OTHER || !pjsip_hdr_is_lazy(hdr))
+        return hdr;
+
+    if (hdr->name.slen == 1 || pj_stricmp(&hdr->name, name) == 0 ||
+        (sname && pj_stricmp(&hdr->name, sname) == 0))
+    {
+        return pjsip_parse_lazy_hdr((pjsip_hdr*)hdr);
+    }
+    return hdr;
+}
+
 PJ_DEF(void*)  pjsip_hdr_find( const void *hdr_list,
                                pjsip_hdr_e hdr_type, const void *start)
 {
@@ -364,6 +396,11 @@ PJ_DEF(void*)  pjsip_hdr_find( const void *hdr_list,
         hdr = end->next;
     }
     for (; hdr!=end; hdr = hdr->next) {
+        if (hdr->type == PJSIP_H_OTHER && hdr_type < PJSIP_H_OTHER &&
+            pjsip_hdr_is_lazy(hdr) && lazy_hdr_match_type(hdr, hdr_type))
+        {
+            hdr = pjsip_parse_lazy_hdr((pjsip_hdr*)hdr);
+        }
         if (hdr->type == hdr_type)
             return (void*)hdr;
     }
@@ -380,6 +417,7 @@ PJ_DEF(void*)  pjsip_hdr_find_by_name( const void *hdr_list,
         hdr = end->next;
     }
     for (; hdr!=end; hdr = hdr->next) {
+        hdr = parse_lazy_by_name(hdr, name, NULL);
         if (pj_stricmp(&hdr->name, name) == 0)
             return (void*)hdr;
     }
@@ -397,6 +435,7 @@ PJ_DEF(void*)  pjsip_hdr_find_by_names( const void *hdr_list,
         hdr = end->next;
     }
     for (; hdr!=end; hdr = hdr->next) {
+        hdr = parse_lazy_by_name(hdr, name, sname);
         if (pj_stricmp(&hdr->name, name) == 0)
             return (void*)hdr;
         if (pj_stricmp(&hdr->name, sname) == 0)
@@ -438,10 +477,35 @@ PJ_DEF(void*) pjsip_msg_find_remove_hdr( pjsip_msg *msg,
 
 PJ_DEF(pj_ssize_t) pjsip_msg_print( const pjsip_msg *msg, 
                                     char *buf, pj_size_t size)
+{
+    return pjsip_msg_print2(msg, buf, size, NULL);
+}
+
+/* Find the header printed previously, searching from the position of the
+ * header in the message since the positions before that have been
+ * overwritten already.
+ */
+static const pjsip_hdr_print_pos*
+find_print_pos(const pjsip_msg_print_cache *cache, const pjsip_hdr *hdr,
+               unsigned idx)
+{
+    for (; idx < cache->cnt; ++idx) {
+        if (cache->pos[idx].hdr == hdr)
+            return cache->pos[idx].len ? &cache->pos[idx] : NULL;
+    }
+    return NULL;
+}
+
+PJ_DEF(pj_ssize_t) pjsip_msg_print2( const pjsip_msg *msg,
+                                     char *buf, pj_size_t size,
+                                     pjsip_msg_print_cache *cache)
 {
     char *p=buf, *end=buf+size;
     pj_ssize_t len;
     pjsip_hdr *hdr;
+    const char *old_buf;
+    unsigned idx;
+    pj_bool_t use_cache;
     pj_str_t clen_hdr =  { "Content-Length: ", 16};
 
     if (pjsip_cfg()->endpt.use_compact_form) {
@@ -499,27 +563,59 @@ PJ_DEF(pj_ssize_t) pjsip_msg_print( const pjsip_msg *msg,
         *p++ = '\n';
     }
 
-    /* Print each of the headers. */
-    for (hdr=msg->hdr.next; hdr!=&msg->hdr; hdr=hdr->next) {
-        len = pjsip_hdr_print_on(hdr, p, end-p);
-        if (len < 0) {
-           if (len == -2) {
-               PJ_LOG(5, ("sip_msg", "Header with no vptr encountered!! "\
-                          "Current buffer: %.*s", (int)(p-buf), buf));
-           }
-           return len;
-        }
-
-        if (len > 0) {
-            p += len;
-            if (p+3 >= end)
+    /* Print each of the headers. The cache is unusable until all of the
+     * headers have been recorded.
+     */
+    old_buf = cache ? cache->buf : NULL;
+    if (cache)
+        cache->buf = NULL;
+    use_cache = (old_buf && old_buf != buf);
+    for (hdr=msg->hdr.next, idx=0; hdr!=&msg->hdr; hdr=hdr->next, ++idx) {
+        const pjsip_hdr_print_pos *pos = NULL;
+        char *start = p;
+
+        if (use_cache)
+            pos = find_print_pos(cache, hdr, idx);
+
+        if (pos) {
+            /* Unmodified since the previous print, copy it. */
+            if (p + pos->len + 3 >= end)
                 return -1;
+            pj_memcpy(p, old_buf + pos->offset, pos->len);
+            p += pos->len;
 
-            *p++ = '\r';
-            *p++ = '\n';
+        } else {
+            len = pjsip_hdr_print_on(hdr, p, end-p);
+            if (len < 0) {
+               if (len == -2) {
+                   PJ_LOG(5, ("sip_msg", "Header with no vptr encountered!! "\
+                              "Current buffer: %.*s", (int)(p-buf), buf));
+               }
+               return len;
+            }
+
+            if (len > 0) {
+                p += len;
+                if (p+3 >= end)
+                    return -1;
+
+                *p++ = '\r';
+                *p++ = '\n';
+            }
+        }
+
+        if (cache && idx < cache->max) {
+            cache->pos[idx].hdr = hdr;
+            cache->pos[idx].offset = (unsigned)(start - buf);
+            cache->pos[idx].len = (unsigned)(p - start);
         }
     }
 
+    if (cache) {
+        cache->buf = buf;
+        cache->cnt = (idx < cache->max) ? idx : cache->max;
+    }
+
     /* Process message body. */
     if (msg->body) {
         enum { CLEN_SPACE = 5 };
@@ -23,6 +23,7 @@
 #include <pjsip/sip_auth_parser.h>
 #include <pjsip/sip_errno.h>
 #include <pjsip/sip_transport.h>        /* rdata structure */
+#include <pjsip/print_util.h>
 #include <pjlib-util/scanner.h>
 #include <pjlib-util/string.h>
 #include <pj/except.h>
@@ -71,6 +72,7 @@ typedef struct handler_rec
     pj_size_t             hname_len;
     pj_uint32_t           hname_hash;
     pjsip_parse_hdr_func *handler;
+    pj_bool_t             nothrow;      /* Won't throw exception.   */
 } handler_rec;
 
 static handler_rec handler[PJSIP_MAX_HEADER_TYPES];
@@ -124,6 +126,17 @@ static pj_cis_buf_t cis_buf;
  */
 static pjsip_msg *  int_parse_msg( pjsip_parse_ctx *ctx, 
                                    pjsip_parser_err_report *err_list);
+static pjsip_msg *  int_parse_msg_nothrow( pjsip_parse_ctx *ctx,
+                                           pjsip_parser_err_report *err_list);
+static void         parse_msg_body( pj_pool_t *pool, pj_scanner *scanner,
+                                    pjsip_msg *msg,
+                                    pjsip_ctype_hdr *ctype_hdr );
+static void         add_err_report( pj_pool_t *pool,
+                                    pjsip_parser_err_report *err_list,
+                                    pj_scanner *scanner, int except_code,
+                                    const pj_str_t *hname,
+                                    const pjsip_msg *msg );
+static void         skip_bad_hdr( pj_scanner *scanner );
 static void         int_parse_param( pj_scanner *scanner, 
                                      pj_pool_t *pool,
                                      pj_str_t *pname, 
@@ -160,6 +173,10 @@ static void*        int_parse_sip_url( pj_scanner *scanner,
 static pjsip_name_addr *
                     int_parse_name_addr( pj_scanner *scanner, 
                                          pj_pool_t *pool );
+static pjsip_uri *  call_uri_parser( pjsip_parse_uri_func *func,
+                                     pj_scanner *scanner,
+                                     pj_pool_t *pool,
+                                     pj_bool_t parse_params);
 static void*        int_parse_other_uri(pj_scanner *scanner, 
                                         pj_pool_t *pool,
                                         pj_bool_t parse_params);
@@ -185,6 +202,10 @@ static pjsip_hdr*   parse_hdr_to( pjsip_parse_ctx *ctx );
 static pjsip_hdr*   parse_hdr_unsupported( pjsip_parse_ctx *ctx );
 static pjsip_hdr*   parse_hdr_via( pjsip_parse_ctx *ctx );
 static pjsip_hdr*   parse_hdr_generic_string( pjsip_parse_ctx *ctx);
+static pj_bool_t    is_eager_hdr( pjsip_parse_hdr_func *func );
+static pj_bool_t    is_builtin_hdr( pjsip_parse_hdr_func *func );
+static pjsip_hdr*   parse_hdr_lazy( pjsip_parse_ctx *ctx,
+                                    const pj_str_t *hname );
 
 /* Convert non NULL terminated string to integer. */
 static unsigned long pj_strtoul_mindigit(const pj_str_t *str, 
@@ -230,8 +251,78 @@ static void on_syntax_error(pj_scanner *scanner)
     PJ_THROW(PJSIP_SYN_ERR_EXCEPTION);
 }
 
+/*
+ * Scanner of the non-throwing parser (pjsip_parse_msg2()).
+ *
+ * Instead of throwing, the syntax error callback records the first error
+ * and points the scanner to an empty input, so that every following
+ * scanner call fails too and the parsing functions return through their
+ * normal path. The message parser then restores the position of the error
+ * and continues just like the exception handler of int_parse_msg() does.
+ */
+typedef struct nothrow_scanner
+{
+    pj_scanner      scanner;        /* Must be the first member.        */
+    char           *end;            /* End of the input buffer.         */
+    int             except_code;    /* First error, or zero.            */
+    pj_scan_state   err_state;      /* Position of the first error.     */
+} nothrow_scanner;
+
+/* Input of the non-throwing scanner after an error. */
+static char nothrow_eof[1];
+
+static void on_syntax_error_nothrow(pj_scanner *scanner);
+
+#define IS_NOTHROW(scanner)     ((scanner)->callback==&on_syntax_error_nothrow)
+#define PARSE_FAILED(scanner)   (IS_NOTHROW(scanner) && \
+                                 ((nothrow_scanner*)(scanner))->except_code)
+
+/* Record the error of the non-throwing parser. */
+static void set_parse_error(pj_scanner *scanner, int except_code)
+{
+    nothrow_scanner *ns = (nothrow_scanner*)scanner;
+
+    if (ns->except_code == 0) {
+        ns->except_code = except_code;
+        pj_scan_save_state(scanner, &ns->err_state);
+    }
+    scanner->curptr = scanner->end = nothrow_eof;
+}
+
+/* Clear the error of the non-throwing parser, and move the scanner back to
+ * the position of the error. Returns the exception code of the error.
+ */
+static int clear_parse_error(pj_scanner *scanner)
+{
+    nothrow_scanner *ns = (nothrow_scanner*)scanner;
+    int except_code = ns->except_code;
+
+    scanner->end = ns->end;
+    pj_scan_restore_state(scanner, &ns->err_state);
+    ns->except_code = 0;
+    return except_code;
+}
+
+/* Syntax error handler for the non-throwing parser. */
+static void on_syntax_error_nothrow(pj_scanner *scanner)
+{
+    set_parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
+}
+
+/* Report parsing error, by throwing an exception or by recording it when
+ * the non-throwing parser is used. The caller must return after this.
+ */
+static void parse_error(pj_scanner *scanner, int except_code)
+{
+    if (IS_NOTHROW(scanner))
+        set_parse_error(scanner, except_code);
+    else
+        PJ_THROW(except_code);
+}
+
 /* Syntax error handler for parser. */
-static void on_str_parse_error(const pj_str_t *str, int rc)
+static void on_str_parse_error(pj_scanner *scanner, const pj_str_t *str,
+                               int rc)
 {
     char *s;
 
@@ -256,17 +347,21 @@ static void on_str_parse_error(const pj_str_t *str, int rc)
     } else {
         PJ_LOG(1, (THIS_FILE, "Can't parse input string: %s", s));
     }
-    PJ_THROW(PJSIP_EINVAL_ERR_EXCEPTION);
+    parse_error(scanner, PJSIP_EINVAL_ERR_EXCEPTION);
 }
 
-static void strtoi_validate(const pj_str_t *str, int min_val,
-                            int max_val, int *value)
+static void strtoi_validate(pj_scanner *scanner, const pj_str_t *str,
+                            int min_val, int max_val, int *value)
 { 
     long retval;
     pj_status_t status;
 
+    /* The string is not valid after an error in the non-throwing parser */
+    if (PARSE_FAILED(scanner))
+        return;
+
     if (!str || !value) {
-        on_str_parse_error(str, PJ_EINVAL);
+        on_str_parse_error(scanner, str, PJ_EINVAL);
         return;
     }
     status = pj_strtol2(str, &retval);
@@ -282,7 +377,7 @@ static void strtoi_validate(const pj_str_t *str, int min_val,
     }
 
     if (status != PJ_SUCCESS)
-        on_str_parse_error(str, status);
+        on_str_parse_error(scanner, str, status);
 }
 
 /* Get parser constants. */
@@ -618,6 +713,7 @@ static pj_status_t int_register_parser( const char *name,
 
     /* Initialize temporary handler. */
     rec.handler = fptr;
+    rec.nothrow = is_builtin_hdr(fptr);
     rec.hname_len = strlen(name);
     if (rec.hname_len >= sizeof(rec.hname)) {
         pj_assert(!"Header name is too long!");
@@ -705,8 +801,8 @@ PJ_DEF(pj_status_t) pjsip_register_hdr_parser( const char *hname,
 
 
 /* Find handler to parse the header name. */
-static pjsip_parse_hdr_func * find_handler_imp(pj_uint32_t  hash, 
-                                               const pj_str_t *hname)
+static const handler_rec* find_handler_imp(pj_uint32_t  hash, 
+                                           const pj_str_t *hname)
 {
     handler_rec *first;
     int          comp;
@@ -732,17 +828,17 @@ static pjsip_parse_hdr_func * find_handler_imp(pj_uint32_t  hash,
         }
     }
 
-    return comp==0 ? first->handler : NULL;
+    return comp==0 ? first : NULL;
 }
 
 
-/* Find handler to parse the header name. */
-static pjsip_parse_hdr_func* find_handler(const pj_str_t *hname)
+/* Find handler record to parse the header name. */
+static const handler_rec* find_handler_rec(const pj_str_t *hname)
 {
     pj_uint32_t hash;
     char hname_copy[PJSIP_MAX_HNAME_LEN];
     pj_str_t tmp;
-    pjsip_parse_hdr_func *func;
+    const handler_rec *rec;
 
     if (hname->slen >= PJSIP_MAX_HNAME_LEN) {
         /* Guaranteed not to be able to find handler. */
@@ -751,9 +847,9 @@ static pjsip_parse_hdr_func* find_handler(const pj_str_t *hname)
 
     /* First, common case, try to find handler with exact name */
     hash = pj_hash_calc(0, hname->ptr, (unsigned)hname->slen);
-    func = find_handler_imp(hash, hname);
-    if (func)
-        return func;
+    rec = find_handler_imp(hash, hname);
+    if (rec)
+        return rec;
 
 
     /* If not found, try converting the header name to lowercase and
@@ -766,6 +862,41 @@ static pjsip_parse_hdr_func* find_handler(const pj_str_t *hname)
 }
 
 
+/* Find handler to parse the header name. */
+static pjsip_parse_hdr_func* find_handler(const pj_str_t *hname)
+{
+    const handler_rec *rec = find_handler_rec(hname);
+    return rec ? rec->handler : NULL;
+}
+
+
+/* Call header parser. Parsers other than the built-in ones may throw
+ * exception, so the non-throwing parser calls them inside a try block.
+ */
+static pjsip_hdr* call_hdr_parser(const handler_rec *rec,
+                                  pjsip_parse_ctx *ctx)
+{
+    pj_scanner *scanner = ctx->scanner;
+    pjsip_hdr *volatile hdr = NULL;
+    PJ_USE_EXCEPTION;
+
+    if (rec->nothrow)
+        return (*rec->handler)(ctx);
+
+    scanner->callback = &on_syntax_error;
+    PJ_TRY {
+        hdr = (*rec->handler)(ctx);
+    }
+    PJ_CATCH_ANY {
+        set_parse_error(scanner, PJ_GET_EXCEPTION());
+    }
+    PJ_END;
+    scanner->callback = &on_syntax_error_nothrow;
+
+    return hdr;
+}
+
+
 /* Find URI handler. */
 static pjsip_parse_uri_func* find_uri_handler(const pj_str_t *scheme)
 {
@@ -777,6 +908,34 @@ static pjsip_parse_uri_func* find_uri_handler(const pj_str_t *scheme)
     return &int_parse_other_uri;
 }
 
+/* Call URI parser, see call_hdr_parser(). */
+static pjsip_uri* call_uri_parser(pjsip_parse_uri_func *func,
+                                  pj_scanner *scanner,
+                                  pj_pool_t *pool,
+                                  pj_bool_t parse_params)
+{
+    pjsip_uri *volatile uri = NULL;
+    PJ_USE_EXCEPTION;
+
+    if (!IS_NOTHROW(scanner) || func == &int_parse_sip_url ||
+        func == &int_parse_other_uri)
+    {
+        return (pjsip_uri*)(*func)(scanner, pool, parse_params);
+    }
+
+    scanner->callback = &on_syntax_error;
+    PJ_TRY {
+        uri = (pjsip_uri*)(*func)(scanner, pool, parse_params);
+    }
+    PJ_CATCH_ANY {
+        set_parse_error(scanner, PJ_GET_EXCEPTION());
+    }
+    PJ_END;
+    scanner->callback = &on_syntax_error_nothrow;
+
+    return uri;
+}
+
 /* Register URI parser. */
 PJ_DEF(pj_status_t) pjsip_register_uri_parser( char *scheme,
                                                pjsip_parse_uri_func *func)
@@ -833,6 +992,57 @@ PJ_DEF(pjsip_msg *) pjsip_parse_rdata( char *buf, pj_size_t size,
     return rdata->msg_info.msg;
 }
 
+/* Public function to parse SIP message without exception. */
+PJ_DEF(pj_status_t) pjsip_parse_msg2( pj_pool_t *pool,
+                                      char *buf, pj_size_t size,
+                                      pjsip_parser_err_report *err_list,
+                                      pjsip_msg **p_msg)
+{
+    nothrow_scanner ns;
+    pjsip_parse_ctx context;
+
+    PJ_ASSERT_RETURN(pool && buf && p_msg, PJ_EINVAL);
+
+    pj_scan_init(&ns.scanner, buf, size, PJ_SCAN_AUTOSKIP_WS_HEADER, 
+                 &on_syntax_error_nothrow);
+    ns.end = ns.scanner.end;
+    ns.except_code = 0;
+
+    context.scanner = &ns.scanner;
+    context.pool = pool;
+    context.rdata = NULL;
+
+    *p_msg = int_parse_msg_nothrow(&context, err_list);
+
+    pj_scan_fini(&ns.scanner);
+    return *p_msg ? PJ_SUCCESS : PJSIP_EINVALIDMSG;
+}
+
+/* Public function to parse as rdata without exception. */
+PJ_DEF(pj_status_t) pjsip_parse_rdata2( char *buf, pj_size_t size,
+                                        pjsip_rx_data *rdata )
+{
+    nothrow_scanner ns;
+    pjsip_parse_ctx context;
+
+    PJ_ASSERT_RETURN(buf && rdata, PJ_EINVAL);
+
+    pj_scan_init(&ns.scanner, buf, size, PJ_SCAN_AUTOSKIP_WS_HEADER, 
+                 &on_syntax_error_nothrow);
+    ns.end = ns.scanner.end;
+    ns.except_code = 0;
+
+    context.scanner = &ns.scanner;
+    context.pool = rdata->tp_info.pool;
+    context.rdata = rdata;
+
+    rdata->msg_info.msg = int_parse_msg_nothrow(&context,
+                                                &rdata->msg_info.parse_err);
+
+    pj_scan_fini(&ns.scanner);
+    return rdata->msg_info.msg ? PJ_SUCCESS : PJSIP_EINVALIDMSG;
+}
+
 /* Determine if a message has been received. */
 PJ_DEF(pj_status_t) pjsip_find_msg( const char *buf, pj_size_t size, 
                                   pj_bool_t is_datagram, pj_size_t *msg_size)
@@ -908,7 +1118,8 @@ PJ_DEF(pj_status_t) pjsip_find_msg( const char *buf, pj_size_t size,
                 pj_scan_get_newline(&scanner);
 
                 /* Found a valid Content-Length header. */
-                strtoi_validate(&str_clen, PJSIP_MIN_CONTENT_LENGTH,
+                strtoi_validate(&scanner, &str_clen,
+                                PJSIP_MIN_CONTENT_LENGTH,
                                 PJSIP_MAX_CONTENT_LENGTH, &content_length);
             }
             PJ_CATCH_ANY {
@@ -992,10 +1203,10 @@ static void parse_sip_version(pj_scanner *scanner)
 
     pj_scan_get( scanner, &pconst.pjsip_ALPHA_SPEC, &sip);
     if (pj_scan_get_char(scanner) != '/')
-        on_syntax_error(scanner);
+        parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
     pj_scan_get_n( scanner, 3, &version);
     if (pj_stricmp(&sip, &SIP) || pj_stricmp(&version, &V2))
-        on_syntax_error(scanner);
+        parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
 }
 
 static pj_bool_t is_next_sip_version(pj_scanner *scanner)
@@ -1027,6 +1238,7 @@ static pjsip_msg *int_parse_msg( pjsip_parse_ctx *ctx,
     pj_str_t hname;
     pj_scanner *scanner = ctx->scanner;
     pj_pool_t *pool = ctx->pool;
+    pj_bool_t lazy = pjsip_cfg()->endpt.lazy_hdr_parsing;
     PJ_USE_EXCEPTION;
 
     parsing_headers = PJ_FALSE;
@@ -1083,8 +1295,14 @@ parse_headers:
             /* Call the handler if found.
              * If no handler is found, then treat the header as generic
              * hname/hvalue pair.
+             * In lazy mode, headers which are not needed for transaction
+             * matching and routing are only stored as raw value, to be
+             * parsed later when they're looked up.
              */
-            if (func) {
+            if (func && lazy && !is_eager_hdr(func)) {
+                hdr = parse_hdr_lazy(ctx, &hname);
+
+            } else if (func) {
                 hdr = (*func)(ctx);
 
                 /* Note:
@@ -1120,78 +1338,18 @@ parse_headers:
         
         parsing_headers = PJ_FALSE;
 
-        /* If empty line is found, eat it. */
-        if (!pj_scan_is_eof(scanner)) {
-            if (IS_NEWLINE(*scanner->curptr)) {
-                pj_scan_get_newline(scanner);
-            }
-        }
-
-        /* If we have Content-Type header, treat the rest of the message 
-         * as body.
-         */
-        if (ctype_hdr && scanner->curptr!=scanner->end) {
-            /* New: if Content-Type indicates that this is a multipart
-             * message body, parse it.
-             */
-            const pj_str_t STR_MULTIPART = { "multipart", 9 };
-            pjsip_msg_body *body;
-
-            if (pj_stricmp(&ctype_hdr->media.type, &STR_MULTIPART)==0) {
-                body = pjsip_multipart_parse(pool, scanner->curptr,
-                                             scanner->end - scanner->curptr,
-                                             &ctype_hdr->media, 0);
-            } else {
-                body = PJ_POOL_ALLOC_T(pool, pjsip_msg_body);
-                pjsip_media_type_cp(pool, &body->content_type,
-                                    &ctype_hdr->media);
-
-                body->data = scanner->curptr;
-                body->len = (unsigned)(scanner->end - scanner->curptr);
-                body->print_body = &pjsip_print_text_body;
-                body->clone_data = &pjsip_clone_text_data;
-            }
-
-            msg->body = body;
-        }
+        parse_msg_body(pool, scanner, msg, ctype_hdr);
     }
     PJ_CATCH_ANY 
     {
         /* Exception was thrown during parsing. 
          * Skip until newline, and parse next header. 
          */
-        if (err_list) {
-            pjsip_parser_err_report *err_info;
-            
-            err_info = PJ_POOL_ALLOC_T(pool, pjsip_parser_err_report);
-            err_info->except_code = PJ_GET_EXCEPTION();
-            err_info->line = scanner->line;
-            /* Scanner's column is zero based, so add 1 */
-            err_info->col = pj_scan_get_col(scanner) + 1;
-            if (parsing_headers)
-                err_info->hname = hname;
-            else if (msg && msg->type == PJSIP_REQUEST_MSG)
-                err_info->hname = pj_str("Request Line");
-            else if (msg && msg->type == PJSIP_RESPONSE_MSG)
-                err_info->hname = pj_str("Status Line");
-            else
-                err_info->hname.slen = 0;
-            
-            pj_list_insert_before(err_list, err_info);
-        }
+        add_err_report(pool, err_list, scanner, PJ_GET_EXCEPTION(),
+                       parsing_headers ? &hname : NULL, msg);
         
         if (parsing_headers) {
-            if (!pj_scan_is_eof(scanner)) {
-                /* Skip until next line.
-                 * Watch for header continuation.
-                 */
-                do {
-                    pj_scan_skip_line(scanner);
-                } while (IS_SPACE(*scanner->curptr));
-            }
-
-            /* Restore flag. Flag may be set in int_parse_sip_url() */
-            scanner->skip_ws = PJ_SCAN_AUTOSKIP_WS_HEADER;
+            skip_bad_hdr(scanner);
 
             /* Continue parse next header, if any. */
             if (!pj_scan_is_eof(scanner) && !IS_NEWLINE(*scanner->curptr)) {
@@ -1206,6 +1364,190 @@ parse_headers:
     return msg;
 }
 
+/* Internal function to parse SIP message with the non-throwing scanner.
+ * This must behave exactly like int_parse_msg().
+ */
+static pjsip_msg *int_parse_msg_nothrow( pjsip_parse_ctx *ctx,
+                                         pjsip_parser_err_report *err_list)
+{
+    pjsip_msg *msg;
+    pjsip_ctype_hdr *ctype_hdr = NULL;
+    pj_str_t hname;
+    pj_scanner *scanner = ctx->scanner;
+    pj_pool_t *pool = ctx->pool;
+    pj_bool_t lazy = pjsip_cfg()->endpt.lazy_hdr_parsing;
+
+    pj_assert(IS_NOTHROW(scanner));
+
+    /* Skip leading newlines. */
+    while (IS_NEWLINE(*scanner->curptr)) {
+        pj_scan_get_newline(scanner);
+    }
+
+    /* Check if we still have valid packet. */
+    if (pj_scan_is_eof(scanner))
+        return NULL;
+
+    /* Parse request or status line */
+    if (is_next_sip_version(scanner)) {
+        msg = pjsip_msg_create(pool, PJSIP_RESPONSE_MSG);
+        int_parse_status_line( scanner, &msg->line.status );
+    } else {
+        msg = pjsip_msg_create(pool, PJSIP_REQUEST_MSG);
+        int_parse_req_line(scanner, pool, &msg->line.req );
+    }
+
+    if (PARSE_FAILED(scanner)) {
+        int except_code = clear_parse_error(scanner);
+        add_err_report(pool, err_list, scanner, except_code, NULL, msg);
+        return NULL;
+    }
+
+    /* Parse headers. */
+    do {
+        const handler_rec *rec;
+        pjsip_hdr *hdr = NULL;
+
+        hname.slen = 0;
+
+        /* Get hname. */
+        pj_scan_get( scanner, &pconst.pjsip_TOKEN_SPEC, &hname);
+        if (pj_scan_get_char( scanner ) != ':') {
+            parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
+        }
+
+        /* Find and call handler, see int_parse_msg() */
+        if (!PARSE_FAILED(scanner)) {
+            rec = find_handler_rec(&hname);
+
+            if (rec && lazy && !is_eager_hdr(rec->handler)) {
+                hdr = parse_hdr_lazy(ctx, &hname);
+
+            } else if (rec) {
+                hdr = call_hdr_parser(rec, ctx);
+
+                if (hdr && hdr->type == PJSIP_H_CONTENT_TYPE &&
+                    !PARSE_FAILED(scanner))
+                {
+                    ctype_hdr = (pjsip_ctype_hdr*)hdr;
+                }
+
+            } else {
+                hdr = parse_hdr_generic_string(ctx);
+                hdr->name = hdr->sname = hname;
+            }
+        }
+
+        if (PARSE_FAILED(scanner)) {
+            int except_code = clear_parse_error(scanner);
+
+            /* Skip until newline, and parse next header, if any. */
+            add_err_report(pool, err_list, scanner, except_code, &hname, msg);
+            skip_bad_hdr(scanner);
+            if (pj_scan_is_eof(scanner) || IS_NEWLINE(*scanner->curptr))
+                return NULL;
+            continue;
+        }
+
+        if (hdr)
+            pj_list_insert_nodes_before(&msg->hdr, hdr);
+
+        /* Parse until EOF or an empty line is found. */
+    } while (!pj_scan_is_eof(scanner) && !IS_NEWLINE(*scanner->curptr));
+
+    parse_msg_body(pool, scanner, msg, ctype_hdr);
+
+    return msg;
+}
+
+/* Parse the message body following the headers, if the message has
+ * Content-Type header.
+ */
+static void parse_msg_body( pj_pool_t *pool, pj_scanner *scanner,
+                            pjsip_msg *msg, pjsip_ctype_hdr *ctype_hdr )
+{
+    /* If empty line is found, eat it. */
+    if (!pj_scan_is_eof(scanner)) {
+        if (IS_NEWLINE(*scanner->curptr)) {
+            pj_scan_get_newline(scanner);
+        }
+    }
+
+    /* If we have Content-Type header, treat the rest of the message 
+     * as body.
+     */
+    if (ctype_hdr && scanner->curptr!=scanner->end) {
+        /* New: if Content-Type indicates that this is a multipart
+         * message body, parse it.
+         */
+        const pj_str_t STR_MULTIPART = { "multipart", 9 };
+        pjsip_msg_body *body;
+
+        if (pj_stricmp(&ctype_hdr->media.type, &STR_MULTIPART)==0) {
+            body = pjsip_multipart_parse(pool, scanner->curptr,
+                                         scanner->end - scanner->curptr,
+                                         &ctype_hdr->media, 0);
+        } else {
+            body = PJ_POOL_ALLOC_T(pool, pjsip_msg_body);
+            pjsip_media_type_cp(pool, &body->content_type,
+                                &ctype_hdr->media);
+
+            body->data = scanner->curptr;
+            body->len = (unsigned)(scanner->end - scanner->curptr);
+            body->print_body = &pjsip_print_text_body;
+            body->clone_data = &pjsip_clone_text_data;
+        }
+
+        msg->body = body;
+    }
+}
+
+/* Add parsing error report to the list. The hname is NULL if the error
+ * is in the request or status line.
+ */
+static void add_err_report( pj_pool_t *pool,
+                            pjsip_parser_err_report *err_list,
+                            pj_scanner *scanner, int except_code,
+                            const pj_str_t *hname, const pjsip_msg *msg )
+{
+    pjsip_parser_err_report *err_info;
+
+    if (!err_list)
+        return;
+
+    err_info = PJ_POOL_ALLOC_T(pool, pjsip_parser_err_report);
+    err_info->except_code = except_code;
+    err_info->line = scanner->line;
+    /* Scanner's column is zero based, so add 1 */
+    err_info->col = pj_scan_get_col(scanner) + 1;
+    if (hname)
+        err_info->hname = *hname;
+    else if (msg && msg->type == PJSIP_REQUEST_MSG)
+        err_info->hname = pj_str("Request Line");
+    else if (msg && msg->type == PJSIP_RESPONSE_MSG)
+        err_info->hname = pj_str("Status Line");
+    else
+        err_info->hname.slen = 0;
+    
+    pj_list_insert_before(err_list, err_info);
+}
+
+/* Skip the rest of the header which fails to parse. */
+static void skip_bad_hdr( pj_scanner *scanner )
+{
+    if (!pj_scan_is_eof(scanner)) {
+        /* Skip until next line.
+         * Watch for header continuation.
+         */
+        do {
+            pj_scan_skip_line(scanner);
+        } while (IS_SPACE(*scanner->curptr));
+    }
+
+    /* Restore flag. Flag may be set in int_parse_sip_url() */
+    scanner->skip_ws = PJ_SCAN_AUTOSKIP_WS_HEADER;
+}
+
 
 /* Parse parameter (pname ["=" pvalue]). */
 static void parse_param_imp( pj_scanner *scanner, pj_pool_t *pool,
@@ -1361,7 +1703,8 @@ static void int_parse_uri_host_port( pj_scanner *scanner,
         pj_str_t port;
         pj_scan_get_char(scanner);
         pj_scan_get(scanner, &pconst.pjsip_DIGIT_SPEC, &port);
-        strtoi_validate(&port, PJSIP_MIN_PORT, PJSIP_MAX_PORT, p_port);
+        strtoi_validate(scanner, &port, PJSIP_MIN_PORT, PJSIP_MAX_PORT,
+                        p_port);
     } else {
         *p_port = 0;
     }
@@ -1428,12 +1771,12 @@ static pjsip_uri *int_parse_uri_or_name_addr( pj_scanner *scanner, pj_pool_t *po
 
             if (func == NULL) {
                 /* Unsupported URI scheme */
-                PJ_THROW(PJSIP_SYN_ERR_EXCEPTION);
+                parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
+                return NULL;
             }
 
-            uri = (pjsip_uri*)
-                  (*func)(scanner, pool, 
-                          (opt & PJSIP_PARSE_URI_IN_FROM_TO_HDR)==0);
+            uri = call_uri_parser(func, scanner, pool, 
+                                  (opt & PJSIP_PARSE_URI_IN_FROM_TO_HDR)==0);
 
 
         } else {
@@ -1476,17 +1819,18 @@ static pjsip_uri *int_parse_uri(pj_scanner *scanner, pj_pool_t *pool,
         /* Get scheme. */
         colon = pj_scan_peek(scanner, &pconst.pjsip_TOKEN_SPEC, &scheme);
         if (colon != ':') {
-            PJ_THROW(PJSIP_SYN_ERR_EXCEPTION);
+            parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
+            return NULL;
         }
 
         func = find_uri_handler(&scheme);
         if (func)  {
-            return (pjsip_uri*)(*func)(scanner, pool, parse_params);
+            return call_uri_parser(func, scanner, pool, parse_params);
 
         } else {
             /* Unsupported URI scheme */
-            PJ_THROW(PJSIP_SYN_ERR_EXCEPTION);
-            UNREACHED({ return NULL; /* Not reached. */ })
+            parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
+            return NULL;
         }
 
     /*
@@ -1510,7 +1854,8 @@ static void* int_parse_sip_url( pj_scanner *scanner,
     pj_scan_get(scanner, &pconst.pjsip_TOKEN_SPEC, &scheme);
     colon = pj_scan_get_char(scanner);
     if (colon != ':') {
-        PJ_THROW(PJSIP_SYN_ERR_EXCEPTION);
+        parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
+        return NULL;
     }
 
     if (parser_stricmp(scheme, pconst.pjsip_SIP_STR)==0) {
@@ -1520,12 +1865,8 @@ static void* int_parse_sip_url( pj_scanner *scanner,
         url = pjsip_sip_uri_create(pool, 1);
 
     } else {
-        PJ_THROW(PJSIP_SYN_ERR_EXCEPTION);
-        /* should not reach here */
-        UNREACHED({
-            pj_assert(0);
-            return 0;
-        })
+        parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
+        return NULL;
     }
 
     if (int_is_next_user(scanner)) {
@@ -1552,7 +1893,7 @@ static void* int_parse_sip_url( pj_scanner *scanner,
             url->transport_param = pvalue;
 
         } else if (!parser_stricmp(pname, pconst.pjsip_TTL_STR) && pvalue.slen) {
-            strtoi_validate(&pvalue, PJSIP_MIN_TTL, PJSIP_MAX_TTL,
+            strtoi_validate(scanner, &pvalue, PJSIP_MIN_TTL, PJSIP_MAX_TTL,
                             &url->ttl_param);
         } else if (!parser_stricmp(pname, pconst.pjsip_MADDR_STR) && pvalue.slen) {
             url->maddr_param = pvalue;
@@ -1628,12 +1969,13 @@ static pjsip_name_addr *int_parse_name_addr( pj_scanner *scanner,
          * Allowing (invalid) name-addr to pass URI verification will
          * cause us to send invalid URI to the wire.
          */
-        PJ_THROW( PJSIP_SYN_ERR_EXCEPTION);
+        parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
+        return name_addr;
     }
     name_addr->uri = int_parse_uri( scanner, pool, PJ_TRUE );
     if (has_bracket) {
         if (pj_scan_get_char(scanner) != '>')
-            PJ_THROW( PJSIP_SYN_ERR_EXCEPTION);
+            parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
     }
 
     return name_addr;
@@ -1657,7 +1999,8 @@ static void* int_parse_other_uri(pj_scanner *scanner,
     
     pj_scan_get(scanner, &pc->pjsip_TOKEN_SPEC, &uri->scheme);
     if (pj_scan_get_char(scanner) != ':') {
-        PJ_THROW(PJSIP_SYN_ERR_EXCEPTION);
+        parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
+        return NULL;
     }
     
     pj_scan_get(scanner, &pc->pjsip_OTHER_URI_CONTENT, &uri->content);
@@ -1689,8 +2032,8 @@ static void int_parse_status_line( pj_scanner *scanner,
 
     parse_sip_version(scanner);
     pj_scan_get( scanner, &pconst.pjsip_DIGIT_SPEC, &token);
-    strtoi_validate(&token, PJSIP_MIN_STATUS_CODE, PJSIP_MAX_STATUS_CODE,
-                    &status_line->code);
+    strtoi_validate(scanner, &token, PJSIP_MIN_STATUS_CODE,
+                    PJSIP_MAX_STATUS_CODE, &status_line->code);
     if (*scanner->curptr != '\r' && *scanner->curptr != '\n')
         pj_scan_get( scanner, &pconst.pjsip_NOT_NEWLINE, &status_line->reason);
     else
@@ -1762,12 +2105,14 @@ static void parse_generic_array_hdr( pjsip_generic_array_hdr *hdr,
 
     if (hdr->count >= PJ_ARRAY_SIZE(hdr->values)) {
         /* Too many elements */
-        on_syntax_error(scanner);
+        parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
         return;
     }
 
     pj_scan_get( scanner, &pconst.pjsip_NOT_COMMA_OR_NEWLINE, 
                  &hdr->values[hdr->count]);
+    if (PARSE_FAILED(scanner))
+        return;
     hdr->count++;
 
     while ((hdr->count < PJSIP_GENERIC_ARRAY_MAX_COUNT) &&
@@ -1776,6 +2121,8 @@ static void parse_generic_array_hdr( pjsip_generic_array_hdr *hdr,
         pj_scan_get_char(scanner);
         pj_scan_get( scanner, &pconst.pjsip_NOT_COMMA_OR_NEWLINE, 
                      &hdr->values[hdr->count]);
+        if (PARSE_FAILED(scanner))
+            return;
         hdr->count++;
     }
 
@@ -1857,7 +2204,7 @@ static pjsip_hdr* parse_hdr_call_id(pjsip_parse_ctx *ctx)
     pj_scan_get( ctx->scanner, &pconst.pjsip_NOT_NEWLINE, &hdr->id);
     parse_hdr_end(ctx->scanner);
 
-    if (ctx->rdata)
+    if (ctx->rdata && !PARSE_FAILED(ctx->scanner))
         ctx->rdata->msg_info.cid = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -1875,16 +2222,16 @@ static void int_parse_contact_param( pjsip_contact_hdr *hdr,
         if (!parser_stricmp(pname, pconst.pjsip_Q_STR) && pvalue.slen) {
             char *dot_pos = (char*) pj_memchr(pvalue.ptr, '.', pvalue.slen);
             if (!dot_pos) {
-                strtoi_validate(&pvalue, PJSIP_MIN_Q1000, PJSIP_MAX_Q1000,
-                                &hdr->q1000);
+                strtoi_validate(scanner, &pvalue, PJSIP_MIN_Q1000,
+                                PJSIP_MAX_Q1000, &hdr->q1000);
                 hdr->q1000 *= 1000;
             } else {
                 pj_str_t tmp = pvalue;
                 unsigned long qval_frac;
 
                 tmp.slen = dot_pos - pvalue.ptr;
-                strtoi_validate(&tmp, PJSIP_MIN_Q1000, PJSIP_MAX_Q1000,
-                                &hdr->q1000);
+                strtoi_validate(scanner, &tmp, PJSIP_MIN_Q1000,
+                                PJSIP_MAX_Q1000, &hdr->q1000);
                 hdr->q1000 *= 1000;
 
                 pvalue.slen = (pvalue.ptr+pvalue.slen) - (dot_pos+1);
@@ -1894,7 +2241,8 @@ static void int_parse_contact_param( pjsip_contact_hdr *hdr,
                 }
                 qval_frac = pj_strtoul_mindigit(&pvalue, 3);
                 if ((unsigned)hdr->q1000 > (PJ_MAXINT32 - qval_frac)) {
-                    PJ_THROW(PJSIP_SYN_ERR_EXCEPTION);
+                    parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
+                    return;
                 }
                 hdr->q1000 += qval_frac;
             }    
@@ -1968,7 +2316,7 @@ static pjsip_hdr* parse_hdr_content_len( pjsip_parse_ctx *ctx )
     hdr->len = pj_strtoul(&digit);
     parse_hdr_end(ctx->scanner);
 
-    if (ctx->rdata)
+    if (ctx->rdata && !PARSE_FAILED(ctx->scanner))
         ctx->rdata->msg_info.clen = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -1996,7 +2344,7 @@ static pjsip_hdr* parse_hdr_content_type( pjsip_parse_ctx *ctx )
 
     parse_hdr_end(ctx->scanner);
 
-    if (ctx->rdata)
+    if (ctx->rdata && !PARSE_FAILED(ctx->scanner))
         ctx->rdata->msg_info.ctype = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -2010,7 +2358,8 @@ static pjsip_hdr* parse_hdr_cseq( pjsip_parse_ctx *ctx )
     int cseq_val = 0;
 
     pj_scan_get( ctx->scanner, &pconst.pjsip_DIGIT_SPEC, &cseq);
-    strtoi_validate(&cseq, PJSIP_MIN_CSEQ, PJSIP_MAX_CSEQ, &cseq_val);
+    strtoi_validate(ctx->scanner, &cseq, PJSIP_MIN_CSEQ, PJSIP_MAX_CSEQ,
+                    &cseq_val);
 
     hdr = pjsip_cseq_hdr_create(ctx->pool);
     hdr->cseq = cseq_val;
@@ -2019,7 +2368,7 @@ static pjsip_hdr* parse_hdr_cseq( pjsip_parse_ctx *ctx )
     parse_hdr_end( ctx->scanner );
 
     pjsip_method_init_np(&hdr->method, &method);
-    if (ctx->rdata) {
+    if (ctx->rdata && !PARSE_FAILED(ctx->scanner)) {
         ctx->rdata->msg_info.cseq = hdr;
     }
 
@@ -2067,7 +2416,7 @@ static pjsip_hdr* parse_hdr_from( pjsip_parse_ctx *ctx )
 {
     pjsip_from_hdr *hdr = pjsip_from_hdr_create(ctx->pool);
     parse_hdr_fromto(ctx->scanner, ctx->pool, hdr);
-    if (ctx->rdata)
+    if (ctx->rdata && !PARSE_FAILED(ctx->scanner))
         ctx->rdata->msg_info.from = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -2103,8 +2452,8 @@ static pjsip_hdr* parse_hdr_retry_after(pjsip_parse_ctx *ctx)
     hdr = pjsip_retry_after_hdr_create(ctx->pool, 0);
     
     pj_scan_get(scanner, &pconst.pjsip_DIGIT_SPEC, &tmp);
-    strtoi_validate(&tmp, PJSIP_MIN_RETRY_AFTER, PJSIP_MAX_RETRY_AFTER,
-                    &hdr->ivalue);
+    strtoi_validate(scanner, &tmp, PJSIP_MIN_RETRY_AFTER,
+                    PJSIP_MAX_RETRY_AFTER, &hdr->ivalue);
 
     while (!pj_scan_is_eof(scanner) && *scanner->curptr!='\r' &&
            *scanner->curptr!='\n')
@@ -2119,7 +2468,7 @@ static pjsip_hdr* parse_hdr_retry_after(pjsip_parse_ctx *ctx)
             int_parse_param(scanner, ctx->pool, &prm->name, &prm->value, 0);
             pj_list_push_back(&hdr->param, prm);
         } else {
-            on_syntax_error(scanner);
+            parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
         }
     }
 
@@ -2152,7 +2501,7 @@ static pjsip_hdr* parse_hdr_to( pjsip_parse_ctx *ctx )
     pjsip_to_hdr *hdr = pjsip_to_hdr_create(ctx->pool);
     parse_hdr_fromto(ctx->scanner, ctx->pool, hdr);
 
-    if (ctx->rdata)
+    if (ctx->rdata && !PARSE_FAILED(ctx->scanner))
         ctx->rdata->msg_info.to = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -2196,7 +2545,7 @@ static void int_parse_via_param( pjsip_via_hdr *hdr, pj_scanner *scanner,
             hdr->branch_param = pvalue;
 
         } else if (!parser_stricmp(pname, pconst.pjsip_TTL_STR) && pvalue.slen) {
-            strtoi_validate(&pvalue, PJSIP_MIN_TTL, PJSIP_MAX_TTL,
+            strtoi_validate(scanner, &pvalue, PJSIP_MIN_TTL, PJSIP_MAX_TTL,
                             &hdr->ttl_param);
             
         } else if (!parser_stricmp(pname, pconst.pjsip_MADDR_STR) && pvalue.slen) {
@@ -2207,8 +2556,8 @@ static void int_parse_via_param( pjsip_via_hdr *hdr, pj_scanner *scanner,
 
         } else if (!parser_stricmp(pname, pconst.pjsip_RPORT_STR)) {
             if (pvalue.slen) {
-                strtoi_validate(&pvalue, PJSIP_MIN_PORT, PJSIP_MAX_PORT,
-                                &hdr->rport_param);
+                strtoi_validate(scanner, &pvalue, PJSIP_MIN_PORT,
+                                PJSIP_MAX_PORT, &hdr->rport_param);
             } else
                 hdr->rport_param = 0;
         } else {
@@ -2227,7 +2576,7 @@ static pjsip_hdr* parse_hdr_max_forwards( pjsip_parse_ctx *ctx )
     hdr = pjsip_max_fwd_hdr_create(ctx->pool, 0);
     parse_generic_int_hdr(hdr, ctx->scanner);
 
-    if (ctx->rdata)
+    if (ctx->rdata && !PARSE_FAILED(ctx->scanner))
         ctx->rdata->msg_info.max_fwd = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -2280,8 +2629,11 @@ static pjsip_hdr* parse_hdr_rr( pjsip_parse_ctx *ctx)
     } while (1);
     parse_hdr_end(scanner);
 
-    if (ctx->rdata && ctx->rdata->msg_info.record_route==NULL)
+    if (ctx->rdata && ctx->rdata->msg_info.record_route==NULL &&
+        !PARSE_FAILED(scanner))
+    {
         ctx->rdata->msg_info.record_route = first;
+    }
 
     return (pjsip_hdr*)first;
 }
@@ -2308,8 +2660,11 @@ static pjsip_hdr* parse_hdr_route( pjsip_parse_ctx *ctx )
     } while (1);
     parse_hdr_end(scanner);
 
-    if (ctx->rdata && ctx->rdata->msg_info.route==NULL)
+    if (ctx->rdata && ctx->rdata->msg_info.route==NULL &&
+        !PARSE_FAILED(scanner))
+    {
         ctx->rdata->msg_info.route = first;
+    }
 
     return (pjsip_hdr*)first;
 }
@@ -2329,7 +2684,7 @@ static pjsip_hdr* parse_hdr_via( pjsip_parse_ctx *ctx )
 
         parse_sip_version(scanner);
         if (pj_scan_get_char(scanner) != '/')
-            on_syntax_error(scanner);
+            parse_error(scanner, PJSIP_SYN_ERR_EXCEPTION);
 
         pj_scan_get( scanner, &pconst.pjsip_TOKEN_SPEC, &hdr->transport);
         int_parse_host(scanner, &hdr->sent_by.host);
@@ -2338,7 +2693,7 @@ static pjsip_hdr* parse_hdr_via( pjsip_parse_ctx *ctx )
             pj_str_t digit;
             pj_scan_get_char(scanner);
             pj_scan_get(scanner, &pconst.pjsip_DIGIT_SPEC, &digit);
-            strtoi_validate(&digit, PJSIP_MIN_PORT, PJSIP_MAX_PORT,
+            strtoi_validate(scanner, &digit, PJSIP_MIN_PORT, PJSIP_MAX_PORT,
                             &hdr->sent_by.port);
         }
         
@@ -2359,8 +2714,11 @@ static pjsip_hdr* parse_hdr_via( pjsip_parse_ctx *ctx )
 
     parse_hdr_end(scanner);
 
-    if (ctx->rdata && ctx->rdata->msg_info.via == NULL)
+    if (ctx->rdata && ctx->rdata->msg_info.via == NULL &&
+        !PARSE_FAILED(scanner))
+    {
         ctx->rdata->msg_info.via = first;
+    }
 
     return (pjsip_hdr*)first;
 }
@@ -2376,6 +2734,154 @@ static pjsip_hdr* parse_hdr_generic_string( pjsip_parse_ctx *ctx )
 
 }
 
+/*
+ * Lazy header, i.e. a known header whose parsing is deferred until it is
+ * looked up. It is laid out as generic string header, with additional
+ * pointer to the pool to be used to parse the value later.
+ */
+typedef struct lazy_hdr
+{
+    PJSIP_DECL_HDR_MEMBER(struct lazy_hdr);
+    pj_str_t    hvalue;
+    pj_pool_t  *pool;
+} lazy_hdr;
+
+static lazy_hdr* lazy_hdr_clone( pj_pool_t *pool, const lazy_hdr *rhs );
+static lazy_hdr* lazy_hdr_shallow_clone( pj_pool_t *pool,
+                                         const lazy_hdr *rhs );
+static int lazy_hdr_print( lazy_hdr *hdr, char *buf, pj_size_t size );
+
+static pjsip_hdr_vptr lazy_hdr_vptr =
+{
+    (pjsip_hdr_clone_fptr) &lazy_hdr_clone,
+    (pjsip_hdr_clone_fptr) &lazy_hdr_shallow_clone,
+    (pjsip_hdr_print_fptr) &lazy_hdr_print,
+};
+
+/* Headers which are always parsed, since they're needed by the transaction
+ * layer, by the proxy routing, or to fill the rdata msg_info.
+ */
+static pj_bool_t is_eager_hdr( pjsip_parse_hdr_func *func )
+{
+    return func == &parse_hdr_via || func == &parse_hdr_from ||
+           func == &parse_hdr_to || func == &parse_hdr_call_id ||
+           func == &parse_hdr_cseq || func == &parse_hdr_route ||
+           func == &parse_hdr_rr || func == &parse_hdr_max_forwards ||
+           func == &parse_hdr_content_len ||
+           func == &parse_hdr_content_type ||
+           func == &parse_hdr_require || func == &parse_hdr_supported;
+}
+
+/* Headers with parser in this file, which don't throw exception when
+ * parsing with the non-throwing scanner.
+ */
+static pj_bool_t is_builtin_hdr( pjsip_parse_hdr_func *func )
+{
+    return is_eager_hdr(func) ||
+           func == &parse_hdr_accept || func == &parse_hdr_allow ||
+           func == &parse_hdr_contact || func == &parse_hdr_expires ||
+           func == &parse_hdr_min_expires ||
+           func == &parse_hdr_retry_after ||
+           func == &parse_hdr_unsupported;
+}
+
+static pjsip_hdr* parse_hdr_lazy( pjsip_parse_ctx *ctx,
+                                  const pj_str_t *hname )
+{
+    lazy_hdr *hdr = PJ_POOL_ALLOC_T(ctx->pool, lazy_hdr);
+
+    hdr->type = PJSIP_H_OTHER;
+    hdr->name = hdr->sname = *hname;
+    hdr->vptr = &lazy_hdr_vptr;
+    hdr->pool = ctx->pool;
+    pj_list_init(hdr);
+
+    parse_generic_string_hdr((pjsip_generic_string_hdr*)hdr, ctx);
+    return (pjsip_hdr*)hdr;
+}
+
+static lazy_hdr* lazy_hdr_clone( pj_pool_t *pool, const lazy_hdr *rhs )
+{
+    lazy_hdr *hdr = PJ_POOL_ALLOC_T(pool, lazy_hdr);
+
+    pj_memcpy(hdr, rhs, sizeof(*hdr));
+    pj_strdup(pool, &hdr->name, &rhs->name);
+    hdr->sname = hdr->name;
+    pj_strdup(pool, &hdr->hvalue, &rhs->hvalue);
+    hdr->pool = pool;
+    pj_list_init(hdr);
+    return hdr;
+}
+
+static lazy_hdr* lazy_hdr_shallow_clone( pj_pool_t *pool,
+                                         const lazy_hdr *rhs )
+{
+    lazy_hdr *hdr = PJ_POOL_ALLOC_T(pool, lazy_hdr);
+
+    pj_memcpy(hdr, rhs, sizeof(*hdr));
+    hdr->pool = pool;
+    pj_list_init(hdr);
+    return hdr;
+}
+
+static int lazy_hdr_print( lazy_hdr *hdr, char *buf, pj_size_t size )
+{
+    char *p = buf;
+
+    if ((pj_ssize_t)size < hdr->name.slen + hdr->hvalue.slen + 5)
+        return -1;
+
+    pj_memcpy(p, hdr->name.ptr, hdr->name.slen);
+    p += hdr->name.slen;
+    *p++ = ':';
+    *p++ = ' ';
+    pj_memcpy(p, hdr->hvalue.ptr, hdr->hvalue.slen);
+    p += hdr->hvalue.slen;
+    *p = '\0';
+
+    return (int)(p - buf);
+}
+
+PJ_DEF(pj_bool_t) pjsip_hdr_is_lazy( const pjsip_hdr *hdr )
+{
+    return hdr->vptr == &lazy_hdr_vptr;
+}
+
+PJ_DEF(pjsip_hdr*) pjsip_parse_lazy_hdr( pjsip_hdr *hdr )
+{
+    lazy_hdr *lh = (lazy_hdr*)hdr;
+    pjsip_hdr *parsed;
+    char *buf;
+
+    PJ_ASSERT_RETURN(hdr, NULL);
+    if (!pjsip_hdr_is_lazy(hdr))
+        return hdr;
+
+    /* Parser requires NULL terminated input */
+    buf = (char*) pj_pool_alloc(lh->pool, lh->hvalue.slen + 1);
+    pj_memcpy(buf, lh->hvalue.ptr, lh->hvalue.slen);
+    buf[lh->hvalue.slen] = '\0';
+
+    parsed = (pjsip_hdr*) pjsip_parse_hdr(lh->pool, &lh->name, buf,
+                                          lh->hvalue.slen, NULL);
+    if (!parsed) {
+        /* Invalid value. Keep it as generic header so that it can still
+         * be forwarded unchanged.
+         */
+        parsed = (pjsip_hdr*)
+                 pjsip_generic_string_hdr_create(lh->pool, &lh->name,
+                                                 &lh->hvalue);
+    }
+
+    /* Replace the lazy header with the parsed header(s) */
+    if (hdr->next && hdr->next != hdr) {
+        pj_list_insert_nodes_before(hdr, parsed);
+        pj_list_erase(hdr);
+    }
+
+    return parsed;
+}
+
 /* Public function to parse a header value. */
 PJ_DEF(void*) pjsip_parse_hdr( pj_pool_t *pool, const pj_str_t *hname,
                                char *buf, pj_size_t size, int *parsed_len )
@@ -40,12 +40,18 @@
 #define TSX_TRACE_(expr)
 #endif
 
-/* When this macro is set, transaction will keep the hashed value
- * so that future lookup (to unregister transaction) does not need
- * to recalculate the hash again. It should gains a little bit of
- * performance, so generally we'd want this.
+#if PJSIP_TSX_TABLE_SHARD_CNT < 1 || PJSIP_TSX_TABLE_SHARD_CNT > 256 || \
+    (PJSIP_TSX_TABLE_SHARD_CNT & (PJSIP_TSX_TABLE_SHARD_CNT-1)) != 0
+#   error "PJSIP_TSX_TABLE_SHARD_CNT must be a power of two up to 256"
+#endif
+
+/* Select the shard of a hashed key. The hash table buckets are indexed
+ * with the low bits of the hash, so take the shard from the top bits of
+ * a multiplicative mix to keep the two independent.
  */
-#define PRECALC_HASH
+#define TSX_SHARD(hval) \
+    (&mod_tsx_layer.shard[((pj_uint32_t)((hval) * 2654435761U) >> 24) & \
+                          (PJSIP_TSX_TABLE_SHARD_CNT-1)])
 
 
 /* Defined in sip_util_statefull.c */
@@ -66,15 +72,29 @@ static pj_status_t mod_tsx_layer_unload(void);
 static pj_bool_t   mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata);
 static pj_bool_t   mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata);
 
+/* A shard of the transaction table. The primary table is keyed by the
+ * transaction key, the secondary table by the RFC 2543 style key of UAS
+ * transactions, and a transaction is placed in the shard of each key.
+ * The hash tables use the entry buffers in the transaction, so they can
+ * be rebuilt with more buckets from the shard's own pool.
+ */
+struct tsx_shard
+{
+    pj_mutex_t          *mutex;
+    pj_pool_t           *pool;
+    unsigned             size;
+    pj_hash_table_t     *htable;
+    pj_hash_table_t     *htable2;
+};
+
 /* Transaction layer module definition. */
 static struct mod_tsx_layer
 {
     struct pjsip_module  mod;
     pj_pool_t           *pool;
     pjsip_endpoint      *endpt;
-    pj_mutex_t          *mutex;
-    pj_hash_table_t     *htable;
-    pj_hash_table_t     *htable2;
+    pj_bool_t            stopping;
+    struct tsx_shard     shard[PJSIP_TSX_TABLE_SHARD_CNT];
 } mod_tsx_layer = 
 {   {
         NULL, NULL,                     /* List's prev and next.    */
@@ -494,12 +514,147 @@ PJ_DEF(void) pjsip_tsx_set_max_retransmit_count(int max)
  **
  *****************************************************************************
  **/
+/*
+ * Create the hash tables of a shard with the specified number of buckets,
+ * moving the transactions from the current tables if there are any.
+ */
+static pj_status_t tsx_shard_rehash(struct tsx_shard *shard, unsigned size)
+{
+    pj_pool_t *pool;
+    pj_hash_table_t *htable, *htable2;
+    pj_hash_iterator_t it_buf, *it;
+
+    pool = pjsip_endpt_create_pool(mod_tsx_layer.endpt, "tsxtbl%p",
+                                   2 * size * sizeof(void*) + 512, 512);
+    if (!pool)
+        return PJ_ENOMEM;
+
+    htable = pj_hash_create(pool, size);
+    htable2 = pj_hash_create(pool, size);
+    if (!htable || !htable2) {
+        pjsip_endpt_release_pool(mod_tsx_layer.endpt, pool);
+        return PJ_ENOMEM;
+    }
+
+    /* Advance the iterator before reinserting the transaction, since
+     * reinserting reuses the entry that the iterator is standing on.
+     */
+    if (shard->htable) {
+        it = pj_hash_first(shard->htable, &it_buf);
+        while (it) {
+            pjsip_transaction *tsx = (pjsip_transaction*)
+                                     pj_hash_this(shard->htable, it);
+            it = pj_hash_next(shard->htable, it);
+            pj_hash_set_np_lower(htable, tsx->transaction_key.ptr,
+                                 (unsigned)tsx->transaction_key.slen,
+                                 tsx->hashed_key, tsx->hentry, tsx);
+        }
+
+        it = pj_hash_first(shard->htable2, &it_buf);
+        while (it) {
+            pjsip_transaction *tsx = (pjsip_transaction*)
+                                     pj_hash_this(shard->htable2, it);
+            it = pj_hash_next(shard->htable2, it);
+            pj_hash_set_np_lower(htable2, tsx->transaction_key2.ptr,
+                                 (unsigned)tsx->transaction_key2.slen,
+                                 tsx->hashed_key2, tsx->hentry2, tsx);
+        }
+    }
+
+    if (shard->pool)
+        pjsip_endpt_release_pool(mod_tsx_layer.endpt, shard->pool);
+
+    shard->pool = pool;
+    shard->size = size;
+    shard->htable = htable;
+    shard->htable2 = htable2;
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Grow the shard when it holds more than twice as many transactions as
+ * buckets in either table. Must be called with the shard mutex held.
+ */
+static void tsx_shard_check_grow(struct tsx_shard *shard)
+{
+    pj_status_t status;
+
+    /* Do not move the entries while the table is being iterated. */
+    if (mod_tsx_layer.stopping)
+        return;
+
+    if (pj_hash_count(shard->htable) <= 2 * shard->size &&
+        pj_hash_count(shard->htable2) <= 2 * shard->size)
+    {
+        return;
+    }
+
+    status = tsx_shard_rehash(shard, shard->size * 2);
+    if (status != PJ_SUCCESS) {
+        PJ_PERROR(3,(THIS_FILE, status,
+                     "Unable to grow transaction table shard"));
+        return;
+    }
+
+    PJ_LOG(5,(THIS_FILE, "Transaction table shard %p grown to %u buckets",
+              shard, shard->size));
+}
+
+/* Create a shard of the transaction table. */
+static pj_status_t tsx_shard_create(struct tsx_shard *shard, unsigned size)
+{
+    pj_status_t status;
+
+    status = tsx_shard_rehash(shard, size);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    return pj_mutex_create_recursive(mod_tsx_layer.pool, "tsxtbl%p",
+                                     &shard->mutex);
+}
+
+/* Destroy the mutexes and release the pools of the shards. */
+static void tsx_layer_destroy_shards(void)
+{
+    unsigned i;
+
+    for (i = 0; i < PJSIP_TSX_TABLE_SHARD_CNT; ++i) {
+        struct tsx_shard *shard = &mod_tsx_layer.shard[i];
+
+        if (shard->mutex)
+            pj_mutex_destroy(shard->mutex);
+        if (shard->pool)
+            pjsip_endpt_release_pool(mod_tsx_layer.endpt, shard->pool);
+        pj_bzero(shard, sizeof(*shard));
+    }
+}
+
+/* Get the number of transactions in the primary tables of the shards. */
+static unsigned tsx_layer_count(pj_bool_t lock)
+{
+    unsigned i, count = 0;
+
+    for (i = 0; i < PJSIP_TSX_TABLE_SHARD_CNT; ++i) {
+        struct tsx_shard *shard = &mod_tsx_layer.shard[i];
+
+        if (lock)
+            pj_mutex_lock(shard->mutex);
+        count += pj_hash_count(shard->htable);
+        if (lock)
+            pj_mutex_unlock(shard->mutex);
+    }
+
+    return count;
+}
+
 /*
  * Create transaction layer module and registers it to the endpoint.
  */
 PJ_DEF(pj_status_t) pjsip_tsx_layer_init_module(pjsip_endpoint *endpt)
 {
     pj_pool_t *pool;
+    unsigned size, i;
     pj_status_t status;
 
 
@@ -526,21 +681,25 @@ PJ_DEF(pj_status_t) pjsip_tsx_layer_init_module(pjsip_endpoint *endpt)
     /* Initialize some attributes. */
     mod_tsx_layer.pool = pool;
     mod_tsx_layer.endpt = endpt;
+    mod_tsx_layer.stopping = PJ_FALSE;
+    pj_bzero(mod_tsx_layer.shard, sizeof(mod_tsx_layer.shard));
 
 
-    /* Create hash table. */
-    mod_tsx_layer.htable = pj_hash_create( pool, pjsip_cfg()->tsx.max_count );
-    mod_tsx_layer.htable2 = pj_hash_create(pool, pjsip_cfg()->tsx.max_count);
-    if (!mod_tsx_layer.htable || !mod_tsx_layer.htable2) {
-        pjsip_endpt_release_pool(endpt, pool);
-        return PJ_ENOMEM;
-    }
+    /* Create the shards, splitting the configured table size among them.
+     * The size is kept as a power of two so that it matches the number of
+     * buckets created by pj_hash_create().
+     */
+    size = 16;
+    while (size * PJSIP_TSX_TABLE_SHARD_CNT < pjsip_cfg()->tsx.max_count)
+        size <<= 1;
 
-    /* Create group lock. */
-    status = pj_mutex_create_recursive(pool, "tsxlayer", &mod_tsx_layer.mutex);
-    if (status != PJ_SUCCESS) {
-        pjsip_endpt_release_pool(endpt, pool);
-        return status;
+    for (i = 0; i < PJSIP_TSX_TABLE_SHARD_CNT; ++i) {
+        status = tsx_shard_create(&mod_tsx_layer.shard[i], size);
+        if (status != PJ_SUCCESS) {
+            tsx_layer_destroy_shards();
+            pjsip_endpt_release_pool(endpt, pool);
+            return status;
+        }
     }
 
     /*
@@ -548,7 +707,7 @@ PJ_DEF(pj_status_t) pjsip_tsx_layer_init_module(pjsip_endpoint *endpt)
      */
     status = pjsip_endpt_register_module( endpt, &mod_tsx_layer.mod );
     if (status != PJ_SUCCESS) {
-        pj_mutex_destroy(mod_tsx_layer.mutex);
+        tsx_layer_destroy_shards();
         pjsip_endpt_release_pool(endpt, pool);
         return status;
     }
@@ -593,21 +752,25 @@ PJ_DEF(pj_status_t) pjsip_tsx_layer_destroy(void)
  */
 static pj_status_t mod_tsx_layer_register_tsx( pjsip_transaction *tsx)
 {
+    struct tsx_shard *shard;
+
     pj_assert(tsx->transaction_key.slen != 0);
 
+    shard = TSX_SHARD(tsx->hashed_key);
+
     /* Lock hash table mutex. */
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    pj_mutex_lock(shard->mutex);
 
     /* Check if no transaction with the same key exists. 
      * Do not use PJ_ASSERT_RETURN since it evaluates the expression
      * twice!
      */
-    if(pj_hash_get_lower(mod_tsx_layer.htable, 
+    if(pj_hash_get_lower(shard->htable, 
                          tsx->transaction_key.ptr,
                          (unsigned)tsx->transaction_key.slen, 
-                         NULL))
+                         &tsx->hashed_key))
     {
-        pj_mutex_unlock(mod_tsx_layer.mutex);
+        pj_mutex_unlock(shard->mutex);
         PJ_LOG(2,(THIS_FILE, 
                   "Unable to register %.*s transaction (key exists)",
                   (int)tsx->method.name.slen,
@@ -622,32 +785,28 @@ static pj_status_t mod_tsx_layer_register_tsx( pjsip_transaction *tsx)
 
     /* Register the transaction to the hash tables. We register the tsx
      * to the secondary hash table only if it's UAS, for the purpose of
-     * detecting merged requests.
+     * detecting merged requests. The secondary key may belong to another
+     * shard, which is locked separately so that no two shard locks are
+     * ever held together.
      */
-#ifdef PRECALC_HASH
-    pj_hash_set_lower( tsx->pool, mod_tsx_layer.htable,
-                       tsx->transaction_key.ptr,
-                       (unsigned)tsx->transaction_key.slen, 
-                       tsx->hashed_key, tsx);
-    if (tsx->role == PJSIP_ROLE_UAS) {
-        pj_hash_set_lower( tsx->pool, mod_tsx_layer.htable2,
-                           tsx->transaction_key2.ptr,
-                           (unsigned)tsx->transaction_key2.slen,
-                           tsx->hashed_key2, tsx);
-    }
-#else
-    pj_hash_set_lower( tsx->pool, mod_tsx_layer.htable,
-                       tsx->transaction_key.ptr,
-                       tsx->transaction_key.slen, 0, tsx);
-    if (tsx->role == PJSIP_ROLE_UAS) {
-        pj_hash_set_lower( tsx->pool, mod_tsx_layer.htable2,
-                           tsx->transaction_key2.ptr,
-                           tsx->transaction_key2.slen, 0, tsx);
-    }
-#endif
+    pj_hash_set_np_lower(shard->htable, tsx->transaction_key.ptr,
+                         (unsigned)tsx->transaction_key.slen,
+                         tsx->hashed_key, tsx->hentry, tsx);
+    tsx_shard_check_grow(shard);
 
     /* Unlock mutex. */
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    pj_mutex_unlock(shard->mutex);
+
+    if (tsx->role == PJSIP_ROLE_UAS) {
+        shard = TSX_SHARD(tsx->hashed_key2);
+
+        pj_mutex_lock(shard->mutex);
+        pj_hash_set_np_lower(shard->htable2, tsx->transaction_key2.ptr,
+                             (unsigned)tsx->transaction_key2.slen,
+                             tsx->hashed_key2, tsx->hentry2, tsx);
+        tsx_shard_check_grow(shard);
+        pj_mutex_unlock(shard->mutex);
+    }
 
     return PJ_SUCCESS;
 }
@@ -658,6 +817,8 @@ static pj_status_t mod_tsx_layer_register_tsx( pjsip_transaction *tsx)
  */
 static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
 {
+    struct tsx_shard *shard;
+
     if (mod_tsx_layer.mod.id == -1) {
         /* The transaction layer has been unregistered. This could happen
          * if the transaction was pending on transport and the application
@@ -670,29 +831,15 @@ static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
     pj_assert(tsx->transaction_key.slen != 0);
     //pj_assert(tsx->state != PJSIP_TSX_STATE_NULL);
 
+    shard = TSX_SHARD(tsx->hashed_key);
+
     /* Lock hash table mutex. */
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    pj_mutex_lock(shard->mutex);
 
     /* Unregister the transaction from the hash tables. */
-#ifdef PRECALC_HASH
-    pj_hash_set_lower( NULL, mod_tsx_layer.htable, tsx->transaction_key.ptr,
+    pj_hash_set_lower( NULL, shard->htable, tsx->transaction_key.ptr,
                        (unsigned)tsx->transaction_key.slen, tsx->hashed_key,
                        NULL);
-    if (tsx->role == PJSIP_ROLE_UAS) {
-        pj_hash_set_lower(NULL, mod_tsx_layer.htable2,
-                          tsx->transaction_key2.ptr,
-                          (unsigned)tsx->transaction_key2.slen,
-                          tsx->hashed_key2, NULL);
-    }
-#else
-    pj_hash_set_lower( NULL, mod_tsx_layer.htable, tsx->transaction_key.ptr,
-                       tsx->transaction_key.slen, 0, NULL);
-    if (tsx->role == PJSIP_ROLE_UAS) {
-        pj_hash_set_lower(NULL, mod_tsx_layer.htable2,
-                          tsx->transaction_key2.ptr,
-                          tsx->transaction_key2.slen, 0, NULL);
-    }
-#endif
 
     TSX_TRACE_((THIS_FILE, 
                 "Transaction %p unregistered, hkey=0x%p and key=%.*s",
@@ -700,7 +847,18 @@ static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
                 tsx->transaction_key.ptr));
 
     /* Unlock mutex. */
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    pj_mutex_unlock(shard->mutex);
+
+    if (tsx->role == PJSIP_ROLE_UAS) {
+        shard = TSX_SHARD(tsx->hashed_key2);
+
+        pj_mutex_lock(shard->mutex);
+        pj_hash_set_lower(NULL, shard->htable2,
+                          tsx->transaction_key2.ptr,
+                          (unsigned)tsx->transaction_key2.slen,
+                          tsx->hashed_key2, NULL);
+        pj_mutex_unlock(shard->mutex);
+    }
 }
 
 
@@ -710,16 +868,10 @@ static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
  */
 PJ_DEF(unsigned) pjsip_tsx_layer_get_tsx_count(void)
 {
-    unsigned count;
-
     /* Are we registered? */
     PJ_ASSERT_RETURN(mod_tsx_layer.endpt!=NULL, 0);
 
-    pj_mutex_lock(mod_tsx_layer.mutex);
-    count = pj_hash_count(mod_tsx_layer.htable);
-    pj_mutex_unlock(mod_tsx_layer.mutex);
-
-    return count;
+    return tsx_layer_count(PJ_TRUE);
 }
 
 
@@ -730,11 +882,15 @@ static pjsip_transaction* find_tsx( const pj_str_t *key, pj_bool_t lock,
                                     pj_bool_t add_ref )
 {
     pjsip_transaction *tsx;
-    pj_uint32_t hval = 0;
+    pj_uint32_t hval;
+    struct tsx_shard *shard;
+
+    hval = pj_hash_calc_tolower(0, NULL, key);
+    shard = TSX_SHARD(hval);
 
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    pj_mutex_lock(shard->mutex);
     tsx = (pjsip_transaction*)
-          pj_hash_get_lower( mod_tsx_layer.htable, key->ptr, 
+          pj_hash_get_lower( shard->htable, key->ptr, 
                              (unsigned)key->slen, &hval );
     
     /* Prevent the transaction to get deleted before we have chance to lock it.
@@ -742,7 +898,7 @@ static pjsip_transaction* find_tsx( const pj_str_t *key, pj_bool_t lock,
     if (tsx)
         pj_grp_lock_add_ref(tsx->grp_lock);
     
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    pj_mutex_unlock(shard->mutex);
 
     TSX_TRACE_((THIS_FILE, 
                 "Finding tsx with hkey=0x%p and key=%.*s: found %p",
@@ -802,26 +958,40 @@ static pj_status_t mod_tsx_layer_start(void)
 static pj_status_t mod_tsx_layer_stop(void)
 {
     pj_hash_iterator_t it_buf, *it;
+    unsigned i;
 
     PJ_LOG(4,(THIS_FILE, "Stopping transaction layer module"));
 
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    /* Lock all shards, always in the same order, since terminating a
+     * transaction also unregisters it from the shard of its secondary key.
+     */
+    for (i = 0; i < PJSIP_TSX_TABLE_SHARD_CNT; ++i)
+        pj_mutex_lock(mod_tsx_layer.shard[i].mutex);
+
+    mod_tsx_layer.stopping = PJ_TRUE;
 
     /* Destroy all transactions. */
-    it = pj_hash_first(mod_tsx_layer.htable, &it_buf);
-    while (it) {
-        pjsip_transaction *tsx = (pjsip_transaction*) 
-                                 pj_hash_this(mod_tsx_layer.htable, it);
-        pj_hash_iterator_t *next = pj_hash_next(mod_tsx_layer.htable, it);
-        if (tsx) {
-            pjsip_tsx_terminate(tsx, PJSIP_SC_SERVICE_UNAVAILABLE);
-            mod_tsx_layer_unregister_tsx(tsx);
-            tsx_shutdown(tsx);
+    for (i = 0; i < PJSIP_TSX_TABLE_SHARD_CNT; ++i) {
+        pj_hash_table_t *htable = mod_tsx_layer.shard[i].htable;
+
+        it = pj_hash_first(htable, &it_buf);
+        while (it) {
+            pjsip_transaction *tsx = (pjsip_transaction*) 
+                                     pj_hash_this(htable, it);
+            pj_hash_iterator_t *next = pj_hash_next(htable, it);
+            if (tsx) {
+                pjsip_tsx_terminate(tsx, PJSIP_SC_SERVICE_UNAVAILABLE);
+                mod_tsx_layer_unregister_tsx(tsx);
+                tsx_shutdown(tsx);
+            }
+            it = next;
         }
-        it = next;
     }
 
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    mod_tsx_layer.stopping = PJ_FALSE;
+
+    for (i = PJSIP_TSX_TABLE_SHARD_CNT; i > 0; --i)
+        pj_mutex_unlock(mod_tsx_layer.shard[i-1].mutex);
 
     PJ_LOG(4,(THIS_FILE, "Stopped transaction layer module"));
 
@@ -834,8 +1004,8 @@ static void tsx_layer_destroy(pjsip_endpoint *endpt)
 {
     PJ_UNUSED_ARG(endpt);
 
-    /* Destroy mutex. */
-    pj_mutex_destroy(mod_tsx_layer.mutex);
+    /* Destroy the shards. */
+    tsx_layer_destroy_shards();
 
     /* Release pool. */
     pjsip_endpt_release_pool(mod_tsx_layer.endpt, mod_tsx_layer.pool);
@@ -858,7 +1028,7 @@ static pj_status_t mod_tsx_layer_unload(void)
      * crash when the pending transaction finally got error response
      * from transport and when it tries to unregister itself.
      */
-    if (pj_hash_count(mod_tsx_layer.htable) != 0) {
+    if (tsx_layer_count(PJ_FALSE) != 0) {
         pj_status_t status;
         status = pjsip_endpt_atexit(mod_tsx_layer.endpt, &tsx_layer_destroy);
         if (status != PJ_SUCCESS) {
@@ -879,7 +1049,9 @@ PJ_DEF(pjsip_transaction *)
 pjsip_tsx_detect_merged_requests(pjsip_rx_data *rdata)
 {
     pj_str_t key, key2;
-    pj_uint32_t hval = 0;
+    pj_uint32_t hval;
+    struct tsx_shard *shard;
+    pjsip_transaction *tsx;
     pj_status_t status;
 
     PJ_ASSERT_RETURN(rdata->msg_info.msg->type == PJSIP_REQUEST_MSG, NULL);
@@ -898,11 +1070,17 @@ pjsip_tsx_detect_merged_requests(pjsip_rx_data *rdata)
     /* This request must not match any transaction in our primary hash
      * table.
      */
-    if (pj_hash_get_lower(mod_tsx_layer.htable, key.ptr, (unsigned)key.slen,
-                          &hval) != NULL)
-    {
+    hval = pj_hash_calc_tolower(0, NULL, &key);
+    shard = TSX_SHARD(hval);
+
+    pj_mutex_lock(shard->mutex);
+    tsx = (pjsip_transaction*)
+          pj_hash_get_lower(shard->htable, key.ptr, (unsigned)key.slen,
+                            &hval);
+    pj_mutex_unlock(shard->mutex);
+
+    if (tsx != NULL)
         return NULL;
-    }
 
     /* Now check it against our secondary hash table, based on a key that
      * consists of From tag, CSeq, and Call-ID.
@@ -913,11 +1091,16 @@ pjsip_tsx_detect_merged_requests(pjsip_rx_data *rdata)
     if (status != PJ_SUCCESS)
         return NULL;
 
-    hval = 0;
-    return (pjsip_transaction *) pj_hash_get_lower(mod_tsx_layer.htable2,
-                                                   key2.ptr,
-                                                   (unsigned)key2.slen,
-                                                   &hval);
+    hval = pj_hash_calc_tolower(0, NULL, &key2);
+    shard = TSX_SHARD(hval);
+
+    pj_mutex_lock(shard->mutex);
+    tsx = (pjsip_transaction*)
+          pj_hash_get_lower(shard->htable2, key2.ptr, (unsigned)key2.slen,
+                            &hval);
+    pj_mutex_unlock(shard->mutex);
+
+    return tsx;
 }
 
 /* This module callback is called when endpoint has received an
@@ -926,17 +1109,21 @@ pjsip_tsx_detect_merged_requests(pjsip_rx_data *rdata)
 static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
 {
     pj_str_t key;
-    pj_uint32_t hval = 0;
+    pj_uint32_t hval;
+    struct tsx_shard *shard;
     pjsip_transaction *tsx;
 
     pjsip_tsx_create_key(rdata->tp_info.pool, &key, PJSIP_ROLE_UAS,
                          &rdata->msg_info.cseq->method, rdata);
 
     /* Find transaction. */
-    pj_mutex_lock( mod_tsx_layer.mutex );
+    hval = pj_hash_calc_tolower(0, NULL, &key);
+    shard = TSX_SHARD(hval);
+
+    pj_mutex_lock( shard->mutex );
 
     tsx = (pjsip_transaction*) 
-          pj_hash_get_lower( mod_tsx_layer.htable, key.ptr, (unsigned)key.slen, 
+          pj_hash_get_lower( shard->htable, key.ptr, (unsigned)key.slen, 
                              &hval );
 
 
@@ -950,7 +1137,7 @@ static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
          * Reject the request so that endpoint passes the request to
          * upper layer modules.
          */
-        pj_mutex_unlock( mod_tsx_layer.mutex);
+        pj_mutex_unlock( shard->mutex);
         return PJ_FALSE;
     }
 
@@ -962,7 +1149,7 @@ static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
         tsx->method.id == PJSIP_INVITE_METHOD &&
         tsx->status_code/100 == 2)
     {
-        pj_mutex_unlock( mod_tsx_layer.mutex);
+        pj_mutex_unlock( shard->mutex);
         return PJ_FALSE;
     }
 
@@ -972,7 +1159,7 @@ static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
     pj_grp_lock_add_ref(tsx->grp_lock);
     
     /* Unlock hash table. */
-    pj_mutex_unlock( mod_tsx_layer.mutex );
+    pj_mutex_unlock( shard->mutex );
 
     /* Simulate race condition! */
     PJ_RACE_ME(5);
@@ -992,17 +1179,21 @@ static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
 static pj_bool_t mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata)
 {
     pj_str_t key;
-    pj_uint32_t hval = 0;
+    pj_uint32_t hval;
+    struct tsx_shard *shard;
     pjsip_transaction *tsx;
 
     pjsip_tsx_create_key(rdata->tp_info.pool, &key, PJSIP_ROLE_UAC,
                          &rdata->msg_info.cseq->method, rdata);
 
     /* Find transaction. */
-    pj_mutex_lock( mod_tsx_layer.mutex );
+    hval = pj_hash_calc_tolower(0, NULL, &key);
+    shard = TSX_SHARD(hval);
+
+    pj_mutex_lock( shard->mutex );
 
     tsx = (pjsip_transaction*) 
-          pj_hash_get_lower( mod_tsx_layer.htable, key.ptr, (unsigned)key.slen, 
+          pj_hash_get_lower( shard->htable, key.ptr, (unsigned)key.slen, 
                              &hval );
 
 
@@ -1016,7 +1207,7 @@ static pj_bool_t mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata)
          * Reject the request so that endpoint passes the request to
          * upper layer modules.
          */
-        pj_mutex_unlock( mod_tsx_layer.mutex);
+        pj_mutex_unlock( shard->mutex);
         return PJ_FALSE;
     }
 
@@ -1026,7 +1217,7 @@ static pj_bool_t mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata)
     pj_grp_lock_add_ref(tsx->grp_lock);
 
     /* Unlock hash table. */
-    pj_mutex_unlock( mod_tsx_layer.mutex );
+    pj_mutex_unlock( shard->mutex );
 
     /* Simulate race condition! */
     PJ_RACE_ME(5);
@@ -1057,22 +1248,24 @@ PJ_DEF(void) pjsip_tsx_layer_dump(pj_bool_t detail)
 {
 #if PJ_LOG_MAX_LEVEL >= 3
     pj_hash_iterator_t itbuf, *it;
-
-    /* Lock mutex. */
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    unsigned i, count;
 
     PJ_LOG(3, (THIS_FILE, "Dumping transaction table:"));
     PJ_LOG(3, (THIS_FILE, " Total %d transactions", 
-                          pj_hash_count(mod_tsx_layer.htable)));
+                          tsx_layer_count(PJ_TRUE)));
 
     if (detail) {
-        it = pj_hash_first(mod_tsx_layer.htable, &itbuf);
-        if (it == NULL) {
-            PJ_LOG(3, (THIS_FILE, " - none - "));
-        } else {
+        count = 0;
+        for (i = 0; i < PJSIP_TSX_TABLE_SHARD_CNT; ++i) {
+            struct tsx_shard *shard = &mod_tsx_layer.shard[i];
+
+            /* Lock mutex. */
+            pj_mutex_lock(shard->mutex);
+
+            it = pj_hash_first(shard->htable, &itbuf);
             while (it != NULL) {
                 pjsip_transaction *tsx = (pjsip_transaction*) 
-                                         pj_hash_this(mod_tsx_layer.htable,it);
+                                         pj_hash_this(shard->htable, it);
 
                 PJ_LOG(3, (THIS_FILE, " %s %s|%d|%s",
                            tsx->obj_name,
@@ -1082,13 +1275,18 @@ PJ_DEF(void) pjsip_tsx_layer_dump(pj_bool_t detail)
                            tsx->status_code,
                            pjsip_tsx_state_str(tsx->state)));
 
-                it = pj_hash_next(mod_tsx_layer.htable, it);
+                ++count;
+                it = pj_hash_next(shard->htable, it);
             }
+
+            /* Unlock mutex. */
+            pj_mutex_unlock(shard->mutex);
         }
-    }
 
-    /* Unlock mutex. */
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+        if (count == 0) {
+            PJ_LOG(3, (THIS_FILE, " - none - "));
+        }
+    }
 #endif
 }
 
@@ -1597,9 +1795,7 @@ PJ_DEF(pj_status_t) pjsip_tsx_create_uac2(pjsip_module *tsx_user,
                          &via->branch_param);
 
     /* Calculate hashed key value. */
-#ifdef PRECALC_HASH
     tsx->hashed_key = pj_hash_calc_tolower(0, NULL, &tsx->transaction_key);
-#endif
 
     PJ_LOG(6, (tsx->obj_name, "tsx_key=%.*s", (int)tsx->transaction_key.slen,
                tsx->transaction_key.ptr));
@@ -1751,10 +1947,8 @@ PJ_DEF(pj_status_t) pjsip_tsx_create_uas2(pjsip_module *tsx_user,
     }
 
     /* Calculate hashed key value. */
-#ifdef PRECALC_HASH
     tsx->hashed_key = pj_hash_calc_tolower(0, NULL, &tsx->transaction_key);
     tsx->hashed_key2 = pj_hash_calc_tolower(0, NULL, &tsx->transaction_key2);
-#endif
 
     /* Duplicate branch parameter for transaction. */
     branch = &rdata->msg_info.via->branch_param;
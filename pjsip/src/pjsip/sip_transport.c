@@ -127,6 +127,30 @@ typedef struct transport
     pjsip_transport *tp;
 } transport;
 
+/* Kind of pools in pool_cache */
+enum pool_kind
+{
+    POOL_TDATA,
+    POOL_RDATA,
+    POOL_KIND_CNT
+};
+
+#if PJSIP_TPMGR_POOL_CACHE_SIZE
+/* Released pools kept by a thread for reuse. It is only accessed by the
+ * owning thread, except when collecting the statistics and when the
+ * transport manager is destroyed.
+ */
+struct pool_cache
+{
+    PJ_DECL_LIST_MEMBER(struct pool_cache);
+
+    pj_pool_t       *pool[POOL_KIND_CNT][PJSIP_TPMGR_POOL_CACHE_SIZE];
+    unsigned         cnt[POOL_KIND_CNT];
+    pj_uint64_t      hit[POOL_KIND_CNT];
+    pj_uint64_t      miss[POOL_KIND_CNT];
+};
+#endif
+
 /*
  * Transport manager.
  */
@@ -153,6 +177,14 @@ struct pjsip_tpmgr
 
     /* List of free transport entry. */
     transport        tp_entry_freelist;
+
+#if PJSIP_TPMGR_POOL_CACHE_SIZE
+    /* Thread local pool_cache of the calling thread, and the list of
+     * pool_cache of all threads.
+     */
+    long             pool_cache_tls;
+    struct pool_cache pool_cache_list;
+#endif
 };
 
 
@@ -472,6 +504,68 @@ PJ_DEF(void) pjsip_tpselector_dec_ref(pjsip_tpselector *sel)
  *
  *****************************************************************************/
 
+#if PJSIP_TPMGR_POOL_CACHE_SIZE
+/* Get the pool_cache of the calling thread, creating it if needed. */
+static struct pool_cache *get_pool_cache(pjsip_tpmgr *mgr)
+{
+    struct pool_cache *cache;
+
+    cache = (struct pool_cache*) pj_thread_local_get(mgr->pool_cache_tls);
+    if (cache == NULL) {
+        pj_lock_acquire(mgr->lock);
+        cache = PJ_POOL_ZALLOC_T(mgr->pool, struct pool_cache);
+        pj_list_push_back(&mgr->pool_cache_list, cache);
+        pj_lock_release(mgr->lock);
+
+        pj_thread_local_set(mgr->pool_cache_tls, cache);
+    }
+
+    return cache;
+}
+#endif
+
+/* Take a released pool of the calling thread. Returns NULL if there is
+ * none, and the caller must create a new pool.
+ */
+static pj_pool_t *take_cached_pool(pjsip_tpmgr *mgr, int kind)
+{
+#if PJSIP_TPMGR_POOL_CACHE_SIZE
+    struct pool_cache *cache = get_pool_cache(mgr);
+
+    if (cache->cnt[kind]) {
+        ++cache->hit[kind];
+        return cache->pool[kind][--cache->cnt[kind]];
+    }
+    ++cache->miss[kind];
+#else
+    PJ_UNUSED_ARG(mgr);
+    PJ_UNUSED_ARG(kind);
+#endif
+
+    return NULL;
+}
+
+/* Keep the pool for reuse by the calling thread, or release it if the
+ * thread has enough pools already.
+ */
+static void release_cached_pool(pjsip_tpmgr *mgr, int kind, pj_pool_t *pool)
+{
+#if PJSIP_TPMGR_POOL_CACHE_SIZE
+    struct pool_cache *cache = get_pool_cache(mgr);
+
+    if (cache->cnt[kind] < PJSIP_TPMGR_POOL_CACHE_SIZE) {
+        pj_pool_reset(pool);
+        cache->pool[kind][cache->cnt[kind]++] = pool;
+        return;
+    }
+#else
+    PJ_UNUSED_ARG(mgr);
+    PJ_UNUSED_ARG(kind);
+#endif
+
+    pj_pool_release(pool);
+}
+
 /*
  * Create new transmit buffer.
  */
@@ -484,11 +578,14 @@ PJ_DEF(pj_status_t) pjsip_tx_data_create( pjsip_tpmgr *mgr,
 
     PJ_ASSERT_RETURN(mgr && p_tdata, PJ_EINVAL);
 
-    pool = pjsip_endpt_create_pool( mgr->endpt, "tdta%p",
-                                    PJSIP_POOL_LEN_TDATA,
-                                    PJSIP_POOL_INC_TDATA );
-    if (!pool)
-        return PJ_ENOMEM;
+    pool = take_cached_pool(mgr, POOL_TDATA);
+    if (!pool) {
+        pool = pjsip_endpt_create_pool( mgr->endpt, "tdta%p",
+                                        PJSIP_POOL_LEN_TDATA,
+                                        PJSIP_POOL_INC_TDATA );
+        if (!pool)
+            return PJ_ENOMEM;
+    }
 
     tdata = PJ_POOL_ZALLOC_T(pool, pjsip_tx_data);
     tdata->pool = pool;
@@ -554,7 +651,7 @@ static void tx_data_destroy(pjsip_tx_data *tdata)
 
     pj_atomic_destroy( tdata->ref_cnt );
     pj_lock_destroy( tdata->lock );
-    pjsip_endpt_release_pool( tdata->mgr->endpt, tdata->pool );
+    release_cached_pool( tdata->mgr, POOL_TDATA, tdata->pool );
 }
 
 /*
@@ -585,6 +682,49 @@ PJ_DEF(void) pjsip_tx_data_invalidate_msg( pjsip_tx_data *tdata )
 {
     tdata->buf.cur = tdata->buf.start;
     tdata->info = NULL;
+    tdata->print_cache.buf = NULL;
+}
+
+/*
+ * Invalidate a header, to be re-printed with the start line and the body
+ * when the message is sent.
+ */
+PJ_DEF(void) pjsip_tx_data_invalidate_hdr( pjsip_tx_data *tdata,
+                                           const void *hdr )
+{
+    pjsip_msg_print_cache *cache = &tdata->print_cache;
+    unsigned i;
+
+    for (i=0; i<cache->cnt; ++i) {
+        if (cache->pos[i].hdr == hdr) {
+            cache->pos[i].len = 0;
+            break;
+        }
+    }
+
+    tdata->buf.cur = tdata->buf.start;
+    tdata->info = NULL;
+}
+
+/* Make room in the print cache for all headers of the message. */
+static void init_print_cache(pjsip_tx_data *tdata)
+{
+    pjsip_msg_print_cache *cache = &tdata->print_cache;
+    const pjsip_hdr *hdr;
+    unsigned cnt = 0;
+
+    for (hdr=tdata->msg->hdr.next; hdr!=&tdata->msg->hdr; hdr=hdr->next)
+        ++cnt;
+
+    if (cnt > cache->max) {
+        /* Leave room for a few more headers, e.g. Authorization */
+        cache->max = cnt + 4;
+        cache->pos = (pjsip_hdr_print_pos*)
+                     pj_pool_alloc(tdata->pool,
+                                   cache->max * sizeof(pjsip_hdr_print_pos));
+        cache->buf = NULL;
+        cache->cnt = 0;
+    }
 }
 
 /*
@@ -611,13 +751,41 @@ PJ_DEF(pj_status_t) pjsip_tx_data_encode(pjsip_tx_data *tdata)
 
     /* Do we need to reprint? */
     if (!pjsip_tx_data_is_valid(tdata)) {
+        pj_size_t buf_size = tdata->buf.end - tdata->buf.start;
         pj_ssize_t size;
 
-        size = pjsip_msg_print( tdata->msg, tdata->buf.start, 
-                                tdata->buf.end - tdata->buf.start);
-        if (size < 0) {
-            return PJSIP_EMSGTOOLONG;
+        init_print_cache(tdata);
+
+        if (tdata->print_cache.buf == tdata->buf.start) {
+            char *printed;
+
+            /* The headers in the buffer are still good, print to the
+             * spare buffer and swap.
+             */
+            if (tdata->spare_buf == NULL) {
+                tdata->spare_buf = (char*)
+                                   pj_pool_alloc(tdata->pool, buf_size);
+            }
+
+            size = pjsip_msg_print2(tdata->msg, tdata->spare_buf, buf_size,
+                                    &tdata->print_cache);
+            if (size < 0) {
+                return PJSIP_EMSGTOOLONG;
+            }
+
+            printed = tdata->spare_buf;
+            tdata->spare_buf = tdata->buf.start;
+            tdata->buf.start = tdata->buf.cur = printed;
+            tdata->buf.end = printed + buf_size;
+
+        } else {
+            size = pjsip_msg_print2(tdata->msg, tdata->buf.start, buf_size,
+                                    &tdata->print_cache);
+            if (size < 0) {
+                return PJSIP_EMSGTOOLONG;
+            }
         }
+
         pj_assert(size != 0);
         tdata->buf.cur[size] = '\0';
         tdata->buf.cur += size;
@@ -783,13 +951,16 @@ PJ_DEF(pj_status_t) pjsip_rx_data_clone( const pjsip_rx_data *src,
 
     PJ_ASSERT_RETURN(src && flags==0 && p_rdata, PJ_EINVAL);
 
-    pool = pj_pool_create(src->tp_info.pool->factory,
-                          "rtd%p",
-                          PJSIP_POOL_RDATA_LEN,
-                          PJSIP_POOL_RDATA_INC,
-                          NULL);
-    if (!pool)
-        return PJ_ENOMEM;
+    pool = take_cached_pool(src->tp_info.transport->tpmgr, POOL_RDATA);
+    if (!pool) {
+        pool = pj_pool_create(src->tp_info.pool->factory,
+                              "rtd%p",
+                              PJSIP_POOL_RDATA_LEN,
+                              PJSIP_POOL_RDATA_INC,
+                              NULL);
+        if (!pool)
+            return PJ_ENOMEM;
+    }
 
     dst = PJ_POOL_ZALLOC_T(pool, pjsip_rx_data);
 
@@ -848,10 +1019,14 @@ PJ_DEF(pj_status_t) pjsip_rx_data_clone( const pjsip_rx_data *src,
 /* Free previously cloned pjsip_rx_data. */
 PJ_DEF(pj_status_t) pjsip_rx_data_free_cloned(pjsip_rx_data *rdata)
 {
+    pjsip_tpmgr *mgr;
+
     PJ_ASSERT_RETURN(rdata, PJ_EINVAL);
 
+    /* Transport may be destroyed after dec_ref */
+    mgr = rdata->tp_info.transport->tpmgr;
     pjsip_transport_dec_ref(rdata->tp_info.transport);
-    pj_pool_release(rdata->tp_info.pool);
+    release_cached_pool(mgr, POOL_RDATA, rdata->tp_info.pool);
 
     return PJ_SUCCESS;
 }
@@ -1635,6 +1810,15 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_create( pj_pool_t *pool,
     if (status != PJ_SUCCESS)
         return status;
 
+#if PJSIP_TPMGR_POOL_CACHE_SIZE
+    pj_list_init(&mgr->pool_cache_list);
+    status = pj_thread_local_alloc(&mgr->pool_cache_tls);
+    if (status != PJ_SUCCESS) {
+        pj_lock_destroy(mgr->lock);
+        return status;
+    }
+#endif
+
     for (; i < PJSIP_TRANSPORT_ENTRY_ALLOC_CNT; ++i) {
         transport *tp_add = NULL;
 
@@ -1901,6 +2085,38 @@ PJ_DEF(unsigned) pjsip_tpmgr_get_transport_count(pjsip_tpmgr *mgr)
     return nr_of_transports;
 }
 
+/*
+ * Get the statistics of the tdata and rdata pool reuse.
+ */
+PJ_DEF(pj_status_t) pjsip_tpmgr_get_pool_stat(pjsip_tpmgr *mgr,
+                                              pjsip_tpmgr_pool_stat *stat)
+{
+    PJ_ASSERT_RETURN(mgr && stat, PJ_EINVAL);
+
+    pj_bzero(stat, sizeof(*stat));
+
+#if PJSIP_TPMGR_POOL_CACHE_SIZE
+    pj_lock_acquire(mgr->lock);
+    {
+        struct pool_cache *cache = mgr->pool_cache_list.next;
+
+        /* The counters are updated by their threads without lock, so the
+         * values may be slightly behind.
+         */
+        while (cache != &mgr->pool_cache_list) {
+            stat->tdata_hit += cache->hit[POOL_TDATA];
+            stat->tdata_miss += cache->miss[POOL_TDATA];
+            stat->rdata_hit += cache->hit[POOL_RDATA];
+            stat->rdata_miss += cache->miss[POOL_RDATA];
+            cache = cache->next;
+        }
+    }
+    pj_lock_release(mgr->lock);
+#endif
+
+    return PJ_SUCCESS;
+}
+
 /*
  * pjsip_tpmgr_destroy()
  *
@@ -1971,6 +2187,24 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_destroy( pjsip_tpmgr *mgr )
     pj_atomic_destroy(mgr->tdata_counter);
 #endif
 
+#if PJSIP_TPMGR_POOL_CACHE_SIZE
+    /* Release the pools kept by all threads */
+    {
+        struct pool_cache *cache = mgr->pool_cache_list.next;
+
+        while (cache != &mgr->pool_cache_list) {
+            unsigned kind;
+
+            for (kind = 0; kind < POOL_KIND_CNT; ++kind) {
+                while (cache->cnt[kind])
+                    pj_pool_release(cache->pool[kind][--cache->cnt[kind]]);
+            }
+            cache = cache->next;
+        }
+        pj_thread_local_free(mgr->pool_cache_tls);
+    }
+#endif
+
     pj_lock_destroy(mgr->lock);
 
     /* Unregister mod_msg_print. */
@@ -2187,8 +2421,8 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
         current_pkt[msg_fragment_size] = '\0';
 
         /* Parse the message. */
-        rdata->msg_info.msg = msg = 
-            pjsip_parse_rdata( current_pkt, msg_fragment_size, rdata);
+        pjsip_parse_rdata2( current_pkt, msg_fragment_size, rdata);
+        msg = rdata->msg_info.msg;
 
         /* Restore null termination */
         current_pkt[msg_fragment_size] = saved;
@@ -21,6 +21,8 @@
 #include <pjsip/sip_errno.h>
 #include <pj/addr_resolv.h>
 #include <pj/assert.h>
+#include <pj/hash.h>
+#include <pj/ioqueue.h>
 #include <pj/lock.h>
 #include <pj/log.h>
 #include <pj/os.h>
@@ -64,6 +66,39 @@
 #   define PJSIP_UDP_SO_RCVBUF_SIZE     0
 #endif
 
+/**
+ * Number of entries in the table that remembers which socket received
+ * the last packet from a remote address, when the transport has more
+ * than one SO_REUSEPORT socket. Must be a power of two.
+ */
+#ifndef PJSIP_UDP_FLOW_TABLE_SIZE
+#   define PJSIP_UDP_FLOW_TABLE_SIZE    1024
+#endif
+
+/* Maximum number of SO_REUSEPORT sockets in one transport */
+#define MAX_REUSEPORT_CNT       64
+
+
+struct udp_transport;
+
+/* Additional SO_REUSEPORT socket, polled by its own ioqueue and thread */
+struct udp_port
+{
+    struct udp_transport *tp;
+    pj_sock_t           sock;
+    pj_ioqueue_t       *ioqueue;
+    pj_ioqueue_key_t   *key;
+    pj_thread_t        *thread;
+    pj_timer_entry      reap_timer;
+    int                 read_loop_spin;
+};
+
+/* Packet counters of a socket */
+struct udp_sock_stat
+{
+    pj_atomic_t        *rx_cnt;
+    pj_atomic_t        *tx_cnt;
+};
 
 /* Struct udp_transport "inherits" struct pjsip_transport */
 struct udp_transport
@@ -79,6 +114,30 @@ struct udp_transport
 
     /* Group lock to be used by UDP transport and ioqueue key */
     pj_grp_lock_t      *grp_lock;
+
+    /* Number of rdata for each socket */
+    int                 async_cnt;
+
+    /* Additional sockets bound to the same address with SO_REUSEPORT.
+     * Socket index 0 is the main socket, index n is ports[n-1].
+     */
+    unsigned            port_cnt;
+    struct udp_port    *ports;
+    pj_bool_t           ports_quit;
+
+    /* Socket index + 1 where the last packet from the remote address
+     * was received, in the low 8 bits, and the upper bits of the hash of
+     * the address in the other bits.
+     */
+    pj_uint32_t        *flow_tbl;
+
+    /* Packet counters, one for each socket index */
+    struct udp_sock_stat *sock_stat;
+
+#if PJSIP_UDP_RX_BATCH > 1
+    /* Batch read packets, PJSIP_UDP_RX_BATCH for each rdata */
+    pj_sock_mmsg       *rx_batch;
+#endif
 };
 
 
@@ -111,6 +170,99 @@ static void init_rdata(struct udp_transport *tp, unsigned rdata_index,
 }
 
 
+/* Get the ioqueue key of the socket with the specified index */
+static pj_ioqueue_key_t *get_sock_key(struct udp_transport *tp,
+                                      unsigned sock_idx)
+{
+    return (sock_idx == 0) ? tp->key : tp->ports[sock_idx-1].key;
+}
+
+#if PJSIP_UDP_RX_BATCH > 1
+/* Get the socket with the specified index */
+static pj_sock_t get_sock(struct udp_transport *tp, unsigned sock_idx)
+{
+    return (sock_idx == 0) ? tp->sock : tp->ports[sock_idx-1].sock;
+}
+#endif
+
+/* Get the ioqueue key of the socket where the rdata is reading */
+static pj_ioqueue_key_t *get_rdata_key(struct udp_transport *tp,
+                                       unsigned rdata_index)
+{
+    return get_sock_key(tp, rdata_index / tp->async_cnt);
+}
+
+/* Get the read loop counter of the socket where the rdata is reading.
+ * Each additional socket is polled by its own thread, so it has its own
+ * counter.
+ */
+static int *get_read_loop_spin(struct udp_transport *tp,
+                               unsigned rdata_index)
+{
+    unsigned sock_idx = rdata_index / tp->async_cnt;
+
+    return (sock_idx == 0) ? &tp->read_loop_spin :
+                             &tp->ports[sock_idx-1].read_loop_spin;
+}
+
+/* Check whether any udp_on_read_complete() loop is still running */
+static pj_bool_t is_read_loop_spinning(struct udp_transport *tp)
+{
+    unsigned i;
+
+    if (tp->read_loop_spin)
+        return PJ_TRUE;
+
+    for (i=0; i<tp->port_cnt; ++i) {
+        if (tp->ports[i].read_loop_spin)
+            return PJ_TRUE;
+    }
+
+    return PJ_FALSE;
+}
+
+static pj_uint32_t flow_hash(const pj_sockaddr_t *addr)
+{
+    pj_uint16_t port = pj_sockaddr_get_port(addr);
+    pj_uint32_t hval;
+
+    hval = pj_hash_calc(0, pj_sockaddr_get_addr(addr),
+                        pj_sockaddr_get_addr_len(addr));
+    return pj_hash_calc(hval, &port, sizeof(port));
+}
+
+/* Remember the socket where a packet from the address was received */
+static void flow_update(struct udp_transport *tp,
+                        const pj_sockaddr_t *src_addr,
+                        unsigned sock_idx)
+{
+    pj_uint32_t hval = flow_hash(src_addr);
+
+    tp->flow_tbl[hval & (PJSIP_UDP_FLOW_TABLE_SIZE-1)] =
+        (hval & ~0xFF) | (sock_idx + 1);
+}
+
+/* Select the socket index to send to the address: the one where the
+ * flow is being received, or a socket selected by the hash of the address
+ * for new flows.
+ */
+static unsigned flow_get_sock(struct udp_transport *tp,
+                              const pj_sockaddr_t *rem_addr)
+{
+    pj_uint32_t hval, entry;
+
+    if (tp->port_cnt == 0)
+        return 0;
+
+    hval = flow_hash(rem_addr);
+    entry = tp->flow_tbl[hval & (PJSIP_UDP_FLOW_TABLE_SIZE-1)];
+    if ((entry & 0xFF) != 0 && (entry & ~0xFF) == (hval & ~0xFF))
+        return (entry & 0xFF) - 1;
+
+    return hval % (tp->port_cnt + 1);
+}
+
+
 /*
  * udp_on_read_complete()
  *
@@ -126,10 +278,18 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
     pjsip_rx_data_op_key *rdata_op_key = (pjsip_rx_data_op_key*) op_key;
     pjsip_rx_data *rdata = rdata_op_key->rdata;
     struct udp_transport *tp = (struct udp_transport*)rdata->tp_info.transport;
+    unsigned rdata_index = (unsigned)(unsigned long)(pj_ssize_t)
+                           rdata->tp_info.tp_data;
+    int *read_loop_spin = get_read_loop_spin(tp, rdata_index);
     int i;
     pj_status_t status;
+#if PJSIP_UDP_RX_BATCH > 1
+    pj_sock_mmsg *batch = &tp->rx_batch[rdata_index * PJSIP_UDP_RX_BATCH];
+    unsigned batch_cnt = 0, batch_idx = 0;
+    pj_bool_t drained = PJ_FALSE;
+#endif
 
-    ++tp->read_loop_spin;
+    ++*read_loop_spin;
 
     /* Don't do anything if transport is closing. */
     if (tp->is_closing) {
@@ -144,7 +304,7 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
     if (-bytes_read == PJ_ESOCKETSTOP) {
 #if 0
         /* Auto restart is disabled, see #2881 */
-        --tp->read_loop_spin;
+        --*read_loop_spin;
         /* Try to recover by restarting the transport. */
         PJ_LOG(4,(tp->base.obj_name, "Restarting SIP UDP transport"));
         status = pjsip_udp_transport_restart2(
@@ -173,6 +333,7 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
     for (i=0;; ++i) {
         enum { MIN_SIZE = 32 };
         pj_uint32_t flags;
+        unsigned sock_idx;
 
         /* Report the packet to transport manager. Only do so if packet size
          * is relatively big enough for a SIP packet.
@@ -189,6 +350,13 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
                               sizeof(rdata->pkt_info.src_name), 0);
             rdata->pkt_info.src_port = pj_sockaddr_get_port(src_addr);
 
+            sock_idx = rdata_index / tp->async_cnt;
+            pj_atomic_inc(tp->sock_stat[sock_idx].rx_cnt);
+
+            /* Responses to this address will be sent from this socket */
+            if (tp->port_cnt)
+                flow_update(tp, src_addr, sock_idx);
+
             size_eaten = 
                 pjsip_tpmgr_receive_packet(rdata->tp_info.transport->tpmgr, 
                                            rdata);
@@ -232,11 +400,8 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
         {
             pj_pool_t *rdata_pool = rdata->tp_info.pool;
             struct udp_transport *rdata_tp ;
-            unsigned rdata_index;
 
             rdata_tp = (struct udp_transport*)rdata->tp_info.transport;
-            rdata_index = (unsigned)(unsigned long)(pj_ssize_t)
-                          rdata->tp_info.tp_data;
 
             pj_pool_reset(rdata_pool);
             init_rdata(rdata_tp, rdata_index, rdata_pool, &rdata);
@@ -254,6 +419,43 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
         if (tp->is_paused)
             break;
 
+#if PJSIP_UDP_RX_BATCH > 1
+        /* Read the packets already queued in the socket with a single
+         * call, and process them before reading from the ioqueue again.
+         * Once the socket is drained, wait for the next packet
+         * asynchronously instead of trying another read.
+         */
+        if (batch_idx == batch_cnt && !drained && flags == 0) {
+            unsigned j;
+
+            for (j=0; j<PJSIP_UDP_RX_BATCH; ++j)
+                batch[j].len = PJSIP_MAX_PKT_LEN;
+
+            batch_cnt = PJSIP_UDP_RX_BATCH;
+            batch_idx = 0;
+            status = pj_sock_recvmmsg(get_sock(tp, rdata_index /
+                                                   tp->async_cnt),
+                                      batch, &batch_cnt, 0);
+            /* Errors will be reported by the next ioqueue read */
+            if (status != PJ_SUCCESS)
+                batch_cnt = 0;
+            drained = (batch_cnt < PJSIP_UDP_RX_BATCH);
+        }
+
+        if (batch_idx < batch_cnt) {
+            pj_sock_mmsg *pkt = &batch[batch_idx++];
+
+            pj_memcpy(rdata->pkt_info.packet, pkt->buf, pkt->len);
+            rdata->pkt_info.src_addr = pkt->addr;
+            rdata->pkt_info.src_addr_len = pkt->addr_len;
+            bytes_read = pkt->len;
+            continue;
+        }
+
+        if (drained)
+            flags = PJ_IOQUEUE_ALWAYS_ASYNC;
+#endif
+
         /* Read next packet. */
         bytes_read = sizeof(rdata->pkt_info.packet);
         rdata->pkt_info.src_addr_len = sizeof(rdata->pkt_info.src_addr);
@@ -306,7 +508,7 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
     }
 
 on_return:
-    --tp->read_loop_spin;
+    --*read_loop_spin;
 }
 
 /*
@@ -365,6 +567,7 @@ static pj_status_t udp_send_msg( pjsip_transport *transport,
                                  pjsip_transport_callback callback)
 {
     struct udp_transport *tp = (struct udp_transport*)transport;
+    unsigned sock_idx;
     pj_ssize_t size;
     pj_status_t status;
 
@@ -382,10 +585,15 @@ static pj_status_t udp_send_msg( pjsip_transport *transport,
 
     /* Send to ioqueue! */
     size = tdata->buf.cur - tdata->buf.start;
-    status = pj_ioqueue_sendto(tp->key, (pj_ioqueue_op_key_t*)&tdata->op_key,
+    sock_idx = flow_get_sock(tp, rem_addr);
+    status = pj_ioqueue_sendto(get_sock_key(tp, sock_idx),
+                               (pj_ioqueue_op_key_t*)&tdata->op_key,
                                tdata->buf.start, &size, 0,
                                rem_addr, addr_len);
 
+    if (status == PJ_SUCCESS || status == PJ_EPENDING)
+        pj_atomic_inc(tp->sock_stat[sock_idx].tx_cnt);
+
     if (status != PJ_EPENDING) {
 #if 0
         /* Auto restart is disabled, see #2881 */
@@ -416,6 +624,7 @@ static pj_status_t udp_send_msg( pjsip_transport *transport,
 static void udp_on_destroy(void *arg)
 {
     struct udp_transport *tp = (struct udp_transport*)arg;
+    unsigned j;
     int i;
 
     /* Destroy rdata */
@@ -423,6 +632,14 @@ static void udp_on_destroy(void *arg)
         pj_pool_release(tp->rdata[i]->tp_info.pool);
     }
 
+    /* Destroy packet counters */
+    for (j=0; tp->sock_stat && j<=tp->port_cnt; ++j) {
+        if (tp->sock_stat[j].rx_cnt)
+            pj_atomic_destroy(tp->sock_stat[j].rx_cnt);
+        if (tp->sock_stat[j].tx_cnt)
+            pj_atomic_destroy(tp->sock_stat[j].tx_cnt);
+    }
+
     /* Destroy reference counter. */
     if (tp->base.ref_cnt)
         pj_atomic_destroy(tp->base.ref_cnt);
@@ -438,6 +655,100 @@ static void udp_on_destroy(void *arg)
 }
 
 
+/* Join the thread of an additional socket that has destroyed the
+ * transport, and destroy its ioqueue.
+ */
+static void udp_port_reap(pj_timer_heap_t *timer_heap, pj_timer_entry *e)
+{
+    struct udp_port *port = (struct udp_port*)e->user_data;
+    pj_grp_lock_t *grp_lock = port->tp->base.grp_lock;
+
+    PJ_UNUSED_ARG(timer_heap);
+
+    pj_thread_join(port->thread);
+    pj_thread_destroy(port->thread);
+    port->thread = NULL;
+
+    pj_ioqueue_destroy(port->ioqueue);
+    port->ioqueue = NULL;
+
+    pj_grp_lock_dec_ref(grp_lock);
+}
+
+/* Close the additional sockets, keeping their ioqueues and threads */
+static void close_ports(struct udp_transport *tp)
+{
+    unsigned i;
+
+    for (i=0; i<tp->port_cnt; ++i) {
+        struct udp_port *port = &tp->ports[i];
+
+        if (port->key) {
+            /* This implicitly closes the socket */
+            pj_ioqueue_unregister(port->key);
+            port->key = NULL;
+        } else if (port->sock != PJ_INVALID_SOCKET) {
+            pj_sock_close(port->sock);
+        }
+        port->sock = PJ_INVALID_SOCKET;
+    }
+}
+
+/* Stop the threads and close the additional sockets */
+static void destroy_ports(struct udp_transport *tp)
+{
+    unsigned i;
+
+    tp->ports_quit = PJ_TRUE;
+
+    for (i=0; i<tp->port_cnt; ++i) {
+        struct udp_port *port = &tp->ports[i];
+
+        if (!port->thread)
+            continue;
+
+        if (port->thread == pj_thread_this()) {
+            /* The transport is destroyed from a callback called by this
+             * thread, which can neither join itself nor destroy the
+             * ioqueue it is polling. Let the endpoint do it once the
+             * thread has quit, keeping the transport alive until then.
+             */
+            pj_time_val delay = {0, 0};
+            pj_status_t status;
+
+            pj_grp_lock_add_ref(tp->grp_lock);
+            pj_timer_entry_init(&port->reap_timer, 0, port, &udp_port_reap);
+            status = pjsip_endpt_schedule_timer(tp->base.endpt,
+                                                &port->reap_timer, &delay);
+            if (status != PJ_SUCCESS) {
+                PJ_PERROR(2,(tp->base.obj_name, status,
+                             "Unable to schedule port thread cleanup"));
+                pj_grp_lock_dec_ref(tp->grp_lock);
+            }
+            continue;
+        }
+
+        pj_thread_join(port->thread);
+        pj_thread_destroy(port->thread);
+        port->thread = NULL;
+    }
+
+    close_ports(tp);
+
+    for (i=0; i<tp->port_cnt; ++i) {
+        struct udp_port *port = &tp->ports[i];
+
+        /* The ioqueue of a thread that is still running is destroyed by
+         * udp_port_reap().
+         */
+        if (port->ioqueue && !port->thread) {
+            pj_ioqueue_destroy(port->ioqueue);
+            port->ioqueue = NULL;
+        }
+    }
+}
+
+
 /*
  * udp_destroy()
  *
@@ -464,6 +775,11 @@ static pj_status_t udp_destroy( pjsip_transport *transport )
     }
     */
 
+    /* Stop the additional sockets first, their threads may be using
+     * the transport.
+     */
+    destroy_ports(tp);
+
     /* Unregister from ioqueue. */
     if (tp->key) {
         pj_ioqueue_unregister(tp->key);
@@ -526,7 +842,8 @@ static pj_status_t udp_shutdown(pjsip_transport *transport)
 
 /* Create socket */
 static pj_status_t create_socket(int af, const pj_sockaddr_t *local_a,
-                                 int addr_len, pj_sock_t *p_sock)
+                                 int addr_len, pj_bool_t reuseport,
+                                 pj_sock_t *p_sock)
 {
     pj_sock_t sock;
     pj_sockaddr_in tmp_addr;
@@ -550,6 +867,17 @@ static pj_status_t create_socket(int af, const pj_sockaddr_t *local_a,
         }
     }
 
+    if (reuseport) {
+        int enabled = 1;
+
+        status = pj_sock_setsockopt(sock, pj_SOL_SOCKET(), pj_SO_REUSEPORT(),
+                                    &enabled, sizeof(enabled));
+        if (status != PJ_SUCCESS) {
+            pj_sock_close(sock);
+            return status;
+        }
+    }
+
     status = pj_sock_bind(sock, local_a, addr_len);
     if (status != PJ_SUCCESS) {
         pj_sock_close(sock);
@@ -739,11 +1067,12 @@ static pj_status_t start_async_read(struct udp_transport *tp)
 
     /* Start reading the ioqueue. */
     for (i=0; i<tp->rdata_cnt; ++i) {
+        pj_ioqueue_key_t *key = get_rdata_key(tp, i);
         pj_ssize_t size;
 
         size = sizeof(tp->rdata[i]->pkt_info.packet);
         tp->rdata[i]->pkt_info.src_addr_len = sizeof(tp->rdata[i]->pkt_info.src_addr);
-        status = pj_ioqueue_recvfrom(tp->key, 
+        status = pj_ioqueue_recvfrom(key, 
                                      &tp->rdata[i]->tp_info.op_key.op_key,
                                      tp->rdata[i]->pkt_info.packet,
                                      &size, PJ_IOQUEUE_ALWAYS_ASYNC,
@@ -751,7 +1080,7 @@ static pj_status_t start_async_read(struct udp_transport *tp)
                                      &tp->rdata[i]->pkt_info.src_addr_len);
         if (status == PJ_SUCCESS) {
             pj_assert(!"Shouldn't happen because PJ_IOQUEUE_ALWAYS_ASYNC!");
-            udp_on_read_complete(tp->key, &tp->rdata[i]->tp_info.op_key.op_key,
+            udp_on_read_complete(key, &tp->rdata[i]->tp_info.op_key.op_key,
                                  size);
         } else if (status != PJ_EPENDING) {
             /* Error! */
@@ -763,6 +1092,73 @@ static pj_status_t start_async_read(struct udp_transport *tp)
 }
 
 
+/* Register the additional sockets, each to its own ioqueue. The ioqueue
+ * is kept when the sockets are recreated by transport restart.
+ */
+static pj_status_t register_ports(struct udp_transport *tp)
+{
+    pj_ioqueue_callback ioqueue_cb;
+    unsigned i;
+    pj_status_t status;
+
+    pj_memset(&ioqueue_cb, 0, sizeof(ioqueue_cb));
+    ioqueue_cb.on_read_complete = &udp_on_read_complete;
+    ioqueue_cb.on_write_complete = &udp_on_write_complete;
+
+    for (i=0; i<tp->port_cnt; ++i) {
+        struct udp_port *port = &tp->ports[i];
+
+        /* Ignore if already registered */
+        if (port->key != NULL)
+            continue;
+
+        if (port->ioqueue == NULL) {
+            status = pj_ioqueue_create(tp->base.pool, 2, &port->ioqueue);
+            if (status != PJ_SUCCESS)
+                return status;
+        }
+
+        status = pj_ioqueue_register_sock2(tp->base.pool, port->ioqueue,
+                                           port->sock, tp->grp_lock, tp,
+                                           &ioqueue_cb, &port->key);
+        if (status != PJ_SUCCESS)
+            return status;
+    }
+
+    return PJ_SUCCESS;
+}
+
+/* Thread to poll the ioqueue of an additional socket */
+static int udp_port_thread(void *arg)
+{
+    struct udp_port *port = (struct udp_port*)arg;
+
+    while (!port->tp->ports_quit) {
+        pj_time_val timeout = {0, 100};
+        pj_ioqueue_poll(port->ioqueue, &timeout);
+    }
+
+    return 0;
+}
+
+/* Start the threads of the additional sockets */
+static pj_status_t start_port_threads(struct udp_transport *tp)
+{
+    unsigned i;
+    pj_status_t status;
+
+    for (i=0; i<tp->port_cnt; ++i) {
+        status = pj_thread_create(tp->base.pool, "udprp%p",
+                                  &udp_port_thread, &tp->ports[i], 0, 0,
+                                  &tp->ports[i].thread);
+        if (status != PJ_SUCCESS)
+            return status;
+    }
+
+    return PJ_SUCCESS;
+}
+
+
 /*
  * pjsip_udp_transport_attach()
  *
@@ -771,6 +1167,8 @@ static pj_status_t start_async_read(struct udp_transport *tp)
 static pj_status_t transport_attach( pjsip_endpoint *endpt,
                                      pjsip_transport_type_e type,
                                      pj_sock_t sock,
+                                     const pj_sock_t port_socks[],
+                                     unsigned port_cnt,
                                      const pjsip_host_port *a_name,
                                      unsigned async_cnt,
                                      pjsip_transport **p_transport)
@@ -814,11 +1212,38 @@ static pj_status_t transport_attach( pjsip_endpoint *endpt,
 
     pj_memcpy(tp->base.obj_name, pool->obj_name, PJ_MAX_OBJ_NAME);
 
+    /* The additional sockets are owned by the transport from now on */
+    if (port_cnt) {
+        tp->ports = (struct udp_port*)
+                    pj_pool_calloc(pool, port_cnt, sizeof(struct udp_port));
+        for (i=0; i<port_cnt; ++i) {
+            tp->ports[i].tp = tp;
+            tp->ports[i].sock = port_socks[i];
+        }
+        tp->port_cnt = port_cnt;
+
+        tp->flow_tbl = (pj_uint32_t*)
+                       pj_pool_calloc(pool, PJSIP_UDP_FLOW_TABLE_SIZE,
+                                      sizeof(pj_uint32_t));
+    }
+
     /* Init reference counter. */
     status = pj_atomic_create(pool, 0, &tp->base.ref_cnt);
     if (status != PJ_SUCCESS)
         goto on_error;
 
+    /* Init packet counters. */
+    tp->sock_stat = (struct udp_sock_stat*)
+                    pj_pool_calloc(pool, port_cnt + 1,
+                                   sizeof(struct udp_sock_stat));
+    for (i=0; i<=port_cnt; ++i) {
+        status = pj_atomic_create(pool, 0, &tp->sock_stat[i].rx_cnt);
+        if (status == PJ_SUCCESS)
+            status = pj_atomic_create(pool, 0, &tp->sock_stat[i].tx_cnt);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+    }
+
     /* Init lock. */
     status = pj_lock_create_recursive_mutex(pool, pool->obj_name, 
                                             &tp->base.lock);
@@ -871,6 +1296,10 @@ static pj_status_t transport_attach( pjsip_endpoint *endpt,
     if (status != PJ_SUCCESS)
         goto on_error;
 
+    status = register_ports(tp);
+    if (status != PJ_SUCCESS)
+        goto on_error;
+
     /* Set functions. */
     tp->base.send_msg = &udp_send_msg;
     tp->base.do_shutdown = &udp_shutdown;
@@ -888,12 +1317,13 @@ static pj_status_t transport_attach( pjsip_endpoint *endpt,
      */
     pjsip_transport_add_ref(&tp->base);
 
-    /* Create rdata and put it in the array. */
+    /* Create rdata for each socket and put it in the array. */
+    tp->async_cnt = async_cnt;
     tp->rdata_cnt = 0;
     tp->rdata = (pjsip_rx_data**)
-                pj_pool_calloc(tp->base.pool, async_cnt, 
+                pj_pool_calloc(tp->base.pool, async_cnt * (port_cnt + 1), 
                                sizeof(pjsip_rx_data*));
-    for (i=0; i<async_cnt; ++i) {
+    for (i=0; i<async_cnt * (port_cnt + 1); ++i) {
         pj_pool_t *rdata_pool = pjsip_endpt_create_pool(endpt, "rtd%p", 
                                                         PJSIP_POOL_RDATA_LEN,
                                                         PJSIP_POOL_RDATA_INC);
@@ -907,8 +1337,22 @@ static pj_status_t transport_attach( pjsip_endpoint *endpt,
         tp->rdata_cnt++;
     }
 
+#if PJSIP_UDP_RX_BATCH > 1
+    /* Create the batch read buffers for each rdata. */
+    tp->rx_batch = (pj_sock_mmsg*)
+                   pj_pool_calloc(tp->base.pool,
+                                  tp->rdata_cnt * PJSIP_UDP_RX_BATCH,
+                                  sizeof(pj_sock_mmsg));
+    for (i=0; i<(unsigned)tp->rdata_cnt * PJSIP_UDP_RX_BATCH; ++i) {
+        tp->rx_batch[i].buf = pj_pool_alloc(tp->base.pool,
+                                            PJSIP_MAX_PKT_LEN);
+    }
+#endif
+
     /* Start reading the ioqueue. */
     status = start_async_read(tp);
+    if (status == PJ_SUCCESS)
+        status = start_port_threads(tp);
     if (status != PJ_SUCCESS) {
         pjsip_transport_destroy(&tp->base);
         return status;
@@ -941,8 +1385,8 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_attach( pjsip_endpoint *endpt,
                                                 unsigned async_cnt,
                                                 pjsip_transport **p_transport)
 {
-    return transport_attach(endpt, PJSIP_TRANSPORT_UDP, sock, a_name,
-                            async_cnt, p_transport);
+    return transport_attach(endpt, PJSIP_TRANSPORT_UDP, sock, NULL, 0,
+                            a_name, async_cnt, p_transport);
 }
 
 PJ_DEF(pj_status_t) pjsip_udp_transport_attach2( pjsip_endpoint *endpt,
@@ -952,7 +1396,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_attach2( pjsip_endpoint *endpt,
                                                  unsigned async_cnt,
                                                  pjsip_transport **p_transport)
 {
-    return transport_attach(endpt, type, sock, a_name,
+    return transport_attach(endpt, type, sock, NULL, 0, a_name,
                             async_cnt, p_transport);
 }
 
@@ -967,6 +1411,7 @@ PJ_DEF(void) pjsip_udp_transport_cfg_default(pjsip_udp_transport_cfg *cfg,
     cfg->af = af;
     pj_sockaddr_init(cfg->af, &cfg->bind_addr, NULL, 0);
     cfg->async_cnt = 1;
+    cfg->reuseport_cnt = 1;
 }
 
 
@@ -981,6 +1426,8 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start2(
                                         pjsip_transport **p_transport)
 {
     pj_sock_t sock;
+    pj_sock_t port_socks[MAX_REUSEPORT_CNT-1];
+    unsigned i, sock_cnt;
     pj_status_t status;
     pjsip_host_port addr_name;
     char addr_buf[PJ_INET6_ADDRSTRLEN];
@@ -989,6 +1436,11 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start2(
     int addr_len;
 
     PJ_ASSERT_RETURN(endpt && cfg && cfg->async_cnt, PJ_EINVAL);
+    PJ_ASSERT_RETURN(cfg->reuseport_cnt <= MAX_REUSEPORT_CNT, PJ_EINVAL);
+
+    sock_cnt = cfg->reuseport_cnt ? cfg->reuseport_cnt : 1;
+    if (sock_cnt > 1 && pj_SO_REUSEPORT() == 0xFFFF)
+        return PJ_ENOTSUP;
 
     if (cfg->bind_addr.addr.sa_family == pj_AF_INET()) {
         af = pj_AF_INET();
@@ -1000,17 +1452,45 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start2(
         addr_len = sizeof(pj_sockaddr_in6);
     }
 
-    status = create_socket(af, &cfg->bind_addr, addr_len, &sock);
+    status = create_socket(af, &cfg->bind_addr, addr_len, sock_cnt > 1,
+                           &sock);
     if (status != PJ_SUCCESS)
         return status;
 
-    /* Apply QoS, if specified */
-    pj_sock_apply_qos2(sock, cfg->qos_type, &cfg->qos_params,
-                       2, THIS_FILE, "SIP UDP transport");
+    /* Bind the additional sockets to the actual address of the first
+     * socket, in case it was bound to an arbitrary port.
+     */
+    if (sock_cnt > 1) {
+        pj_sockaddr bound_addr;
+        int bound_len = sizeof(bound_addr);
+        unsigned created = 0;
+
+        status = pj_sock_getsockname(sock, &bound_addr, &bound_len);
+        while (status == PJ_SUCCESS && created < sock_cnt-1) {
+            status = create_socket(af, &bound_addr, bound_len, PJ_TRUE,
+                                   &port_socks[created]);
+            if (status == PJ_SUCCESS)
+                ++created;
+        }
+        if (status != PJ_SUCCESS) {
+            while (created > 0)
+                pj_sock_close(port_socks[--created]);
+            pj_sock_close(sock);
+            return status;
+        }
+    }
+
+    for (i=0; i<sock_cnt; ++i) {
+        pj_sock_t s = (i == 0) ? sock : port_socks[i-1];
+
+        /* Apply QoS, if specified */
+        pj_sock_apply_qos2(s, cfg->qos_type, &cfg->qos_params,
+                           2, THIS_FILE, "SIP UDP transport");
 
-    /* Apply sockopt, if specified */
-    if (cfg->sockopt_params.cnt)
-        pj_sock_setsockopt_params(sock, &cfg->sockopt_params);
+        /* Apply sockopt, if specified */
+        if (cfg->sockopt_params.cnt)
+            pj_sock_setsockopt_params(s, &cfg->sockopt_params);
+    }
 
     if (cfg->addr_name.host.slen == 0) {
         /* Address name is not specified.
@@ -1019,6 +1499,8 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start2(
         status = get_published_name(sock, addr_buf, sizeof(addr_buf),
                                     &addr_name);
         if (status != PJ_SUCCESS) {
+            for (i=0; i<sock_cnt-1; ++i)
+                pj_sock_close(port_socks[i]);
             pj_sock_close(sock);
             return status;
         }
@@ -1026,9 +1508,9 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start2(
         addr_name = cfg->addr_name;
     }
 
-    return pjsip_udp_transport_attach2(endpt, transport_type, sock,
-                                       &addr_name, cfg->async_cnt,
-                                       p_transport);
+    return transport_attach(endpt, transport_type, sock, port_socks,
+                            sock_cnt-1, &addr_name, cfg->async_cnt,
+                            p_transport);
 }
 
 /*
@@ -1092,6 +1574,30 @@ PJ_DEF(pj_sock_t) pjsip_udp_transport_get_socket(pjsip_transport *transport)
 }
 
 
+/*
+ * Get the packet counters of a socket of the transport. Socket index zero
+ * is the main socket. This is only used by the test, it is not part of
+ * the API.
+ */
+pj_status_t pjsip_udp_transport_get_sock_stat(pjsip_transport *transport,
+                                              unsigned sock_idx,
+                                              pj_uint32_t *rx_cnt,
+                                              pj_uint32_t *tx_cnt)
+{
+    struct udp_transport *tp;
+
+    PJ_ASSERT_RETURN(transport && rx_cnt && tx_cnt, PJ_EINVAL);
+
+    tp = (struct udp_transport*) transport;
+    PJ_ASSERT_RETURN(sock_idx <= tp->port_cnt, PJ_EINVAL);
+
+    *rx_cnt = (pj_uint32_t)pj_atomic_get(tp->sock_stat[sock_idx].rx_cnt);
+    *tx_cnt = (pj_uint32_t)pj_atomic_get(tp->sock_stat[sock_idx].tx_cnt);
+
+    return PJ_SUCCESS;
+}
+
+
 /*
  * Temporarily pause or shutdown the transport. 
  */
@@ -1117,9 +1623,9 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_pause(pjsip_transport *transport,
      */
     tp->is_paused = PJ_TRUE;
 
-    /* Cancel the ioqueue operation. */
+    /* Cancel the ioqueue operation, on the main and additional sockets. */
     for (i=0; i<(unsigned)tp->rdata_cnt; ++i) {
-        pj_ioqueue_post_completion(tp->key, 
+        pj_ioqueue_post_completion(get_rdata_key(tp, i),
                                    &tp->rdata[i]->tp_info.op_key.op_key, -1);
     }
 
@@ -1137,7 +1643,8 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_pause(pjsip_transport *transport,
             }
         }
         tp->sock = PJ_INVALID_SOCKET;
-        
+
+        close_ports(tp);
     }
 
     PJ_LOG(4,(tp->base.obj_name, "SIP UDP transport paused"));
@@ -1207,12 +1714,15 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_restart2(pjsip_transport *transport,
             }
         }
         tp->sock = PJ_INVALID_SOCKET;
+        close_ports(tp);
 
-        /* Create the socket if it's not specified */
+        /* Create the socket if it's not specified. With additional
+         * sockets, it must allow them to bind to the same address.
+         */
         if (sock == PJ_INVALID_SOCKET) {
             status = create_socket(local?local->addr.sa_family:pj_AF_UNSPEC(), 
                                    local, local?pj_sockaddr_get_len(local):0, 
-                                   &sock);
+                                   tp->port_cnt > 0, &sock);
             if (status != PJ_SUCCESS)
                 return status;
         }
@@ -1239,6 +1749,23 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_restart2(pjsip_transport *transport,
             return status;
         }
 
+        /* Rebind the additional sockets to the new address */
+        for (i = 0; i < (int)tp->port_cnt; ++i) {
+            status = create_socket(tp->base.local_addr.addr.sa_family,
+                                   &tp->base.local_addr, tp->base.addr_len,
+                                   PJ_TRUE, &tp->ports[i].sock);
+            if (status != PJ_SUCCESS) {
+                close_ports(tp);
+                pj_sock_close(sock);
+                return status;
+            }
+        }
+
+        /* Flows received on the old sockets are no longer valid */
+        if (tp->port_cnt)
+            pj_bzero(tp->flow_tbl, PJSIP_UDP_FLOW_TABLE_SIZE *
+                                   sizeof(tp->flow_tbl[0]));
+
         /* Assign the socket and published address to transport. */
         udp_set_socket(tp, sock, a_name);
 
@@ -1255,7 +1782,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_restart2(pjsip_transport *transport,
     /* Make sure all udp_on_read_complete() loop spin are stopped */
     do {
         pj_thread_sleep(1);
-    } while (tp->read_loop_spin);
+    } while (is_read_loop_spinning(tp));
 
     /* Re-register new or existing socket to ioqueue. */
     status = register_to_ioqueue(tp);
@@ -1263,6 +1790,10 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_restart2(pjsip_transport *transport,
         return status;
     }
 
+    status = register_ports(tp);
+    if (status != PJ_SUCCESS)
+        return status;
+
     /* Re-init op_key. */
     for (i = 0; i < tp->rdata_cnt; ++i) {
         pj_ioqueue_op_key_init(&tp->rdata[i]->tp_info.op_key.op_key,
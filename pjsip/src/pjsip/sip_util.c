@@ -105,21 +105,23 @@ PJ_DEF(pj_status_t) pjsip_target_set_add_from_msg( pjsip_target_set *tset,
 
     PJ_ASSERT_RETURN(tset && pool && msg, PJ_EINVAL);
 
-    /* Scan for Contact headers and add the URI */
-    hdr = msg->hdr.next;
-    while (hdr != &msg->hdr) {
-        if (hdr->type == PJSIP_H_CONTACT) {
-            const pjsip_contact_hdr *cn_hdr = (const pjsip_contact_hdr*)hdr;
-
-            if (!cn_hdr->star) {
-                pj_status_t rc;
-                rc = pjsip_target_set_add_uri(tset, pool, cn_hdr->uri, 
-                                              cn_hdr->q1000);
-                if (rc == PJ_SUCCESS)
-                    ++added;
-            }
+    /* Scan for Contact headers and add the URI. The headers are searched
+     * with pjsip_msg_find_hdr(), which also parses them when header
+     * parsing is lazy.
+     */
+    hdr = (const pjsip_hdr*) pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT, NULL);
+    while (hdr) {
+        const pjsip_contact_hdr *cn_hdr = (const pjsip_contact_hdr*)hdr;
+
+        if (!cn_hdr->star) {
+            pj_status_t rc;
+            rc = pjsip_target_set_add_uri(tset, pool, cn_hdr->uri, 
+                                          cn_hdr->q1000);
+            if (rc == PJ_SUCCESS)
+                ++added;
         }
-        hdr = hdr->next;
+        hdr = (const pjsip_hdr*)
+              pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT, hdr->next);
     }
 
     return added ? PJ_SUCCESS : PJ_EEXISTS;
@@ -1280,7 +1282,11 @@ static void stateless_send_transport_cb( void *token,
             }
         }
 
-        pjsip_tx_data_invalidate_msg(tdata);
+        /* Only the Via header needs to be printed again. Headers added or
+         * removed by pjsip_process_route_set() are handled by the print
+         * cache, and the request line is always printed.
+         */
+        pjsip_tx_data_invalidate_hdr(tdata, via);
 
         /* Send message using this transport. */
         status = pjsip_transport_send( stateless_data->cur_transport,
@@ -1505,9 +1511,67 @@ struct send_raw_data
     pjsip_tpselector        *sel;
     void                    *app_token;
     pjsip_tp_send_callback   app_cb;
+    int                      via_offset;    /* Via to write, or -1  */
+    pj_str_t                 via_branch;
 };
 
 
+/* Write the Via of a forwarded request with the transport acquired for
+ * the resolved address, and select that transport to send the request.
+ */
+static pj_status_t send_fwd_write_via(struct send_raw_data *sraw_data,
+                                      const pjsip_server_addresses *addr)
+{
+    pjsip_tx_data *tdata = sraw_data->tdata;
+    pjsip_transport *tp;
+    pjsip_via_hdr *hvia;
+    char buf[PJSIP_MAX_URL_SIZE * 2];
+    char *pos;
+    int len;
+    pj_status_t status;
+
+    status = pjsip_endpt_acquire_transport2(sraw_data->endpt,
+                                            addr->entry[0].type,
+                                            &addr->entry[0].addr,
+                                            addr->entry[0].addr_len,
+                                            sraw_data->sel, tdata, &tp);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    hvia = pjsip_via_hdr_create(tdata->pool);
+    hvia->transport = pj_str(tp->type_name);
+    hvia->sent_by = tp->local_name;
+    hvia->rport_param = pjsip_cfg()->endpt.disable_rport ? -1 : 0;
+    hvia->branch_param = sraw_data->via_branch;
+
+    len = pjsip_hdr_print_on(hvia, buf, sizeof(buf) - 2);
+    if (len < 1 || len + 2 > tdata->buf.end - tdata->buf.cur) {
+        pjsip_transport_dec_ref(tp);
+        return PJSIP_EMSGTOOLONG;
+    }
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+
+    /* Insert it in the packet */
+    pos = tdata->buf.start + sraw_data->via_offset;
+    pj_memmove(pos + len, pos, tdata->buf.cur - pos);
+    pj_memcpy(pos, buf, len);
+    tdata->buf.cur += len;
+
+    if (sraw_data->sel)
+        pjsip_tpselector_dec_ref(sraw_data->sel);
+    else
+        sraw_data->sel = PJ_POOL_ALLOC_T(tdata->pool, pjsip_tpselector);
+    pj_bzero(sraw_data->sel, sizeof(pjsip_tpselector));
+    sraw_data->sel->type = PJSIP_TPSELECTOR_TRANSPORT;
+    sraw_data->sel->u.transport = tp;
+    pjsip_tpselector_add_ref(sraw_data->sel);
+
+    pjsip_transport_dec_ref(tp);
+    return PJ_SUCCESS;
+}
+
+
 /* Resolver callback for sending raw data. */
 static void send_raw_resolver_callback( pj_status_t status,
                                         void *token,
@@ -1515,6 +1579,9 @@ static void send_raw_resolver_callback( pj_status_t status,
 {
     struct send_raw_data *sraw_data = (struct send_raw_data*) token;
 
+    if (status == PJ_SUCCESS && sraw_data->via_offset >= 0)
+        status = send_fwd_write_via(sraw_data, addr);
+
     if (status != PJ_SUCCESS) {
         if (sraw_data->app_cb) {
             (*sraw_data->app_cb)(sraw_data->app_token, sraw_data->tdata,
@@ -1537,7 +1604,9 @@ static void send_raw_resolver_callback( pj_status_t status,
                                       addr->entry[0].addr_len, 
                                       sraw_data->app_token,
                                       sraw_data->app_cb);
-        if (status == PJ_SUCCESS) {
+        if (!sraw_data->app_cb) {
+            /* Nothing to notify */
+        } else if (status == PJ_SUCCESS) {
             (*sraw_data->app_cb)(sraw_data->app_token, sraw_data->tdata,
                                  data_len);
         } else if (status != PJ_EPENDING) {
@@ -1608,6 +1677,7 @@ PJ_DEF(pj_status_t) pjsip_endpt_send_raw_to_uri(pjsip_endpoint *endpt,
     sraw_data->tdata = tdata;
     sraw_data->app_token = token;
     sraw_data->app_cb = cb;
+    sraw_data->via_offset = -1;
 
     if (sel) {
         sraw_data->sel = PJ_POOL_ALLOC_T(tdata->pool, pjsip_tpselector);
@@ -1627,6 +1697,142 @@ PJ_DEF(pj_status_t) pjsip_endpt_send_raw_to_uri(pjsip_endpoint *endpt,
 }
 
 
+/*
+ * Send a message forwarded without cloning.
+ */
+PJ_DEF(pj_status_t) pjsip_endpt_send_fwd(pjsip_endpoint *endpt,
+                                         const pjsip_fwd_data *fwd,
+                                         const pjsip_uri *dst_uri,
+                                         const pjsip_tpselector *sel,
+                                         void *token,
+                                         pjsip_tp_send_callback cb)
+{
+    pjsip_rx_data *rdata;
+    pjsip_tx_data *tdata;
+    struct send_raw_data *sraw_data;
+    pjsip_host_info dest_info;
+    pj_size_t len, room;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(endpt && fwd && fwd->rdata, PJ_EINVAL);
+
+    rdata = fwd->rdata;
+    PJ_ASSERT_RETURN((rdata->msg_info.msg->type == PJSIP_REQUEST_MSG) ==
+                     (dst_uri != NULL), PJ_EINVAL);
+
+    /* Allocate buffer */
+    status = pjsip_endpt_create_tdata(endpt, &tdata);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    pjsip_tx_data_add_ref(tdata);
+
+    /* Build destination info. */
+    if (dst_uri) {
+        status = pjsip_get_dest_info(dst_uri, NULL, tdata->pool, &dest_info);
+        if (status != PJ_SUCCESS) {
+            pjsip_tx_data_dec_ref(tdata);
+            return status;
+        }
+    } else {
+        /* The response goes to the Via below ours, using the maddr, the
+         * received and the rport parameters (RFC 3261 Section 18.2.2 and
+         * RFC 3581).
+         */
+        const pjsip_via_hdr *via = NULL;
+
+        if (rdata->msg_info.via) {
+            via = (const pjsip_via_hdr*)
+                  pjsip_msg_find_hdr(rdata->msg_info.msg, PJSIP_H_VIA,
+                                     rdata->msg_info.via->next);
+        }
+        if (!via) {
+            pjsip_tx_data_dec_ref(tdata);
+            return PJSIP_EMISSINGHDR;
+        }
+
+        pj_bzero(&dest_info, sizeof(dest_info));
+        dest_info.type = pjsip_transport_get_type_from_name(&via->transport);
+        dest_info.flag = pjsip_transport_get_flag_from_type(dest_info.type);
+        if (via->maddr_param.slen) {
+            /* The port is from sent-by, the rport is not used since the
+             * request was not received from the maddr address.
+             */
+            dest_info.addr.host = via->maddr_param;
+            dest_info.addr.port = via->sent_by.port;
+        } else {
+            dest_info.addr.host = via->recvd_param.slen ? via->recvd_param :
+                                                          via->sent_by.host;
+            dest_info.addr.port = via->rport_param > 0 ? via->rport_param :
+                                                         via->sent_by.port;
+        }
+        if (dest_info.addr.port == 0) {
+            dest_info.addr.port = 
+                pjsip_transport_get_default_port_for_type(dest_info.type);
+        }
+    }
+
+    /* The host name must outlive the rdata, resolving may be pending */
+    pj_strdup(tdata->pool, &tdata->dest_info.name, &dest_info.addr.host);
+    dest_info.addr.host = tdata->dest_info.name;
+
+    /* Print the packet with the edits applied, leaving room for the Via
+     * that is written after the transport is selected.
+     */
+    len = pjsip_fwd_data_get_len(fwd);
+    room = fwd->via_pos ? PJSIP_MAX_URL_SIZE * 2 : 0;
+    tdata->buf.start = (char*) pj_pool_alloc(tdata->pool, len+room+1);
+    tdata->buf.end = tdata->buf.start + len + room + 1;
+    tdata->buf.cur = tdata->buf.start + pjsip_fwd_data_print(fwd,
+                                                             tdata->buf.start,
+                                                             len);
+    tdata->info = "fwd";
+
+    /* Init send_raw_data */
+    sraw_data = PJ_POOL_ZALLOC_T(tdata->pool, struct send_raw_data);
+    sraw_data->endpt = endpt;
+    sraw_data->tdata = tdata;
+    sraw_data->app_token = token;
+    sraw_data->app_cb = cb;
+    sraw_data->via_offset = -1;
+
+    if (fwd->via_pos) {
+        /* Our Via goes right above the previous top-most Via, i.e. after
+         * the edits before it and the insertions at its position.
+         */
+        const char *via_pos = fwd->via_pos;
+        unsigned i;
+
+        sraw_data->via_offset = (int)(via_pos - rdata->msg_info.msg_buf);
+        for (i=0; i<fwd->splice_cnt; ++i) {
+            const pjsip_fwd_splice *sp = &fwd->splice[i];
+
+            if (sp->start > via_pos ||
+                (sp->start == via_pos && sp->end != sp->start))
+            {
+                break;
+            }
+            sraw_data->via_offset += (int)(sp->text.slen -
+                                           (sp->end - sp->start));
+        }
+        pj_strdup(tdata->pool, &sraw_data->via_branch, &fwd->via_branch);
+    }
+
+    if (sel) {
+        sraw_data->sel = PJ_POOL_ALLOC_T(tdata->pool, pjsip_tpselector);
+        pj_memcpy(sraw_data->sel, sel, sizeof(pjsip_tpselector));
+        pjsip_tpselector_add_ref(sraw_data->sel);
+    }
+
+    /* Resolve destination host.
+     * The processing then resumed when the resolving callback is called.
+     */
+    pjsip_endpt_resolve( endpt, tdata->pool, &dest_info, sraw_data,
+                         &send_raw_resolver_callback);
+    return PJ_SUCCESS;
+}
+
+
 /*
  * Determine which address (and transport) to use to send response message
  * based on the received request. This function follows the specification
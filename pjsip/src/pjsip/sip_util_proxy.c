@@ -323,6 +323,464 @@ on_error:
 }
 
 
+/*****************************************************************************
+ *
+ * Forwarding without cloning the message.
+ *
+ * The edits are recorded as byte range splices over the received packet,
+ * and the packet is copied with the splices applied when it is sent.
+ * The parsed message in the rdata is only used to get the values of the
+ * headers, the position of the headers in the packet is found by scanning
+ * the header lines since the parser does not keep them.
+ *
+ *****************************************************************************
+ */
+
+/* Raw text of a header in the packet. */
+typedef struct raw_hdr
+{
+    const char  *start;         /* Start of header name.                */
+    const char  *value;         /* Start of header value.               */
+    const char  *end;           /* End of header, after the CRLF.       */
+} raw_hdr;
+
+static const pj_str_t STR_VIA = { "Via", 3 };
+static const pj_str_t STR_VIA_S = { "v", 1 };
+static const pj_str_t STR_MAX_FWD = { "Max-Forwards", 12 };
+
+/* Get the end of the header line at p, after the CRLF. Continuation
+ * lines are part of the header.
+ */
+static const char *raw_line_end(const char *p, const char *end)
+{
+    for (;;) {
+        while (p != end && *p != '\n')
+            ++p;
+        if (p == end)
+            return end;
+        ++p;
+        if (p == end || (*p != ' ' && *p != '\t'))
+            return p;
+    }
+}
+
+static const char *raw_pkt_end(const pjsip_rx_data *rdata)
+{
+    return rdata->msg_info.msg_buf + rdata->msg_info.len;
+}
+
+/* Get the start of the first header, after the start line. */
+static const char *raw_hdr_begin(const pjsip_rx_data *rdata)
+{
+    const char *p = rdata->msg_info.msg_buf;
+    const char *end = raw_pkt_end(rdata);
+
+    while (p != end && *p != '\n')
+        ++p;
+    return (p == end) ? end : p+1;
+}
+
+/* Find the first header with the specified name. */
+static pj_bool_t raw_find_hdr(const pjsip_rx_data *rdata,
+                              const pj_str_t *name,
+                              const pj_str_t *sname,
+                              raw_hdr *h)
+{
+    const char *p = raw_hdr_begin(rdata);
+    const char *end = raw_pkt_end(rdata);
+
+    /* Headers end with an empty line */
+    while (p != end && *p != '\r' && *p != '\n') {
+        const char *next = raw_line_end(p, end);
+        const char *colon = p;
+        pj_str_t hname;
+
+        while (colon != next && *colon != ':')
+            ++colon;
+
+        if (colon != next) {
+            hname.ptr = (char*)p;
+            hname.slen = colon - p;
+            while (hname.slen && pj_isblank(hname.ptr[hname.slen-1]))
+                --hname.slen;
+
+            if (pj_stricmp(&hname, name)==0 ||
+                (sname && pj_stricmp(&hname, sname)==0))
+            {
+                h->start = p;
+                h->value = colon + 1;
+                while (h->value != next && pj_isblank(*h->value))
+                    ++h->value;
+                h->end = next;
+                return PJ_TRUE;
+            }
+        }
+
+        p = next;
+    }
+
+    return PJ_FALSE;
+}
+
+/* Get the comma after the first value of a header, or NULL if the header
+ * has only one value.
+ */
+static const char *raw_first_value_end(const raw_hdr *h)
+{
+    const char *p;
+    pj_bool_t quoted = PJ_FALSE, bracketed = PJ_FALSE;
+
+    for (p = h->value; p != h->end; ++p) {
+        if (quoted) {
+            if (*p == '\\' && p+1 != h->end)
+                ++p;
+            else if (*p == '"')
+                quoted = PJ_FALSE;
+        } else if (*p == '"') {
+            quoted = PJ_TRUE;
+        } else if (*p == '<') {
+            bracketed = PJ_TRUE;
+        } else if (*p == '>') {
+            bracketed = PJ_FALSE;
+        } else if (*p == ',' && !bracketed) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/* Skip the separator after a comma, which may include line folding. */
+static const char *raw_skip_sep(const char *p, const char *end)
+{
+    while (p != end && (pj_isblank(*p) || *p == '\r' || *p == '\n'))
+        ++p;
+    return p;
+}
+
+/* Print a header to a string allocated from the pool, with CRLF. */
+static pj_status_t print_hdr(pj_pool_t *pool, const pjsip_hdr *hdr,
+                             const char *suffix, pj_str_t *text)
+{
+    char buf[PJSIP_MAX_URL_SIZE * 2];
+    pj_size_t suffix_len = pj_ansi_strlen(suffix);
+    int len;
+
+    len = pjsip_hdr_print_on((void*)hdr, buf, sizeof(buf));
+    if (len < 0 || len + suffix_len > sizeof(buf))
+        return PJSIP_EMSGTOOLONG;
+
+    pj_memcpy(buf + len, suffix, suffix_len);
+    len += (int)suffix_len;
+
+    text->ptr = (char*) pj_pool_alloc(pool, len);
+    pj_memcpy(text->ptr, buf, len);
+    text->slen = len;
+
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(void) pjsip_fwd_data_init(pjsip_fwd_data *fwd, pjsip_rx_data *rdata)
+{
+    pj_assert(fwd && rdata);
+
+    fwd->rdata = rdata;
+    fwd->splice_cnt = 0;
+    fwd->via_pos = NULL;
+    fwd->via_branch.slen = 0;
+}
+
+
+PJ_DEF(pj_status_t) pjsip_fwd_data_splice(pjsip_fwd_data *fwd,
+                                          const char *start,
+                                          const char *end,
+                                          const pj_str_t *text)
+{
+    pjsip_fwd_splice *s;
+    unsigned i;
+
+    PJ_ASSERT_RETURN(fwd && start && end && start <= end, PJ_EINVAL);
+    PJ_ASSERT_RETURN(start >= fwd->rdata->msg_info.msg_buf &&
+                     end <= raw_pkt_end(fwd->rdata), PJ_EINVAL);
+
+    if (fwd->splice_cnt == PJSIP_MAX_FWD_SPLICE)
+        return PJ_ETOOMANY;
+
+    /* Keep the splices sorted. Insertions at the same position are kept
+     * in the order they are added, and before a range that starts there.
+     */
+    for (i=0; i<fwd->splice_cnt; ++i) {
+        s = &fwd->splice[i];
+        if (s->start > start || (s->start == start && s->end > end))
+            break;
+    }
+
+    if ((i > 0 && fwd->splice[i-1].end > start) ||
+        (i < fwd->splice_cnt && fwd->splice[i].start < end))
+    {
+        return PJ_EINVAL;
+    }
+
+    s = &fwd->splice[i];
+    pj_memmove(s+1, s, (fwd->splice_cnt - i) * sizeof(*s));
+    s->start = start;
+    s->end = end;
+    if (text) {
+        s->text = *text;
+    } else {
+        s->text.ptr = NULL;
+        s->text.slen = 0;
+    }
+    ++fwd->splice_cnt;
+
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(pj_status_t) pjsip_fwd_data_set_uri(pjsip_fwd_data *fwd,
+                                           const pjsip_uri *uri)
+{
+    pjsip_rx_data *rdata;
+    const char *line, *line_end, *uri_start, *uri_end;
+    pj_str_t text;
+    int len;
+
+    PJ_ASSERT_RETURN(fwd && uri, PJ_EINVAL);
+
+    rdata = fwd->rdata;
+    PJ_ASSERT_RETURN(rdata->msg_info.msg->type == PJSIP_REQUEST_MSG,
+                     PJSIP_ENOTREQUESTMSG);
+
+    /* Request-Line = Method SP Request-URI SP SIP-Version CRLF */
+    line = rdata->msg_info.msg_buf;
+    line_end = raw_hdr_begin(rdata);
+
+    uri_start = line;
+    while (uri_start != line_end && *uri_start != ' ')
+        ++uri_start;
+    uri_end = line_end;
+    while (uri_end != uri_start && *uri_end != ' ')
+        --uri_end;
+    if (uri_end == uri_start)
+        return PJSIP_EINVALIDREQURI;
+    ++uri_start;
+
+    text.ptr = (char*) pj_pool_alloc(rdata->tp_info.pool, PJSIP_MAX_URL_SIZE);
+    len = pjsip_uri_print(PJSIP_URI_IN_REQ_URI, uri, text.ptr,
+                          PJSIP_MAX_URL_SIZE);
+    if (len < 1)
+        return PJSIP_EURITOOLONG;
+    text.slen = len;
+
+    return pjsip_fwd_data_splice(fwd, uri_start, uri_end, &text);
+}
+
+
+PJ_DEF(pj_status_t) pjsip_fwd_data_dec_max_fwd(pjsip_fwd_data *fwd)
+{
+    pjsip_rx_data *rdata;
+    raw_hdr h;
+    const char *digit_end;
+    pj_str_t text;
+
+    PJ_ASSERT_RETURN(fwd, PJ_EINVAL);
+
+    rdata = fwd->rdata;
+    PJ_ASSERT_RETURN(rdata->msg_info.msg->type == PJSIP_REQUEST_MSG,
+                     PJSIP_ENOTREQUESTMSG);
+
+    /* 16.6.3:
+     * If the copy does not contain a Max-Forwards header field, the
+     * proxy MUST add one with a field value, which SHOULD be 70.
+     */
+    if (rdata->msg_info.max_fwd == NULL ||
+        !raw_find_hdr(rdata, &STR_MAX_FWD, NULL, &h))
+    {
+        const char *pos = raw_hdr_begin(rdata);
+
+        text = pj_str("Max-Forwards: 70\r\n");
+        return pjsip_fwd_data_splice(fwd, pos, pos, &text);
+    }
+
+    if (rdata->msg_info.max_fwd->ivalue <= 0)
+        return PJ_SUCCESS;
+
+    digit_end = h.value;
+    while (digit_end != h.end && pj_isdigit(*digit_end))
+        ++digit_end;
+
+    text.ptr = (char*) pj_pool_alloc(rdata->tp_info.pool, 12);
+    text.slen = pj_utoa(rdata->msg_info.max_fwd->ivalue - 1, text.ptr);
+
+    return pjsip_fwd_data_splice(fwd, h.value, digit_end, &text);
+}
+
+
+PJ_DEF(pj_status_t) pjsip_fwd_data_add_via(pjsip_fwd_data *fwd,
+                                           const pj_str_t *transport,
+                                           const pjsip_host_port *sent_by,
+                                           const pj_str_t *branch)
+{
+    pjsip_rx_data *rdata;
+    pj_pool_t *pool;
+    pjsip_via_hdr *hvia;
+    raw_hdr h;
+    const char *comma;
+    pj_str_t text;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(fwd && (transport == NULL) == (sent_by == NULL),
+                     PJ_EINVAL);
+
+    rdata = fwd->rdata;
+    pool = rdata->tp_info.pool;
+    PJ_ASSERT_RETURN(rdata->msg_info.msg->type == PJSIP_REQUEST_MSG,
+                     PJSIP_ENOTREQUESTMSG);
+    PJ_ASSERT_RETURN(fwd->via_pos == NULL, PJ_EINVALIDOP);
+
+    if (!raw_find_hdr(rdata, &STR_VIA, &STR_VIA_S, &h))
+        return PJSIP_EMISSINGHDR;
+
+    /* Our Via goes on top */
+    hvia = pjsip_via_hdr_create(pool);
+    if (branch)
+        hvia->branch_param = *branch;
+    else
+        hvia->branch_param = pjsip_calculate_branch_id(rdata);
+
+    if (transport) {
+        hvia->transport = *transport;
+        hvia->sent_by = *sent_by;
+        hvia->rport_param = pjsip_cfg()->endpt.disable_rport ? -1 : 0;
+
+        status = print_hdr(pool, (pjsip_hdr*)hvia, "\r\n", &text);
+        if (status != PJ_SUCCESS)
+            return status;
+
+        status = pjsip_fwd_data_splice(fwd, h.start, h.start, &text);
+        if (status != PJ_SUCCESS)
+            return status;
+    }
+
+    /* Replace the first value of the top-most Via with the one that has
+     * the received and rport parameters. The remaining values, if any,
+     * continue in a new Via header.
+     */
+    comma = raw_first_value_end(&h);
+    status = print_hdr(pool, (pjsip_hdr*)rdata->msg_info.via,
+                       comma ? "\r\nVia: " : "\r\n", &text);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    status = pjsip_fwd_data_splice(fwd, h.start,
+                                   comma ? raw_skip_sep(comma+1, h.end) :
+                                           h.end,
+                                   &text);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    /* Without transport, our Via is written when the request is sent */
+    if (!transport) {
+        fwd->via_pos = h.start;
+        fwd->via_branch = hvia->branch_param;
+    }
+
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(pj_status_t) pjsip_fwd_data_remove_via(pjsip_fwd_data *fwd)
+{
+    PJ_ASSERT_RETURN(fwd, PJ_EINVAL);
+    PJ_ASSERT_RETURN(fwd->rdata->msg_info.msg->type == PJSIP_RESPONSE_MSG,
+                     PJSIP_ENOTRESPONSEMSG);
+
+    return pjsip_fwd_data_remove_hdr(fwd, &STR_VIA, &STR_VIA_S);
+}
+
+
+PJ_DEF(pj_status_t) pjsip_fwd_data_remove_hdr(pjsip_fwd_data *fwd,
+                                              const pj_str_t *name,
+                                              const pj_str_t *sname)
+{
+    raw_hdr h;
+    const char *comma;
+
+    PJ_ASSERT_RETURN(fwd && name, PJ_EINVAL);
+
+    if (!raw_find_hdr(fwd->rdata, name, sname, &h))
+        return PJ_ENOTFOUND;
+
+    comma = raw_first_value_end(&h);
+    if (comma)
+        return pjsip_fwd_data_splice(fwd, h.value,
+                                     raw_skip_sep(comma+1, h.end), NULL);
+    else
+        return pjsip_fwd_data_splice(fwd, h.start, h.end, NULL);
+}
+
+
+PJ_DEF(pj_status_t) pjsip_fwd_data_insert_hdr(pjsip_fwd_data *fwd,
+                                              const pjsip_hdr *hdr)
+{
+    const char *pos;
+    pj_str_t text;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(fwd && hdr, PJ_EINVAL);
+
+    status = print_hdr(fwd->rdata->tp_info.pool, hdr, "\r\n", &text);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    pos = raw_hdr_begin(fwd->rdata);
+    return pjsip_fwd_data_splice(fwd, pos, pos, &text);
+}
+
+
+PJ_DEF(pj_size_t) pjsip_fwd_data_get_len(const pjsip_fwd_data *fwd)
+{
+    pj_size_t len;
+    unsigned i;
+
+    len = fwd->rdata->msg_info.len;
+    for (i=0; i<fwd->splice_cnt; ++i) {
+        const pjsip_fwd_splice *s = &fwd->splice[i];
+        len += s->text.slen - (s->end - s->start);
+    }
+
+    return len;
+}
+
+
+PJ_DEF(pj_ssize_t) pjsip_fwd_data_print(const pjsip_fwd_data *fwd,
+                                        char *buf, pj_size_t size)
+{
+    const char *src = fwd->rdata->msg_info.msg_buf;
+    char *p = buf;
+    unsigned i;
+
+    if (pjsip_fwd_data_get_len(fwd) > size)
+        return -1;
+
+    for (i=0; i<fwd->splice_cnt; ++i) {
+        const pjsip_fwd_splice *s = &fwd->splice[i];
+
+        pj_memcpy(p, src, s->start - src);
+        p += (s->start - src);
+        pj_memcpy(p, s->text.ptr, s->text.slen);
+        p += s->text.slen;
+        src = s->end;
+    }
+
+    pj_memcpy(p, src, raw_pkt_end(fwd->rdata) - src);
+    p += (raw_pkt_end(fwd->rdata) - src);
+
+    return p - buf;
+}
+
+
 static void digest2str(const unsigned char digest[], char *output)
 {
     int i;
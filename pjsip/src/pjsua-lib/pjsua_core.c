@@ -1325,6 +1325,14 @@ PJ_DEF(pj_status_t) pjsua_init( const pjsua_config *ua_cfg,
         PJ_LOG(4,(THIS_FILE, "No SIP worker threads created"));
     }
 
+    /* Create receive queues if configured. */
+    if (pjsua_var.ua_cfg.rx_queue_cnt) {
+        status = pjsip_endpt_create_rx_queues(pjsua_var.endpt,
+                                              pjsua_var.ua_cfg.rx_queue_cnt);
+        if (status != PJ_SUCCESS)
+            goto on_error;
+    }
+
     /* Done! */
 
     PJ_LOG(3,(THIS_FILE, "pjsua version %s for %s initialized", 
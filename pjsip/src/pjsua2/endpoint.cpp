@@ -259,6 +259,7 @@ void UaConfig::fromPj(const pjsua_config &ua_cfg)
 
     this->maxCalls = ua_cfg.max_calls;
     this->threadCnt = ua_cfg.thread_cnt;
+    this->rxQueueCnt = ua_cfg.rx_queue_cnt;
     this->userAgent = pj2Str(ua_cfg.user_agent);
 
     for (i=0; i<ua_cfg.nameserver_count; ++i) {
@@ -289,6 +290,7 @@ pjsua_config UaConfig::toPj() const
 
     pua_cfg.max_calls = this->maxCalls;
     pua_cfg.thread_cnt = this->threadCnt;
+    pua_cfg.rx_queue_cnt = this->rxQueueCnt;
     pua_cfg.user_agent = str2Pj(this->userAgent);
 
     for (i=0; i<this->nameserver.size() && i<PJ_ARRAY_SIZE(pua_cfg.nameserver);
@@ -328,6 +330,7 @@ void UaConfig::readObject(const ContainerNode &node) PJSUA2_THROW(Error)
 
     NODE_READ_UNSIGNED( this_node, maxCalls);
     NODE_READ_UNSIGNED( this_node, threadCnt);
+    NODE_READ_UNSIGNED( this_node, rxQueueCnt);
     NODE_READ_BOOL    ( this_node, mainThreadOnly);
     NODE_READ_STRINGV ( this_node, nameserver);
     NODE_READ_STRING  ( this_node, userAgent);
@@ -346,6 +349,7 @@ void UaConfig::writeObject(ContainerNode &node) const PJSUA2_THROW(Error)
 
     NODE_WRITE_UNSIGNED( this_node, maxCalls);
     NODE_WRITE_UNSIGNED( this_node, threadCnt);
+    NODE_WRITE_UNSIGNED( this_node, rxQueueCnt);
     NODE_WRITE_BOOL    ( this_node, mainThreadOnly);
     NODE_WRITE_STRINGV ( this_node, nameserver);
     NODE_WRITE_STRING  ( this_node, userAgent);
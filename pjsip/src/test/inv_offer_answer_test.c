@@ -712,6 +712,70 @@ static inv_test_param_t test_params[] =
 };
 
 
+/*
+ * Dialogs of different Call-IDs are spread over the shards of the dialog
+ * table, check that each of them is still found.
+ */
+static int dlg_table_test(void)
+{
+    enum { COUNT = 64 };
+    pj_str_t uri = pj_str(CONTACT);
+    pj_str_t wrong_cid = pj_str("no-such-call-id");
+    pjsip_dialog *dlg[COUNT];
+    unsigned i, count;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  dialog table"));
+
+    pj_bzero(dlg, sizeof(dlg));
+    count = pjsip_ua_get_dlg_set_count();
+
+    for (i=0; i<COUNT; ++i) {
+        status = pjsip_dlg_create_uac(pjsip_ua_instance(),
+                                      &uri, &uri, &uri, &uri, &dlg[i]);
+        if (status != PJ_SUCCESS) {
+            rc = -700;
+            goto on_return;
+        }
+    }
+
+    if (pjsip_ua_get_dlg_set_count() != count + COUNT) {
+        rc = -710;
+        goto on_return;
+    }
+
+    for (i=0; i<COUNT; ++i) {
+        if (pjsip_ua_find_dialog(&dlg[i]->call_id->id,
+                                 &dlg[i]->local.info->tag,
+                                 &dlg[i]->remote.info->tag,
+                                 PJ_FALSE) != dlg[i])
+        {
+            rc = -720;
+            goto on_return;
+        }
+
+        if (pjsip_ua_find_dialog(&wrong_cid, &dlg[i]->local.info->tag,
+                                 &dlg[i]->remote.info->tag,
+                                 PJ_FALSE) != NULL)
+        {
+            rc = -730;
+            goto on_return;
+        }
+    }
+
+on_return:
+    for (i=0; i<COUNT; ++i) {
+        if (dlg[i])
+            pjsip_dlg_terminate(dlg[i]);
+    }
+
+    if (rc == 0 && pjsip_ua_get_dlg_set_count() != count)
+        rc = -740;
+
+    return rc;
+}
+
 static pjsip_dialog* on_dlg_forked(pjsip_dialog *first_set, pjsip_rx_data *res)
 {
     PJ_UNUSED_ARG(first_set);
@@ -773,6 +837,10 @@ int inv_offer_answer_test(void)
     }
 
     /* Do tests */
+    rc = dlg_table_test();
+    if (rc != 0)
+        goto on_return;
+
     for (i=0; i<PJ_ARRAY_SIZE(test_params); ++i) {
         rc = perform_test(&test_params[i]);
         if (rc != 0)
@@ -38,6 +38,7 @@ static pjsip_msg *create_msg1(pj_pool_t *pool);
 #define FLAG_DETECT_ONLY        1
 #define FLAG_PARSE_ONLY         4
 #define FLAG_PRINT_ONLY         8
+#define FLAG_NOTHROW            16
 
 struct test_msg
 {
@@ -296,7 +297,12 @@ parse_msg:
     var.parse_len = var.parse_len + entry->len;
     pj_get_timestamp(&t1);
     pj_list_init(&err_list);
-    parsed_msg = pjsip_parse_msg(pool, entry->msg, entry->len, &err_list);
+    if (var.flag & FLAG_NOTHROW) {
+        pjsip_parse_msg2(pool, entry->msg, entry->len, &err_list,
+                         &parsed_msg);
+    } else {
+        parsed_msg = pjsip_parse_msg(pool, entry->msg, entry->len, &err_list);
+    }
     if (parsed_msg == NULL) {
         if (entry->expected_status != STATUS_SYNTAX_ERROR) {
             status = -10;
@@ -835,17 +841,347 @@ static pj_status_t simple_test(void)
     if (status != PJ_SUCCESS)
         return status;
 
-    for (i=0; i<PJ_ARRAY_SIZE(test_array); ++i) {
+    for (i=0; i<PJ_ARRAY_SIZE(test_array)*2; ++i) {
         pj_pool_t *pool;
+
+        /* Second round with the non-throwing parser */
+        var.flag = (i < PJ_ARRAY_SIZE(test_array)) ? 0 : FLAG_NOTHROW;
+
         pool = pjsip_endpt_create_pool(endpt, NULL, POOL_SIZE, POOL_SIZE);
-        status = test_entry( pool, &test_array[i] );
+        status = test_entry( pool, &test_array[i % PJ_ARRAY_SIZE(test_array)]);
         pjsip_endpt_release_pool(endpt, pool);
 
         if (status != PJ_SUCCESS)
-            return status;
+            break;
     }
 
-    return PJ_SUCCESS;
+    var.flag = 0;
+    return status;
+}
+
+
+/* Test lazy header parsing mode */
+static pj_status_t lazy_test(void)
+{
+    char msgbuf[] =
+        "REGISTER sip:example.com SIP/2.0\r\n"
+        "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bKlazytest\r\n"
+        "Max-Forwards: 70\r\n"
+        "From: <sip:alice@example.com>;tag=1234\r\n"
+        "To: <sip:alice@example.com>\r\n"
+        "Call-ID: lazy-test@10.0.0.1\r\n"
+        "CSeq: 1 REGISTER\r\n"
+        "m: <sip:alice@10.0.0.1>, <sip:alice@10.0.0.2>;expires=60\r\n"
+        "Expires: 3600\r\n"
+        "Allow: INVITE, ACK, BYE\r\n"
+        "X-Custom: some value\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n";
+    pj_str_t hname_allow = { "Allow", 5 };
+    pj_pool_t *pool;
+    pjsip_msg *msg, *clone;
+    pjsip_hdr *hdr;
+    pjsip_contact_hdr *contact;
+    pjsip_expires_hdr *expires;
+    pjsip_allow_hdr *allow;
+    pj_bool_t saved_lazy;
+    unsigned lazy_cnt;
+    char printbuf[PJSIP_MAX_PKT_LEN];
+    pj_ssize_t len;
+    pj_status_t status = PJ_SUCCESS;
+
+    PJ_LOG(3,(THIS_FILE, "  lazy header parsing test.."));
+
+    pool = pjsip_endpt_create_pool(endpt, NULL, POOL_SIZE, POOL_SIZE);
+    saved_lazy = pjsip_cfg()->endpt.lazy_hdr_parsing;
+    pjsip_cfg()->endpt.lazy_hdr_parsing = PJ_TRUE;
+
+    msg = pjsip_parse_msg(pool, msgbuf, pj_ansi_strlen(msgbuf), NULL);
+    if (!msg) {
+        status = -2000;
+        goto on_return;
+    }
+
+    /* Headers needed by the transaction layer must be parsed already */
+    if (!pjsip_msg_find_hdr(msg, PJSIP_H_VIA, NULL) ||
+        !pjsip_msg_find_hdr(msg, PJSIP_H_CSEQ, NULL) ||
+        !pjsip_msg_find_hdr(msg, PJSIP_H_CALL_ID, NULL))
+    {
+        status = -2010;
+        goto on_return;
+    }
+
+    /* Contact, Expires and Allow must not have been parsed yet */
+    for (hdr=msg->hdr.next, lazy_cnt=0; hdr!=&msg->hdr; hdr=hdr->next) {
+        if (pjsip_hdr_is_lazy(hdr))
+            ++lazy_cnt;
+        if (hdr->type == PJSIP_H_CONTACT || hdr->type == PJSIP_H_EXPIRES) {
+            status = -2020;
+            goto on_return;
+        }
+    }
+    if (lazy_cnt != 3) {
+        status = -2030;
+        goto on_return;
+    }
+
+    /* Clone and print the message while headers are still lazy */
+    clone = pjsip_msg_clone(pool, msg);
+    len = pjsip_msg_print(clone, printbuf, sizeof(printbuf));
+    if (len < 1 || pj_ansi_strstr(printbuf, "Allow: INVITE, ACK, BYE")==NULL) {
+        status = -2040;
+        goto on_return;
+    }
+
+    /* Lookup must parse compact form Contact into two headers */
+    contact = (pjsip_contact_hdr*)
+              pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT, NULL);
+    if (!contact || contact->uri == NULL) {
+        status = -2050;
+        goto on_return;
+    }
+    contact = (pjsip_contact_hdr*)
+              pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT, contact->next);
+    if (!contact || contact->expires != 60) {
+        status = -2060;
+        goto on_return;
+    }
+
+    expires = (pjsip_expires_hdr*)
+              pjsip_msg_find_hdr(msg, PJSIP_H_EXPIRES, NULL);
+    if (!expires || expires->ivalue != 3600) {
+        status = -2070;
+        goto on_return;
+    }
+
+    allow = (pjsip_allow_hdr*)
+            pjsip_msg_find_hdr_by_name(msg, &hname_allow, NULL);
+    if (!allow || allow->type != PJSIP_H_ALLOW || allow->count != 3) {
+        status = -2080;
+        goto on_return;
+    }
+
+    /* The clone must be parsed independently */
+    contact = (pjsip_contact_hdr*)
+              pjsip_msg_find_hdr(clone, PJSIP_H_CONTACT, NULL);
+    if (!contact || contact->uri == NULL) {
+        status = -2090;
+        goto on_return;
+    }
+
+    for (hdr=msg->hdr.next; hdr!=&msg->hdr; hdr=hdr->next) {
+        if (pjsip_hdr_is_lazy(hdr)) {
+            status = -2100;
+            goto on_return;
+        }
+    }
+
+on_return:
+    pjsip_cfg()->endpt.lazy_hdr_parsing = saved_lazy;
+    pjsip_endpt_release_pool(endpt, pool);
+    return status;
+}
+
+
+/*
+ * The non-throwing parser must give identical result as the normal parser,
+ * including for broken messages.
+ */
+static const char *nothrow_msgs[] =
+{
+    /* Header parsers and URI parsers which are not built-in */
+    "INVITE tel:+1-212-555-1234 SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bKnothrow;ttl=20\r\n"
+    "To: <tel:+1-212-555-1234;phone-context=example.com>\r\n"
+    "From: \"Alice\" <sip:alice@example.com:5061;transport=tcp>;tag=12\r\n"
+    "Call-ID: nothrow@10.0.0.1\r\n"
+    "CSeq: 10 INVITE\r\n"
+    "Authorization: Digest username=\"alice\", realm=\"example.com\", "
+    "nonce=\"abc\", uri=\"sip:example.com\", response=\"0123\"\r\n"
+    "Contact: <sip:alice@10.0.0.1>;q=0.7;expires=10\r\n"
+    "Retry-After: 30 (busy);duration=10\r\n"
+    "Require: timer, 100rel\r\n"
+    "Supported: replaces\r\n"
+    "Content-Type: text/plain;charset=utf-8\r\n"
+    "Content-Length: 7\r\n"
+    "\r\n"
+    "hello\r\n",
+
+    /* Errors in headers, see also msg_err_test.c */
+    "SIP/2.0 180 Ringing\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.1:99999;branch=z9hG4bKnothrow\r\n"
+    "Via: SIP/2.0 10.0.0.1\r\n"
+    "To: \"Bob\" sip:bob@example.com\r\n"
+    "From: <sip:alice@example.com;tag=12\r\n"
+    "Call-ID: nothrow@10.0.0.1\r\n"
+    "CSeq: 99999999999 INVITE\r\n"
+    "Contact: <sip:alice@10.0.0.1>;q=2147483.999\r\n"
+    "Route: <tel:>\r\n"
+    "Require: timer\r\n"
+    "Require: \r\n"
+    "Max-Forwards: abc\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+};
+
+/* Compare the printed representation of two headers */
+static pj_bool_t hdr_equal(const void *hdr1, const void *hdr2)
+{
+    char buf1[PJSIP_MAX_URL_SIZE], buf2[PJSIP_MAX_URL_SIZE];
+    int len1, len2;
+
+    if (!hdr1 || !hdr2)
+        return hdr1 == hdr2;
+
+    len1 = pjsip_hdr_print_on((void*)hdr1, buf1, sizeof(buf1));
+    len2 = pjsip_hdr_print_on((void*)hdr2, buf2, sizeof(buf2));
+    return len1 == len2 && (len1 < 1 || pj_memcmp(buf1, buf2, len1) == 0);
+}
+
+/* Parse the buffer with both parsers, and compare the results */
+static int nothrow_compare(pj_pool_t *pool, const char *input, pj_size_t len)
+{
+    static char buf1[PJSIP_MAX_PKT_LEN], buf2[PJSIP_MAX_PKT_LEN];
+    static char print1[PJSIP_MAX_PKT_LEN], print2[PJSIP_MAX_PKT_LEN];
+    pjsip_rx_data *rdata1, *rdata2;
+    pjsip_parser_err_report *e1, *e2;
+    pjsip_msg *msg1, *msg2;
+    pj_status_t status;
+
+    /* Use separate copies, the parser may unescape in place */
+    pj_memcpy(buf1, input, len);
+    pj_memcpy(buf2, input, len);
+    buf1[len] = buf2[len] = '\0';
+
+    rdata1 = PJ_POOL_ZALLOC_T(pool, pjsip_rx_data);
+    rdata2 = PJ_POOL_ZALLOC_T(pool, pjsip_rx_data);
+    rdata1->tp_info.pool = rdata2->tp_info.pool = pool;
+    pj_list_init(&rdata1->msg_info.parse_err);
+    pj_list_init(&rdata2->msg_info.parse_err);
+
+    msg1 = pjsip_parse_rdata(buf1, len, rdata1);
+    status = pjsip_parse_rdata2(buf2, len, rdata2);
+    msg2 = rdata2->msg_info.msg;
+
+    if ((msg1 == NULL) != (msg2 == NULL) ||
+        (status == PJ_SUCCESS) != (msg2 != NULL))
+    {
+        return -2210;
+    }
+
+    if (msg1) {
+        pj_ssize_t len1, len2;
+
+        len1 = pjsip_msg_print(msg1, print1, sizeof(print1));
+        len2 = pjsip_msg_print(msg2, print2, sizeof(print2));
+        if (len1 != len2 || (len1 > 0 && pj_memcmp(print1, print2, len1)))
+            return -2220;
+    }
+
+#define CMP_INFO(field) hdr_equal(rdata1->msg_info.field, \
+                                  rdata2->msg_info.field)
+    if (!CMP_INFO(cid) || !CMP_INFO(from) || !CMP_INFO(to) ||
+        !CMP_INFO(via) || !CMP_INFO(cseq) || !CMP_INFO(max_fwd) ||
+        !CMP_INFO(route) || !CMP_INFO(record_route) || !CMP_INFO(ctype) ||
+        !CMP_INFO(clen) || !CMP_INFO(require) || !CMP_INFO(supported))
+    {
+        return -2230;
+    }
+#undef CMP_INFO
+
+    e1 = rdata1->msg_info.parse_err.next;
+    e2 = rdata2->msg_info.parse_err.next;
+    while (e1 != &rdata1->msg_info.parse_err &&
+           e2 != &rdata2->msg_info.parse_err)
+    {
+        if (e1->except_code != e2->except_code || e1->line != e2->line ||
+            e1->col != e2->col || pj_strcmp(&e1->hname, &e2->hname))
+        {
+            return -2240;
+        }
+        e1 = e1->next;
+        e2 = e2->next;
+    }
+    if (e1 != &rdata1->msg_info.parse_err ||
+        e2 != &rdata2->msg_info.parse_err)
+    {
+        return -2250;
+    }
+
+    return 0;
+}
+
+static int nothrow_compare_mutations(const char *msg, pj_size_t len)
+{
+    static const char chars[] = { '<', ';', ':', '"', ',', '\n', '9', 'z' };
+    char buf[PJSIP_MAX_PKT_LEN];
+    int log_level = pj_log_get_level();
+    pj_size_t i;
+    unsigned j;
+    int rc;
+
+    pj_memcpy(buf, msg, len);
+
+    for (i=0; i<len; ++i) {
+        pj_pool_t *pool;
+
+        pool = pjsip_endpt_create_pool(endpt, NULL, POOL_SIZE, POOL_SIZE);
+
+        /* Mute the parser's logging of invalid values */
+        pj_log_set_level(0);
+
+        /* Truncated message */
+        rc = nothrow_compare(pool, buf, i);
+
+        /* Replaced character */
+        for (j=0; j<PJ_ARRAY_SIZE(chars) && rc==0; ++j) {
+            char c = buf[i];
+            buf[i] = chars[j];
+            rc = nothrow_compare(pool, buf, len);
+            buf[i] = c;
+        }
+
+        pj_log_set_level(log_level);
+        pjsip_endpt_release_pool(endpt, pool);
+
+        if (rc != 0) {
+            PJ_LOG(3,(THIS_FILE, "   error: result mismatch at offset %d",
+                      (int)i));
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+/* Test the non-throwing parser */
+static pj_status_t nothrow_test(void)
+{
+    pj_bool_t saved_lazy = pjsip_cfg()->endpt.lazy_hdr_parsing;
+    unsigned i, lazy;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  non-throwing parser test.."));
+
+    for (lazy=0; lazy<2 && rc==0; ++lazy) {
+        pjsip_cfg()->endpt.lazy_hdr_parsing = lazy;
+
+        for (i=0; i<PJ_ARRAY_SIZE(test_array) && rc==0; ++i) {
+            struct test_msg *entry = &test_array[i];
+
+            if (entry->len == 0)
+                entry->len = pj_ansi_strlen(entry->msg);
+            rc = nothrow_compare_mutations(entry->msg, entry->len);
+        }
+
+        for (i=0; i<PJ_ARRAY_SIZE(nothrow_msgs) && rc==0; ++i) {
+            rc = nothrow_compare_mutations(nothrow_msgs[i],
+                                           pj_ansi_strlen(nothrow_msgs[i]));
+        }
+    }
+
+    pjsip_cfg()->endpt.lazy_hdr_parsing = saved_lazy;
+    return rc;
 }
 
 
@@ -924,6 +1260,123 @@ static int msg_benchmark(unsigned *p_detect, unsigned *p_parse,
     *p_print = (unsigned)avg_print;
     return status;
 }
+
+/* Compare message parsing speed with each scanner implementation */
+static int scanner_benchmark(void)
+{
+    static const struct {
+        pj_scan_impl impl;
+        const char  *name;
+    } impls[] = {
+        { PJ_SCAN_IMPL_SCALAR,  "scalar" },
+        { PJ_SCAN_IMPL_SSE42,   "SSE4.2" },
+        { PJ_SCAN_IMPL_AVX2,    "AVX2" }
+    };
+    enum { RUN = 3 };
+    pj_scan_impl saved_impl = pj_scan_get_impl();
+    unsigned i, run, loop, j;
+    pj_status_t status = PJ_SUCCESS;
+
+    PJ_LOG(3,(THIS_FILE, "  benchmarking scanner implementations.."));
+
+    for (i=0; i<PJ_ARRAY_SIZE(impls); ++i) {
+        pj_uint32_t best = 0;
+
+        if (pj_scan_set_impl(impls[i].impl) != PJ_SUCCESS) {
+            PJ_LOG(3,(THIS_FILE, "    %s: not supported", impls[i].name));
+            continue;
+        }
+
+        for (run=0; run<RUN; ++run) {
+            pj_timestamp zero;
+            pj_uint32_t usec, rate;
+            unsigned count = 0;
+
+            pj_bzero(&var, sizeof(var));
+            var.flag = FLAG_PARSE_ONLY;
+            zero.u64 = 0;
+
+            for (loop=0; loop<LOOP; ++loop) {
+                for (j=0; j<PJ_ARRAY_SIZE(test_array); ++j) {
+                    pj_pool_t *pool;
+
+                    pool = pjsip_endpt_create_pool(endpt, NULL, POOL_SIZE,
+                                                   POOL_SIZE);
+                    status = test_entry(pool, &test_array[j]);
+                    pjsip_endpt_release_pool(endpt, pool);
+                    if (status != PJ_SUCCESS)
+                        goto on_return;
+                    ++count;
+                }
+            }
+
+            usec = pj_elapsed_usec(&zero, &var.parse_time);
+            rate = usec ? (pj_uint32_t)((pj_uint64_t)count*1000000/usec) : 0;
+            if (rate > best)
+                best = rate;
+        }
+
+        PJ_LOG(3,(THIS_FILE, "    %s: %u msg parsing/sec",
+                  impls[i].name, best));
+    }
+
+on_return:
+    var.flag = 0;
+    pj_scan_set_impl(saved_impl);
+    return status;
+}
+
+/* Compare message parsing speed of pjsip_parse_msg() and the non-throwing
+ * pjsip_parse_msg2().
+ */
+static int nothrow_benchmark(void)
+{
+    static const char *names[] = { "pjsip_parse_msg()", "pjsip_parse_msg2()" };
+    enum { RUN = 3 };
+    unsigned i, run, loop, j;
+    pj_status_t status = PJ_SUCCESS;
+
+    PJ_LOG(3,(THIS_FILE, "  benchmarking non-throwing parser.."));
+
+    for (i=0; i<PJ_ARRAY_SIZE(names); ++i) {
+        pj_uint32_t best = 0;
+
+        for (run=0; run<RUN; ++run) {
+            pj_timestamp zero;
+            pj_uint32_t usec, rate;
+            unsigned count = 0;
+
+            pj_bzero(&var, sizeof(var));
+            var.flag = FLAG_PARSE_ONLY | (i ? FLAG_NOTHROW : 0);
+            zero.u64 = 0;
+
+            for (loop=0; loop<LOOP; ++loop) {
+                for (j=0; j<PJ_ARRAY_SIZE(test_array); ++j) {
+                    pj_pool_t *pool;
+
+                    pool = pjsip_endpt_create_pool(endpt, NULL, POOL_SIZE,
+                                                   POOL_SIZE);
+                    status = test_entry(pool, &test_array[j]);
+                    pjsip_endpt_release_pool(endpt, pool);
+                    if (status != PJ_SUCCESS)
+                        goto on_return;
+                    ++count;
+                }
+            }
+
+            usec = pj_elapsed_usec(&zero, &var.parse_time);
+            rate = usec ? (pj_uint32_t)((pj_uint64_t)count*1000000/usec) : 0;
+            if (rate > best)
+                best = rate;
+        }
+
+        PJ_LOG(3,(THIS_FILE, "    %s: %u msg parsing/sec", names[i], best));
+    }
+
+on_return:
+    var.flag = 0;
+    return status;
+}
 #endif  /* INCLUDE_BENCHMARKS */
 
 /*****************************************************************************/
@@ -2004,6 +2457,8 @@ int msg_test(void)
     char desc[250];
     pj_status_t status;
 
+    pj_bzero(run, sizeof(run));
+
     status = hdr_test();
     if (status != 0)
         return status;
@@ -2012,6 +2467,14 @@ int msg_test(void)
     if (status != PJ_SUCCESS)
         return status;
 
+    status = lazy_test();
+    if (status != PJ_SUCCESS)
+        return status;
+
+    status = nothrow_test();
+    if (status != PJ_SUCCESS)
+        return status;
+
 #if INCLUDE_BENCHMARKS
     for (i=0; i<COUNT; ++i) {
         PJ_LOG(3,(THIS_FILE, "  benchmarking (%d of %d)..", i+1, COUNT));
@@ -2020,6 +2483,14 @@ int msg_test(void)
             return status;
     }
 
+    status = scanner_benchmark();
+    if (status != PJ_SUCCESS)
+        return status;
+
+    status = nothrow_benchmark();
+    if (status != PJ_SUCCESS)
+        return status;
+
     /* Calculate average message length */
     for (i=0, avg_len=0; i<PJ_ARRAY_SIZE(test_array); ++i) {
         avg_len += (unsigned)test_array[i].len;
@@ -145,14 +145,14 @@ static pj_bool_t regs_rx_request(pjsip_rx_data *rdata)
         if (registrar.cfg.contact_op == EXACT ||
             registrar.cfg.contact_op == MODIFIED) 
         {
-            pjsip_hdr *hsrc;
+            pjsip_hdr *hsrc = &msg->hdr;
 
-            for (hsrc=msg->hdr.next; hsrc!=&msg->hdr; hsrc=hsrc->next) {
+            while ((hsrc = (pjsip_hdr*)
+                           pjsip_msg_find_hdr(msg, PJSIP_H_CONTACT,
+                                              hsrc->next)) != NULL)
+            {
                 pjsip_contact_hdr *hdst;
 
-                if (hsrc->type != PJSIP_H_CONTACT)
-                    continue;
-
                 hdst = (pjsip_contact_hdr*)
                        pjsip_hdr_clone(rdata->tp_info.pool, hsrc);
 
@@ -1005,7 +1005,8 @@ int regc_test(void)
         },
     };
 
-    unsigned i;
+    unsigned i, lazy;
+    pj_bool_t old_lazy = pjsip_cfg()->endpt.lazy_hdr_parsing;
     pj_sockaddr_in addr;
     pjsip_transport *udp = NULL;
     pj_uint16_t port; 
@@ -1052,72 +1053,84 @@ int regc_test(void)
                     "sip:127.0.0.1:%d", (int)port);
     registrar_uri = pj_str(registrar_uri_buf);
 
-    for (i=0; i<PJ_ARRAY_SIZE(test_rec); ++i) {
-        struct test_rec *t = &test_rec[i];
-        unsigned j, x;
-        pj_str_t reg_uri;
-        pj_str_t contacts[8];
-
-        /* Fill in the registrar address if it's not specified */
-        if (t->alt_registrar == NULL) {
-            reg_uri = registrar_uri;
-        } else {
-            reg_uri = pj_str(t->alt_registrar);
-        }
+    /* Run the tests, then repeat the successful registrations with lazy
+     * header parsing, where the Contact and WWW-Authenticate headers in
+     * the responses are only parsed when they are looked up.
+     */
+    for (lazy=0; lazy<=1; ++lazy) {
+        pjsip_cfg()->endpt.lazy_hdr_parsing = lazy;
 
-        /* Build contact pj_str_t's */
-        for (j=0; j<t->contact_cnt; ++j) {
-            contacts[j] = pj_str(t->contacts[j]);
-        }
+        for (i=0; i<PJ_ARRAY_SIZE(test_rec); ++i) {
+            struct test_rec *t = &test_rec[i];
+            unsigned j, x;
+            pj_str_t reg_uri;
+            pj_str_t contacts[8];
 
-        /* Normalize more_contacts field */
-        if (t->server_cfg.more_contacts.ptr)
-            t->server_cfg.more_contacts.slen = strlen(t->server_cfg.more_contacts.ptr);
+            if (lazy && t->client_cfg.code != 200)
+                continue;
 
-        /* Do tests with three combinations:
-         *  - check_contact on/off
-         *  - add_xuid_param on/off
-         *  - destroy_on_callback on/off
-         */
-        for (x=1; x<=2; ++x) {
-            unsigned y;
+            /* Fill in the registrar address if it's not specified */
+            if (t->alt_registrar == NULL) {
+                reg_uri = registrar_uri;
+            } else {
+                reg_uri = pj_str(t->alt_registrar);
+            }
 
-            if ((t->check_contact & x) == 0)
-                continue;
+            /* Build contact pj_str_t's */
+            for (j=0; j<t->contact_cnt; ++j) {
+                contacts[j] = pj_str(t->contacts[j]);
+            }
 
-            pjsip_cfg()->regc.check_contact = (x-1);
+            /* Normalize more_contacts field */
+            if (t->server_cfg.more_contacts.ptr)
+                t->server_cfg.more_contacts.slen = strlen(t->server_cfg.more_contacts.ptr);
 
-            for (y=1; y<=2; ++y) {
-                unsigned z;
+            /* Do tests with three combinations:
+             *  - check_contact on/off
+             *  - add_xuid_param on/off
+             *  - destroy_on_callback on/off
+             */
+            for (x=1; x<=2; ++x) {
+                unsigned y;
 
-                if ((t->add_xuid_param & y) == 0)
+                if ((t->check_contact & x) == 0)
                     continue;
 
-                pjsip_cfg()->regc.add_xuid_param = (y-1);
+                pjsip_cfg()->regc.check_contact = (x-1);
 
-                for (z=0; z<=1; ++z) {
-                    char new_title[200];
+                for (y=1; y<=2; ++y) {
+                    unsigned z;
 
-                    t->client_cfg.destroy_on_cb = z;
+                    if ((t->add_xuid_param & y) == 0)
+                        continue;
 
-                    pj_ansi_snprintf(new_title, sizeof(new_title),
-                            "%s [check=%d, xuid=%d, destroy=%d]", 
-                            t->title, pjsip_cfg()->regc.check_contact,
-                            pjsip_cfg()->regc.add_xuid_param, z);
-                    rc = do_test(new_title, &t->server_cfg, &t->client_cfg, 
-                                 &reg_uri, t->contact_cnt, contacts, 
-                                 t->expires, PJ_FALSE, NULL);
-                    if (rc != 0)
-                        goto on_return;
-                }
+                    pjsip_cfg()->regc.add_xuid_param = (y-1);
+
+                    for (z=0; z<=1; ++z) {
+                        char new_title[200];
+
+                        t->client_cfg.destroy_on_cb = z;
+
+                        pj_ansi_snprintf(new_title, sizeof(new_title),
+                                "%s [check=%d, xuid=%d, destroy=%d%s]", 
+                                t->title, pjsip_cfg()->regc.check_contact,
+                                pjsip_cfg()->regc.add_xuid_param, z,
+                                (lazy ? ", lazy" : ""));
+                        rc = do_test(new_title, &t->server_cfg, &t->client_cfg, 
+                                     &reg_uri, t->contact_cnt, contacts, 
+                                     t->expires, PJ_FALSE, NULL);
+                        if (rc != 0)
+                            goto on_return;
+                    }
 
+                }
             }
-        }
 
-        /* Sleep between test groups to avoid using up too many
-         * active transactions.
-         */
-        pj_thread_sleep(1000);
+            /* Sleep between test groups to avoid using up too many
+             * active transactions.
+             */
+            pj_thread_sleep(1000);
+        }
     }
 
     /* keep-alive test */
@@ -1151,6 +1164,7 @@ int regc_test(void)
         goto on_return;
 
 on_return:
+    pjsip_cfg()->endpt.lazy_hdr_parsing = old_lazy;
     if (registrar.mod.id != -1) {
         pjsip_endpt_unregister_module(endpt, &registrar.mod);
     }
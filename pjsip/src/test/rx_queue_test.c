@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "test.h"
+#include <pjsip.h>
+#include <pjlib.h>
+
+#define THIS_FILE   "rx_queue_test.c"
+
+#define QUEUE_CNT       4
+#define CALL_CNT        16
+#define MSG_CNT         20      /* Messages per call                */
+#define EXTRA_CNT       10      /* Messages that overflow the queue */
+#define DRAIN_CNT       100     /* Messages queued on destroy       */
+#define WAIT_MSEC       5000
+
+#define TARGET  "sip:bob@127.0.0.1;transport=loop-dgram"
+#define FROM    "<sip:alice@127.0.0.1>"
+
+/*
+ * Test the endpoint's receive queues. The messages are sent through the
+ * datagram loop transport without delay, so they are received (and queued)
+ * by the sending thread:
+ *  - the messages of a Call-ID are processed by one worker, in order,
+ *  - a message is processed by the receiving thread when its queue is
+ *    full,
+ *  - the queued messages are processed when the endpoint is destroyed.
+ * The test recreates the endpoint.
+ */
+static struct call_data
+{
+    pj_thread_t    *thread;     /* Thread that processed the call   */
+    int             last_cseq;
+    int             rx_cnt;
+} calls[CALL_CNT];
+
+static pj_thread_t *sender;     /* The test thread                  */
+static pj_sem_t    *block_sem;  /* Blocks the worker                */
+static pj_str_t     block_cid;  /* Call-ID whose CSeq 1 blocks      */
+static pj_bool_t    blocked;    /* Worker is blocked                */
+static pj_atomic_t *total_cnt;  /* Total messages processed         */
+static int          inline_cnt; /* Processed by the receiving thread*/
+static int          order_err;
+static int          thread_err;
+
+static pj_bool_t on_rx_request(pjsip_rx_data *rdata);
+
+static pjsip_module mod_rx_queue_test =
+{
+    NULL, NULL,                         /* prev, next.          */
+    { "mod-rx-queue-test", 17 },        /* Name.                */
+    -1,                                 /* Id                   */
+    PJSIP_MOD_PRIORITY_APPLICATION,     /* Priority             */
+    NULL,                               /* load()               */
+    NULL,                               /* start()              */
+    NULL,                               /* stop()               */
+    NULL,                               /* unload()             */
+    &on_rx_request,                     /* on_rx_request()      */
+    NULL,                               /* on_rx_response()     */
+    NULL,                               /* on_tx_request.       */
+    NULL,                               /* on_tx_response()     */
+    NULL,                               /* on_tsx_state()       */
+};
+
+static pj_bool_t on_rx_request(pjsip_rx_data *rdata)
+{
+    const pj_str_t *cid = &rdata->msg_info.cid->id;
+    int cseq = rdata->msg_info.cseq->cseq;
+    pj_thread_t *thread = pj_thread_this();
+    unsigned idx;
+
+    if (thread == sender)
+        ++inline_cnt;
+
+    if (block_cid.slen && pj_strcmp(cid, &block_cid) == 0) {
+        if (cseq == 1) {
+            blocked = PJ_TRUE;
+            pj_sem_wait(block_sem);
+        }
+        pj_atomic_inc(total_cnt);
+        return PJ_TRUE;
+    }
+
+    /* Call-ID is "rxq-<idx>" */
+    idx = CALL_CNT;
+    if (cid->slen > 4) {
+        pj_str_t num;
+
+        pj_strset(&num, cid->ptr + 4, cid->slen - 4);
+        idx = (unsigned)pj_strtoul(&num);
+    }
+
+    if (idx >= CALL_CNT || thread == sender) {
+        ++thread_err;
+    } else {
+        struct call_data *call = &calls[idx];
+
+        if (call->thread == NULL)
+            call->thread = thread;
+        else if (call->thread != thread)
+            ++thread_err;
+
+        if (cseq != call->last_cseq + 1)
+            ++order_err;
+        call->last_cseq = cseq;
+        ++call->rx_cnt;
+    }
+
+    pj_atomic_inc(total_cnt);
+    return PJ_TRUE;
+}
+
+static pj_status_t send_msg(const pj_str_t *cid, int cseq)
+{
+    pjsip_tx_data *tdata;
+    const pj_str_t target = pj_str(TARGET);
+    const pj_str_t from = pj_str(FROM);
+    pj_status_t status;
+
+    status = pjsip_endpt_create_request(endpt, &pjsip_options_method, &target,
+                                        &from, &target, NULL, cid, cseq,
+                                        NULL, &tdata);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    return pjsip_endpt_send_request_stateless(endpt, tdata, NULL, NULL);
+}
+
+/* Wait until the expected number of messages have been processed */
+static pj_bool_t wait_rx_cnt(int cnt)
+{
+    unsigned i;
+
+    for (i=0; i<WAIT_MSEC/10 && pj_atomic_get(total_cnt) < cnt; ++i)
+        pj_thread_sleep(10);
+
+    return (pj_atomic_get(total_cnt) == cnt);
+}
+
+/* Recreate the endpoint as created by test_main() */
+static pj_status_t init_endpt(void)
+{
+    pj_status_t status;
+
+    status = pjsip_endpt_create(&caching_pool.factory, "endpt", &endpt);
+    if (status == PJ_SUCCESS)
+        status = pjsip_tsx_layer_init_module(endpt);
+    if (status == PJ_SUCCESS)
+        status = pjsip_loop_start(endpt, NULL);
+
+    return status;
+}
+
+static int unblock_thread(void *arg)
+{
+    PJ_UNUSED_ARG(arg);
+
+    pj_thread_sleep(200);
+    pj_sem_post(block_sem);
+    return 0;
+}
+
+int rx_queue_test(void)
+{
+    pj_pool_t *pool;
+    pj_thread_t *unblock = NULL;
+    pj_thread_t *threads[QUEUE_CNT];
+    unsigned i, j, thread_cnt;
+    int expected;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "testing endpoint receive queues"));
+
+    pool = pj_pool_create(&caching_pool.factory, "rxqtest", 1000, 1000,
+                          NULL);
+    status = pj_sem_create(pool, "rxqtest", 0, 1, &block_sem);
+    if (status == PJ_SUCCESS)
+        status = pj_atomic_create(pool, 0, &total_cnt);
+    if (status != PJ_SUCCESS) {
+        if (block_sem)
+            pj_sem_destroy(block_sem);
+        pj_pool_release(pool);
+        return -10;
+    }
+
+    pj_bzero(calls, sizeof(calls));
+    sender = pj_thread_this();
+    block_cid.slen = 0;
+    blocked = PJ_FALSE;
+    inline_cnt = order_err = thread_err = 0;
+
+    /* The queues live until the endpoint is destroyed, so the test needs
+     * an endpoint of its own.
+     */
+    pjsip_endpt_destroy(endpt);
+    endpt = NULL;
+    status = init_endpt();
+    if (status == PJ_SUCCESS)
+        status = pjsip_endpt_register_module(endpt, &mod_rx_queue_test);
+    if (status == PJ_SUCCESS)
+        status = pjsip_endpt_create_rx_queues(endpt, QUEUE_CNT);
+    if (status != PJ_SUCCESS) {
+        app_perror("   error: unable to create endpoint", status);
+        rc = -20;
+        goto on_return;
+    }
+
+    /* Calls are processed in order, each by a single worker */
+    for (i=0; i<MSG_CNT; ++i) {
+        for (j=0; j<CALL_CNT; ++j) {
+            char cid_buf[16];
+            pj_str_t cid;
+
+            cid.ptr = cid_buf;
+            cid.slen = pj_ansi_snprintf(cid_buf, sizeof(cid_buf),
+                                        "rxq-%d", j);
+            status = send_msg(&cid, i+1);
+            if (status != PJ_SUCCESS) {
+                app_perror("   error: sending message", status);
+                rc = -30;
+                goto on_return;
+            }
+        }
+    }
+
+    expected = CALL_CNT * MSG_CNT;
+    if (!wait_rx_cnt(expected)) {
+        PJ_LOG(3,(THIS_FILE, "   error: %d of %d messages processed",
+                  (int)pj_atomic_get(total_cnt), expected));
+        rc = -40;
+        goto on_return;
+    }
+
+    if (order_err || thread_err) {
+        PJ_LOG(3,(THIS_FILE, "   error: %d out of order, %d on the wrong "
+                  "thread", order_err, thread_err));
+        rc = -50;
+        goto on_return;
+    }
+
+    /* The calls are spread over the workers */
+    for (i=0, thread_cnt=0; i<CALL_CNT; ++i) {
+        for (j=0; j<thread_cnt && threads[j] != calls[i].thread; ++j)
+            ;
+        if (j == thread_cnt && thread_cnt < QUEUE_CNT)
+            threads[thread_cnt++] = calls[i].thread;
+        if (calls[i].rx_cnt != MSG_CNT) {
+            rc = -60;
+            goto on_return;
+        }
+    }
+    if (thread_cnt < 2) {
+        PJ_LOG(3,(THIS_FILE, "   error: all calls on one worker"));
+        rc = -70;
+        goto on_return;
+    }
+
+    /* Block a worker, then overflow its queue. The messages that don't
+     * fit must be processed by the receiving thread.
+     */
+    block_cid = pj_str("rxq-block");
+    status = send_msg(&block_cid, 1);
+    for (i=0; i<WAIT_MSEC/10 && !blocked; ++i)
+        pj_thread_sleep(10);
+    if (status != PJ_SUCCESS || !blocked) {
+        rc = -80;
+        goto on_return;
+    }
+
+    for (i=0; i<PJSIP_RX_QUEUE_SIZE + EXTRA_CNT; ++i) {
+        status = send_msg(&block_cid, i+2);
+        if (status != PJ_SUCCESS) {
+            app_perror("   error: sending message", status);
+            pj_sem_post(block_sem);
+            rc = -90;
+            goto on_return;
+        }
+    }
+
+    if (inline_cnt != EXTRA_CNT) {
+        PJ_LOG(3,(THIS_FILE, "   error: %d messages processed inline, "
+                  "expecting %d", inline_cnt, EXTRA_CNT));
+        pj_sem_post(block_sem);
+        rc = -100;
+        goto on_return;
+    }
+
+    pj_sem_post(block_sem);
+    expected += 1 + PJSIP_RX_QUEUE_SIZE + EXTRA_CNT;
+    if (!wait_rx_cnt(expected)) {
+        PJ_LOG(3,(THIS_FILE, "   error: %d of %d messages processed",
+                  (int)pj_atomic_get(total_cnt), expected));
+        rc = -110;
+        goto on_return;
+    }
+
+    /* Destroy the endpoint while the worker is blocked with messages in
+     * its queue. They must all be processed before destroy returns.
+     */
+    block_cid = pj_str("rxq-drain");
+    blocked = PJ_FALSE;
+    status = send_msg(&block_cid, 1);
+    for (i=0; i<WAIT_MSEC/10 && !blocked; ++i)
+        pj_thread_sleep(10);
+    if (status != PJ_SUCCESS || !blocked) {
+        rc = -120;
+        goto on_return;
+    }
+
+    for (i=0; i<DRAIN_CNT; ++i) {
+        status = send_msg(&block_cid, i+2);
+        if (status != PJ_SUCCESS) {
+            app_perror("   error: sending message", status);
+            pj_sem_post(block_sem);
+            rc = -130;
+            goto on_return;
+        }
+    }
+
+    status = pj_thread_create(pool, "rxqunblock", &unblock_thread, NULL,
+                              0, 0, &unblock);
+    if (status != PJ_SUCCESS) {
+        pj_sem_post(block_sem);
+        rc = -140;
+        goto on_return;
+    }
+
+    expected += 1 + DRAIN_CNT;
+    pjsip_endpt_destroy(endpt);
+    endpt = NULL;
+
+    if (pj_atomic_get(total_cnt) != expected) {
+        PJ_LOG(3,(THIS_FILE, "   error: %d of %d messages processed on "
+                  "destroy", (int)pj_atomic_get(total_cnt), expected));
+        rc = -150;
+    }
+
+on_return:
+    if (endpt)
+        pjsip_endpt_destroy(endpt);
+    endpt = NULL;
+    if (init_endpt() != PJ_SUCCESS && rc == 0)
+        rc = -160;
+    if (unblock) {
+        pj_thread_join(unblock);
+        pj_thread_destroy(unblock);
+    }
+    pj_atomic_destroy(total_cnt);
+    pj_sem_destroy(block_sem);
+    block_sem = NULL;
+    pj_pool_release(pool);
+    return rc;
+}
@@ -69,6 +69,7 @@ static struct {
     { "tsx_bench", 0},
     { "udp", 0},
     { "loop", 0},
+    { "rx_queue", 0},
     { "tcp", 0},
     { "resolve", 0},
     { "tsx", 0},
@@ -84,6 +85,7 @@ enum tests_to_run {
     include_tsx_bench,
     include_udp_test,
     include_loop_test,
+    include_rx_queue_test,
     include_tcp_test,
     include_resolve_test,
     include_tsx_test,
@@ -487,8 +489,14 @@ int test_main(char *testlist)
 #endif
 
     /*
-     * Better be last because it recreates the endpt
+     * Better be last because they recreate the endpt
      */
+#if INCLUDE_RX_QUEUE_TEST
+    if (SHOULD_RUN_TEST(include_rx_queue_test)) {
+        DO_TEST(rx_queue_test());
+    }
+#endif
+
 #if INCLUDE_TSX_DESTROY_TEST
     if (SHOULD_RUN_TEST(include_tsx_destroy_test)) {
         DO_TEST(tsx_destroy_test());
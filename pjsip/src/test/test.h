@@ -65,6 +65,7 @@ extern pj_caching_pool caching_pool;
 #define INCLUDE_TSX_BENCH       (INCLUDE_MESSAGING_GROUP && WITH_BENCHMARK)
 #define INCLUDE_UDP_TEST        INCLUDE_TRANSPORT_GROUP
 #define INCLUDE_LOOP_TEST       INCLUDE_TRANSPORT_GROUP
+#define INCLUDE_RX_QUEUE_TEST   INCLUDE_TRANSPORT_GROUP
 #define INCLUDE_TCP_TEST        INCLUDE_TRANSPORT_GROUP
 #define INCLUDE_RESOLVE_TEST    INCLUDE_TRANSPORT_GROUP
 #define INCLUDE_TSX_TEST        INCLUDE_TSX_GROUP
@@ -83,6 +84,7 @@ int tsx_bench(void);
 int tsx_destroy_test(void);
 int transport_udp_test(void);
 int transport_loop_test(void);
+int rx_queue_test(void);
 int transport_tcp_test(void);
 int resolve_test(void);
 int regc_test(void);
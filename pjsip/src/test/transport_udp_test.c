@@ -106,6 +106,259 @@ static pj_status_t multi_transport_test(pjsip_transport *tp[], unsigned num_tp)
     return PJ_SUCCESS;
 }
 
+#define REUSEPORT_CALL_ID    "reuseport-test"
+
+/* Test-only accessor in sip_transport_udp.c */
+pj_status_t pjsip_udp_transport_get_sock_stat(pjsip_transport *transport,
+                                              unsigned sock_idx,
+                                              pj_uint32_t *rx_cnt,
+                                              pj_uint32_t *tx_cnt);
+
+static pj_bool_t reuseport_on_rx_request(pjsip_rx_data *rdata)
+{
+    if (pj_strcmp2(&rdata->msg_info.cid->id, REUSEPORT_CALL_ID) != 0)
+        return PJ_FALSE;
+
+    pjsip_endpt_respond_stateless(endpt, rdata, 200, NULL, NULL, NULL);
+    return PJ_TRUE;
+}
+
+static pjsip_module reuseport_module = 
+{
+    NULL, NULL,                         /* prev and next        */
+    { "Reuseport-Test", 14},            /* Name.                */
+    -1,                                 /* Id                   */
+    PJSIP_MOD_PRIORITY_TSX_LAYER-1,     /* Priority             */
+    NULL,                               /* load()               */
+    NULL,                               /* start()              */
+    NULL,                               /* stop()               */
+    NULL,                               /* unload()             */
+    &reuseport_on_rx_request,           /* on_rx_request()      */
+    NULL,                               /* on_rx_response()     */
+    NULL,                               /* on_tsx_state()       */
+};
+
+/*
+ * Send requests from many client sockets (hence many flows) and check
+ * that each response leaves from the socket that received the request.
+ */
+static int reuseport_flow_test(pjsip_transport *udp_tp, unsigned sock_cnt)
+{
+    enum { CLIENT_CNT = 16, MAX_SOCK = 8 };
+    pj_sock_t csock[CLIENT_CNT];
+    pj_uint32_t rx0[MAX_SOCK], tx0[MAX_SOCK];
+    pj_sockaddr_in srv_addr;
+    pj_str_t s;
+    unsigned i, rx_total = 0, reply_cnt = 0;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_ASSERT_RETURN(sock_cnt <= MAX_SOCK, -300);
+
+    for (i=0; i<CLIENT_CNT; ++i)
+        csock[i] = PJ_INVALID_SOCKET;
+
+    status = pjsip_endpt_register_module(endpt, &reuseport_module);
+    if (status != PJ_SUCCESS) {
+        app_perror("   Error: unable to register module", status);
+        return -310;
+    }
+
+    flush_events(100);
+    for (i=0; i<sock_cnt; ++i)
+        pjsip_udp_transport_get_sock_stat(udp_tp, i, &rx0[i], &tx0[i]);
+
+    pj_sockaddr_in_init(&srv_addr, pj_cstr(&s, "127.0.0.1"), TEST_UDP_PORT);
+
+    for (i=0; i<CLIENT_CNT; ++i) {
+        pj_sockaddr_in addr;
+        int addr_len = sizeof(addr);
+        char msg[512];
+        pj_ssize_t len;
+
+        pj_sockaddr_in_init(&addr, pj_cstr(&s, "127.0.0.1"), 0);
+        status = pj_sock_socket(pj_AF_INET(), pj_SOCK_DGRAM(), 0, &csock[i]);
+        if (status == PJ_SUCCESS)
+            status = pj_sock_bind(csock[i], &addr, sizeof(addr));
+        if (status == PJ_SUCCESS)
+            status = pj_sock_getsockname(csock[i], &addr, &addr_len);
+        if (status != PJ_SUCCESS) {
+            app_perror("   Error: unable to create client socket", status);
+            rc = -320;
+            goto on_return;
+        }
+
+        len = pj_ansi_snprintf(msg, sizeof(msg),
+                "OPTIONS sip:bob@127.0.0.1:%d SIP/2.0\r\n"
+                "Via: SIP/2.0/UDP 127.0.0.1:%d;branch=z9hG4bKreuseport%d\r\n"
+                "From: <sip:alice@127.0.0.1>;tag=%d\r\n"
+                "To: <sip:bob@127.0.0.1>\r\n"
+                "Call-ID: " REUSEPORT_CALL_ID "\r\n"
+                "CSeq: %d OPTIONS\r\n"
+                "Content-Length: 0\r\n"
+                "\r\n",
+                TEST_UDP_PORT, pj_sockaddr_in_get_port(&addr), i, i, i+1);
+
+        status = pj_sock_sendto(csock[i], msg, &len, 0, &srv_addr,
+                                sizeof(srv_addr));
+        if (status != PJ_SUCCESS) {
+            app_perror("   Error: unable to send request", status);
+            rc = -330;
+            goto on_return;
+        }
+    }
+
+    /* The main socket is polled by the endpoint */
+    flush_events(200);
+
+    for (i=0; i<CLIENT_CNT; ++i) {
+        pj_fd_set_t rset;
+        pj_time_val timeout = {1, 0};
+        char buf[512];
+        pj_ssize_t len = sizeof(buf) - 1;
+
+        PJ_FD_ZERO(&rset);
+        PJ_FD_SET(csock[i], &rset);
+        if (pj_sock_select((int)csock[i]+1, &rset, NULL, NULL, &timeout) <= 0)
+            continue;
+
+        if (pj_sock_recv(csock[i], buf, &len, 0) == PJ_SUCCESS && len > 0) {
+            buf[len] = '\0';
+            if (pj_ansi_strncmp(buf, "SIP/2.0 200", 11) == 0)
+                ++reply_cnt;
+        }
+    }
+
+    if (reply_cnt != CLIENT_CNT) {
+        PJ_LOG(3,(THIS_FILE, "   error: got %d responses, expecting %d",
+                  reply_cnt, CLIENT_CNT));
+        rc = -340;
+        goto on_return;
+    }
+
+    for (i=0; i<sock_cnt; ++i) {
+        pj_uint32_t rx_cnt, tx_cnt;
+
+        pjsip_udp_transport_get_sock_stat(udp_tp, i, &rx_cnt, &tx_cnt);
+        rx_cnt -= rx0[i];
+        tx_cnt -= tx0[i];
+        rx_total += rx_cnt;
+
+        PJ_LOG(3,(THIS_FILE, "   socket %d: %d requests, %d responses",
+                  i, rx_cnt, tx_cnt));
+        if (rx_cnt != tx_cnt) {
+            PJ_LOG(3,(THIS_FILE, "   error: responses not sent from the "
+                      "socket that received the requests"));
+            rc = -350;
+            goto on_return;
+        }
+    }
+
+    if (rx_total != CLIENT_CNT) {
+        rc = -360;
+        goto on_return;
+    }
+
+on_return:
+    for (i=0; i<CLIENT_CNT; ++i) {
+        if (csock[i] != PJ_INVALID_SOCKET)
+            pj_sock_close(csock[i]);
+    }
+    pjsip_endpt_unregister_module(endpt, &reuseport_module);
+    return rc;
+}
+
+/*
+ * Transport with multiple SO_REUSEPORT sockets.
+ */
+static int reuseport_test(void)
+{
+    enum { SOCK_CNT = 4 };
+    pjsip_udp_transport_cfg cfg;
+    pjsip_transport *udp_tp;
+    int rtt, pkt_lost;
+    pj_status_t status;
+
+    if (pj_SO_REUSEPORT() == 0xFFFF) {
+        PJ_LOG(3,(THIS_FILE, "   SO_REUSEPORT is not supported, skipping"));
+        return 0;
+    }
+
+    pjsip_udp_transport_cfg_default(&cfg, pj_AF_INET());
+    pj_sockaddr_set_port(&cfg.bind_addr, TEST_UDP_PORT);
+    cfg.reuseport_cnt = SOCK_CNT;
+
+    status = pjsip_udp_transport_start2(endpt, &cfg, &udp_tp);
+    if (status != PJ_SUCCESS) {
+        app_perror("   Error: unable to start SO_REUSEPORT UDP transport",
+                   status);
+        return -200;
+    }
+
+    status = generic_transport_test(udp_tp);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    status = transport_send_recv_test(PJSIP_TRANSPORT_UDP, udp_tp,
+                                      "sip:alice@127.0.0.1:"TEST_UDP_PORT_STR,
+                                      &rtt);
+    if (status != 0)
+        return status;
+
+    status = transport_rt_test(PJSIP_TRANSPORT_UDP, udp_tp,
+                               "sip:alice@127.0.0.1:"TEST_UDP_PORT_STR,
+                               &pkt_lost);
+    if (status != 0)
+        return status;
+
+    if (pkt_lost != 0)
+        PJ_LOG(3,(THIS_FILE, "   note: %d packet(s) was lost", pkt_lost));
+
+    status = reuseport_flow_test(udp_tp, SOCK_CNT);
+    if (status != 0)
+        return status;
+
+    /* Pause and restart keeping the sockets */
+    status = pjsip_udp_transport_pause(udp_tp,
+                                       PJSIP_UDP_TRANSPORT_KEEP_SOCKET);
+    if (status == PJ_SUCCESS)
+        status = pjsip_udp_transport_restart2(udp_tp,
+                                              PJSIP_UDP_TRANSPORT_KEEP_SOCKET,
+                                              PJ_INVALID_SOCKET, NULL, NULL);
+    if (status != PJ_SUCCESS) {
+        app_perror("   Error: unable to pause/restart transport", status);
+        return -210;
+    }
+
+    status = reuseport_flow_test(udp_tp, SOCK_CNT);
+    if (status != 0)
+        return status;
+
+    /* Restart recreating all the sockets on the same address */
+    status = pjsip_udp_transport_restart2(udp_tp,
+                                          PJSIP_UDP_TRANSPORT_DESTROY_SOCKET,
+                                          PJ_INVALID_SOCKET, &cfg.bind_addr,
+                                          NULL);
+    if (status != PJ_SUCCESS) {
+        app_perror("   Error: unable to restart transport", status);
+        return -212;
+    }
+
+    status = reuseport_flow_test(udp_tp, SOCK_CNT);
+    if (status != 0)
+        return status;
+
+    if (pj_atomic_get(udp_tp->ref_cnt) != 1)
+        return -220;
+
+    pjsip_transport_dec_ref(udp_tp);
+    status = pjsip_transport_destroy(udp_tp);
+    if (status != PJ_SUCCESS)
+        return -230;
+
+    return 0;
+}
+
 /*
  * UDP transport test.
  */
@@ -172,6 +425,12 @@ int transport_udp_test(void)
     PJ_LOG(3,(THIS_FILE, "   Flushing events, 1 second..."));
     flush_events(1000);
 
+    status = reuseport_test();
+    if (status != 0)
+        return status;
+
+    flush_events(500);
+
     /* Done */
     return 0;
 }
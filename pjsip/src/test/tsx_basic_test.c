@@ -135,6 +135,79 @@ static int double_terminate(void)
     return PJ_SUCCESS;
 }
 
+/* Register more transactions than the initial size of the transaction
+ * table, so that the table shards have to grow, and check that they can
+ * all still be found.
+ */
+static int tsx_table_grow_test(void)
+{
+    enum { TSX_CNT = 4 * (PJSIP_MAX_TSX_COUNT + 1) };
+    pj_str_t target, from;
+    pjsip_tx_data *tdata;
+    pjsip_via_hdr *via;
+    pjsip_transaction **tsx;
+    unsigned i, initial_cnt;
+    int rc = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "  transaction table growth test"));
+
+    target = pj_str(TARGET_URI);
+    from = pj_str(FROM_URI);
+
+    status = pjsip_endpt_create_request(endpt, &pjsip_options_method, &target,
+                                        &from, &target, NULL, NULL, -1, NULL,
+                                        &tdata);
+    if (status != PJ_SUCCESS) {
+        app_perror("  error: unable to create request", status);
+        return -200;
+    }
+
+    via = (pjsip_via_hdr*) pjsip_msg_find_hdr(tdata->msg, PJSIP_H_VIA, NULL);
+    tsx = (pjsip_transaction**)
+          pj_pool_zalloc(tdata->pool, TSX_CNT * sizeof(pjsip_transaction*));
+    initial_cnt = pjsip_tsx_layer_get_tsx_count();
+
+    for (i = 0; i < TSX_CNT; ++i) {
+        status = pjsip_tsx_create_uac(NULL, tdata, &tsx[i]);
+        if (status != PJ_SUCCESS) {
+            app_perror("   error: unable to create transaction", status);
+            rc = -210;
+            goto on_return;
+        }
+        /* Have the next transaction generate a new branch. */
+        via->branch_param.slen = 0;
+    }
+
+    if (pjsip_tsx_layer_get_tsx_count() != initial_cnt + TSX_CNT) {
+        rc = -220;
+        goto on_return;
+    }
+
+    for (i = 0; i < TSX_CNT; ++i) {
+        if (pjsip_tsx_layer_find_tsx(&tsx[i]->transaction_key,
+                                     PJ_FALSE) != tsx[i])
+        {
+            PJ_LOG(3,(THIS_FILE, "   error: transaction %d not found", i));
+            rc = -230;
+            goto on_return;
+        }
+    }
+
+on_return:
+    for (i = 0; i < TSX_CNT; ++i) {
+        if (tsx[i])
+            pjsip_tsx_terminate(tsx[i], PJSIP_SC_REQUEST_TERMINATED);
+    }
+    flush_events(500);
+
+    if (rc == 0 && pjsip_tsx_layer_get_tsx_count() != initial_cnt)
+        rc = -240;
+
+    pjsip_tx_data_dec_ref(tdata);
+    return rc;
+}
+
 int tsx_basic_test(struct tsx_test_param *param)
 {
     int status;
@@ -154,6 +227,10 @@ int tsx_basic_test(struct tsx_test_param *param)
     if (status != 0)
         return status;
 
+    status = tsx_table_grow_test();
+    if (status != 0)
+        return status;
+
     return 0;
 }
 
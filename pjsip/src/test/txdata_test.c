@@ -404,6 +404,53 @@ static int gcc_test()
 #endif
 
 
+/*
+ * Test that the pool of a destroyed tdata is reused by the same thread.
+ */
+static int tdata_pool_reuse_test(void)
+{
+    pjsip_tpmgr *tpmgr = pjsip_endpt_get_tpmgr(endpt);
+    pjsip_tpmgr_pool_stat stat0, stat1;
+    pjsip_tx_data *tdata;
+    pj_pool_t *pool;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "   tdata pool reuse test"));
+
+    status = pjsip_tx_data_create(tpmgr, &tdata);
+    if (status != PJ_SUCCESS)
+        return -300;
+    pjsip_tx_data_add_ref(tdata);
+    pool = tdata->pool;
+    pjsip_tx_data_dec_ref(tdata);
+
+    status = pjsip_tpmgr_get_pool_stat(tpmgr, &stat0);
+    if (status != PJ_SUCCESS)
+        return -310;
+
+    status = pjsip_tx_data_create(tpmgr, &tdata);
+    if (status != PJ_SUCCESS)
+        return -320;
+    pjsip_tx_data_add_ref(tdata);
+
+    status = pjsip_tpmgr_get_pool_stat(tpmgr, &stat1);
+    if (status != PJ_SUCCESS)
+        return -330;
+
+#if PJSIP_TPMGR_POOL_CACHE_SIZE
+    if (tdata->pool != pool || stat1.tdata_hit != stat0.tdata_hit + 1) {
+        PJ_LOG(3,(THIS_FILE, "   error: tdata pool is not reused"));
+        pjsip_tx_data_dec_ref(tdata);
+        return -340;
+    }
+#else
+    PJ_UNUSED_ARG(pool);
+#endif
+
+    pjsip_tx_data_dec_ref(tdata);
+    return 0;
+}
+
 /* This tests the request creating functions against the following
  * requirements:
  *  - header params in URI creates header in the request.
@@ -770,6 +817,881 @@ on_error:
 }
 
 
+/*
+ * Forwarding without cloning.
+ */
+static char fwd_req_pkt[] =
+    "INVITE sip:bob@example.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.1:5060;rport;branch=z9hG4bKabc, "
+        "SIP/2.0/TCP 10.0.0.2;branch=z9hG4bKdef\r\n"
+    "v: SIP/2.0/UDP 10.0.0.3;branch=z9hG4bKghi\r\n"
+    "Max-Forwards: 10\r\n"
+    "Route: <sip:proxy.example.com;lr>,\r\n"
+    " <sip:next.example.com;lr>\r\n"
+    "From: \"Alice, A.\" <sip:alice@example.com>;tag=1\r\n"
+    "To: <sip:bob@example.com>\r\n"
+    "Call-ID: fwd-test@10.0.0.1\r\n"
+    "CSeq: 1 INVITE\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 12\r\n"
+    "\r\n"
+    "Hello world!";
+
+static char fwd_res_pkt[] =
+    "SIP/2.0 200 OK\r\n"
+    "Via: SIP/2.0/UDP proxy.example.com;branch=z9hG4bKfwd;received=10.0.0.9,"
+        " SIP/2.0/UDP 10.0.0.1:5060;rport=5061;branch=z9hG4bKabc\r\n"
+    "From: \"Alice, A.\" <sip:alice@example.com>;tag=1\r\n"
+    "To: <sip:bob@example.com>;tag=2\r\n"
+    "Call-ID: fwd-test@10.0.0.1\r\n"
+    "CSeq: 1 INVITE\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+/* Parse the packet as if it has been received by transport */
+static pjsip_msg *fwd_parse_rdata(pj_pool_t *pool, char *pkt,
+                                  pjsip_rx_data *rdata)
+{
+    pj_bzero(rdata, sizeof(*rdata));
+    rdata->tp_info.pool = pool;
+    rdata->msg_info.msg_buf = pkt;
+    rdata->msg_info.len = (int)pj_ansi_strlen(pkt);
+    pj_list_init(&rdata->msg_info.parse_err);
+
+    if (pjsip_parse_rdata2(pkt, rdata->msg_info.len, rdata) != PJ_SUCCESS)
+        return NULL;
+
+    if (rdata->msg_info.msg->type == PJSIP_REQUEST_MSG) {
+        rdata->msg_info.via->recvd_param = pj_str("192.0.2.1");
+        rdata->msg_info.via->rport_param = 5061;
+    }
+    return rdata->msg_info.msg;
+}
+
+/* Apply the proxy edits to the received request */
+static pj_status_t fwd_edit(pjsip_fwd_data *fwd, const pjsip_uri *uri,
+                            const pjsip_hdr *rr)
+{
+    const pj_str_t H_ROUTE = { "Route", 5 };
+    pj_str_t tp_name = { "UDP", 3 };
+    pj_str_t branch = { "z9hG4bKfwd", 10 };
+    pjsip_host_port sent_by = { { "proxy.example.com", 17 }, 5070 };
+    pj_status_t status;
+
+    status = pjsip_fwd_data_set_uri(fwd, uri);
+    if (status == PJ_SUCCESS)
+        status = pjsip_fwd_data_remove_hdr(fwd, &H_ROUTE, NULL);
+    if (status == PJ_SUCCESS)
+        status = pjsip_fwd_data_insert_hdr(fwd, rr);
+    if (status == PJ_SUCCESS)
+        status = pjsip_fwd_data_dec_max_fwd(fwd);
+    if (status == PJ_SUCCESS)
+        status = pjsip_fwd_data_add_via(fwd, &tp_name, &sent_by, &branch);
+    return status;
+}
+
+/* The same edits with the cloned request */
+static pj_status_t fwd_edit_clone(pjsip_rx_data *rdata, const pjsip_uri *uri,
+                                  const pjsip_hdr *rr, pjsip_tx_data **p_tdata)
+{
+    pj_str_t branch = { "z9hG4bKfwd", 10 };
+    pjsip_tx_data *tdata;
+    pjsip_via_hdr *via;
+    pjsip_hdr *route;
+    pj_status_t status;
+
+    status = pjsip_endpt_create_request_fwd(endpt, rdata, uri, &branch, 0,
+                                            &tdata);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    route = (pjsip_hdr*) pjsip_msg_find_hdr(tdata->msg, PJSIP_H_ROUTE, NULL);
+    pj_list_erase(route);
+    pjsip_msg_insert_first_hdr(tdata->msg,
+                               (pjsip_hdr*)pjsip_hdr_clone(tdata->pool, rr));
+
+    via = (pjsip_via_hdr*) pjsip_msg_find_hdr(tdata->msg, PJSIP_H_VIA, NULL);
+    via->transport = pj_str("UDP");
+    via->sent_by.host = pj_str("proxy.example.com");
+    via->sent_by.port = 5070;
+    via->rport_param = 0;
+
+    *p_tdata = tdata;
+    return pjsip_tx_data_encode(tdata);
+}
+
+/* Compare the headers of two messages, ignoring the position of
+ * Content-Type and Content-Length.
+ */
+static int fwd_cmp_msg(const pjsip_msg *msg1, const pjsip_msg *msg2)
+{
+    const pjsip_hdr *h1, *h2;
+    char buf1[256], buf2[256];
+    int len1, len2;
+
+    if (pjsip_uri_cmp(PJSIP_URI_IN_REQ_URI, msg1->line.req.uri,
+                      msg2->line.req.uri) != 0)
+    {
+        return -1;
+    }
+
+    h1 = msg1->hdr.next;
+    h2 = msg2->hdr.next;
+    for (;;) {
+        while (h1 != &msg1->hdr && (h1->type == PJSIP_H_CONTENT_TYPE ||
+                                    h1->type == PJSIP_H_CONTENT_LENGTH))
+            h1 = h1->next;
+        while (h2 != &msg2->hdr && (h2->type == PJSIP_H_CONTENT_TYPE ||
+                                    h2->type == PJSIP_H_CONTENT_LENGTH))
+            h2 = h2->next;
+        if (h1 == &msg1->hdr || h2 == &msg2->hdr)
+            break;
+
+        len1 = pjsip_hdr_print_on((void*)h1, buf1, sizeof(buf1));
+        len2 = pjsip_hdr_print_on((void*)h2, buf2, sizeof(buf2));
+        if (len1 < 0 || len1 != len2 || pj_memcmp(buf1, buf2, len1) != 0) {
+            PJ_LOG(3,(THIS_FILE, "    error: %.*s != %.*s",
+                      len1, buf1, len2, buf2));
+            return -2;
+        }
+
+        h1 = h1->next;
+        h2 = h2->next;
+    }
+
+    if (h1 != &msg1->hdr || h2 != &msg2->hdr)
+        return -3;
+
+    if (!msg1->body || !msg2->body ||
+        msg1->body->len != msg2->body->len ||
+        pj_memcmp(msg1->body->data, msg2->body->data, msg1->body->len) != 0)
+    {
+        return -4;
+    }
+
+    return 0;
+}
+
+static int fwd_test(void)
+{
+    const pj_str_t H_RR = { "Record-Route", 12 };
+    char pkt[sizeof(fwd_req_pkt)];
+    pj_pool_t *pool;
+    pjsip_rx_data rdata;
+    pjsip_fwd_data fwd;
+    pjsip_uri *uri;
+    pjsip_hdr *rr;
+    pjsip_tx_data *tdata = NULL;
+    pjsip_msg *msg, *fwd_msg, *clone_msg;
+    pjsip_via_hdr *via;
+    pjsip_parser_err_report err_list;
+    char buf[PJSIP_MAX_PKT_LEN];
+    pj_ssize_t len;
+    pj_str_t tmp;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "   forwarding without cloning"));
+
+    pool = pjsip_endpt_create_pool(endpt, "fwd", 4000, 4000);
+    pj_list_init(&err_list);
+
+    /* Request: the result must be the same as the cloned request */
+    pj_memcpy(pkt, fwd_req_pkt, sizeof(pkt));
+    msg = fwd_parse_rdata(pool, pkt, &rdata);
+    if (!msg) {
+        rc = -500;
+        goto on_return;
+    }
+
+    tmp = pj_str("sip:bob@192.0.2.9:5062;transport=udp");
+    uri = pjsip_parse_uri(pool, tmp.ptr, tmp.slen, 0);
+    tmp = pj_str("<sip:proxy.example.com:5070;lr>");
+    rr = (pjsip_hdr*) pjsip_generic_string_hdr_create(pool, &H_RR, &tmp);
+    if (!uri || !rr) {
+        rc = -501;
+        goto on_return;
+    }
+
+    pjsip_fwd_data_init(&fwd, &rdata);
+    if (fwd_edit(&fwd, uri, rr) != PJ_SUCCESS) {
+        rc = -510;
+        goto on_return;
+    }
+
+    len = pjsip_fwd_data_print(&fwd, buf, sizeof(buf));
+    if (len < 0 || len != (pj_ssize_t)pjsip_fwd_data_get_len(&fwd)) {
+        rc = -511;
+        goto on_return;
+    }
+    if (pjsip_fwd_data_print(&fwd, buf, len-1) != -1) {
+        rc = -512;
+        goto on_return;
+    }
+
+    fwd_msg = pjsip_parse_msg(pool, buf, len, &err_list);
+    if (!fwd_msg || !pj_list_empty(&err_list)) {
+        PJ_LOG(3,(THIS_FILE, "    error: forwarded request:\n%.*s",
+                  (int)len, buf));
+        rc = -513;
+        goto on_return;
+    }
+
+    if (fwd_edit_clone(&rdata, uri, rr, &tdata) != PJ_SUCCESS) {
+        rc = -520;
+        goto on_return;
+    }
+    clone_msg = pjsip_parse_msg(pool, tdata->buf.start,
+                                tdata->buf.cur - tdata->buf.start, &err_list);
+    if (!clone_msg) {
+        rc = -521;
+        goto on_return;
+    }
+
+    rc = fwd_cmp_msg(fwd_msg, clone_msg);
+    if (rc != 0) {
+        PJ_LOG(3,(THIS_FILE, "    error: forwarded request:\n%.*s",
+                  (int)len, buf));
+        rc = -530 + rc;
+        goto on_return;
+    }
+
+    /* Overlapping edits are rejected */
+    if (pjsip_fwd_data_set_uri(&fwd, uri) != PJ_EINVAL) {
+        rc = -540;
+        goto on_return;
+    }
+
+    /* Response: only the top-most Via is removed */
+    pj_memcpy(pkt, fwd_res_pkt, sizeof(fwd_res_pkt));
+    msg = fwd_parse_rdata(pool, pkt, &rdata);
+    if (!msg) {
+        rc = -550;
+        goto on_return;
+    }
+
+    pjsip_fwd_data_init(&fwd, &rdata);
+    if (pjsip_fwd_data_remove_via(&fwd) != PJ_SUCCESS) {
+        rc = -551;
+        goto on_return;
+    }
+
+    len = pjsip_fwd_data_print(&fwd, buf, sizeof(buf));
+    fwd_msg = pjsip_parse_msg(pool, buf, len, &err_list);
+    if (!fwd_msg) {
+        rc = -552;
+        goto on_return;
+    }
+
+    via = (pjsip_via_hdr*) pjsip_msg_find_hdr(fwd_msg, PJSIP_H_VIA, NULL);
+    if (!via || via->rport_param != 5061 ||
+        pj_strcmp2(&via->branch_param, "z9hG4bKabc") != 0 ||
+        pjsip_msg_find_hdr(fwd_msg, PJSIP_H_VIA, via->next) != NULL ||
+        len != (pj_ssize_t)pj_ansi_strlen(fwd_res_pkt) - 67)
+    {
+        PJ_LOG(3,(THIS_FILE, "    error: forwarded response:\n%.*s",
+                  (int)len, buf));
+        rc = -553;
+        goto on_return;
+    }
+
+on_return:
+    if (tdata)
+        pjsip_tx_data_dec_ref(tdata);
+    pjsip_endpt_release_pool(endpt, pool);
+    return rc;
+}
+
+
+/*
+ * Forwarding without cloning to a next hop that needs to be resolved,
+ * and forwarding a response to the maddr of the Via.
+ */
+static char fwd_maddr_res_pkt[] =
+    "SIP/2.0 200 OK\r\n"
+    "Via: SIP/2.0/loop-dgram 127.0.0.1;branch=z9hG4bKfwd\r\n"
+    "Via: SIP/2.0/loop-dgram 10.0.0.1:5060;maddr=127.0.0.2;"
+        "received=10.0.0.3;rport=5061;branch=z9hG4bKabc\r\n"
+    "From: \"Alice, A.\" <sip:alice@example.com>;tag=1\r\n"
+    "To: <sip:bob@example.com>;tag=2\r\n"
+    "Call-ID: fwd-test@10.0.0.1\r\n"
+    "CSeq: 1 INVITE\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+static char fwd_rx_buf[PJSIP_MAX_PKT_LEN];
+static int fwd_rx_len;
+static char fwd_dest_name[64];
+static pj_ssize_t fwd_sent;
+
+static pj_bool_t fwd_capture(pjsip_rx_data *rdata)
+{
+    pj_str_t call_id = pj_str("fwd-test@10.0.0.1");
+
+    if (pj_strcmp(&rdata->msg_info.cid->id, &call_id) != 0)
+        return PJ_FALSE;
+
+    if (rdata->msg_info.msg->type == PJSIP_REQUEST_MSG &&
+        rdata->msg_info.len < (int)sizeof(fwd_rx_buf))
+    {
+        pj_memcpy(fwd_rx_buf, rdata->msg_info.msg_buf, rdata->msg_info.len);
+        fwd_rx_len = rdata->msg_info.len;
+    }
+    return PJ_TRUE;
+}
+
+static pjsip_module fwd_capture_mod =
+{
+    NULL, NULL,                         /* prev and next        */
+    { "Fwd-Capture", 11},               /* Name.                */
+    -1,                                 /* Id                   */
+    PJSIP_MOD_PRIORITY_APPLICATION-1,   /* Priority             */
+    NULL,                               /* load()               */
+    NULL,                               /* start()              */
+    NULL,                               /* stop()               */
+    NULL,                               /* unload()             */
+    &fwd_capture,                       /* on_rx_request()      */
+    &fwd_capture,                       /* on_rx_response()     */
+    NULL,                               /* on_tx_request()      */
+    NULL,                               /* on_tx_response()     */
+    NULL,                               /* on_tsx_state()       */
+};
+
+static void fwd_send_cb(void *token, pjsip_tx_data *tdata, pj_ssize_t sent)
+{
+    PJ_UNUSED_ARG(token);
+
+    pj_ansi_snprintf(fwd_dest_name, sizeof(fwd_dest_name), "%.*s",
+                     (int)tdata->dest_info.name.slen,
+                     tdata->dest_info.name.ptr);
+    fwd_sent = sent;
+}
+
+static int fwd_send_test(void)
+{
+    pj_str_t branch = { "z9hG4bKfwd", 10 };
+    char pkt[sizeof(fwd_req_pkt)];
+    pj_pool_t *pool;
+    pjsip_rx_data rdata;
+    pjsip_fwd_data fwd;
+    pjsip_transport *loop = NULL;
+    pjsip_uri *uri;
+    pjsip_msg *msg;
+    pjsip_via_hdr *via;
+    pjsip_parser_err_report err_list;
+    pj_sockaddr_in addr;
+    pj_str_t tmp;
+    unsigned i;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "   sending without cloning"));
+
+    pool = pjsip_endpt_create_pool(endpt, "fwdsend", 4000, 4000);
+    pj_list_init(&err_list);
+
+    if (pjsip_endpt_register_module(endpt, &fwd_capture_mod) != PJ_SUCCESS) {
+        rc = -560;
+        goto on_return;
+    }
+
+    pj_sockaddr_in_init(&addr, NULL, 0);
+    if (pjsip_endpt_acquire_transport(endpt, PJSIP_TRANSPORT_LOOP_DGRAM,
+                                      &addr, sizeof(addr), NULL,
+                                      &loop) != PJ_SUCCESS)
+    {
+        rc = -561;
+        goto on_return;
+    }
+
+    /* Request: the Via is written with the transport selected after the
+     * host name of the next hop is resolved.
+     */
+    pj_memcpy(pkt, fwd_req_pkt, sizeof(pkt));
+    if (!fwd_parse_rdata(pool, pkt, &rdata)) {
+        rc = -562;
+        goto on_return;
+    }
+
+    tmp = pj_str("sip:bob@localhost;transport=loop-dgram");
+    uri = pjsip_parse_uri(pool, tmp.ptr, tmp.slen, 0);
+    if (!uri) {
+        rc = -563;
+        goto on_return;
+    }
+
+    pjsip_fwd_data_init(&fwd, &rdata);
+    if (pjsip_fwd_data_dec_max_fwd(&fwd) != PJ_SUCCESS ||
+        pjsip_fwd_data_add_via(&fwd, NULL, NULL, &branch) != PJ_SUCCESS)
+    {
+        rc = -564;
+        goto on_return;
+    }
+
+    fwd_rx_len = 0;
+    fwd_sent = 0;
+    if (pjsip_endpt_send_fwd(endpt, &fwd, uri, NULL, NULL,
+                             &fwd_send_cb) != PJ_SUCCESS)
+    {
+        rc = -565;
+        goto on_return;
+    }
+
+    for (i=0; i<100 && !fwd_rx_len; ++i)
+        flush_events(10);
+
+    if (fwd_sent <= 0 || !fwd_rx_len) {
+        PJ_LOG(3,(THIS_FILE, "    error: request not forwarded, sent=%d",
+                  (int)fwd_sent));
+        rc = -570;
+        goto on_return;
+    }
+
+    msg = pjsip_parse_msg(pool, fwd_rx_buf, fwd_rx_len, &err_list);
+    via = msg ? (pjsip_via_hdr*) pjsip_msg_find_hdr(msg, PJSIP_H_VIA, NULL) :
+                NULL;
+    if (!via || pj_stricmp2(&via->transport, "loop-dgram") != 0 ||
+        pj_strcmp(&via->sent_by.host, &loop->local_name.host) != 0 ||
+        pj_strcmp(&via->branch_param, &branch) != 0 ||
+        !(via = (pjsip_via_hdr*)
+                pjsip_msg_find_hdr(msg, PJSIP_H_VIA, via->next)) ||
+        pj_strcmp2(&via->recvd_param, "192.0.2.1") != 0 ||
+        pj_strcmp2(&via->branch_param, "z9hG4bKabc") != 0)
+    {
+        PJ_LOG(3,(THIS_FILE, "    error: forwarded request:\n%.*s",
+                  fwd_rx_len, fwd_rx_buf));
+        rc = -571;
+        goto on_return;
+    }
+
+    /* Response: maddr of the Via takes precedence over received */
+    pj_memcpy(pkt, fwd_maddr_res_pkt, sizeof(fwd_maddr_res_pkt));
+    if (!fwd_parse_rdata(pool, pkt, &rdata)) {
+        rc = -580;
+        goto on_return;
+    }
+
+    pjsip_fwd_data_init(&fwd, &rdata);
+    if (pjsip_fwd_data_remove_via(&fwd) != PJ_SUCCESS) {
+        rc = -581;
+        goto on_return;
+    }
+
+    fwd_sent = 0;
+    if (pjsip_endpt_send_fwd(endpt, &fwd, NULL, NULL, NULL,
+                             &fwd_send_cb) != PJ_SUCCESS)
+    {
+        rc = -582;
+        goto on_return;
+    }
+
+    for (i=0; i<100 && !fwd_sent; ++i)
+        flush_events(10);
+
+    if (fwd_sent <= 0 || pj_ansi_strcmp(fwd_dest_name, "127.0.0.2") != 0) {
+        PJ_LOG(3,(THIS_FILE, "    error: response sent to %s, sent=%d",
+                  fwd_dest_name, (int)fwd_sent));
+        rc = -583;
+        goto on_return;
+    }
+
+on_return:
+    flush_events(100);
+    if (loop)
+        pjsip_transport_dec_ref(loop);
+    if (fwd_capture_mod.id != -1)
+        pjsip_endpt_unregister_module(endpt, &fwd_capture_mod);
+    pjsip_endpt_release_pool(endpt, pool);
+    return rc;
+}
+
+
+/*
+ * Request forwarding benchmark, cloning vs editing the received packet.
+ */
+static int fwd_bench(pj_bool_t clone, pj_timestamp *p_elapsed)
+{
+    const pj_str_t H_RR = { "Record-Route", 12 };
+    char pkt[sizeof(fwd_req_pkt)];
+    pj_pool_t *pool, *rx_pool;
+    pjsip_rx_data rdata;
+    pjsip_uri *uri;
+    pjsip_hdr *rr;
+    char *buf;
+    pj_str_t tmp;
+    pj_timestamp t1, t2;
+    unsigned i;
+    int rc = 0;
+
+    pool = pjsip_endpt_create_pool(endpt, "fwdbench", 4000, 4000);
+    rx_pool = pjsip_endpt_create_pool(endpt, "fwdrx", 4000, 4000);
+
+    pj_memcpy(pkt, fwd_req_pkt, sizeof(pkt));
+    tmp = pj_str("sip:bob@192.0.2.9:5062;transport=udp");
+    uri = pjsip_parse_uri(pool, tmp.ptr, tmp.slen, 0);
+    tmp = pj_str("<sip:proxy.example.com:5070;lr>");
+    rr = (pjsip_hdr*) pjsip_generic_string_hdr_create(pool, &H_RR, &tmp);
+    if (!fwd_parse_rdata(pool, pkt, &rdata)) {
+        rc = -560;
+        goto on_return;
+    }
+
+    /* Edits are allocated from the rdata pool, which is reset for every
+     * received packet.
+     */
+    rdata.tp_info.pool = rx_pool;
+
+    pj_get_timestamp(&t1);
+    for (i=0; i<LOOP; ++i) {
+        if (clone) {
+            pjsip_tx_data *tdata;
+
+            if (fwd_edit_clone(&rdata, uri, rr, &tdata) != PJ_SUCCESS) {
+                rc = -561;
+                goto on_return;
+            }
+            pjsip_tx_data_dec_ref(tdata);
+        } else {
+            pjsip_fwd_data fwd;
+            pj_size_t len;
+
+            pjsip_fwd_data_init(&fwd, &rdata);
+            if (fwd_edit(&fwd, uri, rr) != PJ_SUCCESS) {
+                rc = -562;
+                goto on_return;
+            }
+            len = pjsip_fwd_data_get_len(&fwd);
+            buf = (char*) pj_pool_alloc(rx_pool, len);
+            pjsip_fwd_data_print(&fwd, buf, len);
+        }
+        pj_pool_reset(rx_pool);
+    }
+    pj_get_timestamp(&t2);
+    pj_sub_timestamp(&t2, &t1);
+    p_elapsed->u64 = t2.u64;
+
+on_return:
+    pjsip_endpt_release_pool(endpt, rx_pool);
+    pjsip_endpt_release_pool(endpt, pool);
+    return rc;
+}
+
+
+/*
+ * Re-encoding with the header print cache must give the same result as
+ * printing the whole message.
+ */
+static int print_cache_check(pjsip_tx_data *tdata, char *buf, int size)
+{
+    pj_ssize_t len;
+
+    if (pjsip_tx_data_encode(tdata) != PJ_SUCCESS)
+        return -1;
+
+    len = pjsip_msg_print(tdata->msg, buf, size);
+    if (len < 0)
+        return -2;
+
+    if (len != tdata->buf.cur - tdata->buf.start ||
+        pj_memcmp(buf, tdata->buf.start, len) != 0)
+    {
+        PJ_LOG(3,(THIS_FILE, "    error: encoded message:\n%.*s\n"
+                  "    expected:\n%.*s",
+                  (int)(tdata->buf.cur - tdata->buf.start),
+                  tdata->buf.start, (int)len, buf));
+        return -3;
+    }
+
+    return 0;
+}
+
+static int print_cache_test(void)
+{
+    pj_str_t target = pj_str("sip:someuser@someprovider.com");
+    pj_str_t from = pj_str("\"Local User\" <sip:localuser@serviceprovider.com>");
+    pj_str_t to = pj_str("\"Remote User\" <sip:remoteuser@serviceprovider.com>");
+    pj_str_t body = pj_str("v=0\r\no=- 1 1 IN IP4 127.0.0.1\r\n");
+    pj_str_t type = pj_str("application"), subtype = pj_str("sdp");
+    pj_str_t hname = pj_str("X-Header"), hvalue = pj_str("value");
+    pjsip_tx_data *tdata;
+    pjsip_via_hdr *via;
+    pjsip_cseq_hdr *cseq;
+    pjsip_hdr *hdr;
+    char *buf;
+    pj_str_t tmp;
+    unsigned i;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "   header print cache"));
+
+    status = pjsip_endpt_create_request(endpt, &pjsip_invite_method,
+                                        &target, &from, &to, &from,
+                                        NULL, -1, NULL, &tdata);
+    if (status != PJ_SUCCESS)
+        return -600;
+
+    tdata->msg->body = pjsip_msg_body_create(tdata->pool, &type, &subtype,
+                                             &body);
+    via = pjsip_via_hdr_create(tdata->pool);
+    via->transport = pj_str("UDP");
+    via->sent_by.host = pj_str("127.0.0.1");
+    via->branch_param = pj_str("z9hG4bK0");
+    pjsip_msg_insert_first_hdr(tdata->msg, (pjsip_hdr*)via);
+    cseq = HFIND(tdata->msg, cseq, CSEQ);
+
+    buf = (char*) pj_pool_alloc(tdata->pool, PJSIP_MAX_PKT_LEN);
+
+    rc = print_cache_check(tdata, buf, PJSIP_MAX_PKT_LEN);
+    if (rc != 0) {
+        rc = -610 + rc;
+        goto on_return;
+    }
+
+    /* Modified headers, several times to use both buffers */
+    for (i=0; i<3; ++i) {
+        tmp.ptr = (char*) pj_pool_alloc(tdata->pool, 32);
+        tmp.slen = pj_ansi_snprintf(tmp.ptr, 32, "z9hG4bKbranch-%u", i);
+        via->branch_param = tmp;
+        via->sent_by.port = 5060 + i;
+        pjsip_tx_data_invalidate_hdr(tdata, via);
+
+        cseq->cseq += 1000;
+        pjsip_tx_data_invalidate_hdr(tdata, cseq);
+
+        rc = print_cache_check(tdata, buf, PJSIP_MAX_PKT_LEN);
+        if (rc != 0) {
+            rc = -620 + rc;
+            goto on_return;
+        }
+    }
+
+    /* Added header */
+    hdr = (pjsip_hdr*) pjsip_generic_string_hdr_create(tdata->pool,
+                                                       &hname, &hvalue);
+    pjsip_msg_insert_first_hdr(tdata->msg, hdr);
+    pjsip_tx_data_invalidate_hdr(tdata, hdr);
+    rc = print_cache_check(tdata, buf, PJSIP_MAX_PKT_LEN);
+    if (rc != 0) {
+        rc = -630 + rc;
+        goto on_return;
+    }
+
+    /* Removed header */
+    pj_list_erase(via);
+    pjsip_tx_data_invalidate_hdr(tdata, via);
+    rc = print_cache_check(tdata, buf, PJSIP_MAX_PKT_LEN);
+    if (rc != 0) {
+        rc = -640 + rc;
+        goto on_return;
+    }
+
+    /* Modified request line, with the whole message invalidated */
+    tdata->msg->line.req.uri = (pjsip_uri*)
+        pjsip_parse_uri(tdata->pool, "sip:other@example.com", 21, 0);
+    cseq->cseq = 1;
+    pjsip_tx_data_invalidate_msg(tdata);
+    rc = print_cache_check(tdata, buf, PJSIP_MAX_PKT_LEN);
+    if (rc != 0) {
+        rc = -650 + rc;
+        goto on_return;
+    }
+
+on_return:
+    pjsip_tx_data_dec_ref(tdata);
+    return rc;
+}
+
+
+/*
+ * Sending a request again in a dialog must only print the headers that
+ * the dialog updates.
+ */
+static pjsip_transaction *dlg_completed_tsx;
+
+static pj_bool_t dlg_user_on_rx_request(pjsip_rx_data *rdata)
+{
+    pj_str_t hname = pj_str("X-Print-Cache");
+
+    if (pjsip_msg_find_hdr_by_name(rdata->msg_info.msg, &hname, NULL)) {
+        pjsip_endpt_respond_stateless(endpt, rdata, 200, NULL, NULL, NULL);
+        return PJ_TRUE;
+    }
+    return PJ_FALSE;
+}
+
+static void dlg_user_on_tsx_state(pjsip_transaction *tsx, pjsip_event *e)
+{
+    PJ_UNUSED_ARG(e);
+
+    if (tsx->role == PJSIP_ROLE_UAC &&
+        tsx->state == PJSIP_TSX_STATE_COMPLETED)
+    {
+        dlg_completed_tsx = tsx;
+    }
+}
+
+static pjsip_module dlg_user =
+{
+    NULL, NULL,                         /* prev and next        */
+    { "Print-Cache-Dlg", 15},           /* Name.                */
+    -1,                                 /* Id                   */
+    PJSIP_MOD_PRIORITY_APPLICATION-1,   /* Priority             */
+    NULL,                               /* load()               */
+    NULL,                               /* start()              */
+    NULL,                               /* stop()               */
+    NULL,                               /* unload()             */
+    &dlg_user_on_rx_request,            /* on_rx_request()      */
+    NULL,                               /* on_rx_response()     */
+    NULL,                               /* on_tx_request()      */
+    NULL,                               /* on_tx_response()     */
+    &dlg_user_on_tsx_state,             /* on_tsx_state()       */
+};
+
+/* Send the request in the dialog and wait until it has been answered. */
+static int dlg_send_and_wait(pjsip_dialog *dlg, pjsip_tx_data *tdata)
+{
+    unsigned i;
+
+    dlg_completed_tsx = NULL;
+
+    pjsip_tx_data_add_ref(tdata);
+    if (pjsip_dlg_send_request(dlg, tdata, -1, NULL) != PJ_SUCCESS)
+        return -1;
+
+    for (i=0; i<200 && !dlg_completed_tsx; ++i)
+        flush_events(10);
+
+    if (!dlg_completed_tsx)
+        return -2;
+
+    pjsip_tsx_terminate(dlg_completed_tsx, 200);
+    return 0;
+}
+
+static int print_cache_dlg_test(void)
+{
+    pj_str_t local = pj_str("<sip:alice@127.0.0.1>");
+    pj_str_t remote = pj_str("<sip:bob@127.0.0.1;transport=loop-dgram>");
+    pj_str_t hname = pj_str("X-Print-Cache"), hvalue = pj_str("first");
+    pjsip_generic_string_hdr *xhdr;
+    pjsip_dialog *dlg = NULL;
+    pjsip_tx_data *tdata = NULL;
+    pjsip_transport *loop = NULL;
+    pjsip_via_hdr *via;
+    pj_sockaddr_in addr;
+    pj_bool_t ua_initialized = PJ_FALSE;
+    char cseq_line[32];
+    pj_str_t printed;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "   header print cache in dialog"));
+
+    if (pjsip_ua_instance()->id == -1) {
+        status = pjsip_ua_init_module(endpt, NULL);
+        if (status != PJ_SUCCESS)
+            return -700;
+        ua_initialized = PJ_TRUE;
+    }
+
+    status = pjsip_endpt_register_module(endpt, &dlg_user);
+    if (status != PJ_SUCCESS) {
+        rc = -705;
+        goto on_return;
+    }
+
+    /* Delay the loopback, so the response is not received before the
+     * transaction has left the Null state.
+     */
+    pj_sockaddr_in_init(&addr, NULL, 0);
+    status = pjsip_endpt_acquire_transport(endpt, PJSIP_TRANSPORT_LOOP_DGRAM,
+                                           &addr, sizeof(addr), NULL, &loop);
+    if (status != PJ_SUCCESS) {
+        rc = -708;
+        goto on_return;
+    }
+    pjsip_loop_set_recv_delay(loop, 10, NULL);
+
+    status = pjsip_dlg_create_uac(pjsip_ua_instance(), &local, NULL,
+                                  &remote, NULL, &dlg);
+    if (status != PJ_SUCCESS) {
+        rc = -710;
+        goto on_return;
+    }
+    pjsip_dlg_inc_session(dlg, &dlg_user);
+    pjsip_dlg_add_usage(dlg, &dlg_user, NULL);
+
+    status = pjsip_dlg_create_request(dlg, &pjsip_options_method, -1,
+                                      &tdata);
+    if (status != PJ_SUCCESS) {
+        rc = -715;
+        goto on_return;
+    }
+    xhdr = pjsip_generic_string_hdr_create(tdata->pool, &hname, &hvalue);
+    pjsip_msg_add_hdr(tdata->msg, (pjsip_hdr*)xhdr);
+
+    rc = dlg_send_and_wait(dlg, tdata);
+    if (rc != 0) {
+        rc = -720 + rc;
+        goto on_return;
+    }
+
+    if (!pj_ansi_strstr(tdata->buf.start, "X-Print-Cache: first")) {
+        rc = -730;
+        goto on_return;
+    }
+
+    /* Modify the header in place without invalidating it, so the previous
+     * text is sent if the header is not printed again. The Via branch
+     * must be cleared for a new transaction, as sip_inv.c does.
+     */
+    xhdr->hvalue = pj_str("second");
+    via = HFIND(tdata->msg, via, VIA);
+    via->branch_param.slen = 0;
+
+    rc = dlg_send_and_wait(dlg, tdata);
+    if (rc != 0) {
+        rc = -740 + rc;
+        goto on_return;
+    }
+
+    if (!pj_ansi_strstr(tdata->buf.start, "X-Print-Cache: first")) {
+        PJ_LOG(3,(THIS_FILE, "    error: unchanged header printed again:"
+                  "\n%s", tdata->buf.start));
+        rc = -750;
+        goto on_return;
+    }
+
+    /* The headers updated by the dialog must have been printed again */
+    pj_ansi_snprintf(cseq_line, sizeof(cseq_line), "CSeq: %d OPTIONS",
+                     HFIND(tdata->msg, cseq, CSEQ)->cseq);
+    printed = pj_str(tdata->buf.start);
+    if (!pj_ansi_strstr(tdata->buf.start, cseq_line) ||
+        !pj_strstr(&printed, &via->branch_param))
+    {
+        PJ_LOG(3,(THIS_FILE, "    error: updated header not printed:\n%s",
+                  tdata->buf.start));
+        rc = -760;
+        goto on_return;
+    }
+
+on_return:
+    if (tdata)
+        pjsip_tx_data_dec_ref(tdata);
+    if (dlg)
+        pjsip_dlg_dec_session(dlg, &dlg_user);
+    flush_events(100);
+    if (loop) {
+        pjsip_loop_set_recv_delay(loop, 0, NULL);
+        pjsip_transport_dec_ref(loop);
+    }
+    if (dlg_user.id != -1)
+        pjsip_endpt_unregister_module(endpt, &dlg_user);
+    if (ua_initialized)
+        pjsip_endpt_unregister_module(endpt, pjsip_ua_instance());
+    return rc;
+}
+
+
 int txdata_test(void)
 {
     enum { REPEAT = 4 };
@@ -795,6 +1717,26 @@ int txdata_test(void)
     if (status != 0)
         return status;
 
+    status = tdata_pool_reuse_test();
+    if (status != 0)
+        return status;
+
+    status = fwd_test();
+    if (status != 0)
+        return status;
+
+    status = fwd_send_test();
+    if (status != 0)
+        return status;
+
+    status = print_cache_test();
+    if (status != 0)
+        return status;
+
+    status = print_cache_dlg_test();
+    if (status != 0)
+        return status;
+
 
     /*
      * Benchmark create_request()
@@ -850,6 +1792,33 @@ int txdata_test(void)
                 "per second with <tt>pjsip_endpt_create_response()</tt>");
 
 
+    /*
+     * Benchmark request forwarding
+     */
+    PJ_LOG(3,(THIS_FILE, "   benchmarking request forwarding:"));
+    for (i=0; i<2; ++i) {
+        const char *name = i==0 ? "cloned" : "edited";
+        unsigned j;
+
+        min.u64 = PJ_UINT64(0xFFFFFFFFFFFFFFF);
+        for (j=0; j<REPEAT; ++j) {
+            status = fwd_bench(i==0, &usec[j]);
+            if (status != 0)
+                return status;
+            if (usec[j].u64 < min.u64) min.u64 = usec[j].u64;
+        }
+
+        msgs = (unsigned)(freq.u64 * LOOP / min.u64);
+        PJ_LOG(3,(THIS_FILE, "    Requests %s and printed at %d requests/sec",
+                  name, msgs));
+    }
+
+    report_ival("fwd-request-per-sec", 
+                msgs, "msg/sec",
+                "Number of typical requests that can be forwarded per "
+                "second with <tt>pjsip_fwd_data_print()</tt>");
+
+
     return 0;
 }
  